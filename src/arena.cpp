@@ -0,0 +1,74 @@
+#include "arena.h"
+#include "memory_track.h"
+#include <cstdlib>
+#include <algorithm>
+
+// with room to align the start like surface_create does
+static char* arena_block_alloc(size_t size)
+{
+	return (char*)memory_alloc(MEMORY_SCRATCH, size + ARENA_ALIGN, 0);
+}
+
+static inline char* arena_block_base(char* block)
+{
+	return (char*)(((size_t)block + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1));
+}
+
+arena_t* arena_create(size_t block_size)
+{
+	arena_t* arena = new arena_t;
+	arena->blocks.push_back(arena_block_alloc(block_size));
+	arena->sizes.push_back(block_size);
+	arena->block = 0;
+	arena->used = 0;
+	arena->total = 0;
+	arena->peak = 0;
+	return arena;
+}
+
+void arena_destory(arena_t* arena)
+{
+	if (arena == NULL) return;
+	for (size_t i = 0; i < arena->blocks.size(); i++) memory_free(arena->blocks[i]);
+	delete arena;
+}
+
+void* arena_alloc(arena_t* arena, size_t bytes)
+{
+	bytes = (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	while (arena->used + bytes > arena->sizes[arena->block])
+	{
+		arena->block++;
+		arena->used = 0;
+		if (arena->block == (int)arena->blocks.size())
+		{
+			// at least double the last block, so a growing frame needs few of them
+			size_t size = std::max(bytes, arena->sizes.back() * 2);
+			arena->blocks.push_back(arena_block_alloc(size));
+			arena->sizes.push_back(size);
+		}
+	}
+	void* p = arena_block_base(arena->blocks[arena->block]) + arena->used;
+	arena->used += bytes;
+	arena->total += bytes;
+	return p;
+}
+
+void arena_reset(arena_t* arena)
+{
+	arena->peak = std::max(arena->peak, arena->total);
+	if (arena->block > 0)
+	{
+		size_t size = 0;
+		for (size_t i = 0; i < arena->blocks.size(); i++)
+		{
+			size += arena->sizes[i];
+			memory_free(arena->blocks[i]);
+		}
+		arena->blocks.assign(1, arena_block_alloc(size));
+		arena->sizes.assign(1, size);
+	}
+	arena->block = 0;
+	arena->used = 0;
+	arena->total = 0;
+}
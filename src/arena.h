@@ -0,0 +1,47 @@
+#ifndef arena_h
+#define arena_h
+//=====================================================================
+// frame arena: a linear allocator for scratch memory that lives until
+// the next arena_reset. device_clear resets the arena of the device and
+// the sub-arenas of the tile workers, so per frame data is carved out
+// of blocks kept from the earlier frames and nothing is freed one by one.
+// only trivially destructible types belong here, no destructor runs.
+//=====================================================================
+#include <cstddef>
+#include <vector>
+#include <type_traits>
+
+#define ARENA_BLOCK (256 * 1024)   // bytes of the first block
+#define ARENA_ALIGN 16             // of every allocation, s_vector and s_matrix need it
+
+struct arena_t
+{
+	std::vector<char*> blocks;
+	std::vector<size_t> sizes;
+	int block;               // the one allocations come from
+	size_t used;             // bytes taken from blocks[block]
+	size_t total;            // bytes handed out since the reset, padding included
+	size_t peak;             // largest total of any frame
+};
+
+arena_t* arena_create(size_t block_size);
+
+void arena_destory(arena_t* arena);
+
+// bytes aligned to ARENA_ALIGN, never NULL. a full block moves on to the next one or adds a block
+void* arena_alloc(arena_t* arena, size_t bytes);
+
+// forget every allocation. the blocks of a frame that needed more than one are merged into one
+// block of their total size, so the frames after it stay in a single block
+void arena_reset(arena_t* arena);
+
+// n uninitialized T
+template <typename T>
+static inline T* arena_array(arena_t* arena, size_t n)
+{
+	static_assert(std::is_trivially_destructible<T>::value, "the arena never runs destructors");
+	static_assert(alignof(T) <= ARENA_ALIGN, "aligned beyond ARENA_ALIGN");
+	return (T*)arena_alloc(arena, n * sizeof(T));
+}
+
+#endif
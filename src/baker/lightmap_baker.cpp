@@ -0,0 +1,46 @@
+//=====================================================================
+// offline lightmap baker: loads the scene, traces the light of every
+// state on its static boxes and writes the lightmaps into one texture
+// file that the lightmaps line of the scene file names
+//   LIGHTMAP_BAKER photo/lightmaps.tex [scene file] [cell] [rays]
+// cell is the texels per side of a triangle, rays the hemisphere rays
+// of the ambient term per texel, 0 bakes it unshadowed
+//=====================================================================
+#include <cstdio>
+#include <cstdlib>
+#include "render.h"
+#include "scene.h"
+#include "lightmap.h"
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("usage: %s output.tex [scene file] [cell] [rays]\n", argv[0]);
+		return 1;
+	}
+	int cell = argc > 3 ? atoi(argv[3]) : LIGHTMAP_CELL;
+	int rays = argc > 4 ? atoi(argv[4]) : 16;
+	if (cell <= 2 * LIGHTMAP_PAD || rays < 0)
+	{
+		printf("cell must be above %d and rays at least 0\n", 2 * LIGHTMAP_PAD);
+		return 1;
+	}
+	if (argc > 2) scene_set_file(argv[2]);
+	// the frames that capture the scene are never looked at, a small device does
+	static device_t device;
+	device_init(&device, 256, 256, NULL);
+	s_vector eye, at;
+	float alpha;
+	scene_view(&device, 1, eye, at, alpha);
+	scene_load(&device);
+	bool ok = scene_bake_lightmaps(&device, argv[1], cell, rays);
+	device_destory(&device);
+	if (!ok)
+	{
+		printf("can't write %s\n", argv[1]);
+		return 1;
+	}
+	printf("%s written\n", argv[1]);
+	return 0;
+}
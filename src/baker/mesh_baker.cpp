@@ -0,0 +1,50 @@
+//=====================================================================
+// offline mesh baker: parses an obj once and writes the mesh file the
+// renderer maps at start up instead of running tinyobj. the indices of
+// every group are reordered for the vertex cache on the way
+//   MESH_BAKER model/nanosuit.obj model/nanosuit.mesh [mtl dir] [material start] [flip y]
+// the defaults of the optional arguments are the ones main.cpp uses
+//=====================================================================
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "render.h"
+#include "mesh_file.h"
+#include "mesh_optimize.h"
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		printf("usage: %s input.obj output.mesh [mtl dir] [material start] [flip y]\n", argv[0]);
+		return 1;
+	}
+	const char* mtl_dir = argc > 3 ? argv[3] : "model";
+	int start = argc > 4 ? atoi(argv[4]) : 3;
+	bool flip_y = argc > 5 ? atoi(argv[5]) != 0 : true;
+
+	std::vector<vertex_t> list;
+	std::vector<mesh_group_t> list_groups;
+	std::vector<mesh_material_t> materials;
+	if (!load_obj_mesh(list, list_groups, materials, argv[1], mtl_dir, start, flip_y)) return 1;
+
+	std::vector<vertex_t> vertices;
+	std::vector<int> indices;
+	std::vector<mesh_group_t> groups;
+	mesh_build_indexed(list.empty() ? NULL : &list[0], list_groups, vertices, indices, groups);
+	float acmr = mesh_acmr(indices.empty() ? NULL : &indices[0], (int)indices.size(), MESH_CACHE_SIZE);
+	// groups are drawn one after another, so each is ordered on its own
+	for (size_t g = 0; g < groups.size(); g++)
+		mesh_optimize_indices(&indices[groups[g].first], groups[g].count, (int)vertices.size());
+	mesh_optimize_vertex_fetch(vertices, indices);
+	printf("acmr %.3f -> %.3f with a %d vertex cache\n", acmr, mesh_acmr(indices.empty() ? NULL : &indices[0], (int)indices.size(), MESH_CACHE_SIZE), MESH_CACHE_SIZE);
+	int attributes = VERTEX_ATTR_POS | VERTEX_ATTR_TEXCOORD | VERTEX_ATTR_COLOR | VERTEX_ATTR_NORMAL | VERTEX_ATTR_TANGENT | VERTEX_ATTR_MATERIAL;
+	if (!mesh_file_write(argv[2], vertices, attributes, indices, groups, materials, start))
+	{
+		printf("can't write %s\n", argv[2]);
+		return 1;
+	}
+	printf("%s: %d triangles, %d corners welded to %d vertices, %d groups, %d materials\n", argv[2],
+		(int)indices.size() / 3, (int)list.size(), (int)vertices.size(), (int)groups.size(), (int)materials.size());
+	return 0;
+}
@@ -0,0 +1,160 @@
+//=====================================================================
+// offline texture baker: decodes images once and writes them with their
+// mip chains, in the layout the renderer samples, into one texture file
+// that mount_texture_file maps at start up
+//   TEXTURE_BAKER photo/textures.tex linear photo/container2.png ...
+// an input mesh:model/nanosuit.mesh adds every texture of the baked mesh,
+// orm:ao,roughness,metallic the packed texture of init_texture_by_orm
+// with - for a missing channel
+//=====================================================================
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "render.h"
+#include "texture.h"
+#include "texture_file.h"
+#include "mesh_file.h"
+
+static int parse_layout(const char* name)
+{
+	if (strcmp(name, "linear") == 0) return TEXTURE_LAYOUT_LINEAR;
+	if (strcmp(name, "tiled") == 0) return TEXTURE_LAYOUT_TILED4;
+	if (strcmp(name, "morton") == 0) return TEXTURE_LAYOUT_MORTON;
+	if (strcmp(name, "bc") == 0) return TEXTURE_LAYOUT_BC;
+	return -1;
+}
+
+// split "ao,roughness,metallic", - stands for a missing file
+static bool parse_orm(const char* spec, std::string files[3])
+{
+	std::string s(spec);
+	size_t a = s.find(','), b = a == std::string::npos ? a : s.find(',', a + 1);
+	if (b == std::string::npos) return false;
+	files[0] = s.substr(0, a);
+	files[1] = s.substr(a + 1, b - a - 1);
+	files[2] = s.substr(b + 1);
+	for (int i = 0; i < 3; i++) if (files[i] == "-") files[i].clear();
+	return true;
+}
+
+static const char* orm_name(const std::string& file)
+{
+	return file.empty() ? NULL : file.c_str();
+}
+
+int main(int argc, char** argv)
+{
+	int layout = argc > 2 ? parse_layout(argv[2]) : -1;
+	if (argc < 4 || layout < 0)
+	{
+		printf("usage: %s output.tex linear|tiled|morton|bc image... [mesh:file.mesh] [orm:ao,roughness,metallic]\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<std::string> paths;
+	std::vector<std::string> orms;
+	for (int i = 3; i < argc; i++)
+	{
+		if (strncmp(argv[i], "orm:", 4) == 0)
+		{
+			orms.push_back(argv[i] + 4);
+			continue;
+		}
+		if (strncmp(argv[i], "mesh:", 5) != 0)
+		{
+			paths.push_back(argv[i]);
+			continue;
+		}
+		mesh_file_t* mesh = mesh_file_open(argv[i] + 5);
+		if (mesh == NULL)
+		{
+			printf("can't open %s\n", argv[i] + 5);
+			return 1;
+		}
+		for (int k = 0; k < mesh->header->material_count; k++)
+		{
+			const mesh_material_t* m = &mesh->materials[k];
+			const char* files[3] = { m->diffuse_path, m->specular_path, m->normal_path };
+			for (int j = 0; j < 3; j++) if (files[j][0] != 0) paths.push_back(files[j]);
+		}
+		mesh_file_close(mesh);
+	}
+
+	std::vector<std::string> names;
+	std::vector<s_texture*> textures;
+	size_t bytes = 0;
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		bool seen = false;
+		for (size_t k = 0; k < names.size(); k++) seen = seen || names[k] == paths[i];
+		if (seen) continue;
+		s_texture* t = new s_texture;
+		texture_init(t);
+		if (!texture_load(t, paths[i].c_str(), layout))
+		{
+			printf("can't read %s\n", paths[i].c_str());
+			return 1;
+		}
+		names.push_back(paths[i]);
+		textures.push_back(t);
+		bytes += t->bytes;
+	}
+	for (size_t i = 0; i < orms.size(); i++)
+	{
+		std::string files[3];
+		if (!parse_orm(orms[i].c_str(), files))
+		{
+			printf("bad orm:%s, expected orm:ao,roughness,metallic\n", orms[i].c_str());
+			return 1;
+		}
+		// same order and channels as init_texture_by_orm
+		static const int order[3] = { 2, 1, 0 };
+		static const int shifts[3] = { 16, 8, 0 };
+		s_texture* orm = new s_texture;
+		texture_init(orm);
+		for (int k = 0; k < 3; k++)
+		{
+			int c = order[k];
+			if (files[c].empty()) continue;
+			s_texture image;
+			texture_init(&image);
+			if (!texture_load(&image, files[c].c_str(), TEXTURE_LAYOUT_LINEAR))
+			{
+				printf("can't read %s\n", files[c].c_str());
+				return 1;
+			}
+			texture_pack_channel(orm, &image, shifts[c], layout);
+			texture_release(&image);
+		}
+		if (orm->levels == 0)
+		{
+			printf("orm:%s has no files\n", orms[i].c_str());
+			return 1;
+		}
+		names.push_back(texture_orm_key(orm_name(files[0]), orm_name(files[1]), orm_name(files[2])));
+		textures.push_back(orm);
+		bytes += orm->bytes;
+	}
+
+	std::vector<const char*> name_list(names.size());
+	std::vector<const s_texture*> texture_list(textures.size());
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		name_list[i] = names[i].c_str();
+		texture_list[i] = textures[i];
+	}
+	if (!texture_file_write(argv[1], name_list.empty() ? NULL : &name_list[0], texture_list.empty() ? NULL : &texture_list[0], (int)names.size()))
+	{
+		printf("can't write %s\n", argv[1]);
+		return 1;
+	}
+	printf("%s: %d textures, %.1f MB of texels\n", argv[1], (int)names.size(), bytes / (1024.0 * 1024.0));
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		texture_release(textures[i]);
+		delete textures[i];
+	}
+	return 0;
+}
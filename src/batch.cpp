@@ -0,0 +1,209 @@
+#include "batch.h"
+#include "scene.h"
+#include "image_file.h"
+#include "profile.h"
+#include "job.h"
+#include "frame_pipeline.h"
+#include <chrono>
+#include <algorithm>
+
+batch_t* batch_create(device_t* source, int threads)
+{
+	batch_t* batch = new batch_t();
+	if (threads < 0) threads = (int)std::thread::hardware_concurrency();
+	if (threads < 1) threads = 1;
+	batch->source = source;
+	batch->views = NULL;
+	batch->next_view = 0;
+	batch->stream = NULL;
+	batch->written = 0;
+	batch->failed = 0;
+	batch->cached = NULL;
+	batch->unchanged = 0;
+	batch->ms = 0.0;
+	batch->frame_width = source->output_width;
+	batch->frame_height = source->output_height;
+	batch->band_written = 0;
+	batch->band_failed = 0;
+	batch->pipelined = 0;
+	// device_init is not thread safe, so the devices are made here and not by the workers
+	for (int i = 0; i < threads; i++)
+	{
+		device_t* device = new device_t();
+		device_init(device, source->output_width, source->output_height, NULL);
+		device_share_assets(device, source);
+		batch->devices.push_back(device);
+	}
+	return batch;
+}
+
+void batch_destory(batch_t* batch)
+{
+	if (batch == NULL) return;
+	for (size_t i = 0; i < batch->devices.size(); i++)
+	{
+		device_destory(batch->devices[i]);
+		delete batch->devices[i];
+	}
+	delete batch;
+}
+
+void batch_draw_scene(device_t* device, const batch_view_t& view)
+{
+	s_vector eye, at, up(0.0f, 0.0f, 1.0f, 1.0f);
+	float alpha;
+	scene_view(device, view.state, eye, at, alpha);
+	if (!view.preset)
+	{
+		s_vector e = view.eye, a = view.at;
+		eye = e;
+		at = a;
+		alpha = view.alpha;
+	}
+	if (view.m1 >= 0.0f) device->m1 = view.m1;
+	if (view.m2 >= 0.0f) device->m2 = view.m2;
+	device->camera.viewpos = eye;
+	if (device->profile != NULL) profile_frame_begin(device->profile);
+	s_vector target;
+	target.add_two(eye, at);
+	// a frame that only changes the lighting of the last one is shaded from its G-buffer
+	bool relit = device_relight_begin(device);
+	if (relit)
+	{
+		camera_at_zero(device, eye, target, up);
+		draw_box(device, alpha);
+		relit = device_relight_end(device);
+	}
+	if (!relit)
+	{
+		device_clear(device, 1);
+		camera_at_zero(device, eye, target, up);
+		draw_box(device, alpha);
+	}
+}
+
+void batch_finish(device_t* device)
+{
+	device_resolve(device);
+	device_present(device);
+	if (device->profile != NULL) profile_frame_end(device->profile);
+}
+
+void batch_draw(device_t* device, const batch_view_t& view)
+{
+	batch_draw_scene(device, view);
+	batch_finish(device);
+}
+
+void batch_set_bands(batch_t* batch, int width, int height)
+{
+	batch->frame_width = width;
+	batch->frame_height = height;
+}
+
+void batch_set_pipelined(batch_t* batch, int enable)
+{
+	batch->pipelined = enable;
+}
+
+// draw view band by band into a writer of its file, false when it can't be written
+static bool batch_draw_bands(batch_t* batch, device_t* device, const batch_view_t& view)
+{
+	int format = image_format_of(view.path.c_str());
+	image_writer_t* writer = image_writer_open(view.path.c_str(), format < 0 ? IMAGE_FORMAT_PPM : format, batch->frame_width, batch->frame_height);
+	if (writer == NULL) return false;
+	for (int y = 0; y < batch->frame_height; y += device->output_height)
+	{
+		device_set_region(device, batch->frame_width, batch->frame_height, 0, y);
+		batch_draw(device, view);
+		int rows = std::min(device->output_height, batch->frame_height - y);
+		surface_t band = surface_view(device->output, 0, 0, device->output_width, rows);
+		image_writer_rows(writer, &band);
+	}
+	return image_writer_close(writer);
+}
+
+// hash the frame of view i device presented and hand it to the stream, unless it is the cached one
+static void batch_output(batch_t* batch, device_t* device, int i)
+{
+	const std::vector<batch_view_t>& views = *batch->views;
+	unsigned long long hash = surface_hash(device->output);
+	batch->hashes[i] = hash;
+	const std::vector<unsigned long long>* cached = batch->cached;
+	if (batch->stream->type == FRAME_STREAM_IMAGES && cached != NULL && i < (int)cached->size() && (*cached)[i] == hash)
+	{
+		batch->unchanged++;
+		return;
+	}
+	int format = image_format_of(views[i].path.c_str());
+	frame_stream_push(batch->stream, i, device->output, views[i].path.c_str(), format < 0 ? IMAGE_FORMAT_PPM : format);
+}
+
+// finish stage of the frame pipelines of batch_render
+static void batch_pipeline_finish(device_t* device, int index, void* user)
+{
+	batch_finish(device);
+	batch_output((batch_t*)user, device, index);
+}
+
+// job of batch_render, draws views on device index until there are none left
+static void batch_worker(void* data, int index, int)
+{
+	batch_t* batch = (batch_t*)data;
+	const std::vector<batch_view_t>& views = *batch->views;
+	if (batch->pipelined)
+	{
+		frame_pipeline_t* fp = frame_pipeline_create(batch->devices[index * 2], batch->devices[index * 2 + 1], batch_pipeline_finish, batch);
+		for (;;)
+		{
+			int i = batch->next_view++;
+			if (i >= (int)views.size()) break;
+			batch_draw_scene(frame_pipeline_begin(fp), views[i]);
+			frame_pipeline_end(fp, i);
+		}
+		frame_pipeline_destory(fp);
+		return;
+	}
+	device_t* device = batch->devices[index];
+	for (;;)
+	{
+		int i = batch->next_view++;
+		if (i >= (int)views.size()) break;
+		if (batch->frame_height > device->output_height)
+		{
+			if (batch_draw_bands(batch, device, views[i])) batch->band_written++;
+			else batch->band_failed++;
+			continue;
+		}
+		batch_draw(device, views[i]);
+		batch_output(batch, device, i);
+	}
+}
+
+int batch_render(batch_t* batch, const std::vector<batch_view_t>& views)
+{
+	auto t0 = std::chrono::steady_clock::now();
+	batch->views = &views;
+	batch->next_view = 0;
+	batch->hashes.assign(views.size(), 0);
+	batch->unchanged = 0;
+	batch->band_written = 0;
+	batch->band_failed = 0;
+	frame_stream_t* own = NULL;
+	if (batch->stream == NULL) batch->stream = own = frame_stream_open(FRAME_STREAM_IMAGES, NULL, 0, 0, 0);
+	int written = batch->stream->written, failed = batch->stream->failed;
+	// one job per device or pair of devices, the calling thread takes the first
+	int jobs = batch->pipelined ? (int)batch->devices.size() / 2 : (int)batch->devices.size();
+	job_parallel_for(job_system(), 0, jobs, 1, batch_worker, batch);
+	frame_stream_flush(batch->stream);
+	batch->written = batch->stream->written - written + batch->band_written;
+	batch->failed = batch->stream->failed - failed + batch->band_failed;
+	if (own != NULL)
+	{
+		frame_stream_destory(own);
+		batch->stream = NULL;
+	}
+	batch->views = NULL;
+	batch->ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+	return batch->written;
+}
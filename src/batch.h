@@ -0,0 +1,88 @@
+#ifndef batch_h
+#define batch_h
+//=====================================================================
+// batch rendering of many views of one loaded scene. the scene is
+// loaded once into a source device, every job of the job system draws
+// into a device of its own that shares the source's materials and
+// textures, and hands its frames to a frame stream as soon as they
+// are done, so the disk is written by another thread. frames larger
+// than the devices are drawn in horizontal bands the size of a device,
+// each cropped out of the frame by device_set_region, and the bands go
+// to an image writer as they are done. the targets then take memory
+// for a band instead of the frame, whatever the size of the frame.
+// a pipelined batch gives every job two devices, see frame_pipeline.h,
+// and draws the next frame of a job while the last one is resolved,
+// hashed and handed to the stream.
+//
+// the frames are the same bit for bit whatever the number of workers
+// and tile threads: every tile shades its triangles in submit order on
+// one thread, blending follows the order of the draws and no sum over
+// pixels or samples is split between threads. so the hash of a frame
+// tells a render cache whether it changed since an earlier run.
+//=====================================================================
+#include "render.h"
+#include "frame_stream.h"
+#include <string>
+#include <vector>
+#include <atomic>
+
+// one frame of the job
+typedef struct
+{
+	int state;               // scene state 1..SCENE_STATES
+	int preset;              // 1 takes eye, at and alpha from scene_view
+	s_vector eye, at;        // camera_at_zero looks from eye along at
+	float alpha;             // rotation draw_box gives the objects
+	float m1, m2;            // light and material values of the state, < 0 keeps the ones of scene_view
+	std::string path;        // output file, the extension picks the format of image_write
+}batch_view_t;
+
+struct batch_t
+{
+	device_t* source;        // loaded with scene_load, owns the textures
+	std::vector<device_t*> devices;   // one per job
+	const std::vector<batch_view_t>* views;
+	std::atomic<int> next_view;
+	frame_stream_t* stream;  // takes frame i of the views as index i, NULL writes the file of every view
+	int written;
+	int failed;              // views of the last batch_render whose frame could not be written
+	std::vector<unsigned long long> hashes; // surface_hash of the output of every view of the last batch_render
+	const std::vector<unsigned long long>* cached; // hashes of earlier frames by view, NULL or 0 for none
+	std::atomic<int> unchanged;  // views of the last batch_render whose hash was the cached one, not written
+	double ms;               // wall time of the last batch_render
+	int frame_width;         // size of the frames, the devices are bands of them when it is larger, see batch_set_bands
+	int frame_height;
+	std::atomic<int> band_written, band_failed; // files of the last batch_render written band by band
+	int pipelined;           // devices 2i and 2i + 1 are the frame pipeline of job i
+};
+
+// threads devices drawn in parallel, < 0 one per hardware thread. the devices take the size and the modes of source
+batch_t* batch_create(device_t* source, int threads);
+
+void batch_destory(batch_t* batch);
+
+// frames of width x height drawn band by band, the bands are the devices as wide as the frame. they are
+// written to the files of the views as they are drawn, so no frame stream and no hashes
+void batch_set_bands(batch_t* batch, int width, int height);
+
+// draw one view into the output of device, on the calling thread
+void batch_draw(device_t* device, const batch_view_t& view);
+
+// the draws of batch_draw, up to the resolve
+void batch_draw_scene(device_t* device, const batch_view_t& view);
+
+// the rest of batch_draw: resolve and present the frame batch_draw_scene drew into device
+void batch_finish(device_t* device);
+
+// run the jobs of batch_render as frame pipelines of two devices each, the devices must be of an even
+// number and can't draw bands. the frames are the same bit for bit, but the history of temporal anti-aliasing
+// and the levels a device streams would belong to every other frame, so neither is for a pipelined batch
+void batch_set_pipelined(batch_t* batch, int enable);
+
+// draw every view on the next free worker, returns the number of frames written. the frames pushed to
+// batch->stream are written when it returns, the last ones of a y4m stream may be held back by a missing index.
+// an image file whose frame hashes to the one batch->cached has for its view is not written again, a y4m
+// stream takes every frame
+int batch_render(batch_t* batch, const std::vector<batch_view_t>& views);
+
+#endif
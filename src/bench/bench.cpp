@@ -0,0 +1,435 @@
+//=====================================================================
+// benchmark suite: micro benchmarks of the math, triangle setup,
+// texture and fragment shader kernels, and macro benchmarks that draw
+// every demo state headless at a few sizes. the results are written as
+// json so that builds can be compared
+//   SIMPLERENDER_BENCH -frames 20 -size 800 600 -size 1920 1080 -out bench.json
+// run it from src, the scene is loaded from model/ and photo/ like the
+// window does. the target is built with SIMPLERENDER_PROFILE to count
+// the triangles of an untimed frame, the profile is off while timing
+//=====================================================================
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "render.h"
+#include "rasterize.h"
+#include "scene.h"
+#include "scene_assets.h"
+#include "profile.h"
+#include "skin.h"
+
+#define BENCH_MIN_MS  100.0  // a micro benchmark repeats its batch for at least this long
+#define BENCH_ROUNDS  3      // and reports the fastest of this many rounds
+#define BENCH_SAMPLES 4096   // fragments recorded of every shader and state
+
+typedef struct
+{
+	std::string name;
+	double ns;               // per call
+	long long calls;         // of the fastest round
+}bench_micro_t;
+
+typedef struct
+{
+	int state, width, height, frames;
+	double ms;               // per frame
+	long long triangles;     // handed to the pipeline in one frame
+	long long fragments;     // shaded in one frame
+}bench_macro_t;
+
+// keeps the results of the timed loops alive
+static volatile float bench_sink;
+
+static double bench_now_ms()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// batch(n) makes n calls. n doubles until one batch takes BENCH_MIN_MS, the best ns per call of BENCH_ROUNDS such batches
+template<class F> static bench_micro_t bench_run(const char* name, F batch)
+{
+	long long n = 64;
+	for (;;)
+	{
+		double t0 = bench_now_ms();
+		batch(n);
+		if (bench_now_ms() - t0 >= BENCH_MIN_MS || n >= (1LL << 40)) break;
+		n *= 2;
+	}
+	bench_micro_t result;
+	result.name = name;
+	result.calls = n;
+	result.ns = 0.0;
+	for (int r = 0; r < BENCH_ROUNDS; r++)
+	{
+		double t0 = bench_now_ms();
+		batch(n);
+		double ns = (bench_now_ms() - t0) * 1e6 / (double)n;
+		if (r == 0 || ns < result.ns) result.ns = ns;
+	}
+	fprintf(stderr, "%-40s %10.2f ns\n", name, result.ns);
+	return result;
+}
+
+static void bench_vertex(vertex_t* v, float x, float y, float z, float u, float tv)
+{
+	*v = vertex_t();
+	v->pos.reset(x, y, z, 1.0f);
+	v->tc.u = u;
+	v->tc.v = tv;
+	v->color.r = v->color.g = v->color.b = v->color.a = 1.0f;
+	v->rhw = 1.0f;
+}
+
+static void bench_math(std::vector<bench_micro_t>& results)
+{
+	s_matrix a, b, c;
+	a.set_rotate(-1.0f, -0.5f, 1.0f, 0.7f);
+	b.set_translate(2.0f, 1.0f, -3.0f);
+	results.push_back(bench_run("s_matrix::mul_two", [&](long long n) {
+		for (long long i = 0; i < n; i++) { c.mul_two(a, b); a.m[3][0] = c.m[3][0] * 1e-6f; }
+		bench_sink = c.m[0][0];
+	}));
+	results.push_back(bench_run("s_matrix::inverse", [&](long long n) {
+		for (long long i = 0; i < n; i++) { c = a; c.m[3][1] = (float)(i & 7); c.inverse(); }
+		bench_sink = c.m[0][0];
+	}));
+	s_vector v(0.3f, -1.2f, 2.5f, 1.0f), y;
+	results.push_back(bench_run("apply_to_vector", [&](long long n) {
+		for (long long i = 0; i < n; i++) { apply_to_vector(y, v, a); v.x = y.x * 1e-6f + 0.3f; }
+		bench_sink = y.x;
+	}));
+	results.push_back(bench_run("s_vector::normalize", [&](long long n) {
+		for (long long i = 0; i < n; i++) { y.reset(v.x + (float)(i & 15), v.y, v.z, 1.0f); y.normalize(); }
+		bench_sink = y.x;
+	}));
+}
+
+// a 64 x 64 grid bent by 16 joints along x, every vertex between two of them, with a morph target at half weight
+static void bench_skin(std::vector<bench_micro_t>& results)
+{
+	const int side = 64, joints = 16;
+	std::vector<vertex_t> vertices(side * side);
+	std::vector<skin_weights_t> weights(side * side);
+	std::vector<s_vector> offsets(side * side, s_vector(0.0f, 0.0f, 0.1f, 0.0f));
+	for (int y = 0; y < side; y++)
+	{
+		for (int x = 0; x < side; x++)
+		{
+			int i = y * side + x;
+			bench_vertex(&vertices[i], (float)x / side, (float)y / side, 0.0f, (float)x / side, (float)y / side);
+			vertices[i].normal.reset(0.0f, 0.0f, 1.0f, 0.0f);
+			vertices[i].tangent.reset(1.0f, 0.0f, 0.0f, 1.0f);
+			float f = (float)x * (joints - 1) / side;
+			int j = (int)f;
+			skin_weights_t& w = weights[i];
+			w.joint[0] = (unsigned char)j; w.joint[1] = (unsigned char)(j + 1); w.joint[2] = w.joint[3] = 0;
+			w.weight[0] = 1.0f - (f - (float)j); w.weight[1] = f - (float)j; w.weight[2] = w.weight[3] = 0.0f;
+		}
+	}
+	std::vector<int> indices;
+	for (int y = 0; y + 1 < side; y++)
+	{
+		for (int x = 0; x + 1 < side; x++)
+		{
+			int i = y * side + x;
+			int quad[6] = { i, i + 1, i + side, i + 1, i + side + 1, i + side };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+	mesh_group_t group;
+	group.first = 0;
+	group.count = (int)indices.size();
+	group.material_idex = 0;
+	std::vector<s_matrix> bind(joints), pose(joints);
+	for (int j = 0; j < joints; j++)
+	{
+		bind[j].set_translate(-(float)j / joints, 0.0f, 0.0f);
+		pose[j].set_rotate(0.0f, 1.0f, 0.0f, 0.05f * (float)j);
+	}
+	skin_t* skin = skin_create(&vertices[0], side * side, &weights[0], &bind[0], joints, &indices[0], &group, 1);
+	int morph = skin_add_morph(skin, &offsets[0], NULL);
+	skin_set_morph(skin, morph, 0.5f);
+	results.push_back(bench_run("skin_update 4096 vertices", [&](long long n) {
+		for (long long i = 0; i < n; i++) { pose[0].m[3][0] = (float)(i & 7) * 0.01f; skin_set_pose(skin, &pose[0]); skin_update(skin); }
+		bench_sink = skin->pos[skin->current][0].x;
+	}));
+	skin_destory(skin);
+}
+
+static void bench_setup(std::vector<bench_micro_t>& results)
+{
+	vertex_t p[3];
+	bench_vertex(&p[0], 120.5f, 40.25f, 0.5f, 0.0f, 0.0f);
+	bench_vertex(&p[1], 30.75f, 300.5f, 0.4f, 0.0f, 1.0f);
+	bench_vertex(&p[2], 410.0f, 220.5f, 0.6f, 1.0f, 1.0f);
+	trapezoid_t trap[2];
+	results.push_back(bench_run("trapezoid_init_triangle", [&](long long n) {
+		int count = 0;
+		for (long long i = 0; i < n; i++) { p[0].pos.x = 120.5f + (float)(i & 31); count += trapezoid_init_triangle(trap, &p[0], &p[1], &p[2]); }
+		bench_sink = (float)count + trap[0].top;
+	}));
+	s_vector p0(0.0f, 0.0f, 0.0f, 1.0f), p1(1.0f, 0.0f, 0.2f, 1.0f), p2(0.0f, 1.0f, 0.4f, 1.0f), pos(0.25f, 0.25f, 0.15f, 1.0f), w;
+	results.push_back(bench_run("computeBarycentric3D", [&](long long n) {
+		float sum = 0.0f;
+		for (long long i = 0; i < n; i++) { pos.x = 0.25f + (float)(i & 15) * 0.01f; computeBarycentric3D(w, p0, p1, p2, pos); sum += w.x; }
+		bench_sink = sum;
+	}));
+}
+
+static void bench_texture(std::vector<bench_micro_t>& results, device_t* device)
+{
+	const s_texture* texture = &device->assets->material[1].diffuse_texture;
+	if (texture->levels == 0)
+	{
+		fprintf(stderr, "read_the_texture: material 1 has no diffuse texture, skipped\n");
+		return;
+	}
+	s_vector texel;
+	// texture coordinates from a linear congruential walk, so the reads are not all in cache
+	results.push_back(bench_run("read_the_texture", [&](long long n) {
+		unsigned int seed = 12345;
+		float sum = 0.0f;
+		for (long long i = 0; i < n; i++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			float u = (float)(seed >> 16) / 65536.0f, v = (float)(seed & 0xffff) / 65536.0f;
+			read_the_texture(texel, texture, u, v);
+			sum += texel.x;
+		}
+		bench_sink = sum;
+	}));
+}
+
+// fragments f_shader saw while a state was drawn, with the builtin pipeline that shaded them
+typedef struct
+{
+	for_fs ff;
+	int count;
+	const pipeline_t* pipeline;
+}bench_fragment_t;
+
+static std::vector<bench_fragment_t> bench_fragments;
+static int bench_kept[SHADER_COUNT];
+
+// bound while the recorded frame is drawn: keeps up to BENCH_SAMPLES fragments of every builtin pipeline
+static void bench_record(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co)
+{
+	const pipeline_t* bound = device->pipeline;
+	device->pipeline = NULL;
+	const pipeline_t* pipeline = device_pipeline(device, count);
+	device->pipeline = bound;
+	if (pipeline->id < SHADER_COUNT && bench_kept[pipeline->id] < BENCH_SAMPLES)
+	{
+		bench_kept[pipeline->id]++;
+		bench_fragment_t fragment;
+		fragment.ff = *ff;
+		// the instance is in the frame arena, the replay shades with device->PBR
+		fragment.ff.instance = NULL;
+		fragment.count = count;
+		fragment.pipeline = pipeline;
+		bench_fragments.push_back(fragment);
+	}
+	pipeline->fragment(device, ff, color, count, is_ban, ori_co);
+}
+
+static const pipeline_t bench_recorder = { SHADER_CUSTOM, "bench recorder", v_shader, bench_record };
+
+// the scene_view camera of state, as batch_draw sets it
+static void bench_view(device_t* device, int state, float& alpha)
+{
+	s_vector eye, at, up(0.0f, 0.0f, 1.0f, 1.0f);
+	scene_view(device, state, eye, at, alpha);
+	device->camera.viewpos = eye;
+	s_vector target;
+	target.add_two(eye, at);
+	camera_at_zero(device, eye, target, up);
+}
+
+static void bench_draw(device_t* device, float alpha)
+{
+	device_clear(device, 1);
+	draw_box(device, alpha);
+	device_resolve(device);
+	device_present(device);
+}
+
+// every builtin f_shader branch on the fragments one frame of each state produced
+static void bench_shaders(std::vector<bench_micro_t>& results, device_t* device)
+{
+	for (int state = 1; state <= SCENE_STATES; state++)
+	{
+		float alpha;
+		bench_view(device, state, alpha);
+		bench_fragments.clear();
+		memset(bench_kept, 0, sizeof(bench_kept));
+		device_bind_pipeline(device, &bench_recorder);
+		// the light lists and the shadow map the fragments point at stay valid until the next clear
+		device_clear(device, 1);
+		draw_box(device, alpha);
+		device_resolve(device);
+		device_bind_pipeline(device, NULL);
+		for (int id = 0; id < SHADER_COUNT; id++)
+		{
+			const pipeline_t* pipeline = pipeline_builtin(id);
+			std::vector<bench_fragment_t> samples;
+			for (size_t i = 0; i < bench_fragments.size(); i++) if (bench_fragments[i].pipeline == pipeline) samples.push_back(bench_fragments[i]);
+			if (id == SHADER_NONE || samples.empty()) continue;
+			char name[128];
+			snprintf(name, sizeof(name), "f_shader %s, state %d", pipeline->name, state);
+			s_vector destination(0.5f, 0.5f, 0.5f, 1.0f);
+			results.push_back(bench_run(name, [&](long long n) {
+				s_color color;
+				float sum = 0.0f;
+				for (long long i = 0; i < n; i++)
+				{
+					bench_fragment_t& f = samples[(size_t)(i % (long long)samples.size())];
+					bool ban = 0;
+					pipeline->fragment(device, &f.ff, color, f.count, ban, destination);
+					sum += color.r;
+				}
+				bench_sink = sum;
+			}));
+		}
+	}
+	bench_fragments.clear();
+}
+
+static bench_macro_t bench_state(device_t* source, int state, int width, int height, int frames)
+{
+	device_t* device = new device_t();
+	device_init(device, width, height, NULL);
+	device_share_assets(device, source);
+	float alpha;
+	bench_view(device, state, alpha);
+	// the first frame warms the caches and counts the work of one frame
+	device_set_profile(device, 1);
+	if (device->profile != NULL) profile_frame_begin(device->profile);
+	bench_draw(device, alpha);
+	bench_macro_t result;
+	result.state = state;
+	result.width = width;
+	result.height = height;
+	result.frames = frames;
+	result.triangles = device->profile != NULL ? (long long)device->profile->counters[PROFILE_TRIANGLES_IN] : 0;
+	result.fragments = device->profile != NULL ? (long long)device->profile->counters[PROFILE_FRAGMENTS_SHADED] : 0;
+	device_set_profile(device, 0);
+	double t0 = bench_now_ms();
+	for (int f = 0; f < frames; f++) bench_draw(device, alpha);
+	result.ms = (bench_now_ms() - t0) / frames;
+	device_destory(device);
+	delete device;
+	fprintf(stderr, "state %d %4dx%-4d %9.2f ms %8lld triangles\n", state, width, height, result.ms, result.triangles);
+	return result;
+}
+
+static void bench_json(FILE* fp, const std::vector<bench_micro_t>& micro, const std::vector<bench_macro_t>& macro)
+{
+	fprintf(fp, "{\n  \"micro\": [");
+	for (size_t i = 0; i < micro.size(); i++)
+	{
+		fprintf(fp, "%s\n    { \"name\": \"%s\", \"ns\": %.3f, \"calls\": %lld }", i > 0 ? "," : "",
+			micro[i].name.c_str(), micro[i].ns, micro[i].calls);
+	}
+	fprintf(fp, "\n  ],\n  \"macro\": [");
+	for (size_t i = 0; i < macro.size(); i++)
+	{
+		const bench_macro_t& m = macro[i];
+		double seconds = m.ms * 1e-3;
+		fprintf(fp, "%s\n    { \"state\": %d, \"width\": %d, \"height\": %d, \"frames\": %d, \"ms_per_frame\": %.3f, "
+			"\"triangles\": %lld, \"fragments\": %lld, \"mtri_per_s\": %.3f, \"mpix_per_s\": %.3f }", i > 0 ? "," : "",
+			m.state, m.width, m.height, m.frames, m.ms, m.triangles, m.fragments,
+			seconds > 0.0 ? (double)m.triangles / seconds * 1e-6 : 0.0,
+			seconds > 0.0 ? (double)m.width * m.height / seconds * 1e-6 : 0.0);
+	}
+	fprintf(fp, "\n  ]\n}\n");
+}
+
+static void usage(const char* name)
+{
+	printf("usage: %s [options]\n", name);
+	printf("  -size W H           a size of the macro benchmarks, may be repeated. 320 240, 800 600 and 1920 1080\n");
+	printf("  -state N            only state 1..%d in the macro benchmarks, 0 for all of them (default)\n", SCENE_STATES);
+	printf("  -frames N           timed frames of every state and size, 10\n");
+	printf("  -micro              only the micro benchmarks\n");
+	printf("  -macro              only the macro benchmarks\n");
+	printf("  -out FILE           write the json to FILE instead of stdout\n");
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<int> sizes;
+	int frames = 10, state = 0, micro = 1, macro = 1;
+	const char* out = NULL;
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		bool has1 = i + 1 < argc, has2 = i + 2 < argc;
+		if (strcmp(arg, "-size") == 0 && has2) { sizes.push_back(atoi(argv[i + 1])); sizes.push_back(atoi(argv[i + 2])); i += 2; }
+		else if (strcmp(arg, "-state") == 0 && has1) state = atoi(argv[++i]);
+		else if (strcmp(arg, "-frames") == 0 && has1) frames = atoi(argv[++i]);
+		else if (strcmp(arg, "-micro") == 0) macro = 0;
+		else if (strcmp(arg, "-macro") == 0) micro = 0;
+		else if (strcmp(arg, "-out") == 0 && has1) out = argv[++i];
+		else { usage(argv[0]); return 1; }
+	}
+	if (frames < 1 || state < 0 || state > SCENE_STATES)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	if (sizes.empty())
+	{
+		int defaults[] = { 320, 240, 800, 600, 1920, 1080 };
+		sizes.assign(defaults, defaults + 6);
+	}
+	if (!PROFILE_ENABLED) fprintf(stderr, "built without SIMPLERENDER_PROFILE, the triangle counts are 0\n");
+
+	// the scene is loaded once, the macro devices share its assets like the batch workers do
+	static device_t device;
+	device_init(&device, 800, 600, NULL);
+	device_set_texture_filter(&device, TEXTURE_FILTER_TRILINEAR);
+	device.raster_mode = RASTER_MODE_SCANLINE;
+	s_vector eye, at;
+	float alpha;
+	scene_view(&device, 1, eye, at, alpha);
+	scene_load(&device);
+	device.render_state = RENDER_STATE_TEXTURE;
+
+	std::vector<bench_micro_t> micro_results;
+	std::vector<bench_macro_t> macro_results;
+	if (micro)
+	{
+		bench_math(micro_results);
+		bench_setup(micro_results);
+		bench_skin(micro_results);
+		bench_texture(micro_results, &device);
+		bench_shaders(micro_results, &device);
+	}
+	if (macro)
+	{
+		for (size_t i = 0; i + 1 < sizes.size(); i += 2)
+		{
+			for (int s = 1; s <= SCENE_STATES; s++)
+			{
+				if (state != 0 && s != state) continue;
+				macro_results.push_back(bench_state(&device, s, sizes[i], sizes[i + 1], frames));
+			}
+		}
+	}
+
+	FILE* fp = out != NULL ? fopen(out, "w") : stdout;
+	if (fp == NULL)
+	{
+		printf("can't write %s\n", out);
+		device_destory(&device);
+		return 1;
+	}
+	bench_json(fp, micro_results, macro_results);
+	if (fp != stdout) fclose(fp);
+	device_destory(&device);
+	return 0;
+}
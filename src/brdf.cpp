@@ -0,0 +1,74 @@
+#include "brdf.h"
+#include "render.h"
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+
+typedef struct
+{
+	double max_abs, max_rel, sum_rel;
+	int samples;
+}brdf_error_t;
+
+static void brdf_error_add(brdf_error_t* e, float fast, float exact)
+{
+	double abs_error = fabs((double)fast - exact);
+	double rel_error = abs_error / (fabs((double)exact) > 1e-6 ? fabs((double)exact) : 1e-6);
+	if (abs_error > e->max_abs) e->max_abs = abs_error;
+	if (rel_error > e->max_rel) e->max_rel = rel_error;
+	e->sum_rel += rel_error;
+	e->samples++;
+}
+
+static void brdf_error_print(const char* name, const brdf_error_t* e)
+{
+	printf("brdf %-10s max abs %.3g  max rel %.3g  mean rel %.3g  (%d samples)\n", name, e->max_abs, e->max_rel, e->sum_rel / e->samples, e->samples);
+}
+
+void brdf_report()
+{
+	brdf_error_t ndf = {}, geometry = {}, fresnel = {};
+	s_vector N(0.0f, 0.0f, 1.0f, 1.0f);
+	for (int j = 0; j < 97; j++)
+	{
+		float roughness = 0.05f + 0.95f * (j + 0.37f) / 97.0f;
+		for (int i = 0; i < 1009; i++)
+		{
+			float c = (i + 0.5f) / 1009.0f;
+			// NdotH crowded towards 1, where the lobe of a smooth surface is
+			float NdotH = 1.0f - c * c * c * c;
+			float s = sqrtf(1.0f - NdotH * NdotH);
+			s_vector H(s, 0.0f, NdotH, 1.0f);
+			s_vector V(sqrtf(1.0f - c * c), 0.0f, c, 1.0f), L(0.0f, s, NdotH, 1.0f);
+			brdf_error_add(&ndf, brdf_ndf(NdotH, roughness), DistributionGGX(N, H, roughness));
+			brdf_error_add(&geometry, brdf_geometry(c, NdotH, roughness), GeometrySmith(N, V, L, roughness));
+		}
+	}
+	for (int i = 0; i <= 1000; i++)
+	{
+		float x = i / 1000.0f;
+		brdf_error_add(&fresnel, brdf_pow5(x), powf(x, 5.0f));
+	}
+	brdf_error_print("ndf", &ndf);
+	brdf_error_print("geometry", &geometry);
+	brdf_error_print("pow5", &fresnel);
+
+	// D * G * F of one light, the way the shaders call them
+	const int calls = 1 << 20;
+	float sink = 0.0f;
+	double ns[2];
+	for (int mode = 0; mode < 2; mode++)
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		for (int i = 0; i < calls; i++)
+		{
+			float c = (float)(i & 1023) / 1024.0f, roughness = 0.05f + (float)(i >> 10) / 1100.0f;
+			float s = sqrtf(1.0f - c * c);
+			s_vector H(s, 0.0f, c, 1.0f), V(0.0f, s, c, 1.0f);
+			if (mode == 0) sink += DistributionGGX(N, H, roughness) * GeometrySmith(N, V, H, roughness) * powf(1.0f - c, 5.0f);
+			else sink += brdf_ndf(N.dotproduct(H), roughness) * brdf_geometry(N.dotproduct(V), N.dotproduct(H), roughness) * brdf_pow5(1.0f - c);
+		}
+		ns[mode] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / calls;
+	}
+	printf("brdf exact %.1f ns, fast %.1f ns per light (%g)\n", ns[0], ns[1], sink > 0.0f ? 1.0 : 0.0);
+}
@@ -0,0 +1,40 @@
+#ifndef brdf_h
+#define brdf_h
+//=====================================================================
+// the cook torrance terms of BRDF_MODE_FAST: the GGX distribution,
+// the smith geometry over one divide and the pow(x, 5) of fresnel as
+// products, all in single precision. brdf_report measures them against
+// DistributionGGX, GeometrySmith and fresnelSchlick.
+//=====================================================================
+#include <cmath>
+
+#define BRDF_PI 3.14159265f
+
+// DistributionGGX
+inline float brdf_ndf(float NdotH, float roughness)
+{
+	float a = roughness * roughness;
+	float a2 = a * a;
+	float d = NdotH * NdotH * (a2 - 1.0f) + 1.0f;
+	return a2 / (BRDF_PI * d * d);
+}
+
+// GeometrySmith, both GeometrySchlickGGX terms share the divide
+inline float brdf_geometry(float NdotV, float NdotL, float roughness)
+{
+	float r = roughness + 1.0f;
+	float k = r * r * 0.125f;
+	return NdotV * NdotL / ((NdotV * (1.0f - k) + k) * (NdotL * (1.0f - k) + k));
+}
+
+// the pow(x, 5) of fresnelSchlick
+inline float brdf_pow5(float x)
+{
+	float x2 = x * x;
+	return x2 * x2 * x;
+}
+
+// print the largest and the mean error of every term against the exact functions, and their cost
+void brdf_report();
+
+#endif
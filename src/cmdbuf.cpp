@@ -0,0 +1,158 @@
+#include "cmdbuf.h"
+#include "job.h"
+
+cmdbuf_t* cmdbuf_create()
+{
+	cmdbuf_t* cb = new cmdbuf_t;
+	cb->executed = 0;
+	return cb;
+}
+
+void cmdbuf_destory(cmdbuf_t* cb)
+{
+	delete cb;
+}
+
+void cmdbuf_reset(cmdbuf_t* cb)
+{
+	cb->commands.clear();
+	cb->matrices.clear();
+	cb->pbrs.clear();
+	cb->lights.clear();
+	cb->calls.clear();
+}
+
+static void cmdbuf_push(cmdbuf_t* cb, int op, int index, int num, int count, const void* data)
+{
+	cmd_t cmd;
+	cmd.op = op;
+	cmd.index = index;
+	cmd.num = num;
+	cmd.count = count;
+	cmd.data = data;
+	cb->commands.push_back(cmd);
+}
+
+void cmdbuf_set_world(cmdbuf_t* cb, const s_matrix& world)
+{
+	cmdbuf_push(cb, CMD_WORLD, (int)cb->matrices.size(), 0, 0, NULL);
+	cb->matrices.push_back(world);
+}
+
+void cmdbuf_set_pbr(cmdbuf_t* cb, const s_PBR& pbr)
+{
+	cmdbuf_push(cb, CMD_PBR, (int)cb->pbrs.size(), 0, 0, NULL);
+	cb->pbrs.push_back(pbr);
+}
+
+void cmdbuf_bind_pipeline(cmdbuf_t* cb, const pipeline_t* pipeline)
+{
+	cmdbuf_push(cb, CMD_PIPELINE, 0, 0, 0, pipeline);
+}
+
+void cmdbuf_set_light(cmdbuf_t* cb, int index, const s_vector& pos, const s_vector& color, const s_vector* terms)
+{
+	point_light light = point_light();
+	light.lightpos = pos;
+	light.lightcolor = color;
+	if (terms != NULL)
+	{
+		light.ambient = terms[0];
+		light.diffuse = terms[1];
+		light.specular = terms[2];
+	}
+	cmdbuf_push(cb, CMD_LIGHT, (int)cb->lights.size(), index, terms != NULL, NULL);
+	cb->lights.push_back(light);
+}
+
+void cmdbuf_set_shadow_map(cmdbuf_t* cb, shadow_map_t* map)
+{
+	cmdbuf_push(cb, CMD_SHADOW, 0, 0, 0, map);
+}
+
+void cmdbuf_draw_plane(cmdbuf_t* cb, const vertex_t* mesh, int num, int count)
+{
+	cmdbuf_push(cb, CMD_DRAW_PLANE, 0, num, count, mesh);
+}
+
+void cmdbuf_draw_plane_transparent(cmdbuf_t* cb, const vertex_t* mesh, int num, int count)
+{
+	cmdbuf_push(cb, CMD_DRAW_TRANSPARENT, 0, num, count, mesh);
+}
+
+void cmdbuf_call(cmdbuf_t* cb, cmd_call_t fn, void* user, const s_matrix* matrices, int count)
+{
+	cmdbuf_push(cb, CMD_CALL, (int)cb->calls.size(), (int)cb->matrices.size(), count, user);
+	cb->calls.push_back(fn);
+	cb->matrices.insert(cb->matrices.end(), matrices, matrices + count);
+}
+
+void cmdbuf_replay(cmdbuf_t* cb, const cmdbuf_t* source)
+{
+	cmdbuf_push(cb, CMD_REPLAY, 0, 0, 0, source);
+}
+
+// the commands of cb, returns how many ran with those of the replayed buffers
+static long long cmdbuf_run(device_t* device, const cmdbuf_t* cb)
+{
+	long long executed = 0;
+	for (size_t i = 0; i < cb->commands.size(); i++)
+	{
+		const cmd_t& cmd = cb->commands[i];
+		executed++;
+		switch (cmd.op)
+		{
+		case CMD_WORLD:
+			device->transform.world = cb->matrices[cmd.index];
+			device->transform.update();
+			break;
+		case CMD_PBR: device->PBR = cb->pbrs[cmd.index]; break;
+		case CMD_PIPELINE: device_bind_pipeline(device, (const pipeline_t*)cmd.data); break;
+		case CMD_LIGHT:
+		{
+			point_light light = cb->lights[cmd.index];
+			if (cmd.count) device_set_pointlight(device, light.lightpos, light.lightcolor, light.ambient, light.diffuse, light.specular, cmd.num);
+			else device_set_pointlight(device, light.lightpos, light.lightcolor, cmd.num);
+			break;
+		}
+		case CMD_SHADOW: device_set_shadow_map(device, (shadow_map_t*)cmd.data); break;
+		case CMD_DRAW_PLANE: draw_plane(device, cmd.num, (vertex_t*)cmd.data, cmd.count); break;
+		case CMD_DRAW_TRANSPARENT: draw_plane_transparent(device, cmd.num, (vertex_t*)cmd.data, cmd.count); break;
+		case CMD_CALL: cb->calls[cmd.index](device, (void*)cmd.data, cmd.count > 0 ? &cb->matrices[cmd.num] : NULL, cmd.count); break;
+		case CMD_REPLAY: executed += cmdbuf_run(device, (const cmdbuf_t*)cmd.data); break;
+		}
+	}
+	return executed;
+}
+
+void cmdbuf_execute(device_t* device, cmdbuf_t* cb)
+{
+	cb->executed += cmdbuf_run(device, cb);
+}
+
+typedef struct
+{
+	cmdbuf_t** buffers;
+	cmdbuf_record_t fn;
+	void* data;
+}cmdbuf_recording_t;
+
+// job of cmdbuf_record_parallel, the buffers [begin, end)
+static void cmdbuf_record_job(void* data, int begin, int end)
+{
+	cmdbuf_recording_t* recording = (cmdbuf_recording_t*)data;
+	for (int i = begin; i < end; i++)
+	{
+		cmdbuf_reset(recording->buffers[i]);
+		recording->fn(recording->buffers[i], i, recording->data);
+	}
+}
+
+void cmdbuf_record_parallel(cmdbuf_t** buffers, int count, cmdbuf_record_t fn, void* data)
+{
+	cmdbuf_recording_t recording;
+	recording.buffers = buffers;
+	recording.fn = fn;
+	recording.data = data;
+	job_parallel_for(job_system(), 0, count, 1, cmdbuf_record_job, &recording);
+}
@@ -0,0 +1,85 @@
+#ifndef cmdbuf_h
+#define cmdbuf_h
+//=====================================================================
+// command buffers: draws, state binds and constants recorded into
+// compact arrays and executed on a device later, in recording order.
+// recording never touches a device, so several threads may record
+// buffers of their own at the same time, see cmdbuf_record_parallel,
+// and the thread owning the device executes them one after another.
+// executing leaves the buffer as it is: what doesn't change between
+// frames is recorded once and replayed, also from inside the buffer
+// of a frame with cmdbuf_replay.
+//=====================================================================
+#include "render.h"
+#include <vector>
+
+#define CMD_WORLD             0   // device->transform.world = matrices[index]
+#define CMD_PBR               1   // device->PBR = pbrs[index]
+#define CMD_PIPELINE          2   // device_bind_pipeline(data), NULL unbinds
+#define CMD_LIGHT             3   // pointlight[num] = lights[index], count: with the ambient, diffuse and specular terms
+#define CMD_SHADOW            4   // device_set_shadow_map(data)
+#define CMD_DRAW_PLANE        5   // draw_plane(num vertices of data, material count)
+#define CMD_DRAW_TRANSPARENT  6   // draw_plane_transparent(num vertices of data, material count)
+#define CMD_CALL              7   // calls[index](device, data, matrices + num, count)
+#define CMD_REPLAY            8   // the commands of the cmdbuf_t data
+
+// what the draws and binds of the buffer's recorder can't express, run when the command is executed with the
+// matrices recorded with it, so a buffer replayed later runs with the values of its recording
+typedef void (*cmd_call_t)(device_t* device, void* user, const s_matrix* matrices, int count);
+
+typedef struct
+{
+	int op;                  // CMD_*
+	int index;               // into the constants of the buffer
+	int num, count;
+	const void* data;        // mesh, pipeline, shadow map, user or buffer, not owned
+}cmd_t;
+
+struct cmdbuf_t
+{
+	std::vector<cmd_t> commands;
+	std::vector<s_matrix> matrices;
+	std::vector<s_PBR> pbrs;
+	std::vector<point_light> lights;
+	std::vector<cmd_call_t> calls;
+	long long executed;      // commands run by cmdbuf_execute, the replayed ones included
+};
+
+cmdbuf_t* cmdbuf_create();
+
+void cmdbuf_destory(cmdbuf_t* cb);
+
+// forget the commands, the arrays keep their memory for the next recording
+void cmdbuf_reset(cmdbuf_t* cb);
+
+void cmdbuf_set_world(cmdbuf_t* cb, const s_matrix& world);
+void cmdbuf_set_pbr(cmdbuf_t* cb, const s_PBR& pbr);
+void cmdbuf_bind_pipeline(cmdbuf_t* cb, const pipeline_t* pipeline);
+
+// light index of device->pointlight at pos with color. terms are its ambient, diffuse and specular colors,
+// NULL keeps the ones the device has when the command runs, like device_set_pointlight
+void cmdbuf_set_light(cmdbuf_t* cb, int index, const s_vector& pos, const s_vector& color, const s_vector* terms);
+
+void cmdbuf_set_shadow_map(cmdbuf_t* cb, shadow_map_t* map);
+
+// mesh must live until the last execution of the buffer
+void cmdbuf_draw_plane(cmdbuf_t* cb, const vertex_t* mesh, int num, int count);
+void cmdbuf_draw_plane_transparent(cmdbuf_t* cb, const vertex_t* mesh, int num, int count);
+
+// matrices[0, count) are copied into the buffer, count may be 0
+void cmdbuf_call(cmdbuf_t* cb, cmd_call_t fn, void* user, const s_matrix* matrices, int count);
+
+// the commands source has when cb is executed, so a static buffer recorded once is shared by the frames
+void cmdbuf_replay(cmdbuf_t* cb, const cmdbuf_t* source);
+
+// run the commands of cb on device in recording order
+void cmdbuf_execute(device_t* device, cmdbuf_t* cb);
+
+// fills the buffer index of a cmdbuf_record_parallel, on a thread of the job system
+typedef void (*cmdbuf_record_t)(cmdbuf_t* cb, int index, void* data);
+
+// reset buffers[0, count) and record them at the same time with fn, one job per buffer. returns when all
+// of them are recorded
+void cmdbuf_record_parallel(cmdbuf_t** buffers, int count, cmdbuf_record_t fn, void* data);
+
+#endif
@@ -0,0 +1,61 @@
+#include "coarse.h"
+#include <cmath>
+#include <algorithm>
+
+// 1 - the length of the mean normal of a tile, the spread of its normals, and the least roughness a
+// rate needs. a sphere turns 0.004 over a tile when it is about 25 pixels across, 0.001 at 50
+#define COARSE_SPREAD_2 0.004f
+#define COARSE_SPREAD_4 0.001f
+#define COARSE_ROUGH_2 0.25f
+#define COARSE_ROUGH_4 0.5f
+
+coarse_t* coarse_create()
+{
+	coarse_t* coarse = new coarse_t;
+	coarse->mode = SHADING_RATE_AUTO;
+	coarse->tiles_x = coarse->tiles_y = 0;
+	coarse->shaded = coarse->taken = 0;
+	return coarse;
+}
+
+void coarse_destory(coarse_t* coarse)
+{
+	delete coarse;
+}
+
+int coarse_tile_rate(device_t* device, const coarse_t* coarse, const gbuffer_t* gbuffer, int tx, int ty)
+{
+	if (!coarse->image.empty())
+	{
+		if (tx >= coarse->tiles_x || ty >= coarse->tiles_y) return 1;
+		int rate = coarse->image[ty * coarse->tiles_x + tx];
+		return rate >= 4 ? 4 : rate >= 2 ? 2 : 1;
+	}
+	if (coarse->mode != SHADING_RATE_AUTO) return 1;
+	int x0 = tx * COARSE_TILE, y0 = ty * COARSE_TILE;
+	int x1 = std::min(x0 + COARSE_TILE, gbuffer->width), y1 = std::min(y0 + COARSE_TILE, gbuffer->height);
+	float nx = 0.0f, ny = 0.0f, nz = 0.0f, rough = 1.0f;
+	int samples = 0, last = -1, id = SHADER_NONE;
+	for (int y = y0; y < y1; y++)
+	{
+		for (int x = x0; x < x1; x++)
+		{
+			int index = y * gbuffer->width + x;
+			int count = gbuffer->counts[index];
+			if (count < 0) continue;
+			// the texture of the other shaders changes from pixel to pixel, a textured PBR tile spans dozens of
+			// levels of albedo and is not worth the fetches it would take to find the flat ones
+			if (count != last) id = device_pipeline(device, last = count)->id;
+			if (id != SHADER_PBR && id != SHADER_LIGHT) return 1;
+			const g_sample_t* s = &gbuffer->samples[index];
+			if (id == SHADER_PBR && s->pbr >= 0) rough = std::min(rough, gbuffer->pbr[s->pbr].roughness);
+			nx += s->normal.x; ny += s->normal.y; nz += s->normal.z;
+			samples++;
+		}
+	}
+	if (samples == 0) return 1;
+	float spread = 1.0f - sqrtf(nx * nx + ny * ny + nz * nz) / (float)samples;
+	if (spread < COARSE_SPREAD_4 && rough >= COARSE_ROUGH_4) return 4;
+	if (spread < COARSE_SPREAD_2 && rough >= COARSE_ROUGH_2) return 2;
+	return 1;
+}
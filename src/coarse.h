@@ -0,0 +1,40 @@
+#ifndef coarse_h
+#define coarse_h
+//=====================================================================
+// coarse shading of deferred frames: the G-buffer is resolved in tiles
+// of COARSE_TILE pixels, each with a rate of 1, 2 or 4. at rate 2 and 4
+// the sample nearest the middle of every 2x2 or 4x4 block is shaded and
+// its colour is taken by the samples of the block that are of the same
+// material and PBR constants, of about its depth and facing its way.
+// the others are shaded by themselves, so depth and coverage stay per
+// pixel. the rate of a tile comes from the rate image when there is
+// one, otherwise from its samples: only tiles of Cook-Torrance and
+// light samples are coarse, by how rough they are and how little their
+// normals vary. forward frames shade every pixel.
+//=====================================================================
+#include "render.h"
+#include "gbuffer.h"
+#include <vector>
+
+#define COARSE_TILE 8            // pixels, the side of the tiles of the rate image
+#define COARSE_NORMAL 0.99f      // least cosine between the normals of a sample and the shaded one of its block
+#define COARSE_DEPTH 0.02f       // largest relative difference of their clip w
+
+struct coarse_t
+{
+	int mode;                // SHADING_RATE_*
+	std::vector<unsigned char> image; // rate of every tile, row major, empty without a rate image
+	std::vector<unsigned char> rates; // of the row of tiles being resolved
+	int tiles_x, tiles_y;    // of the image
+	long long shaded;        // samples that ran the shader since coarse_create
+	long long taken;         // samples that took the colour of their block instead
+};
+
+coarse_t* coarse_create();
+
+void coarse_destory(coarse_t* coarse);
+
+// the rate of the tile at (tx, ty) of the G-buffer, before any of it is resolved
+int coarse_tile_rate(device_t* device, const coarse_t* coarse, const gbuffer_t* gbuffer, int tx, int ty);
+
+#endif
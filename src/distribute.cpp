@@ -0,0 +1,469 @@
+#include "distribute.h"
+#include "job.h"
+#include "scene.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+
+#define DISTRIBUTE_MAGIC  0x52445253u  // "SRDR"
+#define DISTRIBUTE_FRAME  1            // coordinator to worker: a view and the regions of it to draw
+#define DISTRIBUTE_REGION 2            // worker to coordinator: one drawn region
+
+// the byte code of qoi, x is dropped
+#define DISTRIBUTE_OP_INDEX 0x00       // one of the last 64 colours by hash
+#define DISTRIBUTE_OP_DIFF  0x40       // -2..1 on r, g and b
+#define DISTRIBUTE_OP_LUMA  0x80       // -32..31 on g, r and b -8..7 from that, a second byte
+#define DISTRIBUTE_OP_RUN   0xc0       // 1..62 times the pixel before
+#define DISTRIBUTE_OP_RGB   0xfe       // the colour in the next 3 bytes
+#define DISTRIBUTE_RUN_MAX  62
+// the longest code of a region, every pixel DISTRIBUTE_OP_RGB
+#define DISTRIBUTE_CODE_MAX (4 * DISTRIBUTE_TILE * DISTRIBUTE_TILE)
+#define DISTRIBUTE_SIZE_MAX 16384      // width and height of a frame a worker takes
+
+typedef struct
+{
+	unsigned magic;
+	int type;                // DISTRIBUTE_FRAME or DISTRIBUTE_REGION
+	int bytes;               // after the header
+}distribute_header_t;
+
+typedef struct
+{
+	int index;               // of the frame
+	int width, height;       // of the frame
+	int tile;                // DISTRIBUTE_TILE of the coordinator
+	int state;
+	float eye[3], at[3];     // camera of batch_view_t
+	float alpha, m1, m2;
+	int count;               // region indices after it
+}distribute_frame_t;
+
+typedef struct
+{
+	int index;               // of the frame
+	int tile;                // region, tile_y * tiles_x + tile_x
+	float ms;                // the worker drew and compressed it in
+	int raw;                 // bytes of its pixels, the code follows
+}distribute_region_t;
+
+static inline int distribute_hash(IUINT32 c)
+{
+	return (int)(((c >> 16) & 255) * 3 + ((c >> 8) & 255) * 5 + (c & 255) * 7) & 63;
+}
+
+// the difference of the bytes of a and b at shift, -128..127
+static inline int distribute_delta(IUINT32 a, IUINT32 b, int shift)
+{
+	return (signed char)(unsigned char)(((a >> shift) & 255) - ((b >> shift) & 255));
+}
+
+static inline IUINT32 distribute_add(IUINT32 c, int dr, int dg, int db)
+{
+	IUINT32 r = (((c >> 16) & 255) + dr) & 255, g = (((c >> 8) & 255) + dg) & 255, b = ((c & 255) + db) & 255;
+	return (r << 16) | (g << 8) | b;
+}
+
+void distribute_encode(const surface_t* region, std::vector<unsigned char>& out)
+{
+	IUINT32 seen[64] = { 0 };
+	IUINT32 prev = 0;
+	int run = 0;
+	out.clear();
+	for (int y = 0; y < region->height; y++)
+	{
+		const IUINT32* row = surface_row_u32(region, y);
+		for (int x = 0; x < region->width; x++)
+		{
+			IUINT32 c = row[x] & 0xffffff;
+			if (c == prev)
+			{
+				if (++run == DISTRIBUTE_RUN_MAX)
+				{
+					out.push_back((unsigned char)(DISTRIBUTE_OP_RUN | (run - 1)));
+					run = 0;
+				}
+				continue;
+			}
+			if (run > 0)
+			{
+				out.push_back((unsigned char)(DISTRIBUTE_OP_RUN | (run - 1)));
+				run = 0;
+			}
+			int h = distribute_hash(c);
+			if (seen[h] == c) out.push_back((unsigned char)(DISTRIBUTE_OP_INDEX | h));
+			else
+			{
+				seen[h] = c;
+				int dr = distribute_delta(c, prev, 16), dg = distribute_delta(c, prev, 8), db = distribute_delta(c, prev, 0);
+				int rg = dr - dg, bg = db - dg;
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+					out.push_back((unsigned char)(DISTRIBUTE_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+				else if (dg >= -32 && dg <= 31 && rg >= -8 && rg <= 7 && bg >= -8 && bg <= 7)
+				{
+					out.push_back((unsigned char)(DISTRIBUTE_OP_LUMA | (dg + 32)));
+					out.push_back((unsigned char)(((rg + 8) << 4) | (bg + 8)));
+				}
+				else
+				{
+					out.push_back(DISTRIBUTE_OP_RGB);
+					out.push_back((unsigned char)(c >> 16));
+					out.push_back((unsigned char)(c >> 8));
+					out.push_back((unsigned char)c);
+				}
+			}
+			prev = c;
+		}
+	}
+	if (run > 0) out.push_back((unsigned char)(DISTRIBUTE_OP_RUN | (run - 1)));
+}
+
+bool distribute_decode(const unsigned char* data, size_t bytes, surface_t* region)
+{
+	IUINT32 seen[64] = { 0 };
+	IUINT32 prev = 0;
+	int run = 0;
+	size_t p = 0;
+	for (int y = 0; y < region->height; y++)
+	{
+		IUINT32* row = surface_row_u32(region, y);
+		for (int x = 0; x < region->width; x++)
+		{
+			if (run > 0) run--;
+			else
+			{
+				if (p >= bytes) return false;
+				int op = data[p++];
+				if (op == DISTRIBUTE_OP_RGB)
+				{
+					if (p + 3 > bytes) return false;
+					prev = ((IUINT32)data[p] << 16) | ((IUINT32)data[p + 1] << 8) | data[p + 2];
+					p += 3;
+				}
+				else if ((op & 0xc0) == DISTRIBUTE_OP_INDEX) prev = seen[op & 63];
+				else if ((op & 0xc0) == DISTRIBUTE_OP_DIFF) prev = distribute_add(prev, ((op >> 4) & 3) - 2, ((op >> 2) & 3) - 2, (op & 3) - 2);
+				else if ((op & 0xc0) == DISTRIBUTE_OP_LUMA)
+				{
+					if (p >= bytes) return false;
+					int dg = (op & 63) - 32, next = data[p++];
+					prev = distribute_add(prev, dg + (next >> 4) - 8, dg, dg + (next & 15) - 8);
+				}
+				// this pixel and run more
+				else run = op & 63;
+				seen[distribute_hash(prev)] = prev;
+			}
+			row[x] = prev;
+		}
+	}
+	return run == 0 && p == bytes;
+}
+
+static bool distribute_send(net_socket_t s, int type, const void* head, int head_bytes, const void* payload, int payload_bytes)
+{
+	distribute_header_t header = { DISTRIBUTE_MAGIC, type, head_bytes + payload_bytes };
+	return net_send(s, &header, sizeof(header)) && net_send(s, head, head_bytes) && (payload_bytes == 0 || net_send(s, payload, payload_bytes));
+}
+
+// the header of a message of type with at least bytes after it
+static bool distribute_expect(net_socket_t s, int type, int bytes, distribute_header_t* header)
+{
+	return net_recv(s, header, sizeof(*header)) && header->magic == DISTRIBUTE_MAGIC && header->type == type && header->bytes >= bytes;
+}
+
+// the rectangle of tile within a frame of width x height
+static surface_t distribute_tile_view(const surface_t* frame, int tiles_x, int tile)
+{
+	int x = (tile % tiles_x) * DISTRIBUTE_TILE, y = (tile / tiles_x) * DISTRIBUTE_TILE;
+	return surface_view(frame, x, y, std::min(DISTRIBUTE_TILE, frame->width - x), std::min(DISTRIBUTE_TILE, frame->height - y));
+}
+
+//=====================================================================
+// worker
+//=====================================================================
+struct distribute_work_t
+{
+	batch_t* batch;
+	net_socket_t socket;
+	std::mutex send;         // the devices send their regions one at a time
+	distribute_frame_t frame;
+	std::vector<int> tiles;
+	batch_view_t view;
+	std::atomic<int> next;
+	std::atomic<int> failed;
+};
+
+// job of distribute_serve, draws regions on device index until there are none left
+static void distribute_worker_job(void* data, int index, int)
+{
+	distribute_work_t* work = (distribute_work_t*)data;
+	device_t* device = work->batch->devices[index];
+	const distribute_frame_t& f = work->frame;
+	int tiles_x = (f.width + DISTRIBUTE_TILE - 1) / DISTRIBUTE_TILE;
+	std::vector<unsigned char> code;
+	for (;;)
+	{
+		int i = work->next++;
+		if (i >= (int)work->tiles.size() || work->failed) break;
+		int tile = work->tiles[i];
+		auto t0 = std::chrono::steady_clock::now();
+		device_set_region(device, f.width, f.height, (tile % tiles_x) * DISTRIBUTE_TILE, (tile / tiles_x) * DISTRIBUTE_TILE);
+		batch_draw(device, work->view);
+		// the part of the device inside the frame
+		surface_t region = surface_view(device->output, 0, 0, std::min(DISTRIBUTE_TILE, f.width - (tile % tiles_x) * DISTRIBUTE_TILE),
+			std::min(DISTRIBUTE_TILE, f.height - (tile / tiles_x) * DISTRIBUTE_TILE));
+		distribute_encode(&region, code);
+		distribute_region_t r;
+		r.index = f.index;
+		r.tile = tile;
+		r.ms = (float)std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+		r.raw = region.width * region.height * 4;
+		std::lock_guard<std::mutex> lock(work->send);
+		if (!distribute_send(work->socket, DISTRIBUTE_REGION, &r, sizeof(r), code.empty() ? NULL : &code[0], (int)code.size())) work->failed = 1;
+	}
+}
+
+// the next frame of the coordinator of work->socket into work, false when it went or sent nonsense
+static bool distribute_read_frame(distribute_work_t* work)
+{
+	distribute_header_t header;
+	distribute_frame_t& f = work->frame;
+	if (!distribute_expect(work->socket, DISTRIBUTE_FRAME, sizeof(f), &header) || !net_recv(work->socket, &f, sizeof(f))) return false;
+	if (f.tile != DISTRIBUTE_TILE || f.width <= 0 || f.height <= 0 || f.width > DISTRIBUTE_SIZE_MAX || f.height > DISTRIBUTE_SIZE_MAX ||
+		f.state < 1 || f.state > SCENE_STATES) return false;
+	// a region is at most once in a frame, the count is checked before it sizes anything
+	int tiles = ((f.width + DISTRIBUTE_TILE - 1) / DISTRIBUTE_TILE) * ((f.height + DISTRIBUTE_TILE - 1) / DISTRIBUTE_TILE);
+	if (f.count < 0 || f.count > tiles || header.bytes != (int)(sizeof(f) + f.count * sizeof(int))) return false;
+	work->tiles.resize(f.count);
+	if (f.count > 0 && !net_recv(work->socket, &work->tiles[0], f.count * sizeof(int))) return false;
+	for (int i = 0; i < f.count; i++)
+		if (work->tiles[i] < 0 || work->tiles[i] >= tiles) return false;
+	batch_view_t& v = work->view;
+	v.state = f.state;
+	v.preset = 0;
+	v.eye.reset(f.eye[0], f.eye[1], f.eye[2], 1.0f);
+	v.at.reset(f.at[0], f.at[1], f.at[2], 1.0f);
+	v.alpha = f.alpha;
+	v.m1 = f.m1;
+	v.m2 = f.m2;
+	return true;
+}
+
+// thread of distribute_serve, the frames of one coordinator until it goes
+static void distribute_session(batch_t* batch, std::mutex* drawing, net_socket_t socket)
+{
+	distribute_work_t* work = new distribute_work_t;
+	work->batch = batch;
+	work->socket = socket;
+	while (distribute_read_frame(work))
+	{
+		std::lock_guard<std::mutex> lock(*drawing);
+		work->next = 0;
+		work->failed = 0;
+		job_parallel_for(job_system(), 0, (int)batch->devices.size(), 1, distribute_worker_job, work);
+		if (work->failed) break;
+	}
+	net_close(socket);
+	delete work;
+}
+
+bool distribute_serve(batch_t* batch, int port)
+{
+	const device_t* device = batch->devices[0];
+	if (device->output_width != DISTRIBUTE_TILE || device->output_height != DISTRIBUTE_TILE || !net_startup()) return false;
+	net_socket_t listener = net_listen(port);
+	if (listener == NET_INVALID) return false;
+	// a session per connection, so a coordinator that lists the node twice or another coordinator doesn't wait
+	// for the first to leave. their frames take turns on the devices
+	static std::mutex drawing;
+	for (;;)
+	{
+		net_socket_t socket = net_accept(listener);
+		if (socket != NET_INVALID) std::thread(distribute_session, batch, &drawing, socket).detach();
+	}
+}
+
+//=====================================================================
+// coordinator
+//=====================================================================
+distribute_t* distribute_connect(const char* nodes, int width, int height)
+{
+	if (!net_startup()) return NULL;
+	distribute_t* d = new distribute_t;
+	d->width = width;
+	d->height = height;
+	d->tiles_x = (width + DISTRIBUTE_TILE - 1) / DISTRIBUTE_TILE;
+	d->tiles_y = (height + DISTRIBUTE_TILE - 1) / DISTRIBUTE_TILE;
+	d->cost.assign(d->tiles_x * d->tiles_y, 0.0f);
+	d->frame = surface_create(width, height, SURFACE_FORMAT_XRGB32, NULL, 0);
+	d->index = 0;
+	d->reassigned = 0;
+	d->ms = 0.0;
+	int live = 0;
+	std::string list = nodes;
+	size_t start = 0;
+	while (start <= list.size())
+	{
+		size_t comma = list.find(',', start);
+		if (comma == std::string::npos) comma = list.size();
+		std::string item = list.substr(start, comma - start);
+		start = comma + 1;
+		if (item.empty()) continue;
+		distribute_node_t node;
+		size_t colon = item.rfind(':');
+		node.host = item.substr(0, colon);
+		node.port = colon != std::string::npos ? atoi(item.c_str() + colon + 1) : DISTRIBUTE_PORT;
+		node.socket = net_connect(node.host.c_str(), node.port);
+		// a node that hangs is given up like one that went away
+		if (node.socket != NET_INVALID) net_set_timeout(node.socket, DISTRIBUTE_TIMEOUT);
+		node.ms = 0.0;
+		node.speed = 1.0;
+		node.regions = 0;
+		node.raw = node.sent = 0;
+		if (node.socket != NET_INVALID) live++;
+		d->nodes.push_back(node);
+	}
+	if (live == 0)
+	{
+		distribute_destory(d);
+		return NULL;
+	}
+	return d;
+}
+
+void distribute_destory(distribute_t* d)
+{
+	if (d == NULL) return;
+	for (size_t i = 0; i < d->nodes.size(); i++) net_close(d->nodes[i].socket);
+	surface_destory(d->frame);
+	delete d;
+}
+
+// give the regions tiles out to the live nodes, longest first to the one that finishes it soonest
+static void distribute_assign(distribute_t* d, const std::vector<int>& tiles)
+{
+	// the regions never drawn take the mean time of the others
+	double known = 0.0;
+	int count = 0;
+	for (size_t i = 0; i < tiles.size(); i++)
+	{
+		if (d->cost[tiles[i]] <= 0.0f) continue;
+		known += d->cost[tiles[i]];
+		count++;
+	}
+	double guess = count > 0 ? known / count : 1.0;
+	std::vector<std::pair<double, int> > order;
+	for (size_t i = 0; i < tiles.size(); i++)
+	{
+		float c = d->cost[tiles[i]];
+		order.push_back(std::make_pair(-(c > 0.0f ? c : guess), tiles[i]));
+	}
+	std::sort(order.begin(), order.end());
+	std::vector<double> load(d->nodes.size(), 0.0);
+	for (size_t n = 0; n < d->nodes.size(); n++) d->nodes[n].tiles.clear();
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		double c = -order[i].first, best = 0.0;
+		int chosen = -1;
+		for (size_t n = 0; n < d->nodes.size(); n++)
+		{
+			if (d->nodes[n].socket == NET_INVALID) continue;
+			double finish = (load[n] + c) / d->nodes[n].speed;
+			if (chosen < 0 || finish < best)
+			{
+				best = finish;
+				chosen = (int)n;
+			}
+		}
+		load[chosen] += c;
+		d->nodes[chosen].tiles.push_back(order[i].second);
+	}
+}
+
+// thread of distribute_render: send node its regions and put the ones that come back into the frame.
+// the node is closed when the link fails, its regions that didn't come are left for another round
+static void distribute_node_run(distribute_t* d, distribute_node_t* node, distribute_frame_t frame)
+{
+	auto t0 = std::chrono::steady_clock::now();
+	frame.count = (int)node->tiles.size();
+	bool ok = distribute_send(node->socket, DISTRIBUTE_FRAME, &frame, sizeof(frame), &node->tiles[0], frame.count * (int)sizeof(int));
+	std::vector<unsigned char> code;
+	double cost = 0.0;
+	for (int i = 0; i < frame.count && ok; i++)
+	{
+		distribute_header_t header;
+		distribute_region_t r;
+		ok = distribute_expect(node->socket, DISTRIBUTE_REGION, sizeof(r), &header) && net_recv(node->socket, &r, sizeof(r));
+		if (!ok) break;
+		// only its own regions of this frame, each once
+		ok = r.index == frame.index && std::find(node->tiles.begin(), node->tiles.end(), r.tile) != node->tiles.end() && !d->done[r.tile];
+		ok = ok && header.bytes - (int)sizeof(r) <= DISTRIBUTE_CODE_MAX;
+		if (!ok) break;
+		code.resize(header.bytes - sizeof(r));
+		if (!code.empty()) ok = net_recv(node->socket, &code[0], code.size());
+		if (!ok) break;
+		surface_t region = distribute_tile_view(d->frame, d->tiles_x, r.tile);
+		ok = distribute_decode(code.empty() ? NULL : &code[0], code.size(), &region);
+		if (!ok) break;
+		d->done[r.tile] = 1;
+		d->cost[r.tile] = r.ms > 0.0f ? r.ms : 1e-3f;
+		cost += d->cost[r.tile];
+		node->regions++;
+		node->raw += r.raw;
+		node->sent += (long long)code.size();
+	}
+	if (!ok)
+	{
+		net_close(node->socket);
+		node->socket = NET_INVALID;
+		return;
+	}
+	node->ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+	if (cost > 0.0 && node->ms > 0.0) node->speed = cost / node->ms;
+}
+
+bool distribute_render(distribute_t* d, const batch_view_t& view)
+{
+	auto t0 = std::chrono::steady_clock::now();
+	distribute_frame_t frame;
+	frame.index = d->index++;
+	frame.width = d->width;
+	frame.height = d->height;
+	frame.tile = DISTRIBUTE_TILE;
+	frame.state = view.state;
+	frame.eye[0] = view.eye.x;
+	frame.eye[1] = view.eye.y;
+	frame.eye[2] = view.eye.z;
+	frame.at[0] = view.at.x;
+	frame.at[1] = view.at.y;
+	frame.at[2] = view.at.z;
+	frame.alpha = view.alpha;
+	frame.m1 = view.m1;
+	frame.m2 = view.m2;
+	frame.count = 0;
+	int tiles = d->tiles_x * d->tiles_y;
+	d->done.assign(tiles, 0);
+	std::vector<int> missing;
+	for (int i = 0; i < tiles; i++) missing.push_back(i);
+	for (int round = 0; !missing.empty(); round++)
+	{
+		bool live = false;
+		for (size_t n = 0; n < d->nodes.size(); n++) live = live || d->nodes[n].socket != NET_INVALID;
+		if (!live) return false;
+		if (round > 0) d->reassigned += (int)missing.size();
+		distribute_assign(d, missing);
+		// the nodes wait on their sockets, so they get threads of their own instead of workers of the job system
+		std::vector<std::thread> threads;
+		for (size_t n = 0; n < d->nodes.size(); n++)
+			if (d->nodes[n].socket != NET_INVALID && !d->nodes[n].tiles.empty()) threads.push_back(std::thread(distribute_node_run, d, &d->nodes[n], frame));
+		for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+		std::vector<int> left;
+		for (size_t i = 0; i < missing.size(); i++)
+			if (!d->done[missing[i]]) left.push_back(missing[i]);
+		missing.swap(left);
+	}
+	d->ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+	return true;
+}
@@ -0,0 +1,73 @@
+#ifndef distribute_h
+#define distribute_h
+//=====================================================================
+// distributed sort-first rendering. a coordinator splits the frame
+// into square regions of DISTRIBUTE_TILE pixels and hands them out to
+// worker processes on other nodes. every worker loaded the scene from
+// the baked meshes and textures itself and draws its regions with the
+// devices of a batch, each cropped to its region by device_set_region.
+// the regions come back compressed with the byte code of the qoi image
+// format, which is lossless and fast, and are put together into the
+// frame. every region is sent with the time it took: the next frame
+// gives the regions out longest first, each to the node that would be
+// done with it soonest at the speed that node had in the last frame.
+// the regions of a node that goes away or stays silent for
+// DISTRIBUTE_TIMEOUT are drawn again by the others.
+// the messages are in the byte order of the nodes, which must agree.
+//=====================================================================
+#include "batch.h"
+#include "net.h"
+#include "surface.h"
+#include <string>
+#include <vector>
+
+#define DISTRIBUTE_TILE 128      // size of the regions, the devices of a worker have this size
+#define DISTRIBUTE_PORT 7411     // of a node given without one
+#define DISTRIBUTE_TIMEOUT 10000 // ms the coordinator waits on a node for its next message
+
+typedef struct
+{
+	std::string host;
+	int port;
+	net_socket_t socket;     // NET_INVALID once the node is gone, or when it never answered
+	std::vector<int> tiles;  // regions of the frame being drawn, longest first
+	double ms;               // wall time of its regions in the last frame, with the transfers
+	double speed;            // ms of region time it gets through per ms of wall time, its devices together
+	long long regions;       // drawn since distribute_connect
+	long long raw, sent;     // bytes of those regions before and after compression
+}distribute_node_t;
+
+struct distribute_t
+{
+	std::vector<distribute_node_t> nodes;
+	int width, height;
+	int tiles_x, tiles_y;
+	std::vector<float> cost;     // ms of every region the last time it was drawn, 0 before
+	std::vector<char> done;      // regions of the frame being drawn that came back
+	surface_t* frame;            // XRGB32 width x height, drawn by distribute_render
+	int index;                   // of the next frame
+	int reassigned;              // regions drawn again because their node went away
+	double ms;                   // wall time of the last distribute_render
+};
+
+// connect to the workers of nodes, "host[:port],host[:port],...", for frames of width x height. the nodes
+// that don't answer are kept with no socket. NULL when none answers
+distribute_t* distribute_connect(const char* nodes, int width, int height);
+
+void distribute_destory(distribute_t* d);
+
+// draw view on the nodes into d->frame, false when every node is gone
+bool distribute_render(distribute_t* d, const batch_view_t& view);
+
+// the pixels of region row by row as qoi codes into out, x is dropped
+void distribute_encode(const surface_t* region, std::vector<unsigned char>& out);
+
+// the codes of distribute_encode into region, false when they don't fill it exactly
+bool distribute_decode(const unsigned char* data, size_t bytes, surface_t* region);
+
+// worker: draw the regions the coordinators connecting to port ask for with the devices of batch, whose
+// output is DISTRIBUTE_TILE square. the frames of several coordinators take turns on the devices. returns
+// false when port can't be listened on
+bool distribute_serve(batch_t* batch, int port);
+
+#endif
@@ -0,0 +1,69 @@
+#include "file_map.h"
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool file_map_open(file_map_t* map, const char* path)
+{
+	memset(map, 0, sizeof(file_map_t));
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size;
+	HANDLE mapping = NULL;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+	{
+		CloseHandle(file);
+		return false;
+	}
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == NULL)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	map->data = data;
+	map->size = (size_t)size.QuadPart;
+	map->file = file;
+	map->mapping = mapping;
+	return true;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0)
+	{
+		close(fd);
+		return false;
+	}
+	void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping stays valid after the descriptor is closed
+	close(fd);
+	if (data == MAP_FAILED) return false;
+	map->data = data;
+	map->size = (size_t)st.st_size;
+	return true;
+#endif
+}
+
+void file_map_close(file_map_t* map)
+{
+	if (map->data == NULL) return;
+#ifdef _WIN32
+	UnmapViewOfFile(map->data);
+	CloseHandle((HANDLE)map->mapping);
+	CloseHandle((HANDLE)map->file);
+#else
+	munmap((void*)map->data, map->size);
+#endif
+	map->data = NULL;
+}
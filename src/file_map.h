@@ -0,0 +1,22 @@
+#ifndef file_map_h
+#define file_map_h
+//=====================================================================
+// read only mappings of whole files, shared by the baked mesh and
+// texture containers. CreateFileMapping on windows, mmap elsewhere.
+//=====================================================================
+#include <cstddef>
+
+typedef struct
+{
+	const void* data;
+	size_t size;
+	void* file;              // platform handles of the mapping
+	void* mapping;
+}file_map_t;
+
+// false when the file is missing or empty, map is left empty then
+bool file_map_open(file_map_t* map, const char* path);
+
+void file_map_close(file_map_t* map);
+
+#endif
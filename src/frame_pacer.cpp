@@ -0,0 +1,34 @@
+#include "frame_pacer.h"
+#include <chrono>
+#include <thread>
+
+double frame_clock()
+{
+	static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void frame_pacer_init(frame_pacer_t* pacer, float fps)
+{
+	pacer->interval = fps > 0.0f ? 1.0 / fps : 0.0;
+	pacer->last = frame_clock();
+	pacer->next = pacer->last + pacer->interval;
+	pacer->dt = 0.0f;
+}
+
+float frame_pacer_wait(frame_pacer_t* pacer)
+{
+	double now = frame_clock();
+	if (pacer->interval > 0.0)
+	{
+		// the sleep may oversleep by the scheduler tick, so it stops 2 ms early and yields the rest
+		double sleep = pacer->next - now - 0.002;
+		if (sleep > 0.0) std::this_thread::sleep_for(std::chrono::duration<double>(sleep));
+		while ((now = frame_clock()) < pacer->next) std::this_thread::yield();
+		pacer->next += pacer->interval;
+		if (pacer->next < now) pacer->next = now + pacer->interval;
+	}
+	pacer->dt = (float)(now - pacer->last);
+	pacer->last = now;
+	return pacer->dt;
+}
@@ -0,0 +1,27 @@
+#ifndef frame_pacer_h
+#define frame_pacer_h
+//=====================================================================
+// frame pacing for the window: a steady clock, a fixed frame interval
+// and a wait that sleeps most of the way to the next frame instead of
+// spinning. a pacer that falls behind starts over from now rather than
+// rushing frames to catch up.
+//=====================================================================
+
+typedef struct
+{
+	double interval;         // seconds per frame, 0 runs unpaced
+	double next;             // frame_clock time the next frame is due
+	double last;             // frame_clock time the last frame_pacer_wait returned
+	float dt;                // seconds between the last two frames
+}frame_pacer_t;
+
+// seconds on a steady high resolution clock, from an arbitrary start
+double frame_clock();
+
+// fps <= 0 never waits
+void frame_pacer_init(frame_pacer_t* pacer, float fps);
+
+// block until the next frame is due, returns the seconds since the previous call
+float frame_pacer_wait(frame_pacer_t* pacer);
+
+#endif
@@ -0,0 +1,47 @@
+#include "frame_pipeline.h"
+
+frame_pipeline_t* frame_pipeline_create(device_t* a, device_t* b, frame_pipeline_finish_t finish, void* user)
+{
+	frame_pipeline_t* fp = new frame_pipeline_t;
+	fp->devices[0] = a;
+	fp->devices[1] = b;
+	fp->index[0] = fp->index[1] = -1;
+	fp->next = 0;
+	fp->finish = finish;
+	fp->user = user;
+	return fp;
+}
+
+void frame_pipeline_destory(frame_pipeline_t* fp)
+{
+	if (fp == NULL) return;
+	frame_pipeline_flush(fp);
+	delete fp;
+}
+
+device_t* frame_pipeline_begin(frame_pipeline_t* fp)
+{
+	return fp->devices[fp->next];
+}
+
+// job of frame_pipeline_end, finishes the frame of device slot
+static void frame_pipeline_job(void* data, int slot, int)
+{
+	frame_pipeline_t* fp = (frame_pipeline_t*)data;
+	fp->finish(fp->devices[slot], fp->index[slot], fp->user);
+}
+
+void frame_pipeline_end(frame_pipeline_t* fp, int index)
+{
+	int slot = fp->next;
+	// the frame before is on the other device, the next frame is drawn there once it is finished
+	job_wait(job_system(), &fp->finishing);
+	fp->index[slot] = index;
+	job_submit(job_system(), frame_pipeline_job, fp, slot, slot + 1, &fp->finishing);
+	fp->next = 1 - slot;
+}
+
+void frame_pipeline_flush(frame_pipeline_t* fp)
+{
+	job_wait(job_system(), &fp->finishing);
+}
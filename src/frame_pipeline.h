@@ -0,0 +1,44 @@
+#ifndef frame_pipeline_h
+#define frame_pipeline_h
+//=====================================================================
+// pipelined frames of one thread: the draws of a frame go into one of
+// two devices while the job system finishes the frame before on the
+// other, its resolve, post effects, present and output. a tile is
+// shaded when the draw that touched it flushes, from the state the
+// device has then, so two frames can't overlap on one device; each
+// device has its own bins, targets and scratch arena, and the frames
+// alternate between them. frame_pipeline_end waits for the frame
+// before to be finished before it hands this one over, so the frames
+// are finished in order and at most one frame behind the draws.
+//=====================================================================
+#include "render.h"
+#include "job.h"
+
+// the finish stage of frame index, drawn into device, on a thread of the job system
+typedef void (*frame_pipeline_finish_t)(device_t* device, int index, void* user);
+
+struct frame_pipeline_t
+{
+	device_t* devices[2];    // of the same size and modes, not owned
+	int index[2];            // of the frame drawn into each device
+	int next;                // device of the next frame
+	frame_pipeline_finish_t finish;
+	void* user;
+	job_counter_t finishing; // the finish job of the last frame
+};
+
+frame_pipeline_t* frame_pipeline_create(device_t* a, device_t* b, frame_pipeline_finish_t finish, void* user);
+
+// finishes the last frame first
+void frame_pipeline_destory(frame_pipeline_t* fp);
+
+// the device to draw the next frame into, no frame is being finished on it
+device_t* frame_pipeline_begin(frame_pipeline_t* fp);
+
+// the frame of the last frame_pipeline_begin is drawn, finish it as frame index once the one before is finished
+void frame_pipeline_end(frame_pipeline_t* fp, int index);
+
+// return when every frame is finished
+void frame_pipeline_flush(frame_pipeline_t* fp);
+
+#endif
@@ -0,0 +1,289 @@
+#include "frame_stream.h"
+#include "image_file.h"
+#include <cstring>
+#include <csignal>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRAME_STREAM_SSE 1
+#endif
+
+#ifdef _WIN32
+#define frame_stream_popen(command) _popen(command, "wb")
+#define frame_stream_pclose _pclose
+#else
+#define frame_stream_popen(command) popen(command, "w")
+#define frame_stream_pclose pclose
+#endif
+
+// BT.601 studio swing with the 8 bit weights of the usual integer approximation, the SSE2 path
+// computes the same values
+static inline unsigned char yuv_y(int r, int g, int b) { return (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16); }
+static inline unsigned char yuv_u(int r, int g, int b) { return (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128); }
+static inline unsigned char yuv_v(int r, int g, int b) { return (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128); }
+
+#ifdef FRAME_STREAM_SSE
+// r, g and b of 8 pixels as 16 bit lanes
+static inline void yuv_split(const IUINT32* row, __m128i& r, __m128i& g, __m128i& b)
+{
+	__m128i mask = _mm_set1_epi32(0xff);
+	__m128i p0 = _mm_loadu_si128((const __m128i*)row);
+	__m128i p1 = _mm_loadu_si128((const __m128i*)(row + 4));
+	b = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+	g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask), _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+	r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask), _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+}
+
+// the sums stay below 2^16, so the unsigned 16 bit lanes never wrap
+static inline __m128i yuv_y8(__m128i r, __m128i g, __m128i b)
+{
+	__m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)), _mm_mullo_epi16(g, _mm_set1_epi16(129))),
+		_mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(25)), _mm_set1_epi16(128)));
+	return _mm_add_epi16(_mm_srli_epi16(sum, 8), _mm_set1_epi16(16));
+}
+
+// a chroma row of means r, g and b below 256, the sums fit signed 16 bit lanes
+static inline __m128i yuv_chroma8(__m128i r, __m128i g, __m128i b, short wr, short wg, short wb)
+{
+	__m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(wr)), _mm_mullo_epi16(g, _mm_set1_epi16(wg))),
+		_mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(wb)), _mm_set1_epi16(128)));
+	return _mm_add_epi16(_mm_srai_epi16(sum, 8), _mm_set1_epi16(128));
+}
+
+// the means of the 2x2 blocks of 16 pixels of two rows, lo and hi hold pixels 0..7 and 8..15 of each row
+static inline __m128i yuv_mean(__m128i lo0, __m128i hi0, __m128i lo1, __m128i hi1)
+{
+	__m128i ones = _mm_set1_epi16(1);
+	__m128i lo = _mm_madd_epi16(_mm_add_epi16(lo0, lo1), ones);
+	__m128i hi = _mm_madd_epi16(_mm_add_epi16(hi0, hi1), ones);
+	return _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(lo, hi), _mm_set1_epi16(2)), 2);
+}
+
+// the first multiple of 16 pixels of the rows r0 and r1, returns how many were done
+static int yuv420_sse(const IUINT32* r0, const IUINT32* r1, unsigned char* y0, unsigned char* y1, unsigned char* u, unsigned char* v, int width)
+{
+	int x = 0;
+	for (; x + 16 <= width; x += 16)
+	{
+		__m128i rl0, gl0, bl0, rh0, gh0, bh0, rl1, gl1, bl1, rh1, gh1, bh1;
+		yuv_split(r0 + x, rl0, gl0, bl0);
+		yuv_split(r0 + x + 8, rh0, gh0, bh0);
+		yuv_split(r1 + x, rl1, gl1, bl1);
+		yuv_split(r1 + x + 8, rh1, gh1, bh1);
+		_mm_storeu_si128((__m128i*)(y0 + x), _mm_packus_epi16(yuv_y8(rl0, gl0, bl0), yuv_y8(rh0, gh0, bh0)));
+		_mm_storeu_si128((__m128i*)(y1 + x), _mm_packus_epi16(yuv_y8(rl1, gl1, bl1), yuv_y8(rh1, gh1, bh1)));
+		__m128i r = yuv_mean(rl0, rh0, rl1, rh1);
+		__m128i g = yuv_mean(gl0, gh0, gl1, gh1);
+		__m128i b = yuv_mean(bl0, bh0, bl1, bh1);
+		__m128i cu = yuv_chroma8(r, g, b, -38, -74, 112);
+		__m128i cv = yuv_chroma8(r, g, b, 112, -94, -18);
+		_mm_storel_epi64((__m128i*)(u + x / 2), _mm_packus_epi16(cu, cu));
+		_mm_storel_epi64((__m128i*)(v + x / 2), _mm_packus_epi16(cv, cv));
+	}
+	return x;
+}
+#endif
+
+void frame_stream_yuv420(const surface_t* color, unsigned char* py, unsigned char* pu, unsigned char* pv)
+{
+	int width = color->width, height = color->height, chroma = (width + 1) / 2;
+	for (int y = 0; y < height; y += 2)
+	{
+		// the last row and column of an odd size pair with themselves
+		int y_next = y + 1 < height ? y + 1 : y;
+		const IUINT32* r0 = surface_row_u32(color, y);
+		const IUINT32* r1 = surface_row_u32(color, y_next);
+		unsigned char* y0 = py + y * width;
+		unsigned char* y1 = py + y_next * width;
+		unsigned char* u = pu + (y / 2) * chroma;
+		unsigned char* v = pv + (y / 2) * chroma;
+		int x = 0;
+#ifdef FRAME_STREAM_SSE
+		x = yuv420_sse(r0, r1, y0, y1, u, v, width);
+#endif
+		for (; x < width; x += 2)
+		{
+			int x_next = x + 1 < width ? x + 1 : x;
+			IUINT32 p[4] = { r0[x], r0[x_next], r1[x], r1[x_next] };
+			int r = 2, g = 2, b = 2;
+			for (int k = 0; k < 4; k++)
+			{
+				r += (p[k] >> 16) & 0xff;
+				g += (p[k] >> 8) & 0xff;
+				b += p[k] & 0xff;
+			}
+			for (int k = 0; k < 4; k++)
+			{
+				unsigned char* row = k < 2 ? y0 : y1;
+				row[k & 1 ? x_next : x] = yuv_y((p[k] >> 16) & 0xff, (p[k] >> 8) & 0xff, p[k] & 0xff);
+			}
+			u[x / 2] = yuv_u(r >> 2, g >> 2, b >> 2);
+			v[x / 2] = yuv_v(r >> 2, g >> 2, b >> 2);
+		}
+	}
+}
+
+// the next frame the worker may write, NULL when it has to wait for one
+static frame_stream_frame_t* frame_stream_ready(frame_stream_t* stream)
+{
+	if (stream->pending.empty()) return NULL;
+	frame_stream_frame_t* frame = stream->pending.begin()->second;
+	if (stream->type == FRAME_STREAM_Y4M && frame->index > stream->next) return NULL;
+	return frame;
+}
+
+static bool frame_stream_write(frame_stream_t* stream, frame_stream_frame_t* frame)
+{
+	if (stream->type == FRAME_STREAM_IMAGES) return image_write(frame->path.c_str(), frame->color, frame->format);
+	static const char header[] = "FRAME\n";
+	if (fwrite(header, 1, sizeof(header) - 1, stream->fp) != sizeof(header) - 1) return false;
+	return fwrite(&frame->yuv[0], 1, frame->yuv.size(), stream->fp) == frame->yuv.size();
+}
+
+static void frame_stream_worker(frame_stream_t* stream)
+{
+	std::unique_lock<std::mutex> hold(stream->lock);
+	for (;;)
+	{
+		stream->queued.wait(hold, [stream] { return stream->quit || frame_stream_ready(stream) != NULL; });
+		frame_stream_frame_t* frame = frame_stream_ready(stream);
+		if (frame == NULL)
+		{
+			// closing, the frames after a missing one still go out in order
+			if (stream->pending.empty()) break;
+			frame = stream->pending.begin()->second;
+		}
+		stream->pending.erase(stream->pending.begin());
+		stream->writing++;
+		// the render threads keep pushing meanwhile
+		hold.unlock();
+		bool ok = frame_stream_write(stream, frame);
+		hold.lock();
+		if (ok) stream->written++;
+		else stream->failed++;
+		if (frame->index >= stream->next) stream->next = frame->index + 1;
+		stream->writing--;
+		stream->spare.push_back(frame);
+		stream->drained.notify_all();
+	}
+}
+
+frame_stream_t* frame_stream_open(int type, const char* target, int width, int height, int fps)
+{
+	FILE* fp = NULL;
+	int piped = 0;
+	if (type == FRAME_STREAM_Y4M)
+	{
+		if (target == NULL || width <= 0 || height <= 0 || fps <= 0) return NULL;
+		if (target[0] == '|')
+		{
+#ifndef _WIN32
+			// an encoder that quits fails the writes instead of ending the process
+			signal(SIGPIPE, SIG_IGN);
+#endif
+			fp = frame_stream_popen(target + 1);
+			piped = 1;
+		}
+		else fp = fopen(target, "wb");
+		if (fp == NULL) return NULL;
+		// C420jpeg: the chroma sample sits in the middle of its 2x2 block
+		fprintf(fp, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+	}
+	frame_stream_t* stream = new frame_stream_t();
+	stream->type = type;
+	stream->width = width;
+	stream->height = height;
+	stream->fp = fp;
+	stream->piped = piped;
+	stream->next = 0;
+	stream->writing = 0;
+	stream->buffers = 0;
+	stream->written = 0;
+	stream->failed = 0;
+	stream->quit = false;
+	stream->worker = std::thread(frame_stream_worker, stream);
+	return stream;
+}
+
+void frame_stream_destory(frame_stream_t* stream)
+{
+	if (stream == NULL) return;
+	{
+		std::lock_guard<std::mutex> hold(stream->lock);
+		stream->quit = true;
+	}
+	stream->queued.notify_all();
+	stream->worker.join();
+	for (size_t i = 0; i < stream->spare.size(); i++)
+	{
+		surface_destory(stream->spare[i]->color);
+		delete stream->spare[i];
+	}
+	// a pipe closes once the encoder finished reading
+	if (stream->fp != NULL)
+	{
+		if (stream->piped) frame_stream_pclose(stream->fp);
+		else fclose(stream->fp);
+	}
+	delete stream;
+}
+
+void frame_stream_push(frame_stream_t* stream, int index, const surface_t* color, const char* path, int format)
+{
+	frame_stream_frame_t* frame;
+	{
+		std::lock_guard<std::mutex> hold(stream->lock);
+		if (!stream->spare.empty())
+		{
+			frame = stream->spare.back();
+			stream->spare.pop_back();
+		}
+		else
+		{
+			frame = new frame_stream_frame_t();
+			frame->color = NULL;
+			stream->buffers++;
+		}
+	}
+	frame->index = index;
+	bool ok = true;
+	if (stream->type == FRAME_STREAM_Y4M)
+	{
+		ok = color->width == stream->width && color->height == stream->height;
+		if (ok)
+		{
+			int luma = color->width * color->height, chroma = ((color->width + 1) / 2) * ((color->height + 1) / 2);
+			frame->yuv.resize(luma + chroma * 2);
+			frame_stream_yuv420(color, &frame->yuv[0], &frame->yuv[luma], &frame->yuv[luma + chroma]);
+		}
+	}
+	else
+	{
+		if (frame->color == NULL || frame->color->width != color->width || frame->color->height != color->height)
+		{
+			surface_destory(frame->color);
+			frame->color = surface_create(color->width, color->height, SURFACE_FORMAT_XRGB32, NULL, 0);
+		}
+		for (int y = 0; y < color->height; y++)
+			memcpy(surface_row_u32(frame->color, y), surface_row_u32(color, y), color->width * sizeof(IUINT32));
+		frame->path = path;
+		frame->format = format;
+	}
+	{
+		std::lock_guard<std::mutex> hold(stream->lock);
+		// a second frame of an index that is still queued is dropped
+		if (ok) ok = stream->pending.insert(std::make_pair(index, frame)).second;
+		if (!ok)
+		{
+			stream->failed++;
+			stream->spare.push_back(frame);
+			return;
+		}
+	}
+	stream->queued.notify_one();
+}
+
+void frame_stream_flush(frame_stream_t* stream)
+{
+	std::unique_lock<std::mutex> hold(stream->lock);
+	stream->drained.wait(hold, [stream] { return stream->writing == 0 && frame_stream_ready(stream) == NULL; });
+}
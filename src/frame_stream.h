@@ -0,0 +1,72 @@
+#ifndef frame_stream_h
+#define frame_stream_h
+//=====================================================================
+// frame stream: finished frames leave the renderer through a writer
+// thread, either as one yuv4mpeg2 stream an encoder reads (a file or
+// the stdin of a command like ffmpeg) or as one image file per frame.
+// push converts or copies the frame into a buffer of the stream and
+// returns. when every buffer is still queued a new one is made instead
+// of waiting, so a render thread never waits on the disk or the pipe.
+// y4m frames are written in index order whatever order they come in.
+//=====================================================================
+#include "surface.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#define FRAME_STREAM_Y4M    0  // 4:2:0 BT.601 studio swing, the chroma of every 2x2 block is its mean
+#define FRAME_STREAM_IMAGES 1  // image_write to the path of every frame
+
+// a pushed frame, the buffers are kept for the next ones
+typedef struct
+{
+	int index;
+	std::string path;        // FRAME_STREAM_IMAGES
+	int format;              // IMAGE_FORMAT_* of path
+	surface_t* color;        // FRAME_STREAM_IMAGES: copy of the frame
+	std::vector<unsigned char> yuv; // FRAME_STREAM_Y4M: the y, u and v planes
+}frame_stream_frame_t;
+
+struct frame_stream_t
+{
+	int type;                // FRAME_STREAM_*
+	int width, height;       // every frame of a y4m stream has this size
+	FILE* fp;                // y4m output
+	int piped;               // fp is a popen command
+	std::map<int, frame_stream_frame_t*> pending; // pushed and not written, by index
+	std::vector<frame_stream_frame_t*> spare;     // written, free for the next push
+	int next;                // y4m: index of the frame written next
+	int writing;             // frames the worker took and has not finished
+	int buffers;             // frames allocated, more than the render threads means the output fell behind
+	std::atomic<int> written;
+	std::atomic<int> failed;
+	std::thread worker;
+	std::mutex lock;
+	std::condition_variable queued, drained;
+	bool quit;
+};
+
+// type FRAME_STREAM_Y4M writes width x height frames at fps to target, a path or "|command" whose stdin
+// takes the stream. FRAME_STREAM_IMAGES ignores the other arguments. NULL when target can't be opened
+frame_stream_t* frame_stream_open(int type, const char* target, int width, int height, int fps);
+
+// writes what is left, y4m frames after a missing index too, then stops the thread and closes the output
+void frame_stream_destory(frame_stream_t* stream);
+
+// queue color as frame index, images go to path in IMAGE_FORMAT_* format. a y4m stream counts the
+// frames of another size as failed. returns at once, safe to call from several threads
+void frame_stream_push(frame_stream_t* stream, int index, const surface_t* color, const char* path, int format);
+
+// wait until the worker wrote every frame it can, a y4m stream stops at the first missing index
+void frame_stream_flush(frame_stream_t* stream);
+
+// the 4:2:0 planes of FRAME_STREAM_Y4M of an XRGB32 surface, u and v are (width + 1) / 2 by
+// (height + 1) / 2. SSE2 takes 16 pixels of two rows at a time
+void frame_stream_yuv420(const surface_t* color, unsigned char* y, unsigned char* u, unsigned char* v);
+
+#endif
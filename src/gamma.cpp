@@ -0,0 +1,28 @@
+#include "gamma.h"
+#include <cmath>
+#include <mutex>
+
+float gamma_decode_table[256];
+float gamma_encode_table[GAMMA_ENCODE_SIZE + 1];
+
+// the tables, filled once by gamma_init
+static void gamma_fill()
+{
+	for (int i = 0; i < 256; i++)
+	{
+		float c = (float)i / 255.0f;
+		gamma_decode_table[i] = pow(c, GAMMA);
+	}
+	for (int i = 0; i <= GAMMA_ENCODE_SIZE; i++)
+	{
+		double s = (double)i / GAMMA_ENCODE_SIZE;
+		gamma_encode_table[i] = (float)pow(s * s, 1.0 / GAMMA);
+	}
+}
+
+void gamma_init()
+{
+	// devices may be initialized on several threads at once
+	static std::once_flag once;
+	std::call_once(once, gamma_fill);
+}
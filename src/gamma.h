@@ -0,0 +1,36 @@
+#ifndef gamma_h
+#define gamma_h
+//=====================================================================
+// the 2.2 power curve the PBR shaders use to decode albedo and encode
+// the output, as tables instead of pow calls. gamma_init fills them
+// and is called by device_init.
+//=====================================================================
+#include <cmath>
+
+#define GAMMA 2.2f
+#define GAMMA_ENCODE_SIZE 1024
+
+// (i / 255) ^ 2.2, bit for bit what the shaders computed with pow
+extern float gamma_decode_table[256];
+// indexed by sqrt(x), where x ^ (1 / 2.2) = sqrt(x) ^ (2 / 2.2) is close to a line
+extern float gamma_encode_table[GAMMA_ENCODE_SIZE + 1];
+
+void gamma_init();
+
+inline float gamma_decode(int c)
+{
+	return gamma_decode_table[c];
+}
+
+// x ^ (1 / 2.2) for x in [0, 1], within 6.5e-5 of pow: the worst is near x = 1.2e-7 in the first table step,
+// where the curve is steepest. from x = 1e-4 on it is within 1.5e-6
+inline float gamma_encode(float x)
+{
+	if (!(x > 0.0f)) return 0.0f;
+	if (x >= 1.0f) return 1.0f;
+	float f = sqrtf(x) * (float)GAMMA_ENCODE_SIZE;
+	int i = (int)f;
+	return gamma_encode_table[i] + (gamma_encode_table[i + 1] - gamma_encode_table[i]) * (f - (float)i);
+}
+
+#endif
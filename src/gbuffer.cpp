@@ -0,0 +1,42 @@
+#include "gbuffer.h"
+#include "memory_track.h"
+#include <cstring>
+
+gbuffer_t* gbuffer_create(int width, int height)
+{
+	gbuffer_t* gbuffer = new gbuffer_t;
+	gbuffer->width = width;
+	gbuffer->height = height;
+	gbuffer->active = 0;
+	gbuffer->samples.resize(width * height);
+	gbuffer->counts.resize(width * height);
+	memory_note(MEMORY_TARGETS, memory_bytes(gbuffer->samples) + memory_bytes(gbuffer->counts));
+	gbuffer_clear(gbuffer);
+	return gbuffer;
+}
+
+void gbuffer_destory(gbuffer_t* gbuffer)
+{
+	if (gbuffer == NULL) return;
+	memory_note(MEMORY_TARGETS, -(memory_bytes(gbuffer->samples) + memory_bytes(gbuffer->counts)));
+	delete gbuffer;
+}
+
+void gbuffer_clear(gbuffer_t* gbuffer)
+{
+	if (!gbuffer->counts.empty()) memset(&gbuffer->counts[0], 0xff, gbuffer->counts.size() * sizeof(int));
+	gbuffer->pbr.clear();
+}
+
+bool gbuffer_pbr_equal(const s_PBR& a, const s_PBR& b)
+{
+	return a.albedo.x == b.albedo.x && a.albedo.y == b.albedo.y && a.albedo.z == b.albedo.z && a.albedo.w == b.albedo.w
+		&& a.metallic == b.metallic && a.roughness == b.roughness && a.ao == b.ao;
+}
+
+int gbuffer_track_pbr(gbuffer_t* gbuffer, const s_PBR& pbr)
+{
+	if (!gbuffer->pbr.empty() && gbuffer_pbr_equal(gbuffer->pbr.back(), pbr)) return (int)gbuffer->pbr.size() - 1;
+	gbuffer->pbr.push_back(pbr);
+	return (int)gbuffer->pbr.size() - 1;
+}
@@ -0,0 +1,46 @@
+#ifndef gbuffer_h
+#define gbuffer_h
+//=====================================================================
+// deferred shading: the depth test winner of every pixel is stored in
+// the G-buffer and f_shader runs once per visible pixel at resolve.
+//=====================================================================
+#include "render.h"
+#include <vector>
+
+typedef struct
+{
+	s_vector pos;            // world position, w holds the clip w like for_fs::pos
+	s_vector normal;         // normalized
+	s_vector2f texcoord;
+	float duv[4];            // for_fs::duv
+	s_color color;
+	s_vector storage0;       // TBN rows used by the normal mapped materials
+	s_vector storage1;
+	s_vector storage2;
+	int pbr;                 // index into gbuffer_t::pbr
+}g_sample_t;
+
+struct gbuffer_t
+{
+	int width, height;
+	int active;              // set by device_clear when RENDER_STATE_DEFERRED is on
+	std::vector<g_sample_t> samples;    // width * height, row major
+	std::vector<int> counts;            // material index passed to f_shader per pixel, -1 when empty.
+	                                    // kept apart from samples so clear and resolve only touch 4 bytes per empty pixel
+	std::vector<s_PBR> pbr;  // device->PBR changes between draws, so every distinct value is kept
+};
+
+gbuffer_t* gbuffer_create(int width, int height);
+
+void gbuffer_destory(gbuffer_t* gbuffer);
+
+// mark every pixel empty and forget the PBR table
+void gbuffer_clear(gbuffer_t* gbuffer);
+
+// field by field, s_PBR has padding after the aligned albedo
+bool gbuffer_pbr_equal(const s_PBR& a, const s_PBR& b);
+
+// remember device->PBR for the following fragments if it changed since the last draw, returns its index
+int gbuffer_track_pbr(gbuffer_t* gbuffer, const s_PBR& pbr);
+
+#endif
@@ -0,0 +1,780 @@
+//=====================================================================
+// golden image regression test: draws the seven demo states with the
+// camera presets of the window on the reference path (scanline, scalar
+// math, forward shading, no tiles, no hi-z, exact brdf) and compares
+// them with the images stored in golden/, then draws them again on
+// every optimized path and compares those with the reference frames.
+// a frame passes when its PSNR and its largest channel error are both
+// within the limits of its path. the paths whose limits against the
+// reference are loose store images of their own as well, and those are
+// held to the limits of the reference path. the tiled paths draw every
+// frame once more with their tiles shaded on one thread, and that frame
+// has to hash the same.
+//   GOLDEN_TEST                 compare, exit code 1 on a failure
+//   GOLDEN_TEST -update         store the reference and stored paths' frames as the new golden images
+//   GOLDEN_TEST -diff failed    write every failing frame as failed_PATH_STATE.png
+// run it from src, ctest does
+//=====================================================================
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "render.h"
+#include "scene.h"
+#include "image_file.h"
+#include "s_simd.h"
+#include "msaa.h"
+#include "taa.h"
+#include "post.h"
+#include "coarse.h"
+#include "ibl.h"
+#include "scene_file.h"
+#include "rasterize.h"
+#include "distribute.h"
+#include "skin.h"
+#include "multiview.h"
+
+#define GOLDEN_WIDTH  320
+#define GOLDEN_HEIGHT 240
+#define GOLDEN_SSAO_STATE  3     // the state whose boxes occlude each other, see golden_check_occluded
+#define GOLDEN_SSAO_PIXELS 300   // half of the 597 pixels ssao darkens there
+#define GOLDEN_TRIANGLES   500   // random triangles golden_check_edge_weights covers
+#define GOLDEN_RECORDINGS 4
+#define GOLDEN_BAND 64           // rows of the bands path, not a divisor of the frame height
+#define GOLDEN_PIPELINE SHADER_PHONG_TEXTURE // bound by golden_check_bound_pipeline
+#define GOLDEN_PIPELINE_STATE 6  // a PBR state, so now_state and the bound pipeline disagree
+#define GOLDEN_SKIN_STATE 2      // drawn by golden_check_skin
+#define GOLDEN_SKIN_SIDE 32
+#define GOLDEN_SKIN_JOINTS 4
+#define GOLDEN_STEREO 0.3f       // eye separation of golden_check_multiview
+
+typedef struct
+{
+	const char* name;
+	int raster_mode;         // RASTER_MODE_*
+	int tiles;               // device_set_tile_mode
+	int flags;               // RENDER_STATE_DEFERRED, RENDER_STATE_DEPTH_PREPASS
+	int hiz;
+	int lod;                 // device_set_lod
+	int occlusion;           // device_set_occlusion
+	int raytrace;            // device_set_raytrace samples
+	int msaa;                // device_set_msaa
+	int taa;                 // device_set_taa, the frame is drawn once per jitter phase
+	int relight;             // device_set_relight, drawn with other m1 and m2 first, then shaded from its G-buffer
+	int hdr;                 // device_set_hdr
+	int post;                // device_set_post
+	int ssao;                // device_set_ssao
+	int coarse;              // device_set_shading_rate, 2 or 4 a rate image of every tile at that rate
+	int layout;              // device_set_texture_layout, another one loads the scene again in it
+	int record;              // frames of GOLDEN_RECORDINGS angles recorded at once, the first replayed, see golden_draw_recorded
+	int ibl;                 // the environment computed again from its image instead of read from its cache
+	int region_width;        // the frame put together from regions of this size drawn by device_set_region, 0 for none
+	int region_height;
+	int brdf_mode;           // BRDF_MODE_*
+	int simd;                // best back end instead of S_SIMD_SCALAR
+	int stored;              // its frames are stored too and held to the limits of the reference path, see golden_file
+	double psnr;             // dB, at least
+	int max_error;           // of one channel of one pixel, at most
+}golden_path_t;
+
+// the first entry is the reference path, its limits are the ones against the stored images. the
+// edge walk covers pixels along triangle edges differently from the scanline one, msaa and taa blend them
+// and lod draws the small meshes coarser. the ray tracer shadows every scene with traced rays and
+// shades without texture derivatives, bloom and fxaa spread the bright pixels and the edges, so their
+// limits against the reference are loose and only catch a path gone wrong everywhere. the ones marked
+// stored also compare with their own images, which catches a change of a few pixels. a coarse block takes the reflection of the environment of its shaded sample, coarse 2 and 4
+// shade every block of every tile once and the bump maps lose the most.
+// record has to match bit for bit, and so does ibl: the irradiance, prefiltered levels and brdf table of the
+// environment are the same computed as read from the cache. the regions of distribute.h keep the projection of the
+// frame and only move the viewport, the scanline walk rounds a few pixels at their edges one level apart. bands
+// of batch.h move it by whole rows only and match bit for bit.
+// bc samples the block compressed textures, lossy by a few levels per texel
+static const golden_path_t golden_paths[] = {
+	{ "reference", RASTER_MODE_SCANLINE, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 0, 50.0, 8 },
+	{ "simd", RASTER_MODE_SCANLINE, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 1, 0, 60.0, 1 },
+	{ "hiz", RASTER_MODE_SCANLINE, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 0, 60.0, 1 },
+	{ "tiles", RASTER_MODE_SCANLINE, 4, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 0, 60.0, 1 },
+	{ "prepass", RASTER_MODE_SCANLINE, 0, RENDER_STATE_DEPTH_PREPASS, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 0, 60.0, 1 },
+	{ "deferred", RASTER_MODE_SCANLINE, 0, RENDER_STATE_DEFERRED, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 0, 60.0, 1 },
+	{ "edge", RASTER_MODE_EDGE, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 1, 32.0, 160 },
+	{ "quad", RASTER_MODE_QUAD, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 1, 32.0, 160 },
+	{ "msaa", RASTER_MODE_EDGE, 4, RENDER_STATE_DEPTH_PREPASS, 1, 0, 0, 0, MSAA_SAMPLES, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 1, 30.0, 160 },
+	{ "taa", RASTER_MODE_SCANLINE, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 1, 30.0, 160 },
+	{ "brdf fast", RASTER_MODE_SCANLINE, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, BRDF_MODE_FAST, 0, 0, 45.0, 8 },
+	{ "lod", RASTER_MODE_SCANLINE, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 1, 30.0, 160 },
+	{ "occlusion", RASTER_MODE_SCANLINE, 0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 0, 60.0, 1 },
+	{ "raytrace", RASTER_MODE_SCANLINE, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 0, 28.0, 200 },
+	{ "relight", RASTER_MODE_SCANLINE, 0, RENDER_STATE_DEFERRED, 0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 0, 60.0, 1 },
+	{ "hdr", RASTER_MODE_SCANLINE, 4, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 0, 60.0, 1 },
+	{ "post", RASTER_MODE_SCANLINE, 4, 0, 0, 0, 0, 0, 1, 0, 0, 1, POST_BLOOM | POST_FXAA, 0, 0, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 1, 28.0, 160 },
+	{ "ssao", RASTER_MODE_SCANLINE, 4, RENDER_STATE_DEFERRED, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 0, 45.0, 32 },
+	{ "coarse", RASTER_MODE_SCANLINE, 4, RENDER_STATE_DEFERRED, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, SHADING_RATE_AUTO, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 0, 60.0, 20 },
+	{ "coarse 2", RASTER_MODE_SCANLINE, 4, RENDER_STATE_DEFERRED, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 1, 30.0, 160 },
+	{ "coarse 4", RASTER_MODE_SCANLINE, 4, RENDER_STATE_DEFERRED, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 1, 28.0, 160 },
+	{ "bc", RASTER_MODE_SCANLINE, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, TEXTURE_LAYOUT_BC, 0, 0, 0, 0, BRDF_MODE_EXACT, 0, 0, 40.0, 96 },
+	{ "record", RASTER_MODE_SCANLINE, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, BRDF_MODE_EXACT, 0, 0, 1000.0, 0 },
+	{ "ibl", RASTER_MODE_SCANLINE, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, BRDF_MODE_EXACT, 0, 0, 1000.0, 0 },
+	{ "regions", RASTER_MODE_SCANLINE, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, DISTRIBUTE_TILE, DISTRIBUTE_TILE, BRDF_MODE_EXACT, 0, 0, 60.0, 1 },
+	{ "bands", RASTER_MODE_SCANLINE, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, GOLDEN_WIDTH, GOLDEN_BAND, BRDF_MODE_EXACT, 0, 0, 1000.0, 0 },
+	{ "all", RASTER_MODE_EDGE, 4, RENDER_STATE_DEFERRED, 1, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, BRDF_MODE_FAST, 1, 1, 32.0, 160 },
+};
+
+#define GOLDEN_PATHS ((int)(sizeof(golden_paths) / sizeof(golden_paths[0])))
+
+// the best back end, s_simd_get picks it before anything is forced
+static int golden_simd_best;
+
+typedef struct
+{
+	device_t* device;
+	float theta;
+}golden_recording_t;
+
+// cmdbuf_record_t of golden_draw_recorded, buffer index is the frame at theta + index
+static void golden_record(cmdbuf_t* cb, int index, void* data)
+{
+	golden_recording_t* recording = (golden_recording_t*)data;
+	scene_record(cb, recording->device, recording->theta + (float)index);
+}
+
+// draw_box through command buffers: the frames of GOLDEN_RECORDINGS angles are recorded on the job system at
+// the same time, the first at theta, and a frame buffer replays the first. it matches draw_box only when no
+// recording moves the nodes of another and the replayed buffer keeps the places of its own recording
+static void golden_draw_recorded(device_t* device, float theta)
+{
+	cmdbuf_t* buffers[GOLDEN_RECORDINGS];
+	for (int i = 0; i < GOLDEN_RECORDINGS; i++) buffers[i] = cmdbuf_create();
+	golden_recording_t recording = { device, theta };
+	cmdbuf_record_parallel(buffers, GOLDEN_RECORDINGS, golden_record, &recording);
+	cmdbuf_t* frame = cmdbuf_create();
+	cmdbuf_replay(frame, buffers[0]);
+	cmdbuf_execute(device, frame);
+	cmdbuf_destory(frame);
+	for (int i = 0; i < GOLDEN_RECORDINGS; i++) cmdbuf_destory(buffers[i]);
+}
+
+static void golden_draw_box(device_t* device, const golden_path_t* path, float theta)
+{
+	if (path->record) golden_draw_recorded(device, theta);
+	else draw_box(device, theta);
+}
+
+// shift is added to m1 and m2 of the preset
+static void golden_draw(device_t* device, const golden_path_t* path, int state, float shift)
+{
+	s_vector eye, at, up(0.0f, 0.0f, 1.0f, 1.0f);
+	float alpha;
+	scene_view(device, state, eye, at, alpha);
+	device->m1 += shift;
+	device->m2 += shift;
+	device->camera.viewpos = eye;
+	s_vector target;
+	target.add_two(eye, at);
+	bool relit = device_relight_begin(device);
+	if (relit)
+	{
+		camera_at_zero(device, eye, target, up);
+		golden_draw_box(device, path, alpha);
+		relit = device_relight_end(device);
+	}
+	if (!relit)
+	{
+		device_clear(device, 1);
+		camera_at_zero(device, eye, target, up);
+		golden_draw_box(device, path, alpha);
+	}
+	device_resolve(device);
+	device_present(device);
+}
+
+// the environment of the scene computed from its image without the cache, NULL when there is none
+static ibl_t* golden_ibl()
+{
+	scene_file_t* file = scene_file_open(SCENE_FILE_DEFAULT);
+	if (file == NULL) return NULL;
+	ibl_t* ibl = file->environment.empty() ? NULL : ibl_load(file->environment.c_str(), NULL);
+	scene_file_destory(file);
+	return ibl;
+}
+
+// draw state region by region into frame with device, which has the size of the regions of path
+static void golden_draw_regions(device_t* device, const golden_path_t* path, int state, surface_t* frame)
+{
+	for (int y = 0; y < GOLDEN_HEIGHT; y += path->region_height)
+	{
+		for (int x = 0; x < GOLDEN_WIDTH; x += path->region_width)
+		{
+			device_set_region(device, GOLDEN_WIDTH, GOLDEN_HEIGHT, x, y);
+			golden_draw(device, path, state, 0.0f);
+			int w = std::min(path->region_width, GOLDEN_WIDTH - x), h = std::min(path->region_height, GOLDEN_HEIGHT - y);
+			for (int row = 0; row < h; row++) memcpy(surface_row_u32(frame, y + row) + x, surface_row_u32(device->output, row), w * 4);
+		}
+	}
+}
+
+// a device of path that draws with the assets of source, or with assets of its own in another texture layout.
+// it is the size of a region when path draws in regions
+static device_t* golden_device(device_t* source, const golden_path_t* path)
+{
+	device_t* device = new device_t();
+	if (path->region_width > 0) device_init(device, path->region_width, path->region_height, NULL);
+	else device_init(device, GOLDEN_WIDTH, GOLDEN_HEIGHT, NULL);
+	if (path->layout != source->texture_layout)
+	{
+		device_set_texture_filter(device, TEXTURE_FILTER_TRILINEAR);
+		device_set_texture_layout(device, path->layout);
+		s_vector eye, at;
+		float alpha;
+		scene_view(device, 1, eye, at, alpha);
+		scene_load(device);
+	}
+	else device_share_assets(device, source);
+	device->raster_mode = path->raster_mode;
+	device->render_state = RENDER_STATE_TEXTURE | path->flags;
+	device_set_hiz(device, path->hiz);
+	device_set_lod(device, path->lod);
+	device_set_occlusion(device, path->occlusion);
+	device_set_raytrace(device, path->raytrace);
+	device_set_msaa(device, path->msaa);
+	device_set_brdf_mode(device, path->brdf_mode);
+	if (path->tiles > 0) device_set_tile_mode(device, path->tiles);
+	device_set_relight(device, path->relight);
+	device_set_hdr(device, path->hdr);
+	device_set_post(device, path->post);
+	device_set_ssao(device, path->ssao);
+	if (path->ibl) device_set_ibl(device, golden_ibl());
+	device_set_shading_rate(device, path->coarse == SHADING_RATE_AUTO ? SHADING_RATE_AUTO : SHADING_RATE_OFF);
+	if (path->coarse >= 2)
+	{
+		int tiles_x = (GOLDEN_WIDTH + COARSE_TILE - 1) / COARSE_TILE, tiles_y = (GOLDEN_HEIGHT + COARSE_TILE - 1) / COARSE_TILE;
+		std::vector<unsigned char> rates(tiles_x * tiles_y, (unsigned char)path->coarse);
+		device_set_shading_rate_image(device, &rates[0], tiles_x, tiles_y);
+	}
+	s_simd_select(path->simd ? golden_simd_best : S_SIMD_SCALAR);
+	return device;
+}
+
+// psnr in dB over the rgb channels, 1000 for equal images. max_error is the largest channel difference
+static double golden_compare(const surface_t* a, const surface_t* b, int& max_error)
+{
+	max_error = 0;
+	double sum = 0.0;
+	for (int y = 0; y < a->height; y++)
+	{
+		const IUINT32* ra = surface_row_u32(a, y);
+		const IUINT32* rb = surface_row_u32(b, y);
+		for (int x = 0; x < a->width; x++)
+		{
+			for (int shift = 0; shift <= 16; shift += 8)
+			{
+				int d = abs((int)((ra[x] >> shift) & 0xff) - (int)((rb[x] >> shift) & 0xff));
+				if (d > max_error) max_error = d;
+				sum += (double)d * d;
+			}
+		}
+	}
+	double mse = sum / ((double)a->width * a->height * 3.0);
+	return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 1000.0;
+}
+
+// the golden image of state, PATH_state_N.png for a path other than the reference one
+static std::string golden_file(const char* dir, const golden_path_t* path, int state)
+{
+	char file[512];
+	if (path == &golden_paths[0]) snprintf(file, sizeof(file), "%s/state_%d.png", dir, state);
+	else
+	{
+		snprintf(file, sizeof(file), "%s/%s_state_%d.png", dir, path->name, state);
+		for (char* c = file + strlen(dir); *c; c++) if (*c == ' ') *c = '_';
+	}
+	return file;
+}
+
+// false when the frame is outside the limits of path, it is then written under diff when one is given
+static bool golden_check(const char* what, const golden_path_t* path, int state, const surface_t* frame, const surface_t* expected, const char* diff)
+{
+	int max_error;
+	double psnr = golden_compare(frame, expected, max_error);
+	bool pass = psnr >= path->psnr && max_error <= path->max_error;
+	printf("%-4s %-10s state %d vs %-9s psnr %7.2f dB  max error %3d\n", pass ? "ok" : "FAIL", path->name, state, what, psnr >= 1000.0 ? INFINITY : psnr, max_error);
+	if (!pass && diff != NULL)
+	{
+		char name[512];
+		snprintf(name, sizeof(name), "%s_%s_%d.png", diff, path->name, state);
+		for (char* c = name + strlen(diff); *c; c++) if (*c == ' ') *c = '_';
+		image_write(name, frame, IMAGE_FORMAT_PNG);
+	}
+	return pass;
+}
+
+// draw state again with the tiles of device shaded on the calling thread, false when the frame differs
+// from the one output holds by a single bit
+static bool golden_check_threads(device_t* device, const golden_path_t* path, int state)
+{
+	unsigned long long hash = surface_hash(device->output);
+	device_set_tile_mode(device, 1);
+	golden_draw(device, path, state, 0.0f);
+	unsigned long long single = surface_hash(device->output);
+	device_set_tile_mode(device, path->tiles);
+	bool pass = hash == single;
+	printf("%-4s %-10s state %d vs 1 thread hash %016llx %s %016llx\n", pass ? "ok" : "FAIL", path->name, state, hash, pass ? "==" : "!=", single);
+	return pass;
+}
+
+// state GOLDEN_PIPELINE_STATE drawn with the builtin pipeline GOLDEN_PIPELINE bound, on the reference path and on
+// the edge path, which shades rows with f_shader_packet. the packet shaders have to follow the bound pipeline and
+// not now_state: the frames only differ where the two walks cover the edges of the triangles, cook-torrance
+// in place of phong costs more than 20 dB
+static bool golden_check_bound_pipeline(device_t* source, const char* diff)
+{
+	golden_path_t edge;
+	for (int p = 0; p < GOLDEN_PATHS; p++) if (strcmp(golden_paths[p].name, "edge") == 0) edge = golden_paths[p];
+	edge.psnr = 60.0;
+	edge.max_error = 8;
+	device_t* reference = golden_device(source, &golden_paths[0]);
+	device_t* device = golden_device(source, &edge);
+	device_bind_pipeline(reference, pipeline_builtin(GOLDEN_PIPELINE));
+	device_bind_pipeline(device, pipeline_builtin(GOLDEN_PIPELINE));
+	golden_draw(reference, &golden_paths[0], GOLDEN_PIPELINE_STATE, 0.0f);
+	golden_draw(device, &edge, GOLDEN_PIPELINE_STATE, 0.0f);
+	bool pass = golden_check("bound", &edge, GOLDEN_PIPELINE_STATE, device->output, reference->output, diff);
+	device_destory(reference);
+	delete reference;
+	device_destory(device);
+	delete device;
+	return pass;
+}
+
+// the boxes of the state, which set its lights, and the skin of golden_check_skin in front of its camera, or the
+// rest mesh without the skin
+static void golden_draw_skin_mesh(device_t* device, skin_t* skin, const vertex_layout_t* rest, const int* indices, const mesh_group_t* group)
+{
+	s_vector eye, at, up(0.0f, 0.0f, 1.0f, 1.0f);
+	float alpha;
+	scene_view(device, GOLDEN_SKIN_STATE, eye, at, alpha);
+	device->camera.viewpos = eye;
+	s_vector target;
+	target.add_two(eye, at);
+	camera_at_zero(device, eye, target, up);
+	draw_box(device, alpha);
+	device->transform.world.set_translate(eye.x + at.x * 6.0f, eye.y + at.y * 6.0f, eye.z + at.z * 6.0f);
+	device->transform.update();
+	if (skin != NULL) skin_draw(device, skin);
+	else draw_indexed_groups(device, rest, indices, group, 1);
+}
+
+// a frame of golden_draw_skin_mesh, shaded from the kept G-buffer when device relights and nothing moved. true then
+static bool golden_draw_skin(device_t* device, skin_t* skin, const vertex_layout_t* rest, const int* indices, const mesh_group_t* group)
+{
+	bool relit = device_relight_begin(device);
+	if (relit)
+	{
+		golden_draw_skin_mesh(device, skin, rest, indices, group);
+		relit = device_relight_end(device);
+	}
+	if (!relit)
+	{
+		device_clear(device, 1);
+		golden_draw_skin_mesh(device, skin, rest, indices, group);
+	}
+	device_resolve(device);
+	device_present(device);
+	return relit;
+}
+
+// a bumped grid of GOLDEN_SKIN_SIDE^2 vertices that follow GOLDEN_SKIN_JOINTS joints, blended along x, with a
+// morph target at weight 0. posed in the bind pose it has to draw like its rest mesh bit for bit, and a relit
+// frame has to tell two poses apart that skin_update wrote into the same streams
+static bool golden_check_skin(device_t* source, const char* diff)
+{
+	int side = GOLDEN_SKIN_SIDE, joints = GOLDEN_SKIN_JOINTS;
+	std::vector<vertex_t> vertices(side * side);
+	std::vector<skin_weights_t> weights(side * side);
+	std::vector<s_vector> offsets(side * side);
+	for (int y = 0; y < side; y++)
+	{
+		for (int x = 0; x < side; x++)
+		{
+			float u = (float)x / (side - 1), v = (float)y / (side - 1);
+			float dx = u * 2.0f - 1.0f, dy = v * 2.0f - 1.0f;
+			vertex_t& vert = vertices[y * side + x];
+			vert = vertex_t();
+			vert.pos.reset(dx, dy, 0.3f * cosf(dx * 2.0f) * cosf(dy * 2.0f), 1.0f);
+			vert.normal.reset(0.6f * sinf(dx * 2.0f) * cosf(dy * 2.0f), 0.6f * cosf(dx * 2.0f) * sinf(dy * 2.0f), 1.0f, 0.0f);
+			s_simd_get()->normalize3(&vert.normal.x);
+			vert.tangent.reset(1.0f, 0.0f, 0.0f, 1.0f);
+			vert.tc.u = u;
+			vert.tc.v = v;
+			vert.color.r = vert.color.g = vert.color.b = vert.color.a = 1.0f;
+			vert.rhw = 1.0f;
+			vert.material_idex = 1;
+			float f = u * (joints - 1);
+			int j = std::min((int)f, joints - 2);
+			skin_weights_t& w = weights[y * side + x];
+			w.joint[0] = (unsigned char)j; w.joint[1] = (unsigned char)(j + 1); w.joint[2] = w.joint[3] = 0;
+			w.weight[1] = floorf((f - (float)j) * 4.0f) * 0.25f;
+			w.weight[0] = 1.0f - w.weight[1]; w.weight[2] = w.weight[3] = 0.0f;
+			offsets[y * side + x].reset(0.0f, 0.0f, 0.5f, 0.0f);
+		}
+	}
+	std::vector<int> indices;
+	for (int y = 0; y + 1 < side; y++)
+	{
+		for (int x = 0; x + 1 < side; x++)
+		{
+			int i = y * side + x;
+			int quad[6] = { i, i + 1, i + side, i + 1, i + side + 1, i + side };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+	mesh_group_t group;
+	mesh_compute_bounds(&vertices[0], 0, side * side, &group);
+	group.first = 0;
+	group.count = (int)indices.size();
+	// joint j sits at x = j, the bind pose puts it back there
+	std::vector<s_matrix> inverse_bind(joints), pose(joints);
+	for (int j = 0; j < joints; j++)
+	{
+		inverse_bind[j].set_translate(-(float)j, 0.0f, 0.0f);
+		pose[j].set_translate((float)j, 0.0f, 0.0f);
+	}
+	skin_t* skin = skin_create(&vertices[0], side * side, &weights[0], &inverse_bind[0], joints, &indices[0], &group, 1);
+	skin_set_morph(skin, skin_add_morph(skin, &offsets[0], NULL), 0.0f);
+	skin_set_pose(skin, &pose[0]);
+	skin_update(skin);
+	vertex_layout_t rest;
+	vertex_layout_interleaved(&rest, &vertices[0], side * side);
+
+	golden_path_t path = golden_paths[0];
+	path.name = "skin";
+	path.psnr = 1000.0;
+	path.max_error = 0;
+	device_t* device = golden_device(source, &path);
+	golden_draw_skin(device, NULL, &rest, &indices[0], &group);
+	surface_t* expected = surface_create(GOLDEN_WIDTH, GOLDEN_HEIGHT, SURFACE_FORMAT_XRGB32, NULL, 0);
+	for (int y = 0; y < GOLDEN_HEIGHT; y++) memcpy(surface_row_u32(expected, y), surface_row_u32(device->output, y), GOLDEN_WIDTH * 4);
+	golden_draw_skin(device, skin, &rest, &indices[0], &group);
+	bool pass = golden_check("rest mesh", &path, GOLDEN_SKIN_STATE, device->output, expected, diff);
+	surface_destory(expected);
+	device_destory(device);
+	delete device;
+
+	// relit while the pose holds, drawn again after two skin_updates that find the streams of the kept frame
+	path.flags = RENDER_STATE_DEFERRED;
+	path.relight = 1;
+	device = golden_device(source, &path);
+	golden_draw_skin(device, skin, &rest, &indices[0], &group);
+	bool held = golden_draw_skin(device, skin, &rest, &indices[0], &group);
+	for (int j = 0; j < joints; j++) pose[j].set_translate((float)j, 0.0f, 0.25f * (float)j);
+	skin_set_pose(skin, &pose[0]);
+	skin_update(skin);
+	skin_update(skin);
+	bool moved = !golden_draw_skin(device, skin, &rest, &indices[0], &group);
+	printf("%-4s %-10s state %d relit while posed alike %s, drawn after two poses %s\n", held && moved ? "ok" : "FAIL", path.name, GOLDEN_SKIN_STATE,
+		held ? "yes" : "no", moved ? "yes" : "no");
+	device_destory(device);
+	delete device;
+	skin_destory(skin);
+	return pass && held && moved;
+}
+
+// every state drawn for a stereo pair GOLDEN_STEREO apart by multiview_end, each eye against draw_box with the
+// camera of that eye alone on the reference path. the views draw the vertices the leader shaded once in world
+// space, and they have to match bit for bit
+static bool golden_check_multiview(device_t* source, int only, const char* diff)
+{
+	golden_path_t path = golden_paths[0];
+	path.name = "multiview";
+	path.psnr = 1000.0;
+	path.max_error = 0;
+	device_t* leader = golden_device(source, &path);
+	device_t* single = golden_device(source, &path);
+	multiview_t* mv = multiview_create(leader, 2);
+	int failed = 0;
+	for (int state = 1; state <= SCENE_STATES; state++)
+	{
+		if (only != 0 && state != only) continue;
+		s_vector eye, at, up(0.0f, 0.0f, 1.0f, 1.0f);
+		float alpha;
+		scene_view(leader, state, eye, at, alpha);
+		s_vector target;
+		target.add_two(eye, at);
+		multiview_set_stereo(mv, eye, target, up, GOLDEN_STEREO);
+		multiview_begin(mv, 1);
+		draw_box(leader, alpha);
+		multiview_end(mv);
+		// the eyes of multiview_set_stereo, the left one moved against the screen's right
+		s_vector forward, right;
+		forward.minus_two(target, eye);
+		forward.normalize();
+		right.crossproduct(up, forward);
+		right.normalize();
+		right.float_dot(GOLDEN_STEREO * 0.5f);
+		for (int view = 0; view < 2; view++)
+		{
+			s_vector e, a;
+			if (view == 0) { e.minus_two(eye, right); a.minus_two(target, right); }
+			else { e.add_two(eye, right); a.add_two(target, right); }
+			e.w = a.w = 1.0f;
+			scene_view(single, state, eye, at, alpha);
+			single->camera.viewpos = e;
+			device_clear(single, 1);
+			camera_at_zero(single, e, a, up);
+			draw_box(single, alpha);
+			device_resolve(single);
+			device_present(single);
+			if (!golden_check(view == 0 ? "left eye" : "right eye", &path, state, mv->views[view]->output, single->output, diff)) failed++;
+		}
+	}
+	multiview_destory(mv);
+	device_destory(single);
+	delete single;
+	device_destory(leader);
+	delete leader;
+	return failed == 0;
+}
+
+// ssao only takes light away, and the boxes of state GOLDEN_SSAO_STATE stand in each other's creases: at least
+// GOLDEN_SSAO_PIXELS of its pixels are darker than the reference by more than 12 levels over the three channels,
+// none is brighter by more than 3. false otherwise, a frame drawn without occlusion fails
+static bool golden_check_occluded(const golden_path_t* path, int state, const surface_t* frame, const surface_t* reference)
+{
+	int darker = 0, brighter = 0;
+	for (int y = 0; y < frame->height; y++)
+	{
+		const IUINT32* a = surface_row_u32(frame, y);
+		const IUINT32* b = surface_row_u32(reference, y);
+		for (int x = 0; x < frame->width; x++)
+		{
+			int d = 0;
+			for (int shift = 0; shift <= 16; shift += 8) d += (int)((b[x] >> shift) & 0xff) - (int)((a[x] >> shift) & 0xff);
+			if (d > 12) darker++;
+			if (d < -3) brighter++;
+		}
+	}
+	bool pass = darker >= GOLDEN_SSAO_PIXELS && brighter == 0;
+	printf("%-4s %-10s state %d occluded  %d pixels darker, %d brighter\n", pass ? "ok" : "FAIL", path->name, state, darker, brighter);
+	return pass;
+}
+
+// the weights of the edge function path against the same weights in double precision at the pixels of
+// GOLDEN_TRIANGLES random triangles of the frame size, their w between 0.1 and 100. false when one is
+// off by more than RASTER_EDGE_EPSILON
+static bool golden_check_edge_weights()
+{
+	unsigned seed = 1;
+	double worst = 0.0;
+	long long pixels = 0;
+	for (int t = 0; t < GOLDEN_TRIANGLES; t++)
+	{
+		vertex_t v[3] = {};
+		for (int i = 0; i < 3; i++)
+		{
+			float r[4];
+			for (int k = 0; k < 4; k++)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				r[k] = (float)(seed >> 8) / 16777216.0f;
+			}
+			v[i].pos.reset(r[0] * GOLDEN_WIDTH, r[1] * GOLDEN_HEIGHT, r[2], 1.0f);
+			v[i].rhw = 1.0f / (0.1f + r[3] * 99.9f);
+		}
+		edge_triangle_t tri;
+		if (!edge_triangle_init(&tri, &v[0], &v[1], &v[2])) continue;
+		for (int y = tri.min_y; y <= tri.max_y; y++)
+		{
+			for (int x = tri.min_x; x <= tri.max_x; x++)
+			{
+				long long e[3];
+				for (int i = 0; i < 3; i++) e[i] = edge_eq_value(&tri.e[i], RASTER_CENTER(x), RASTER_CENTER(y));
+				if (e[0] < tri.e[0].min || e[1] < tri.e[1].min || e[2] < tri.e[2].min) continue;
+				float b[3], ww;
+				edge_triangle_weights(&tri, (float)e[0] * RASTER_EDGE_UNIT, (float)e[1] * RASTER_EDGE_UNIT, (float)e[2] * RASTER_EDGE_UNIT, b, ww);
+				double exact[3], sum = 0.0;
+				for (int i = 0; i < 3; i++) sum += exact[i] = (double)e[i] * (double)tri.rhw[i];
+				for (int i = 0; i < 3; i++) worst = std::max(worst, fabs((double)b[i] - exact[i] / sum));
+				pixels++;
+			}
+		}
+	}
+	bool pass = worst <= RASTER_EDGE_EPSILON;
+	printf("%-4s edge weights of %lld pixels, worst error %.3g, at most %.3g\n", pass ? "ok" : "FAIL", pixels, worst, (double)RASTER_EDGE_EPSILON);
+	return pass;
+}
+
+// decode the distribute_encode code of image into a surface of its size, false when a pixel differs from the
+// rgb of image or the code without its last byte decodes too
+static bool golden_codec_round_trip(const surface_t* image, long long& raw, long long& sent)
+{
+	std::vector<unsigned char> code;
+	distribute_encode(image, code);
+	surface_t* decoded = surface_create(image->width, image->height, SURFACE_FORMAT_XRGB32, NULL, 0);
+	bool pass = distribute_decode(code.empty() ? NULL : &code[0], code.size(), decoded);
+	for (int y = 0; y < image->height && pass; y++)
+		for (int x = 0; x < image->width; x++)
+			if (((surface_row_u32(image, y)[x] ^ surface_row_u32(decoded, y)[x]) & 0xffffff) != 0) pass = false;
+	if (!code.empty() && distribute_decode(&code[0], code.size() - 1, decoded)) pass = false;
+	surface_destory(decoded);
+	raw += (long long)image->width * image->height * 4;
+	sent += (long long)code.size();
+	return pass;
+}
+
+// the qoi code of the distributed renderer on the frames, on their DISTRIBUTE_TILE regions and on noise of
+// runs, small steps and whole colours, false when one of them doesn't come back the same
+static bool golden_check_codec(const std::vector<surface_t*>& frames)
+{
+	long long raw = 0, sent = 0;
+	int images = 0, failed = 0;
+	surface_t* noise = surface_create(GOLDEN_WIDTH, GOLDEN_HEIGHT, SURFACE_FORMAT_XRGB32, NULL, 0);
+	unsigned seed = 7;
+	IUINT32 c = 0;
+	for (int y = 0; y < GOLDEN_HEIGHT; y++)
+	{
+		for (int x = 0; x < GOLDEN_WIDTH; x++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			int kind = (seed >> 28) & 3;
+			if (kind == 1) c ^= (seed >> 8) & 0x010101;
+			else if (kind == 2) c += (seed >> 4) & 0x0f1f0f;
+			else if (kind == 3) c = (seed >> 4) & 0xffffff;
+			surface_row_u32(noise, y)[x] = c & 0xffffff;
+		}
+	}
+	std::vector<const surface_t*> all(frames.begin(), frames.end());
+	all.push_back(noise);
+	for (size_t i = 0; i < all.size(); i++)
+	{
+		const surface_t* frame = all[i];
+		if (frame == NULL) continue;
+		images++;
+		if (!golden_codec_round_trip(frame, raw, sent)) failed++;
+		for (int y = 0; y < frame->height; y += DISTRIBUTE_TILE)
+		{
+			for (int x = 0; x < frame->width; x += DISTRIBUTE_TILE)
+			{
+				surface_t region = surface_view(frame, x, y, std::min(DISTRIBUTE_TILE, frame->width - x), std::min(DISTRIBUTE_TILE, frame->height - y));
+				images++;
+				if (!golden_codec_round_trip(&region, raw, sent)) failed++;
+			}
+		}
+	}
+	surface_destory(noise);
+	printf("%-4s codec of %d images, %d differ, %lld bytes of %lld\n", failed == 0 ? "ok" : "FAIL", images, failed, sent, raw);
+	return failed == 0;
+}
+
+static void usage(const char* name)
+{
+	printf("usage: %s [options]\n", name);
+	printf("  -update             store the frames of the reference path and of the stored ones as the golden images\n");
+	printf("  -dir DIR            where the golden images are, golden\n");
+	printf("  -state N            only state 1..%d, 0 for all of them (default)\n", SCENE_STATES);
+	printf("  -diff PREFIX        write the failing frames as PREFIX_PATH_STATE.png\n");
+}
+
+int main(int argc, char** argv)
+{
+	int update = 0, only = 0;
+	const char* dir = "golden";
+	const char* diff = NULL;
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		bool has1 = i + 1 < argc;
+		if (strcmp(arg, "-update") == 0) update = 1;
+		else if (strcmp(arg, "-dir") == 0 && has1) dir = argv[++i];
+		else if (strcmp(arg, "-state") == 0 && has1) only = atoi(argv[++i]);
+		else if (strcmp(arg, "-diff") == 0 && has1) diff = argv[++i];
+		else { usage(argv[0]); return 1; }
+	}
+	golden_simd_best = s_simd_get()->isa;
+
+	static device_t source;
+	device_init(&source, GOLDEN_WIDTH, GOLDEN_HEIGHT, NULL);
+	device_set_texture_filter(&source, TEXTURE_FILTER_TRILINEAR);
+	s_vector eye, at;
+	float alpha;
+	scene_view(&source, 1, eye, at, alpha);
+	scene_load(&source);
+
+	// the frames of the reference path, the other paths are held against them
+	std::vector<surface_t*> reference(SCENE_STATES + 1, (surface_t*)NULL);
+	int failed = 0;
+	if (!golden_check_edge_weights()) failed++;
+	if (source.ibl == NULL)
+	{
+		printf("FAIL the scene has no environment, the PBR states are drawn without image based lighting\n");
+		failed++;
+	}
+	for (int p = 0; p < GOLDEN_PATHS; p++)
+	{
+		const golden_path_t* path = &golden_paths[p];
+		if (update && p > 0 && !path->stored) continue;
+		device_t* device = golden_device(&source, path);
+		for (int state = 1; state <= SCENE_STATES; state++)
+		{
+			if (only != 0 && state != only) continue;
+			if (path->taa) device_set_taa(device, 1);
+			if (path->relight) golden_draw(device, path, state, 0.5f);
+			surface_t* out = device->output;
+			if (path->region_width > 0)
+			{
+				out = surface_create(GOLDEN_WIDTH, GOLDEN_HEIGHT, SURFACE_FORMAT_XRGB32, NULL, 0);
+				golden_draw_regions(device, path, state, out);
+			}
+			else for (int frame = 0; frame < (path->taa ? TAA_JITTER_PHASES : 1); frame++) golden_draw(device, path, state, 0.0f);
+			if (p == 0)
+			{
+				reference[state] = surface_create(GOLDEN_WIDTH, GOLDEN_HEIGHT, SURFACE_FORMAT_XRGB32, NULL, 0);
+				for (int y = 0; y < GOLDEN_HEIGHT; y++) memcpy(surface_row_u32(reference[state], y), surface_row_u32(out, y), GOLDEN_WIDTH * 4);
+			}
+			if (p == 0 || path->stored)
+			{
+				std::string file = golden_file(dir, path, state);
+				if (update)
+				{
+					if (!image_write(file.c_str(), out, IMAGE_FORMAT_PNG)) { printf("can't write %s\n", file.c_str()); failed++; }
+					else printf("wrote %s\n", file.c_str());
+					continue;
+				}
+				// a path compares with its own images as tight as the reference path does
+				golden_path_t own = *path;
+				own.psnr = golden_paths[0].psnr;
+				own.max_error = golden_paths[0].max_error;
+				surface_t* golden = image_read(file.c_str());
+				if (golden == NULL || golden->width != GOLDEN_WIDTH || golden->height != GOLDEN_HEIGHT)
+				{
+					printf("FAIL %s is missing or not %dx%d, run with -update\n", file.c_str(), GOLDEN_WIDTH, GOLDEN_HEIGHT);
+					failed++;
+				}
+				else if (!golden_check("golden", &own, state, out, golden, diff)) failed++;
+				surface_destory(golden);
+			}
+			if (p > 0 && !golden_check("reference", path, state, out, reference[state], diff)) failed++;
+			if (p > 0 && path->ssao && state == GOLDEN_SSAO_STATE && !golden_check_occluded(path, state, out, reference[state])) failed++;
+			if (p > 0 && path->tiles > 0 && !path->taa && !golden_check_threads(device, path, state)) failed++;
+			if (out != device->output) surface_destory(out);
+		}
+		if (path->ibl) ibl_destory(device->ibl);
+		device_destory(device);
+		delete device;
+	}
+	if (!update && !golden_check_bound_pipeline(&source, diff)) failed++;
+	if (!update && !golden_check_skin(&source, diff)) failed++;
+	if (!update && !golden_check_multiview(&source, only, diff)) failed++;
+	s_simd_select(golden_simd_best);
+	if (!update && !golden_check_codec(reference)) failed++;
+	for (size_t i = 0; i < reference.size(); i++) surface_destory(reference[i]);
+	device_destory(&source);
+	if (failed > 0)
+	{
+		printf("%d frames failed\n", failed);
+		return 1;
+	}
+	printf("all frames passed\n");
+	return 0;
+}
@@ -0,0 +1,162 @@
+#include "hdr.h"
+#include "job.h"
+#include <cmath>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#define HDR_SSE 1
+#endif
+
+// 4x4 ordered dither, (rank + 0.5) / 16 of the bayer matrix, added before the channels are truncated
+static const float hdr_bayer[4][4] = {
+	{ 0.5f / 16, 8.5f / 16, 2.5f / 16, 10.5f / 16 },
+	{ 12.5f / 16, 4.5f / 16, 14.5f / 16, 6.5f / 16 },
+	{ 3.5f / 16, 11.5f / 16, 1.5f / 16, 9.5f / 16 },
+	{ 15.5f / 16, 7.5f / 16, 13.5f / 16, 5.5f / 16 },
+};
+
+hdr_t* hdr_create()
+{
+	hdr_t* hdr = new hdr_t;
+	hdr->color = NULL;
+	hdr->exposure = 1.0f;
+	hdr->active = 0;
+	for (int i = 0; i < 256; i++) hdr->radiance[i] = 0.0f;
+	return hdr;
+}
+
+void hdr_destory(hdr_t* hdr)
+{
+	if (hdr == NULL) return;
+	surface_destory(hdr->color);
+	delete hdr;
+}
+
+typedef struct
+{
+	hdr_t* hdr;
+	surface_t* target;
+}hdr_pass_t;
+
+// job of hdr_load, rows [begin, end)
+static void hdr_load_rows(void* data, int begin, int end)
+{
+	hdr_pass_t* pass = (hdr_pass_t*)data;
+	const float* radiance = pass->hdr->radiance;
+	for (int y = begin; y < end; y++)
+	{
+		const IUINT32* src = surface_row_u32(pass->target, y);
+		float* dst = hdr_pixel(pass->hdr, 0, y);
+		for (int x = 0; x < pass->target->width; x++, dst += 4)
+		{
+			IUINT32 c = src[x];
+			dst[0] = radiance[(c >> 16) & 0xff];
+			dst[1] = radiance[(c >> 8) & 0xff];
+			dst[2] = radiance[c & 0xff];
+			dst[3] = 0.0f;
+		}
+	}
+}
+
+void hdr_load(hdr_t* hdr, const surface_t* target)
+{
+	if (hdr->color == NULL || hdr->color->width != target->width || hdr->color->height != target->height)
+	{
+		surface_destory(hdr->color);
+		hdr->color = surface_create(target->width, target->height, SURFACE_FORMAT_RGBA32F, NULL, 0);
+	}
+	// x / (x + 1) = d inverts to d / (1 - d), white stops short of 1
+	for (int i = 0; i < 256; i++)
+	{
+		float d = std::min(gamma_decode(i), HDR_WHITE);
+		hdr->radiance[i] = d / (1.0f - d) / hdr->exposure;
+	}
+	hdr_pass_t pass = { hdr, (surface_t*)target };
+	job_parallel_for(job_system(), 0, target->height, HDR_ROWS, hdr_load_rows, &pass);
+}
+
+// exposure, tone map and gamma of one channel, gamma_encode of t in [0, 1)
+static inline float hdr_tonemap(float c, float exposure)
+{
+	c = c * exposure;
+	c = c > 0.0f ? c : 0.0f;
+	c = c < HDR_MAX ? c : HDR_MAX;
+	float t = c / (c + 1.0f);
+	float f = sqrtf(t) * (float)GAMMA_ENCODE_SIZE;
+	int i = (int)f;
+	return gamma_encode_table[i] + (gamma_encode_table[i + 1] - gamma_encode_table[i]) * (f - (float)i);
+}
+
+#ifdef HDR_SSE
+// hdr_tonemap of four values with the same operations
+static inline __m128 hdr_tonemap4(__m128 c, __m128 exposure)
+{
+	c = _mm_min_ps(_mm_max_ps(_mm_mul_ps(c, exposure), _mm_set1_ps(0.0f)), _mm_set1_ps(HDR_MAX));
+	__m128 t = _mm_div_ps(c, _mm_add_ps(c, _mm_set1_ps(1.0f)));
+	__m128 f = _mm_mul_ps(_mm_sqrt_ps(t), _mm_set1_ps((float)GAMMA_ENCODE_SIZE));
+	__m128i i = _mm_cvttps_epi32(f);
+	int index[4];
+	_mm_storeu_si128((__m128i*)index, i);
+	const float* table = gamma_encode_table;
+	__m128 lo = _mm_setr_ps(table[index[0]], table[index[1]], table[index[2]], table[index[3]]);
+	__m128 hi = _mm_setr_ps(table[index[0] + 1], table[index[1] + 1], table[index[2] + 1], table[index[3] + 1]);
+	return _mm_add_ps(lo, _mm_mul_ps(_mm_sub_ps(hi, lo), _mm_sub_ps(f, _mm_cvtepi32_ps(i))));
+}
+#endif
+
+// job of hdr_resolve, rows [begin, end). a tone mapped channel is at most 1 and the dither is below 1,
+// so the truncated channels are at most 255
+static void hdr_tonemap_rows(void* data, int begin, int end)
+{
+	hdr_pass_t* pass = (hdr_pass_t*)data;
+	float exposure = pass->hdr->exposure;
+	int width = pass->target->width;
+	for (int y = begin; y < end; y++)
+	{
+		const float* src = hdr_pixel(pass->hdr, 0, y);
+		IUINT32* dst = surface_row_u32(pass->target, y);
+		const float* dither = hdr_bayer[y & 3];
+		int x = 0;
+#ifdef HDR_SSE
+		// four pixels at a time, transposed to a vector per channel. the dither repeats every four pixels,
+		// so four that are the last four again, the background mostly, pack the same
+		__m128 ex = _mm_set1_ps(exposure), scale = _mm_set1_ps(255.0f), d = _mm_loadu_ps(dither);
+		__m128 last[4];
+		__m128i c = _mm_setzero_si128();
+		for (; x + 4 <= width; x += 4)
+		{
+			__m128 r = _mm_loadu_ps(src + x * 4), g = _mm_loadu_ps(src + x * 4 + 4);
+			__m128 b = _mm_loadu_ps(src + x * 4 + 8), a = _mm_loadu_ps(src + x * 4 + 12);
+			if (x > 0)
+			{
+				__m128 same = _mm_and_ps(_mm_and_ps(_mm_cmpeq_ps(r, last[0]), _mm_cmpeq_ps(g, last[1])), _mm_and_ps(_mm_cmpeq_ps(b, last[2]), _mm_cmpeq_ps(a, last[3])));
+				if (_mm_movemask_ps(same) == 15)
+				{
+					_mm_storeu_si128((__m128i*)(dst + x), c);
+					continue;
+				}
+			}
+			last[0] = r; last[1] = g; last[2] = b; last[3] = a;
+			_MM_TRANSPOSE4_PS(r, g, b, a);
+			__m128i R = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(hdr_tonemap4(r, ex), scale), d));
+			__m128i G = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(hdr_tonemap4(g, ex), scale), d));
+			__m128i B = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(hdr_tonemap4(b, ex), scale), d));
+			c = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(R, 16), _mm_slli_epi32(G, 8)), B);
+			_mm_storeu_si128((__m128i*)(dst + x), c);
+		}
+#endif
+		for (; x < width; x++)
+		{
+			const float* pixel = src + x * 4;
+			int q[3];
+			for (int k = 0; k < 3; k++) q[k] = (int)(hdr_tonemap(pixel[k], exposure) * 255.0f + dither[x & 3]);
+			dst[x] = (q[0] << 16) | (q[1] << 8) | q[2];
+		}
+	}
+}
+
+void hdr_resolve(hdr_t* hdr, surface_t* target)
+{
+	hdr_pass_t pass = { hdr, target };
+	job_parallel_for(job_system(), 0, target->height, HDR_ROWS, hdr_tonemap_rows, &pass);
+}
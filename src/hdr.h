@@ -0,0 +1,78 @@
+#ifndef hdr_h
+#define hdr_h
+//=====================================================================
+// HDR colour target: the PBR shaders leave out their tone map and the
+// fragments write linear radiance as floats. the other shaders shade in
+// display colour and write the radiance the tone map takes back to it,
+// so they look as before whatever the exposure. device_resolve runs one
+// post pass over the rows on the job system: exposure, x / (x + 1), the
+// gamma table of gamma.h, an ordered dither and the pack into the XRGB32
+// colour target. frames with samples, a tracer or wire frames keep
+// shading into the colour target, they write it without the shaders.
+//=====================================================================
+#include "render.h"
+#include "gamma.h"
+#include <algorithm>
+
+#define HDR_WHITE 0.99999f   // the largest tone mapped value display colour turns into, 1 has no radiance
+#define HDR_MAX 65504.0f     // radiance is clamped to [0, HDR_MAX] before the tone map
+#define HDR_ROWS 16          // rows per job of the passes
+
+struct hdr_t
+{
+	surface_t* color;        // SURFACE_FORMAT_RGBA32F, r g b and an a that stays 0
+	float exposure;          // radiance is multiplied with it before the tone map, hdr_load divides the background by it
+	int active;              // the frame since device_clear is shaded into color
+	float radiance[256];     // of a display channel value, with the exposure of the frame
+};
+
+hdr_t* hdr_create();
+
+void hdr_destory(hdr_t* hdr);
+
+// with device_clear: size color like target and load the background of target into it
+void hdr_load(hdr_t* hdr, const surface_t* target);
+
+// the post pass: tone map color into target
+void hdr_resolve(hdr_t* hdr, surface_t* target);
+
+inline bool hdr_active(const hdr_t* hdr)
+{
+	return hdr != NULL && hdr->active;
+}
+
+inline float* hdr_pixel(const hdr_t* hdr, int x, int y)
+{
+	return surface_row_f32(hdr->color, y) + x * 4;
+}
+
+// write a shaded colour, radiance or display colour in [0, 1]
+inline void hdr_store(const hdr_t* hdr, float* pixel, const s_color& color, bool radiance)
+{
+	if (radiance)
+	{
+		pixel[0] = color.r;
+		pixel[1] = color.g;
+		pixel[2] = color.b;
+		return;
+	}
+	// the channel value the colour target would hold
+	int c[3] = { (int)(color.r * 255.0f), (int)(color.g * 255.0f), (int)(color.b * 255.0f) };
+	for (int i = 0; i < 3; i++) pixel[i] = hdr->radiance[std::min(std::max(c[i], 0), 255)];
+}
+
+// the display colour of a pixel without the dither, what the blending shaders read
+inline void hdr_display(const hdr_t* hdr, const float* pixel, s_vector& out)
+{
+	float c[3];
+	for (int i = 0; i < 3; i++)
+	{
+		float x = pixel[i] * hdr->exposure;
+		x = x > 0.0f ? x : 0.0f;
+		x = x < HDR_MAX ? x : HDR_MAX;
+		c[i] = gamma_encode(x / (x + 1.0f));
+	}
+	out.reset(c[0], c[1], c[2], 0.0f);
+}
+
+#endif
@@ -0,0 +1,643 @@
+//=====================================================================
+// headless renderer: draws the demo scene into a framebuffer of its
+// own, with no window, and writes every frame as an image file
+//   HEADLESS_RENDER -size 1920 1080 -state 6 -frames 30 -turn 0.02 -out shots/ball
+// a view list replays cameras instead of the state presets, one view
+// per line, # starts a comment, m1 and m2 may be left out
+//   state eye.x eye.y eye.z at.x at.y at.z alpha [m1 m2]
+// -present draws the views into the buffers of a present backend and
+// shows them instead of writing files, -stereo draws every view as a
+// pair of eyes that share the vertex work of the frame
+// -serve makes a worker of a render farm that draws the regions of the
+// frames a coordinator started with -nodes hands it, see distribute.h
+// -bands draws frames too large for memory a band of rows at a time
+//   HEADLESS_RENDER -size 16384 16384 -bands 256 -state 6 -out poster
+//   HEADLESS_RENDER -serve 7411 -deferred          on every node
+//   HEADLESS_RENDER -nodes a:7411,b:7411 -size 3840 2160 -out shots/ball
+// the frames are drawn by batch_render on every core. they don't depend
+// on the thread count, -hash keeps their hashes so a later run skips
+// writing the ones that didn't change
+//=====================================================================
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include "render.h"
+#include "scene.h"
+#include "post.h"
+#include "coarse.h"
+#include "scene_assets.h"
+#include "texture.h"
+#include "image_file.h"
+#include "batch.h"
+#include "upscale.h"
+#include "profile.h"
+#include "msaa.h"
+#include "relight.h"
+#include "present.h"
+#include "swap_chain.h"
+#include "memory_track.h"
+#include "multiview.h"
+#include "distribute.h"
+
+static void usage(const char* name)
+{
+	printf("usage: %s [options]\n", name);
+	printf("  -size W H           framebuffer size, 800 600\n");
+	printf("  -state N            state 1..%d with its camera preset, 0 for all of them (default)\n", SCENE_STATES);
+	printf("  -views FILE         render the views of FILE instead of the presets\n");
+	printf("  -scene FILE         read the states from FILE, %s\n", SCENE_FILE_DEFAULT);
+	printf("  -threads N          worker threads, 0 for one per hardware thread (default)\n");
+	printf("  -frames N           frames of each view, 1\n");
+	printf("  -turn A             added to the rotation of the objects after every frame, 0\n");
+	printf("  -format png|exr|ppm image format, png\n");
+	printf("  -out PREFIX         files are PREFIX_VIEW_FRAME.ext, frame\n");
+	printf("  -y4m PATH|\"|CMD\"    one yuv4mpeg2 stream of every frame instead of files, |CMD pipes it to CMD\n");
+	printf("  -fps N              frame rate of -y4m, 30\n");
+	printf("  -filter nearest|bilinear|trilinear  texture filter, trilinear\n");
+	printf("  -scale S            draw at S (%.2f..1) times the size and scale up, 1\n", RENDER_SCALE_MIN);
+	printf("  -upscale bilinear|edge  filter of -scale, bilinear\n");
+	printf("  -profile            print the stage times and counters of every worker, needs SIMPLERENDER_PROFILE\n");
+	printf("  -taa                temporal anti-aliasing over the frames of each view, draws on one thread\n");
+	printf("  -lod                draw the meshes at the level of detail of their size on screen\n");
+	printf("  -occlusion          skip the objects the occluders hide in a small depth buffer\n");
+	printf("  -raytrace N         ray trace the frames with N samples per pixel\n");
+	printf("  -texture-budget MB  stream the levels of the mounted textures within MB, draws on one thread\n");
+	printf("  -compress           block compress the textures, BC1 and BC3 colour, BC4 grey and orm channels, BC5 normal maps\n");
+	printf("  -msaa               %d samples per pixel, only with -edge or -quad\n", MSAA_SAMPLES);
+	printf("  -depth 16|24|32     bits of the depth buffer, 16 and 24 are integers, 32\n");
+	printf("  -relight            shade a frame whose geometry and camera didn't change from the G-buffer of the last, implies -deferred\n");
+	printf("  -ssao               screen space ambient occlusion at half resolution, implies -deferred\n");
+	printf("  -coarse auto|2|4    shade smooth rough tiles, or every tile, once per 2x2 or 4x4 block, implies -deferred\n");
+	printf("  -hdr                shade into a float colour target and tone map it once per frame\n");
+	printf("  -exposure E         radiance multiplier of the tone map of -hdr, 1\n");
+	printf("  -bloom              blur the radiance above 8 and add it back before the tone map, implies -hdr\n");
+	printf("  -fxaa               smooth the edges of the finished frames\n");
+	printf("  -grade FILE         colour grade the frames with the 3D LUT of a .cube file\n");
+	printf("  -vignette S         darken the corners by S (0..1)\n");
+	printf("  -stereo D           every view as a left and a right eye D apart, PREFIX_VIEW_FRAME_l.ext and _r.ext, draws the eyes together\n");
+	printf("  -present null|x11   show the frames through a present backend instead of writing them, draws on one thread\n");
+	printf("  -serve PORT         draw the regions of the frames of coordinators on PORT, the scene and modes are this node's\n");
+	printf("  -nodes HOST:PORT,.. draw the frames on the workers of -serve, their regions balanced by the times of the last frame\n");
+	printf("  -pipeline           draw the next frame of a worker while the last one is resolved and written, two devices per worker\n");
+	printf("  -bands N            draw the frames in bands of N rows and write each band when it is done, targets for a band only\n");
+	printf("  -memory             print the live and peak bytes of the textures, meshes, targets and scratch memory\n");
+	printf("  -hash FILE          frame hashes of the last run, the files of unchanged frames are not written again\n");
+	printf("  -edge  -quad  -deferred  -prepass  -tiles N\n");
+}
+
+static bool read_views(const char* path, std::vector<batch_view_t>& views)
+{
+	FILE* fp = fopen(path, "r");
+	if (fp == NULL) return false;
+	char line[512];
+	int number = 0;
+	bool ok = true;
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		number++;
+		char* comment = strchr(line, '#');
+		if (comment != NULL) *comment = 0;
+		batch_view_t v;
+		float e[3], a[3];
+		v.m1 = v.m2 = -1.0f;
+		int n = sscanf(line, "%d %f %f %f %f %f %f %f %f %f", &v.state, &e[0], &e[1], &e[2], &a[0], &a[1], &a[2], &v.alpha, &v.m1, &v.m2);
+		if (n <= 0) continue;
+		if ((n != 8 && n != 10) || v.state < 1 || v.state > SCENE_STATES)
+		{
+			printf("%s:%d: expected state eye.x eye.y eye.z at.x at.y at.z alpha [m1 m2]\n", path, number);
+			ok = false;
+			break;
+		}
+		s_vector eye(e[0], e[1], e[2], 1.0f), at(a[0], a[1], a[2], 1.0f);
+		v.eye = eye;
+		v.at = at;
+		v.preset = 0;
+		views.push_back(v);
+	}
+	fclose(fp);
+	return ok;
+}
+
+// the lines "HASH PATH" of -hash, empty when the file is missing
+static void read_hashes(const char* path, std::map<std::string, unsigned long long>& hashes)
+{
+	FILE* fp = fopen(path, "r");
+	if (fp == NULL) return;
+	char line[1200], name[1100];
+	unsigned long long hash;
+	while (fgets(line, sizeof(line), fp) != NULL)
+		if (sscanf(line, "%llx %1099s", &hash, name) == 2) hashes[name] = hash;
+	fclose(fp);
+}
+
+static bool write_hashes(const char* path, const std::vector<batch_view_t>& views, const std::vector<unsigned long long>& hashes)
+{
+	FILE* fp = fopen(path, "w");
+	if (fp == NULL) return false;
+	for (size_t i = 0; i < views.size(); i++) fprintf(fp, "%016llx %s\n", hashes[i], views[i].path.c_str());
+	return fclose(fp) == 0;
+}
+
+static void headless_show(const surface_t* buffer, void* user)
+{
+	present_show((present_t*)user, buffer);
+}
+
+// draws the views straight into the buffers of the backend while the last one is shown, returns the
+// number shown or -1 when the backend can't be opened
+static int headless_present(device_t* device, int kind, const std::vector<batch_view_t>& views)
+{
+	present_t* present = present_create(kind, device->output_width, device->output_height, 2, NULL);
+	if (present == NULL)
+	{
+		printf("can't open the present backend, it needs a display and a build with it\n");
+		return -1;
+	}
+	swap_chain_t* chain = swap_chain_create_on(present->buffers, headless_show, present);
+	auto t0 = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < views.size(); i++)
+	{
+		present_poll(present);
+		if (present->closed) break;
+		surface_t* back = swap_chain_acquire(chain);
+		device_set_framebuffer(device, back->pixels, back->pitch);
+		batch_draw(device, views[i]);
+		swap_chain_submit(chain);
+	}
+	swap_chain_destory(chain);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+	int shown = present->presented;
+	printf("%d frames of %dx%d shown in %.1f ms, %.2f ms per frame, %s buffers\n", shown, present->width, present->height, ms,
+		shown > 0 ? ms / shown : 0.0, present->shared ? "shared" : "copied");
+	// the device must not keep pointing at the buffers
+	device_set_framebuffer(device, NULL, 0);
+	present_destory(present);
+	return shown;
+}
+
+// coordinator of -nodes: draws the views on the workers and writes them like batch_render, returns the number written
+// or -1 when no node answers
+static int headless_distribute(const char* nodes, int width, int height, const std::vector<batch_view_t>& views, const char* y4m, int fps)
+{
+	distribute_t* d = distribute_connect(nodes, width, height);
+	if (d == NULL)
+	{
+		printf("no node of %s answers\n", nodes);
+		return -1;
+	}
+	for (size_t n = 0; n < d->nodes.size(); n++)
+		if (d->nodes[n].socket == NET_INVALID) printf("node %s:%d doesn't answer, going on without it\n", d->nodes[n].host.c_str(), d->nodes[n].port);
+	frame_stream_t* stream = y4m != NULL ? frame_stream_open(FRAME_STREAM_Y4M, y4m, width, height, fps) : frame_stream_open(FRAME_STREAM_IMAGES, NULL, 0, 0, 0);
+	if (stream == NULL)
+	{
+		printf("can't open %s\n", y4m);
+		distribute_destory(d);
+		return -1;
+	}
+	auto t0 = std::chrono::steady_clock::now();
+	int drawn = 0;
+	for (size_t i = 0; i < views.size(); i++)
+	{
+		if (!distribute_render(d, views[i]))
+		{
+			printf("every node is gone\n");
+			break;
+		}
+		int format = image_format_of(views[i].path.c_str());
+		frame_stream_push(stream, (int)i, d->frame, views[i].path.c_str(), format < 0 ? IMAGE_FORMAT_PPM : format);
+		drawn++;
+	}
+	frame_stream_flush(stream);
+	int written = stream->written;
+	frame_stream_destory(stream);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+	printf("%d frames of %dx%d in %.1f ms on %d nodes, %.2f ms per frame, %d regions of %d pixels drawn again elsewhere\n", drawn, width, height, ms,
+		(int)d->nodes.size(), drawn > 0 ? ms / drawn : 0.0, d->reassigned, DISTRIBUTE_TILE);
+	for (size_t n = 0; n < d->nodes.size(); n++)
+	{
+		const distribute_node_t& node = d->nodes[n];
+		printf("  node %s:%d %lld regions, last frame %.1f ms at speed %.2f, %.1f MB sent as %.1f MB\n", node.host.c_str(), node.port, node.regions,
+			node.ms, node.speed, node.raw / (1024.0 * 1024.0), node.sent / (1024.0 * 1024.0));
+	}
+	distribute_destory(d);
+	return written;
+}
+
+// draws the views as stereo pairs with device as the left eye, returns the number of files written
+static int headless_stereo(device_t* device, const std::vector<batch_view_t>& views, float separation)
+{
+	multiview_t* mv = multiview_create(device, 2);
+	s_vector up(0.0f, 0.0f, 1.0f, 1.0f);
+	int written = 0;
+	auto t0 = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < views.size(); i++)
+	{
+		const batch_view_t& view = views[i];
+		s_vector eye, at;
+		float alpha;
+		// the presets were taken when the views were made, this only sets the state and its values
+		scene_view(device, view.state, eye, at, alpha);
+		if (view.m1 >= 0.0f) device->m1 = view.m1;
+		if (view.m2 >= 0.0f) device->m2 = view.m2;
+		s_vector e = view.eye, target;
+		target.add_two(e, view.at);
+		multiview_set_stereo(mv, e, target, up, separation);
+		multiview_begin(mv, 1);
+		draw_box(device, view.alpha);
+		multiview_end(mv);
+		// the eyes go next to the file of the view
+		std::string path = view.path;
+		size_t dot = path.rfind('.');
+		if (dot == std::string::npos) dot = path.size();
+		int format = image_format_of(path.c_str());
+		for (int eye_index = 0; eye_index < 2; eye_index++)
+		{
+			std::string file = path.substr(0, dot) + (eye_index == 0 ? "_l" : "_r") + path.substr(dot);
+			if (image_write(file.c_str(), mv->views[eye_index]->output, format < 0 ? IMAGE_FORMAT_PPM : format)) written++;
+			else printf("can't write %s\n", file.c_str());
+		}
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+	printf("%d stereo frames of %dx%d in %.1f ms, %.2f ms per pair, %lld vertices shaded once for both eyes\n", (int)views.size(),
+		device->output_width, device->output_height, ms, views.empty() ? 0.0 : ms / views.size(), mv->shaded);
+	multiview_destory(mv);
+	return written;
+}
+
+int main(int argc, char** argv)
+{
+	int width = 800, height = 600, state = 0, frames = 1, format = IMAGE_FORMAT_PNG, tiles = 0;
+	int filter = TEXTURE_FILTER_TRILINEAR, raster = RASTER_MODE_SCANLINE, flags = 0, threads = 0, msaa = 1, taa = 0, depth = SURFACE_FORMAT_DEPTH32;
+	int upscale = UPSCALE_BILINEAR, profile = 0, lod = 0, occlusion = 0, raytrace = 0, texture_budget = -1, relight = 0, hdr = 0, effects = 0, ssao = 0, coarse = 0, present = -1, memory = 0, pipeline = 0, compress = 0;
+	float turn = 0.0f, scale = 1.0f, exposure = 1.0f, vignette = 0.0f, stereo = 0.0f;
+	const char* views_path = NULL;
+	const char* prefix = "frame";
+	const char* y4m = NULL;
+	const char* hash_path = NULL;
+	const char* grade = NULL;
+	const char* nodes = NULL;
+	int fps = 30, serve = 0, bands = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		bool has1 = i + 1 < argc, has2 = i + 2 < argc;
+		if (strcmp(arg, "-size") == 0 && has2) { width = atoi(argv[i + 1]); height = atoi(argv[i + 2]); i += 2; }
+		else if (strcmp(arg, "-state") == 0 && has1) state = atoi(argv[++i]);
+		else if (strcmp(arg, "-views") == 0 && has1) views_path = argv[++i];
+		else if (strcmp(arg, "-scene") == 0 && has1) scene_set_file(argv[++i]);
+		else if (strcmp(arg, "-threads") == 0 && has1) threads = atoi(argv[++i]);
+		else if (strcmp(arg, "-frames") == 0 && has1) frames = atoi(argv[++i]);
+		else if (strcmp(arg, "-turn") == 0 && has1) turn = (float)atof(argv[++i]);
+		else if (strcmp(arg, "-format") == 0 && has1) format = image_format_of(argv[++i]);
+		else if (strcmp(arg, "-out") == 0 && has1) prefix = argv[++i];
+		else if (strcmp(arg, "-y4m") == 0 && has1) y4m = argv[++i];
+		else if (strcmp(arg, "-fps") == 0 && has1) fps = atoi(argv[++i]);
+		else if (strcmp(arg, "-hash") == 0 && has1) hash_path = argv[++i];
+		else if (strcmp(arg, "-filter") == 0 && has1)
+		{
+			const char* name = argv[++i];
+			if (strcmp(name, "nearest") == 0) filter = TEXTURE_FILTER_NEAREST;
+			else if (strcmp(name, "bilinear") == 0) filter = TEXTURE_FILTER_BILINEAR;
+			else if (strcmp(name, "trilinear") == 0) filter = TEXTURE_FILTER_TRILINEAR;
+			else filter = -1;
+		}
+		else if (strcmp(arg, "-scale") == 0 && has1) scale = (float)atof(argv[++i]);
+		else if (strcmp(arg, "-upscale") == 0 && has1)
+		{
+			const char* name = argv[++i];
+			if (strcmp(name, "bilinear") == 0) upscale = UPSCALE_BILINEAR;
+			else if (strcmp(name, "edge") == 0) upscale = UPSCALE_EDGE;
+			else upscale = -1;
+		}
+		else if (strcmp(arg, "-profile") == 0) profile = 1;
+		else if (strcmp(arg, "-memory") == 0) memory = 1;
+		else if (strcmp(arg, "-edge") == 0) raster = RASTER_MODE_EDGE;
+		else if (strcmp(arg, "-quad") == 0) raster = RASTER_MODE_QUAD;
+		else if (strcmp(arg, "-msaa") == 0) msaa = MSAA_SAMPLES;
+		else if (strcmp(arg, "-depth") == 0 && has1)
+		{
+			const char* name = argv[++i];
+			depth = strcmp(name, "16") == 0 ? SURFACE_FORMAT_DEPTH16 : strcmp(name, "24") == 0 ? SURFACE_FORMAT_DEPTH24 : strcmp(name, "32") == 0 ? SURFACE_FORMAT_DEPTH32 : -1;
+		}
+		else if (strcmp(arg, "-taa") == 0) taa = 1;
+		else if (strcmp(arg, "-lod") == 0) lod = 1;
+		else if (strcmp(arg, "-occlusion") == 0) occlusion = 1;
+		else if (strcmp(arg, "-raytrace") == 0 && has1) raytrace = atoi(argv[++i]);
+		else if (strcmp(arg, "-texture-budget") == 0 && has1) texture_budget = atoi(argv[++i]);
+		else if (strcmp(arg, "-deferred") == 0) flags |= RENDER_STATE_DEFERRED;
+		else if (strcmp(arg, "-relight") == 0) { relight = 1; flags |= RENDER_STATE_DEFERRED; }
+		else if (strcmp(arg, "-ssao") == 0) { ssao = 1; flags |= RENDER_STATE_DEFERRED; }
+		else if (strcmp(arg, "-coarse") == 0 && has1)
+		{
+			const char* name = argv[++i];
+			coarse = strcmp(name, "auto") == 0 ? 1 : strcmp(name, "2") == 0 ? 2 : strcmp(name, "4") == 0 ? 4 : -1;
+			flags |= RENDER_STATE_DEFERRED;
+		}
+		else if (strcmp(arg, "-hdr") == 0) hdr = 1;
+		else if (strcmp(arg, "-exposure") == 0 && has1) exposure = (float)atof(argv[++i]);
+		else if (strcmp(arg, "-bloom") == 0) { hdr = 1; effects |= POST_BLOOM; }
+		else if (strcmp(arg, "-fxaa") == 0) effects |= POST_FXAA;
+		else if (strcmp(arg, "-grade") == 0 && has1) { grade = argv[++i]; effects |= POST_GRADE; }
+		else if (strcmp(arg, "-vignette") == 0 && has1) { vignette = (float)atof(argv[++i]); effects |= POST_VIGNETTE; }
+		else if (strcmp(arg, "-stereo") == 0 && has1)
+		{
+			stereo = (float)atof(argv[++i]);
+			if (!(stereo > 0.0f)) { usage(argv[0]); return 1; }
+		}
+		else if (strcmp(arg, "-present") == 0 && has1)
+		{
+			present = present_kind_of(argv[++i]);
+			if (present < 0) { usage(argv[0]); return 1; }
+		}
+		else if (strcmp(arg, "-pipeline") == 0) pipeline = 1;
+		else if (strcmp(arg, "-compress") == 0) compress = 1;
+		else if (strcmp(arg, "-bands") == 0 && has1) bands = atoi(argv[++i]);
+		else if (strcmp(arg, "-serve") == 0 && has1) serve = atoi(argv[++i]);
+		else if (strcmp(arg, "-nodes") == 0 && has1) nodes = argv[++i];
+		else if (strcmp(arg, "-prepass") == 0) flags |= RENDER_STATE_DEPTH_PREPASS;
+		else if (strcmp(arg, "-tiles") == 0 && has1) tiles = atoi(argv[++i]);
+		else { usage(argv[0]); return 1; }
+	}
+	if (width <= 0 || height <= 0 || frames <= 0 || threads < 0 || format < 0 || filter < 0 || upscale < 0 || scale < RENDER_SCALE_MIN || scale > 1.0f || state < 0 || state > SCENE_STATES || raytrace < 0 || fps <= 0 || !(exposure > 0.0f) || !(vignette >= 0.0f && vignette <= 1.0f) || coarse < 0 || depth < 0 || serve < 0 || serve > 65535 || bands < 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	// a band is written as soon as it is drawn, no whole frame is ever kept
+	if (bands >= height) bands = 0;
+	if (bands > 0 && (taa || relight || stereo > 0.0f || present >= 0 || serve > 0 || nodes != NULL || y4m != NULL || hash_path != NULL))
+	{
+		printf("-bands writes image files band by band, not with -taa, -relight, -stereo, -present, -serve, -nodes, -y4m or -hash\n");
+		return 1;
+	}
+	// the screen space effects only see the band they are drawn with and a band at a lower scale starts between pixels,
+	// either would leave seams between the bands
+	if (bands > 0 && (ssao || (effects & (POST_BLOOM | POST_FXAA | POST_VIGNETTE)) || scale < 1.0f))
+	{
+		printf("-bands draws every band on its own, not with -ssao, -bloom, -fxaa, -vignette or -scale below 1\n");
+		return 1;
+	}
+	// the devices of a worker draw another region every frame, nothing of the frame before is theirs
+	if ((serve > 0 || nodes != NULL) && (taa || relight || stereo > 0.0f || present >= 0 || (serve > 0 && nodes != NULL)))
+	{
+		printf("-serve and -nodes draw every frame on its own, not with -taa, -relight, -stereo, -present or each other\n");
+		return 1;
+	}
+	// the two devices of a worker take turns, neither sees every frame of a view
+	if (pipeline && (taa || texture_budget >= 0 || stereo > 0.0f || present >= 0 || serve > 0 || nodes != NULL || bands > 0))
+	{
+		printf("-pipeline draws the frames of a worker on two devices, not with -taa, -texture-budget, -stereo, -present, -serve, -nodes or -bands\n");
+		return 1;
+	}
+
+	std::vector<batch_view_t> cameras;
+	if (views_path != NULL)
+	{
+		if (!read_views(views_path, cameras))
+		{
+			printf("can't read views from %s\n", views_path);
+			return 1;
+		}
+	}
+	else
+	{
+		for (int s = 1; s <= SCENE_STATES; s++)
+		{
+			if (state != 0 && s != state) continue;
+			batch_view_t v;
+			v.state = s;
+			v.alpha = 0.0f;
+			v.m1 = v.m2 = -1.0f;
+			v.preset = 1;
+			cameras.push_back(v);
+		}
+	}
+
+	// the device owns its framebuffer when it is given none
+	static device_t device;
+	if (serve > 0) device_init(&device, DISTRIBUTE_TILE, DISTRIBUTE_TILE, NULL);
+	else device_init(&device, width, bands > 0 ? bands : height, NULL);
+	device_set_texture_filter(&device, filter);
+	if (compress) device_set_texture_layout(&device, TEXTURE_LAYOUT_BC);
+	device.raster_mode = raster;
+	device_set_upscale_filter(&device, upscale);
+	device_set_render_scale(&device, scale);
+	device_set_msaa(&device, msaa);
+	device_set_depth_format(&device, depth);
+	device_set_lod(&device, lod);
+	device_set_occlusion(&device, occlusion);
+	device_set_raytrace(&device, raytrace);
+	if (texture_budget >= 0) device_set_texture_budget(&device, texture_budget);
+	// the presets and the state of draw_box have to be set before the scene loads
+	s_vector eye, at;
+	float alpha = 0.0f;
+	scene_view(&device, cameras.empty() ? 1 : cameras[0].state, eye, at, alpha);
+	// a coordinator only needs the cameras
+	if (nodes == NULL) scene_load(&device);
+	device.render_state = RENDER_STATE_TEXTURE | flags;
+
+	// every frame of every camera is a view of its own, the rotation turns from frame to frame
+	std::vector<batch_view_t> views;
+	for (size_t i = 0; i < cameras.size(); i++)
+	{
+		batch_view_t v = cameras[i];
+		if (v.preset)
+		{
+			scene_view(&device, v.state, eye, at, v.alpha);
+			v.eye = eye;
+			v.at = at;
+			v.preset = 0;
+		}
+		float start = v.alpha;
+		for (int f = 0; f < frames; f++)
+		{
+			char path[1024];
+			snprintf(path, sizeof(path), "%s_%d_%04d%s", prefix, views_path != NULL ? (int)i : v.state, f, image_format_extension(format));
+			v.path = path;
+			v.alpha = start + turn * f;
+			views.push_back(v);
+		}
+	}
+
+	if (nodes != NULL)
+	{
+		int written = headless_distribute(nodes, width, height, views, y4m, fps);
+		device_destory(&device);
+		return written == (int)views.size() ? 0 : 1;
+	}
+
+	// the history of a worker has to be the frame before, so the frames are drawn in order
+	// and the streamed textures are updated by the device that clears, while no other one draws
+	if (taa || texture_budget >= 0 || present >= 0 || stereo > 0.0f) threads = 1;
+	int workers = threads > 0 ? threads : -1;
+	// a worker of a pipeline keeps about two threads busy
+	if (pipeline) workers = 2 * (threads > 0 ? threads : std::max((int)std::thread::hardware_concurrency() / 2, 1));
+	batch_t* batch = batch_create(&device, workers);
+	batch_set_pipelined(batch, pipeline);
+	if (bands > 0) batch_set_bands(batch, width, height);
+	if (taa)
+	{
+		for (size_t i = 0; i < batch->devices.size(); i++) device_set_taa(batch->devices[i], 1);
+	}
+	if (tiles > 0)
+	{
+		for (size_t i = 0; i < batch->devices.size(); i++) device_set_tile_mode(batch->devices[i], tiles);
+	}
+	if (profile)
+	{
+		for (size_t i = 0; i < batch->devices.size(); i++) device_set_profile(batch->devices[i], 1);
+	}
+	if (relight)
+	{
+		for (size_t i = 0; i < batch->devices.size(); i++) device_set_relight(batch->devices[i], 1);
+	}
+	if (ssao)
+	{
+		for (size_t i = 0; i < batch->devices.size(); i++) device_set_ssao(batch->devices[i], 1);
+	}
+	for (size_t i = 0; i < batch->devices.size() && coarse; i++)
+	{
+		device_t* target = batch->devices[i];
+		device_set_shading_rate(target, SHADING_RATE_AUTO);
+		if (coarse == 1) continue;
+		// one rate for every tile
+		int tiles_x = (target->width + COARSE_TILE - 1) / COARSE_TILE, tiles_y = (target->height + COARSE_TILE - 1) / COARSE_TILE;
+		std::vector<unsigned char> rates(tiles_x * tiles_y, (unsigned char)coarse);
+		device_set_shading_rate_image(target, &rates[0], tiles_x, tiles_y);
+	}
+	if (hdr)
+	{
+		for (size_t i = 0; i < batch->devices.size(); i++)
+		{
+			device_set_hdr(batch->devices[i], 1);
+			device_set_exposure(batch->devices[i], exposure);
+		}
+	}
+	for (size_t i = 0; i < batch->devices.size() && effects; i++)
+	{
+		device_t* target = batch->devices[i];
+		device_set_post(target, effects);
+		target->post->vignette = vignette;
+		if (grade != NULL && !post_load_grade(target->post, grade))
+		{
+			printf("can't read the grade %s\n", grade);
+			batch_destory(batch);
+			device_destory(&device);
+			return 1;
+		}
+	}
+	if (serve > 0)
+	{
+		printf("drawing regions of %dx%d for the coordinators on port %d with %d devices\n", DISTRIBUTE_TILE, DISTRIBUTE_TILE, serve, (int)batch->devices.size());
+		fflush(stdout);
+		distribute_serve(batch, serve);
+		printf("can't listen on port %d\n", serve);
+		batch_destory(batch);
+		device_destory(&device);
+		return 1;
+	}
+	if (y4m != NULL)
+	{
+		batch->stream = frame_stream_open(FRAME_STREAM_Y4M, y4m, device.output_width, device.output_height, fps);
+		if (batch->stream == NULL)
+		{
+			printf("can't open %s\n", y4m);
+			batch_destory(batch);
+			device_destory(&device);
+			return 1;
+		}
+	}
+	if (present >= 0)
+	{
+		int shown = headless_present(batch->devices[0], present, views);
+		batch_destory(batch);
+		device_destory(&device);
+		return shown < 0 ? 1 : 0;
+	}
+	if (stereo > 0.0f)
+	{
+		int pairs = (int)views.size();
+		int written = headless_stereo(batch->devices[0], views, stereo);
+		if (memory) memory_print(stdout);
+		batch_destory(batch);
+		device_destory(&device);
+		return written == pairs * 2 ? 0 : 1;
+	}
+	std::vector<unsigned long long> cached;
+	if (hash_path != NULL)
+	{
+		std::map<std::string, unsigned long long> known;
+		read_hashes(hash_path, known);
+		for (size_t i = 0; i < views.size(); i++)
+		{
+			// a file removed since is written again
+			std::map<std::string, unsigned long long>::const_iterator it = known.find(views[i].path);
+			FILE* fp = it != known.end() ? fopen(views[i].path.c_str(), "rb") : NULL;
+			cached.push_back(fp != NULL ? it->second : 0);
+			if (fp != NULL) fclose(fp);
+		}
+		batch->cached = &cached;
+	}
+	int written = batch_render(batch, views);
+	int drawn = written + batch->unchanged;
+	printf("%d frames of %dx%d in %.1f ms on %d threads, %.2f ms per frame\n", drawn, width, height, batch->ms, (int)batch->devices.size() / (pipeline ? 2 : 1), drawn > 0 ? batch->ms / drawn : 0.0);
+	if (hash_path != NULL)
+	{
+		printf("%d frames unchanged since the last run, not written\n", batch->unchanged.load());
+		if (!write_hashes(hash_path, views, batch->hashes)) printf("can't write %s\n", hash_path);
+	}
+	if (profile)
+	{
+		for (size_t i = 0; i < batch->devices.size(); i++)
+		{
+			printf("worker %d ", (int)i);
+			if (batch->devices[i]->profile != NULL) profile_print(stdout, batch->devices[i]->profile, PROFILE_HISTORY);
+			else printf("profile: built without SIMPLERENDER_PROFILE\n");
+		}
+	}
+	if (texture_budget >= 0)
+	{
+		texture_streamer_t* streamer = device.assets->textures->streamer;
+		texture_stream_stats_t stats = texture_streamer_stats(streamer);
+		printf("streamed textures: %d, %.1f MB resident of %d MB, %lld levels loaded, %lld evicted, %lld misses\n", stats.streams,
+			streamer->resident / (1024.0 * 1024.0), texture_budget, stats.loads, stats.evictions, stats.misses);
+	}
+	if (relight)
+	{
+		int relit = 0;
+		for (size_t i = 0; i < batch->devices.size(); i++) relit += batch->devices[i]->relight->relit;
+		printf("%d frames shaded from the G-buffer of the frame before\n", relit);
+	}
+	if (coarse)
+	{
+		long long shaded = 0, taken = 0;
+		for (size_t i = 0; i < batch->devices.size(); i++)
+		{
+			shaded += batch->devices[i]->coarse->shaded;
+			taken += batch->devices[i]->coarse->taken;
+		}
+		printf("coarse shading: %lld samples shaded, %lld took the colour of their block\n", shaded, taken);
+	}
+	if (memory) memory_print(stdout);
+	int failed = batch->failed;
+	// every frame was pushed, the encoder gets the end of the stream
+	if (batch->stream != NULL)
+	{
+		frame_stream_destory(batch->stream);
+		batch->stream = NULL;
+	}
+	batch_destory(batch);
+	device_destory(&device);
+	if (failed > 0)
+	{
+		printf("%d files could not be written\n", failed);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,56 @@
+#include "hiz.h"
+#include <algorithm>
+#include <cstring>
+
+hiz_t* hiz_create(int width, int height)
+{
+	hiz_t* hiz = new hiz_t;
+	hiz->blocks_x = (width + HIZ_BLOCK - 1) / HIZ_BLOCK;
+	hiz->blocks_y = (height + HIZ_BLOCK - 1) / HIZ_BLOCK;
+	hiz->zmin.resize(hiz->blocks_x * hiz->blocks_y);
+	hiz->dirty.resize(hiz->blocks_x * hiz->blocks_y);
+	hiz_clear(hiz);
+	return hiz;
+}
+
+void hiz_destory(hiz_t* hiz)
+{
+	delete hiz;
+}
+
+void hiz_clear(hiz_t* hiz)
+{
+	std::fill(hiz->zmin.begin(), hiz->zmin.end(), 0.0f);
+	std::fill(hiz->dirty.begin(), hiz->dirty.end(), 0);
+	hiz->tris_rejected = 0;
+	hiz->blocks_rejected = 0;
+}
+
+float hiz_block_min(hiz_t* hiz, const surface_t* depth, int bx, int by)
+{
+	int index = by * hiz->blocks_x + bx;
+	if (!hiz->dirty[index]) return hiz->zmin[index];
+	int x0 = bx * HIZ_BLOCK, y0 = by * HIZ_BLOCK;
+	int x1 = std::min(x0 + HIZ_BLOCK, depth->width), y1 = std::min(y0 + HIZ_BLOCK, depth->height);
+	float m = 1e30f;
+	for (int y = y0; y < y1; y++)
+	{
+		const float* row = surface_row_f32(depth, y);
+		for (int x = x0; x < x1; x++) m = std::min(m, row[x]);
+	}
+	hiz->zmin[index] = m;
+	hiz->dirty[index] = 0;
+	return m;
+}
+
+bool hiz_rect_hidden(hiz_t* hiz, const surface_t* depth, int x0, int y0, int x1, int y1, float zmax)
+{
+	x0 = std::max(x0, 0); y0 = std::max(y0, 0);
+	x1 = std::min(x1, depth->width - 1); y1 = std::min(y1, depth->height - 1);
+	if (x0 > x1 || y0 > y1) return false;
+	zmax *= 1.0f + HIZ_EPSILON;
+	for (int by = y0 / HIZ_BLOCK; by <= y1 / HIZ_BLOCK; by++)
+		for (int bx = x0 / HIZ_BLOCK; bx <= x1 / HIZ_BLOCK; bx++)
+			if (zmax >= hiz_block_min(hiz, depth, bx, by)) return false;
+	return true;
+}
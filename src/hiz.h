@@ -0,0 +1,47 @@
+#ifndef hiz_h
+#define hiz_h
+//=====================================================================
+// hierarchical z: the farthest depth of every HIZ_BLOCK x HIZ_BLOCK
+// block of the depth surface. depth only ever gets nearer during a
+// frame, so a stale block value is still a safe bound and blocks are
+// only rescanned when they were written since the last query.
+//=====================================================================
+#include "render.h"
+#include <vector>
+#include <atomic>
+
+#define HIZ_BLOCK RASTER_BLOCK
+// relative margin on the nearest depth of a triangle, covers the rounding
+// of the scanline barycentrics and of the edge function weights
+#define HIZ_EPSILON 1e-3f
+
+struct hiz_t
+{
+	int blocks_x, blocks_y;
+	std::vector<float> zmin;            // farthest 1/z of each block, 0 when anything in it is empty
+	std::vector<unsigned char> dirty;   // written since zmin was computed
+	std::atomic<int> tris_rejected;     // counters since the last hiz_clear
+	std::atomic<int> blocks_rejected;
+};
+
+hiz_t* hiz_create(int width, int height);
+
+void hiz_destory(hiz_t* hiz);
+
+// call with the depth clear
+void hiz_clear(hiz_t* hiz);
+
+// flag the block of a written pixel
+inline void hiz_mark(hiz_t* hiz, int x, int y)
+{
+	hiz->dirty[(y / HIZ_BLOCK) * hiz->blocks_x + x / HIZ_BLOCK] = 1;
+}
+
+// current farthest depth of block (bx, by), rescanning the depth surface if it is dirty
+float hiz_block_min(hiz_t* hiz, const surface_t* depth, int bx, int by);
+
+// true when nothing with a depth of at most zmax (1/z, larger is nearer) can pass the depth
+// test anywhere in the pixel rectangle [x0, x1] x [y0, y1]
+bool hiz_rect_hidden(hiz_t* hiz, const surface_t* depth, int x0, int y0, int x1, int y1, float zmax);
+
+#endif
@@ -0,0 +1,380 @@
+#include "ibl.h"
+#include "stb_image.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#define IBL_PI 3.14159265f
+
+// direction of the texel center (x, y) of a w x h equirectangular level
+static void ibl_texel_dir(int x, int y, int w, int h, float* d)
+{
+	float phi = ((x + 0.5f) / w) * 2.0f * IBL_PI - IBL_PI;
+	float theta = ((y + 0.5f) / h) * IBL_PI;
+	float s = sinf(theta);
+	d[0] = s * cosf(phi);
+	d[1] = cosf(theta);
+	d[2] = s * sinf(phi);
+}
+
+// bilinear fetch of an rgb equirectangular level, x wraps around and y is clamped
+static void ibl_sample(const float* level, int w, int h, float dx, float dy, float dz, float* rgb)
+{
+	float len = sqrtf(dx * dx + dy * dy + dz * dz);
+	if (len <= 0.0f) { rgb[0] = rgb[1] = rgb[2] = 0.0f; return; }
+	float y_dir = CMID(dy / len, -1.0f, 1.0f);
+	float u = (atan2f(dz, dx) + IBL_PI) / (2.0f * IBL_PI);
+	float v = acosf(y_dir) / IBL_PI;
+	float fx = u * w - 0.5f, fy = v * h - 0.5f;
+	int x0 = (int)floorf(fx), y0 = (int)floorf(fy);
+	float tx = fx - x0, ty = fy - y0;
+	int x1 = x0 + 1, y1 = y0 + 1;
+	x0 = ((x0 % w) + w) % w; x1 = ((x1 % w) + w) % w;
+	y0 = y0 < 0 ? 0 : (y0 >= h ? h - 1 : y0);
+	y1 = y1 < 0 ? 0 : (y1 >= h ? h - 1 : y1);
+	const float* a = level + (y0 * w + x0) * 3, *b = level + (y0 * w + x1) * 3;
+	const float* c = level + (y1 * w + x0) * 3, *e = level + (y1 * w + x1) * 3;
+	for (int k = 0; k < 3; k++)
+	{
+		float top = a[k] + (b[k] - a[k]) * tx;
+		float bottom = c[k] + (e[k] - c[k]) * tx;
+		rgb[k] = top + (bottom - top) * ty;
+	}
+}
+
+// the 9 real spherical harmonics of band 0..2
+static void ibl_sh_basis(float x, float y, float z, float* b)
+{
+	b[0] = 0.282095f;
+	b[1] = 0.488603f * y;
+	b[2] = 0.488603f * z;
+	b[3] = 0.488603f * x;
+	b[4] = 1.092548f * x * y;
+	b[5] = 1.092548f * y * z;
+	b[6] = 0.315392f * (3.0f * z * z - 1.0f);
+	b[7] = 1.092548f * x * z;
+	b[8] = 0.546274f * (x * x - y * y);
+}
+
+// i-th of n points of the hammersley set
+static void ibl_hammersley(unsigned i, unsigned n, float* u, float* v)
+{
+	unsigned bits = i;
+	bits = (bits << 16) | (bits >> 16);
+	bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+	bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+	bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+	bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+	*u = (float)i / (float)n;
+	*v = bits * 2.3283064365386963e-10f;
+}
+
+// GGX half vector around n for the sample (u, v), alpha is roughness squared
+static void ibl_importance_ggx(float u, float v, float alpha, const float* n, float* h)
+{
+	float phi = 2.0f * IBL_PI * u;
+	float cos_theta = sqrtf((1.0f - v) / (1.0f + (alpha * alpha - 1.0f) * v));
+	float sin_theta = sqrtf(1.0f - cos_theta * cos_theta);
+	float t[3] = { sin_theta * cosf(phi), sin_theta * sinf(phi), cos_theta };
+	// tangent frame of n
+	float up[3] = { 0.0f, 0.0f, 1.0f };
+	if (fabsf(n[2]) > 0.999f) { up[0] = 1.0f; up[2] = 0.0f; }
+	float tx[3] = { up[1] * n[2] - up[2] * n[1], up[2] * n[0] - up[0] * n[2], up[0] * n[1] - up[1] * n[0] };
+	float len = sqrtf(tx[0] * tx[0] + tx[1] * tx[1] + tx[2] * tx[2]);
+	for (int k = 0; k < 3; k++) tx[k] /= len;
+	float ty[3] = { n[1] * tx[2] - n[2] * tx[1], n[2] * tx[0] - n[0] * tx[2], n[0] * tx[1] - n[1] * tx[0] };
+	for (int k = 0; k < 3; k++) h[k] = tx[k] * t[0] + ty[k] * t[1] + n[k] * t[2];
+}
+
+// the schlick-ggx visibility with the k of image based lighting
+static float ibl_geometry(float NdotV, float NdotL, float roughness)
+{
+	float k = roughness * roughness * 0.5f;
+	return (NdotV / (NdotV * (1.0f - k) + k)) * (NdotL / (NdotL * (1.0f - k) + k));
+}
+
+static unsigned long long ibl_hash(const float* rgb, int w, int h)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	const unsigned char* p = (const unsigned char*)rgb;
+	size_t bytes = (size_t)w * h * 3 * sizeof(float);
+	for (size_t i = 0; i < bytes; i++) { hash ^= p[i]; hash *= 1099511628211ull; }
+	hash ^= (unsigned long long)w << 32 | (unsigned)h;
+	return hash * 1099511628211ull;
+}
+
+static ibl_t* ibl_alloc()
+{
+	ibl_t* ibl = new ibl_t;
+	memset(ibl->sh, 0, sizeof(ibl->sh));
+	for (int k = 0; k < IBL_LEVELS; k++)
+	{
+		ibl->width[k] = IBL_BASE_WIDTH >> k;
+		ibl->height[k] = ibl->width[k] / 2;
+		ibl->levels[k].resize(ibl->width[k] * ibl->height[k] * 3);
+	}
+	ibl->lut.resize(IBL_LUT_SIZE * IBL_LUT_SIZE * 2);
+	ibl->intensity = 1.0f;
+	ibl->source_hash = 0;
+	ibl->cached = 0;
+	return ibl;
+}
+
+// box[k] is the source averaged down to the size of level k, the prefilter reads it by sample footprint
+static void ibl_box_chain(ibl_t* ibl, const float* rgb, int w, int h, std::vector<float>* box)
+{
+	int bw = ibl->width[0], bh = ibl->height[0];
+	box[0].resize(bw * bh * 3);
+	for (int y = 0; y < bh; y++)
+	{
+		int sy0 = y * h / bh, sy1 = (y + 1) * h / bh;
+		if (sy1 <= sy0) sy1 = sy0 + 1;
+		for (int x = 0; x < bw; x++)
+		{
+			int sx0 = x * w / bw, sx1 = (x + 1) * w / bw;
+			if (sx1 <= sx0) sx1 = sx0 + 1;
+			float sum[3] = { 0.0f, 0.0f, 0.0f };
+			for (int sy = sy0; sy < sy1; sy++)
+				for (int sx = sx0; sx < sx1; sx++)
+					for (int c = 0; c < 3; c++) sum[c] += rgb[(sy * w + sx) * 3 + c];
+			float n = (float)((sy1 - sy0) * (sx1 - sx0));
+			for (int c = 0; c < 3; c++) box[0][(y * bw + x) * 3 + c] = sum[c] / n;
+		}
+	}
+	for (int k = 1; k < IBL_LEVELS; k++)
+	{
+		int lw = ibl->width[k], lh = ibl->height[k], pw = ibl->width[k - 1];
+		box[k].resize(lw * lh * 3);
+		for (int y = 0; y < lh; y++)
+			for (int x = 0; x < lw; x++)
+				for (int c = 0; c < 3; c++)
+				{
+					const float* p = &box[k - 1][0];
+					float s = p[((2 * y) * pw + 2 * x) * 3 + c] + p[((2 * y) * pw + 2 * x + 1) * 3 + c]
+						+ p[((2 * y + 1) * pw + 2 * x) * 3 + c] + p[((2 * y + 1) * pw + 2 * x + 1) * 3 + c];
+					box[k][(y * lw + x) * 3 + c] = s * 0.25f;
+				}
+	}
+}
+
+static void ibl_project_sh(ibl_t* ibl, const std::vector<float>& level, int w, int h)
+{
+	float sh[9][3];
+	memset(sh, 0, sizeof(sh));
+	for (int y = 0; y < h; y++)
+	{
+		float theta = ((y + 0.5f) / h) * IBL_PI;
+		float solid_angle = (2.0f * IBL_PI / w) * (IBL_PI / h) * sinf(theta);
+		for (int x = 0; x < w; x++)
+		{
+			float d[3], b[9];
+			ibl_texel_dir(x, y, w, h, d);
+			ibl_sh_basis(d[0], d[1], d[2], b);
+			const float* c = &level[(y * w + x) * 3];
+			for (int i = 0; i < 9; i++)
+				for (int k = 0; k < 3; k++) sh[i][k] += c[k] * b[i] * solid_angle;
+		}
+	}
+	// convolve with the clamped cosine and divide by pi
+	static const float band[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+	for (int i = 0; i < 9; i++)
+		for (int k = 0; k < 3; k++) ibl->sh[i][k] = sh[i][k] * band[i];
+}
+
+// radiance of the GGX lobe of roughness around each texel, with n = v = r
+static void ibl_prefilter(ibl_t* ibl, const std::vector<float>* box)
+{
+	ibl->levels[0] = box[0];
+	float texel_angle = 4.0f * IBL_PI / (ibl->width[0] * ibl->height[0]);
+	for (int k = 1; k < IBL_LEVELS; k++)
+	{
+		float roughness = (float)k / (IBL_LEVELS - 1);
+		float alpha = roughness * roughness;
+		int w = ibl->width[k], h = ibl->height[k];
+		for (int y = 0; y < h; y++)
+			for (int x = 0; x < w; x++)
+			{
+				float n[3];
+				ibl_texel_dir(x, y, w, h, n);
+				float sum[3] = { 0.0f, 0.0f, 0.0f }, weight = 0.0f;
+				for (unsigned i = 0; i < IBL_SAMPLES; i++)
+				{
+					float u, v, hv[3];
+					ibl_hammersley(i, IBL_SAMPLES, &u, &v);
+					ibl_importance_ggx(u, v, alpha, n, hv);
+					float NdotH = n[0] * hv[0] + n[1] * hv[1] + n[2] * hv[2];
+					float l[3] = { 2.0f * NdotH * hv[0] - n[0], 2.0f * NdotH * hv[1] - n[1], 2.0f * NdotH * hv[2] - n[2] };
+					float NdotL = n[0] * l[0] + n[1] * l[1] + n[2] * l[2];
+					if (NdotL <= 0.0f) continue;
+					// read the box level whose texels cover the solid angle of the sample
+					float d = NdotH * NdotH * (alpha * alpha - 1.0f) + 1.0f;
+					float D = alpha * alpha / (IBL_PI * d * d);
+					float pdf = D * 0.25f + 0.0001f;
+					float sample_angle = 1.0f / (IBL_SAMPLES * pdf);
+					float mip = alpha == 0.0f ? 0.0f : 0.5f * log2f(sample_angle / texel_angle) + 1.0f;
+					mip = CMID(mip, 0.0f, (float)(IBL_LEVELS - 1));
+					int m0 = (int)mip, m1 = m0 + 1 < IBL_LEVELS ? m0 + 1 : m0;
+					float t = mip - m0, c0[3], c1[3];
+					ibl_sample(&box[m0][0], ibl->width[m0], ibl->height[m0], l[0], l[1], l[2], c0);
+					ibl_sample(&box[m1][0], ibl->width[m1], ibl->height[m1], l[0], l[1], l[2], c1);
+					for (int c = 0; c < 3; c++) sum[c] += (c0[c] + (c1[c] - c0[c]) * t) * NdotL;
+					weight += NdotL;
+				}
+				float* out = &ibl->levels[k][(y * w + x) * 3];
+				for (int c = 0; c < 3; c++) out[c] = weight > 0.0f ? sum[c] / weight : 0.0f;
+			}
+	}
+}
+
+// integrate the GGX specular of a white surface for F0 = 0 and F0 = 1
+static void ibl_integrate_brdf(ibl_t* ibl)
+{
+	float n[3] = { 0.0f, 0.0f, 1.0f };
+	for (int j = 0; j < IBL_LUT_SIZE; j++)
+	{
+		float roughness = (j + 0.5f) / IBL_LUT_SIZE;
+		float alpha = roughness * roughness;
+		for (int i = 0; i < IBL_LUT_SIZE; i++)
+		{
+			float NdotV = (i + 0.5f) / IBL_LUT_SIZE;
+			float view[3] = { sqrtf(1.0f - NdotV * NdotV), 0.0f, NdotV };
+			float a = 0.0f, b = 0.0f;
+			for (unsigned s = 0; s < IBL_SAMPLES; s++)
+			{
+				float u, v, hv[3];
+				ibl_hammersley(s, IBL_SAMPLES, &u, &v);
+				ibl_importance_ggx(u, v, alpha, n, hv);
+				float VdotH = view[0] * hv[0] + view[1] * hv[1] + view[2] * hv[2];
+				float l[3] = { 2.0f * VdotH * hv[0] - view[0], 2.0f * VdotH * hv[1] - view[1], 2.0f * VdotH * hv[2] - view[2] };
+				float NdotL = l[2], NdotH = hv[2];
+				VdotH = VdotH > 0.0f ? VdotH : 0.0f;
+				if (NdotL <= 0.0f) continue;
+				float g = ibl_geometry(NdotV, NdotL, roughness) * VdotH / (NdotH * NdotV);
+				float fc = powf(1.0f - VdotH, 5.0f);
+				a += (1.0f - fc) * g;
+				b += fc * g;
+			}
+			ibl->lut[(j * IBL_LUT_SIZE + i) * 2] = a / IBL_SAMPLES;
+			ibl->lut[(j * IBL_LUT_SIZE + i) * 2 + 1] = b / IBL_SAMPLES;
+		}
+	}
+}
+
+ibl_t* ibl_create(const float* rgb, int w, int h)
+{
+	ibl_t* ibl = ibl_alloc();
+	ibl->source_hash = ibl_hash(rgb, w, h);
+	std::vector<float> box[IBL_LEVELS];
+	ibl_box_chain(ibl, rgb, w, h, box);
+	ibl_project_sh(ibl, box[0], ibl->width[0], ibl->height[0]);
+	ibl_prefilter(ibl, box);
+	ibl_integrate_brdf(ibl);
+	return ibl;
+}
+
+void ibl_destory(ibl_t* ibl)
+{
+	delete ibl;
+}
+
+static void ibl_file_header(ibl_file_header_t* header, unsigned long long source_hash)
+{
+	memset(header, 0, sizeof(ibl_file_header_t));
+	header->magic = IBL_FILE_MAGIC;
+	header->version = IBL_FILE_VERSION;
+	header->levels = IBL_LEVELS;
+	header->base_width = IBL_BASE_WIDTH;
+	header->lut_size = IBL_LUT_SIZE;
+	header->samples = IBL_SAMPLES;
+	header->source_hash = source_hash;
+}
+
+bool ibl_write(const ibl_t* ibl, const char* path)
+{
+	ibl_file_header_t header;
+	ibl_file_header(&header, ibl->source_hash);
+	FILE* fp = fopen(path, "wb");
+	if (fp == NULL) return false;
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(ibl->sh, sizeof(ibl->sh), 1, fp) == 1;
+	for (int k = 0; ok && k < IBL_LEVELS; k++)
+		ok = fwrite(&ibl->levels[k][0], sizeof(float), ibl->levels[k].size(), fp) == ibl->levels[k].size();
+	if (ok) ok = fwrite(&ibl->lut[0], sizeof(float), ibl->lut.size(), fp) == ibl->lut.size();
+	if (fclose(fp) != 0) ok = false;
+	return ok;
+}
+
+ibl_t* ibl_read(const char* path, unsigned long long source_hash)
+{
+	FILE* fp = fopen(path, "rb");
+	if (fp == NULL) return NULL;
+	ibl_file_header_t header, expect;
+	ibl_file_header(&expect, source_hash);
+	bool ok = fread(&header, sizeof(header), 1, fp) == 1 && memcmp(&header, &expect, sizeof(header)) == 0;
+	ibl_t* ibl = ok ? ibl_alloc() : NULL;
+	if (ok) ok = fread(ibl->sh, sizeof(ibl->sh), 1, fp) == 1;
+	for (int k = 0; ok && k < IBL_LEVELS; k++)
+		ok = fread(&ibl->levels[k][0], sizeof(float), ibl->levels[k].size(), fp) == ibl->levels[k].size();
+	if (ok) ok = fread(&ibl->lut[0], sizeof(float), ibl->lut.size(), fp) == ibl->lut.size();
+	fclose(fp);
+	if (!ok) { ibl_destory(ibl); return NULL; }
+	ibl->source_hash = source_hash;
+	ibl->cached = 1;
+	return ibl;
+}
+
+ibl_t* ibl_load(const char* path, const char* cache_path)
+{
+	int w, h, channels;
+	float* rgb = stbi_loadf(path, &w, &h, &channels, 3);
+	if (rgb == NULL) return NULL;
+	unsigned long long hash = ibl_hash(rgb, w, h);
+	ibl_t* ibl = cache_path != NULL ? ibl_read(cache_path, hash) : NULL;
+	if (ibl == NULL)
+	{
+		ibl = ibl_create(rgb, w, h);
+		if (cache_path != NULL && !ibl_write(ibl, cache_path)) printf("ibl: can't write %s\n", cache_path);
+	}
+	stbi_image_free(rgb);
+	return ibl;
+}
+
+void ibl_irradiance(const ibl_t* ibl, const s_vector& n, s_vector& result)
+{
+	float b[9], c[3] = { 0.0f, 0.0f, 0.0f };
+	ibl_sh_basis(n.x, n.y, n.z, b);
+	for (int i = 0; i < 9; i++)
+		for (int k = 0; k < 3; k++) c[k] += ibl->sh[i][k] * b[i];
+	float s = ibl->intensity;
+	result.reset(max(c[0], 0.0f) * s, max(c[1], 0.0f) * s, max(c[2], 0.0f) * s, 1.0f);
+}
+
+void ibl_specular(const ibl_t* ibl, const s_vector& r, float roughness, s_vector& result)
+{
+	float level = CMID(roughness, 0.0f, 1.0f) * (IBL_LEVELS - 1);
+	int l0 = (int)level, l1 = l0 + 1 < IBL_LEVELS ? l0 + 1 : l0;
+	float t = level - l0, c0[3], c1[3];
+	ibl_sample(&ibl->levels[l0][0], ibl->width[l0], ibl->height[l0], r.x, r.y, r.z, c0);
+	ibl_sample(&ibl->levels[l1][0], ibl->width[l1], ibl->height[l1], r.x, r.y, r.z, c1);
+	float s = ibl->intensity;
+	result.reset((c0[0] + (c1[0] - c0[0]) * t) * s, (c0[1] + (c1[1] - c0[1]) * t) * s, (c0[2] + (c1[2] - c0[2]) * t) * s, 1.0f);
+}
+
+void ibl_brdf(const ibl_t* ibl, float NdotV, float roughness, float* scale, float* bias)
+{
+	float fx = CMID(NdotV, 0.0f, 1.0f) * IBL_LUT_SIZE - 0.5f;
+	float fy = CMID(roughness, 0.0f, 1.0f) * IBL_LUT_SIZE - 0.5f;
+	fx = CMID(fx, 0.0f, (float)(IBL_LUT_SIZE - 1));
+	fy = CMID(fy, 0.0f, (float)(IBL_LUT_SIZE - 1));
+	int x0 = (int)fx, y0 = (int)fy;
+	int x1 = x0 + 1 < IBL_LUT_SIZE ? x0 + 1 : x0, y1 = y0 + 1 < IBL_LUT_SIZE ? y0 + 1 : y0;
+	float tx = fx - x0, ty = fy - y0;
+	const float* lut = &ibl->lut[0];
+	for (int k = 0; k < 2; k++)
+	{
+		float a = lut[(y0 * IBL_LUT_SIZE + x0) * 2 + k], b = lut[(y0 * IBL_LUT_SIZE + x1) * 2 + k];
+		float c = lut[(y1 * IBL_LUT_SIZE + x0) * 2 + k], d = lut[(y1 * IBL_LUT_SIZE + x1) * 2 + k];
+		float top = a + (b - a) * tx, bottom = c + (d - c) * tx;
+		*(k == 0 ? scale : bias) = top + (bottom - top) * ty;
+	}
+}
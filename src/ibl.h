@@ -0,0 +1,67 @@
+#ifndef ibl_h
+#define ibl_h
+//=====================================================================
+// image based lighting for the PBR shaders: an equirectangular
+// environment is reduced once to 9 spherical harmonics of diffuse
+// irradiance, a chain of GGX prefiltered specular levels and a split
+// sum BRDF table. the result is cached in a file next to the image,
+// so shading only costs a few table lookups.
+//=====================================================================
+#include "render.h"
+#include <vector>
+
+#define IBL_FILE_MAGIC   0x43424949   // "IIBC"
+#define IBL_FILE_VERSION 1
+#define IBL_LEVELS       6            // specular levels, level k is for roughness k / (IBL_LEVELS - 1)
+#define IBL_BASE_WIDTH   128          // of level 0, every level is twice as wide as high
+#define IBL_LUT_SIZE     32
+#define IBL_SAMPLES      128          // GGX samples per prefiltered texel and per table entry
+
+typedef struct
+{
+	unsigned magic;
+	unsigned version;
+	int levels;
+	int base_width;
+	int lut_size;
+	int samples;
+	unsigned long long source_hash;  // of the decoded environment, a changed image makes the cache stale
+}ibl_file_header_t;
+// the header is followed by sh, every level and the lut, as floats
+
+struct ibl_t
+{
+	float sh[9][3];                  // irradiance / pi, so diffuse is albedo times the sum
+	int width[IBL_LEVELS], height[IBL_LEVELS];
+	std::vector<float> levels[IBL_LEVELS]; // rgb, equirectangular, +y up
+	std::vector<float> lut;          // IBL_LUT_SIZE^2 (scale, bias) of F0, x is NdotV, y is roughness
+	float intensity;                 // scales both terms, 1 after loading
+	unsigned long long source_hash;
+	int cached;                      // read from the cache file instead of computed
+};
+
+// precompute everything from a w x h rgb equirectangular image
+ibl_t* ibl_create(const float* rgb, int w, int h);
+
+// decode path with stbi_loadf, an ldr image is linearized. the tables are read from cache_path
+// when it was written for the same image, else computed and written there. NULL when path can't
+// be read, cache_path may be NULL
+ibl_t* ibl_load(const char* path, const char* cache_path);
+
+void ibl_destory(ibl_t* ibl);
+
+bool ibl_write(const ibl_t* ibl, const char* path);
+
+// NULL when the file is missing, from another version or for another image
+ibl_t* ibl_read(const char* path, unsigned long long source_hash);
+
+// diffuse irradiance / pi around the normal n
+void ibl_irradiance(const ibl_t* ibl, const s_vector& n, s_vector& result);
+
+// prefiltered radiance along the reflection r, trilinear between the roughness levels
+void ibl_specular(const ibl_t* ibl, const s_vector& r, float roughness, s_vector& result);
+
+// split sum factors, the specular term is radiance * (F0 * scale + bias)
+void ibl_brdf(const ibl_t* ibl, float NdotV, float roughness, float* scale, float* bias);
+
+#endif
@@ -0,0 +1,309 @@
+#include "image_file.h"
+#include "gamma.h"
+#include "stb_image.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <string>
+
+int image_format_of(const char* name)
+{
+	const char* dot = strrchr(name, '.');
+	const char* ext = dot != NULL ? dot + 1 : name;
+	if (strcmp(ext, "ppm") == 0) return IMAGE_FORMAT_PPM;
+	if (strcmp(ext, "png") == 0) return IMAGE_FORMAT_PNG;
+	if (strcmp(ext, "exr") == 0) return IMAGE_FORMAT_EXR;
+	return -1;
+}
+
+const char* image_format_extension(int format)
+{
+	if (format == IMAGE_FORMAT_PNG) return ".png";
+	if (format == IMAGE_FORMAT_EXR) return ".exr";
+	return ".ppm";
+}
+
+static void image_put_u32_be(std::vector<unsigned char>& out, IUINT32 v)
+{
+	unsigned char b[4] = { (unsigned char)(v >> 24), (unsigned char)(v >> 16), (unsigned char)(v >> 8), (unsigned char)v };
+	out.insert(out.end(), b, b + 4);
+}
+
+static void image_put_u32_le(std::vector<unsigned char>& out, IUINT32 v)
+{
+	unsigned char b[4] = { (unsigned char)v, (unsigned char)(v >> 8), (unsigned char)(v >> 16), (unsigned char)(v >> 24) };
+	out.insert(out.end(), b, b + 4);
+}
+
+struct image_writer_t
+{
+	FILE* fp;
+	int format;
+	int width, height;
+	int rows;                // written so far
+	IUINT32 adler_a, adler_b; // png: adler32 of the filtered rows so far
+	bool ok;
+	std::vector<unsigned char> bytes;
+	std::vector<float> line;
+};
+
+static void image_writer_put(image_writer_t* writer, const std::vector<unsigned char>& bytes)
+{
+	if (!bytes.empty() && fwrite(&bytes[0], 1, bytes.size(), writer->fp) != bytes.size()) writer->ok = false;
+}
+
+typedef struct
+{
+	IUINT32 entry[256];
+}image_crc_table_t;
+
+static image_crc_table_t image_crc_table()
+{
+	image_crc_table_t table;
+	for (IUINT32 i = 0; i < 256; i++)
+	{
+		IUINT32 c = i;
+		for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+		table.entry[i] = c;
+	}
+	return table;
+}
+
+static IUINT32 image_crc32(const unsigned char* data, size_t n, IUINT32 crc)
+{
+	// built once by the first call, threads may write files at the same time
+	static const image_crc_table_t table = image_crc_table();
+	crc = ~crc;
+	for (size_t i = 0; i < n; i++) crc = table.entry[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void image_png_chunk(std::vector<unsigned char>& out, const char* type, const std::vector<unsigned char>& data)
+{
+	image_put_u32_be(out, (IUINT32)data.size());
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	image_put_u32_be(out, image_crc32(&out[start], out.size() - start, 0));
+}
+
+static void image_exr_attribute(std::vector<unsigned char>& out, const char* name, const char* type, const void* value, int size)
+{
+	out.insert(out.end(), name, name + strlen(name) + 1);
+	out.insert(out.end(), type, type + strlen(type) + 1);
+	image_put_u32_le(out, size);
+	const unsigned char* p = (const unsigned char*)value;
+	out.insert(out.end(), p, p + size);
+}
+
+static void image_header_ppm(image_writer_t* writer, std::vector<unsigned char>& bytes)
+{
+	char header[64];
+	int n = sprintf(header, "P6\n%d %d\n255\n", writer->width, writer->height);
+	bytes.insert(bytes.end(), header, header + n);
+}
+
+static void image_header_png(image_writer_t* writer, std::vector<unsigned char>& bytes)
+{
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	bytes.insert(bytes.end(), signature, signature + 8);
+	std::vector<unsigned char> ihdr;
+	image_put_u32_be(ihdr, writer->width);
+	image_put_u32_be(ihdr, writer->height);
+	unsigned char rest[5] = { 8, 2, 0, 0, 0 };   // 8 bits, rgb, deflate, adaptive filters, no interlace
+	ihdr.insert(ihdr.end(), rest, rest + 5);
+	image_png_chunk(bytes, "IHDR", ihdr);
+	writer->adler_a = 1;
+	writer->adler_b = 0;
+}
+
+static void image_header_exr(image_writer_t* writer, std::vector<unsigned char>& bytes)
+{
+	gamma_init();
+	int w = writer->width, h = writer->height;
+	image_put_u32_le(bytes, 20000630);   // magic
+	image_put_u32_le(bytes, 2);          // version 2, single part scanline
+	// channels in alphabetical order, 32 bit float, no subsampling
+	std::vector<unsigned char> channels;
+	const char* names[3] = { "B", "G", "R" };
+	for (int c = 0; c < 3; c++)
+	{
+		channels.push_back((unsigned char)names[c][0]); channels.push_back(0);
+		image_put_u32_le(channels, 2);
+		image_put_u32_le(channels, 0);   // pLinear and reserved
+		image_put_u32_le(channels, 1);
+		image_put_u32_le(channels, 1);
+	}
+	channels.push_back(0);
+	image_exr_attribute(bytes, "channels", "chlist", &channels[0], (int)channels.size());
+	unsigned char none = 0;
+	image_exr_attribute(bytes, "compression", "compression", &none, 1);
+	int window[4] = { 0, 0, w - 1, h - 1 };
+	image_exr_attribute(bytes, "dataWindow", "box2i", window, sizeof(window));
+	image_exr_attribute(bytes, "displayWindow", "box2i", window, sizeof(window));
+	image_exr_attribute(bytes, "lineOrder", "lineOrder", &none, 1);
+	float aspect = 1.0f, center[2] = { 0.0f, 0.0f };
+	image_exr_attribute(bytes, "pixelAspectRatio", "float", &aspect, sizeof(aspect));
+	image_exr_attribute(bytes, "screenWindowCenter", "v2f", center, sizeof(center));
+	image_exr_attribute(bytes, "screenWindowWidth", "float", &aspect, sizeof(aspect));
+	bytes.push_back(0);
+	// offset table, the blocks of the rows are all one size so it is known before any of them
+	size_t table = bytes.size();
+	size_t block = (size_t)w * 3 * sizeof(float);
+	bytes.resize(table + (size_t)h * 8);
+	for (int y = 0; y < h; y++)
+	{
+		unsigned long long offset = table + (size_t)h * 8 + (size_t)y * (8 + block);
+		memcpy(&bytes[table + (size_t)y * 8], &offset, 8);
+	}
+}
+
+image_writer_t* image_writer_open(const char* path, int format, int width, int height)
+{
+	FILE* fp = fopen(path, "wb");
+	if (fp == NULL) return NULL;
+	image_writer_t* writer = new image_writer_t;
+	writer->fp = fp;
+	writer->format = format;
+	writer->width = width;
+	writer->height = height;
+	writer->rows = 0;
+	writer->ok = true;
+	std::vector<unsigned char>& bytes = writer->bytes;
+	bytes.clear();
+	if (format == IMAGE_FORMAT_PNG) image_header_png(writer, bytes);
+	else if (format == IMAGE_FORMAT_EXR) image_header_exr(writer, bytes);
+	else image_header_ppm(writer, bytes);
+	image_writer_put(writer, bytes);
+	return writer;
+}
+
+static void image_rows_ppm(const surface_t* rows, std::vector<unsigned char>& bytes)
+{
+	for (int y = 0; y < rows->height; y++)
+	{
+		const IUINT32* row = surface_row_u32(rows, y);
+		for (int x = 0; x < rows->width; x++)
+		{
+			bytes.push_back((unsigned char)(row[x] >> 16));
+			bytes.push_back((unsigned char)(row[x] >> 8));
+			bytes.push_back((unsigned char)row[x]);
+		}
+	}
+}
+
+// one IDAT chunk of the rows, the zlib stream of stored deflate blocks runs on over the chunks
+static void image_rows_png(image_writer_t* writer, const surface_t* rows, std::vector<unsigned char>& bytes)
+{
+	int w = rows->width, h = rows->height;
+	// filter type 0 and rgb for every row
+	std::vector<unsigned char> raw;
+	raw.reserve((size_t)(w * 3 + 1) * h);
+	for (int y = 0; y < h; y++)
+	{
+		const IUINT32* row = surface_row_u32(rows, y);
+		raw.push_back(0);
+		for (int x = 0; x < w; x++)
+		{
+			raw.push_back((unsigned char)(row[x] >> 16));
+			raw.push_back((unsigned char)(row[x] >> 8));
+			raw.push_back((unsigned char)row[x]);
+		}
+	}
+	bool last = writer->rows + h >= writer->height;
+	// stored blocks of at most 65535 bytes, the last one of the image ends the stream
+	std::vector<unsigned char> z;
+	if (writer->rows == 0)
+	{
+		z.push_back(0x78); z.push_back(0x01);
+	}
+	size_t at = 0;
+	do
+	{
+		size_t n = raw.size() - at < 65535 ? raw.size() - at : 65535;
+		z.push_back(last && at + n == raw.size() ? 1 : 0);
+		z.push_back((unsigned char)n); z.push_back((unsigned char)(n >> 8));
+		z.push_back((unsigned char)~n); z.push_back((unsigned char)(~n >> 8));
+		z.insert(z.end(), raw.begin() + at, raw.begin() + at + n);
+		at += n;
+	} while (at < raw.size());
+	IUINT32 a = writer->adler_a, b = writer->adler_b;
+	for (size_t i = 0; i < raw.size(); i++) { a = (a + raw[i]) % 65521; b = (b + a) % 65521; }
+	writer->adler_a = a;
+	writer->adler_b = b;
+	if (last) image_put_u32_be(z, (b << 16) | a);
+	image_png_chunk(bytes, "IDAT", z);
+	if (last) image_png_chunk(bytes, "IEND", std::vector<unsigned char>());
+}
+
+// one block per row: y, byte count and the B, G and R rows
+static void image_rows_exr(image_writer_t* writer, const surface_t* rows, std::vector<unsigned char>& bytes)
+{
+	int w = rows->width;
+	size_t block = (size_t)w * 3 * sizeof(float);
+	std::vector<float>& line = writer->line;
+	line.resize(w * 3);
+	for (int y = 0; y < rows->height; y++)
+	{
+		image_put_u32_le(bytes, writer->rows + y);
+		image_put_u32_le(bytes, (IUINT32)block);
+		const IUINT32* row = surface_row_u32(rows, y);
+		for (int x = 0; x < w; x++)
+		{
+			line[x] = gamma_decode(row[x] & 0xff);
+			line[w + x] = gamma_decode((row[x] >> 8) & 0xff);
+			line[2 * w + x] = gamma_decode((row[x] >> 16) & 0xff);
+		}
+		const unsigned char* p = (const unsigned char*)&line[0];
+		bytes.insert(bytes.end(), p, p + block);
+	}
+}
+
+bool image_writer_rows(image_writer_t* writer, const surface_t* rows)
+{
+	if (rows->width != writer->width || rows->height <= 0 || writer->rows + rows->height > writer->height)
+	{
+		writer->ok = false;
+		return false;
+	}
+	std::vector<unsigned char>& bytes = writer->bytes;
+	bytes.clear();
+	if (writer->format == IMAGE_FORMAT_PNG) image_rows_png(writer, rows, bytes);
+	else if (writer->format == IMAGE_FORMAT_EXR) image_rows_exr(writer, rows, bytes);
+	else image_rows_ppm(rows, bytes);
+	writer->rows += rows->height;
+	image_writer_put(writer, bytes);
+	return writer->ok;
+}
+
+bool image_writer_close(image_writer_t* writer)
+{
+	bool ok = writer->ok && writer->rows == writer->height;
+	if (fclose(writer->fp) != 0) ok = false;
+	delete writer;
+	return ok;
+}
+
+bool image_write(const char* path, const surface_t* color, int format)
+{
+	image_writer_t* writer = image_writer_open(path, format, color->width, color->height);
+	if (writer == NULL) return false;
+	image_writer_rows(writer, color);
+	return image_writer_close(writer);
+}
+
+surface_t* image_read(const char* path)
+{
+	int w, h, channels;
+	unsigned char* data = stbi_load(path, &w, &h, &channels, 3);
+	if (data == NULL) return NULL;
+	surface_t* image = surface_create(w, h, SURFACE_FORMAT_XRGB32, NULL, 0);
+	for (int y = 0; y < h; y++)
+	{
+		IUINT32* row = surface_row_u32(image, y);
+		const unsigned char* src = data + (size_t)y * w * 3;
+		for (int x = 0; x < w; x++, src += 3) row[x] = ((IUINT32)src[0] << 16) | ((IUINT32)src[1] << 8) | src[2];
+	}
+	stbi_image_free(data);
+	return image;
+}
@@ -0,0 +1,41 @@
+#ifndef image_file_h
+#define image_file_h
+//=====================================================================
+// writers for a SURFACE_FORMAT_XRGB32 surface: binary ppm, png with
+// stored deflate blocks and an uncompressed float openexr scanline
+// file. none of them needs a library, so the headless renderer builds
+// anywhere the renderer does. an image writer takes the rows of a
+// frame a band at a time and writes them out as they come, so a frame
+// drawn in bands is never whole in memory. 8 bit images are read back
+// with the stb_image the textures are loaded with.
+//=====================================================================
+#include "surface.h"
+
+#define IMAGE_FORMAT_PPM 0
+#define IMAGE_FORMAT_PNG 1
+#define IMAGE_FORMAT_EXR 2  // the 8 bit channels decoded with the 2.2 curve of gamma.h
+
+// IMAGE_FORMAT_* of a name like "png" or "out.exr", -1 when it is none of them
+int image_format_of(const char* name);
+
+// ".ppm", ".png" or ".exr"
+const char* image_format_extension(int format);
+
+struct image_writer_t;
+
+// write color to path, false when the file can't be written
+bool image_write(const char* path, const surface_t* color, int format);
+
+// a width x height image of format in path, filled top to bottom by image_writer_rows. NULL when it can't be made
+image_writer_t* image_writer_open(const char* path, int format, int width, int height);
+
+// the next rows->height rows, rows is width pixels wide. false once anything failed
+bool image_writer_rows(image_writer_t* writer, const surface_t* rows);
+
+// false when a write failed or fewer rows than height came
+bool image_writer_close(image_writer_t* writer);
+
+// a new XRGB32 surface of a png, ppm or any other file stb_image reads, NULL when it can't be read
+surface_t* image_read(const char* path);
+
+#endif
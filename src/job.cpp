@@ -0,0 +1,214 @@
+#include "job.h"
+#include <chrono>
+#include <algorithm>
+#include <iterator>
+
+// the system whose worker this thread is and its index there, 0 for every other system
+static thread_local job_system_t* job_thread_system = NULL;
+static thread_local int job_thread = 0;
+
+static std::atomic<long long> job_total_run(0), job_total_stolen(0), job_total_idle_us(0);
+
+static inline int job_slot(job_system_t* system)
+{
+	return job_thread_system == system ? job_thread : 0;
+}
+
+static void job_push(job_system_t* system, const job_t& job)
+{
+	job_queue_t* queue = system->queues[job_slot(system)];
+	{
+		std::unique_lock<std::mutex> guard(queue->lock);
+		queue->jobs.push_back(job);
+	}
+	{
+		// under the lock, so a worker going to sleep can't miss it
+		std::unique_lock<std::mutex> guard(system->lock);
+		system->queued++;
+		system->pushed++;
+	}
+	system->wake.notify_one();
+	system->done.notify_all();
+}
+
+// the newest job of the own queue, else the oldest of another one. a counter only takes its own jobs
+static bool job_take(job_system_t* system, job_counter_t* counter, job_t& out)
+{
+	int self = job_slot(system);
+	for (int i = 0; i < system->threads; i++)
+	{
+		job_queue_t* queue = system->queues[(self + i) % system->threads];
+		std::unique_lock<std::mutex> guard(queue->lock);
+		std::deque<job_t>& jobs = queue->jobs;
+		if (jobs.empty()) continue;
+		if (i == 0)
+		{
+			std::deque<job_t>::reverse_iterator it = jobs.rbegin();
+			while (counter != NULL && it != jobs.rend() && it->counter != counter) ++it;
+			if (it == jobs.rend()) continue;
+			out = *it;
+			jobs.erase(std::next(it).base());
+		}
+		else
+		{
+			std::deque<job_t>::iterator it = jobs.begin();
+			while (counter != NULL && it != jobs.end() && it->counter != counter) ++it;
+			if (it == jobs.end()) continue;
+			out = *it;
+			jobs.erase(it);
+			job_total_stolen++;
+		}
+		system->queued--;
+		return true;
+	}
+	return false;
+}
+
+static void job_run(job_system_t* system, const job_t& job)
+{
+	job.fn(job.data, job.begin, job.end);
+	job_total_run++;
+	std::vector<job_t> after;
+	{
+		std::unique_lock<std::mutex> guard(system->lock);
+		// the counter is not touched after the decrement, a waiter may return and free it
+		if (job.counter->pending == 1) after.swap(job.counter->after);
+		job.counter->pending--;
+	}
+	system->done.notify_all();
+	for (size_t i = 0; i < after.size(); i++) job_push(system, after[i]);
+}
+
+static void job_worker(job_system_t* system, int index)
+{
+	job_thread_system = system;
+	job_thread = index;
+	for (;;)
+	{
+		job_t job;
+		if (job_take(system, NULL, job))
+		{
+			job_run(system, job);
+			continue;
+		}
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		{
+			std::unique_lock<std::mutex> guard(system->lock);
+			system->wake.wait(guard, [&] { return system->quit || system->queued > 0; });
+			if (system->quit) return;
+		}
+		job_total_idle_us += (long long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+	}
+}
+
+job_system_t* job_system_create(int workers)
+{
+	if (workers < 0) workers = (int)std::thread::hardware_concurrency() - 1;
+	if (workers < 1) workers = 1;
+	job_system_t* system = new job_system_t;
+	system->threads = workers + 1;
+	for (int i = 0; i < system->threads; i++) system->queues.push_back(new job_queue_t);
+	system->queued = 0;
+	system->pushed = 0;
+	system->quit = false;
+	for (int i = 1; i <= workers; i++)
+		system->workers.push_back(std::thread(job_worker, system, i));
+	return system;
+}
+
+void job_system_destory(job_system_t* system)
+{
+	if (system == NULL) return;
+	{
+		std::unique_lock<std::mutex> guard(system->lock);
+		system->quit = true;
+	}
+	system->wake.notify_all();
+	for (size_t i = 0; i < system->workers.size(); i++)
+		system->workers[i].join();
+	for (size_t i = 0; i < system->queues.size(); i++) delete system->queues[i];
+	delete system;
+}
+
+// joins the workers of the shared system at exit
+struct job_system_holder_t
+{
+	job_system_t* system;
+	~job_system_holder_t() { job_system_destory(system); }
+};
+
+job_system_t* job_system()
+{
+	static job_system_holder_t holder = { job_system_create(-1) };
+	return holder.system;
+}
+
+void job_submit(job_system_t* system, job_fn_t fn, void* data, int begin, int end, job_counter_t* counter)
+{
+	job_t job = { fn, data, begin, end, counter };
+	counter->pending++;
+	job_push(system, job);
+}
+
+void job_submit_after(job_system_t* system, job_counter_t* after, job_fn_t fn, void* data, int begin, int end, job_counter_t* counter)
+{
+	job_t job = { fn, data, begin, end, counter };
+	counter->pending++;
+	{
+		std::unique_lock<std::mutex> guard(system->lock);
+		if (after->pending > 0)
+		{
+			after->after.push_back(job);
+			return;
+		}
+	}
+	job_push(system, job);
+}
+
+void job_wait(job_system_t* system, job_counter_t* counter)
+{
+	while (counter->pending > 0)
+	{
+		int seen;
+		{
+			std::unique_lock<std::mutex> guard(system->lock);
+			seen = system->pushed;
+		}
+		job_t job;
+		if (job_take(system, counter, job))
+		{
+			job_run(system, job);
+			continue;
+		}
+		// the rest runs elsewhere, or is submitted later by one of them
+		std::unique_lock<std::mutex> guard(system->lock);
+		system->done.wait(guard, [&] { return counter->pending == 0 || system->pushed != seen; });
+	}
+}
+
+void job_parallel_for(job_system_t* system, int begin, int end, int grain, job_fn_t fn, void* data)
+{
+	if (grain < 1) grain = 1;
+	if (end - begin <= grain)
+	{
+		if (end > begin) fn(data, begin, end);
+		return;
+	}
+	job_counter_t counter;
+	for (int b = begin + grain; b < end; b += grain)
+		job_submit(system, fn, data, b, std::min(b + grain, end), &counter);
+	fn(data, begin, begin + grain);
+	job_wait(system, &counter);
+}
+
+int job_thread_index(job_system_t* system)
+{
+	return job_slot(system);
+}
+
+void job_get_stats(job_stats_t* stats)
+{
+	stats->run = job_total_run;
+	stats->stolen = job_total_stolen;
+	stats->idle_us = job_total_idle_us;
+}
@@ -0,0 +1,93 @@
+#ifndef job_h
+#define job_h
+//=====================================================================
+// job system: one pool of worker threads that the tile shader, the
+// batch renderer and the texture loader submit to instead of spawning
+// threads of their own. every worker owns a deque, it runs the newest
+// of its own jobs and steals the oldest of the others when it runs dry.
+// a job belongs to a counter that job_wait waits on, the waiting thread
+// runs the jobs of that counter in the meantime. jobs submitted with
+// job_submit_after only start once another counter reached zero.
+//=====================================================================
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+struct job_counter_t;
+
+// runs the indices [begin, end) of data
+typedef void (*job_fn_t)(void* data, int begin, int end);
+
+typedef struct
+{
+	job_fn_t fn;
+	void* data;
+	int begin, end;
+	job_counter_t* counter;  // of the job, decremented when it returns
+}job_t;
+
+// the unfinished jobs of a group, zero when all of them returned
+struct job_counter_t
+{
+	std::atomic<int> pending;
+	std::vector<job_t> after;  // submitted with job_submit_after, pushed once pending is zero
+	job_counter_t() : pending(0) {}
+};
+
+struct job_queue_t
+{
+	std::mutex lock;
+	std::deque<job_t> jobs;  // the owner works at the back, thieves take from the front
+};
+
+struct job_system_t
+{
+	int threads;             // workers + 1, queues[0] is shared by the threads outside the pool
+	std::vector<job_queue_t*> queues;
+	std::vector<std::thread> workers;
+	std::mutex lock;         // the after lists of the counters and the two conditions
+	std::condition_variable wake, done;
+	std::atomic<int> queued; // in the queues, not taken yet
+	int pushed;              // generation of the queues, job_wait looks again when it moves
+	bool quit;
+};
+
+// totals of every job system since the start of the program, for the profiler
+typedef struct
+{
+	long long run;           // jobs that returned
+	long long stolen;        // taken from the queue of another thread
+	long long idle_us;       // workers asleep with nothing to run
+}job_stats_t;
+
+// workers threads, < 0 one less than the hardware threads but at least one
+job_system_t* job_system_create(int workers);
+
+// waits for the running jobs, the queued ones are dropped
+void job_system_destory(job_system_t* system);
+
+// the system every subsystem shares, created on the first call and destroyed at exit
+job_system_t* job_system();
+
+// queue fn(data, begin, end) on the calling thread's deque
+void job_submit(job_system_t* system, job_fn_t fn, void* data, int begin, int end, job_counter_t* counter);
+
+// like job_submit, but not before the jobs of after finished
+void job_submit_after(job_system_t* system, job_counter_t* after, job_fn_t fn, void* data, int begin, int end, job_counter_t* counter);
+
+// return when every job of counter finished, runs them on this thread while there are any queued
+void job_wait(job_system_t* system, job_counter_t* counter);
+
+// fn over [begin, end) in jobs of grain indices, returns when all of them finished. the calling
+// thread takes part, a single job runs on it directly
+void job_parallel_for(job_system_t* system, int begin, int end, int grain, job_fn_t fn, void* data);
+
+// 1..threads - 1 on the workers of system, 0 on every other thread
+int job_thread_index(job_system_t* system);
+
+void job_get_stats(job_stats_t* stats);
+
+#endif
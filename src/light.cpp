@@ -0,0 +1,112 @@
+#include "light.h"
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+light_list_t* light_list_create(int width, int height)
+{
+	light_list_t* list = new light_list_t;
+	list->width = width;
+	list->height = height;
+	list->tiles_x = (width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+	list->tiles_y = (height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+	list->offsets.resize(list->tiles_x * list->tiles_y);
+	list->dirty = 1;
+	list->binned = 0;
+	return list;
+}
+
+void light_list_destory(light_list_t* list)
+{
+	delete list;
+}
+
+int light_list_add(light_list_t* list, const point_light& light)
+{
+	list->lights.push_back(light);
+	list->dirty = 1;
+	return (int)list->lights.size() - 1;
+}
+
+void light_list_clear(light_list_t* list)
+{
+	list->lights.clear();
+	list->dirty = 1;
+}
+
+// screen tiles of device the sphere of light can touch seen with list->vp, false when it is behind the camera.
+// the 8 corners of its bounding box are projected, a corner behind the eye covers the screen
+static bool light_tile_rect(light_list_t* list, const device_t* device, point_light& light, int* rect)
+{
+	float r = light.range;
+	float min_x = 1e30f, max_x = -1e30f, min_y = 1e30f, max_y = -1e30f;
+	bool behind = false, in_front = false;
+	for (int k = 0; k < 8; k++)
+	{
+		s_vector corner(light.lightpos.x + ((k & 1) ? r : -r), light.lightpos.y + ((k & 2) ? r : -r),
+			light.lightpos.z + ((k & 4) ? r : -r), 1.0f);
+		s_vector clip, screen;
+		apply_to_vector(clip, corner, list->vp);
+		if (clip.w < 1e-4f) { behind = true; continue; }
+		in_front = true;
+		device_homogenize(device, screen, clip);
+		min_x = std::min(min_x, screen.x); max_x = std::max(max_x, screen.x);
+		min_y = std::min(min_y, screen.y); max_y = std::max(max_y, screen.y);
+	}
+	if (!in_front) return false;
+	if (behind)
+	{
+		rect[0] = 0; rect[1] = 0;
+		rect[2] = list->tiles_x - 1; rect[3] = list->tiles_y - 1;
+		return true;
+	}
+	if (max_x < 0.0f || max_y < 0.0f || min_x >= (float)list->width || min_y >= (float)list->height) return false;
+	rect[0] = std::max((int)floorf(min_x), 0) / LIGHT_TILE_SIZE;
+	rect[1] = std::max((int)floorf(min_y), 0) / LIGHT_TILE_SIZE;
+	rect[2] = std::min((int)ceilf(max_x), list->width - 1) / LIGHT_TILE_SIZE;
+	rect[3] = std::min((int)ceilf(max_y), list->height - 1) / LIGHT_TILE_SIZE;
+	return true;
+}
+
+void light_list_update(light_list_t* list, const device_t* device, arena_t* scratch)
+{
+	const s_matrix& vp = device->transform.vp;
+	float viewport[4] = { device->transform.w, device->transform.h, device->viewport_x, device->viewport_y };
+	if (!list->dirty && memcmp(&list->vp, &vp, sizeof(s_matrix)) == 0 && memcmp(list->viewport, viewport, sizeof(viewport)) == 0) return;
+	list->vp = vp;
+	memcpy(list->viewport, viewport, sizeof(viewport));
+	list->dirty = 0;
+	int tiles = list->tiles_x * list->tiles_y;
+	int n = (int)list->lights.size();
+	int* rects = arena_array<int>(scratch, n * 4);
+	char* visible = arena_array<char>(scratch, n);
+	// counting sort: the size of every tile list first, then the indices in light order
+	int* counts = arena_array<int>(scratch, tiles);
+	memset(counts, 0, sizeof(int) * tiles);
+	for (int i = 0; i < n; i++)
+	{
+		int* rect = &rects[i * 4];
+		visible[i] = light_tile_rect(list, device, list->lights[i], rect);
+		if (!visible[i]) continue;
+		for (int ty = rect[1]; ty <= rect[3]; ty++)
+			for (int tx = rect[0]; tx <= rect[2]; tx++) counts[ty * list->tiles_x + tx]++;
+	}
+	int total = 0;
+	for (int t = 0; t < tiles; t++)
+	{
+		list->offsets[t] = total;
+		total += counts[t] + 1;
+	}
+	list->indices.resize(total);
+	list->binned = total - tiles;
+	int* fill = arena_array<int>(scratch, tiles);
+	memcpy(fill, &list->offsets[0], sizeof(int) * tiles);
+	for (int i = 0; i < n; i++)
+	{
+		if (!visible[i]) continue;
+		int* rect = &rects[i * 4];
+		for (int ty = rect[1]; ty <= rect[3]; ty++)
+			for (int tx = rect[0]; tx <= rect[2]; tx++) list->indices[fill[ty * list->tiles_x + tx]++] = i;
+	}
+	for (int t = 0; t < tiles; t++) list->indices[fill[t]] = -1;
+}
@@ -0,0 +1,56 @@
+#ifndef light_h
+#define light_h
+//=====================================================================
+// light list: range limited point lights on top of the scene light
+// pointlight[0]. once per frame every light is projected to the screen
+// and binned into tiles, each tile keeps the indices of the lights
+// that can reach one of its pixels.
+//=====================================================================
+#include "render.h"
+#include "arena.h"
+#include <vector>
+
+#define LIGHT_TILE_SIZE 16
+
+struct light_list_t
+{
+	std::vector<point_light> lights;
+	int width, height;
+	int tiles_x, tiles_y;
+	std::vector<int> offsets;           // per tile, start of its list in indices
+	std::vector<int> indices;           // light indices of every tile, each list ends with -1
+	s_matrix vp;                        // the view projection the tiles were built for
+	float viewport[4];                  // and the frame size and region corner of device_homogenize
+	int dirty;                          // lights changed since the last light_list_update
+	int binned;                         // tile entries of the last build, for profiling
+};
+
+light_list_t* light_list_create(int width, int height);
+
+void light_list_destory(light_list_t* list);
+
+// returns the index of the new light
+int light_list_add(light_list_t* list, const point_light& light);
+
+void light_list_clear(light_list_t* list);
+
+// rebuild the tiles when a light, the camera or the viewport of device changed since the last call, the
+// working arrays are taken from scratch
+void light_list_update(light_list_t* list, const device_t* device, arena_t* scratch);
+
+// -1 terminated light indices of the tile holding pixel (x, y)
+static inline const int* light_list_tile(const light_list_t* list, int x, int y)
+{
+	return &list->indices[list->offsets[(y / LIGHT_TILE_SIZE) * list->tiles_x + x / LIGHT_TILE_SIZE]];
+}
+
+// smooth window that reaches 0 at range, times the inverse square falloff
+static inline float light_attenuation(float distance, float range)
+{
+	float x = distance / range;
+	float window = 1.0f - x * x * x * x;
+	if (window <= 0.0f) return 0.0f;
+	return window * window / (distance * distance + 1.0f);
+}
+
+#endif
@@ -0,0 +1,188 @@
+#include "lightmap.h"
+#include "raytrace.h"
+#include "texture.h"
+#include "scene_assets.h"
+#include "job.h"
+#include <cmath>
+#include <algorithm>
+
+// cells per row and rows of cells for tris triangles, about square
+static void lightmap_cells(int tris, int& cells_x, int& cells_y)
+{
+	cells_x = std::max((int)ceilf(sqrtf((float)tris)), 1);
+	cells_y = std::max((tris + cells_x - 1) / cells_x, 1);
+}
+
+typedef struct
+{
+	const raytrace_t* rt;
+	std::vector<s_vector> pos, normal; // world space corners of the triangles
+	int tris, cells_x, cell, width;
+	int rays;
+	s_vector lightpos, ambient, diffuse;
+	std::vector<IUINT32> texels;
+}lightmap_bake_t;
+
+// the corner weights of texel (x, y) of its cell, clamped into the triangle so the texels around it
+// repeat its border
+static void lightmap_weights(const lightmap_bake_t* bake, int x, int y, float& s, float& t)
+{
+	float inner = (float)(bake->cell - 2 * LIGHTMAP_PAD);
+	s = std::max(((float)(x % bake->cell) + 0.5f - LIGHTMAP_PAD) / inner, 0.0f);
+	t = std::max(((float)(y % bake->cell) + 0.5f - LIGHTMAP_PAD) / inner, 0.0f);
+	if (s + t > 1.0f)
+	{
+		float k = 1.0f / (s + t);
+		s *= k;
+		t *= k;
+	}
+}
+
+// the share of the hemisphere above p the triangles within LIGHTMAP_AO_DISTANCE leave open. the
+// directions are cosine weighted, turned by seed so neighbouring texels don't band
+static float lightmap_ambient(const lightmap_bake_t* bake, const s_vector& p, const s_vector& n, float seed)
+{
+	if (bake->rays <= 0) return 1.0f;
+	s_vector a = fabsf(n.x) < 0.9f ? s_vector(1.0f, 0.0f, 0.0f, 0.0f) : s_vector(0.0f, 1.0f, 0.0f, 0.0f);
+	s_vector tangent, binormal;
+	tangent.crossproduct(a, n);
+	tangent.normalize();
+	binormal.crossproduct(n, tangent);
+	int open = 0;
+	for (int k = 0; k < bake->rays; k++)
+	{
+		float u1 = ((float)k + 0.5f) / (float)bake->rays;
+		float r = sqrtf(u1), h = sqrtf(1.0f - u1);
+		float phi = 6.2831853f * ((float)k * 0.618034f + seed);
+		float c = cosf(phi) * r, s = sinf(phi) * r;
+		float to[3];
+		for (int i = 0; i < 3; i++)
+			to[i] = (&p.x)[i] + ((&tangent.x)[i] * c + (&binormal.x)[i] * s + (&n.x)[i] * h) * LIGHTMAP_AO_DISTANCE;
+		if (raytrace_visible(bake->rt, &p.x, to)) open++;
+	}
+	return (float)open / (float)bake->rays;
+}
+
+static IUINT32 lightmap_encode(const s_vector& light)
+{
+	IUINT32 c = 0xffu << 24;
+	for (int i = 0; i < 3; i++)
+	{
+		float v = std::min(std::max((&light.x)[i] / LIGHTMAP_RANGE, 0.0f), 1.0f);
+		c |= (IUINT32)(v * 255.0f + 0.5f) << (16 - 8 * i);
+	}
+	return c;
+}
+
+// job of lightmap_bake, the texel rows [begin, end)
+static void lightmap_bake_rows(void* data, int begin, int end)
+{
+	lightmap_bake_t* bake = (lightmap_bake_t*)data;
+	for (int y = begin; y < end; y++)
+	{
+		for (int x = 0; x < bake->width; x++)
+		{
+			IUINT32& texel = bake->texels[(size_t)y * bake->width + x];
+			int tri = (y / bake->cell) * bake->cells_x + x / bake->cell;
+			if (tri >= bake->tris) continue;
+			float s, t;
+			lightmap_weights(bake, x, y, s, t);
+			const s_vector* pos = &bake->pos[tri * 3];
+			const s_vector* normal = &bake->normal[tri * 3];
+			s_vector p = pos[0] + (pos[1] - pos[0]) * s + (pos[2] - pos[0]) * t;
+			s_vector n = normal[0] * (1.0f - s - t) + normal[1] * s + normal[2] * t;
+			n.normalize();
+			// the rays start above the surface so it doesn't hide itself
+			s_vector origin = p + n * LIGHTMAP_BIAS;
+			origin.w = 1.0f;
+			s_vector l = normalize(bake->lightpos - p);
+			float diff = std::max(dot(n, l), 0.0f);
+			if (diff > 0.0f && !raytrace_visible(bake->rt, &origin.x, &bake->lightpos.x)) diff = 0.0f;
+			float seed = (float)((x * 73 + y * 151) % 256) / 256.0f;
+			s_vector light = bake->ambient * lightmap_ambient(bake, origin, n, seed) + bake->diffuse * diff;
+			texel = lightmap_encode(light);
+		}
+	}
+}
+
+void lightmap_bake(s_texture* t, device_t* device, const vertex_t* mesh, int num, const s_matrix& world, int cell, int rays)
+{
+	lightmap_bake_t bake;
+	bake.rt = device->raytrace;
+	bake.tris = num / 3;
+	int cells_y;
+	lightmap_cells(bake.tris, bake.cells_x, cells_y);
+	bake.cell = std::max(cell, 2 * LIGHTMAP_PAD + 2);
+	bake.width = bake.cells_x * bake.cell;
+	bake.rays = rays;
+	bake.lightpos = device->pointlight[0].lightpos;
+	bake.ambient = device->pointlight[0].ambient;
+	bake.diffuse = device->pointlight[0].diffuse;
+	device->transform.world = world;
+	device->transform.update();
+	bake.pos.resize(bake.tris * 3);
+	bake.normal.resize(bake.tris * 3);
+	for (int i = 0; i < bake.tris * 3; i++)
+	{
+		bake.pos[i] = mesh[i].pos * device->transform.world;
+		bake.normal[i] = mesh[i].normal * device->transform.normal;
+		bake.normal[i].normalize();
+	}
+	int height = cells_y * bake.cell;
+	bake.texels.assign((size_t)bake.width * height, 0xffu << 24);
+	job_parallel_for(job_system(), 0, height, 1, lightmap_bake_rows, &bake);
+	std::vector<IUINT32*> rows(height);
+	for (int y = 0; y < height; y++) rows[y] = &bake.texels[(size_t)y * bake.width];
+	texture_store(t, &rows[0], bake.width, height, TEXTURE_LAYOUT_LINEAR);
+}
+
+// the albedo of the mesh's material times the baked light, alpha tested and blended like shade_phong_blend
+static void lightmap_fragment(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co)
+{
+	const s_material* lm = scene_material(device->assets, count);
+	const s_material* material = scene_material(device->assets, lm->light_material);
+	s_vector albedo(0.64f, 0.64f, 0.64f, 1.0f);
+	if (material->have_diffuse == 1)
+		texture_read(albedo, &material->diffuse_texture, ff->texcoord.u, ff->texcoord.v, ff->duv, device->texture_filter);
+	if (albedo.w < 0.1f)
+	{
+		is_ban = 1;
+		return;
+	}
+	if (ori_co.x != -1.0f) albedo = albedo * albedo.w + ori_co * (1.0f - albedo.w);
+	s_vector light;
+	texture_read(light, &lm->light_texture, ff->color.r, ff->color.g, NULL, TEXTURE_FILTER_BILINEAR);
+	color.r = albedo.x * light.x * LIGHTMAP_RANGE;
+	color.g = albedo.y * light.y * LIGHTMAP_RANGE;
+	color.b = albedo.z * light.z * LIGHTMAP_RANGE;
+	color.a = 1.0f;
+}
+
+static const pipeline_t lightmap_pipeline = { SHADER_CUSTOM, "lightmap", v_shader, lightmap_fragment };
+
+void lightmap_init(lightmap_t* lm, device_t* device, const vertex_t* mesh, int num, const s_texture* texture, int material)
+{
+	scene_assets_t* assets = device->assets;
+	lm->material = (int)assets->material.size();
+	s_material* m = scene_assets_material(assets, lm->material);
+	m->pipeline = &lightmap_pipeline;
+	m->light_texture = *texture;
+	m->light_texture.srgb = 0;
+	m->light_material = material;
+	// the corners of every triangle in its cell, as texel centers of the bilinear lookup
+	int tris = num / 3, cells_x, cells_y;
+	lightmap_cells(tris, cells_x, cells_y);
+	int cell = texture->tex_width / cells_x;
+	float corner[3][2] = { { (float)LIGHTMAP_PAD, (float)LIGHTMAP_PAD }, { (float)(cell - LIGHTMAP_PAD), (float)LIGHTMAP_PAD },
+		{ (float)LIGHTMAP_PAD, (float)(cell - LIGHTMAP_PAD) } };
+	lm->mesh.assign(mesh, mesh + tris * 3);
+	for (int i = 0; i < tris * 3; i++)
+	{
+		int tri = i / 3;
+		float x = (float)((tri % cells_x) * cell) + corner[i % 3][0];
+		float y = (float)((tri / cells_x) * cell) + corner[i % 3][1];
+		lm->mesh[i].color.r = (x - 0.5f) / (float)std::max(texture->tex_width - 1, 1);
+		lm->mesh[i].color.g = (y - 0.5f) / (float)std::max(texture->tex_height - 1, 1);
+		lm->mesh[i].material_idex = lm->material;
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef lightmap_h
+#define lightmap_h
+//=====================================================================
+// baked lightmaps of static geometry. every triangle of a mesh gets a
+// square cell of the lightmap, its corners inset by LIGHTMAP_PAD texels
+// so the bilinear lookup never reaches into the next cell, and the
+// texels of the cell hold the light of pointlight[0] on the triangle:
+// the ambient term times the share of the hemisphere no triangle hides
+// and the diffuse term times the traced shadow, both against the world
+// space triangles a ray traced frame captured. specular light depends
+// on the eye and is not baked. the lightmap pipeline shades with the
+// diffuse texture of the mesh's own material times the lightmap, so
+// no light is evaluated per pixel.
+//=====================================================================
+#include "render.h"
+#include <vector>
+
+#define LIGHTMAP_CELL        32      // texels per side of the cell of a triangle, by default
+#define LIGHTMAP_PAD         1       // texels between the corners of a triangle and the border of its cell
+#define LIGHTMAP_RANGE       2.0f    // light of a texel channel of 255, the brighter texels are clamped
+#define LIGHTMAP_BIAS        1e-3f   // world units the rays of a texel start above the surface
+#define LIGHTMAP_AO_DISTANCE 1.0f    // triangles further away don't darken the ambient term
+
+typedef struct
+{
+	std::vector<vertex_t> mesh;  // the mesh with the lightmap uv in color.r and color.g
+	int material;                // material count bound to the lightmap pipeline
+}lightmap_t;
+
+// bake the light of device->pointlight[0] on the triangle list mesh[0, num) placed by world into t,
+// cell texels per triangle, TEXTURE_LAYOUT_LINEAR. the shadows and the rays hiding the ambient term, rays
+// per texel and 0 for none, are traced against the triangles device->raytrace captured, raytrace_end
+// must have built them. sets device->transform.world to world
+void lightmap_bake(s_texture* t, device_t* device, const vertex_t* mesh, int num, const s_matrix& world, int cell, int rays);
+
+// lm draws mesh[0, num) with the light of texture, a lightmap_bake of the same mesh. albedo and alpha
+// come from the diffuse texture of material, the lightmapped copy gets a material count of its own
+void lightmap_init(lightmap_t* lm, device_t* device, const vertex_t* mesh, int num, const s_texture* texture, int material);
+
+#endif
@@ -10,9 +10,22 @@
 #include<ctime>
 #include<iostream>
 #include<vector>
+#include <chrono>
+#include <thread>
 #include"s_math.h"
 #include "rasterize.h"
 #include "render.h"
+#include "texture.h"
+#include "scene.h"
+#include "scene_file.h"
+#include "scene_assets.h"
+#include "upscale.h"
+#include "frame_pacer.h"
+#include "swap_chain.h"
+#include "profile.h"
+#include "taa.h"
+#include "present.h"
+#include "memory_track.h"
 
 using namespace std;
 //=====================================================================
@@ -24,9 +37,7 @@ int screen_w, screen_h, screen_exit = 0;
 int screen_mx = 0, screen_my = 0, screen_mb = 0;
 int screen_keys[512];	// ǰ̰״̬
 static HWND screen_handle = NULL;		//  HWND
-static HDC screen_dc = NULL;			// ׵ HDC
-static HBITMAP screen_hb = NULL;		// DIB
-static HBITMAP screen_ob = NULL;		// ϵ BITMAP
+static present_t* screen_surface = NULL;	// DIB sections the device draws into, see present.h
 unsigned char* screen_fb = NULL;		// frame buffer
 long screen_pitch = 0;
 
@@ -35,6 +46,7 @@ int screen_init(int w, int h, const TCHAR* title);	// 
 int screen_close(void);								// رĻ
 void screen_dispatch(void);							// Ϣ
 void screen_update(void);							// ʾ FrameBuffer
+void screen_blit(void);								// screen_update without the messages, safe off the window thread
 
 // win32 event handler
 static LRESULT screen_events(HWND, UINT, WPARAM, LPARAM);
@@ -48,12 +60,8 @@ static LRESULT screen_events(HWND, UINT, WPARAM, LPARAM);
 int screen_init(int w, int h, const TCHAR* title) {
 	WNDCLASS wc = { CS_BYTEALIGNCLIENT, (WNDPROC)screen_events, 0, 0, 0,
 		NULL, NULL, NULL, NULL, _T("SCREEN3.1415926") };
-	BITMAPINFO bi = { { sizeof(BITMAPINFOHEADER), w, -h, 1, 32, BI_RGB,
-		w * h * 4, 0, 0, 0, 0 } };
 	RECT rect = { 0, 0, w, h };
 	int wx, wy, sx, sy;
-	LPVOID ptr;
-	HDC hDC;
 
 	screen_close();
 
@@ -68,18 +76,14 @@ int screen_init(int w, int h, const TCHAR* title) {
 	if (screen_handle == NULL) return -2;
 
 	screen_exit = 0;
-	hDC = GetDC(screen_handle);
-	screen_dc = CreateCompatibleDC(hDC);
-	ReleaseDC(screen_handle, hDC);
+	// two buffers, one on screen while the swap chain draws the other
+	screen_surface = present_create(PRESENT_DIB, w, h, 2, screen_handle);
+	if (screen_surface == NULL) return -3;
 
-	screen_hb = CreateDIBSection(screen_dc, &bi, DIB_RGB_COLORS, &ptr, 0, 0);
-	if (screen_hb == NULL) return -3;
-
-	screen_ob = (HBITMAP)SelectObject(screen_dc, screen_hb);
-	screen_fb = (unsigned char*)ptr;
+	screen_fb = screen_surface->buffers[0]->pixels;
 	screen_w = w;
 	screen_h = h;
-	screen_pitch = w * 4;
+	screen_pitch = screen_surface->buffers[0]->pitch;
 
 	AdjustWindowRect(&rect, GetWindowLong(screen_handle, GWL_STYLE), 0);
 	wx = rect.right - rect.left;
@@ -94,24 +98,13 @@ int screen_init(int w, int h, const TCHAR* title) {
 	screen_dispatch();
 
 	memset(screen_keys, 0, sizeof(int) * 512);
-	memset(screen_fb, 0, w * h * 4);
 
 	return 0;
 }
 
 int screen_close(void) {
-	if (screen_dc) {
-		if (screen_ob) {
-			SelectObject(screen_dc, screen_ob);
-			screen_ob = NULL;
-		}
-		DeleteDC(screen_dc);
-		screen_dc = NULL;
-	}
-	if (screen_hb) {
-		DeleteObject(screen_hb);
-		screen_hb = NULL;
-	}
+	present_destory(screen_surface);
+	screen_surface = NULL;
 	if (screen_handle) {
 		CloseWindow(screen_handle);
 		screen_handle = NULL;
@@ -133,14 +126,12 @@ static LRESULT screen_events(HWND hWnd, UINT msg,
 	WPARAM wParam, LPARAM lParam) {
 	switch (msg) {
 	case WM_LBUTTONDOWN:
-	{  //printf("%lf %lf\n", me, rou);
-		//printf("\n%lf\n", theta_);
-	//	break;
-	//	eye.show();
-	//	s_vector temp; temp.add_two(eye, at); temp.show();
-	//	at.show();
-	//	up.show();
-	//	printf("\n");
+	{
+		// picked by the main loop after the next frame
+		screen_mx = (short)LOWORD(lParam);
+		screen_my = (short)HIWORD(lParam);
+		screen_mb = 1;
+		break;
 	}
 	case WM_MOUSEMOVE:
 	{   
@@ -163,13 +154,21 @@ void screen_dispatch(void) {
 	}
 }
 
+void screen_blit(void) {
+	int shown = screen_surface->shown >= 0 ? screen_surface->shown : 0;
+	present_show(screen_surface, screen_surface->buffers[shown]);
+}
+
 void screen_update(void) {
-	HDC hDC = GetDC(screen_handle);
-	BitBlt(hDC, 0, 0, screen_w, screen_h, screen_dc, 0, 0, SRCCOPY);
-	ReleaseDC(screen_handle, hDC);
+	screen_blit();
 	screen_dispatch();
 }
 
+// the swap chain's present callback, runs on its present thread
+static void screen_present(const surface_t* buffer, void* user) {
+	present_show(screen_surface, buffer);
+}
+
 void update_1(device_t* device, float start, float end, float now)
 {
 	
@@ -178,13 +177,13 @@ void update_1(device_t* device, float start, float end, float now)
 	int B =  0;
 	for (int i = 110; i <= 110+150; i++)
 	{
-		device->framebuffer[50][i] = (R << 16) | (G << 8) | (B);
-		device->framebuffer[60][i] = (R << 16) | (G << 8) | (B);
+		surface_row_u32(device->output, 50)[i] = (R << 16) | (G << 8) | (B);
+		surface_row_u32(device->output, 60)[i] = (R << 16) | (G << 8) | (B);
 	}
 	for (int i = 50; i <= 50 + 10; i++)
 	{
-		device->framebuffer[i][110] = (R << 16) | (G << 8) | (B);
-		device->framebuffer[i][260]= (R << 16) | (G << 8) | (B);
+		surface_row_u32(device->output, i)[110] = (R << 16) | (G << 8) | (B);
+		surface_row_u32(device->output, i)[260]= (R << 16) | (G << 8) | (B);
 	}
 	float down =(end - start); float up =( now - start);
 	float get = up / down;
@@ -196,20 +195,20 @@ void update_1(device_t* device, float start, float end, float now)
 		if (110 + doit<= 190)
 		{
 			left = 110; right = 110 + doit-1;
-			device->framebuffer[i][110 + doit] = (R << 16) | (G << 8) | (B);
-			device->framebuffer[i][110 + doit + 10] = (R << 16) | (G << 8) | (B);
+			surface_row_u32(device->output, i)[110 + doit] = (R << 16) | (G << 8) | (B);
+			surface_row_u32(device->output, i)[110 + doit + 10] = (R << 16) | (G << 8) | (B);
 		}
 		else
 		{
 			left = 110; right = 249;
-			device->framebuffer[i][250] = (R << 16) | (G << 8) | (B);
-			device->framebuffer[i][260] = (R << 16) | (G << 8) | (B);
+			surface_row_u32(device->output, i)[250] = (R << 16) | (G << 8) | (B);
+			surface_row_u32(device->output, i)[260] = (R << 16) | (G << 8) | (B);
 		}
 	}
 	for(int i=50;i<=50+10;i++)
 	for (int j = left; j <= right; j++)
 	{
-		device->framebuffer[i][j]= (R << 16) | (G << 8) | (B);
+		surface_row_u32(device->output, i)[j]= (R << 16) | (G << 8) | (B);
 	}
 }
 
@@ -221,13 +220,13 @@ void update_2(device_t* device, float start, float end, float now)
 	int B = 0;
 	for (int i = 110; i <= 110 + 150; i++)
 	{
-		device->framebuffer[50+30][i] = (R << 16) | (G << 8) | (B);
-		device->framebuffer[60+30][i] = (R << 16) | (G << 8) | (B);
+		surface_row_u32(device->output, 50+30)[i] = (R << 16) | (G << 8) | (B);
+		surface_row_u32(device->output, 60+30)[i] = (R << 16) | (G << 8) | (B);
 	}
 	for (int i = 50; i <= 50 + 10; i++)
 	{
-		device->framebuffer[i+30][110] = (R << 16) | (G << 8) | (B);
-		device->framebuffer[i+30][260] = (R << 16) | (G << 8) | (B);
+		surface_row_u32(device->output, i+30)[110] = (R << 16) | (G << 8) | (B);
+		surface_row_u32(device->output, i+30)[260] = (R << 16) | (G << 8) | (B);
 	}
 	float down = (end - start); float up = (now - start);
 	float get = up / down;
@@ -239,621 +238,54 @@ void update_2(device_t* device, float start, float end, float now)
 		if (110 + doit <= 190)
 		{
 			left = 110; right = 110 + doit - 1;
-			device->framebuffer[i+30][110 + doit] = (R << 16) | (G << 8) | (B);
-			device->framebuffer[i+30][110 + doit + 10] = (R << 16) | (G << 8) | (B);
+			surface_row_u32(device->output, i+30)[110 + doit] = (R << 16) | (G << 8) | (B);
+			surface_row_u32(device->output, i+30)[110 + doit + 10] = (R << 16) | (G << 8) | (B);
 		}
 		else
 		{
 			left = 110; right = 249;
-			device->framebuffer[i+30][250] = (R << 16) | (G << 8) | (B);
-			device->framebuffer[i+30][260] = (R << 16) | (G << 8) | (B);
+			surface_row_u32(device->output, i+30)[250] = (R << 16) | (G << 8) | (B);
+			surface_row_u32(device->output, i+30)[260] = (R << 16) | (G << 8) | (B);
 		}
 	}
 
 	for (int i = 50; i <= 50 + 10; i++)
 		for (int j = left; j <= right; j++)
 		{
-			device->framebuffer[i+30][j] = (R << 16) | (G << 8) | (B);
+			surface_row_u32(device->output, i+30)[j] = (R << 16) | (G << 8) | (B);
 		}
 	
 }
 //=====================================================================
 // 
 //=====================================================================
-vertex_t mesh[36] = {
-	// Positions                  // Texture Coords  //color           //rhw // Normals
-	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f,-1.0f,0.0f},1},
-	{{-0.5f,  0.5f, -0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f ,1.0f}, 1,{ 0.0f,  0.0f,-1.0f,0.0f},1},
-	{{0.5f,  0.5f, -0.5f, 1.0f}, {1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f ,1.0f},1, {0.0f,  0.0f,-1.0f ,0.0f},1},
-	{{0.5f,  0.5f, -0.5f, 1.0f}, { 1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f ,1.0f},1, {0.0f,  0.0f,-1.0f,0.0f},1},
-	{{0.5f, -0.5f, -0.5f, 1.0f}, {1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, {0.0f,  0.0f,-1.0f ,0.0f},1},
-	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1,{ 0.0f,  0.0f,-1.0f,0.0f},1},
-
-	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f},{1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f, 1.0f,0.0f},1},
-	{{0.5f, -0.5f,  0.5f, 1.0f},{ 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, {0.0f,  0.0f,  1.0f,0.0f},1},
-	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},1},
-	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},1},
-	{{-0.5f,  0.5f,  0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f,  1.0f,0.0f},1},
-	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, { 0.0f,  0.0f,  1.0f,0.0f},1},
-
-	{{-0.5f,  0.5f,  0.5f, 1.0f}, { 1.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f}, 1, {-1.0f,  0.0f,  0.0f,0.0f},1},
-	{{-0.5f,  0.5f, -0.5f, 1.0f},{ 1.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { -1.0f,  0.0f,  0.0f,0.0f},1},
-	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, { -1.0f,  0.0f,  0.0f,0.0f},1},
-	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { -1.0f,  0.0f,  0.0f,0.0f},1},
-	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f}, 1, { -1.0f,  0.0f,  0.0f,0.0f},1},
-	{{-0.5f,  0.5f,  0.5f,1.0f},{ 1.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { -1.0f,  0.0f,  0.0f,0.0f},1},
-
-	{{0.5f,  0.5f,  0.5f,1.0f}, { 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {1.0f,  0.0f,  0.0f,0.0f},1},
-	{{0.5f, -0.5f,  0.5f,1.0f},{ 0.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},1},
-	{{0.5f, -0.5f, -0.5f,1.0f},{ 0.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},1},
-	{{0.5f, -0.5f, -0.5f,1.0f},{ 0.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},1},
-	{{0.5f,  0.5f, -0.5f,1.0f},{ 1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},1},
-	{{0.5f,  0.5f,  0.5f,1.0f},{ 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},1},
-
-	{{-0.5f, -0.5f, -0.5f,1.0f},{  0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, {  0.0f, -1.0f,  0.0f,0.0f},1},
-	{{0.5f, -0.5f, -0.5f,1.0f}, { 1.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, { 0.0f, -1.0f,  0.0f,0.0f},1},
-	{{0.5f, -0.5f,  0.5f,1.0f}, { 1.0f,  0.0f}, {1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f, -1.0f,  0.0f,0.0f},1},
-	{{0.5f, -0.5f,  0.5f,1.0f}, { 1.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1,{ 0.0f, -1.0f,  0.0f,0.0f},1},
-	{{-0.5f, -0.5f,  0.5f,1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, {  0.0f, -1.0f,  0.0f,0.0f},1},
-	{{-0.5f, -0.5f, -0.5f,1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, {  0.0f, -1.0f,  0.0f,0.0f},1},
-
-	{{-0.5f,  0.5f, -0.5f, 1.0f}, {0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f, 1.0f,  0.0f,0.0f},1},
-	{{-0.5f,  0.5f,  0.5f, 1.0f},  {0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1,{ 0.0f, 1.0f,  0.0f,0.0f},1},
-	{{0.5f,  0.5f,  0.5f, 1.0f},  {1.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,1.0f,  0.0f,0.0f},1},
-	{{0.5f,  0.5f,  0.5f, 1.0f},  {1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,1.0f,  0.0f,0.0f},1},
-	{{0.5f,  0.5f, -0.5f, 1.0f},  {1.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1,{ 0.0f,1.0f,  0.0f,0.0f},1},
-	{{-0.5f,  0.5f, -0.5f, 1.0f},  {0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1,{ 0.0f, 1.0f,  0.0f,0.0f},1}
-};
-vertex_t mesh2[36] = {
-	// Positions                  // Texture Coords  //color           //rhw // Normals  //index_material
-	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 1.0f, 1.0f, 1.0f },1, { 0.0f,  0.0f,-1.0f,0.0f},2},
-	{{-0.5f,  0.5f, -0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 1.0f, 1.0f ,1.0f}, 1,{ 0.0f,  0.0f,-1.0f,0.0f},2},
-	{{0.5f,  0.5f, -0.5f, 1.0f}, {1.0f,  1.0f}, { 1.0f, 1.0f, 1.0f ,1.0f},1, {0.0f,  0.0f,-1.0f ,0.0f},2},
-	{{0.5f,  0.5f, -0.5f, 1.0f}, { 1.0f,  1.0f}, { 1.0f, 1.0f, 1.0f ,1.0f},1, {0.0f,  0.0f,-1.0f,0.0f},2},
-	{{0.5f, -0.5f, -0.5f, 1.0f}, {1.0f,  0.0f}, { 1.0f, 1.0f, 1.0f, 1.0f },1, {0.0f,  0.0f,-1.0f ,0.0f},2},
-	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  0.0f},{1.0f, 1.0f, 1.0f, 1.0f }, 1,{ 0.0f,  0.0f,-1.0f,0.0f},2},
-
-	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f},{1.0f, 1.0f, 1.0f, 1.0f },1, { 0.0f,  0.0f, 1.0f,0.0f},2},
-	{{0.5f, -0.5f,  0.5f, 1.0f},{ 1.0f,  0.0f}, { 1.0f, 1.0f, 1.0f, 1.0f },1, {0.0f,  0.0f,  1.0f,0.0f},2},
-	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  1.0f}, { 1.0f, 1.0f, 1.0f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},2},
-	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  1.0f}, { 1.0f, 1.0f, 1.0f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},2},
-	{{-0.5f,  0.5f,  0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 1.0f, 1.0f, 1.0f },1, { 0.0f,  0.0f,  1.0f,0.0f},2},
-	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 1.0f, 1.0f, 1.0f }, 1, { 0.0f,  0.0f,  1.0f,0.0f},2},
-
-	{{-0.5f,  0.5f,  0.5f, 1.0f}, { 1.0f,  0.0f},{ 1.0f, 1.0f, 1.0f, 1.0f}, 1, {-1.0f,  0.0f,  0.0f,0.0f},2},
-	{{-0.5f,  0.5f, -0.5f, 1.0f},{ 1.0f,  1.0f},{ 1.0f, 1.0f, 1.0f, 1.0f },1, { -1.0f,  0.0f,  0.0f,0.0f},2},
-	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 1.0f, 1.0f, 1.0f }, 1, { -1.0f,  0.0f,  0.0f,0.0f},2},
-	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 1.0f, 1.0f, 1.0f },1, { -1.0f,  0.0f,  0.0f,0.0f},2},
-	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 1.0f, 1.0f, 1.0f}, 1, { -1.0f,  0.0f,  0.0f,0.0f},2},
-	{{-0.5f,  0.5f,  0.5f,1.0f},{ 1.0f,  0.0f},{ 1.0f, 1.0f, 1.0f, 1.0f },1, { -1.0f,  0.0f,  0.0f,0.0f},2},
-
-	{{0.5f,  0.5f,  0.5f,1.0f}, { 1.0f,  0.0f}, {1.0f, 1.0f, 1.0f, 1.0f }, 1, {1.0f,  0.0f,  0.0f,0.0f},2},
-	{{0.5f, -0.5f,  0.5f,1.0f},{ 0.0f,  0.0f}, { 1.0f, 1.0f, 1.0f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},2},
-	{{0.5f, -0.5f, -0.5f,1.0f},{ 0.0f,  1.0f}, {1.0f, 1.0f, 1.0f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},2},
-	{{0.5f, -0.5f, -0.5f,1.0f},{ 0.0f,  1.0f}, { 1.0f, 1.0f, 1.0f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},2},
-	{{0.5f,  0.5f, -0.5f,1.0f},{ 1.0f,  1.0f}, { 1.0f, 1.0f, 1.0f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},2},
-	{{0.5f,  0.5f,  0.5f,1.0f},{ 1.0f,  0.0f}, { 1.0f, 1.0f, 1.0f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},2},
-
-	{{-0.5f, -0.5f, -0.5f,1.0f},{  0.0f,  1.0f},{ 1.0f, 1.0f, 1.0f, 1.0f }, 1, {  0.0f, -1.0f,  0.0f,0.0f},2},
-	{{0.5f, -0.5f, -0.5f,1.0f}, { 1.0f,  1.0f},{ 1.0f, 1.0f, 1.0f, 1.0f }, 1, { 0.0f, -1.0f,  0.0f,0.0f},2},
-	{{0.5f, -0.5f,  0.5f,1.0f}, { 1.0f,  0.0f}, {1.0f, 1.0f, 1.0f, 1.0f },1, { 0.0f, -1.0f,  0.0f,0.0f},2},
-	{{0.5f, -0.5f,  0.5f,1.0f}, { 1.0f,  0.0f},{ 1.0f, 1.0f, 1.0f, 1.0f }, 1,{ 0.0f, -1.0f,  0.0f,0.0f},2},
-	{{-0.5f, -0.5f,  0.5f,1.0f},{ 0.0f,  0.0f},{ 1.0f, 1.0f, 1.0f, 1.0f },1, {  0.0f, -1.0f,  0.0f,0.0f},2},
-	{{-0.5f, -0.5f, -0.5f,1.0f},{ 0.0f,  1.0f},{ 1.0f, 1.0f, 1.0f, 1.0f }, 1, {  0.0f, -1.0f,  0.0f,0.0f},2},
-
-	{{-0.5f,  0.5f, -0.5f, 1.0f}, {0.0f,  1.0f},{ 1.0f, 1.0f, 1.0f, 1.0f },1, { 0.0f, 1.0f,  0.0f,0.0f},2},
-	{{-0.5f,  0.5f,  0.5f, 1.0f},  {0.0f,  0.0f},{1.0f, 1.0f, 1.0f, 1.0f },1,{ 0.0f, 1.0f,  0.0f,0.0f},2},
-	{{0.5f,  0.5f,  0.5f, 1.0f},  {1.0f,  0.0f},{ 1.0f, 1.0f, 1.0f, 1.0f },1, { 0.0f,1.0f,  0.0f,0.0f},2},
-	{{0.5f,  0.5f,  0.5f, 1.0f},  {1.0f,  0.0f}, { 1.0f, 1.0f, 1.0f, 1.0f },1, { 0.0f,1.0f,  0.0f,0.0f},2},
-	{{0.5f,  0.5f, -0.5f, 1.0f},  {1.0f,  1.0f},{ 1.0f, 1.0f, 1.0f, 1.0f }, 1,{ 0.0f,1.0f,  0.0f,0.0f},2},
-	{{-0.5f,  0.5f, -0.5f, 1.0f},  {0.0f,  1.0f},{1.0f, 1.0f, 1.0f, 1.0f },1,{ 0.0f, 1.0f,  0.0f,0.0f},2}
-};
-
-vertex_t mesh_grass[6] =
-{
-	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  1.0f},{1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f, 1.0f,0.0f},19},
-	{{0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, {0.0f,  0.0f,  1.0f,0.0f},19},
-	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},19},
-	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},19},
-	{{-0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f,  1.0f,0.0f},19},
-	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, { 0.0f,  0.0f,  1.0f,0.0f},19}
-
-
-
-};
-
-vertex_t mesh_window[6] =
-{
-		{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  1.0f},{1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f, 1.0f,0.0f},18},
-	{{0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, {0.0f,  0.0f,  1.0f,0.0f},18},
-	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},18},
-	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},18},
-	{{-0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f,  1.0f,0.0f},18},
-	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, { 0.0f,  0.0f,  1.0f,0.0f},18}
-
-
-};
-
-vertex_t mesh_bump[36] = {
-	// Positions                  // Texture Coords  //color           //rhw // Normals
-	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f,-1.0f,0.0f},17},
-	{{-0.5f,  0.5f, -0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f ,1.0f}, 1,{ 0.0f,  0.0f,-1.0f,0.0f},17},
-	{{0.5f,  0.5f, -0.5f, 1.0f}, {1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f ,1.0f},1, {0.0f,  0.0f,-1.0f ,0.0f},17},
-	{{0.5f,  0.5f, -0.5f, 1.0f}, { 1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f ,1.0f},1, {0.0f,  0.0f,-1.0f,0.0f},17},
-	{{0.5f, -0.5f, -0.5f, 1.0f}, {1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, {0.0f,  0.0f,-1.0f ,0.0f},17},
-	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1,{ 0.0f,  0.0f,-1.0f,0.0f},17},
-
-	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f},{1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f, 1.0f,0.0f},17},
-	{{0.5f, -0.5f,  0.5f, 1.0f},{ 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, {0.0f,  0.0f,  1.0f,0.0f},17},
-	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},17},
-	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},17},
-	{{-0.5f,  0.5f,  0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f,  1.0f,0.0f},17},
-	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, { 0.0f,  0.0f,  1.0f,0.0f},17},
-
-	{{-0.5f,  0.5f,  0.5f, 1.0f}, { 1.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f}, 1, {-1.0f,  0.0f,  0.0f,0.0f},17},
-	{{-0.5f,  0.5f, -0.5f, 1.0f},{ 1.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { -1.0f,  0.0f,  0.0f,0.0f},17},
-	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, { -1.0f,  0.0f,  0.0f,0.0f},17},
-	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { -1.0f,  0.0f,  0.0f,0.0f},17},
-	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f}, 1, { -1.0f,  0.0f,  0.0f,0.0f},17},
-	{{-0.5f,  0.5f,  0.5f,1.0f},{ 1.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { -1.0f,  0.0f,  0.0f,0.0f},17},
-
-	{{0.5f,  0.5f,  0.5f,1.0f}, { 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {1.0f,  0.0f,  0.0f,0.0f},17},
-	{{0.5f, -0.5f,  0.5f,1.0f},{ 0.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},17},
-	{{0.5f, -0.5f, -0.5f,1.0f},{ 0.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},17},
-	{{0.5f, -0.5f, -0.5f,1.0f},{ 0.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},17},
-	{{0.5f,  0.5f, -0.5f,1.0f},{ 1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},17},
-	{{0.5f,  0.5f,  0.5f,1.0f},{ 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},17},
-
-	{{-0.5f, -0.5f, -0.5f,1.0f},{  0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, {  0.0f, -1.0f,  0.0f,0.0f},17},
-	{{0.5f, -0.5f, -0.5f,1.0f}, { 1.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, { 0.0f, -1.0f,  0.0f,0.0f},17},
-	{{0.5f, -0.5f,  0.5f,1.0f}, { 1.0f,  0.0f}, {1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f, -1.0f,  0.0f,0.0f},17},
-	{{0.5f, -0.5f,  0.5f,1.0f}, { 1.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1,{ 0.0f, -1.0f,  0.0f,0.0f},17},
-	{{-0.5f, -0.5f,  0.5f,1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, {  0.0f, -1.0f,  0.0f,0.0f},17},
-	{{-0.5f, -0.5f, -0.5f,1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, {  0.0f, -1.0f,  0.0f,0.0f},17},
-
-	{{-0.5f,  0.5f, -0.5f, 1.0f}, {0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f, 1.0f,  0.0f,0.0f},17},
-	{{-0.5f,  0.5f,  0.5f, 1.0f},  {0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1,{ 0.0f, 1.0f,  0.0f,0.0f},17},
-	{{0.5f,  0.5f,  0.5f, 1.0f},  {1.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,1.0f,  0.0f,0.0f},17},
-	{{0.5f,  0.5f,  0.5f, 1.0f},  {1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,1.0f,  0.0f,0.0f},17},
-	{{0.5f,  0.5f, -0.5f, 1.0f},  {1.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1,{ 0.0f,1.0f,  0.0f,0.0f},17},
-	{{-0.5f,  0.5f, -0.5f, 1.0f},  {0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1,{ 0.0f, 1.0f,  0.0f,0.0f},17}
-};
-
-std::vector<vertex_t> tot_vertex;
-std::vector<vertex_t> tot_data;
-std::vector<int> indices;
-
-std::vector<vertex_t> tot_vertex2;
-std::vector<vertex_t> tot_data2;
-std::vector<int> indices2;
-void draw_box(device_t* device, float theta)
-{
-	int now_num = device->now_state;
-	if (now_num == 7)
-	{
-		int cnt = 0;
-
-		cnt++;
-		s_matrix m;
-		s_vector axis(-1.0f, -0.5f, 1.0f, 1.0f);
-		s_vector pos(2.0f, 1.0f, 0.0f, 1.0f);
-		s_vector scale(0.6f, 0.6f, 0.6f, 1.0f);
-		//m.set_rotate_translate_scale(axis, theta, pos, scale);
-		m.set_rotate_translate_scale(axis, theta, pos, scale);
-		device->transform.world = m;
-		device->transform.update();
-
-		device->material[20].shininess = 32.0f;
-		device->PBR.ao = 1.0f;
-		
-
-		draw_plane_STRIP(device, tot_data, indices, cnt);
-		//draw_plane(device,tot_data.size(), tot_data,cnt);
-
-		//to draw the light box
-		cnt++;
-		axis.reset(-1.0f, -0.5f, 1.0f, 1.0f);
-		pos.reset(0.0f, 2.0f, 2.0f, 1.0f);
-		scale.reset(0.2f, 0.2f, 0.2f, 1.0f);
-		m.set_rotate_translate_scale(axis, 1.0f, pos, scale);
-		s_vector rightpos(0.5f, 0.5f, 0.5f, 1.0f);
-		s_vector pos2;
-		apply_to_vector(pos2, rightpos, m);
-		s_vector light_color(m1, m1, m1, m1);
-
-		s_vector light_ambient(0.5f, 0.5f, 0.5f, 1.0f);
-		s_vector light_diffuse(0.5f, 0.5f, 0.5f, 1.0f);
-		s_vector light_specular(1.0f, 1.0f, 1.0f, 1.0f);
-
-		device_set_pointlight(device, pos2, light_color, light_ambient, light_diffuse, light_specular, 0);
-		device->transform.world = m;
-		device->transform.update();
-		draw_plane(device, 36, mesh2, cnt);
-	}
-	else if (now_num == 1)
-	{
-		int cnt = 0;
-		cnt++;
-		s_matrix m;
-		s_vector axis(-1.0f, -0.5f, 1.0f, 1.0f);
-		s_vector pos(2.0f, 0.0f, 0.0f, 1.0f);
-		s_vector scale(1.0f, 1.0f, 1.0f, 1.0f);
-		m.set_rotate_translate_scale(axis, theta, pos, scale);
-	//	m.set_rotate(-1, -0.5, 1, theta);
-		device->transform.world = m;
-		device->transform.update();
-		// this is the first box 
-		device->m1 = m1;
-		device->m2 = m2;
-		draw_plane(device, 36, mesh, cnt);
-
-		//to draw the light box
-		cnt++;
-		axis.reset(-1.0f, -0.5f, 1.0f, 1.0f);
-		pos.reset(2.3f, 1.0f, 1.0f, 1.0f);
-		scale.reset(0.2f, 0.2f, 0.2f, 1.0f);
-		m.set_rotate_translate_scale(axis, 1.0f, pos, scale);
-		s_vector rightpos(0.5f, 0.5f, 0.5f, 1.0f);
-		s_vector pos2;
-		apply_to_vector(pos2, rightpos, m);
-		s_vector light_color(1.0f, 1.0f, 1.0f, 1.0f);
-		device_set_pointlight(device, pos2, light_color, 0);
-		device->transform.world = m;
-		device->transform.update();
-		draw_plane(device, 36, mesh2, cnt);
-	}
-	else if (now_num == 2)
-	{
-		int cnt = 0;
-		cnt++;
-		s_matrix m;
-		m.set_rotate(-1, -0.5, 1, theta);
-		device->transform.world = m;
-		device->transform.update();
-		// this is the first box 
-
-		//ò
-
-		//device_set_material(device, m_ambient, m_diffuse, m_specular, m_shininess, cnt);
-
-
-		device->material[cnt].shininess = 64.0f;
-		draw_plane(device, 36, mesh, cnt);
-
-		//to draw the light box
-		cnt++;
-		s_vector axis(-1.0f, -0.5f, 1.0f, 1.0f);
-		s_vector pos(0.0f, 2.0f, 2.0f, 1.0f);
-		s_vector scale(0.2f, 0.2f, 0.2f, 1.0f);
-		m.set_rotate_translate_scale(axis, 1.0f, pos, scale);
-		s_vector rightpos(0.5f, 0.5f, 0.5f, 1.0f);
-		s_vector pos2;
-		apply_to_vector(pos2, rightpos, m);
-		s_vector light_color(1.0f, 1.0f, 1.0f, 1.0f);
-
-		s_vector light_ambient(0.2f, 0.2f, 0.2f, 1.0f);
-		s_vector light_diffuse(0.5f, 0.5f, 0.5f, 1.0f);
-		s_vector light_specular(1.0f, 1.0f, 1.0f, 1.0f);
-
-		device_set_pointlight(device, pos2, light_color, light_ambient, light_diffuse, light_specular, 0);
-		device->transform.world = m;
-		device->transform.update();
-		draw_plane(device, 36, mesh2, cnt);
-	}
-	else if (now_num == 3)
-	{
-	int cnt = 0;
-	cnt++;
-	s_matrix m;
-
-
-	//to draw the light box
-	cnt++;
-	s_vector axis(-1.0f, -0.5f, 1.0f, 1.0f);
-	s_vector pos(4.0f, 2.0f, 2.0f, 1.0f);
-	s_vector scale(0.2f, 0.2f, 0.2f, 1.0f);
-	m.set_rotate_translate_scale(axis, 1.0f, pos, scale);
-	s_vector rightpos(0.5f, 0.5f, 0.5f, 1.0f);
-	s_vector pos2;
-	apply_to_vector(pos2, rightpos, m);
-	s_vector light_color(1.0f, 1.0f, 1.0f, 1.0f);
-
-	s_vector light_ambient(m1,m1, m1, 1.0f);
-	s_vector light_diffuse(0.5f, 0.5f, 0.5f, 1.0f);
-	s_vector light_specular(1.0f, 1.0f, 1.0f, 1.0f);
-
-	device_set_pointlight(device, pos2, light_color, light_ambient, light_diffuse, light_specular, 0);
-	device->transform.world = m;
-	device->transform.update();
-	draw_plane(device, 36, mesh2, cnt);
-
-	axis.reset(1.0f, 0.0f, 0.0f, 1.0f);
-	pos.reset(0.0f, 1.5f, 0.0f, 1.0f);
-	scale.reset(0.3f, 0.3f, 0.3f, 1.0f);
-
-	//obj
-	cnt++;
-	m.set_rotate_translate_scale(axis, 3.5f, pos, scale);
-	device->transform.world = m;
-	device->transform.update();
-	draw_plane(device, tot_vertex.size(), tot_vertex, cnt);
-    }
-	else if (now_num == 4)
-	{
-	int cnt = 0;
-
-	cnt++;
-	s_matrix m;
-	s_vector axis(-1.0f, -0.5f, 1.0f, 1.0f);
-	s_vector pos(2.0f, 0.0f, 0.0f, 1.0f);
-	s_vector scale(1.0f, 1.0f, 1.0f, 1.0f);
-	//m.set_rotate_translate_scale(axis, theta, pos, scale);
-	m.set_rotate(-1, -0.5, 1, 2.44f);
-	m.set_rotate_translate_scale(axis, 2.44f, pos, scale);
-	device->transform.world = m;
-	device->transform.update();
-	// this is the first box 
-
-	//ò
-
-	//device_set_material(device, m_ambient, m_diffuse, m_specular, m_shininess, cnt);
-
-
-	device->material[cnt].shininess = 64.0f;
-	draw_plane(device, 36, mesh, cnt);
-
-	//to draw the light box
-	cnt++;
-	axis.reset(-1.0f, -0.5f, 1.0f, 1.0f);
-	pos.reset(2.3f, 2.0f, 2.0f, 1.0f);
-	scale.reset(0.2f, 0.2f, 0.2f, 1.0f);
-	m.set_rotate_translate_scale(axis, 1.0f, pos, scale);
-	s_vector rightpos(0.5f, 0.5f, 0.5f, 1.0f);
-	s_vector pos2;
-	apply_to_vector(pos2, rightpos, m);
-	s_vector light_color(1.0f, 1.0f, 1.0f, 1.0f);
-
-	s_vector light_ambient(0.2f, 0.2f, 0.2f, 1.0f);
-	s_vector light_diffuse(0.5f, 0.5f, 0.5f, 1.0f);
-	s_vector light_specular(1.0f, 1.0f, 1.0f, 1.0f);
-
-	device_set_pointlight(device, pos2, light_color, light_ambient, light_diffuse, light_specular, 0);
-	device->transform.world = m;
-	device->transform.update();
-	draw_plane(device, 36, mesh2, cnt);
-
-	// 
-	cnt++;
-	axis.reset(1.0f, 0.0f, 0.0f, 1.0f);
-	pos.reset(1.0f, 1.0f + m1, -1.0f, 1.0f);
-	scale.reset(1.0f, 1.0f, 1.0f, 1.0f);
-	m.set_rotate_translate_scale(axis, -0.30f, pos, scale);
-
-	//theta_ = theta;
-	device->transform.world = m;
-	device->transform.update();
-	device->material[19].shininess = 16.0f;
-	draw_plane(device, 6, mesh_grass, cnt);
-	//obj
-	/*
-	cnt++;
-	m.set_rotate_translate_scale(axis, theta, pos, scale);
-	device->transform.world = m;
-	device->transform.update();
-	draw_plane(device, tot_vertex.size(), tot_vertex, cnt);
-	*/
-
-	//
-	cnt++;
-	axis.reset(1.0f, 0.0f, 0.0f, 1.0f);
-	pos.reset(1.0f, 1.0f, 0.0f, 1.0f);
-	scale.reset(1.0f, 1.0f, 1.0f, 1.0f);
-	m.set_rotate_translate_scale(axis, -0.30f, pos, scale);
-	//theta_ = theta;
-	device->transform.world = m;
-	device->transform.update();
-	device->material[18].shininess = 16.0f;
-	draw_plane(device, 6, mesh_window, cnt);
-    }
-	else if (now_num == 5)
-	{
-	int cnt = 0;
-
-	cnt++;
-	s_matrix m;
-	s_vector axis(-1.0f, -0.5f, 1.0f, 1.0f);
-	s_vector pos(2.0f, 1.0f, 0.0f, 1.0f);
-	s_vector scale(1.5f, 1.5f, 1.5f, 1.5f);
-	//m.set_rotate_translate_scale(axis, theta, pos, scale);
-	m.set_rotate(-1, -0.5, 1, theta);
-	device->transform.world = m;
-	device->transform.update();
-	// this is the first box 
-
-	//ò
-
-	//device_set_material(device, m_ambient, m_diffuse, m_specular, m_shininess, cnt);
-
-
-	device->material[17].shininess = 32.0f;
-	draw_plane(device, 36, mesh_bump, cnt);
-
-	//to draw the light box
-	cnt++;
-	axis.reset(-1.0f, -0.5f, 1.0f, 1.0f);
-	pos.reset(0.0f, 2.0f, 2.0f, 1.0f);
-	scale.reset(0.2f, 0.2f, 0.2f, 1.0f);
-	m.set_rotate_translate_scale(axis, 1.0f, pos, scale);
-	s_vector rightpos(0.5f, 0.5f, 0.5f, 1.0f);
-	s_vector pos2;
-	apply_to_vector(pos2, rightpos, m);
-	s_vector light_color(1.0f, 1.0f, 1.0f, 1.0f);
-
-	s_vector light_ambient(0.2f, 0.2f, 0.2f, 1.0f);
-	s_vector light_diffuse(0.5f, 0.5f, 0.5f, 1.0f);
-	s_vector light_specular(1.0f, 1.0f, 1.0f, 1.0f);
-
-	device_set_pointlight(device, pos2, light_color, light_ambient, light_diffuse, light_specular, 0);
-	device->transform.world = m;
-	device->transform.update();
-	draw_plane(device, 36, mesh2, cnt);
-    }
-	else if (now_num == 6)
-	{
-	int cnt = 0;
-
-	cnt++;
-	s_matrix m;
-	s_vector axis(-1.0f, -0.5f, 1.0f, 1.0f);
-	s_vector pos(2.0f, 1.0f, 0.0f, 1.0f);
-	s_vector scale(0.6f, 0.6f, 0.6f, 1.0f);
-	//m.set_rotate_translate_scale(axis, theta, pos, scale);
-	m.set_rotate_translate_scale(axis, theta, pos, scale);
-	device->transform.world = m;
-	device->transform.update();
-
-	device->material[17].shininess = 32.0f;
-
-	device->PBR.albedo.x = 0.5f; device->PBR.albedo.y = 0.0f; device->PBR.albedo.z = 0.0f; device->PBR.albedo.w = 1.0f;
-	device->PBR.ao = 1.0f;
-	device->PBR.metallic = m1 / 7.0f;
-	device->PBR.roughness = m2 / 7.0f;
-
-	draw_plane_STRIP(device, tot_data2, indices2, cnt);
-	//draw_plane(device,tot_data.size(), tot_data,cnt);
-
-	//to draw the light box
-	cnt++;
-	axis.reset(-1.0f, -0.5f, 1.0f, 1.0f);
-	pos.reset(0.0f, 2.0f, 2.0f, 1.0f);
-	scale.reset(0.2f, 0.2f, 0.2f, 1.0f);
-	m.set_rotate_translate_scale(axis, 1.0f, pos, scale);
-	s_vector rightpos(0.5f, 0.5f, 0.5f, 1.0f);
-	s_vector pos2;
-	apply_to_vector(pos2, rightpos, m);
-	s_vector light_color(1.18f,1.18f, 1.18f, 1.0f);
-
-	s_vector light_ambient(0.5f, 0.5f, 0.5f, 1.0f);
-	s_vector light_diffuse(0.5f, 0.5f, 0.5f, 1.0f);
-	s_vector light_specular(1.0f, 1.0f, 1.0f, 1.0f);
-
-	device_set_pointlight(device, pos2, light_color, light_ambient, light_diffuse, light_specular, 0);
-	device->transform.world = m;
-	device->transform.update();
-	draw_plane(device, 36, mesh2, cnt);
-
-    }
-}
-
 float deltaTime = 0.0f;
-float lastFrame = 0.0f;
-
-void get_the_ball(std::vector<vertex_t>& tot_data,std::vector<int>& indices)
-{
-	const unsigned int X_SEGMENTS = 64;
-	const unsigned int Y_SEGMENTS = 64;
-	const float PI = 3.14159265359;
-	for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
-	{
-		for (unsigned int y = 0; y <= Y_SEGMENTS; ++y)
-		{
-			float xSegment = (float)x / (float)X_SEGMENTS;
-			float ySegment = (float)y / (float)Y_SEGMENTS;
-			float xPos = std::cos(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
-			float yPos = std::cos(ySegment * PI);
-			float zPos = std::sin(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
-			vertex_t m;
-			m.pos.x = xPos; m.pos.y = yPos;  m.pos.z = zPos; m.pos.w = 1.0f;
-			m.tc.u = xSegment; m.tc.v = ySegment;
-			m.normal.x = xPos; m.normal.y = yPos; m.normal.z = zPos;
-			m.material_idex = 20;
-			m.rhw = 1;
-			m.color.r = 0.5f; m.color.g = 0.0f; m.color.b = 0.0f; m.color.a = 1.0f;
-			//positions.push_back(glm::vec3(xPos, yPos, zPos));
-			//uv.push_back(glm::vec2(xSegment, ySegment));
-		//	normals.push_back(glm::vec3(xPos, yPos, zPos));
-			tot_data.push_back(m);
-			
-		}
-	}
-	bool oddRow = false;
-	for (unsigned int y = 0; y < Y_SEGMENTS; ++y)
-	{
-		if (!oddRow) // even rows: y == 0, y == 2; and so on
-		{
-			for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
-			{
-				indices.push_back(y * (X_SEGMENTS + 1) + x);
-				indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-			}
-		}
-		else
-		{
-			for (int x = X_SEGMENTS; x >= 0; --x)
-			{
-				indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-				indices.push_back(y * (X_SEGMENTS + 1) + x);
-			}
-		}
-		oddRow = !oddRow;
-	}
-		
-}
-void get_the_ball2(std::vector<vertex_t>& tot_data, std::vector<int>& indices)
+// everything the keys change that the picture depends on, a frame equal to the last one is not drawn again
+typedef struct
 {
-	const unsigned int X_SEGMENTS = 64;
-	const unsigned int Y_SEGMENTS = 64;
-	const float PI = 3.14159265359;
-	for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
-	{
-		for (unsigned int y = 0; y <= Y_SEGMENTS; ++y)
-		{
-			float xSegment = (float)x / (float)X_SEGMENTS;
-			float ySegment = (float)y / (float)Y_SEGMENTS;
-			float xPos = std::cos(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
-			float yPos = std::cos(ySegment * PI);
-			float zPos = std::sin(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
-			vertex_t m;
-			m.pos.x = xPos; m.pos.y = yPos;  m.pos.z = zPos; m.pos.w = 1.0f;
-			m.tc.u = xSegment; m.tc.v = ySegment;
-			m.normal.x = xPos; m.normal.y = yPos; m.normal.z = zPos;
-			m.material_idex = 16;
-			m.rhw = 1;
-			m.color.r = 0.5f; m.color.g = 0.0f; m.color.b = 0.0f; m.color.a = 1.0f;
-			//positions.push_back(glm::vec3(xPos, yPos, zPos));
-			//uv.push_back(glm::vec2(xSegment, ySegment));
-		//	normals.push_back(glm::vec3(xPos, yPos, zPos));
-			tot_data.push_back(m);
-
-		}
-	}
-	bool oddRow = false;
-	for (unsigned int y = 0; y < Y_SEGMENTS; ++y)
-	{
-		if (!oddRow) // even rows: y == 0, y == 2; and so on
-		{
-			for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
-			{
-				indices.push_back(y * (X_SEGMENTS + 1) + x);
-				indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-			}
-		}
-		else
-		{
-			for (int x = X_SEGMENTS; x >= 0; --x)
-			{
-				indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-				indices.push_back(y * (X_SEGMENTS + 1) + x);
-			}
-		}
-		oddRow = !oddRow;
-	}
+	s_vector eye, at;
+	float alpha, m1, m2;
+	int now_state, render_state, is_cull, bump;
+	float render_scale;
+}view_state_t;
 
+static void view_state_get(view_state_t* state, device_t* device, float alpha)
+{
+	// zeroed so that the padding compares equal too
+	memset(state, 0, sizeof(view_state_t));
+	state->eye = eye;
+	state->at = at;
+	state->alpha = alpha;
+	state->m1 = m1;
+	state->m2 = m2;
+	state->now_state = device->now_state;
+	state->render_state = device->render_state;
+	state->is_cull = device->is_cull;
+	state->bump = device->assets->material[17].have_normal;
+	state->render_scale = device->render_scale;
 }
 int main()
 {
-	get_the_ball(tot_data, indices);
-	get_the_ball2(tot_data2, indices2);
 	device_t device;
 	int states[] = { RENDER_STATE_TEXTURE,RENDER_STATE_WIREFRAME };
 	int indicator = 0;
@@ -868,6 +300,9 @@ int main()
 	if (screen_init(800, 600, title)) return -1;
 
 	device_init(&device, 800, 600, screen_fb);
+	device_set_texture_filter(&device, TEXTURE_FILTER_TRILINEAR);
+	// only when built with SIMPLERENDER_PROFILE
+	device_set_profile(&device, 1);
 	
 	device.camera.viewpos = eye;
 	/* glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, 3.0f);
@@ -889,56 +324,27 @@ int main()
 
 	printf("F3,F4 ڻ\n");
 	printf("F5,F6 ھ߹(תҵ߹)\n");
+	printf("F7,F8 render scale, F9 automatic render scale\n");
+	printf("F10 print the frame profile\n");
+	printf("F11 temporal anti-aliasing\n");
 	printf("Loading,Please wait\n");
-		device.now_state = 1;
-		m1 = 0.01f; m2 = 1.0f;  alpha = 1.0f;
-		//ʾ1õĲϢ
-		
-		
-			device.material[20].have_diffuse = 0;
-			//init_texture_by_diffuse(&device, "photo/brickwall.jpg",1);
-			device.material[20].have_specular = 0;
-			//init_texture_by_specular(&device, "photo/container2_specular.png", 1);
-			device.material[20].have_normal = 1;
-
-			init_texture_by_normal(&device, "photo/rustediron2_normal.png", 20);
-			init_texture_by_albedo(&device, "photo/rustediron2_basecolor.png", 20);
-			init_texture_by_metallic(&device, "photo/rustediron2_metallic.png", 20);
-			init_texture_by_roughness(&device, "photo/rustediron2_roughness.png", 20);
-		
-
-			//ʾ1õĲϢ
-			device.material[1].have_diffuse = 1;
-			init_texture_by_diffuse(&device, "photo/container2.png", 1);
-			device.material[1].have_specular = 1;
-			init_texture_by_specular(&device, "photo/container2_specular.png", 1);
-		//init_texture_by_normal(&device, "photo/brickwall_normal.jpg", 1);
-
-
-			device.material[19].have_diffuse = 1;
-			init_texture_by_diffuse(&device, "photo/grass.png", 19);
-			device.material[19].have_specular = 0;
-
-			device.material[18].have_diffuse = 1;
-			init_texture_by_diffuse(&device, "photo/blending_transparent_window.png", 18);
-			device.material[18].have_specular = 0;
-
-			//ʾ1õĲϢ
-			device.material[17].have_diffuse = 1;
-			init_texture_by_diffuse(&device, "photo/brickwall.jpg", 17);
-			device.material[17].have_specular = 0;
-			//init_texture_by_specular(&device, "photo/container2_specular.png", 1);
-			device.material[17].have_normal = 1;
-
-			init_texture_by_normal(&device, "photo/brickwall_normal.jpg", 17);
-
-
-			//ʾ1õĲϢ
-			device.material[16].have_diffuse = 0;
-			//init_texture_by_diffuse(&device, "photo/brickwall.jpg",1);
-			device.material[16].have_specular = 0;
-			//init_texture_by_specular(&device, "photo/container2_specular.png", 1);
-			device.material[16].have_normal = 0;
+	{
+		// the window's help images, decoded while the scene loads
+		const char* files[] = { "tool/1_1.png", "tool/1_2.png", "tool/3_1.png", "tool/3_2.png", "tool/4_1.png", "tool/5_1.png", "tool/6_1.png", "tool/6_2.png",
+			"tool/7_1.png", "tool/7_2.png", "tool/8_1.png" };
+		for (int i = 0; i < (int)(sizeof(files) / sizeof(files[0])); i++) prefetch_texture(&device, files[i]);
+	}
+		scene_view(&device, 1, eye, at, alpha);
+		m1 = device.m1;
+		m2 = device.m2;
+		// the window keeps answering while the scene loads on a thread of its own
+		scene_loader_t* loader = scene_load_begin(&device);
+		while (!scene_load_poll(loader))
+		{
+			screen_dispatch();
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		scene_load_end(loader);
 
 			init_texture_by_diffuse(&device, "tool/1_1.png", 21);
 
@@ -962,7 +368,6 @@ int main()
 
 			init_texture_by_diffuse(&device, "tool/8_1.png", 31);
 
-			load_obj(tot_vertex, &device, "model/nanosuit.obj", "model", 3, 1);
 
 		//init_texture_by_diffuse(&device, "model/arm_dif.png", 3);
 			// if you wanna use the obj,please change the number of 3,as it means that it's the 3rd object.
@@ -972,28 +377,35 @@ int main()
 		//init_texture_by_photo(&device, "container2.png");
 		device.render_state = RENDER_STATE_TEXTURE;
 		int hitchange = 0;  int hit2 = 0;
+		// frames are paced to target_fps. F7 / F8 step the render scale, F9 lets it follow the frame time
+		const float target_fps = 30.0f;
+		render_scale_control_t scale_control;
+		render_scale_control_init(&scale_control, 1000.0f / target_fps, 0.5f, 1.0f);
+		int auto_scale = 0; int hitscale = 0; int hitprofile = 0; int hittaa = 0;
+		float render_ms = 0.0f;
+		frame_pacer_t pacer;
+		frame_pacer_init(&pacer, target_fps);
+		view_state_t drawn;
+		int have_drawn = 0;
+		int reload_frames = 0;
+		// the device draws into one DIB section while the other is blitted, nothing is copied in between
+		swap_chain_t* chain = swap_chain_create_on(screen_surface->buffers, screen_present, NULL);
 		while (screen_exit == 0 && screen_keys[VK_ESCAPE] == 0)
 		{
+			deltaTime = frame_pacer_wait(&pacer);
 			screen_dispatch();
-			device_clear(&device, 1);
-
-			//point_t eye = { x,y,z,1 }, at = { 0,0,0,1 }, up = { 0,0,1,1 };
-			s_vector attemp;
-			attemp.add_two(eye, at);
-			/*if (mousechange == true)
+			// the scene file and the images it names are checked about once a second, what changed is bound again
+			if (++reload_frames >= (int)target_fps)
 			{
-				mousechange = false;
-				at = front;
-			}*/
-
-
-			camera_at_zero(&device, eye, attemp, up);
-
+				reload_frames = 0;
+				if (scene_reload(&device) & SCENE_FILE_CAMERAS)
+				{
+					scene_view(&device, device.now_state, eye, at, alpha);
+					m1 = device.m1;
+					m2 = device.m2;
+				}
+			}
 
-			clock_t nowtime = clock();
-			float currentFrame = (float)nowtime / CLOCKS_PER_SEC;
-			deltaTime = currentFrame - lastFrame;
-			lastFrame = currentFrame;
 			float cameraSpeed = 2.7f * deltaTime;
 			s_vector att;
 			s_vector temp = { cameraSpeed,cameraSpeed,cameraSpeed,1.0f };
@@ -1039,8 +451,8 @@ int main()
 						hit2 = 1; 
 						if (m2 == 0.0f) m2 = 1.0f;
 						else m2 = 0.0f;
-						if (device.material[17].have_normal == 1) device.material[17].have_normal = 0;
-						else device.material[17].have_normal = 1;
+						if (device.assets->material[17].have_normal == 1) device.assets->material[17].have_normal = 0;
+						else device.assets->material[17].have_normal = 1;
 					}
 					
 				}
@@ -1140,68 +552,45 @@ int main()
 					device.now_state++;
 					if (device.now_state > 7) device.now_state = 1;
 					int the_num = device.now_state;
+					scene_view(&device, the_num, eye, at, alpha);
+					m1 = device.m1;
+					m2 = device.m2;
 					if (the_num == 1) 
 					{
 						hit2 = 0;
-						device.is_cull = 1;
-						eye.reset(2.472f, 0.378f, 10.346f, 1.0f);
-						at.reset(0.03139f, 0.0296f, -0.999f, 1.0f);
 
-						m1 = 0.01f; m2 = 1.0f;  alpha = 1.0f;
-					
 					printf("--------------------------------------------------\n"); 
 					printf("1.ֶphongղ\n"); 
 					printf("F1,F2ת\n");
-				
 					printf("F3,F4 ڻ\n");
 					printf("F5,F6 ھ߹(תҵ߹)\n");
 					}
 					else if (the_num == 2) 
 					{
 						hit2 = 0;
-						device.is_cull = 1;
-						eye.reset(0.6189f, 0.748992, 10.3465, 1.0f);
-						at.reset(0.041852,0.0314f,-0.9986f,1.0f);
-						alpha = 1.0f; printf("--------------------------------------------------\n"); 
+						printf("--------------------------------------------------\n"); 
 						printf("2.ͼ߹ͼĲʲ\n"); 
 						printf("F1,F2ת\n");
 					}
 					else if (the_num == 3) 
 					{
 						hit2 = 0;
-						device.is_cull = 1;
-						eye.reset(0.54118f, 1.43f, 9.918f, 1.0f);
-						at.reset(0.2888f, 0.0314f, -0.9568f, 1.0f);
-						alpha = 3.5f; m1 = 0.2f; printf("--------------------------------------------------\n"); printf("3.obj +յʵ\n");  printf("F3,F4ڻǿ\n");}
+						printf("--------------------------------------------------\n"); printf("3.obj +յʵ\n");  printf("F3,F4ڻǿ\n");}
 					else if (the_num == 4) 
 					{
 						hit2 = 0;
-						eye.reset(0.8868f, 1.471f, 8.4735f, 1.0f);
-						at.reset(0.228298f, -0.020942f, -0.97336f, 1.0f);
-						device.is_cull = 1;   m2 = 0.0f;
-						alpha = 1.0f; m1 = 0.0f;  printf("--------------------------------------------------\n"); printf("4.ϵչʾ ޳չʾ\n"); printf("F3,F4ƶС\n"); printf("F5ת޳\n"); }
+						printf("--------------------------------------------------\n"); printf("4.ϵչʾ ޳չʾ\n"); printf("F3,F4ƶС\n"); printf("F5ת޳\n"); }
 					else if (the_num == 5)
 					{
 						hit2 = 0;
-						device.is_cull = 1;  m2 = 0.0f;
-						eye.reset(-0.093224f, 1.51399f, 5.7037f, 1.0f);
-						at.reset(0.020937f, 0.015707f, -0.999657f, 1.0f);
-						alpha = 2.3f; printf("--------------------------------------------------\n"); printf("5.bumpչʾ\n"); printf("F1,F2ת\n"); printf("F3bump֮ǰ\n"); }
+						printf("--------------------------------------------------\n"); printf("5.bumpչʾ\n"); printf("F1,F2ת\n"); printf("F3bump֮ǰ\n"); }
 					else if (the_num == 6) 
 					{
 						hit2 = 0;
-						device.is_cull = 1;
-						eye.reset(1.1584f, 0.03366f, 8.6363f, 1.0f);
-						at.reset(-0.04627f, 0.187f, -0.98f, 1.0f);
-						alpha = 1.0f;  printf("--------------------------------------------------\n"); m1 = 6.5f; m2 = 2.0f; printf("6.pbrֶչʾ\n"); printf("F3,F4ڽ\n"); printf("F5,F6ڴֲڶ\n"); }
+						printf("--------------------------------------------------\n");   printf("6.pbrֶչʾ\n"); printf("F3,F4ڽ\n"); printf("F5,F6ڴֲڶ\n"); }
 					else if (the_num == 7)
 					{
 						hit2 = 0;
-						device.is_cull = 1;
-						m1 = 0.78f;
-						eye.reset(0.557345f, -0.021029f, 9.1009f, 1.0f);
-						at.reset(-0.000122f, 0.000541, -1.0f, 1.0f);
-						
 
 
 						printf("--------------------------------------------------\n");
@@ -1227,8 +616,100 @@ int main()
 			{
 				kbhit = 0;
 			}
+			if (screen_keys[VK_F7] || screen_keys[VK_F8] || screen_keys[VK_F9])
+			{
+				if (hitscale == 0)
+				{
+					hitscale = 1;
+					if (screen_keys[VK_F9])
+					{
+						auto_scale = !auto_scale;
+						scale_control.scale = device.render_scale;
+						scale_control.average_ms = 0.0f;
+					}
+					else
+					{
+						auto_scale = 0;
+						device_set_render_scale(&device, device.render_scale + (screen_keys[VK_F8] ? 0.125f : -0.125f));
+					}
+					printf("render scale %.3f%s\n", device.render_scale, auto_scale ? " auto" : "");
+				}
+			}
+			else
+			{
+				hitscale = 0;
+			}
+			if (screen_keys[VK_F10])
+			{
+				if (hitprofile == 0)
+				{
+					hitprofile = 1;
+					if (device.profile != NULL) profile_print(stdout, device.profile, PROFILE_HISTORY);
+					else printf("profile: built without SIMPLERENDER_PROFILE\n");
+				}
+			}
+			else
+			{
+				hitprofile = 0;
+			}
+			// F11 turns temporal anti-aliasing on and off
+			if (screen_keys[VK_F11])
+			{
+				if (hittaa == 0)
+				{
+					hittaa = 1;
+					device_set_taa(&device, device.taa == NULL);
+					printf("taa %s\n", device.taa != NULL ? "on" : "off");
+				}
+			}
+			else
+			{
+				hittaa = 0;
+			}
+			// nothing changed: the last frame is still in the buffer on screen, only present it
+			view_state_t state;
+			view_state_get(&state, &device, alpha);
+			// a still view keeps drawing until the taa history has every jitter phase
+			bool settling = device.taa != NULL && device.taa->frame < TAA_JITTER_PHASES;
+			if (have_drawn && !settling && memcmp(&state, &drawn, sizeof(state)) == 0)
+			{
+				swap_chain_flush(chain);
+				screen_update();
+				continue;
+			}
+			if (auto_scale && have_drawn)
+			{
+				device_set_render_scale(&device, render_scale_control_update(&scale_control, render_ms));
+				view_state_get(&state, &device, alpha);
+			}
+			memcpy(&drawn, &state, sizeof(state));
+			have_drawn = 1;
+			double render_start = frame_clock();
 
+			//point_t eye = { x,y,z,1 }, at = { 0,0,0,1 }, up = { 0,0,1,1 };
+			s_vector attemp;
+			attemp.add_two(eye, at);
+			camera_at_zero(&device, eye, attemp, up);
+
+			surface_t* back = swap_chain_acquire(chain);
+			device_set_framebuffer(&device, back->pixels, back->pitch);
+			if (device.profile != NULL) profile_frame_begin(device.profile);
+			// after the scale, a resize leaves the targets empty
+			device_clear(&device, 1);
+			device.m1 = m1;
+			device.m2 = m2;
 			draw_box(&device, alpha);
+			if (screen_mb)
+			{
+				// the window is the output, the scene is drawn at the render scale
+				float scale = (float)device.width / device.output_width;
+				int node = scene_pick(&device, screen_mx * scale, screen_my * scale);
+				printf("picked node %d of state %d\n", node, device.now_state);
+				screen_mb = 0;
+			}
+			device_resolve(&device);
+			device_present(&device);
+			double hud_start = frame_clock();
 
 			//Ǹ˵ͼ
 			for (int i = 30; i <= 30 + 150 - 1; i++)
@@ -1238,7 +719,7 @@ int main()
 					int xx = (i - 30);
 					int yy = (j - 500);
 					s_vector the_color;
-					read_the_texture_dir(the_color, &device.material[31].diffuse_texture, xx, yy);
+					read_the_texture_dir(the_color, &device.assets->material[31].diffuse_texture, xx, yy);
 					float a = the_color.w;
 					float r = the_color.x;
 					float g = the_color.y;
@@ -1249,7 +730,7 @@ int main()
 					R = CMID(R, 0, 255);
 					G = CMID(G, 0, 255);
 					B = CMID(B, 0, 255);
-					device.framebuffer[i][j] = (R << 16) | (G << 8) | (B);
+					surface_row_u32(device.output, i)[j] = (R << 16) | (G << 8) | (B);
 				}
 			}
 
@@ -1262,7 +743,7 @@ int main()
 						int xx =( i - 45);
 						int yy = (j);
 						s_vector the_color;
-						read_the_texture_dir(the_color, &device.material[21].diffuse_texture, xx, yy);
+						read_the_texture_dir(the_color, &device.assets->material[21].diffuse_texture, xx, yy);
 						float a = the_color.w;
 						float r = the_color.x;
 						float g = the_color.y;
@@ -1273,7 +754,7 @@ int main()
 						R = CMID(R, 0, 255);
 						G = CMID(G, 0, 255);
 						B = CMID(B, 0, 255);
-						device.framebuffer[i][j] = (R << 16) | (G << 8) | (B);
+						surface_row_u32(device.output, i)[j] = (R << 16) | (G << 8) | (B);
 					}
 				}
 
@@ -1284,7 +765,7 @@ int main()
 						int xx = (i - 45);
 						int yy = (j-270);
 						s_vector the_color;
-						read_the_texture_dir(the_color, &device.material[22].diffuse_texture, xx, yy);
+						read_the_texture_dir(the_color, &device.assets->material[22].diffuse_texture, xx, yy);
 						float a = the_color.w;
 						float r = the_color.x;
 						float g = the_color.y;
@@ -1295,7 +776,7 @@ int main()
 						R = CMID(R, 0, 255);
 						G = CMID(G, 0, 255);
 						B = CMID(B, 0, 255);
-						device.framebuffer[i][j] = (R << 16) | (G << 8) | (B);
+						surface_row_u32(device.output, i)[j] = (R << 16) | (G << 8) | (B);
 					}
 				}
 
@@ -1311,7 +792,7 @@ int main()
 						int xx = (i - 45);
 						int yy = (j);
 						s_vector the_color;
-						read_the_texture_dir(the_color, &device.material[23].diffuse_texture, xx, yy);
+						read_the_texture_dir(the_color, &device.assets->material[23].diffuse_texture, xx, yy);
 						float a = the_color.w;
 						float r = the_color.x;
 						float g = the_color.y;
@@ -1322,7 +803,7 @@ int main()
 						R = CMID(R, 0, 255);
 						G = CMID(G, 0, 255);
 						B = CMID(B, 0, 255);
-						device.framebuffer[i][j] = (R << 16) | (G << 8) | (B);
+						surface_row_u32(device.output, i)[j] = (R << 16) | (G << 8) | (B);
 					}
 				}
 
@@ -1333,7 +814,7 @@ int main()
 						int xx = (i - 45);
 						int yy = (j - 270);
 						s_vector the_color;
-						read_the_texture_dir(the_color, &device.material[24].diffuse_texture, xx, yy);
+						read_the_texture_dir(the_color, &device.assets->material[24].diffuse_texture, xx, yy);
 						float a = the_color.w;
 						float r = the_color.x;
 						float g = the_color.y;
@@ -1344,7 +825,7 @@ int main()
 						R = CMID(R, 0, 255);
 						G = CMID(G, 0, 255);
 						B = CMID(B, 0, 255);
-						device.framebuffer[i][j] = (R << 16) | (G << 8) | (B);
+						surface_row_u32(device.output, i)[j] = (R << 16) | (G << 8) | (B);
 					}
 				}
 				update_1(&device, 0.1f, 1.0f, m1);
@@ -1358,7 +839,7 @@ int main()
 						int xx = (i - 45);
 						int yy = (j);
 						s_vector the_color;
-						read_the_texture_dir(the_color, &device.material[25].diffuse_texture, xx, yy);
+						read_the_texture_dir(the_color, &device.assets->material[25].diffuse_texture, xx, yy);
 						float a = the_color.w;
 						float r = the_color.x;
 						float g = the_color.y;
@@ -1369,7 +850,7 @@ int main()
 						R = CMID(R, 0, 255);
 						G = CMID(G, 0, 255);
 						B = CMID(B, 0, 255);
-						device.framebuffer[i][j] = (R << 16) | (G << 8) | (B);
+						surface_row_u32(device.output, i)[j] = (R << 16) | (G << 8) | (B);
 					}
 				}
 				update_1(&device, 0.0f, 1.3f, m1);
@@ -1384,7 +865,7 @@ int main()
 					int xx = (i - 45);
 					int yy = (j);
 					s_vector the_color;
-					read_the_texture_dir(the_color, &device.material[26].diffuse_texture, xx, yy);
+					read_the_texture_dir(the_color, &device.assets->material[26].diffuse_texture, xx, yy);
 					float a = the_color.w;
 					float r = the_color.x;
 					float g = the_color.y;
@@ -1395,7 +876,7 @@ int main()
 					R = CMID(R, 0, 255);
 					G = CMID(G, 0, 255);
 					B = CMID(B, 0, 255);
-					device.framebuffer[i][j] = (R << 16) | (G << 8) | (B);
+					surface_row_u32(device.output, i)[j] = (R << 16) | (G << 8) | (B);
 				}
 			}
 			   update_1(&device, 0.0f, 1.0f, m2);
@@ -1410,7 +891,7 @@ int main()
 					int xx = (i - 45);
 					int yy = (j);
 					s_vector the_color;
-					read_the_texture_dir(the_color, &device.material[27].diffuse_texture, xx, yy);
+					read_the_texture_dir(the_color, &device.assets->material[27].diffuse_texture, xx, yy);
 					float a = the_color.w;
 					float r = the_color.x;
 					float g = the_color.y;
@@ -1421,7 +902,7 @@ int main()
 					R = CMID(R, 0, 255);
 					G = CMID(G, 0, 255);
 					B = CMID(B, 0, 255);
-					device.framebuffer[i][j] = (R << 16) | (G << 8) | (B);
+					surface_row_u32(device.output, i)[j] = (R << 16) | (G << 8) | (B);
 				}
 			}
 
@@ -1432,7 +913,7 @@ int main()
 					int xx = (i - 45);
 					int yy = (j - 270);
 					s_vector the_color;
-					read_the_texture_dir(the_color, &device.material[28].diffuse_texture, xx, yy);
+					read_the_texture_dir(the_color, &device.assets->material[28].diffuse_texture, xx, yy);
 					float a = the_color.w;
 					float r = the_color.x;
 					float g = the_color.y;
@@ -1443,7 +924,7 @@ int main()
 					R = CMID(R, 0, 255);
 					G = CMID(G, 0, 255);
 					B = CMID(B, 0, 255);
-					device.framebuffer[i][j] = (R << 16) | (G << 8) | (B);
+					surface_row_u32(device.output, i)[j] = (R << 16) | (G << 8) | (B);
 				}
 			}
 			update_1(&device, 0.0f, 1.0f, m1/7.0f);
@@ -1459,7 +940,7 @@ int main()
 					int xx = (i - 45);
 					int yy = (j);
 					s_vector the_color;
-					read_the_texture_dir(the_color, &device.material[29].diffuse_texture, xx, yy);
+					read_the_texture_dir(the_color, &device.assets->material[29].diffuse_texture, xx, yy);
 					float a = the_color.w;
 					float r = the_color.x;
 					float g = the_color.y;
@@ -1470,7 +951,7 @@ int main()
 					R = CMID(R, 0, 255);
 					G = CMID(G, 0, 255);
 					B = CMID(B, 0, 255);
-					device.framebuffer[i][j] = (R << 16) | (G << 8) | (B);
+					surface_row_u32(device.output, i)[j] = (R << 16) | (G << 8) | (B);
 				}
 			}
 
@@ -1481,7 +962,7 @@ int main()
 					int xx = (i - 45);
 					int yy = (j - 270);
 					s_vector the_color;
-					read_the_texture_dir(the_color, &device.material[30].diffuse_texture, xx, yy);
+					read_the_texture_dir(the_color, &device.assets->material[30].diffuse_texture, xx, yy);
 					float a = the_color.w;
 					float r = the_color.x;
 					float g = the_color.y;
@@ -1492,15 +973,25 @@ int main()
 					R = CMID(R, 0, 255);
 					G = CMID(G, 0, 255);
 					B = CMID(B, 0, 255);
-					device.framebuffer[i][j] = (R << 16) | (G << 8) | (B);
+					surface_row_u32(device.output, i)[j] = (R << 16) | (G << 8) | (B);
 				}
 			}
 			update_1(&device, 0.38f, 3.0f, m1);
 
             }
-			screen_update();
-			Sleep(1);
+			if (device.profile != NULL)
+			{
+				profile_add_ms(device.profile, PROFILE_STAGE_HUD, (frame_clock() - hud_start) * 1000.0);
+				profile_frame_end(device.profile);
+			}
+			render_ms = (float)((frame_clock() - render_start) * 1000.0);
+			swap_chain_submit(chain);
+			screen_dispatch();
 		}
+		swap_chain_destory(chain);
+		device_set_framebuffer(&device, screen_fb, screen_pitch);
+		// what the textures, meshes and targets held at their peak
+		memory_print(stdout);
 	
 		return 0;
 }
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "memory_track.h"
+#include <atomic>
+#include <cstdlib>
+#include <cassert>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#define MEMORY_HEADER 64         // in front of every block, keeps the ones on huge pages 64 byte aligned
+
+typedef struct
+{
+	size_t bytes;            // asked for
+	size_t mapped;           // length of the huge page mapping at the header, 0 for malloc
+	int tag;
+}memory_header_t;
+
+typedef struct
+{
+	std::atomic<long long> live, peak, allocations, huge, budget;
+}memory_counters_t;
+
+// one per tag and the total after them
+static memory_counters_t memory_counters[MEMORY_TAGS + 1];
+
+// large pages need a privilege on windows, the first refusal stops the tries
+static std::atomic<int> memory_huge_refused(0);
+
+static const char* memory_names[MEMORY_TAGS] = { "textures", "meshes", "targets", "scratch" };
+
+static void memory_count(memory_counters_t* c, long long bytes, long long huge)
+{
+	long long live = c->live.fetch_add(bytes) + bytes;
+	long long peak = c->peak.load();
+	while (live > peak && !c->peak.compare_exchange_weak(peak, live)) {}
+	if (huge != 0) c->huge.fetch_add(huge);
+}
+
+static void memory_add(int tag, long long bytes, long long huge)
+{
+	assert(tag >= 0 && tag < MEMORY_TAGS);
+	memory_count(&memory_counters[tag], bytes, huge);
+	memory_count(&memory_counters[MEMORY_TAGS], bytes, huge);
+}
+
+// size bytes starting on a huge page, NULL when the system has none to give
+static char* memory_map_huge(size_t size, size_t* mapped)
+{
+	if (memory_huge_refused.load(std::memory_order_relaxed)) return NULL;
+#if defined(_WIN32)
+	size_t page = GetLargePageMinimum();
+	if (page == 0)
+	{
+		memory_huge_refused = 1;
+		return NULL;
+	}
+	size_t length = (size + page - 1) & ~(page - 1);
+	char* p = (char*)VirtualAlloc(NULL, length, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+	if (p == NULL)
+	{
+		memory_huge_refused = 1;
+		return NULL;
+	}
+	*mapped = length;
+	return p;
+#elif defined(MADV_HUGEPAGE)
+	size_t length = (size + MEMORY_HUGE - 1) & ~(size_t)(MEMORY_HUGE - 1);
+	// mapped with a huge page to spare and trimmed to start on a boundary, so every page of it can be huge
+	char* p = (char*)mmap(NULL, length + MEMORY_HUGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == (char*)MAP_FAILED) return NULL;
+	char* start = (char*)(((size_t)p + MEMORY_HUGE - 1) & ~(size_t)(MEMORY_HUGE - 1));
+	if (start > p) munmap(p, start - p);
+	size_t tail = (size_t)(p + length + MEMORY_HUGE - (start + length));
+	if (tail > 0) munmap(start + length, tail);
+	// transparent huge pages, a system that has them off keeps small pages
+	madvise(start, length, MADV_HUGEPAGE);
+	*mapped = length;
+	return start;
+#else
+	(void)size;
+	(void)mapped;
+	memory_huge_refused = 1;
+	return NULL;
+#endif
+}
+
+static void memory_unmap_huge(char* base, size_t mapped)
+{
+#if defined(_WIN32)
+	(void)mapped;
+	VirtualFree(base, 0, MEM_RELEASE);
+#elif defined(MADV_HUGEPAGE)
+	munmap(base, mapped);
+#else
+	(void)base;
+	(void)mapped;
+#endif
+}
+
+void* memory_alloc(int tag, size_t bytes, int clear)
+{
+	size_t size = bytes + MEMORY_HEADER, mapped = 0;
+	// mapped pages come zeroed
+	char* base = bytes >= MEMORY_HUGE ? memory_map_huge(size, &mapped) : NULL;
+	if (base == NULL)
+	{
+		base = (char*)(clear ? calloc(size, 1) : malloc(size));
+		mapped = 0;
+	}
+	assert(base);
+	memory_header_t* header = (memory_header_t*)base;
+	header->bytes = bytes;
+	header->mapped = mapped;
+	header->tag = tag;
+	memory_counters[tag].allocations++;
+	memory_counters[MEMORY_TAGS].allocations++;
+	memory_add(tag, (long long)bytes, mapped != 0 ? (long long)bytes : 0);
+	return base + MEMORY_HEADER;
+}
+
+void memory_free(void* p)
+{
+	if (p == NULL) return;
+	char* base = (char*)p - MEMORY_HEADER;
+	memory_header_t* header = (memory_header_t*)base;
+	long long bytes = (long long)header->bytes;
+	memory_add(header->tag, -bytes, header->mapped != 0 ? -bytes : 0);
+	if (header->mapped != 0) memory_unmap_huge(base, header->mapped);
+	else free(base);
+}
+
+void memory_note(int tag, long long bytes)
+{
+	memory_add(tag, bytes, 0);
+}
+
+memory_stats_t memory_stats(int tag)
+{
+	const memory_counters_t* c = &memory_counters[tag >= 0 && tag < MEMORY_TAGS ? tag : MEMORY_TAGS];
+	memory_stats_t stats;
+	stats.live = c->live.load();
+	stats.peak = c->peak.load();
+	stats.allocations = c->allocations.load();
+	stats.huge = c->huge.load();
+	stats.budget = c->budget.load();
+	return stats;
+}
+
+void memory_set_budget(int tag, long long budget)
+{
+	if (tag >= 0 && tag <= MEMORY_TAGS) memory_counters[tag].budget = budget;
+}
+
+const char* memory_tag_name(int tag)
+{
+	return tag >= 0 && tag < MEMORY_TAGS ? memory_names[tag] : "total";
+}
+
+void memory_print(FILE* fp)
+{
+	const double mb = 1.0 / (1024.0 * 1024.0);
+	fprintf(fp, "memory:\n");
+	for (int tag = 0; tag <= MEMORY_TAGS; tag++)
+	{
+		memory_stats_t s = memory_stats(tag);
+		fprintf(fp, "  %-9s %8.1f MB live %8.1f MB peak %8.1f MB on huge pages %8lld allocations", memory_tag_name(tag),
+			s.live * mb, s.peak * mb, s.huge * mb, s.allocations);
+		if (s.budget > 0 && s.peak > s.budget) fprintf(fp, ", over the budget of %.1f MB", s.budget * mb);
+		fprintf(fp, "\n");
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef memory_track_h
+#define memory_track_h
+//=====================================================================
+// memory accounting: the big allocations of the renderer go through
+// memory_alloc with a tag, and the live and peak bytes of every tag
+// are kept in atomics, so they can be read while frames are drawn and
+// printed when the program ends. blocks of MEMORY_HUGE or more are put
+// on huge pages where the system has them: transparent huge pages on
+// linux, large pages on windows when the process may lock memory.
+// memory held in containers is noted by hand with memory_note.
+//=====================================================================
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+#define MEMORY_TEXTURES 0        // texel blocks, streamed levels and the texture row tables of device_init
+#define MEMORY_MESHES   1        // vertices, indices and levels of detail
+#define MEMORY_TARGETS  2        // surfaces: framebuffers, depth, colour and shadow targets
+#define MEMORY_SCRATCH  3        // per frame arenas
+#define MEMORY_TAGS     4
+
+#define MEMORY_HUGE (2 << 20)    // bytes from which a block goes on huge pages
+
+typedef struct
+{
+	long long live;          // bytes allocated and not freed
+	long long peak;          // most live bytes so far
+	long long allocations;   // memory_alloc calls so far
+	long long huge;          // live bytes on huge pages
+	long long budget;        // 0 for none, see memory_set_budget
+}memory_stats_t;
+
+// bytes for tag, 64 byte aligned on huge pages and 16 otherwise, zeroed when clear is set. never NULL
+void* memory_alloc(int tag, size_t bytes, int clear);
+
+// a block of memory_alloc, or NULL
+void memory_free(void* p);
+
+// bytes allocated (> 0) or freed (< 0) outside memory_alloc, so they count for tag too
+void memory_note(int tag, long long bytes);
+
+// the bytes a vector holds
+template <class T> inline long long memory_bytes(const std::vector<T>& v) { return (long long)(v.capacity() * sizeof(T)); }
+
+// tag MEMORY_TAGS is the total of every tag
+memory_stats_t memory_stats(int tag);
+
+// a peak above budget is reported by memory_print, 0 for none. MEMORY_TAGS sets the one of the total
+void memory_set_budget(int tag, long long budget);
+
+const char* memory_tag_name(int tag);
+
+// one line per tag and the total
+void memory_print(FILE* fp);
+
+#endif
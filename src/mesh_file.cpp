@@ -0,0 +1,199 @@
+#include "mesh_file.h"
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+
+// the fields of a vertex without the alignment padding between them
+static std::string mesh_vertex_key(const vertex_t* v)
+{
+	float f[19] = { v->pos.x, v->pos.y, v->pos.z, v->pos.w, v->tc.u, v->tc.v, v->color.r, v->color.g, v->color.b, v->color.a, v->rhw,
+		v->normal.x, v->normal.y, v->normal.z, v->tangent.x, v->tangent.y, v->tangent.z, v->tangent.w, (float)v->material_idex };
+	return std::string((const char*)f, sizeof(f));
+}
+
+void mesh_build_indexed(const vertex_t* list, const std::vector<mesh_group_t>& list_groups, std::vector<vertex_t>& vertices, std::vector<int>& indices, std::vector<mesh_group_t>& groups)
+{
+	// load_obj gives the corners of one obj vertex identical values, tangents included
+	std::map<std::string, int> welded;
+	for (size_t g = 0; g < list_groups.size(); g++)
+	{
+		mesh_group_t group = list_groups[g];
+		int end = group.first + group.count;
+		group.first = (int)indices.size();
+		for (int i = list_groups[g].first; i < end; i++)
+		{
+			std::string key = mesh_vertex_key(&list[i]);
+			std::map<std::string, int>::iterator it = welded.find(key);
+			if (it == welded.end())
+			{
+				it = welded.insert(std::make_pair(key, (int)vertices.size())).first;
+				vertex_t v(list[i]);
+				vertices.push_back(v);
+			}
+			indices.push_back(it->second);
+		}
+		groups.push_back(group);
+	}
+}
+
+static size_t mesh_file_align(size_t offset)
+{
+	return (offset + MESH_FILE_ALIGN - 1) / MESH_FILE_ALIGN * MESH_FILE_ALIGN;
+}
+
+static const int mesh_file_attributes[6] = { VERTEX_ATTR_POS, VERTEX_ATTR_TEXCOORD, VERTEX_ATTR_COLOR, VERTEX_ATTR_NORMAL, VERTEX_ATTR_TANGENT, VERTEX_ATTR_MATERIAL };
+static const size_t mesh_file_attribute_sizes[6] = { sizeof(s_vector), sizeof(s_vector2f), sizeof(s_color), sizeof(s_vector), sizeof(s_vector), sizeof(int) };
+
+// offsets of the vertex streams and record arrays, and the file size
+static size_t mesh_file_layout(const mesh_file_header_t* header, size_t offsets[MESH_FILE_SECTIONS])
+{
+	size_t sizes[MESH_FILE_SECTIONS];
+	for (int i = 0; i < 6; i++)
+		sizes[i] = (header->attributes & mesh_file_attributes[i]) ? (size_t)header->vertex_count * mesh_file_attribute_sizes[i] : 0;
+	sizes[6] = (size_t)header->index_count * sizeof(int);
+	sizes[7] = (size_t)header->group_count * sizeof(mesh_group_t);
+	sizes[8] = (size_t)header->material_count * sizeof(mesh_material_t);
+	size_t offset = sizeof(mesh_file_header_t);
+	for (int i = 0; i < MESH_FILE_SECTIONS; i++)
+	{
+		offsets[i] = mesh_file_align(offset);
+		offset = offsets[i] + sizes[i];
+	}
+	return offset;
+}
+
+static bool mesh_file_put(FILE* fp, size_t offset, const void* data, size_t size)
+{
+	static const char zeros[MESH_FILE_ALIGN] = { 0 };
+	long at = ftell(fp);
+	if (at < 0 || (size_t)at > offset) return false;
+	if (fwrite(zeros, 1, offset - (size_t)at, fp) != offset - (size_t)at) return false;
+	return size == 0 || fwrite(data, 1, size, fp) == size;
+}
+
+// one attribute of every vertex, tightly packed
+template <typename T>
+static bool mesh_file_put_stream(FILE* fp, size_t offset, const std::vector<vertex_t>& vertices, T vertex_t::* member)
+{
+	std::vector<T> stream;
+	stream.reserve(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		T value(vertices[i].*member);
+		stream.push_back(value);
+	}
+	return mesh_file_put(fp, offset, stream.empty() ? NULL : &stream[0], stream.size() * sizeof(T));
+}
+
+bool mesh_file_write(const char* path, const std::vector<vertex_t>& vertices, int attributes, const std::vector<int>& indices, const std::vector<mesh_group_t>& groups, const std::vector<mesh_material_t>& materials, int material_start)
+{
+	FILE* fp = fopen(path, "wb");
+	if (fp == NULL) return false;
+	mesh_file_header_t header;
+	memset(&header, 0, sizeof(header));
+	header.magic = MESH_FILE_MAGIC;
+	header.version = MESH_FILE_VERSION;
+	header.group_size = sizeof(mesh_group_t);
+	header.material_size = sizeof(mesh_material_t);
+	header.attributes = attributes | VERTEX_ATTR_POS;
+	header.vertex_count = (int)vertices.size();
+	header.index_count = (int)indices.size();
+	header.group_count = (int)groups.size();
+	header.material_count = (int)materials.size();
+	header.material_start = material_start;
+	size_t offsets[MESH_FILE_SECTIONS];
+	mesh_file_layout(&header, offsets);
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	if (ok) ok = mesh_file_put_stream(fp, offsets[0], vertices, &vertex_t::pos);
+	if (ok && (header.attributes & VERTEX_ATTR_TEXCOORD)) ok = mesh_file_put_stream(fp, offsets[1], vertices, &vertex_t::tc);
+	if (ok && (header.attributes & VERTEX_ATTR_COLOR)) ok = mesh_file_put_stream(fp, offsets[2], vertices, &vertex_t::color);
+	if (ok && (header.attributes & VERTEX_ATTR_NORMAL)) ok = mesh_file_put_stream(fp, offsets[3], vertices, &vertex_t::normal);
+	if (ok && (header.attributes & VERTEX_ATTR_TANGENT)) ok = mesh_file_put_stream(fp, offsets[4], vertices, &vertex_t::tangent);
+	if (ok && (header.attributes & VERTEX_ATTR_MATERIAL)) ok = mesh_file_put_stream(fp, offsets[5], vertices, &vertex_t::material_idex);
+	if (ok) ok = mesh_file_put(fp, offsets[6], indices.empty() ? NULL : &indices[0], indices.size() * sizeof(int));
+	if (ok) ok = mesh_file_put(fp, offsets[7], groups.empty() ? NULL : &groups[0], groups.size() * sizeof(mesh_group_t));
+	if (ok) ok = mesh_file_put(fp, offsets[8], materials.empty() ? NULL : &materials[0], materials.size() * sizeof(mesh_material_t));
+	if (fclose(fp) != 0) ok = false;
+	return ok;
+}
+
+// the records of a mapped file point only inside it: indices to vertices, groups to indices and vertices to the
+// materials before them and of the file, the material paths end within MESH_PATH_MAX
+static bool mesh_file_check(const mesh_file_header_t* header, const char* base, const size_t offsets[MESH_FILE_SECTIONS])
+{
+	if (header->material_start < 0) return false;
+	const int* indices = (const int*)(base + offsets[6]);
+	for (int i = 0; i < header->index_count; i++)
+		if (indices[i] < 0 || indices[i] >= header->vertex_count) return false;
+	const mesh_group_t* groups = (const mesh_group_t*)(base + offsets[7]);
+	for (int g = 0; g < header->group_count; g++)
+		if (groups[g].first < 0 || groups[g].count < 0 || (long long)groups[g].first + groups[g].count > header->index_count) return false;
+	if (header->attributes & VERTEX_ATTR_MATERIAL)
+	{
+		const int* material = (const int*)(base + offsets[5]);
+		for (int i = 0; i < header->vertex_count; i++)
+			if (material[i] < 0 || material[i] >= (long long)header->material_start + header->material_count) return false;
+	}
+	const mesh_material_t* materials = (const mesh_material_t*)(base + offsets[8]);
+	for (int m = 0; m < header->material_count; m++)
+	{
+		if (memchr(materials[m].diffuse_path, 0, MESH_PATH_MAX) == NULL || memchr(materials[m].specular_path, 0, MESH_PATH_MAX) == NULL
+			|| memchr(materials[m].normal_path, 0, MESH_PATH_MAX) == NULL)
+			return false;
+	}
+	return true;
+}
+
+mesh_file_t* mesh_file_open(const char* path)
+{
+	mesh_file_t* mesh = new mesh_file_t;
+	memset(mesh, 0, sizeof(mesh_file_t));
+	if (!file_map_open(&mesh->map, path))
+	{
+		delete mesh;
+		return NULL;
+	}
+	const mesh_file_header_t* header = (const mesh_file_header_t*)mesh->map.data;
+	bool ok = mesh->map.size >= sizeof(mesh_file_header_t)
+		&& header->magic == MESH_FILE_MAGIC && header->version == MESH_FILE_VERSION
+		&& header->group_size == sizeof(mesh_group_t) && header->material_size == sizeof(mesh_material_t)
+		&& (header->attributes & VERTEX_ATTR_POS)
+		&& header->vertex_count >= 0 && header->index_count >= 0 && header->group_count >= 0 && header->material_count >= 0;
+	size_t offsets[MESH_FILE_SECTIONS];
+	if (ok) ok = mesh->map.size >= mesh_file_layout(header, offsets);
+	if (!ok)
+	{
+		printf("%s is not a mesh file of this build, bake it again\n", path);
+		mesh_file_close(mesh);
+		return NULL;
+	}
+	const char* base = (const char*)mesh->map.data;
+	if (!mesh_file_check(header, base, offsets))
+	{
+		printf("%s is corrupt, bake it again\n", path);
+		mesh_file_close(mesh);
+		return NULL;
+	}
+	mesh->header = header;
+	vertex_layout_t* layout = &mesh->layout;
+	layout->count = header->vertex_count;
+	layout->attributes = header->attributes;
+	vertex_stream_t* streams[6] = { &layout->pos, &layout->tc, &layout->color, &layout->normal, &layout->tangent, &layout->material };
+	for (int i = 0; i < 6; i++)
+	{
+		streams[i]->data = base + offsets[i];
+		streams[i]->stride = (int)mesh_file_attribute_sizes[i];
+	}
+	mesh->indices = (const int*)(base + offsets[6]);
+	mesh->groups = (const mesh_group_t*)(base + offsets[7]);
+	mesh->materials = (const mesh_material_t*)(base + offsets[8]);
+	return mesh;
+}
+
+void mesh_file_close(mesh_file_t* mesh)
+{
+	if (mesh == NULL) return;
+	file_map_close(&mesh->map);
+	delete mesh;
+}
@@ -0,0 +1,55 @@
+#ifndef mesh_file_h
+#define mesh_file_h
+//=====================================================================
+// baked meshes: an indexed triangle list with tangents, its material
+// groups and the obj materials, written by the mesh baker tool and
+// mapped into memory at run time. every vertex attribute is its own
+// stream and the records are the structs of this build, so
+// draw_indexed_groups reads them in place.
+//=====================================================================
+#include "render.h"
+#include "file_map.h"
+#include <vector>
+
+#define MESH_FILE_MAGIC   0x4853454d   // "MESH"
+#define MESH_FILE_VERSION 2
+#define MESH_FILE_ALIGN   16           // s_vector is alignas(16), every record array starts on it
+#define MESH_FILE_SECTIONS 9
+
+typedef struct
+{
+	unsigned magic;
+	unsigned version;
+	// sizes of the records, a file written by a build with other layouts is refused
+	unsigned group_size, material_size;
+	unsigned attributes;     // VERTEX_ATTR_* streams in the file
+	int vertex_count, index_count, group_count, material_count;
+	int material_start;      // vertex_t::material_idex already includes it
+}mesh_file_header_t;
+// followed by the streams pos, tc, color, normal, tangent and material_idex of vertex_count vertices,
+// empty when not in attributes, int[index_count], mesh_group_t[group_count] with index ranges and
+// mesh_material_t[material_count], each padded to MESH_FILE_ALIGN
+
+typedef struct
+{
+	const mesh_file_header_t* header;
+	vertex_layout_t layout;  // the mapped streams
+	const int* indices;
+	const mesh_group_t* groups;
+	const mesh_material_t* materials;
+	file_map_t map;
+}mesh_file_t;
+
+// weld the triangle list groups into shared vertices in first use order, the
+// groups of the result are index ranges
+void mesh_build_indexed(const vertex_t* list, const std::vector<mesh_group_t>& list_groups, std::vector<vertex_t>& vertices, std::vector<int>& indices, std::vector<mesh_group_t>& groups);
+
+// the attributes of vertices not in attributes are left out, pos is always written
+bool mesh_file_write(const char* path, const std::vector<vertex_t>& vertices, int attributes, const std::vector<int>& indices, const std::vector<mesh_group_t>& groups, const std::vector<mesh_material_t>& materials, int material_start);
+
+// map a baked mesh, NULL when it is missing, truncated, from another version or has a record pointing outside it
+mesh_file_t* mesh_file_open(const char* path);
+
+void mesh_file_close(mesh_file_t* mesh);
+
+#endif
@@ -0,0 +1,299 @@
+#include "mesh_lod.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <queue>
+
+// symmetric 4x4 error matrix: xx xy xz xw yy yz yw zz zw ww
+typedef struct
+{
+	double q[10];
+}mesh_quadric_t;
+
+static void mesh_quadric_add_plane(mesh_quadric_t& m, double a, double b, double c, double d, double weight)
+{
+	m.q[0] += weight * a * a; m.q[1] += weight * a * b; m.q[2] += weight * a * c; m.q[3] += weight * a * d;
+	m.q[4] += weight * b * b; m.q[5] += weight * b * c; m.q[6] += weight * b * d;
+	m.q[7] += weight * c * c; m.q[8] += weight * c * d;
+	m.q[9] += weight * d * d;
+}
+
+// squared distance to the planes of a + b, weighted by their areas
+static float mesh_quadric_error(const mesh_quadric_t& a, const mesh_quadric_t& b, const s_vector& p)
+{
+	double q[10];
+	for (int i = 0; i < 10; i++) q[i] = a.q[i] + b.q[i];
+	double x = p.x, y = p.y, z = p.z;
+	double e = q[0] * x * x + 2.0 * q[1] * x * y + 2.0 * q[2] * x * z + 2.0 * q[3] * x
+		+ q[4] * y * y + 2.0 * q[5] * y * z + 2.0 * q[6] * y
+		+ q[7] * z * z + 2.0 * q[8] * z + q[9];
+	return (float)fabs(e);
+}
+
+static s_vector mesh_face_normal(const s_vector& a, const s_vector& b, const s_vector& c)
+{
+	s_vector e1(b.x - a.x, b.y - a.y, b.z - a.z, 0.0f), e2(c.x - a.x, c.y - a.y, c.z - a.z, 0.0f), n;
+	n.crossproduct(e1, e2);
+	n.w = 0.0f;
+	return n;
+}
+
+// a collapse of vertex from onto vertex to, the heap pops the cheapest first
+typedef struct
+{
+	float cost;
+	int from, to;
+}mesh_collapse_t;
+
+struct mesh_collapse_greater
+{
+	bool operator()(const mesh_collapse_t& a, const mesh_collapse_t& b) const { return a.cost > b.cost; }
+};
+
+int mesh_simplify(const vertex_layout_t* layout, const int* indices, int index_count, int target, std::vector<int>& out)
+{
+	// the vertices the triangles use, numbered locally
+	std::vector<int> verts(indices, indices + index_count);
+	std::sort(verts.begin(), verts.end());
+	verts.erase(std::unique(verts.begin(), verts.end()), verts.end());
+	int n = (int)verts.size();
+	std::vector<s_vector> pos(n);
+	for (int i = 0; i < n; i++) pos[i] = vertex_fetch<s_vector>(layout->pos, verts[i]);
+
+	std::vector<int> tri;
+	tri.reserve(index_count);
+	for (int i = 0; i + 2 < index_count; i += 3)
+	{
+		int id[3];
+		for (int k = 0; k < 3; k++) id[k] = (int)(std::lower_bound(verts.begin(), verts.end(), indices[i + k]) - verts.begin());
+		s_vector fn = mesh_face_normal(pos[id[0]], pos[id[1]], pos[id[2]]);
+		if (fn.x == 0.0f && fn.y == 0.0f && fn.z == 0.0f) continue;
+		tri.insert(tri.end(), id, id + 3);
+	}
+	int tris = (int)tri.size() / 3, live = tris;
+	std::vector<char> alive(tris, 1);
+
+	// vertices sharing a position with another one are on an attribute seam, moving one of them
+	// would tear the seam open
+	std::vector<char> locked(n, 0);
+	{
+		std::vector<int> order(n);
+		for (int i = 0; i < n; i++) order[i] = i;
+		std::sort(order.begin(), order.end(), [&](int a, int b) {
+			if (pos[a].x != pos[b].x) return pos[a].x < pos[b].x;
+			if (pos[a].y != pos[b].y) return pos[a].y < pos[b].y;
+			return pos[a].z < pos[b].z;
+		});
+		for (int i = 1; i < n; i++)
+		{
+			const s_vector& a = pos[order[i - 1]];
+			const s_vector& b = pos[order[i]];
+			if (a.x == b.x && a.y == b.y && a.z == b.z) locked[order[i - 1]] = locked[order[i]] = 1;
+		}
+	}
+	// so are the ends of an edge no other triangle runs the other way along
+	{
+		std::vector<long long> edges;
+		edges.reserve(tris * 3);
+		for (int t = 0; t < tris; t++)
+			for (int k = 0; k < 3; k++)
+				edges.push_back((long long)tri[t * 3 + k] * n + tri[t * 3 + (k + 1) % 3]);
+		std::sort(edges.begin(), edges.end());
+		for (size_t i = 0; i < edges.size(); i++)
+		{
+			int a = (int)(edges[i] / n), b = (int)(edges[i] % n);
+			if (!std::binary_search(edges.begin(), edges.end(), (long long)b * n + a)) locked[a] = locked[b] = 1;
+		}
+	}
+
+	std::vector<mesh_quadric_t> quadric(n);
+	memset(&quadric[0], 0, sizeof(mesh_quadric_t) * n);
+	std::vector<std::vector<int> > around(n);
+	for (int t = 0; t < tris; t++)
+	{
+		const int* id = &tri[t * 3];
+		s_vector fn = mesh_face_normal(pos[id[0]], pos[id[1]], pos[id[2]]);
+		double length = sqrt((double)fn.x * fn.x + (double)fn.y * fn.y + (double)fn.z * fn.z);
+		double a = fn.x / length, b = fn.y / length, c = fn.z / length;
+		double d = -(a * pos[id[0]].x + b * pos[id[0]].y + c * pos[id[0]].z);
+		for (int k = 0; k < 3; k++)
+		{
+			mesh_quadric_add_plane(quadric[id[k]], a, b, c, d, length * 0.5);
+			around[id[k]].push_back(t);
+		}
+	}
+
+	std::priority_queue<mesh_collapse_t, std::vector<mesh_collapse_t>, mesh_collapse_greater> heap;
+	for (int t = 0; t < tris; t++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			int a = tri[t * 3 + k], b = tri[t * 3 + (k + 1) % 3];
+			if (!locked[a]) { mesh_collapse_t c = { mesh_quadric_error(quadric[a], quadric[b], pos[b]), a, b }; heap.push(c); }
+			if (!locked[b]) { mesh_collapse_t c = { mesh_quadric_error(quadric[b], quadric[a], pos[a]), b, a }; heap.push(c); }
+		}
+	}
+
+	std::vector<char> gone(n, 0);
+	while (live > target && !heap.empty())
+	{
+		mesh_collapse_t c = heap.top();
+		heap.pop();
+		int a = c.from, b = c.to;
+		if (gone[a] || gone[b]) continue;
+		// the edge may have gone with an earlier collapse
+		bool adjacent = false;
+		for (size_t i = 0; i < around[a].size() && !adjacent; i++)
+		{
+			int t = around[a][i];
+			adjacent = alive[t] && (tri[t * 3] == b || tri[t * 3 + 1] == b || tri[t * 3 + 2] == b);
+		}
+		if (!adjacent) continue;
+		// the quadrics grew since the entry was pushed, it goes back with its current cost
+		float cost = mesh_quadric_error(quadric[a], quadric[b], pos[b]);
+		if (cost > c.cost * 1.0001f + 1e-12f)
+		{
+			c.cost = cost;
+			heap.push(c);
+			continue;
+		}
+		// no triangle kept may turn over or lose its area
+		bool flips = false;
+		for (size_t i = 0; i < around[a].size() && !flips; i++)
+		{
+			int t = around[a][i];
+			const int* id = &tri[t * 3];
+			if (!alive[t] || id[0] == b || id[1] == b || id[2] == b) continue;
+			s_vector p[3];
+			for (int k = 0; k < 3; k++) p[k] = pos[id[k]];
+			s_vector before = mesh_face_normal(p[0], p[1], p[2]);
+			for (int k = 0; k < 3; k++) if (id[k] == a) p[k] = pos[b];
+			s_vector after = mesh_face_normal(p[0], p[1], p[2]);
+			flips = before.dotproduct(after) <= 0.0f;
+		}
+		if (flips) continue;
+
+		gone[a] = 1;
+		for (int i = 0; i < 10; i++) quadric[b].q[i] += quadric[a].q[i];
+		for (size_t i = 0; i < around[a].size(); i++)
+		{
+			int t = around[a][i];
+			if (!alive[t]) continue;
+			int* id = &tri[t * 3];
+			if (id[0] == b || id[1] == b || id[2] == b)
+			{
+				alive[t] = 0;
+				live--;
+				continue;
+			}
+			for (int k = 0; k < 3; k++) if (id[k] == a) id[k] = b;
+			around[b].push_back(t);
+		}
+		around[a].clear();
+		for (size_t i = 0; i < around[b].size(); i++)
+		{
+			int t = around[b][i];
+			if (!alive[t]) continue;
+			for (int k = 0; k < 3; k++)
+			{
+				int u = tri[t * 3 + k];
+				if (u == b) continue;
+				if (!locked[u]) { mesh_collapse_t e = { mesh_quadric_error(quadric[u], quadric[b], pos[b]), u, b }; heap.push(e); }
+				if (!locked[b]) { mesh_collapse_t e = { mesh_quadric_error(quadric[b], quadric[u], pos[u]), b, u }; heap.push(e); }
+			}
+		}
+	}
+
+	for (int t = 0; t < tris; t++)
+		if (alive[t])
+			for (int k = 0; k < 3; k++) out.push_back(verts[tri[t * 3 + k]]);
+	return live;
+}
+
+void mesh_strip_to_list(const int* indices, int index_count, std::vector<int>& out)
+{
+	for (int i = 2; i < index_count; i++)
+	{
+		// same winding as draw_indexed
+		int a = i % 2 == 0 ? indices[i - 2] : indices[i - 1];
+		int b = i % 2 == 0 ? indices[i - 1] : indices[i - 2];
+		int c = indices[i];
+		if (a == b || b == c || a == c) continue;
+		out.push_back(a);
+		out.push_back(b);
+		out.push_back(c);
+	}
+}
+
+// every attribute, the padding of vertex_t is left out
+static bool mesh_vertex_less(const vertex_t& a, const vertex_t& b)
+{
+	const float fa[] = { a.pos.x, a.pos.y, a.pos.z, a.pos.w, a.tc.u, a.tc.v, a.color.r, a.color.g, a.color.b, a.color.a, a.rhw,
+		a.normal.x, a.normal.y, a.normal.z, a.normal.w, (float)a.material_idex, a.tangent.x, a.tangent.y, a.tangent.z, a.tangent.w };
+	const float fb[] = { b.pos.x, b.pos.y, b.pos.z, b.pos.w, b.tc.u, b.tc.v, b.color.r, b.color.g, b.color.b, b.color.a, b.rhw,
+		b.normal.x, b.normal.y, b.normal.z, b.normal.w, (float)b.material_idex, b.tangent.x, b.tangent.y, b.tangent.z, b.tangent.w };
+	return std::lexicographical_compare(fa, fa + 20, fb, fb + 20);
+}
+
+void mesh_weld(const std::vector<vertex_t>& expanded, std::vector<vertex_t>& vertices, std::vector<int>& indices)
+{
+	std::map<vertex_t, int, bool (*)(const vertex_t&, const vertex_t&)> welded(mesh_vertex_less);
+	for (size_t i = 0; i < expanded.size(); i++)
+	{
+		std::map<vertex_t, int, bool (*)(const vertex_t&, const vertex_t&)>::iterator it = welded.find(expanded[i]);
+		if (it == welded.end())
+		{
+			it = welded.insert(std::make_pair(expanded[i], (int)vertices.size())).first;
+			vertices.push_back(expanded[i]);
+		}
+		indices.push_back(it->second);
+	}
+}
+
+void mesh_lod_build(mesh_lod_t* lod, const vertex_layout_t* layout, const int* indices, const mesh_group_t* groups, int group_count)
+{
+	lod->levels = 1;
+	lod->triangles[0] = 0;
+	for (int g = 0; g < group_count; g++)
+	{
+		mesh_group_t run = groups[g];
+		run.first = (int)lod->indices[0].size();
+		lod->indices[0].insert(lod->indices[0].end(), indices + groups[g].first, indices + groups[g].first + groups[g].count);
+		lod->groups[0].push_back(run);
+		lod->triangles[0] += groups[g].count / 3;
+	}
+	for (int level = 1; level < MESH_LOD_LEVELS; level++)
+	{
+		std::vector<int>& out = lod->indices[level];
+		std::vector<mesh_group_t>& runs = lod->groups[level];
+		for (int g = 0; g < group_count; g++)
+		{
+			int target = (int)(groups[g].count / 3 * powf(MESH_LOD_RATIO, (float)level));
+			mesh_group_t run = groups[g];
+			run.first = (int)out.size();
+			mesh_simplify(layout, indices + groups[g].first, groups[g].count, target, out);
+			run.count = (int)out.size() - run.first;
+			if (run.count > 0) runs.push_back(run);
+		}
+		lod->triangles[level] = (int)out.size() / 3;
+		// locked borders stop the collapses at some point, a level that barely saves anything is left out
+		if (lod->triangles[level] > lod->triangles[level - 1] * 0.8f)
+		{
+			out.clear();
+			runs.clear();
+			break;
+		}
+		lod->levels++;
+	}
+}
+
+int mesh_lod_select(device_t* device, const mesh_lod_t* lod, const mesh_group_t* bounds)
+{
+	if (device->lod_density <= 0.0f) return 0;
+	float radius = device_screen_radius(device, bounds);
+	float budget = 3.14159265f * radius * radius * device->lod_density;
+	int level = 0;
+	while (level + 1 < lod->levels && lod->triangles[level] > budget) level++;
+	return level;
+}
@@ -0,0 +1,45 @@
+#ifndef mesh_lod_h
+#define mesh_lod_h
+//=====================================================================
+// level of detail: load time simplification of indexed triangle lists
+// by quadric error edge collapse (Garland and Heckbert), every level
+// keeps the vertices of the mesh and only drops triangles, so the levels
+// share one vertex buffer. borders and attribute seams are locked so the
+// levels don't crack. the cull stage picks a level from the pixels the
+// bounding sphere covers, see device_set_lod.
+//=====================================================================
+#include "render.h"
+#include <vector>
+
+#define MESH_LOD_LEVELS  4       // level 0 is the mesh itself
+#define MESH_LOD_RATIO   0.5f    // triangles of a level relative to the level before it
+#define MESH_LOD_DENSITY 0.25f   // triangles per pixel of the bounding circle device_set_lod aims at
+
+typedef struct
+{
+	int levels;                                        // 1 + the simplified ones that saved enough
+	std::vector<int> indices[MESH_LOD_LEVELS];         // triangle lists into the vertices of the mesh
+	std::vector<mesh_group_t> groups[MESH_LOD_LEVELS]; // index ranges of indices[level], with the bounds of level 0
+	int triangles[MESH_LOD_LEVELS];
+}mesh_lod_t;
+
+// collapse edges of the triangle list indices until at most target triangles are left or no collapse
+// is possible without flipping a triangle. appends the triangles left to out, returns their count.
+// triangles without area are dropped, they cover no pixel
+int mesh_simplify(const vertex_layout_t* layout, const int* indices, int index_count, int target, std::vector<int>& out);
+
+// the triangle list of a strip, with the winding of draw_indexed and without the stitching triangles
+void mesh_strip_to_list(const int* indices, int index_count, std::vector<int>& out);
+
+// merge the equal vertices of the triangle list expanded, indices address vertices
+void mesh_weld(const std::vector<vertex_t>& expanded, std::vector<vertex_t>& vertices, std::vector<int>& indices);
+
+// level 0 is indices and groups as they are, every level after it simplifies each group on its own
+// to MESH_LOD_RATIO of the level before
+void mesh_lod_build(mesh_lod_t* lod, const vertex_layout_t* layout, const int* indices, const mesh_group_t* groups, int group_count);
+
+// the level a mesh with bounds is drawn with, 0 while device_set_lod is off. the finest level with at
+// most device->lod_density triangles per pixel of the bounding circle, the coarsest when none has
+int mesh_lod_select(device_t* device, const mesh_lod_t* lod, const mesh_group_t* bounds);
+
+#endif
@@ -0,0 +1,143 @@
+#include "mesh_optimize.h"
+#include <cmath>
+#include <algorithm>
+
+float mesh_acmr(const int* indices, int index_count, int cache_size)
+{
+	if (index_count < 3) return 0.0f;
+	std::vector<int> fifo(cache_size, -1);
+	int head = 0, misses = 0;
+	for (int i = 0; i < index_count; i++)
+	{
+		if (std::find(fifo.begin(), fifo.end(), indices[i]) != fifo.end()) continue;
+		fifo[head] = indices[i];
+		head = (head + 1) % cache_size;
+		misses++;
+	}
+	return (float)misses / (index_count / 3);
+}
+
+// score of a vertex from its LRU position (-1 outside the cache) and its triangles not emitted yet
+static float mesh_vertex_score(int position, int remaining)
+{
+	if (remaining == 0) return -1.0f;
+	float score = 0.0f;
+	if (position >= 0)
+	{
+		// the last triangle's vertices score the same so the next one isn't biased towards any of them
+		if (position < 3) score = 0.75f;
+		else score = powf(1.0f - (float)(position - 3) / (MESH_CACHE_SIZE - 3), 1.5f);
+	}
+	// few triangles left means finishing the vertex off now saves a later miss
+	return score + 2.0f * powf((float)remaining, -0.5f);
+}
+
+void mesh_optimize_indices(int* indices, int index_count, int vertex_count)
+{
+	int tri_count = index_count / 3;
+	if (tri_count < 2) return;
+
+	// triangles of every vertex
+	std::vector<int> remaining(vertex_count, 0), first(vertex_count + 1, 0), tris(tri_count * 3);
+	for (int i = 0; i < tri_count * 3; i++) remaining[indices[i]]++;
+	for (int v = 0; v < vertex_count; v++) first[v + 1] = first[v] + remaining[v];
+	std::vector<int> fill(first.begin(), first.end() - 1);
+	for (int i = 0; i < tri_count * 3; i++) tris[fill[indices[i]]++] = i / 3;
+
+	std::vector<int> position(vertex_count, -1);
+	std::vector<float> vertex_score(vertex_count), tri_score(tri_count);
+	std::vector<char> emitted(tri_count, 0);
+	for (int v = 0; v < vertex_count; v++) vertex_score[v] = mesh_vertex_score(-1, remaining[v]);
+	for (int t = 0; t < tri_count; t++)
+		tri_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+
+	std::vector<int> out;
+	out.reserve(tri_count * 3);
+	// the cache holds up to 3 vertices more while a triangle is pushed in
+	std::vector<int> cache, next_cache;
+	int scan = 0, best = -1;
+	for (int emitted_count = 0; emitted_count < tri_count; emitted_count++)
+	{
+		if (best < 0)
+		{
+			// nothing in the cache has triangles left, take the next one in the old order
+			while (emitted[scan]) scan++;
+			best = scan;
+		}
+		int* tri = indices + best * 3;
+		emitted[best] = 1;
+		for (int k = 0; k < 3; k++)
+		{
+			int v = tri[k];
+			out.push_back(v);
+			remaining[v]--;
+			// drop the triangle from the vertex's list, order in the list doesn't matter
+			int* list = &tris[first[v]];
+			int n = remaining[v] + 1;
+			for (int j = 0; j < n; j++)
+			{
+				if (list[j] != best) continue;
+				list[j] = list[n - 1];
+				break;
+			}
+		}
+
+		// the triangle's vertices move to the front of the LRU
+		next_cache.assign(tri, tri + 3);
+		for (size_t i = 0; i < cache.size(); i++)
+			if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2]) next_cache.push_back(cache[i]);
+		// the evicted vertices score like ones that were never cached
+		for (size_t i = MESH_CACHE_SIZE; i < next_cache.size(); i++)
+		{
+			int v = next_cache[i];
+			position[v] = -1;
+			vertex_score[v] = mesh_vertex_score(-1, remaining[v]);
+		}
+		if (next_cache.size() > MESH_CACHE_SIZE) next_cache.resize(MESH_CACHE_SIZE);
+		cache.swap(next_cache);
+
+		// rescore what moved and pick the best triangle that touches the cache
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			position[cache[i]] = (int)i;
+			vertex_score[cache[i]] = mesh_vertex_score((int)i, remaining[cache[i]]);
+		}
+		best = -1;
+		float best_score = -1.0f;
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			int v = cache[i];
+			for (int j = 0; j < remaining[v]; j++)
+			{
+				int t = tris[first[v] + j];
+				const int* c = indices + t * 3;
+				tri_score[t] = vertex_score[c[0]] + vertex_score[c[1]] + vertex_score[c[2]];
+				if (tri_score[t] > best_score)
+				{
+					best_score = tri_score[t];
+					best = t;
+				}
+			}
+		}
+	}
+	std::copy(out.begin(), out.end(), indices);
+}
+
+void mesh_optimize_vertex_fetch(std::vector<vertex_t>& vertices, std::vector<int>& indices)
+{
+	std::vector<int> remap(vertices.size(), -1);
+	std::vector<vertex_t> ordered;
+	ordered.reserve(vertices.size());
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		int& id = remap[indices[i]];
+		if (id < 0)
+		{
+			id = (int)ordered.size();
+			vertex_t v(vertices[indices[i]]);
+			ordered.push_back(v);
+		}
+		indices[i] = id;
+	}
+	vertices.swap(ordered);
+}
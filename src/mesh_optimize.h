@@ -0,0 +1,24 @@
+#ifndef mesh_optimize_h
+#define mesh_optimize_h
+//=====================================================================
+// load time ordering of indexed triangle lists: triangles are reordered
+// for a small post-transform cache (Forsyth's linear speed vertex cache
+// optimisation), then vertices are renumbered in the order the new
+// indices first fetch them so the vertex reads walk memory forwards.
+//=====================================================================
+#include "render.h"
+#include <vector>
+
+#define MESH_CACHE_SIZE 32       // entries of the simulated FIFO / LRU vertex cache
+
+// average cache misses per triangle of a triangle list, for a FIFO cache of cache_size
+// vertices. 0.5 is the best a regular grid can get, 3 means no vertex is ever reused
+float mesh_acmr(const int* indices, int index_count, int cache_size);
+
+// reorder the triangles of indices in place, the set of triangles and their winding stay
+void mesh_optimize_indices(int* indices, int index_count, int vertex_count);
+
+// renumber vertices in first use order of indices, unreferenced vertices are dropped
+void mesh_optimize_vertex_fetch(std::vector<vertex_t>& vertices, std::vector<int>& indices);
+
+#endif
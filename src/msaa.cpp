@@ -0,0 +1,57 @@
+#include "msaa.h"
+
+// msaa_resolve divides the sums by shifting
+static_assert(MSAA_SAMPLES == 4, "msaa_resolve averages 4 samples");
+
+const int msaa_offsets[MSAA_SAMPLES][2] = { { -2, -6 }, { 6, -2 }, { -6, 2 }, { 2, 6 } };
+
+msaa_t* msaa_create(int width, int height)
+{
+	msaa_t* msaa = new msaa_t;
+	msaa->width = width;
+	msaa->height = height;
+	msaa->active = 0;
+	msaa->color = surface_create(width * MSAA_SAMPLES, height, SURFACE_FORMAT_XRGB32, NULL, 0);
+	msaa->depth = surface_create(width * MSAA_SAMPLES, height, SURFACE_FORMAT_DEPTH32, NULL, 0);
+	return msaa;
+}
+
+void msaa_destory(msaa_t* msaa)
+{
+	if (msaa == NULL) return;
+	surface_destory(msaa->color);
+	surface_destory(msaa->depth);
+	delete msaa;
+}
+
+void msaa_clear(msaa_t* msaa, const surface_t* color)
+{
+	for (int y = 0; y < msaa->height; y++)
+	{
+		const IUINT32* src = surface_row_u32(color, y);
+		for (int x = 0; x < msaa->width; x++) msaa_fill(msaa, x, y, src[x]);
+	}
+	surface_clear(msaa->depth, 0);
+}
+
+void msaa_resolve(const msaa_t* msaa, surface_t* color)
+{
+	for (int y = 0; y < msaa->height; y++)
+	{
+		const IUINT32* samples = surface_row_u32(msaa->color, y);
+		IUINT32* dst = surface_row_u32(color, y);
+		for (int x = 0; x < msaa->width; x++, samples += MSAA_SAMPLES)
+		{
+			// the channels are summed apart so they do not carry into each other
+			IUINT32 rb = 0, g = 0;
+			for (int s = 0; s < MSAA_SAMPLES; s++)
+			{
+				rb += samples[s] & 0xff00ff;
+				g += samples[s] & 0x00ff00;
+			}
+			rb = ((rb + 0x020002) >> 2) & 0xff00ff;
+			g = ((g + 0x000200) >> 2) & 0x00ff00;
+			dst[x] = rb | g;
+		}
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef msaa_h
+#define msaa_h
+//=====================================================================
+// multisample anti-aliasing: coverage and depth are kept for MSAA_SAMPLES
+// points of every pixel, f_shader still runs once per pixel and triangle
+// and its colour goes to the samples the triangle covers. msaa_resolve
+// averages the samples into device->color at device_resolve.
+//=====================================================================
+#include "render.h"
+
+#define MSAA_SAMPLES 4
+// rotated grid, 1/16 pixel units from the pixel center
+#define MSAA_GRID 16
+// farthest a sample is from its pixel center on either axis, in pixels
+#define MSAA_REACH (6.0f / MSAA_GRID)
+
+extern const int msaa_offsets[MSAA_SAMPLES][2];
+
+struct msaa_t
+{
+	int width, height;
+	int active;              // set by device_clear when the frame is drawn with samples
+	surface_t* color;        // XRGB32, pixel x of a row is at x * MSAA_SAMPLES + sample
+	surface_t* depth;        // DEPTH32, same layout
+};
+
+msaa_t* msaa_create(int width, int height);
+
+void msaa_destory(msaa_t* msaa);
+
+// every sample takes the colour of its pixel in color and the empty depth
+void msaa_clear(msaa_t* msaa, const surface_t* color);
+
+// set the samples of one pixel to c, for pixels written without coverage like lines
+inline void msaa_fill(msaa_t* msaa, int x, int y, IUINT32 c)
+{
+	IUINT32* samples = surface_row_u32(msaa->color, y) + x * MSAA_SAMPLES;
+	for (int s = 0; s < MSAA_SAMPLES; s++) samples[s] = c;
+}
+
+// average the samples of every pixel into color
+void msaa_resolve(const msaa_t* msaa, surface_t* color);
+
+#endif
@@ -0,0 +1,230 @@
+#include "multiview.h"
+#include "light.h"
+#include "transparent.h"
+#include "gbuffer.h"
+#include "hdr.h"
+#include "post.h"
+#include "ssao.h"
+#include "coarse.h"
+#include "arena.h"
+#include "job.h"
+#include <cstring>
+
+// the modes of leader device_share_assets leaves out
+static void multiview_copy_modes(device_t* view, const device_t* leader)
+{
+	view->is_cull = leader->is_cull;
+	view->background = leader->background;
+	if (leader->tile_threads != 0) device_set_tile_mode(view, leader->tile_threads);
+	device_set_hiz(view, leader->hiz != NULL);
+	device_set_hdr(view, leader->hdr != NULL);
+	if (leader->hdr != NULL) device_set_exposure(view, leader->hdr->exposure);
+	device_set_post(view, leader->post != NULL ? leader->post->effects : 0);
+	if (leader->post != NULL)
+	{
+		view->post->bloom_threshold = leader->post->bloom_threshold;
+		view->post->bloom_strength = leader->post->bloom_strength;
+		view->post->vignette = leader->post->vignette;
+		view->post->grade_size = leader->post->grade_size;
+		view->post->grade = leader->post->grade;
+	}
+	device_set_ssao(view, leader->ssao != NULL);
+	device_set_shading_rate(view, leader->coarse != NULL ? leader->coarse->mode : SHADING_RATE_OFF);
+	if (leader->coarse != NULL && !leader->coarse->image.empty())
+		device_set_shading_rate_image(view, &leader->coarse->image[0], leader->coarse->tiles_x, leader->coarse->tiles_y);
+}
+
+multiview_t* multiview_create(device_t* leader, int views)
+{
+	if (views < 1) views = 1;
+	if (views > MULTIVIEW_MAX) views = MULTIVIEW_MAX;
+	multiview_t* mv = new multiview_t;
+	mv->views.push_back(leader);
+	mv->mode = 1;
+	mv->shaded = 0;
+	mv->triangles = 0;
+	// device_init is not thread safe, so the views are made here
+	for (int i = 1; i < views; i++)
+	{
+		device_t* view = new device_t();
+		device_init(view, leader->output_width, leader->output_height, NULL);
+		device_share_assets(view, leader);
+		multiview_copy_modes(view, leader);
+		view->transform.view = leader->transform.view;
+		view->transform.update();
+		mv->views.push_back(view);
+	}
+	return mv;
+}
+
+void multiview_destory(multiview_t* mv)
+{
+	if (mv == NULL) return;
+	mv->views[0]->multiview = NULL;
+	for (size_t i = 1; i < mv->views.size(); i++)
+	{
+		device_destory(mv->views[i]);
+		delete mv->views[i];
+	}
+	delete mv;
+}
+
+void multiview_set_camera(multiview_t* mv, int view, s_vector eye, s_vector at, s_vector up)
+{
+	device_t* device = mv->views[view];
+	camera_at_zero(device, eye, at, up);
+	device->camera.viewpos = eye;
+}
+
+void multiview_set_stereo(multiview_t* mv, s_vector eye, s_vector at, s_vector up, float separation)
+{
+	// the x axis of the look at matrix, the screen's right in world space
+	s_vector forward, right, offset;
+	forward.minus_two(at, eye);
+	forward.normalize();
+	right.crossproduct(up, forward);
+	right.normalize();
+	offset = right;
+	offset.float_dot(separation * 0.5f);
+	for (int i = 0; i < 2 && i < (int)mv->views.size(); i++)
+	{
+		s_vector e, a;
+		if (i == 0)
+		{
+			e.minus_two(eye, offset);
+			a.minus_two(at, offset);
+		}
+		else
+		{
+			e.add_two(eye, offset);
+			a.add_two(at, offset);
+		}
+		e.w = a.w = 1.0f;
+		multiview_set_camera(mv, i, e, a, up);
+	}
+}
+
+void multiview_begin(multiview_t* mv, int mode)
+{
+	device_t* leader = mv->views[0];
+	mv->mode = mode;
+	mv->vertices.clear();
+	mv->corners.clear();
+	mv->materials.clear();
+	mv->draws.clear();
+	for (size_t i = 0; i < mv->views.size(); i++)
+	{
+		device_t* view = mv->views[i];
+		view->render_state = leader->render_state;
+		view->raster_mode = leader->raster_mode;
+		view->now_state = leader->now_state;
+		device_clear(view, mode);
+	}
+	leader->multiview = mv;
+}
+
+void multiview_draw(multiview_t* mv, device_t* device, int varyings)
+{
+	multiview_draw_t draw;
+	draw.render_state = device->render_state;
+	draw.now_state = device->now_state;
+	draw.pipeline = device->pipeline;
+	draw.shadow = device->shadow;
+	draw.instanced = device->instance != NULL;
+	draw.pbr = device->instance != NULL ? device->instance->pbr : device->PBR;
+	draw.varyings = varyings;
+	draw.first = (int)mv->materials.size();
+	draw.triangles = 0;
+	mv->draws.push_back(draw);
+}
+
+void multiview_transparent(multiview_t* mv, device_t* device, vertex_t* mesh, int num)
+{
+	for (size_t i = 0; i < mv->views.size(); i++)
+	{
+		device_t* view = mv->views[i];
+		if (view != device)
+		{
+			view->transform.world = device->transform.world;
+			view->transform.update();
+			view->PBR = device->PBR;
+		}
+		if (view->transparent == NULL) view->transparent = transparent_list_create();
+		transparent_list_push(view->transparent, view, mesh, num);
+	}
+}
+
+// the lights and constants of the leader's frame, before the views draw at the same time
+static void multiview_copy_frame(device_t* view, const device_t* leader)
+{
+	memcpy(view->pointlight, leader->pointlight, sizeof(view->pointlight));
+	view->m1 = leader->m1;
+	view->m2 = leader->m2;
+	view->ibl = leader->ibl;
+	view->PBR = leader->PBR;
+	device_clear_lights(view);
+	if (leader->lights == NULL) return;
+	for (size_t i = 0; i < leader->lights->lights.size(); i++)
+	{
+		if (view->lights == NULL) view->lights = light_list_create(view->width, view->height);
+		light_list_add(view->lights, leader->lights->lights[i]);
+	}
+}
+
+// job of multiview_end, draws the record into the views [begin, end)
+static void multiview_view_job(void* data, int begin, int end)
+{
+	multiview_t* mv = (multiview_t*)data;
+	for (int v = begin; v < end; v++)
+	{
+		device_t* view = mv->views[v];
+		int render_state = view->render_state, now_state = view->now_state;
+		const pipeline_t* pipeline = view->pipeline;
+		shadow_map_t* shadow = view->shadow;
+		s_PBR pbr = view->PBR;
+		for (size_t d = 0; d < mv->draws.size(); d++)
+		{
+			const multiview_draw_t& draw = mv->draws[d];
+			if (draw.triangles == 0) continue;
+			view->render_state = draw.render_state;
+			view->now_state = draw.now_state;
+			view->pipeline = draw.pipeline;
+			view->shadow = draw.shadow;
+			if (draw.instanced)
+			{
+				// the fragments point at their instance until the frame is resolved, like the ones of draw_instanced
+				instance_t* instance = arena_array<instance_t>(view->arena, 1);
+				instance->pbr = draw.pbr;
+				gbuffer_t* gbuffer = view->gbuffer;
+				instance->gbuffer_pbr = gbuffer != NULL && gbuffer->active ? gbuffer_track_pbr(gbuffer, draw.pbr) : -1;
+				view->instance = instance;
+			}
+			else view->PBR = draw.pbr;
+			draw_shaded(view, &mv->vertices[0], &mv->corners[draw.first * 3], &mv->materials[draw.first], draw.triangles, draw.varyings);
+			view->instance = NULL;
+		}
+		view->render_state = render_state;
+		view->now_state = now_state;
+		view->pipeline = pipeline;
+		view->shadow = shadow;
+		view->PBR = pbr;
+		device_resolve(view);
+		device_present(view);
+	}
+}
+
+void multiview_end(multiview_t* mv)
+{
+	device_t* leader = mv->views[0];
+	leader->multiview = NULL;
+	for (size_t d = 0; d < mv->draws.size(); d++)
+	{
+		size_t next = d + 1 < mv->draws.size() ? (size_t)mv->draws[d + 1].first : mv->materials.size();
+		mv->draws[d].triangles = (int)next - mv->draws[d].first;
+	}
+	mv->shaded += (long long)mv->vertices.size();
+	mv->triangles += (long long)mv->materials.size();
+	for (size_t i = 1; i < mv->views.size(); i++) multiview_copy_frame(mv->views[i], leader);
+	// one job per view, each bins and shades its tiles on the workers too
+	job_parallel_for(job_system(), 0, (int)mv->views.size(), 1, multiview_view_job, mv);
+}
@@ -0,0 +1,74 @@
+#ifndef multiview_h
+#define multiview_h
+//=====================================================================
+// multi-view rendering: one frame of the scene seen by several cameras,
+// a stereo pair or a rig, each view drawn into a device of its own.
+// between multiview_begin and multiview_end the draws of the leader
+// only record their triangles: every vertex is transformed, given its
+// tangent frame and vertex shaded once in world space. the objects are
+// culled against the frusta of all views together. multiview_end then
+// draws the record into every view on the job system at once, each with
+// its own clip transform, triangle cull, binning and resolve.
+//=====================================================================
+#include "render.h"
+#include <vector>
+
+#define MULTIVIEW_MAX 8
+
+// one draw call of the leader, its triangles are [first, first + triangles) of multiview_t::materials
+typedef struct
+{
+	int render_state;
+	int now_state;
+	const pipeline_t* pipeline;
+	shadow_map_t* shadow;
+	s_PBR pbr;               // the constants of its fragments
+	int instanced;           // pbr is the one of a draw_instanced instance, device->PBR is left alone
+	int varyings;            // VARYING_* of its vertex layout
+	int first, triangles;
+}multiview_draw_t;
+
+struct multiview_t
+{
+	std::vector<device_t*> views;      // views[0] is the leader, the others share its assets and own their targets
+	int mode;                          // of device_clear, see multiview_begin
+	std::vector<for_fs> vertices;      // v_shader output of the recorded vertices, pos is the world position
+	std::vector<int> corners;          // 3 vertices per triangle
+	std::vector<int> materials;        // 1 per triangle
+	std::vector<multiview_draw_t> draws;
+	long long shaded;                  // vertices shaded since multiview_create
+	long long triangles;               // recorded since multiview_create, every view draws each of them
+};
+
+// views - 1 devices next to leader with its size, assets and modes. leader stays the caller's
+multiview_t* multiview_create(device_t* leader, int views);
+
+void multiview_destory(multiview_t* mv);
+
+// the camera of view, like camera_at_zero. it is also the eye the view is lit from
+void multiview_set_camera(multiview_t* mv, int view, s_vector eye, s_vector at, s_vector up);
+
+// views 0 and 1 as the left and right eye of a camera at eye looking along the same direction, separation apart
+void multiview_set_stereo(multiview_t* mv, s_vector eye, s_vector at, s_vector up, float separation);
+
+// device_clear of every view with the render state of the leader, from now on the leader records its draws
+void multiview_begin(multiview_t* mv, int mode);
+
+// draw the record into every view in parallel, then device_resolve and device_present each. the lights
+// and the constants the leader has now are those of every view
+void multiview_end(multiview_t* mv);
+
+// the views the draws of device are recorded for, NULL while they are drawn as usual. shadow passes are
+// always drawn
+static inline multiview_t* multiview_recording(const device_t* device)
+{
+	return device->shadow_pass ? NULL : device->multiview;
+}
+
+// start a draw with the state of device, the triangles pushed until the next one are its own
+void multiview_draw(multiview_t* mv, device_t* device, int varyings);
+
+// queue the blended triangles of mesh into every view, they are sorted by the depth of each
+void multiview_transparent(multiview_t* mv, device_t* device, vertex_t* mesh, int num);
+
+#endif
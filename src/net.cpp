@@ -0,0 +1,148 @@
+#include "net.h"
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif
+
+typedef SOCKET net_native_t;
+#define NET_NATIVE_INVALID INVALID_SOCKET
+#define net_close_native closesocket
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <signal.h>
+
+typedef int net_native_t;
+#define NET_NATIVE_INVALID (-1)
+#define net_close_native close
+#endif
+
+static inline net_native_t net_native(net_socket_t s) { return (net_native_t)s; }
+
+// the small messages of a frame go out at once instead of waiting for more
+static void net_no_delay(net_native_t s)
+{
+	int one = 1;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+}
+
+bool net_startup()
+{
+#ifdef _WIN32
+	WSADATA data;
+	return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+	// a write to a closed link fails with EPIPE instead of ending the process
+	signal(SIGPIPE, SIG_IGN);
+	return true;
+#endif
+}
+
+net_socket_t net_listen(int port)
+{
+	net_native_t s = socket(AF_INET, SOCK_STREAM, 0);
+	if (s == NET_NATIVE_INVALID) return NET_INVALID;
+	int one = 1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons((unsigned short)port);
+	if (bind(s, (const sockaddr*)&address, sizeof(address)) != 0 || listen(s, 4) != 0)
+	{
+		net_close_native(s);
+		return NET_INVALID;
+	}
+	return (net_socket_t)s;
+}
+
+net_socket_t net_accept(net_socket_t listener)
+{
+	net_native_t s = accept(net_native(listener), NULL, NULL);
+	if (s == NET_NATIVE_INVALID) return NET_INVALID;
+	net_no_delay(s);
+	return (net_socket_t)s;
+}
+
+net_socket_t net_connect(const char* host, int port)
+{
+	char service[16];
+	snprintf(service, sizeof(service), "%d", port);
+	addrinfo hints, *found = NULL;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, service, &hints, &found) != 0) return NET_INVALID;
+	net_native_t s = NET_NATIVE_INVALID;
+	for (addrinfo* a = found; a != NULL && s == NET_NATIVE_INVALID; a = a->ai_next)
+	{
+		s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+		if (s == NET_NATIVE_INVALID) continue;
+		if (connect(s, a->ai_addr, (int)a->ai_addrlen) != 0)
+		{
+			net_close_native(s);
+			s = NET_NATIVE_INVALID;
+		}
+	}
+	freeaddrinfo(found);
+	if (s == NET_NATIVE_INVALID) return NET_INVALID;
+	net_no_delay(s);
+	return (net_socket_t)s;
+}
+
+bool net_send(net_socket_t s, const void* data, size_t bytes)
+{
+	const char* p = (const char*)data;
+	while (bytes > 0)
+	{
+		int chunk = bytes > (1 << 30) ? (1 << 30) : (int)bytes;
+		int sent = (int)send(net_native(s), p, chunk, 0);
+		if (sent <= 0) return false;
+		p += sent;
+		bytes -= sent;
+	}
+	return true;
+}
+
+bool net_recv(net_socket_t s, void* data, size_t bytes)
+{
+	char* p = (char*)data;
+	while (bytes > 0)
+	{
+		int chunk = bytes > (1 << 30) ? (1 << 30) : (int)bytes;
+		int got = (int)recv(net_native(s), p, chunk, 0);
+		if (got <= 0) return false;
+		p += got;
+		bytes -= got;
+	}
+	return true;
+}
+
+void net_set_timeout(net_socket_t s, int ms)
+{
+#ifdef _WIN32
+	DWORD timeout = (DWORD)ms;
+#else
+	timeval timeout;
+	timeout.tv_sec = ms / 1000;
+	timeout.tv_usec = (ms % 1000) * 1000;
+#endif
+	setsockopt(net_native(s), SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+	setsockopt(net_native(s), SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+}
+
+void net_close(net_socket_t s)
+{
+	if (s != NET_INVALID) net_close_native(net_native(s));
+}
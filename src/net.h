@@ -0,0 +1,37 @@
+#ifndef net_h
+#define net_h
+//=====================================================================
+// blocking tcp sockets of the distributed renderer: posix sockets, or
+// winsock on windows. every call waits until it is done or the link
+// is gone, a failed send or receive means the other side went away.
+//=====================================================================
+#include <cstddef>
+
+typedef long long net_socket_t;
+
+#define NET_INVALID ((net_socket_t)-1)
+
+// once before the other calls, false when the system has no sockets
+bool net_startup();
+
+// a socket accepting connections on port of every interface, NET_INVALID when it is taken
+net_socket_t net_listen(int port);
+
+// the next connection of listener, NET_INVALID when it failed
+net_socket_t net_accept(net_socket_t listener);
+
+// a connection to host (a name or an address) at port, NET_INVALID when nobody answers
+net_socket_t net_connect(const char* host, int port);
+
+// all bytes of data, false when the link is gone
+bool net_send(net_socket_t s, const void* data, size_t bytes);
+
+// exactly bytes into data, false when the link closed before
+bool net_recv(net_socket_t s, void* data, size_t bytes);
+
+// net_recv and net_send on s fail after ms without progress, 0 waits forever
+void net_set_timeout(net_socket_t s, int ms);
+
+void net_close(net_socket_t s);
+
+#endif
@@ -0,0 +1,134 @@
+#include "occlusion.h"
+#include <cmath>
+#include <algorithm>
+
+// vertices with a clip w below this are behind the near plane for the occlusion buffer
+#define OCCLUSION_NEAR_W 1e-5f
+
+occlusion_t* occlusion_create(int width, int height)
+{
+	occlusion_t* occlusion = new occlusion_t;
+	occlusion->width = width;
+	occlusion->height = height;
+	occlusion->depth.assign(width * height, 1.0f);
+	occlusion->vp.set_identity();
+	occlusion->triangles = 0;
+	occlusion->tested = occlusion->culled = 0;
+	return occlusion;
+}
+
+void occlusion_destory(occlusion_t* occlusion)
+{
+	delete occlusion;
+}
+
+void occlusion_begin(occlusion_t* occlusion, const s_matrix& vp)
+{
+	std::fill(occlusion->depth.begin(), occlusion->depth.end(), 1.0f);
+	occlusion->vp = vp;
+	occlusion->triangles = 0;
+	occlusion->tested = occlusion->culled = 0;
+}
+
+// clip space p to buffer pixels, z/w in z. false behind the near plane
+static inline bool occlusion_project(const occlusion_t* occlusion, const s_vector& clip, float* out)
+{
+	if (clip.w < OCCLUSION_NEAR_W) return false;
+	float rhw = 1.0f / clip.w;
+	out[0] = (clip.x * rhw + 1.0f) * occlusion->width * 0.5f;
+	out[1] = (1.0f - clip.y * rhw) * occlusion->height * 0.5f;
+	out[2] = clip.z * rhw;
+	return true;
+}
+
+static void occlusion_triangle(occlusion_t* occlusion, const float* p0, const float* p1, const float* p2)
+{
+	float area = (p1[0] - p0[0]) * (p2[1] - p0[1]) - (p1[1] - p0[1]) * (p2[0] - p0[0]);
+	if (area == 0.0f) return;
+	// edges as a x + b y + c, >= 0 inside whatever the winding
+	const float* p[3] = { p0, p1, p2 };
+	float a[3], b[3], c[3];
+	for (int i = 0; i < 3; i++)
+	{
+		const float* u = p[i];
+		const float* v = p[(i + 1) % 3];
+		a[i] = u[1] - v[1];
+		b[i] = v[0] - u[0];
+		c[i] = u[0] * v[1] - u[1] * v[0];
+		if (area < 0.0f) { a[i] = -a[i]; b[i] = -b[i]; c[i] = -c[i]; }
+	}
+	// z/w is a plane over the screen, zx x + zy y + z0
+	float zx = ((p1[2] - p0[2]) * (p2[1] - p0[1]) - (p2[2] - p0[2]) * (p1[1] - p0[1])) / area;
+	float zy = ((p2[2] - p0[2]) * (p1[0] - p0[0]) - (p1[2] - p0[2]) * (p2[0] - p0[0])) / area;
+	float z0 = p0[2] - zx * p0[0] - zy * p0[1];
+	int x0 = std::max(0, (int)floorf(std::min(p0[0], std::min(p1[0], p2[0]))));
+	int x1 = std::min(occlusion->width - 1, (int)ceilf(std::max(p0[0], std::max(p1[0], p2[0]))) - 1);
+	int y0 = std::max(0, (int)floorf(std::min(p0[1], std::min(p1[1], p2[1]))));
+	int y1 = std::min(occlusion->height - 1, (int)ceilf(std::max(p0[1], std::max(p1[1], p2[1]))) - 1);
+	// the farthest z/w of the plane over a pixel is at the corner its gradient points to, the triangle
+	// itself reaches no farther than its farthest vertex
+	float fx = zx > 0.0f ? 1.0f : 0.0f, fy = zy > 0.0f ? 1.0f : 0.0f;
+	float zmax = std::max(p0[2], std::max(p1[2], p2[2]));
+	for (int y = y0; y <= y1; y++)
+	{
+		float* row = &occlusion->depth[y * occlusion->width];
+		float cy = y + 0.5f;
+		for (int x = x0; x <= x1; x++)
+		{
+			float cx = x + 0.5f;
+			if (a[0] * cx + b[0] * cy + c[0] < 0.0f || a[1] * cx + b[1] * cy + c[1] < 0.0f || a[2] * cx + b[2] * cy + c[2] < 0.0f)
+				continue;
+			float z = std::min(zmax, zx * (x + fx) + zy * (y + fy) + z0);
+			if (z < row[x]) row[x] = z;
+		}
+	}
+	occlusion->triangles++;
+}
+
+void occlusion_add(occlusion_t* occlusion, const s_matrix& world, const vertex_t* vertices, int count)
+{
+	s_matrix m;
+	m.mul_two(world, occlusion->vp);
+	for (int i = 0; i + 2 < count; i += 3)
+	{
+		float p[3][3];
+		bool front = true;
+		for (int k = 0; k < 3 && front; k++)
+		{
+			s_vector pos = vertices[i + k].pos, clip;
+			apply_to_vector(clip, pos, m);
+			front = occlusion_project(occlusion, clip, p[k]);
+		}
+		if (front) occlusion_triangle(occlusion, p[0], p[1], p[2]);
+	}
+}
+
+bool occlusion_test(occlusion_t* occlusion, const s_vector& box_min, const s_vector& box_max)
+{
+	occlusion->tested++;
+	float left = 1e30f, right = -1e30f, top = 1e30f, bottom = -1e30f, znear = 1e30f;
+	for (int i = 0; i < 8; i++)
+	{
+		s_vector corner(i & 1 ? box_max.x : box_min.x, i & 2 ? box_max.y : box_min.y, i & 4 ? box_max.z : box_min.z, 1.0f), clip;
+		apply_to_vector(clip, corner, occlusion->vp);
+		float p[3];
+		if (!occlusion_project(occlusion, clip, p) || p[2] < 0.0f) return false;
+		left = std::min(left, p[0]); right = std::max(right, p[0]);
+		top = std::min(top, p[1]); bottom = std::max(bottom, p[1]);
+		znear = std::min(znear, p[2]);
+	}
+	if (right < 0.0f || bottom < 0.0f || left >= occlusion->width || top >= occlusion->height) return false;
+	// every pixel the box touches and the ring around them, an occluder edge crosses the pixels whose
+	// centers it covers. the part outside the buffer is outside the frame
+	int x0 = std::max(0, (int)floorf(left) - 1), x1 = std::min(occlusion->width - 1, (int)floorf(right) + 1);
+	int y0 = std::max(0, (int)floorf(top) - 1), y1 = std::min(occlusion->height - 1, (int)floorf(bottom) + 1);
+	znear -= OCCLUSION_EPSILON;
+	for (int y = y0; y <= y1; y++)
+	{
+		const float* row = &occlusion->depth[y * occlusion->width];
+		for (int x = x0; x <= x1; x++)
+			if (row[x] >= znear) return false;
+	}
+	occlusion->culled++;
+	return true;
+}
@@ -0,0 +1,42 @@
+#ifndef occlusion_h
+#define occlusion_h
+//=====================================================================
+// software occlusion culling: the designated occluders of a scene are
+// rasterized depth only into a small buffer before anything is drawn,
+// then the boxes of the other objects are tested against it and the
+// hidden ones are never submitted. a pixel takes the triangles that
+// cover its center with the farthest depth they have inside of it, and
+// a box is only hidden when the ring of pixels around it is covered too,
+// so the test stays conservative at any frame size.
+//=====================================================================
+#include "render.h"
+#include <vector>
+
+#define OCCLUSION_WIDTH  256
+#define OCCLUSION_HEIGHT 128
+#define OCCLUSION_EPSILON 1e-4f  // z/w a box has to be behind the occluders by
+
+struct occlusion_t
+{
+	int width, height;
+	std::vector<float> depth;  // nearest of the occluder z/w that cover the pixel, 1 where none does
+	s_matrix vp;               // view projection of occlusion_begin
+	int triangles;             // occluder triangles rasterized since occlusion_begin
+	int tested, culled;        // boxes handed to occlusion_test and the hidden ones
+};
+
+occlusion_t* occlusion_create(int width, int height);
+
+void occlusion_destory(occlusion_t* occlusion);
+
+// forget the occluders, they and the boxes tested afterwards are seen through vp
+void occlusion_begin(occlusion_t* occlusion, const s_matrix& vp);
+
+// the triangle list vertices[0, count) under world. occluders have to be drawn opaque with depth writes,
+// and closed when the device culls back faces. triangles reaching behind the near plane are left out
+void occlusion_add(occlusion_t* occlusion, const s_matrix& world, const vertex_t* vertices, int count);
+
+// true when the occluders hide the world space box everywhere
+bool occlusion_test(occlusion_t* occlusion, const s_vector& box_min, const s_vector& box_max);
+
+#endif
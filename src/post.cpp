@@ -0,0 +1,519 @@
+#include "post.h"
+#include "job.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define POST_SSE 1
+#endif
+
+#define POST_FXAA_EDGE       0.125f        // contrast of the neighbours to the brightest of them that is an edge
+#define POST_FXAA_EDGE_MIN   (1.0f / 16)   // below it dark pixels are left alone
+#define POST_FXAA_REDUCE_MUL (1.0f / 8)
+#define POST_FXAA_REDUCE_MIN (1.0f / 128)
+#define POST_FXAA_SPAN       8.0f          // pixels the edge is followed at most
+
+//=====================================================================
+// one RGBA32F pixel, the same float operations in both forms
+//=====================================================================
+#ifdef POST_SSE
+typedef __m128 p4;
+static inline p4 p4_load(const float* p) { return _mm_loadu_ps(p); }
+static inline void p4_store(float* p, p4 a) { _mm_storeu_ps(p, a); }
+static inline p4 p4_set(float a) { return _mm_set1_ps(a); }
+static inline p4 p4_add(p4 a, p4 b) { return _mm_add_ps(a, b); }
+static inline p4 p4_sub(p4 a, p4 b) { return _mm_sub_ps(a, b); }
+static inline p4 p4_mul(p4 a, p4 b) { return _mm_mul_ps(a, b); }
+// max(a, 0) then min(a, top), a NaN lane becomes 0
+static inline p4 p4_clamp(p4 a, float top) { return _mm_min_ps(_mm_max_ps(a, _mm_setzero_ps()), _mm_set1_ps(top)); }
+// the channels of an XRGB32 pixel, b g r x
+static inline p4 p4_unpack(IUINT32 c)
+{
+	__m128i z = _mm_setzero_si128();
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)c), z), z));
+}
+// b g r of a in [0, 255] truncated into an XRGB32 pixel
+static inline IUINT32 p4_pack(p4 a)
+{
+	__m128i c = _mm_cvttps_epi32(a);
+	c = _mm_packs_epi32(c, c);
+	return (IUINT32)_mm_cvtsi128_si32(_mm_packus_epi16(c, c)) & 0xffffff;
+}
+#else
+typedef struct { float v[4]; } p4;
+static inline p4 p4_load(const float* p) { p4 r; for (int i = 0; i < 4; i++) r.v[i] = p[i]; return r; }
+static inline void p4_store(float* p, p4 a) { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+static inline p4 p4_set(float a) { p4 r; for (int i = 0; i < 4; i++) r.v[i] = a; return r; }
+static inline p4 p4_add(p4 a, p4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] + b.v[i]; return a; }
+static inline p4 p4_sub(p4 a, p4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] - b.v[i]; return a; }
+static inline p4 p4_mul(p4 a, p4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] * b.v[i]; return a; }
+static inline p4 p4_clamp(p4 a, float top)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		float c = a.v[i] > 0.0f ? a.v[i] : 0.0f;
+		a.v[i] = c < top ? c : top;
+	}
+	return a;
+}
+static inline p4 p4_unpack(IUINT32 c)
+{
+	p4 r;
+	for (int i = 0; i < 4; i++) r.v[i] = (float)((c >> (i * 8)) & 0xff);
+	return r;
+}
+static inline IUINT32 p4_pack(p4 a)
+{
+	return ((IUINT32)a.v[2] << 16) | ((IUINT32)a.v[1] << 8) | (IUINT32)a.v[0];
+}
+#endif
+
+// a + (b - a) * t
+static inline p4 p4_lerp(p4 a, p4 b, p4 t)
+{
+	return p4_add(a, p4_mul(p4_sub(b, a), t));
+}
+
+static inline const float* post_pixel(const surface_t* s, int x, int y)
+{
+	return surface_row_f32(s, y) + x * 4;
+}
+
+post_t* post_create()
+{
+	post_t* post = new post_t;
+	post->effects = 0;
+	post->bloom_threshold = 8.0f;
+	post->bloom_strength = 0.2f;
+	post->vignette = 0.3f;
+	post->copy = NULL;
+	// the identity, the corners of the cube
+	post->grade_size = 2;
+	post->grade.resize(2 * 2 * 2 * 4);
+	for (int i = 0; i < 8; i++)
+	{
+		float* p = &post->grade[i * 4];
+		p[0] = (float)((i >> 2) & 1);
+		p[1] = (float)((i >> 1) & 1);
+		p[2] = (float)(i & 1);
+		p[3] = 0.0f;
+	}
+	return post;
+}
+
+static void post_free_levels(post_t* post)
+{
+	for (size_t i = 0; i < post->levels.size(); i++)
+	{
+		surface_destory(post->levels[i]);
+		surface_destory(post->blur[i]);
+	}
+	post->levels.clear();
+	post->blur.clear();
+}
+
+void post_destory(post_t* post)
+{
+	if (post == NULL) return;
+	post_free_levels(post);
+	surface_destory(post->copy);
+	delete post;
+}
+
+bool post_load_grade(post_t* post, const char* path)
+{
+	FILE* fp = fopen(path, "r");
+	if (fp == NULL) return false;
+	char line[256];
+	int size = 0;
+	std::vector<float> grade;
+	bool ok = true;
+	while (ok && fgets(line, sizeof(line), fp) != NULL)
+	{
+		char* comment = strchr(line, '#');
+		if (comment != NULL) *comment = 0;
+		float r, g, b;
+		if (strncmp(line, "LUT_3D_SIZE", 11) == 0)
+		{
+			size = atoi(line + 11);
+			ok = size >= 2 && size <= POST_GRADE_MAX && grade.empty();
+		}
+		else if (strncmp(line, "LUT_1D_SIZE", 11) == 0) ok = false;
+		else if (sscanf(line, "%f %f %f", &r, &g, &b) == 3)
+		{
+			// red runs fastest in the file and in the table
+			ok = size > 0 && (int)grade.size() < size * size * size * 4;
+			float p[4] = { b, g, r, 0.0f };
+			grade.insert(grade.end(), p, p + 4);
+		}
+		// TITLE, DOMAIN_MIN and DOMAIN_MAX
+	}
+	fclose(fp);
+	if (!ok || size == 0 || (int)grade.size() != size * size * size * 4) return false;
+	post->grade_size = size;
+	post->grade.swap(grade);
+	return true;
+}
+
+//=====================================================================
+// bloom
+//=====================================================================
+typedef struct
+{
+	post_t* post;
+	const surface_t* src;
+	surface_t* dst;
+}post_pass_t;
+
+// the 2x2 average of src into dst, rows [begin, end) of dst. the first level clamps the radiance and
+// keeps what is above the threshold
+template <bool Bright>
+static void post_down_rows(void* data, int begin, int end)
+{
+	post_pass_t* pass = (post_pass_t*)data;
+	const surface_t* src = pass->src;
+	p4 quarter = p4_set(0.25f), threshold = p4_set(pass->post->bloom_threshold);
+	for (int y = begin; y < end; y++)
+	{
+		int y0 = std::min(y * 2, src->height - 1), y1 = std::min(y * 2 + 1, src->height - 1);
+		float* dst = surface_row_f32(pass->dst, y);
+		for (int x = 0; x < pass->dst->width; x++, dst += 4)
+		{
+			int x0 = std::min(x * 2, src->width - 1), x1 = std::min(x * 2 + 1, src->width - 1);
+			p4 a = p4_load(post_pixel(src, x0, y0)), b = p4_load(post_pixel(src, x1, y0));
+			p4 c = p4_load(post_pixel(src, x0, y1)), d = p4_load(post_pixel(src, x1, y1));
+			if (Bright)
+			{
+				a = p4_clamp(a, POST_BLOOM_CLAMP); b = p4_clamp(b, POST_BLOOM_CLAMP);
+				c = p4_clamp(c, POST_BLOOM_CLAMP); d = p4_clamp(d, POST_BLOOM_CLAMP);
+			}
+			p4 sum = p4_mul(p4_add(p4_add(a, b), p4_add(c, d)), quarter);
+			if (Bright) sum = p4_clamp(p4_sub(sum, threshold), POST_BLOOM_CLAMP);
+			p4_store(dst, sum);
+		}
+	}
+}
+
+// the 1 4 6 4 1 gaussian, the edges repeat
+static const float post_gauss[5] = { 1.0f / 16, 4.0f / 16, 6.0f / 16, 4.0f / 16, 1.0f / 16 };
+
+// horizontal blur of src into dst, rows [begin, end)
+static void post_blur_rows(void* data, int begin, int end)
+{
+	post_pass_t* pass = (post_pass_t*)data;
+	const surface_t* src = pass->src;
+	int width = src->width;
+	p4 w[5];
+	for (int k = 0; k < 5; k++) w[k] = p4_set(post_gauss[k]);
+	for (int y = begin; y < end; y++)
+	{
+		const float* row = surface_row_f32(src, y);
+		float* dst = surface_row_f32(pass->dst, y);
+		for (int x = 0; x < width; x++)
+		{
+			p4 sum = p4_set(0.0f);
+			if (x >= 2 && x + 2 < width)
+			{
+				const float* p = row + (x - 2) * 4;
+				for (int k = 0; k < 5; k++) sum = p4_add(sum, p4_mul(p4_load(p + k * 4), w[k]));
+			}
+			else
+			{
+				for (int k = 0; k < 5; k++) sum = p4_add(sum, p4_mul(p4_load(row + std::min(std::max(x + k - 2, 0), width - 1) * 4), w[k]));
+			}
+			p4_store(dst + x * 4, sum);
+		}
+	}
+}
+
+// vertical blur of src into dst, tiles [begin, end) of POST_TILE pixels in row order, so the five rows
+// a tile reads stay in the cache
+static void post_blur_tiles(void* data, int begin, int end)
+{
+	post_pass_t* pass = (post_pass_t*)data;
+	const surface_t* src = pass->src;
+	int tiles_x = (src->width + POST_TILE - 1) / POST_TILE;
+	p4 w[5];
+	for (int k = 0; k < 5; k++) w[k] = p4_set(post_gauss[k]);
+	for (int t = begin; t < end; t++)
+	{
+		int x0 = (t % tiles_x) * POST_TILE, y0 = (t / tiles_x) * POST_TILE;
+		int x1 = std::min(x0 + POST_TILE, src->width), y1 = std::min(y0 + POST_TILE, src->height);
+		for (int y = y0; y < y1; y++)
+		{
+			const float* rows[5];
+			for (int k = 0; k < 5; k++) rows[k] = surface_row_f32(src, std::min(std::max(y + k - 2, 0), src->height - 1));
+			float* dst = surface_row_f32(pass->dst, y);
+			for (int x = x0; x < x1; x++)
+			{
+				p4 sum = p4_set(0.0f);
+				for (int k = 0; k < 5; k++) sum = p4_add(sum, p4_mul(p4_load(rows[k] + x * 4), w[k]));
+				p4_store(dst + x * 4, sum);
+			}
+		}
+	}
+}
+
+// bilinear source position of pixel i of a side of dst size on a side of src size
+static inline void post_bilinear(int i, int dst, int src, int& i0, int& i1, float& f)
+{
+	float s = ((float)i + 0.5f) * (float)src / (float)dst - 0.5f;
+	s = std::min(std::max(s, 0.0f), (float)(src - 1));
+	i0 = (int)s;
+	i1 = std::min(i0 + 1, src - 1);
+	f = s - (float)i0;
+}
+
+// dst += src scaled up with bilinear weights and multiplied by the strength when it is the frame, rows [begin, end)
+template <bool Frame>
+static void post_up_rows(void* data, int begin, int end)
+{
+	post_pass_t* pass = (post_pass_t*)data;
+	const surface_t* src = pass->src;
+	surface_t* dst = pass->dst;
+	p4 strength = p4_set(pass->post->bloom_strength);
+	// the columns are the same for every row, and a row of src is blended vertically once
+	std::vector<int> columns(dst->width * 2);
+	std::vector<float> weights(dst->width), blend(src->width * 4);
+	for (int x = 0; x < dst->width; x++) post_bilinear(x, dst->width, src->width, columns[x * 2], columns[x * 2 + 1], weights[x]);
+	for (int y = begin; y < end; y++)
+	{
+		int y0, y1;
+		float fy;
+		post_bilinear(y, dst->height, src->height, y0, y1, fy);
+		p4 ty = p4_set(fy);
+		const float* top = surface_row_f32(src, y0);
+		const float* bottom = surface_row_f32(src, y1);
+		for (int x = 0; x < src->width * 4; x += 4) p4_store(&blend[x], p4_lerp(p4_load(top + x), p4_load(bottom + x), ty));
+		float* row = surface_row_f32(dst, y);
+		for (int x = 0; x < dst->width; x++, row += 4)
+		{
+			p4 c = p4_lerp(p4_load(&blend[columns[x * 2] * 4]), p4_load(&blend[columns[x * 2 + 1] * 4]), p4_set(weights[x]));
+			if (Frame) c = p4_mul(c, strength);
+			p4_store(row, p4_add(p4_load(row), c));
+		}
+	}
+}
+
+static void post_run(job_fn_t fn, post_t* post, const surface_t* src, surface_t* dst, int count, int grain)
+{
+	post_pass_t pass = { post, src, dst };
+	job_parallel_for(job_system(), 0, count, grain, fn, &pass);
+}
+
+void post_bloom(post_t* post, hdr_t* hdr)
+{
+	surface_t* frame = hdr->color;
+	int width = std::max(frame->width / 2, 1), height = std::max(frame->height / 2, 1);
+	if (post->levels.empty() || post->levels[0]->width != width || post->levels[0]->height != height)
+	{
+		post_free_levels(post);
+		for (int i = 0; i < POST_BLOOM_LEVELS; i++)
+		{
+			post->levels.push_back(surface_create(width, height, SURFACE_FORMAT_RGBA32F, NULL, 0));
+			post->blur.push_back(surface_create(width, height, SURFACE_FORMAT_RGBA32F, NULL, 0));
+			if (width == 1 && height == 1) break;
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+		}
+	}
+	int levels = (int)post->levels.size();
+	post_run(post_down_rows<true>, post, frame, post->levels[0], post->levels[0]->height, POST_ROWS);
+	for (int i = 1; i < levels; i++) post_run(post_down_rows<false>, post, post->levels[i - 1], post->levels[i], post->levels[i]->height, POST_ROWS);
+	for (int i = 0; i < levels; i++)
+	{
+		surface_t* level = post->levels[i];
+		int tiles = ((level->width + POST_TILE - 1) / POST_TILE) * ((level->height + POST_TILE - 1) / POST_TILE);
+		post_run(post_blur_rows, post, level, post->blur[i], level->height, POST_ROWS);
+		post_run(post_blur_tiles, post, post->blur[i], level, tiles, 1);
+	}
+	// the wide blur of the small levels is added up on the way back
+	for (int i = levels - 1; i > 0; i--) post_run(post_up_rows<false>, post, post->levels[i], post->levels[i - 1], post->levels[i - 1]->height, POST_ROWS);
+	post_run(post_up_rows<true>, post, post->levels[0], frame, frame->height, POST_ROWS);
+}
+
+//=====================================================================
+// fxaa
+//=====================================================================
+#define POST_LUMA_R (0.299f / 255.0f)
+#define POST_LUMA_G (0.587f / 255.0f)
+#define POST_LUMA_B (0.114f / 255.0f)
+
+// copy the rows [begin, end) of the frame and their luma
+static void post_luma_rows(void* data, int begin, int end)
+{
+	post_pass_t* pass = (post_pass_t*)data;
+	post_t* post = pass->post;
+	int width = pass->src->width;
+	for (int y = begin; y < end; y++)
+	{
+		const IUINT32* src = surface_row_u32(pass->src, y);
+		memcpy(surface_row_u32(post->copy, y), src, width * sizeof(IUINT32));
+		float* luma = &post->luma[(size_t)y * width];
+		int x = 0;
+#ifdef POST_SSE
+		const __m128i mask = _mm_set1_epi32(0xff);
+		const __m128 wr = _mm_set1_ps(POST_LUMA_R), wg = _mm_set1_ps(POST_LUMA_G), wb = _mm_set1_ps(POST_LUMA_B);
+		for (; x + 4 <= width; x += 4)
+		{
+			__m128i c = _mm_loadu_si128((const __m128i*)(src + x));
+			__m128 r = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(c, 16), mask));
+			__m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(c, 8), mask));
+			__m128 b = _mm_cvtepi32_ps(_mm_and_si128(c, mask));
+			_mm_storeu_ps(luma + x, _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, wr), _mm_mul_ps(g, wg)), _mm_mul_ps(b, wb)));
+		}
+#endif
+		for (; x < width; x++)
+		{
+			IUINT32 c = src[x];
+			luma[x] = (float)((c >> 16) & 0xff) * POST_LUMA_R + (float)((c >> 8) & 0xff) * POST_LUMA_G + (float)(c & 0xff) * POST_LUMA_B;
+		}
+	}
+}
+
+// bilinear colour of the frame at (u, v) in pixels, the pixel centers are at + 0.5. channels in [0, 255]
+static inline void post_sample(const surface_t* s, float u, float v, float* rgb)
+{
+	u = std::min(std::max(u - 0.5f, 0.0f), (float)(s->width - 1));
+	v = std::min(std::max(v - 0.5f, 0.0f), (float)(s->height - 1));
+	int x0 = (int)u, y0 = (int)v;
+	int x1 = std::min(x0 + 1, s->width - 1), y1 = std::min(y0 + 1, s->height - 1);
+	float fu = u - (float)x0, fv = v - (float)y0;
+	IUINT32 a = surface_row_u32(s, y0)[x0], b = surface_row_u32(s, y0)[x1];
+	IUINT32 c = surface_row_u32(s, y1)[x0], d = surface_row_u32(s, y1)[x1];
+	for (int k = 0; k < 3; k++)
+	{
+		int shift = 16 - k * 8;
+		float top = (float)((a >> shift) & 0xff) + ((float)((b >> shift) & 0xff) - (float)((a >> shift) & 0xff)) * fu;
+		float bottom = (float)((c >> shift) & 0xff) + ((float)((d >> shift) & 0xff) - (float)((c >> shift) & 0xff)) * fu;
+		rgb[k] = top + (bottom - top) * fv;
+	}
+}
+
+// the edge pixels of rows [begin, end), the others keep their colour
+static void post_fxaa_rows(void* data, int begin, int end)
+{
+	post_pass_t* pass = (post_pass_t*)data;
+	post_t* post = pass->post;
+	const surface_t* copy = post->copy;
+	int width = copy->width, height = copy->height;
+	for (int y = begin; y < end; y++)
+	{
+		const float* up = &post->luma[(size_t)std::max(y - 1, 0) * width];
+		const float* mid = &post->luma[(size_t)y * width];
+		const float* down = &post->luma[(size_t)std::min(y + 1, height - 1) * width];
+		IUINT32* dst = surface_row_u32(pass->dst, y);
+		for (int x = 0; x < width; x++)
+		{
+			int xl = std::max(x - 1, 0), xr = std::min(x + 1, width - 1);
+			float nw = up[xl], ne = up[xr], sw = down[xl], se = down[xr], m = mid[x];
+			float lmin = std::min(m, std::min(std::min(nw, ne), std::min(sw, se)));
+			float lmax = std::max(m, std::max(std::max(nw, ne), std::max(sw, se)));
+			if (lmax - lmin < std::max(POST_FXAA_EDGE_MIN, lmax * POST_FXAA_EDGE)) continue;
+			// along the edge, across the gradient of the luma
+			float dx = -((nw + ne) - (sw + se));
+			float dy = (nw + sw) - (ne + se);
+			float reduce = std::max((nw + ne + sw + se) * (0.25f * POST_FXAA_REDUCE_MUL), POST_FXAA_REDUCE_MIN);
+			float rcp = 1.0f / (std::min(fabsf(dx), fabsf(dy)) + reduce);
+			dx = std::min(std::max(dx * rcp, -POST_FXAA_SPAN), POST_FXAA_SPAN);
+			dy = std::min(std::max(dy * rcp, -POST_FXAA_SPAN), POST_FXAA_SPAN);
+			float px = (float)x + 0.5f, py = (float)y + 0.5f;
+			float s0[3], s1[3], s2[3], s3[3];
+			post_sample(copy, px + dx * (1.0f / 3 - 0.5f), py + dy * (1.0f / 3 - 0.5f), s0);
+			post_sample(copy, px + dx * (2.0f / 3 - 0.5f), py + dy * (2.0f / 3 - 0.5f), s1);
+			post_sample(copy, px - dx * 0.5f, py - dy * 0.5f, s2);
+			post_sample(copy, px + dx * 0.5f, py + dy * 0.5f, s3);
+			float a[3], b[3];
+			for (int k = 0; k < 3; k++)
+			{
+				a[k] = 0.5f * (s0[k] + s1[k]);
+				b[k] = a[k] * 0.5f + 0.25f * (s2[k] + s3[k]);
+			}
+			// the wide average crossed another edge when its luma is out of the neighbours' range
+			float lb = b[0] * POST_LUMA_R + b[1] * POST_LUMA_G + b[2] * POST_LUMA_B;
+			const float* c = (lb < lmin || lb > lmax) ? a : b;
+			int q[3];
+			for (int k = 0; k < 3; k++) q[k] = std::min((int)(c[k] + 0.5f), 255);
+			dst[x] = (q[0] << 16) | (q[1] << 8) | q[2];
+		}
+	}
+}
+
+void post_fxaa(post_t* post, surface_t* color)
+{
+	if (post->copy == NULL || post->copy->width != color->width || post->copy->height != color->height)
+	{
+		surface_destory(post->copy);
+		post->copy = surface_create(color->width, color->height, SURFACE_FORMAT_XRGB32, NULL, 0);
+		post->luma.resize((size_t)color->width * color->height);
+	}
+	post_run(post_luma_rows, post, color, NULL, color->height, POST_ROWS);
+	post_run(post_fxaa_rows, post, NULL, color, color->height, POST_ROWS);
+}
+
+//=====================================================================
+// grade and vignette
+//=====================================================================
+// the grade of one pixel, b g r 0 in [0, 1]. the table is in the lane order of an XRGB32 pixel
+static inline p4 post_grade_pixel(const post_t* post, IUINT32 c)
+{
+	int n = post->grade_size;
+	float s = (float)(n - 1) / 255.0f;
+	float f[3] = { (float)(c & 0xff) * s, (float)((c >> 8) & 0xff) * s, (float)((c >> 16) & 0xff) * s };
+	int i0[3], i1[3];
+	for (int k = 0; k < 3; k++)
+	{
+		i0[k] = std::min((int)f[k], n - 1);
+		i1[k] = std::min(i0[k] + 1, n - 1);
+		f[k] -= (float)i0[k];
+	}
+	// index of red i, green j, blue k
+	const float* lut = &post->grade[0];
+	#define POST_GRADE_AT(r, g, b) p4_load(lut + (((b) * n + (g)) * n + (r)) * 4)
+	p4 tr = p4_set(f[2]), tg = p4_set(f[1]), tb = p4_set(f[0]);
+	p4 c00 = p4_lerp(POST_GRADE_AT(i0[2], i0[1], i0[0]), POST_GRADE_AT(i1[2], i0[1], i0[0]), tr);
+	p4 c10 = p4_lerp(POST_GRADE_AT(i0[2], i1[1], i0[0]), POST_GRADE_AT(i1[2], i1[1], i0[0]), tr);
+	p4 c01 = p4_lerp(POST_GRADE_AT(i0[2], i0[1], i1[0]), POST_GRADE_AT(i1[2], i0[1], i1[0]), tr);
+	p4 c11 = p4_lerp(POST_GRADE_AT(i0[2], i1[1], i1[0]), POST_GRADE_AT(i1[2], i1[1], i1[0]), tr);
+	#undef POST_GRADE_AT
+	return p4_lerp(p4_lerp(c00, c10, tg), p4_lerp(c01, c11, tg), tb);
+}
+
+// rows [begin, end) of the frame through the grade and the vignette that are on
+static void post_grade_rows(void* data, int begin, int end)
+{
+	post_pass_t* pass = (post_pass_t*)data;
+	const post_t* post = pass->post;
+	surface_t* color = pass->dst;
+	bool grade = (post->effects & POST_GRADE) != 0, vignette = (post->effects & POST_VIGNETTE) != 0;
+	const float* falloff = &post->falloff[0];
+	p4 scale = p4_set(grade ? 255.0f : 1.0f), half = p4_set(0.5f);
+	for (int y = begin; y < end; y++)
+	{
+		IUINT32* row = surface_row_u32(color, y);
+		// 1 in the middle, 1 - vignette in the corners
+		float dy = ((float)y + 0.5f) / (float)color->height * 2.0f - 1.0f;
+		float middle = 1.0f - post->vignette * dy * dy * 0.5f;
+		for (int x = 0; x < color->width; x++)
+		{
+			p4 v = grade ? post_grade_pixel(post, row[x]) : p4_unpack(row[x]);
+			v = p4_mul(v, scale);
+			if (vignette) v = p4_mul(v, p4_set(middle - falloff[x]));
+			row[x] = p4_pack(p4_add(p4_clamp(v, 255.0f), half));
+		}
+	}
+}
+
+void post_grade(post_t* post, surface_t* color)
+{
+	// the part of the vignette of each column
+	post->falloff.resize(color->width);
+	for (int x = 0; x < color->width; x++)
+	{
+		float dx = ((float)x + 0.5f) / (float)color->width * 2.0f - 1.0f;
+		post->falloff[x] = post->vignette * dx * dx * 0.5f;
+	}
+	post_run(post_grade_rows, post, NULL, color, color->height, POST_ROWS);
+}
@@ -0,0 +1,63 @@
+#ifndef post_h
+#define post_h
+//=====================================================================
+// post processing in device_resolve, every effect a row or tile kernel
+// on the job system with an SSE form and a scalar one that does the
+// same operations:
+//   bloom     the radiance of the HDR colour above a threshold, halved
+//             into a pyramid of levels, each blurred with a separable
+//             gaussian and added up from the smallest back into the
+//             HDR colour before the tone map. needs device_set_hdr
+//   fxaa      after the tone map and taa, pixels whose neighbours differ
+//             in luma take the colour along the edge through them
+//   grade     the colour target through a 3D LUT, trilinear
+//   vignette  the corners darkened, in the pass of the grade
+//=====================================================================
+#include "render.h"
+#include "hdr.h"
+#include <vector>
+
+#define POST_BLOOM    1
+#define POST_FXAA     2
+#define POST_GRADE    4
+#define POST_VIGNETTE 8
+
+#define POST_BLOOM_LEVELS 5      // of the pyramid, the first is half the size of the frame
+#define POST_BLOOM_CLAMP 16.0f   // radiance is clamped to it first, the white of display colour is far more
+#define POST_GRADE_MAX 65        // LUT points per axis
+#define POST_ROWS 16             // rows per job of the row kernels
+#define POST_TILE 64             // side of the tiles of the vertical blur
+
+struct post_t
+{
+	int effects;             // POST_*
+	float bloom_threshold;   // radiance above it blooms, 8 by default
+	float bloom_strength;    // of the pyramid added to the HDR colour, 0.2 by default
+	float vignette;          // darkening of the corners, 0.3 by default
+	std::vector<surface_t*> levels; // RGBA32F, levels[i] is 1 / 2^(i+1) of the frame
+	std::vector<surface_t*> blur;   // the horizontal pass of each level
+	surface_t* copy;         // XRGB32, the frame fxaa reads
+	std::vector<float> luma; // of copy, one per pixel
+	int grade_size;          // LUT points per axis
+	std::vector<float> grade; // grade_size^3 points of b g r 0 in [0, 1], red runs fastest
+	std::vector<float> falloff; // darkening of the vignette of each column
+};
+
+// every effect off, the grade is the identity
+post_t* post_create();
+
+void post_destory(post_t* post);
+
+// read a .cube file (LUT_3D_SIZE and the points, red fastest) as the grade, false when it can't be read.
+// the domain is taken to be [0, 1]
+bool post_load_grade(post_t* post, const char* path);
+
+// add the bloom of the radiance of hdr to it
+void post_bloom(post_t* post, hdr_t* hdr);
+
+void post_fxaa(post_t* post, surface_t* color);
+
+// the grade and the vignette that are on
+void post_grade(post_t* post, surface_t* color);
+
+#endif
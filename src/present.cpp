@@ -0,0 +1,82 @@
+#include "present.h"
+#include <cstring>
+
+static void present_null_show(present_t*, int) {}
+
+static void present_null_poll(present_t*) {}
+
+static void present_null_close(present_t* present)
+{
+	for (size_t i = 0; i < present->buffers.size(); i++) surface_destory(present->buffers[i]);
+	present->buffers.clear();
+}
+
+present_t* present_create(int kind, int width, int height, int buffers, void* window)
+{
+	if (buffers < 1) buffers = 1;
+	if (buffers > PRESENT_MAX_BUFFERS) buffers = PRESENT_MAX_BUFFERS;
+	present_t* present = new present_t;
+	present->kind = kind;
+	present->width = width;
+	present->height = height;
+	present->shown = -1;
+	present->presented = 0;
+	present->closed = 0;
+	present->shared = 1;
+	present->native = NULL;
+	bool opened = false;
+	if (kind == PRESENT_NULL)
+	{
+		for (int i = 0; i < buffers; i++) present->buffers.push_back(surface_create(width, height, SURFACE_FORMAT_XRGB32, NULL, 0));
+		present->show = present_null_show;
+		present->poll = present_null_poll;
+		present->close = present_null_close;
+		opened = true;
+	}
+#ifdef _WIN32
+	if (kind == PRESENT_DIB) opened = present_open_dib(present, buffers, window);
+#endif
+#ifdef SIMPLERENDER_X11
+	if (kind == PRESENT_XSHM) opened = present_open_xshm(present, buffers);
+#endif
+	(void)window;
+	if (!opened)
+	{
+		delete present;
+		return NULL;
+	}
+	for (size_t i = 0; i < present->buffers.size(); i++) surface_clear(present->buffers[i], 0);
+	return present;
+}
+
+void present_destory(present_t* present)
+{
+	if (present == NULL) return;
+	present->close(present);
+	delete present;
+}
+
+int present_kind_of(const char* name)
+{
+	if (strcmp(name, "null") == 0) return PRESENT_NULL;
+	if (strcmp(name, "dib") == 0) return PRESENT_DIB;
+	if (strcmp(name, "x11") == 0) return PRESENT_XSHM;
+	return -1;
+}
+
+void present_show(present_t* present, const surface_t* buffer)
+{
+	for (size_t i = 0; i < present->buffers.size(); i++)
+	{
+		if (present->buffers[i] != buffer) continue;
+		present->show(present, (int)i);
+		present->shown = (int)i;
+		present->presented++;
+		return;
+	}
+}
+
+void present_poll(present_t* present)
+{
+	present->poll(present);
+}
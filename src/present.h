@@ -0,0 +1,60 @@
+#ifndef present_h
+#define present_h
+//=====================================================================
+// present backends: the buffers a window shows, in memory the display
+// reads itself, so the device draws straight into them and showing a
+// frame copies nothing on our side. a win32 DIB section is blitted by
+// GDI, an x11 MIT-SHM image is read by the server from the shared
+// segment. the null backend keeps plain buffers and shows nothing, for
+// headless runs. a swap chain made with swap_chain_create_on hands its
+// buffers out for drawing and present_show as its present callback.
+//=====================================================================
+#include "surface.h"
+#include <vector>
+
+#define PRESENT_NULL 0           // plain memory, nothing is shown
+#define PRESENT_DIB  1           // win32 DIB sections blitted to the window given to present_create
+#define PRESENT_XSHM 2           // x11 window of its own, MIT-SHM images, XPutImage when the server can't share memory
+
+#define PRESENT_MAX_BUFFERS 3
+
+struct present_t
+{
+	int kind;                // PRESENT_*
+	int width, height;
+	std::vector<surface_t*> buffers;  // XRGB32 wrappers of the shared memory
+	int shown;               // index of the buffer on screen, -1 before the first present_show
+	int presented;           // present_show calls since create
+	int closed;              // the window was closed or escape pressed
+	int shared;              // the display reads the buffers without a copy through a socket
+	// the backend's part, set by its open function
+	void (*show)(present_t* present, int index);
+	void (*poll)(present_t* present);
+	void (*close)(present_t* present);
+	void* native;
+};
+
+// buffers is clamped to 1..PRESENT_MAX_BUFFERS, window is the HWND of PRESENT_DIB and unused otherwise.
+// NULL when the backend isn't built in or the display can't be opened
+present_t* present_create(int kind, int width, int height, int buffers, void* window);
+
+void present_destory(present_t* present);
+
+// PRESENT_* of "null", "dib" or "x11", -1 for none
+int present_kind_of(const char* name);
+
+// show one of the buffers and return when the display is done reading it. safe off the thread of the window
+void present_show(present_t* present, const surface_t* buffer);
+
+// handle the events of the window, sets closed
+void present_poll(present_t* present);
+
+// the open functions of the backends, they fill buffers and the callbacks or return false
+#ifdef _WIN32
+bool present_open_dib(present_t* present, int buffers, void* window);
+#endif
+#ifdef SIMPLERENDER_X11
+bool present_open_xshm(present_t* present, int buffers);
+#endif
+
+#endif
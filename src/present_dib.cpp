@@ -0,0 +1,88 @@
+#include "present.h"
+#ifdef _WIN32
+#include <windows.h>
+#include <dwmapi.h>
+
+#ifdef _MSC_VER
+#pragma comment(lib, "gdi32.lib")
+#pragma comment(lib, "dwmapi.lib")
+#endif
+
+typedef struct
+{
+	HWND window;
+	std::vector<HDC> dcs;            // a memory DC with each DIB selected, so showing selects nothing
+	std::vector<HBITMAP> bitmaps;
+	std::vector<HBITMAP> olds;       // the bitmaps the DCs came with
+	int vsync;                       // the desktop is composed, a blit waits for its next refresh
+}present_dib_t;
+
+static void present_dib_show(present_t* present, int index)
+{
+	present_dib_t* d = (present_dib_t*)present->native;
+	HDC hDC = GetDC(d->window);
+	BitBlt(hDC, 0, 0, present->width, present->height, d->dcs[index], 0, 0, SRCCOPY);
+	ReleaseDC(d->window, hDC);
+	// the blit only reaches the screen with the compositor's next frame, so wait for it instead of tearing ahead
+	if (d->vsync) DwmFlush();
+}
+
+// the window's messages are dispatched by its owner
+static void present_dib_poll(present_t*) {}
+
+static void present_dib_close(present_t* present)
+{
+	present_dib_t* d = (present_dib_t*)present->native;
+	for (size_t i = 0; i < present->buffers.size(); i++) surface_destory(present->buffers[i]);
+	present->buffers.clear();
+	for (size_t i = 0; i < d->dcs.size(); i++)
+	{
+		SelectObject(d->dcs[i], d->olds[i]);
+		DeleteDC(d->dcs[i]);
+		DeleteObject(d->bitmaps[i]);
+	}
+	delete d;
+	present->native = NULL;
+}
+
+bool present_open_dib(present_t* present, int buffers, void* window)
+{
+	if (window == NULL) return false;
+	int w = present->width, h = present->height;
+	BITMAPINFO bi = { { sizeof(BITMAPINFOHEADER), w, -h, 1, 32, BI_RGB,
+		(unsigned)(w * h * 4), 0, 0, 0, 0 } };
+	present_dib_t* d = new present_dib_t;
+	d->window = (HWND)window;
+	present->native = d;
+	present->show = present_dib_show;
+	present->poll = present_dib_poll;
+	present->close = present_dib_close;
+	HDC hDC = GetDC(d->window);
+	for (int i = 0; i < buffers; i++)
+	{
+		HDC dc = CreateCompatibleDC(hDC);
+		if (dc == NULL) break;
+		LPVOID ptr = NULL;
+		HBITMAP bitmap = CreateDIBSection(dc, &bi, DIB_RGB_COLORS, &ptr, 0, 0);
+		if (bitmap == NULL)
+		{
+			DeleteDC(dc);
+			break;
+		}
+		d->dcs.push_back(dc);
+		d->bitmaps.push_back(bitmap);
+		d->olds.push_back((HBITMAP)SelectObject(dc, bitmap));
+		present->buffers.push_back(surface_create(w, h, SURFACE_FORMAT_XRGB32, ptr, w * 4));
+	}
+	ReleaseDC(d->window, hDC);
+	if ((int)present->buffers.size() < buffers)
+	{
+		present_dib_close(present);
+		return false;
+	}
+	BOOL composed = FALSE;
+	d->vsync = SUCCEEDED(DwmIsCompositionEnabled(&composed)) && composed;
+	return true;
+}
+
+#endif
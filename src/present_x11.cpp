@@ -0,0 +1,172 @@
+#include "present.h"
+#ifdef SIMPLERENDER_X11
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <cstdlib>
+
+typedef struct
+{
+	Display* display;
+	Window window;
+	GC gc;
+	Atom wm_delete;
+	std::vector<XImage*> images;
+	std::vector<XShmSegmentInfo> segments; // empty without MIT-SHM
+}present_x11_t;
+
+// XShmAttach of a client on another machine fails asynchronously, the handler notes it
+static int present_x11_failed = 0;
+
+static int present_x11_error(Display*, XErrorEvent*)
+{
+	present_x11_failed = 1;
+	return 0;
+}
+
+static void present_x11_show(present_t* present, int index)
+{
+	present_x11_t* x = (present_x11_t*)present->native;
+	if (!x->segments.empty()) XShmPutImage(x->display, x->window, x->gc, x->images[index], 0, 0, 0, 0, present->width, present->height, False);
+	else XPutImage(x->display, x->window, x->gc, x->images[index], 0, 0, 0, 0, present->width, present->height);
+	// the server copies out of the image while it handles the request, so the buffer is free after the round trip
+	XSync(x->display, False);
+}
+
+static void present_x11_poll(present_t* present)
+{
+	present_x11_t* x = (present_x11_t*)present->native;
+	while (XPending(x->display) > 0)
+	{
+		XEvent event;
+		XNextEvent(x->display, &event);
+		if (event.type == ClientMessage && (Atom)event.xclient.data.l[0] == x->wm_delete) present->closed = 1;
+		if (event.type == KeyPress && XLookupKeysym(&event.xkey, 0) == XK_Escape) present->closed = 1;
+	}
+}
+
+static void present_x11_close(present_t* present)
+{
+	present_x11_t* x = (present_x11_t*)present->native;
+	for (size_t i = 0; i < present->buffers.size(); i++) surface_destory(present->buffers[i]);
+	present->buffers.clear();
+	for (size_t i = 0; i < x->images.size(); i++)
+	{
+		if (!x->segments.empty())
+		{
+			XShmDetach(x->display, &x->segments[i]);
+			shmdt(x->segments[i].shmaddr);
+		}
+		else free(x->images[i]->data);
+		// the data isn't XDestroyImage's to free
+		x->images[i]->data = NULL;
+		XDestroyImage(x->images[i]);
+	}
+	if (x->gc != NULL) XFreeGC(x->display, x->gc);
+	if (x->window != 0) XDestroyWindow(x->display, x->window);
+	XCloseDisplay(x->display);
+	delete x;
+	present->native = NULL;
+}
+
+// shared images of buffers segments, false when one can't be made or attached
+static bool present_x11_shm(present_t* present, present_x11_t* x, Visual* visual, int buffers)
+{
+	if (!XShmQueryExtension(x->display)) return false;
+	x->segments.resize(buffers);
+	int attached = 0;
+	for (int i = 0; i < buffers; i++)
+	{
+		XShmSegmentInfo* segment = &x->segments[i];
+		segment->shmaddr = NULL;
+		XImage* image = XShmCreateImage(x->display, visual, 24, ZPixmap, NULL, segment, present->width, present->height);
+		if (image == NULL) break;
+		x->images.push_back(image);
+		segment->shmid = shmget(IPC_PRIVATE, (size_t)image->bytes_per_line * image->height, IPC_CREAT | 0600);
+		if (segment->shmid < 0) break;
+		char* address = (char*)shmat(segment->shmid, NULL, 0);
+		// marked for removal at once, it goes away with the last detach even if the process dies
+		shmctl(segment->shmid, IPC_RMID, NULL);
+		if (address == (char*)-1) break;
+		segment->shmaddr = image->data = address;
+		segment->readOnly = True;
+		present_x11_failed = 0;
+		XErrorHandler old = XSetErrorHandler(present_x11_error);
+		XShmAttach(x->display, segment);
+		XSync(x->display, False);
+		XSetErrorHandler(old);
+		if (present_x11_failed) break;
+		attached++;
+	}
+	if (attached == buffers) return true;
+	// undo the ones made, the caller falls back to XPutImage
+	for (size_t i = 0; i < x->images.size(); i++)
+	{
+		if ((int)i < attached) XShmDetach(x->display, &x->segments[i]);
+		if (x->segments[i].shmaddr != NULL) shmdt(x->segments[i].shmaddr);
+		x->images[i]->data = NULL;
+		XDestroyImage(x->images[i]);
+	}
+	XSync(x->display, False);
+	x->images.clear();
+	x->segments.clear();
+	return false;
+}
+
+bool present_open_xshm(present_t* present, int buffers)
+{
+	// the swap chain shows from its own thread while the window thread polls
+	static int threads = XInitThreads();
+	(void)threads;
+	Display* display = XOpenDisplay(NULL);
+	if (display == NULL) return false;
+	int screen = DefaultScreen(display);
+	XVisualInfo info;
+	// the buffers are XRGB32, only a visual of that layout takes them as they are
+	if (!XMatchVisualInfo(display, screen, 24, TrueColor, &info) || info.red_mask != 0xff0000 || info.green_mask != 0xff00 || info.blue_mask != 0xff)
+	{
+		XCloseDisplay(display);
+		return false;
+	}
+	present_x11_t* x = new present_x11_t;
+	x->display = display;
+	x->gc = NULL;
+	XSetWindowAttributes attributes;
+	attributes.colormap = XCreateColormap(display, RootWindow(display, screen), info.visual, AllocNone);
+	attributes.background_pixel = 0;
+	attributes.border_pixel = 0;
+	attributes.event_mask = KeyPressMask | StructureNotifyMask;
+	x->window = XCreateWindow(display, RootWindow(display, screen), 0, 0, present->width, present->height, 0, 24, InputOutput, info.visual,
+		CWColormap | CWBackPixel | CWBorderPixel | CWEventMask, &attributes);
+	x->gc = XCreateGC(display, x->window, 0, NULL);
+	XStoreName(display, x->window, "SimpleRender");
+	x->wm_delete = XInternAtom(display, "WM_DELETE_WINDOW", False);
+	XSetWMProtocols(display, x->window, &x->wm_delete, 1);
+	XMapWindow(display, x->window);
+	present->native = x;
+	present->show = present_x11_show;
+	present->poll = present_x11_poll;
+	present->close = present_x11_close;
+	present->shared = present_x11_shm(present, x, info.visual, buffers);
+	if (!present->shared)
+	{
+		for (int i = 0; i < buffers; i++)
+		{
+			char* data = (char*)malloc((size_t)present->width * present->height * 4);
+			XImage* image = XCreateImage(display, info.visual, 24, ZPixmap, 0, data, present->width, present->height, 32, present->width * 4);
+			x->images.push_back(image);
+		}
+	}
+	for (size_t i = 0; i < x->images.size(); i++)
+	{
+		XImage* image = x->images[i];
+		present->buffers.push_back(surface_create(present->width, present->height, SURFACE_FORMAT_XRGB32, image->data, image->bytes_per_line));
+	}
+	XSync(display, False);
+	return true;
+}
+
+#endif
@@ -0,0 +1,84 @@
+#include "profile.h"
+#include <cstring>
+#include <vector>
+
+static const char* profile_stage_names[PROFILE_STAGES] = { "clear", "vertex", "raster", "shade", "resolve", "present", "hud",
+	"bloom", "tone map", "fxaa", "grade", "ssao" };
+static const char* profile_counter_names[PROFILE_COUNTERS] = { "triangles in", "culled", "clipped", "rasterized",
+	"fragments shaded", "depth rejected", "blended", "jobs run", "jobs stolen", "job idle us" };
+
+profile_t* profile_create()
+{
+	profile_t* profile = new profile_t();
+	profile->frames = 0;
+	memset(profile->history, 0, sizeof(profile->history));
+	profile_frame_begin(profile);
+	return profile;
+}
+
+void profile_destory(profile_t* profile)
+{
+	delete profile;
+}
+
+void profile_frame_begin(profile_t* profile)
+{
+	for (int i = 0; i < PROFILE_STAGES; i++) profile->ns[i] = 0;
+	for (int i = 0; i < PROFILE_COUNTERS; i++) profile->counters[i] = 0;
+	job_get_stats(&profile->jobs);
+	profile->start = std::chrono::steady_clock::now();
+}
+
+void profile_frame_end(profile_t* profile)
+{
+	profile_frame_t* frame = &profile->history[profile->frames % PROFILE_HISTORY];
+	for (int i = 0; i < PROFILE_STAGES; i++) frame->ms[i] = (double)profile->ns[i] * 1e-6;
+	job_stats_t jobs;
+	job_get_stats(&jobs);
+	profile->counters[PROFILE_JOBS_RUN] += jobs.run - profile->jobs.run;
+	profile->counters[PROFILE_JOBS_STOLEN] += jobs.stolen - profile->jobs.stolen;
+	profile->counters[PROFILE_JOBS_IDLE_US] += jobs.idle_us - profile->jobs.idle_us;
+	for (int i = 0; i < PROFILE_COUNTERS; i++) frame->counters[i] = profile->counters[i];
+	frame->frame_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - profile->start).count();
+	profile->frames++;
+}
+
+void profile_add_ms(profile_t* profile, int stage, double ms)
+{
+	profile->ns[stage].fetch_add((long long)(ms * 1e6), std::memory_order_relaxed);
+}
+
+int profile_history(const profile_t* profile, profile_frame_t* out, int max)
+{
+	int n = profile->frames < PROFILE_HISTORY ? profile->frames : PROFILE_HISTORY;
+	if (n > max) n = max;
+	for (int i = 0; i < n; i++) out[i] = profile->history[(profile->frames - n + i) % PROFILE_HISTORY];
+	return n;
+}
+
+void profile_print(FILE* fp, const profile_t* profile, int frames)
+{
+	if (!PROFILE_ENABLED)
+	{
+		fprintf(fp, "profile: built without SIMPLERENDER_PROFILE\n");
+		return;
+	}
+	std::vector<profile_frame_t> last(PROFILE_HISTORY);
+	int n = profile_history(profile, &last[0], frames);
+	if (n == 0)
+	{
+		fprintf(fp, "profile: no frames yet\n");
+		return;
+	}
+	profile_frame_t sum;
+	memset(&sum, 0, sizeof(sum));
+	for (int f = 0; f < n; f++)
+	{
+		for (int i = 0; i < PROFILE_STAGES; i++) sum.ms[i] += last[f].ms[i];
+		for (int i = 0; i < PROFILE_COUNTERS; i++) sum.counters[i] += last[f].counters[i];
+		sum.frame_ms += last[f].frame_ms;
+	}
+	fprintf(fp, "profile: average of %d frames, %.2f ms per frame\n", n, sum.frame_ms / n);
+	for (int i = 0; i < PROFILE_STAGES; i++) fprintf(fp, "  %-18s %9.3f ms\n", profile_stage_names[i], sum.ms[i] / n);
+	for (int i = 0; i < PROFILE_COUNTERS; i++) fprintf(fp, "  %-18s %9lld\n", profile_counter_names[i], sum.counters[i] / n);
+}
@@ -0,0 +1,115 @@
+#ifndef profile_h
+#define profile_h
+//=====================================================================
+// frame profiler: time spent in each pipeline stage and counters of
+// the triangles and fragments that pass through it, kept for the last
+// PROFILE_HISTORY frames. the PROFILE_* macros in the hot paths only
+// exist when built with SIMPLERENDER_PROFILE, otherwise they compile
+// to nothing and device_set_profile has no effect.
+//=====================================================================
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include "job.h"
+
+#define PROFILE_STAGE_CLEAR    0  // device_clear
+#define PROFILE_STAGE_VERTEX   1  // transform, back face test and v_shader of draw_plane / draw_indexed
+#define PROFILE_STAGE_RASTER   2  // trapezoid and edge walks, shading included
+#define PROFILE_STAGE_SHADE    3  // f_shader and f_shader_packet with the framebuffer write
+#define PROFILE_STAGE_RESOLVE  4  // device_resolve: deferred shading, the transparent pass and the post passes
+#define PROFILE_STAGE_PRESENT  5  // device_present
+#define PROFILE_STAGE_HUD      6  // the help images of the window
+#define PROFILE_STAGE_BLOOM    7  // post_bloom, in RESOLVE
+#define PROFILE_STAGE_TONEMAP  8  // hdr_resolve, in RESOLVE
+#define PROFILE_STAGE_FXAA     9  // post_fxaa, in RESOLVE
+#define PROFILE_STAGE_GRADE    10 // post_grade, in RESOLVE
+#define PROFILE_STAGE_SSAO     11 // ssao_compute, in RESOLVE
+#define PROFILE_STAGES         12
+
+#define PROFILE_TRIANGLES_IN    0  // triangles handed to the pipeline, once per pass
+#define PROFILE_TRIANGLES_CULLED 1 // dropped as back faces, outside the frustum or hidden by hi-z
+#define PROFILE_TRIANGLES_CLIPPED 2 // cut by the near plane or the guard band
+#define PROFILE_TRIANGLES_RASTER 3 // set up and walked
+#define PROFILE_FRAGMENTS_SHADED 4
+#define PROFILE_FRAGMENTS_DEPTH_REJECTED 5 // failed the depth test outside the depth only pass
+#define PROFILE_FRAGMENTS_BLENDED 6 // shaded in the transparent pass
+#define PROFILE_JOBS_RUN        7  // by the job system during the frame, every device and subsystem
+#define PROFILE_JOBS_STOLEN     8  // taken from the deque of another thread
+#define PROFILE_JOBS_IDLE_US    9  // microseconds the workers slept with nothing to run
+#define PROFILE_COUNTERS        10
+
+#define PROFILE_HISTORY 120
+
+// one finished frame. the stage times of the tile workers add up, so they are thread time, and
+// RASTER includes SHADE, RESOLVE the post passes
+typedef struct
+{
+	double ms[PROFILE_STAGES];
+	long long counters[PROFILE_COUNTERS];
+	double frame_ms;         // profile_frame_begin to profile_frame_end
+}profile_frame_t;
+
+struct profile_t
+{
+	std::atomic<long long> ns[PROFILE_STAGES];           // of the open frame
+	std::atomic<long long> counters[PROFILE_COUNTERS];
+	std::chrono::steady_clock::time_point start;
+	job_stats_t jobs;        // of the job system at profile_frame_begin
+	profile_frame_t history[PROFILE_HISTORY];            // ring, frames % PROFILE_HISTORY is the next slot
+	int frames;              // finished since profile_create
+};
+
+profile_t* profile_create();
+
+void profile_destory(profile_t* profile);
+
+// zero the counters of the next frame
+void profile_frame_begin(profile_t* profile);
+
+// move the counters into the ring, the job counters are the growth of job_get_stats since the begin
+void profile_frame_end(profile_t* profile);
+
+// for a stage that does not fit in one block, adds ms to the open frame
+void profile_add_ms(profile_t* profile, int stage, double ms);
+
+// copy up to max of the last frames into out, oldest first, returns how many
+int profile_history(const profile_t* profile, profile_frame_t* out, int max);
+
+// the average of the last frames, one line per stage and counter
+void profile_print(FILE* fp, const profile_t* profile, int frames);
+
+// adds the time from construction to destruction to one stage, does nothing for a NULL profile
+class profile_scope_t
+{
+public:
+	profile_scope_t(profile_t* profile, int stage) : profile(profile), stage(stage)
+	{
+		if (profile != NULL) start = std::chrono::steady_clock::now();
+	}
+	~profile_scope_t()
+	{
+		if (profile == NULL) return;
+		long long ns = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		profile->ns[stage].fetch_add(ns, std::memory_order_relaxed);
+	}
+private:
+	profile_t* profile;
+	int stage;
+	std::chrono::steady_clock::time_point start;
+};
+
+#ifdef SIMPLERENDER_PROFILE
+#define PROFILE_ENABLED 1
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+// time the rest of the enclosing block as stage of device->profile
+#define PROFILE_SCOPE(device, stage) profile_scope_t PROFILE_JOIN(profile_scope_, __LINE__)((device)->profile, stage)
+#define PROFILE_COUNT(device, counter, n) \
+	do { if ((device)->profile != NULL) (device)->profile->counters[counter].fetch_add((n), std::memory_order_relaxed); } while (0)
+#else
+#define PROFILE_ENABLED 0
+#define PROFILE_SCOPE(device, stage) ((void)0)
+#define PROFILE_COUNT(device, counter, n) ((void)0)
+#endif
+
+#endif
@@ -1,14 +1,13 @@
 #include "rasterize.h"
+#include "s_simd.h"
 #include<iostream>
 #include<cmath>
+#include <cstdlib>
+#include <algorithm>
 //this=a*m
 void apply_to_vector(s_vector& tmp, s_vector& a, s_matrix& m)
 {
-	float X = a.x, Y = a.y, Z = a.z, W = a.w;
-	tmp.x = X * m.m[0][0] + Y * m.m[1][0] + Z * m.m[2][0] + W * m.m[3][0];
-	tmp.y = X * m.m[0][1] + Y * m.m[1][1] + Z * m.m[2][1] + W * m.m[3][1];
-	tmp.z = X * m.m[0][2] + Y * m.m[1][2] + Z * m.m[2][2] + W * m.m[3][2];
-	tmp.w = X * m.m[0][3] + Y * m.m[1][3] + Z * m.m[2][3] + W * m.m[3][3];
+	s_simd_get()->apply(&tmp.x, &a.x, &m.m[0][0]);
 }
 // let m be the look at matrix
 void set_look_at_matrix(s_matrix& m, s_vector eye, s_vector at, s_vector up)
@@ -75,6 +74,7 @@ s_transform::s_transform(int width, int height)
 	set_perspective_matrix(projection, 3.1415926f * 0.25f, aspect, 1.0f, 500.0f);
 	w = (float)width;
 	h = (float)height;
+	normal_dirty = 1;
 	this->update();
 }
 void s_transform::init(int width, int height)
@@ -85,6 +85,7 @@ void s_transform::init(int width, int height)
 	set_perspective_matrix(projection, 3.1415926f * 0.25f, aspect, 1.0f, 500.0f);
 	w = (float)width;
 	h = (float)height;
+	normal_dirty = 1;
 	this->update();
 }
 
@@ -95,6 +96,29 @@ void s_transform::update()
 	transform.mul_two(m, projection);
 	m.mul_two(view, projection);
 	vp = m;
+	// row vectors, so clip.k = dot(p, column k) and every plane is a sum of two columns
+	for (int i = 0; i < 3; i++)
+	{
+		float* f[2] = { &frustum[i * 2].x, &frustum[i * 2 + 1].x };
+		for (int r = 0; r < 4; r++)
+		{
+			float c = transform.m[r][i], w = transform.m[r][3];
+			f[0][r] = i == 2 ? c : w + c;
+			f[1][r] = w - c;
+		}
+	}
+	// world changes once per draw at most, the inverse is only redone when it does
+	bool changed = normal_dirty != 0;
+	for (int i = 0; i < 4 && !changed; i++)
+		for (int j = 0; j < 4; j++)
+			if (world.m[i][j] != normal_world.m[i][j]) { changed = true; break; }
+	if (changed)
+	{
+		normal = world;
+		normal.inverse(); normal.transpose();
+		normal_world = world;
+		normal_dirty = 0;
+	}
 }
 //y=x*transform
 void s_transform::apply(s_vector& y, s_vector& x)
@@ -295,10 +319,105 @@ void trapezoid_edge_interp(trapezoid_t* trap, float y)
 void trapezoid_init_scan_line(trapezoid_t* trap, scanline_t* scanline, int y)
 {
 	float width = trap->right.v.pos.x - trap->left.v.pos.x;
-	scanline->x = (int)(trap->left.v.pos.x + 0.5f);
-	scanline->w = (int)(trap->right.v.pos.x + 0.5f) - scanline->x;
+	// floor and not a cast, spans starting left of the target keep the pixel their first step is at
+	scanline->x = (int)floorf(trap->left.v.pos.x + 0.5f);
+	scanline->w = (int)floorf(trap->right.v.pos.x + 0.5f) - scanline->x;
 	scanline->y = y;
 	scanline->v = trap->left.v;
 	if (trap->left.v.pos.x >= trap->right.v.pos.x) scanline->w = 0;
 	vertex_division(&scanline->step, &trap->left.v, &trap->right.v, width);
 }
+
+
+static void edge_eq_init(edge_eq_t* e, const long long* a, const long long* b)
+{
+	e->ia = a[1] - b[1];
+	e->ib = b[0] - a[0];
+	e->ix0 = a[0];
+	e->iy0 = a[1];
+}
+
+// the float form and the fill rule of e once its inside is the positive side
+static void edge_eq_finish(edge_eq_t* e)
+{
+	e->a = (float)e->ia / RASTER_SUBPIXEL;
+	e->b = (float)e->ib / RASTER_SUBPIXEL;
+	e->x0 = (float)e->ix0 / RASTER_SUBPIXEL;
+	e->y0 = (float)e->iy0 / RASTER_SUBPIXEL;
+	// the inside is below a top edge and right of a left edge, screen y points down
+	bool top_left = e->ia > 0 || (e->ia == 0 && e->ib > 0);
+	e->min = top_left ? 0 : 1;
+}
+
+int edge_triangle_init(edge_triangle_t* tri, const vertex_t* p1, const vertex_t* p2, const vertex_t* p3)
+{
+	const vertex_t* p[3] = { p1, p2, p3 };
+	long long snap[3][2];
+	for (int i = 0; i < 3; i++)
+	{
+		snap[i][0] = (long long)floorf(p[i]->pos.x * RASTER_SUBPIXEL + 0.5f);
+		snap[i][1] = (long long)floorf(p[i]->pos.y * RASTER_SUBPIXEL + 0.5f);
+	}
+	edge_eq_init(&tri->e[0], snap[1], snap[2]);
+	edge_eq_init(&tri->e[1], snap[2], snap[0]);
+	edge_eq_init(&tri->e[2], snap[0], snap[1]);
+	long long iarea = edge_eq_value(&tri->e[0], snap[0][0], snap[0][1]);
+	if (iarea == 0) return 0;
+	// make the inside positive for both windings
+	if (iarea < 0)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			tri->e[i].ia = -tri->e[i].ia;
+			tri->e[i].ib = -tri->e[i].ib;
+		}
+		iarea = -iarea;
+	}
+	for (int i = 0; i < 3; i++) edge_eq_finish(&tri->e[i]);
+	float area = (float)iarea * RASTER_EDGE_UNIT;
+	tri->inv_area = 1.0f / area;
+	long long minx = snap[0][0], maxx = snap[0][0], miny = snap[0][1], maxy = snap[0][1];
+	for (int i = 0; i < 3; i++)
+	{
+		tri->z[i] = p[i]->pos.z;
+		tri->rhw[i] = p[i]->rhw;
+		tri->rhw_area[i] = p[i]->rhw * tri->inv_area;
+		tri->zrhw[i] = p[i]->pos.z * p[i]->rhw;
+		minx = std::min(minx, snap[i][0]);
+		maxx = std::max(maxx, snap[i][0]);
+		miny = std::min(miny, snap[i][1]);
+		maxy = std::max(maxy, snap[i][1]);
+	}
+	// pixel x is sampled at x + 0.5: floor(min - 0.5) and ceil(max - 0.5), the shifts round down
+	const long long half = RASTER_SUBPIXEL / 2;
+	tri->min_x = (int)((minx - half) >> RASTER_SUBPIXEL_BITS);
+	tri->min_y = (int)((miny - half) >> RASTER_SUBPIXEL_BITS);
+	tri->max_x = (int)-((half - maxx) >> RASTER_SUBPIXEL_BITS);
+	tri->max_y = (int)-((half - maxy) >> RASTER_SUBPIXEL_BITS);
+	return 1;
+}
+
+int edge_triangle_classify_block(const edge_triangle_t* tri, float x, float y, int size)
+{
+	return edge_triangle_classify_samples(tri, x, y, size, 0.0f);
+}
+
+int edge_triangle_classify_samples(const edge_triangle_t* tri, float x, float y, int size, float reach)
+{
+	long long sx = (long long)floorf(x * RASTER_SUBPIXEL + 0.5f), sy = (long long)floorf(y * RASTER_SUBPIXEL + 0.5f);
+	long long span = (long long)(size - 1) << RASTER_SUBPIXEL_BITS;
+	long long r = (long long)floorf(reach * RASTER_SUBPIXEL + 0.5f);
+	int full = 1;
+	for (int i = 0; i < 3; i++)
+	{
+		const edge_eq_t* e = &tri->e[i];
+		long long v = edge_eq_value(e, sx, sy) - e->min;
+		// an affine function takes its extremes at the corners, the sample reach widens the block on every side
+		long long margin = (std::abs(e->ia) + std::abs(e->ib)) * r;
+		long long lo = v + (e->ia < 0 ? e->ia * span : 0) + (e->ib < 0 ? e->ib * span : 0) - margin;
+		long long hi = v + (e->ia > 0 ? e->ia * span : 0) + (e->ib > 0 ? e->ib * span : 0) + margin;
+		if (hi < 0) return 0;
+		if (lo < 0) full = 0;
+	}
+	return full ? 2 : 1;
+}
@@ -19,17 +19,25 @@ public:
 	s_matrix world/*任*/, view/*任*/, projection/*ͶӰ任*/;
 	s_matrix transform;//transform=world* view * projection
 	s_matrix vp;//view*projection
+	s_matrix normal;         // inverse transpose of world, transforms the normals
+	s_matrix normal_world;   // the world that normal was built from
+	int normal_dirty;        // rebuild normal on the next update() even if world compares equal
+	s_vector frustum[6];     // planes of transform, dot(plane, model space point) >= 0 inside: left right bottom top near far
 	float w, h;//ĻС
 	s_transform(int width, int height);
-	s_transform() {}
+	s_transform() { normal_dirty = 1; }
 	~s_transform() {}
 	void init(int width, int height);
-	s_transform& operator=(s_transform& t)
+	s_transform& operator=(const s_transform& t)
 	{
 		world = t.world;
 		view = t.view;
 		projection = t.projection;
 		transform = t.transform;
+		normal = t.normal;
+		normal_world = t.normal_world;
+		normal_dirty = t.normal_dirty;
+		for (int i = 0; i < 6; i++) frustum[i] = t.frustum[i];
 		w = t.w;
 		h = t.h;
 		return *this;
@@ -50,7 +58,8 @@ void transform_homogenize_reverse(s_vector& y, s_vector& x, float w, float width
 
 int transform_check_cvv(s_vector& v);
 
-typedef struct { s_vector pos; s_vector2f tc; s_color color; float rhw; s_vector normal; int material_idex; } vertex_t;
+// tangent is the model space tangent from mesh_compute_tangents, w = +-1 handedness
+typedef struct { s_vector pos; s_vector2f tc; s_color color; float rhw; s_vector normal; int material_idex; s_vector tangent; } vertex_t;
 void vertex_rhw_init(vertex_t* v);
 
 void vertex_interp(vertex_t* y, vertex_t* x1, vertex_t* x2, float t);
@@ -73,6 +82,66 @@ void trapezoid_edge_interp(trapezoid_t* trap, float y);
 
 void trapezoid_init_scan_line(trapezoid_t* trap, scanline_t* scanline, int y);
 
+// half-space rasterization: E(x, y) = a * (x - x0) + b * (y - y0), >= 0 inside the triangle.
+// evaluating relative to a vertex (x0, y0) of the edge avoids the cancellation of the a * x + b * y + c form.
+// the vertices are snapped to 1 / RASTER_SUBPIXEL of a pixel and coverage is decided on the exact
+// 64 bit value of E in subpixel units, with the top-left rule for points on an edge, so a pixel on the
+// edge two triangles share is covered by exactly one of them whatever block or tile it is walked from
+#define RASTER_BLOCK 8
+#define RASTER_SUBPIXEL_BITS 8
+#define RASTER_SUBPIXEL (1 << RASTER_SUBPIXEL_BITS)
+// E in pixels^2 per unit of the fixed point E
+#define RASTER_EDGE_UNIT (1.0f / (RASTER_SUBPIXEL * RASTER_SUBPIXEL))
+// subpixel coordinate of the center of pixel x
+#define RASTER_CENTER(x) (((long long)(x) << RASTER_SUBPIXEL_BITS) + RASTER_SUBPIXEL / 2)
+// bound on |weight - exact| of edge_triangle_weights, exact being the same weights in double precision
+// from the fixed point E. the golden test holds random triangles to it, the worst is about 2e-7. the
+// un-project + computeBarycentric3D path is off by more than 1e-3 on small or edge-on triangles, so it
+// is not used as the reference
+#define RASTER_EDGE_EPSILON 1e-6f
+typedef struct
+{
+	float a, b, x0, y0;      // of the snapped vertices, in pixels
+	long long ia, ib;        // a and b in subpixels
+	long long ix0, iy0;      // (x0, y0) in subpixels
+	long long min;           // 0 on top and left edges, 1 on the others: a point is inside when E >= min
+}edge_eq_t;
+
+// the fixed point E of e at subpixel (sx, sy), exact
+inline long long edge_eq_value(const edge_eq_t* e, long long sx, long long sy)
+{
+	return e->ia * (sx - e->ix0) + e->ib * (sy - e->iy0);
+}
+typedef struct
+{
+	edge_eq_t e[3];          // e[i] is the edge opposite vertex i, so e[i] / area is the weight of vertex i
+	float inv_area;
+	float z[3];              // screen space depth of the vertices
+	float rhw[3];            // 1/w of the vertices
+	float rhw_area[3];       // rhw[i] / area, e[i] * rhw_area[i] summed over i is the 1/w plane
+	float zrhw[3];           // z[i] * rhw[i], perspective correct depth numerator
+	int min_x, min_y, max_x, max_y; // pixel bounding box, inclusive
+}edge_triangle_t;
+
+// the perspective correct weights b and the w of a point whose edge values are e0..e2 in pixels^2: the screen
+// space weights e[i] / area turned into perspective correct ones with the 1/w plane
+inline void edge_triangle_weights(const edge_triangle_t* tri, float e0, float e1, float e2, float* b, float& ww)
+{
+	float r0 = e0 * tri->rhw_area[0], r1 = e1 * tri->rhw_area[1], r2 = e2 * tri->rhw_area[2];
+	ww = 1.0f / (r0 + r1 + r2);
+	b[0] = r0 * ww; b[1] = r1 * ww; b[2] = r2 * ww;
+}
+
+// set up the edge equations of a screen space triangle, returns 0 for degenerate triangles
+int edge_triangle_init(edge_triangle_t* tri, const vertex_t* p1, const vertex_t* p2, const vertex_t* p3);
+
+// 0: block is outside, 1: partially covered, 2: fully covered by the fixed point test. (x, y) is the first pixel center
+int edge_triangle_classify_block(const edge_triangle_t* tri, float x, float y, int size);
+
+// edge_triangle_classify_block for the points up to reach pixels from the pixel centers on either
+// axis, like the samples of msaa_t: 2 only when all of them are inside
+int edge_triangle_classify_samples(const edge_triangle_t* tri, float x, float y, int size, float reach);
+
 
 
 #endif
\ No newline at end of file
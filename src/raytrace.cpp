@@ -0,0 +1,784 @@
+#include "raytrace.h"
+#include "light.h"
+#include "job.h"
+#include "scene_assets.h"
+#include <cmath>
+#include <cstring>
+#include <cfloat>
+#include <algorithm>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RAYTRACE_SSE 1
+#endif
+
+#define RAYTRACE_STACK 64        // bvh entries a traversal keeps pending
+
+//=====================================================================
+// 4 lanes, one ray of a packet each. masks are all bits set or clear
+// with SSE and 1.0f / 0.0f in the scalar fallback
+//=====================================================================
+#ifdef RAYTRACE_SSE
+typedef __m128 f4;
+static inline f4 f4_set(float a) { return _mm_set1_ps(a); }
+static inline f4 f4_load(const float* p) { return _mm_loadu_ps(p); }
+static inline void f4_store(float* p, f4 a) { _mm_storeu_ps(p, a); }
+static inline f4 f4_add(f4 a, f4 b) { return _mm_add_ps(a, b); }
+static inline f4 f4_sub(f4 a, f4 b) { return _mm_sub_ps(a, b); }
+static inline f4 f4_mul(f4 a, f4 b) { return _mm_mul_ps(a, b); }
+static inline f4 f4_div(f4 a, f4 b) { return _mm_div_ps(a, b); }
+static inline f4 f4_min(f4 a, f4 b) { return _mm_min_ps(a, b); }
+static inline f4 f4_max(f4 a, f4 b) { return _mm_max_ps(a, b); }
+static inline f4 f4_select(f4 mask, f4 a, f4 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+static inline f4 f4_and(f4 a, f4 b) { return _mm_and_ps(a, b); }
+static inline f4 f4_or(f4 a, f4 b) { return _mm_or_ps(a, b); }
+static inline f4 f4_le(f4 a, f4 b) { return _mm_cmple_ps(a, b); }
+static inline f4 f4_lt(f4 a, f4 b) { return _mm_cmplt_ps(a, b); }
+static inline f4 f4_gt(f4 a, f4 b) { return _mm_cmpgt_ps(a, b); }
+static inline int f4_bits(f4 mask) { return _mm_movemask_ps(mask); }
+#else
+typedef struct { float v[4]; } f4;
+static inline f4 f4_set(float a) { f4 r; for (int i = 0; i < 4; i++) r.v[i] = a; return r; }
+static inline f4 f4_load(const float* p) { f4 r; for (int i = 0; i < 4; i++) r.v[i] = p[i]; return r; }
+static inline void f4_store(float* p, f4 a) { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+static inline f4 f4_add(f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] + b.v[i]; return a; }
+static inline f4 f4_sub(f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] - b.v[i]; return a; }
+static inline f4 f4_mul(f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] * b.v[i]; return a; }
+static inline f4 f4_div(f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] / b.v[i]; return a; }
+// like minps / maxps the second operand wins when either is NaN
+static inline f4 f4_min(f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return a; }
+static inline f4 f4_max(f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return a; }
+static inline f4 f4_select(f4 mask, f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = mask.v[i] != 0.0f ? a.v[i] : b.v[i]; return a; }
+static inline f4 f4_and(f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = (a.v[i] != 0.0f && b.v[i] != 0.0f) ? 1.0f : 0.0f; return a; }
+static inline f4 f4_or(f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = (a.v[i] != 0.0f || b.v[i] != 0.0f) ? 1.0f : 0.0f; return a; }
+static inline f4 f4_le(f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] <= b.v[i] ? 1.0f : 0.0f; return a; }
+static inline f4 f4_lt(f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] < b.v[i] ? 1.0f : 0.0f; return a; }
+static inline f4 f4_gt(f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] > b.v[i] ? 1.0f : 0.0f; return a; }
+static inline int f4_bits(f4 mask) { int bits = 0; for (int i = 0; i < 4; i++) if (mask.v[i] != 0.0f) bits |= 1 << i; return bits; }
+#endif
+
+// 2x2 rays with a common origin
+typedef struct
+{
+	f4 ox, oy, oz;
+	f4 dx, dy, dz;
+	f4 ix, iy, iz;           // 1 / d
+	f4 tmin, t;              // the hits so far are at t, FLT_MAX where there are none
+	f4 u, v;
+	int triangle[4];         // in rt->triangles, -1 for none
+}raytrace_packet_t;
+
+raytrace_t* raytrace_create(int samples)
+{
+	raytrace_t* rt = new raytrace_t;
+	rt->samples = std::max(samples, 1);
+	rt->capturing = 0;
+	rt->shadow = shadow_map_create(SHADOW_TRACED, 0);
+	rt->shadow->tracer = rt;
+	rt->width = rt->height = 0;
+	rt->accumulated = 0;
+	rt->key = 0;
+	memset(&rt->stats, 0, sizeof(rt->stats));
+	return rt;
+}
+
+void raytrace_destory(raytrace_t* rt)
+{
+	if (rt == NULL) return;
+	shadow_map_destory(rt->shadow);
+	delete rt;
+}
+
+void raytrace_begin(raytrace_t* rt)
+{
+	rt->triangles.clear();
+	rt->materials.clear();
+	rt->capturing = 1;
+}
+
+// the same shading state, field by field
+static bool raytrace_material_same(const raytrace_material_t& a, const raytrace_material_t& b)
+{
+	const s_PBR& p = a.instance.pbr;
+	const s_PBR& q = b.instance.pbr;
+	return a.pipeline == b.pipeline && a.count == b.count && a.cull == b.cull && a.instance.gbuffer_pbr == b.instance.gbuffer_pbr
+		&& p.albedo.x == q.albedo.x && p.albedo.y == q.albedo.y && p.albedo.z == q.albedo.z && p.albedo.w == q.albedo.w
+		&& p.metallic == q.metallic && p.roughness == q.roughness && p.ao == q.ao;
+}
+
+void raytrace_add(raytrace_t* rt, device_t* device, const s_vector* world, const for_fs* corners, int count)
+{
+	raytrace_material_t material = {};
+	material.pipeline = device_pipeline(device, count);
+	material.count = count;
+	material.instance.pbr = device->instance != NULL ? device->instance->pbr : device->PBR;
+	material.instance.gbuffer_pbr = -1;
+	material.cull = device->is_cull;
+	// the triangles of a draw share one entry
+	if (rt->materials.empty() || !raytrace_material_same(rt->materials.back(), material)) rt->materials.push_back(material);
+	raytrace_triangle_t tri;
+	for (int i = 0; i < 3; i++)
+	{
+		tri.world[i] = world[i];
+		tri.corners[i] = corners[i];
+	}
+	tri.material = (int)rt->materials.size() - 1;
+	rt->triangles.push_back(tri);
+}
+
+//=====================================================================
+// bvh build: binned surface area heuristic over the triangle centroids
+//=====================================================================
+typedef struct
+{
+	float box_min[3], box_max[3];
+	int count;
+}raytrace_bin_t;
+
+static inline void box_empty(float* box_min, float* box_max)
+{
+	for (int k = 0; k < 3; k++) { box_min[k] = FLT_MAX; box_max[k] = -FLT_MAX; }
+}
+
+static inline void box_grow(float* box_min, float* box_max, const float* p_min, const float* p_max)
+{
+	for (int k = 0; k < 3; k++)
+	{
+		box_min[k] = std::min(box_min[k], p_min[k]);
+		box_max[k] = std::max(box_max[k], p_max[k]);
+	}
+}
+
+static inline float box_area(const float* box_min, const float* box_max)
+{
+	float x = box_max[0] - box_min[0], y = box_max[1] - box_min[1], z = box_max[2] - box_min[2];
+	if (x < 0.0f || y < 0.0f || z < 0.0f) return 0.0f;
+	return x * y + y * z + z * x;
+}
+
+typedef struct
+{
+	std::vector<float> box;      // per triangle min xyz, max xyz
+	std::vector<float> centroid; // per triangle xyz
+	std::vector<int> order;      // the triangles in bvh order
+}raytrace_build_t;
+
+static int bin_of(float c, float lo, float scale)
+{
+	int b = (int)((c - lo) * scale);
+	return std::min(std::max(b, 0), RAYTRACE_BINS - 1);
+}
+
+// node covers order[begin, end) and is depth entries below the root. the traversal stacks hold a pending
+// entry per level, so the ones RAYTRACE_STACK - 1 deep stay leaves whatever they hold
+static void raytrace_split(raytrace_t* rt, raytrace_build_t* build, int node, int begin, int end, int depth)
+{
+	float box_min[3], box_max[3], c_min[3], c_max[3];
+	box_empty(box_min, box_max);
+	box_empty(c_min, c_max);
+	for (int i = begin; i < end; i++)
+	{
+		int t = build->order[i];
+		box_grow(box_min, box_max, &build->box[t * 6], &build->box[t * 6 + 3]);
+		box_grow(c_min, c_max, &build->centroid[t * 3], &build->centroid[t * 3]);
+	}
+	raytrace_node_t& n = rt->nodes[node];
+	memcpy(n.box_min, box_min, sizeof(box_min));
+	memcpy(n.box_max, box_max, sizeof(box_max));
+	n.first = begin;
+	n.count = end - begin;
+	int count = end - begin;
+	if (count <= 1 || depth >= RAYTRACE_STACK - 1) return;
+
+	// cost of a leaf is its triangle count, of a split one traversal step and both sides by area
+	float parent = box_area(box_min, box_max);
+	float best = (float)count;
+	int best_axis = -1, best_bin = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float extent = c_max[axis] - c_min[axis];
+		if (extent <= 0.0f) continue;
+		float scale = RAYTRACE_BINS / extent;
+		raytrace_bin_t bins[RAYTRACE_BINS];
+		for (int b = 0; b < RAYTRACE_BINS; b++) { box_empty(bins[b].box_min, bins[b].box_max); bins[b].count = 0; }
+		for (int i = begin; i < end; i++)
+		{
+			int t = build->order[i];
+			raytrace_bin_t& bin = bins[bin_of(build->centroid[t * 3 + axis], c_min[axis], scale)];
+			box_grow(bin.box_min, bin.box_max, &build->box[t * 6], &build->box[t * 6 + 3]);
+			bin.count++;
+		}
+		// areas and counts of the right side of every boundary, then sweep the left side
+		float right_area[RAYTRACE_BINS];
+		int right_count[RAYTRACE_BINS];
+		float r_min[3], r_max[3];
+		box_empty(r_min, r_max);
+		int r = 0;
+		for (int b = RAYTRACE_BINS - 1; b > 0; b--)
+		{
+			box_grow(r_min, r_max, bins[b].box_min, bins[b].box_max);
+			r += bins[b].count;
+			right_area[b] = box_area(r_min, r_max);
+			right_count[b] = r;
+		}
+		float l_min[3], l_max[3];
+		box_empty(l_min, l_max);
+		int l = 0;
+		for (int b = 1; b < RAYTRACE_BINS; b++)
+		{
+			box_grow(l_min, l_max, bins[b - 1].box_min, bins[b - 1].box_max);
+			l += bins[b - 1].count;
+			if (l == 0 || right_count[b] == 0) continue;
+			float cost = parent > 0.0f ? 1.0f + (box_area(l_min, l_max) * l + right_area[b] * right_count[b]) / parent : (float)count;
+			if (cost < best) { best = cost; best_axis = axis; best_bin = b; }
+		}
+	}
+	int mid;
+	if (best_axis >= 0)
+	{
+		float scale = RAYTRACE_BINS / (c_max[best_axis] - c_min[best_axis]);
+		int* first = &build->order[begin];
+		int* last = &build->order[0] + end;
+		int axis = best_axis;
+		float lo = c_min[axis];
+		mid = (int)(std::partition(first, last, [&](int t) { return bin_of(build->centroid[t * 3 + axis], lo, scale) < best_bin; }) - &build->order[0]);
+	}
+	else if (count > RAYTRACE_LEAF)
+	{
+		// no split is cheaper than the leaf but it holds too many, halve it along the widest axis
+		int axis = 0;
+		for (int k = 1; k < 3; k++) if (c_max[k] - c_min[k] > c_max[axis] - c_min[axis]) axis = k;
+		mid = (begin + end) / 2;
+		std::nth_element(&build->order[begin], &build->order[mid], &build->order[0] + end,
+			[&](int a, int b) { return build->centroid[a * 3 + axis] < build->centroid[b * 3 + axis]; });
+		best_axis = axis;
+	}
+	else return;
+	int left = (int)rt->nodes.size();
+	rt->nodes.resize(left + 2);
+	rt->nodes[node].first = left;
+	rt->nodes[node].count = -1 - best_axis;
+	raytrace_split(rt, build, left, begin, mid, depth + 1);
+	raytrace_split(rt, build, left + 1, mid, end, depth + 1);
+}
+
+static unsigned long long raytrace_hash(unsigned long long h, const void* data, size_t bytes)
+{
+	// FNV-1a
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t i = 0; i < bytes; i++) { h ^= p[i]; h *= 1099511628211ULL; }
+	return h;
+}
+
+void raytrace_end(raytrace_t* rt, device_t* device)
+{
+	rt->capturing = 0;
+	// the captured draws left the frame alone, the clear and the wireframe lines are what the rays miss into
+	rt->background.resize(device->width * device->height);
+	for (int y = 0; y < device->height; y++)
+		memcpy(&rt->background[y * device->width], surface_row_u32(device->color, y), device->width * sizeof(IUINT32));
+	int n = (int)rt->triangles.size();
+	raytrace_build_t build;
+	build.box.resize(n * 6);
+	build.centroid.resize(n * 3);
+	build.order.resize(n);
+	for (int t = 0; t < n; t++)
+	{
+		const s_vector* p = rt->triangles[t].world;
+		float* box = &build.box[t * 6];
+		for (int k = 0; k < 3; k++)
+		{
+			float a = (&p[0].x)[k], b = (&p[1].x)[k], c = (&p[2].x)[k];
+			box[k] = std::min(a, std::min(b, c));
+			box[k + 3] = std::max(a, std::max(b, c));
+			build.centroid[t * 3 + k] = (box[k] + box[k + 3]) * 0.5f;
+		}
+		build.order[t] = t;
+	}
+	rt->nodes.clear();
+	rt->nodes.reserve(std::max(2 * n - 1, 1));
+	rt->nodes.resize(1);
+	if (n > 0) raytrace_split(rt, &build, 0, 0, n, 0);
+	else
+	{
+		box_empty(rt->nodes[0].box_min, rt->nodes[0].box_max);
+		rt->nodes[0].first = rt->nodes[0].count = 0;
+	}
+	rt->edges.resize(n);
+	for (int i = 0; i < n; i++)
+	{
+		int t = build.order[i];
+		const raytrace_triangle_t& tri = rt->triangles[t];
+		const raytrace_material_t& material = rt->materials[tri.material];
+		raytrace_edge_t& e = rt->edges[i];
+		const float* p0 = &tri.world[0].x;
+		const float* p1 = &tri.world[1].x;
+		const float* p2 = &tri.world[2].x;
+		for (int k = 0; k < 3; k++)
+		{
+			e.v0[k] = p0[k];
+			e.e1[k] = p1[k] - p0[k];
+			e.e2[k] = p2[k] - p0[k];
+		}
+		e.triangle = t;
+		e.cull = material.cull;
+		e.caster = material.pipeline->id != SHADER_LIGHT;
+	}
+
+	// the samples so far only count for the same frame
+	unsigned long long key = 14695981039346656037ULL;
+	key = raytrace_hash(key, &device->width, sizeof(device->width));
+	key = raytrace_hash(key, &device->height, sizeof(device->height));
+	key = raytrace_hash(key, &device->viewport_x, sizeof(device->viewport_x));
+	key = raytrace_hash(key, &device->viewport_y, sizeof(device->viewport_y));
+	key = raytrace_hash(key, &device->transform.view, sizeof(s_matrix));
+	key = raytrace_hash(key, &device->transform.projection, sizeof(s_matrix));
+	key = raytrace_hash(key, &device->pointlight[0], sizeof(point_light));
+	key = raytrace_hash(key, &device->now_state, sizeof(device->now_state));
+	if (n > 0) key = raytrace_hash(key, &rt->edges[0], n * sizeof(raytrace_edge_t));
+	for (size_t m = 0; m < rt->materials.size(); m++)
+		key = raytrace_hash(key, &rt->materials[m], sizeof(raytrace_material_t));
+	if (!rt->background.empty()) key = raytrace_hash(key, &rt->background[0], rt->background.size() * sizeof(IUINT32));
+	if (key != rt->key || rt->width != device->width || rt->height != device->height)
+	{
+		rt->key = key;
+		rt->width = device->width;
+		rt->height = device->height;
+		rt->accum.assign(rt->width * rt->height * 3, 0.0f);
+		rt->accumulated = 0;
+	}
+}
+
+//=====================================================================
+// traversal
+//=====================================================================
+#define RAY_CLOSEST 0            // nearest hit, culled faces included
+#define RAY_CULLED  1            // nearest hit of the faces the draws keep
+#define RAY_CASTER  2            // any hit of a shadow caster
+
+// the faces a draw with is_cull culls, det is the determinant of the intersection test. it is
+// positive on the faces the rasterizer keeps with is_cull == 1
+static inline bool raytrace_culled(int cull, float det)
+{
+	if (cull == 1) return det <= 0.0f;
+	if (cull == 2) return det > 0.0f;
+	return false;
+}
+
+static inline float dot3(const float* a, const float* b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+static inline void cross3(float* r, const float* a, const float* b)
+{
+	r[0] = a[1] * b[2] - a[2] * b[1];
+	r[1] = a[2] * b[0] - a[0] * b[2];
+	r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// slab test, true when the ray enters the box before tmax and leaves it after tmin
+static inline bool raytrace_box(const raytrace_node_t& node, const float* origin, const float* inv, float tmin, float tmax)
+{
+	for (int k = 0; k < 3; k++)
+	{
+		float t0 = (node.box_min[k] - origin[k]) * inv[k];
+		float t1 = (node.box_max[k] - origin[k]) * inv[k];
+		if (t0 > t1) std::swap(t0, t1);
+		tmin = t0 > tmin ? t0 : tmin;
+		tmax = t1 < tmax ? t1 : tmax;
+		if (tmin > tmax) return false;
+	}
+	return true;
+}
+
+// one ray, the edge index of the hit or -1
+static int raytrace_trace(const raytrace_t* rt, const float* origin, const float* dir, float tmin, float tmax, int mode, float* t, float* u, float* v, raytrace_stats_t* stats)
+{
+	if (rt->edges.empty()) return -1;
+	float inv[3] = { 1.0f / dir[0], 1.0f / dir[1], 1.0f / dir[2] };
+	int stack[RAYTRACE_STACK];
+	int top = 0;
+	stack[top++] = 0;
+	int hit = -1;
+	float best = tmax;
+	while (top > 0)
+	{
+		const raytrace_node_t& node = rt->nodes[stack[--top]];
+		if (stats != NULL) stats->nodes++;
+		if (!raytrace_box(node, origin, inv, tmin, best)) continue;
+		if (node.count < 0)
+		{
+			// the near child goes on top
+			int axis = -1 - node.count;
+			bool back = dir[axis] < 0.0f;
+			stack[top++] = node.first + (back ? 0 : 1);
+			stack[top++] = node.first + (back ? 1 : 0);
+			continue;
+		}
+		for (int i = node.first; i < node.first + node.count; i++)
+		{
+			const raytrace_edge_t& e = rt->edges[i];
+			if (mode == RAY_CASTER && !e.caster) continue;
+			if (stats != NULL) stats->tests++;
+			float p[3], q[3], s[3];
+			cross3(p, dir, e.e2);
+			float det = dot3(e.e1, p);
+			if (det == 0.0f || (mode == RAY_CULLED && raytrace_culled(e.cull, det))) continue;
+			float inv_det = 1.0f / det;
+			for (int k = 0; k < 3; k++) s[k] = origin[k] - e.v0[k];
+			float a = dot3(s, p) * inv_det;
+			if (a < 0.0f || a > 1.0f) continue;
+			cross3(q, s, e.e1);
+			float b = dot3(dir, q) * inv_det;
+			if (b < 0.0f || a + b > 1.0f) continue;
+			float d = dot3(e.e2, q) * inv_det;
+			if (d <= tmin || d >= best) continue;
+			best = d;
+			hit = i;
+			*u = a;
+			*v = b;
+			if (mode == RAY_CASTER)
+			{
+				*t = d;
+				return hit;
+			}
+		}
+	}
+	*t = best;
+	return hit;
+}
+
+int raytrace_intersect(const raytrace_t* rt, const float* origin, const float* dir, float tmin, float tmax, bool cull, float* t, float* u, float* v)
+{
+	int hit = raytrace_trace(rt, origin, dir, tmin, tmax, cull ? RAY_CULLED : RAY_CLOSEST, t, u, v, NULL);
+	return hit >= 0 ? rt->edges[hit].triangle : -1;
+}
+
+bool raytrace_visible(const raytrace_t* rt, const float* from, const float* to)
+{
+	float dir[3] = { to[0] - from[0], to[1] - from[1], to[2] - from[2] };
+	float t, u, v;
+	// stop just short of the light
+	return raytrace_trace(rt, from, dir, 0.0f, 1.0f - RAYTRACE_EPSILON, RAY_CASTER, &t, &u, &v, NULL) < 0;
+}
+
+// the nearest front faces of the four rays of packet
+static void raytrace_trace_packet(const raytrace_t* rt, raytrace_packet_t* packet, raytrace_stats_t* stats)
+{
+	for (int i = 0; i < 4; i++) packet->triangle[i] = -1;
+	if (rt->edges.empty()) return;
+	float dir_x[4], dir_y[4], dir_z[4];
+	f4_store(dir_x, packet->dx);
+	f4_store(dir_y, packet->dy);
+	f4_store(dir_z, packet->dz);
+	float dir0[3] = { dir_x[0], dir_y[0], dir_z[0] };
+	int stack[RAYTRACE_STACK];
+	int top = 0;
+	stack[top++] = 0;
+	int edge[4] = { -1, -1, -1, -1 };
+	f4 zero = f4_set(0.0f), one = f4_set(1.0f);
+	while (top > 0)
+	{
+		const raytrace_node_t& node = rt->nodes[stack[--top]];
+		stats->nodes++;
+		// the slabs of all four rays at once
+		f4 t0 = f4_mul(f4_sub(f4_set(node.box_min[0]), packet->ox), packet->ix);
+		f4 t1 = f4_mul(f4_sub(f4_set(node.box_max[0]), packet->ox), packet->ix);
+		f4 near = f4_max(f4_min(t0, t1), packet->tmin);
+		f4 far = f4_min(f4_max(t0, t1), packet->t);
+		t0 = f4_mul(f4_sub(f4_set(node.box_min[1]), packet->oy), packet->iy);
+		t1 = f4_mul(f4_sub(f4_set(node.box_max[1]), packet->oy), packet->iy);
+		near = f4_max(f4_min(t0, t1), near);
+		far = f4_min(f4_max(t0, t1), far);
+		t0 = f4_mul(f4_sub(f4_set(node.box_min[2]), packet->oz), packet->iz);
+		t1 = f4_mul(f4_sub(f4_set(node.box_max[2]), packet->oz), packet->iz);
+		near = f4_max(f4_min(t0, t1), near);
+		far = f4_min(f4_max(t0, t1), far);
+		if (f4_bits(f4_le(near, far)) == 0) continue;
+		if (node.count < 0)
+		{
+			// the rays of a packet go the same way, the first one orders the children
+			int axis = -1 - node.count;
+			bool back = dir0[axis] < 0.0f;
+			stack[top++] = node.first + (back ? 0 : 1);
+			stack[top++] = node.first + (back ? 1 : 0);
+			continue;
+		}
+		for (int i = node.first; i < node.first + node.count; i++)
+		{
+			const raytrace_edge_t& e = rt->edges[i];
+			stats->tests++;
+			f4 e1x = f4_set(e.e1[0]), e1y = f4_set(e.e1[1]), e1z = f4_set(e.e1[2]);
+			f4 e2x = f4_set(e.e2[0]), e2y = f4_set(e.e2[1]), e2z = f4_set(e.e2[2]);
+			// p = d x e2, det = e1 . p
+			f4 px = f4_sub(f4_mul(packet->dy, e2z), f4_mul(packet->dz, e2y));
+			f4 py = f4_sub(f4_mul(packet->dz, e2x), f4_mul(packet->dx, e2z));
+			f4 pz = f4_sub(f4_mul(packet->dx, e2y), f4_mul(packet->dy, e2x));
+			f4 det = f4_add(f4_add(f4_mul(e1x, px), f4_mul(e1y, py)), f4_mul(e1z, pz));
+			f4 front = f4_gt(det, zero), back = f4_lt(det, zero);
+			f4 keep = e.cull == 1 ? front : (e.cull == 2 ? back : f4_or(front, back));
+			if (f4_bits(keep) == 0) continue;
+			f4 inv_det = f4_div(one, det);
+			f4 sx = f4_sub(packet->ox, f4_set(e.v0[0]));
+			f4 sy = f4_sub(packet->oy, f4_set(e.v0[1]));
+			f4 sz = f4_sub(packet->oz, f4_set(e.v0[2]));
+			f4 a = f4_mul(f4_add(f4_add(f4_mul(sx, px), f4_mul(sy, py)), f4_mul(sz, pz)), inv_det);
+			// q = s x e1
+			f4 qx = f4_sub(f4_mul(sy, e1z), f4_mul(sz, e1y));
+			f4 qy = f4_sub(f4_mul(sz, e1x), f4_mul(sx, e1z));
+			f4 qz = f4_sub(f4_mul(sx, e1y), f4_mul(sy, e1x));
+			f4 b = f4_mul(f4_add(f4_add(f4_mul(packet->dx, qx), f4_mul(packet->dy, qy)), f4_mul(packet->dz, qz)), inv_det);
+			f4 d = f4_mul(f4_add(f4_add(f4_mul(e2x, qx), f4_mul(e2y, qy)), f4_mul(e2z, qz)), inv_det);
+			keep = f4_and(keep, f4_le(zero, a));
+			keep = f4_and(keep, f4_le(zero, b));
+			keep = f4_and(keep, f4_le(f4_add(a, b), one));
+			keep = f4_and(keep, f4_gt(d, packet->tmin));
+			keep = f4_and(keep, f4_lt(d, packet->t));
+			int bits = f4_bits(keep);
+			if (bits == 0) continue;
+			packet->t = f4_select(keep, d, packet->t);
+			packet->u = f4_select(keep, a, packet->u);
+			packet->v = f4_select(keep, b, packet->v);
+			for (int k = 0; k < 4; k++)
+				if (bits & (1 << k)) edge[k] = i;
+		}
+	}
+	for (int k = 0; k < 4; k++) packet->triangle[k] = edge[k] >= 0 ? rt->edges[edge[k]].triangle : -1;
+}
+
+//=====================================================================
+// shading
+//=====================================================================
+typedef struct
+{
+	raytrace_t* rt;
+	device_t* device;
+	float eye[3];
+	float axis[3][3];            // world space directions of the view x, y and z axes
+	float tmin, tmax;            // the near and far plane along a ray whose view z is 1
+	int tiles_x, tiles_y;
+	int first;                   // sample index of the first sample of the frame
+	std::vector<raytrace_stats_t> stats; // per tile
+}raytrace_frame_t;
+
+// the color a pixel of the frame buffer holds as device_shade_pixel hands it to the shaders as ori_co
+static void raytrace_destination(IUINT32 cc, s_vector& ori)
+{
+	ori.reset(-1.0f, -1.0f, -1.0f, 1.0f);
+	if (cc == 0) return;
+	ori.x = (float)((cc >> 16) & 0xff) / 255.0f;
+	ori.y = (float)((cc >> 8) & 0xff) / 255.0f;
+	ori.z = (float)(cc & 0xff) / 255.0f;
+	ori.w = (float)((cc >> 24) & 0xff) / 255.0f;
+}
+
+static IUINT32 raytrace_pack(const float* rgb)
+{
+	int R = CMID((int)(rgb[0] * 255.0f), 0, 255);
+	int G = CMID((int)(rgb[1] * 255.0f), 0, 255);
+	int B = CMID((int)(rgb[2] * 255.0f), 0, 255);
+	return (R << 16) | (G << 8) | B;
+}
+
+static void raytrace_shade(raytrace_frame_t* frame, int x, int y, const float* dir, int triangle, float t, float u, float v, int depth, float* rgb, raytrace_stats_t* stats);
+
+// the color the ray sees past the hit at t, the background once depth surfaces were passed
+static void raytrace_behind(raytrace_frame_t* frame, int x, int y, const float* dir, float t, int depth, float* rgb, raytrace_stats_t* stats)
+{
+	float tb = 0.0f, ub = 0.0f, vb = 0.0f;
+	int next = -1;
+	if (depth > 0)
+	{
+		stats->rays++;
+		next = raytrace_trace(frame->rt, frame->eye, dir, t + RAYTRACE_EPSILON, frame->tmax, RAY_CULLED, &tb, &ub, &vb, stats);
+	}
+	raytrace_shade(frame, x, y, dir, next >= 0 ? frame->rt->edges[next].triangle : -1, tb, ub, vb, depth - 1, rgb, stats);
+}
+
+// the color of pixel (x, y) the ray brings back from the hit at t on triangle, shaded like
+// device_shade_pixel shades a fragment. a blending texel gets the ray continued behind it as the
+// destination and a discarded fragment lets it through, depth counts the surfaces left to pass
+static void raytrace_shade(raytrace_frame_t* frame, int x, int y, const float* dir, int triangle, float t, float u, float v, int depth, float* rgb, raytrace_stats_t* stats)
+{
+	device_t* device = frame->device;
+	const raytrace_t* rt = frame->rt;
+	if (triangle < 0)
+	{
+		IUINT32 background = rt->background[y * rt->width + x];
+		rgb[0] = ((background >> 16) & 0xff) / 255.0f;
+		rgb[1] = ((background >> 8) & 0xff) / 255.0f;
+		rgb[2] = (background & 0xff) / 255.0f;
+		return;
+	}
+	const raytrace_triangle_t& tri = rt->triangles[triangle];
+	const raytrace_material_t& material = rt->materials[tri.material];
+	for_fs corners[3] = { tri.corners[0], tri.corners[1], tri.corners[2] };
+	for_fs ff;
+	ff_interpolating(&ff, &corners[0], &corners[1], &corners[2], 1.0f - u - v, u, v, VARYING_ALL);
+	for (int k = 0; k < 4; k++) ff.duv[k] = 0.0f;
+	ff.instance = &material.instance;
+	light_list_t* lights = device->lights;
+	ff.lights = (lights != NULL && !lights->lights.empty()) ? light_list_tile(lights, x, y) : NULL;
+	ff.occlusion = 1.0f;
+	int count = material.count;
+	s_vector ori;
+	raytrace_destination(0, ori);
+	float behind[3];
+	bool traced = false;
+	if (f_shader_reads_destination(device, &ff, count))
+	{
+		raytrace_behind(frame, x, y, dir, t, depth, behind, stats);
+		raytrace_destination(raytrace_pack(behind), ori);
+		traced = true;
+	}
+	s_color color(0.0f, 0.0f, 0.0f, 1.0f);
+	bool ban = 0;
+	material.pipeline->fragment(device, &ff, color, count, ban, ori);
+	if (ban && count != 2 && !(device->render_state & RENDER_STATE_COLOR))
+	{
+		if (!traced) raytrace_behind(frame, x, y, dir, t, depth, behind, stats);
+		memcpy(rgb, behind, sizeof(behind));
+		return;
+	}
+	rgb[0] = CMID(color.r, 0.0f, 1.0f);
+	rgb[1] = CMID(color.g, 0.0f, 1.0f);
+	rgb[2] = CMID(color.b, 0.0f, 1.0f);
+}
+
+static float raytrace_halton(int index, int base)
+{
+	float f = 1.0f, r = 0.0f;
+	while (index > 0)
+	{
+		f /= base;
+		r += f * (index % base);
+		index /= base;
+	}
+	return r;
+}
+
+// the world space direction through (px, py) in pixels, its view z is 1
+static void raytrace_direction(const raytrace_frame_t* frame, float px, float py, float* dir)
+{
+	const device_t* device = frame->device;
+	const s_matrix& p = device->transform.projection;
+	float nx = (px + device->viewport_x) / device->transform.w * 2.0f - 1.0f, ny = 1.0f - (py + device->viewport_y) / device->transform.h * 2.0f;
+	float view[3] = { (nx - p.m[2][0]) / p.m[0][0], (ny - p.m[2][1]) / p.m[1][1], 1.0f };
+	for (int i = 0; i < 3; i++)
+		dir[i] = view[0] * frame->axis[0][i] + view[1] * frame->axis[1][i] + view[2] * frame->axis[2][i];
+}
+
+// job of raytrace_render, the tiles [begin, end)
+static void raytrace_tile_job(void* data, int begin, int end)
+{
+	raytrace_frame_t* frame = (raytrace_frame_t*)data;
+	raytrace_t* rt = frame->rt;
+	device_t* device = frame->device;
+	for (int tile = begin; tile < end; tile++)
+	{
+		raytrace_stats_t* stats = &frame->stats[tile];
+		int x0 = (tile % frame->tiles_x) * RAYTRACE_TILE, y0 = (tile / frame->tiles_x) * RAYTRACE_TILE;
+		int x1 = std::min(x0 + RAYTRACE_TILE, device->width), y1 = std::min(y0 + RAYTRACE_TILE, device->height);
+		for (int s = 0; s < rt->samples; s++)
+		{
+			// the first sample is the pixel center the rasterizer takes, the others spread over the pixel
+			int index = frame->first + s;
+			float jx = index == 0 ? 0.5f : raytrace_halton(index, 2);
+			float jy = index == 0 ? 0.5f : raytrace_halton(index, 3);
+			for (int y = y0; y < y1; y += 2)
+			{
+				for (int x = x0; x < x1; x += 2)
+				{
+					// a 2x2 packet, lanes outside the frame trace the pixel of lane 0
+					float d[3][4];
+					int lx[4], ly[4];
+					for (int k = 0; k < 4; k++)
+					{
+						lx[k] = x + (k & 1);
+						ly[k] = y + (k >> 1);
+						if (lx[k] >= x1 || ly[k] >= y1) { lx[k] = x; ly[k] = y; }
+						float dir[3];
+						raytrace_direction(frame, lx[k] + jx, ly[k] + jy, dir);
+						d[0][k] = dir[0]; d[1][k] = dir[1]; d[2][k] = dir[2];
+					}
+					raytrace_packet_t packet;
+					packet.ox = f4_set(frame->eye[0]);
+					packet.oy = f4_set(frame->eye[1]);
+					packet.oz = f4_set(frame->eye[2]);
+					packet.dx = f4_load(d[0]);
+					packet.dy = f4_load(d[1]);
+					packet.dz = f4_load(d[2]);
+					f4 one = f4_set(1.0f);
+					packet.ix = f4_div(one, packet.dx);
+					packet.iy = f4_div(one, packet.dy);
+					packet.iz = f4_div(one, packet.dz);
+					packet.tmin = f4_set(frame->tmin);
+					packet.t = f4_set(frame->tmax);
+					packet.u = packet.v = f4_set(0.0f);
+					raytrace_trace_packet(rt, &packet, stats);
+					stats->rays += 4;
+					float t[4], u[4], v[4];
+					f4_store(t, packet.t);
+					f4_store(u, packet.u);
+					f4_store(v, packet.v);
+					for (int k = 0; k < 4; k++)
+					{
+						if (k > 0 && lx[k] == x && ly[k] == y) continue;
+						float dir[3] = { d[0][k], d[1][k], d[2][k] };
+						float rgb[3];
+						raytrace_shade(frame, lx[k], ly[k], dir, packet.triangle[k], t[k], u[k], v[k], RAYTRACE_DEPTH, rgb, stats);
+						float* sum = &rt->accum[(ly[k] * rt->width + lx[k]) * 3];
+						sum[0] += rgb[0]; sum[1] += rgb[1]; sum[2] += rgb[2];
+					}
+				}
+			}
+		}
+		// the average of every sample so far
+		float weight = 1.0f / (rt->accumulated + rt->samples);
+		for (int y = y0; y < y1; y++)
+		{
+			IUINT32* row = surface_row_u32(device->color, y);
+			for (int x = x0; x < x1; x++)
+			{
+				const float* sum = &rt->accum[(y * rt->width + x) * 3];
+				float rgb[3] = { sum[0] * weight, sum[1] * weight, sum[2] * weight };
+				row[x] = raytrace_pack(rgb);
+			}
+		}
+	}
+}
+
+void raytrace_render(raytrace_t* rt, device_t* device)
+{
+	raytrace_frame_t frame;
+	frame.rt = rt;
+	frame.device = device;
+	// the view matrix is a rotation R and a translation t, the eye is -t R^T and the view axes are the rows of R^T
+	const s_matrix& view = device->transform.view;
+	for (int i = 0; i < 3; i++)
+	{
+		frame.eye[i] = -(view.m[3][0] * view.m[i][0] + view.m[3][1] * view.m[i][1] + view.m[3][2] * view.m[i][2]);
+		for (int k = 0; k < 3; k++) frame.axis[k][i] = view.m[i][k];
+	}
+	// clip z = z m22 + m32 runs from 0 at the near plane to w = z at the far one
+	const s_matrix& p = device->transform.projection;
+	frame.tmin = -p.m[3][2] / p.m[2][2];
+	frame.tmax = p.m[3][2] / (1.0f - p.m[2][2]);
+	frame.tiles_x = (device->width + RAYTRACE_TILE - 1) / RAYTRACE_TILE;
+	frame.tiles_y = (device->height + RAYTRACE_TILE - 1) / RAYTRACE_TILE;
+	frame.first = rt->accumulated;
+	int tiles = frame.tiles_x * frame.tiles_y;
+	raytrace_stats_t empty = { 0, 0, 0 };
+	frame.stats.assign(tiles, empty);
+	// the shaders look up pointlight[0] through the traced map and the tiles of the light list
+	shadow_map_t* shadow = device->shadow;
+	rt->shadow->light = device->pointlight[0].lightpos;
+	device->shadow = rt->shadow;
+	if (device->lights != NULL) light_list_update(device->lights, device, device->arena);
+	job_parallel_for(job_system(), 0, tiles, 1, raytrace_tile_job, &frame);
+	device->shadow = shadow;
+	rt->accumulated += rt->samples;
+	rt->stats = empty;
+	for (int i = 0; i < tiles; i++)
+	{
+		rt->stats.rays += frame.stats[i].rays;
+		rt->stats.nodes += frame.stats[i].nodes;
+		rt->stats.tests += frame.stats[i].tests;
+	}
+}
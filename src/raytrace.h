@@ -0,0 +1,111 @@
+#ifndef raytrace_h
+#define raytrace_h
+//=====================================================================
+// ray traced frames of the scene the rasterizer draws. with it on the
+// draws between device_clear and device_resolve only hand their world
+// space triangles and shading state over, device_resolve builds a SAH
+// bounding volume hierarchy over them and traces the frame tile by tile
+// on the job system, 2x2 primary rays per SIMD packet. hits are shaded
+// by the fragment shader of the pipeline the triangle was drawn with,
+// so materials, textures and BRDF are those of f_shader, the shadows of
+// pointlight[0] are traced and transparent texels blend over the ray
+// continued behind them. frames of the same scene and camera add their
+// jittered samples to the ones before, so a still converges.
+//=====================================================================
+#include "render.h"
+#include "shadow.h"
+#include <vector>
+
+#define RAYTRACE_BINS     16     // SAH split candidates per axis
+#define RAYTRACE_LEAF     4      // triangles a leaf holds at most
+#define RAYTRACE_DEPTH    4      // transparent surfaces a ray passes through
+#define RAYTRACE_TILE     16     // pixels per side of the tile a job traces
+#define RAYTRACE_EPSILON  1e-4f  // world units a continued ray starts behind its last hit
+
+// the shading state of a run of captured triangles
+typedef struct
+{
+	const pipeline_t* pipeline;  // device_pipeline of the draw
+	int count;                   // material index passed to the fragment shader
+	instance_t instance;         // device->PBR or the instance of the draw, for_fs::instance points here
+	int cull;                    // device->is_cull of the draw, primary rays skip the faces it culls
+}raytrace_material_t;
+
+// a captured triangle, the corners as the vertex shader left them
+typedef struct
+{
+	s_vector world[3];           // positions of the corners
+	for_fs corners[3];
+	int material;                // raytrace_material_t
+}raytrace_triangle_t;
+
+// a bvh entry, 32 bytes
+typedef struct
+{
+	float box_min[3];
+	int first;                   // leaf: its first entry of edges, inner: the left child, the right one follows it
+	float box_max[3];
+	int count;                   // leaf: triangles, inner: -1 - the axis it was split along
+}raytrace_node_t;
+
+// a triangle in bvh order as the intersection tests read it
+typedef struct
+{
+	float v0[3], e1[3], e2[3];   // world space v0, v1 - v0, v2 - v0
+	int triangle;                // in triangles
+	int cull;                    // is_cull of its draw
+	int caster;                  // 0 for the light cubes, they don't shadow their own light
+}raytrace_edge_t;
+
+// counters of the last raytrace_render
+typedef struct
+{
+	long long rays;              // primary and continued rays, shadow rays not included
+	long long nodes;             // bvh entries the rays and packets visited
+	long long tests;             // ray triangle tests, a packet test counts once
+}raytrace_stats_t;
+
+struct raytrace_t
+{
+	int samples;                 // per pixel and device_resolve
+	int capturing;               // between device_clear and device_resolve
+	std::vector<raytrace_triangle_t> triangles;
+	std::vector<raytrace_material_t> materials;
+	std::vector<raytrace_node_t> nodes;
+	std::vector<raytrace_edge_t> edges;
+	shadow_map_t* shadow;        // SHADOW_TRACED map bound while the frame is shaded
+	int width, height;
+	std::vector<float> accum;    // rgb sums of every pixel
+	std::vector<IUINT32> background; // the frame at raytrace_end, the clear and the draws not captured
+	int accumulated;             // samples in accum
+	unsigned long long key;      // of the scene and camera of accum
+	raytrace_stats_t stats;      // of the last raytrace_render
+};
+
+// samples per pixel and frame, at least 1
+raytrace_t* raytrace_create(int samples);
+
+void raytrace_destory(raytrace_t* rt);
+
+// forget the triangles, the following draws of the device are captured until raytrace_end
+void raytrace_begin(raytrace_t* rt);
+
+// one triangle with the state of the current draw of device: the world space positions of its corners
+// and what the vertex shader made of them
+void raytrace_add(raytrace_t* rt, device_t* device, const s_vector* world, const for_fs* corners, int count);
+
+// stop capturing and build the bvh, the samples start over when the scene or the camera changed
+void raytrace_end(raytrace_t* rt, device_t* device);
+
+// trace rt->samples more samples per pixel and write the average into device->color
+void raytrace_render(raytrace_t* rt, device_t* device);
+
+// the nearest triangle the ray from origin along dir hits in (tmin, tmax), -1 for none. t, u and v
+// get the ray parameter and the weights of corners 1 and 2. cull skips the faces the captured
+// materials cull
+int raytrace_intersect(const raytrace_t* rt, const float* origin, const float* dir, float tmin, float tmax, bool cull, float* t, float* u, float* v);
+
+// true when no triangle but those of the light cubes is between from and to
+bool raytrace_visible(const raytrace_t* rt, const float* from, const float* to);
+
+#endif
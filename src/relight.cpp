@@ -0,0 +1,62 @@
+#include "relight.h"
+
+relight_t* relight_create()
+{
+	relight_t* relight = new relight_t();
+	relight->recording = 0;
+	relight->probing = 0;
+	relight->kept = 0;
+	relight->key = 0;
+	relight->probe = 0;
+	relight->clear_mode = 0;
+	relight->relit = 0;
+	relight->drawn = 0;
+	return relight;
+}
+
+void relight_destory(relight_t* relight)
+{
+	delete relight;
+}
+
+void relight_fold(relight_t* relight, const void* data, size_t bytes)
+{
+	// FNV-1a like surface_hash
+	const unsigned char* p = (const unsigned char*)data;
+	unsigned long long h = relight->probe;
+	for (size_t i = 0; i < bytes; i++) h = (h ^ p[i]) * 0x100000001b3ULL;
+	relight->probe = h;
+}
+
+void relight_keep(relight_t* relight, const gbuffer_t* gbuffer)
+{
+	relight->key = relight->probe;
+	relight->counts = gbuffer->counts;
+	relight->kept_pbr.swap(relight->probe_pbr);
+	relight->probe_pbr.clear();
+	relight->kept = 1;
+}
+
+bool relight_restore(relight_t* relight, gbuffer_t* gbuffer)
+{
+	const std::vector<s_PBR>& from = relight->kept_pbr;
+	const std::vector<s_PBR>& to = relight->probe_pbr;
+	if (from.size() != to.size() || gbuffer->counts.size() != relight->counts.size()) return false;
+	// every entry of the table was the constants of some draw, it takes the new ones of that draw
+	std::vector<s_PBR> table = gbuffer->pbr;
+	for (size_t e = 0; e < table.size(); e++)
+	{
+		const s_PBR* found = NULL;
+		for (size_t i = 0; i < from.size(); i++)
+		{
+			if (!gbuffer_pbr_equal(from[i], gbuffer->pbr[e])) continue;
+			if (found != NULL && !gbuffer_pbr_equal(*found, to[i])) return false;
+			found = &to[i];
+		}
+		if (found != NULL) table[e] = *found;
+	}
+	gbuffer->pbr.swap(table);
+	gbuffer->counts = relight->counts;
+	relight->kept_pbr = relight->probe_pbr;
+	return true;
+}
@@ -0,0 +1,48 @@
+#ifndef relight_h
+#define relight_h
+//=====================================================================
+// lighting only frames: a deferred frame keeps its G-buffer after it
+// is resolved, with a key of what its draws put in it: the vertices,
+// the world and view projection of every draw, the pipeline and the
+// target size. the next frame runs its draws as a probe that only folds
+// them into a key. when the key is the kept one, geometry and camera
+// are unchanged and the kept G-buffer is shaded again with the current
+// lights, m1, m2 and material constants instead of being drawn again.
+// the material constants of the samples follow the draws they came
+// from, so two draws that shared them can't be told apart when only
+// one of them changes, and such a frame is drawn.
+//=====================================================================
+#include "render.h"
+#include "gbuffer.h"
+#include <vector>
+
+struct relight_t
+{
+	int recording;           // the frame since device_clear is drawn, its draws are folded into probe
+	int probing;             // the draws only fold themselves into probe, see device_relight_begin
+	int kept;                // the G-buffer holds the frame of key
+	unsigned long long key;  // of the draws of the kept frame
+	unsigned long long probe; // of the draws since device_clear or device_relight_begin
+	int clear_mode;          // of the device_clear of the kept frame
+	std::vector<int> counts; // gbuffer_t::counts of the kept frame, resolving empties them
+	std::vector<s_PBR> kept_pbr;   // device->PBR or the instance of every draw of the kept frame
+	std::vector<s_PBR> probe_pbr;  // the same for the draws since the probe began
+	int relit;               // frames shaded from the kept G-buffer
+	int drawn;               // probes that found a change
+};
+
+relight_t* relight_create();
+
+void relight_destory(relight_t* relight);
+
+// fold bytes into the key of the frame
+void relight_fold(relight_t* relight, const void* data, size_t bytes);
+
+// after the frame of recording is in gbuffer and before it is resolved: keep it
+void relight_keep(relight_t* relight, const gbuffer_t* gbuffer);
+
+// after a probe whose key is the kept one: put the kept frame back into gbuffer with the material
+// constants of the probe, false when they can't be mapped onto its samples
+bool relight_restore(relight_t* relight, gbuffer_t* gbuffer);
+
+#endif
@@ -11,36 +11,61 @@
 #include<cmath>
 #include<iostream>
 #include <cassert>
+#include <cfloat>
+#include <map>
 #include "s_math.h"
 #include "rasterize.h"
 #include "render.h"
+#include "tile.h"
+#include "gbuffer.h"
+#include "transparent.h"
+#include "light.h"
+#include "shadow.h"
+#include "ibl.h"
+#include "shade_packet.h"
+#include "hiz.h"
+#include "s_simd.h"
+#include "texture.h"
+#include "gamma.h"
+#include "brdf.h"
+#include "scene_assets.h"
+#include "raytrace.h"
+#include "upscale.h"
+#include "profile.h"
+#include "msaa.h"
+#include "taa.h"
+#include "relight.h"
+#include "hdr.h"
+#include "post.h"
+#include "ssao.h"
+#include "coarse.h"
+#include "multiview.h"
+#include "arena.h"
+#include "job.h"
+#include "mesh_lod.h"
+#include "occlusion.h"
+#include "memory_track.h"
 using namespace std;
 const float PI = 3.14159265359;
 //豸ʼfbΪⲿ֡棬NULLⲿ֡ 
 void device_init(device_t* device, int width, int height, void* fb)
 {
-	int need = sizeof(void*) * (height * 2 + 1024) + width * height * 8;
-	char* ptr = (char*)malloc(need + 64);
-	char* framebuf, * zbuf;
-	int j;
-	assert(ptr);
-	device->v_m_num = 0;
+	// the render targets are surfaces, this block only holds the texture row tables
+	// and the 2x2 default texture behind them
+	int need = sizeof(void*) * 1024 + 64;
+	char* ptr = (char*)memory_alloc(MEMORY_TEXTURES, need, 0);
 	device->is_cull = 1;
-	device->framebuffer = (IUINT32**)ptr;
-	device->zbuffer = (float**)(ptr + sizeof(void*) * height);
-	ptr += sizeof(void*) * height * 2;
+	device->table_block = ptr;
+	device->output = surface_create(width, height, SURFACE_FORMAT_XRGB32, fb, width * 4);
+	device->color = device->output;
+	device->output_width = width;
+	device->output_height = height;
+	device->render_scale = 1.0f;
+	device->upscale_filter = UPSCALE_BILINEAR;
+	device->depth = surface_create(width, height, SURFACE_FORMAT_DEPTH32, NULL, 0);
 	device->texture_di = (IUINT32**)ptr;
 	device->texture = (IUINT32**)ptr;
 	ptr += sizeof(void*) * 1024;
-	framebuf = (char*)ptr;
-	zbuf = (char*)ptr + width * height * 4;
-	ptr += width * height * 8;
-	if (fb != NULL) framebuf = (char*)fb;
-	for (j = 0; j < height; j++)
-	{
-		device->framebuffer[j] = (IUINT32*)(framebuf + width * 4 * j);
-		device->zbuffer[j] = (float*)(zbuf + width * 4 * j);
-	}
 	device->texture_di[0] = (IUINT32*)ptr;
 	device->texture_di[1] = (IUINT32*)(ptr + 16);
 	device->texture[0] = (IUINT32*)ptr;
@@ -58,16 +83,386 @@ void device_init(device_t* device, int width, int height, void* fb)
 	device->transform.init(width, height);
 	//transform_init(&device->transform, width, height);
 	device->render_state = RENDER_STATE_WIREFRAME;
+	device->tile_threads = 0;
+	device->tiler = NULL;
+	device->instance = NULL;
+	device->raster_mode = RASTER_MODE_SCANLINE;
+	device->gbuffer = NULL;
+	device->msaa_samples = 1;
+	device->msaa = NULL;
+	device->taa = NULL;
+	device->arena = arena_create(ARENA_BLOCK);
+	device->transparent = NULL;
+	device->lights = NULL;
+	device->shadow = NULL;
+	device->shadow_pass = 0;
+	device->ibl = NULL;
+	device->raster_pass = RASTER_PASS_COLOR;
+	device->hiz = hiz_create(width, height);
+	device->occlusion = NULL;
+	device->pipeline = NULL;
+	memset(&device->cull_stats, 0, sizeof(device->cull_stats));
+	device->texture_filter = TEXTURE_FILTER_NEAREST;
+	device->brdf_mode = BRDF_MODE_EXACT;
+	device->texture_layout = TEXTURE_LAYOUT_LINEAR;
+	device->varyings = VARYING_ALL;
+	gamma_init();
+	device->assets = scene_assets_create();
+	device->owns_assets = 1;
+	device->profile = NULL;
+	device->lod_density = 0.0f;
+	device->raytrace = NULL;
+	device->relight = NULL;
+	device->hdr = NULL;
+	device->post = NULL;
+	device->ssao = NULL;
+	device->coarse = NULL;
+	device->multiview = NULL;
+	device->pretransform = NULL;
+	device->frame_width = width;
+	device->frame_height = height;
+	device->region_x = 0;
+	device->region_y = 0;
+	device->viewport_x = 0.0f;
+	device->viewport_y = 0.0f;
 }
 // ɾ豸
 void device_destory(device_t* device)
 {
-	if (device->framebuffer)
-		free(device->framebuffer);
-	device->framebuffer = NULL;
-	device->zbuffer = NULL;
+	tile_context_destory(device->tiler);
+	device->tiler = NULL;
+	gbuffer_destory(device->gbuffer);
+	device->gbuffer = NULL;
+	msaa_destory(device->msaa);
+	device->msaa = NULL;
+	taa_destory(device->taa);
+	device->taa = NULL;
+	arena_destory(device->arena);
+	device->arena = NULL;
+	transparent_list_destory(device->transparent);
+	device->transparent = NULL;
+	light_list_destory(device->lights);
+	device->lights = NULL;
+	if (device->color != device->output) surface_destory(device->color);
+	surface_destory(device->output);
+	surface_destory(device->depth);
+	device->color = NULL;
+	device->output = NULL;
+	device->depth = NULL;
+	hdr_destory(device->hdr);
+	device->hdr = NULL;
+	post_destory(device->post);
+	device->post = NULL;
+	ssao_destory(device->ssao);
+	device->ssao = NULL;
+	coarse_destory(device->coarse);
+	device->coarse = NULL;
+	hiz_destory(device->hiz);
+	device->hiz = NULL;
+	occlusion_destory(device->occlusion);
+	device->occlusion = NULL;
+	raytrace_destory(device->raytrace);
+	device->raytrace = NULL;
+	relight_destory(device->relight);
+	device->relight = NULL;
+	if (device->owns_assets) scene_assets_destory(device->assets);
+	device->assets = NULL;
+	profile_destory(device->profile);
+	device->profile = NULL;
+	if (device->table_block)
+		memory_free(device->table_block);
+	device->table_block = NULL;
 	device->texture = NULL;
 }
+
+void device_share_assets(device_t* device, const device_t* source)
+{
+	if (device->owns_assets) scene_assets_destory(device->assets);
+	device->assets = source->assets;
+	device->owns_assets = 0;
+	memcpy(device->pointlight, source->pointlight, sizeof(device->pointlight));
+	memcpy(&device->PBR, &source->PBR, sizeof(device->PBR));
+	device->ibl = source->ibl;
+	device->render_state = source->render_state;
+	device->raster_mode = source->raster_mode;
+	device->texture_filter = source->texture_filter;
+	device->brdf_mode = source->brdf_mode;
+	device->lod_density = source->lod_density;
+	device_set_occlusion(device, source->occlusion != NULL);
+	device_set_raytrace(device, source->raytrace != NULL ? source->raytrace->samples : 0);
+	device->upscale_filter = source->upscale_filter;
+	device_set_msaa(device, source->msaa_samples);
+	if (device->depth->format != source->depth->format) device_set_depth_format(device, source->depth->format);
+	device_set_render_scale(device, source->render_scale);
+}
+
+void device_set_framebuffer(device_t* device, void* fb, int pitch)
+{
+	surface_t* output = device->output;
+	// a wrapper of external memory is only pointed elsewhere, so swapping buffers every frame allocates nothing
+	if (fb != NULL && output->block == NULL)
+	{
+		output->pixels = (unsigned char*)fb;
+		output->pitch = pitch > 0 ? pitch : output->width * output->bpp;
+		return;
+	}
+	device->output = surface_create(device->output_width, device->output_height, SURFACE_FORMAT_XRGB32, fb, pitch);
+	if (device->color == output) device->color = device->output;
+	surface_destory(output);
+}
+
+// the frame and the corner of the region in pixels of color, which is the output at the render scale
+static void device_update_viewport(device_t* device)
+{
+	float sx = (float)device->width / device->output_width, sy = (float)device->height / device->output_height;
+	device->transform.w = device->frame_width * sx;
+	device->transform.h = device->frame_height * sy;
+	device->viewport_x = device->region_x * sx;
+	device->viewport_y = device->region_y * sy;
+}
+
+void device_set_render_scale(device_t* device, float scale)
+{
+	if (scale < RENDER_SCALE_MIN) scale = RENDER_SCALE_MIN;
+	if (scale > 1.0f) scale = 1.0f;
+	device->render_scale = scale;
+	int width = (int)(device->output_width * scale + 0.5f);
+	int height = (int)(device->output_height * scale + 0.5f);
+	if (width < 1) width = 1;
+	if (height < 1) height = 1;
+	if (width == device->width && height == device->height) return;
+	device->width = width;
+	device->height = height;
+	if (device->color != device->output) surface_destory(device->color);
+	if (width == device->output_width && height == device->output_height) device->color = device->output;
+	else device->color = surface_create(width, height, SURFACE_FORMAT_XRGB32, NULL, 0);
+	device_set_depth_format(device, device->depth->format);
+	if (device->hiz != NULL)
+	{
+		hiz_destory(device->hiz);
+		device->hiz = hiz_create(width, height);
+	}
+	// the next device_clear makes a G-buffer of the new size
+	gbuffer_destory(device->gbuffer);
+	device->gbuffer = NULL;
+	msaa_destory(device->msaa);
+	device->msaa = NULL;
+	if (device->taa != NULL)
+	{
+		taa_destory(device->taa);
+		device->taa = taa_create(width, height);
+	}
+	if (device->tiler != NULL) device_set_tile_mode(device, device->tile_threads);
+	if (device->lights != NULL)
+	{
+		light_list_t* lights = light_list_create(width, height);
+		lights->lights.swap(device->lights->lights);
+		light_list_destory(device->lights);
+		device->lights = lights;
+	}
+	device_update_viewport(device);
+}
+
+void device_set_region(device_t* device, int frame_width, int frame_height, int x, int y)
+{
+	int width = device->output_width, height = device->output_height;
+	if (frame_width <= 0 || frame_height <= 0)
+	{
+		frame_width = width;
+		frame_height = height;
+		x = y = 0;
+	}
+	device->frame_width = frame_width;
+	device->frame_height = frame_height;
+	device->region_x = x;
+	device->region_y = y;
+	// the perspective of s_transform::init for the frame
+	set_perspective_matrix(device->transform.projection, 3.1415926f * 0.25f, (float)frame_width / (float)frame_height, 1.0f, 500.0f);
+	device->transform.update();
+	device_update_viewport(device);
+}
+
+void device_set_upscale_filter(device_t* device, int filter)
+{
+	device->upscale_filter = filter;
+}
+
+void device_present(device_t* device)
+{
+	if (device->color == device->output) return;
+	PROFILE_SCOPE(device, PROFILE_STAGE_PRESENT);
+	surface_upscale(device->output, device->color, device->upscale_filter);
+}
+
+void device_set_profile(device_t* device, int enable)
+{
+	if (!PROFILE_ENABLED) return;
+	if (enable && device->profile == NULL) device->profile = profile_create();
+	if (!enable)
+	{
+		profile_destory(device->profile);
+		device->profile = NULL;
+	}
+}
+
+void device_set_depth_format(device_t* device, int format)
+{
+	surface_destory(device->depth);
+	device->depth = surface_create(device->width, device->height, format, NULL, 0);
+	if (device->hiz != NULL) hiz_clear(device->hiz);
+}
+
+void device_set_hiz(device_t* device, int enable)
+{
+	if (enable && device->hiz == NULL) device->hiz = hiz_create(device->width, device->height);
+	if (!enable)
+	{
+		hiz_destory(device->hiz);
+		device->hiz = NULL;
+	}
+}
+
+void device_set_lod(device_t* device, int enable)
+{
+	device->lod_density = enable ? MESH_LOD_DENSITY : 0.0f;
+}
+
+void device_set_occlusion(device_t* device, int enable)
+{
+	if (enable && device->occlusion == NULL) device->occlusion = occlusion_create(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+	if (!enable)
+	{
+		occlusion_destory(device->occlusion);
+		device->occlusion = NULL;
+	}
+}
+
+void device_set_raytrace(device_t* device, int samples)
+{
+	// the same tracer keeps the samples accumulated so far
+	if (device->raytrace != NULL && device->raytrace->samples == samples) return;
+	raytrace_destory(device->raytrace);
+	device->raytrace = samples > 0 ? raytrace_create(samples) : NULL;
+}
+
+void device_set_msaa(device_t* device, int samples)
+{
+	device->msaa_samples = samples > 1 ? MSAA_SAMPLES : 1;
+	if (device->msaa_samples == 1)
+	{
+		msaa_destory(device->msaa);
+		device->msaa = NULL;
+	}
+}
+
+void device_set_taa(device_t* device, int enable)
+{
+	if (enable && device->taa == NULL) device->taa = taa_create(device->width, device->height);
+	else if (enable) taa_reset(device->taa);
+	if (!enable)
+	{
+		taa_destory(device->taa);
+		device->taa = NULL;
+	}
+}
+
+void device_set_relight(device_t* device, int enable)
+{
+	if (enable && device->relight == NULL) device->relight = relight_create();
+	if (!enable)
+	{
+		relight_destory(device->relight);
+		device->relight = NULL;
+	}
+}
+
+void device_set_hdr(device_t* device, int enable)
+{
+	if (enable && device->hdr == NULL) device->hdr = hdr_create();
+	if (!enable)
+	{
+		hdr_destory(device->hdr);
+		device->hdr = NULL;
+	}
+}
+
+void device_set_exposure(device_t* device, float exposure)
+{
+	if (device->hdr != NULL) device->hdr->exposure = exposure;
+}
+
+void device_set_post(device_t* device, int effects)
+{
+	if (effects && device->post == NULL) device->post = post_create();
+	if (!effects)
+	{
+		post_destory(device->post);
+		device->post = NULL;
+		return;
+	}
+	device->post->effects = effects;
+}
+
+void device_set_ssao(device_t* device, int enable)
+{
+	if (enable && device->ssao == NULL) device->ssao = ssao_create();
+	if (!enable)
+	{
+		ssao_destory(device->ssao);
+		device->ssao = NULL;
+	}
+}
+
+void device_set_shading_rate(device_t* device, int mode)
+{
+	if (mode == SHADING_RATE_OFF)
+	{
+		coarse_destory(device->coarse);
+		device->coarse = NULL;
+		return;
+	}
+	if (device->coarse == NULL) device->coarse = coarse_create();
+	device->coarse->mode = mode;
+}
+
+void device_set_shading_rate_image(device_t* device, const unsigned char* rates, int tiles_x, int tiles_y)
+{
+	if (device->coarse == NULL) device->coarse = coarse_create();
+	coarse_t* coarse = device->coarse;
+	coarse->image.clear();
+	coarse->tiles_x = coarse->tiles_y = 0;
+	if (rates == NULL) return;
+	coarse->image.assign(rates, rates + tiles_x * tiles_y);
+	coarse->tiles_x = tiles_x;
+	coarse->tiles_y = tiles_y;
+}
+
+arena_t* device_scratch(device_t* device)
+{
+	arena_t* arena = tile_arena();
+	return arena != NULL ? arena : device->arena;
+}
+
+void device_set_texture_filter(device_t* device, int filter)
+{
+	device->texture_filter = filter;
+}
+
+void device_set_brdf_mode(device_t* device, int mode)
+{
+	device->brdf_mode = mode;
+}
+
+void device_set_texture_layout(device_t* device, int layout)
+{
+	device->texture_layout = layout;
+}
+
+// the coarse depth if it can be used with the current depth surface
+static inline hiz_t* device_hiz(device_t* device)
+{
+	return device->depth->format == SURFACE_FORMAT_DEPTH32 ? device->hiz : NULL;
+}
 //õǰ 
 void device_set_texture(device_t* device, void* bits, long pitch, int w, int h)
 {
@@ -106,192 +501,67 @@ void device_set_texture_by_photo(device_t* device, IUINT32** texture, long pitch
 }
 void device_set_texture_by_diffuse(device_t* device, IUINT32** texture, long pitch, int w, int h, int count)
 {
-
-
-
-	//memset(device->texture[0], 0, 64);
-	device->material[count].diffuse_texture.tex_width = 2;
-	device->material[count].diffuse_texture.tex_height = 2;
-	device->material[count].diffuse_texture.max_u = 1.0f;
-	device->material[count].diffuse_texture.max_v = 1.0f;
-	int n = h; int m = w;
-	device->material[count].diffuse_texture.texture = NULL;
-	device->material[count].diffuse_texture.texture = new IUINT32 * [n];
-
-	for (int i = 0; i < n; i++)
-		device->material[count].diffuse_texture.texture[i] = new IUINT32[m];
-
-
-
 	assert(w <= 1024 && h <= 1024);
-	for (int i = 0; i < h; i++)
-	{
-		for (int j = 0; j < w; j++)
-			device->material[count].diffuse_texture.texture[i][j] = texture[i][j];
-	}
-	device->material[count].diffuse_texture.tex_width = w;
-	device->material[count].diffuse_texture.tex_height = h;
-	device->material[count].diffuse_texture.max_u = (float)(w - 1);
-	device->material[count].diffuse_texture.max_v = (float)(h - 1);
-
+	texture_store(&scene_assets_material(device->assets, count)->diffuse_texture, texture, w, h, device->texture_layout);
 }
 
 void device_set_texture_by_specular(device_t* device, IUINT32** texture, long pitch, int w, int h, int count)
 {
-
-
-	device->material[count].specular_texture.tex_width = 2;
-	device->material[count].specular_texture.tex_height = 2;
-	device->material[count].specular_texture.max_u = 1.0f;
-	device->material[count].specular_texture.max_v = 1.0f;
-	int n = h; int m = w;
-	device->material[count].specular_texture.texture = NULL;
-	device->material[count].specular_texture.texture = new IUINT32 * [n];
-
-	for (int i = 0; i < n; i++)
-		device->material[count].specular_texture.texture[i] = new IUINT32[m];
-
-
 	assert(w <= 1024 && h <= 1024);
-	for (int i = 0; i < h; i++)
-	{
-		for (int j = 0; j < w; j++)
-			device->material[count].specular_texture.texture[i][j] = texture[i][j];
-	}
-	device->material[count].specular_texture.tex_width = w;
-	device->material[count].specular_texture.tex_height = h;
-	device->material[count].specular_texture.max_u = (float)(w - 1);
-	device->material[count].specular_texture.max_v = (float)(h - 1);
+	texture_store(&scene_assets_material(device->assets, count)->specular_texture, texture, w, h, device->texture_layout);
 }
 
 void device_set_texture_by_normal(device_t* device, IUINT32** texture, long pitch, int w, int h, int count)
 {
-	device->material[count].normal_texture.tex_width = 2;
-	device->material[count].normal_texture.tex_height = 2;
-	device->material[count].normal_texture.max_u = 1.0f;
-	device->material[count].normal_texture.max_v = 1.0f;
-	int n = h; int m = w;
-	device->material[count].normal_texture.texture = NULL;
-	device->material[count].normal_texture.texture = new IUINT32 * [n];
-
-	for (int i = 0; i < n; i++)
-		device->material[count].normal_texture.texture[i] = new IUINT32[m];
-
-
 	assert(w <= 2048 && h <= 2048);
-	for (int i = 0; i < h; i++)
-	{
-		for (int j = 0; j < w; j++)
-			device->material[count].normal_texture.texture[i][j] = texture[i][j];
-	}
-	device->material[count].normal_texture.tex_width = w;
-	device->material[count].normal_texture.tex_height = h;
-	device->material[count].normal_texture.max_u = (float)(w - 1);
-	device->material[count].normal_texture.max_v = (float)(h - 1);
+	s_texture image;
+	texture_init(&image);
+	texture_store(&image, texture, w, h, TEXTURE_LAYOUT_LINEAR);
+	texture_store_normals(&scene_assets_material(device->assets, count)->normal_texture, &image, device->texture_layout);
+	texture_release(&image);
 }
 
 void device_set_texture_by_albedo(device_t* device, IUINT32** texture, long pitch, int w, int h, int count)
 {
-	device->tPBR[count].albedo_texture.tex_width = 2;
-	device->tPBR[count].albedo_texture.tex_height = 2;
-	device->tPBR[count].albedo_texture.max_u = 1.0f;
-	device->tPBR[count].albedo_texture.max_v = 1.0f;
-	int n = h; int m = w;
-	device->tPBR[count].albedo_texture.texture = NULL;
-	device->tPBR[count].albedo_texture.texture = new IUINT32 * [n];
-
-	for (int i = 0; i < n; i++)
-		device->tPBR[count].albedo_texture.texture[i] = new IUINT32[m];
-
-
 	assert(w <= 2048 && h <= 2048);
-	for (int i = 0; i < h; i++)
-	{
-		for (int j = 0; j < w; j++)
-			device->tPBR[count].albedo_texture.texture[i][j] = texture[i][j];
-	}
-	device->tPBR[count].albedo_texture.tex_width = w;
-	device->tPBR[count].albedo_texture.tex_height = h;
-	device->tPBR[count].albedo_texture.max_u = (float)(w - 1);
-	device->tPBR[count].albedo_texture.max_v = (float)(h - 1);
+	texture_store(&scene_assets_pbr(device->assets, count)->albedo_texture, texture, w, h, device->texture_layout);
+	scene_assets_pbr(device->assets, count)->albedo_texture.srgb = 1;
 }
 
-void device_set_texture_by_metallic(device_t* device, IUINT32** texture, long pitch, int w, int h, int count)
+// write the red channel of src into one channel of the packed ao / roughness / metallic texture
+static void device_pack_orm(device_t* device, const s_texture* src, int count, int channel)
 {
-	device->tPBR[count].metallic_texture.tex_width = 2;
-	device->tPBR[count].metallic_texture.tex_height = 2;
-	device->tPBR[count].metallic_texture.max_u = 1.0f;
-	device->tPBR[count].metallic_texture.max_v = 1.0f;
-	int n = h; int m = w;
-	device->tPBR[count].metallic_texture.texture = NULL;
-	device->tPBR[count].metallic_texture.texture = new IUINT32 * [n];
-
-	for (int i = 0; i < n; i++)
-		device->tPBR[count].metallic_texture.texture[i] = new IUINT32[m];
+	t_PBR* t = scene_assets_pbr(device->assets, count);
+	int shift = channel == ORM_CHANNEL_AO ? 16 : (channel == ORM_CHANNEL_ROUGHNESS ? 8 : 0);
+	texture_pack_channel(&t->orm_texture, src, shift, device->texture_layout);
+	t->orm_channels |= channel;
+}
 
+static void device_pack_orm_rows(device_t* device, IUINT32** texture, int w, int h, int count, int channel)
+{
+	s_texture image;
+	texture_init(&image);
+	texture_store(&image, texture, w, h, TEXTURE_LAYOUT_LINEAR);
+	device_pack_orm(device, &image, count, channel);
+	texture_release(&image);
+}
 
+void device_set_texture_by_metallic(device_t* device, IUINT32** texture, long pitch, int w, int h, int count)
+{
 	assert(w <= 2048 && h <= 2048);
-	for (int i = 0; i < h; i++)
-	{
-		for (int j = 0; j < w; j++)
-			device->tPBR[count].metallic_texture.texture[i][j] = texture[i][j];
-	}
-	device->tPBR[count].metallic_texture.tex_width = w;
-	device->tPBR[count].metallic_texture.tex_height = h;
-	device->tPBR[count].metallic_texture.max_u = (float)(w - 1);
-	device->tPBR[count].metallic_texture.max_v = (float)(h - 1);
+	device_pack_orm_rows(device, texture, w, h, count, ORM_CHANNEL_METALLIC);
 }
 
 void device_set_texture_by_roughness(device_t* device, IUINT32** texture, long pitch, int w, int h, int count)
 {
-	device->tPBR[count].roughness_texture.tex_width = 2;
-	device->tPBR[count].roughness_texture.tex_height = 2;
-	device->tPBR[count].roughness_texture.max_u = 1.0f;
-	device->tPBR[count].roughness_texture.max_v = 1.0f;
-	int n = h; int m = w;
-	device->tPBR[count].roughness_texture.texture = NULL;
-	device->tPBR[count].roughness_texture.texture = new IUINT32 * [n];
-
-	for (int i = 0; i < n; i++)
-		device->tPBR[count].roughness_texture.texture[i] = new IUINT32[m];
-
-
 	assert(w <= 2048 && h <= 2048);
-	for (int i = 0; i < h; i++)
-	{
-		for (int j = 0; j < w; j++)
-			device->tPBR[count].roughness_texture.texture[i][j] = texture[i][j];
-	}
-	device->tPBR[count].roughness_texture.tex_width = w;
-	device->tPBR[count].roughness_texture.tex_height = h;
-	device->tPBR[count].roughness_texture.max_u = (float)(w - 1);
-	device->tPBR[count].roughness_texture.max_v = (float)(h - 1);
+	device_pack_orm_rows(device, texture, w, h, count, ORM_CHANNEL_ROUGHNESS);
 }
 
 void device_set_texture_by_ao(device_t* device, IUINT32** texture, long pitch, int w, int h, int count)
 {
-	device->tPBR[count].ao_texture.tex_width = 2;
-	device->tPBR[count].ao_texture.tex_height = 2;
-	device->tPBR[count].ao_texture.max_u = 1.0f;
-	device->tPBR[count].ao_texture.max_v = 1.0f;
-	int n = h; int m = w;
-	device->tPBR[count].ao_texture.texture = NULL;
-	device->tPBR[count].ao_texture.texture = new IUINT32 * [n];
-
-	for (int i = 0; i < n; i++)
-		device->tPBR[count].ao_texture.texture[i] = new IUINT32[m];
-
-
 	assert(w <= 2048 && h <= 2048);
-	for (int i = 0; i < h; i++)
-	{
-		for (int j = 0; j < w; j++)
-			device->tPBR[count].ao_texture.texture[i][j] = texture[i][j];
-	}
-	device->tPBR[count].ao_texture.tex_width = w;
-	device->tPBR[count].ao_texture.tex_height = h;
-	device->tPBR[count].ao_texture.max_u = (float)(w - 1);
-	device->tPBR[count].ao_texture.max_v = (float)(h - 1);
+	device_pack_orm_rows(device, texture, w, h, count, ORM_CHANNEL_AO);
 }
 
 void device_set_pointlight(device_t* device, s_vector& pos, s_vector& color, s_vector& am, s_vector& di, s_vector& spe, int cnt)
@@ -304,28 +574,84 @@ void device_set_pointlight(device_t* device, s_vector& pos, s_vector& color, s_v
 }
 
 //  framebuffer  zbuffer
+// the background of device_clear, mode 0 fills it, otherwise a grey gradient from top to bottom
+static void device_clear_color(device_t* device, int mode)
+{
+	int y, height = device->height;
+	if (mode == 0) surface_clear(device->color, device->background);
+	else
+	{
+		// the gradient runs over the rows of the frame, in pixels of color
+		int top = device->region_y * height / device->output_height;
+		int rows = device->frame_height * height / device->output_height;
+		if (rows < 2) rows = 2;
+		for (y = 0; y < device->height; y++)
+		{
+			// one row view per step of the grey gradient
+			int step = rows - 1 - (top + y);
+			IUINT32 cc = (step > 0 ? step : 0) * 230 / (rows - 1);
+			cc = (cc << 16) | (cc << 8) | cc;
+			surface_t row = surface_view(device->color, 0, y, device->width, 1);
+			surface_clear(&row, cc);
+		}
+	}
+	if (hdr_active(device->hdr)) hdr_load(device->hdr, device->color);
+}
+// the G-buffer holds one sample per pixel and the scanline walk has no coverage, both draw without samples
+static bool device_msaa_frame(const device_t* device)
+{
+	return device->msaa_samples > 1 && !(device->render_state & RENDER_STATE_DEFERRED) && device->raster_mode != RASTER_MODE_SCANLINE;
+}
 void device_clear(device_t* device, int mode)
 {
-	int y, x, height = device->height;
-	for (y = 0; y < device->height; y++)
+	PROFILE_SCOPE(device, PROFILE_STAGE_CLEAR);
+	// nothing of the last frame is left in the arenas
+	arena_reset(device->arena);
+	if (device->tiler != NULL) tile_context_reset_arenas(device->tiler);
+	// free and load the texture levels for what the last frame sampled
+	if (device->assets->textures->streamer != NULL) texture_streamer_update(device->assets->textures->streamer);
+	// samples, the tracer and wire frames write the colour target without the shaders
+	if (device->hdr != NULL) device->hdr->active = !device_msaa_frame(device) && device->raytrace == NULL && !(device->render_state & RENDER_STATE_WIREFRAME);
+	device_clear_color(device, mode);
+	surface_clear(device->depth, 0);
+	if (device->hiz != NULL) hiz_clear(device->hiz);
+	memset(&device->cull_stats, 0, sizeof(device->cull_stats));
+	if (device->transparent != NULL) transparent_list_clear(device->transparent);
+	if (device->render_state & RENDER_STATE_DEFERRED)
 	{
-		IUINT32* dst = device->framebuffer[y];
-		IUINT32 cc = (height - 1 - y) * 230 / (height - 1);
-		cc = (cc << 16) | (cc << 8) | cc;
-		if (mode == 0) cc = device->background;
-		for (x = device->width; x > 0; dst++, x--) dst[0] = cc;
+		if (device->gbuffer == NULL) device->gbuffer = gbuffer_create(device->width, device->height);
+		gbuffer_clear(device->gbuffer);
+		device->gbuffer->active = 1;
 	}
-	for (y = 0; y < device->height; y++)
+	else if (device->gbuffer != NULL) device->gbuffer->active = 0;
+	// the kept G-buffer is gone, this frame may be the next one
+	relight_t* relight = device->relight;
+	if (relight != NULL)
 	{
-		float* dst = device->zbuffer[y];
-		for (x = device->width; x > 0; dst++, x--) dst[0] = 0.0f;
+		relight->kept = 0;
+		relight->probing = 0;
+		relight->recording = device->gbuffer != NULL && device->gbuffer->active;
+		relight->probe = 0;
+		relight->probe_pbr.clear();
+		relight->clear_mode = mode;
 	}
+	if (device_msaa_frame(device))
+	{
+		if (device->msaa == NULL) device->msaa = msaa_create(device->width, device->height);
+		msaa_clear(device->msaa, device->color);
+		device->msaa->active = 1;
+	}
+	else if (device->msaa != NULL) device->msaa->active = 0;
+	// the tracer jitters its own samples
+	if (device->raytrace != NULL) raytrace_begin(device->raytrace);
+	else if (device->taa != NULL) taa_begin(device->taa, device);
 }
 void device_pixel(device_t* device, int x, int y, IUINT32 color)
 {
 	if (((IUINT32)x) < (IUINT32)device->width && ((IUINT32)y) < (IUINT32)device->height)
 	{
-		device->framebuffer[y][x] = color;
+		surface_row_u32(device->color, y)[x] = color;
+		if (device->msaa != NULL && device->msaa->active) msaa_fill(device->msaa, x, y, color);
 	}
 }
 void device_draw_line(device_t* device, int x1, int y1, int x2, int y2, IUINT32 c)
@@ -409,7 +735,7 @@ IUINT32 device_texture_read_from_material(const s_texture* t_texture, float u, f
 	x = CMID(x, 0, t_texture->tex_width - 1);
 	y = CMID(y, 0, t_texture->tex_height - 1);
 
-	return t_texture->texture[y][x];
+	return texture_texel(t_texture, 0, x, y);
 
 }
 
@@ -423,7 +749,7 @@ void read_the_texture(s_vector& tmp, const  s_texture* t_texture, float u, float
 	x = CMID(x, 0, t_texture->tex_width - 1);
 	y = CMID(y, 0, t_texture->tex_height - 1);
 
-	IUINT32 cc = t_texture->texture[y][x];
+	IUINT32 cc = texture_texel(t_texture, 0, x, y);
 	int texture_a = (cc >> 24) & 0xff;
 	int texture_r = (cc >> 16) & 0xff;
 	int texture_g = (cc >> 8) & 0xff;
@@ -440,7 +766,7 @@ void read_the_texture_dir(s_vector& tmp, const  s_texture* t_texture, int x, int
 {
 	
 
-	IUINT32 cc = t_texture->texture[x][y];
+	IUINT32 cc = texture_texel(t_texture, 0, y, x);
 	int texture_a = (cc >> 24) & 0xff;
 	int texture_r = (cc >> 16) & 0xff;
 	int texture_g = (cc >> 8) & 0xff;
@@ -544,7 +870,7 @@ void calculate_tangent_and_binormal(s_vector& tangent, s_vector& binormal, s_vec
 	//reverse tangents if necessary
 	s_vector tangentCross;
 	tangentCross.crossproduct(tangent, binormal);
-	if (tangentCross.dotproduct(normal) < 0.0f)
+	if (dot(tangentCross, normal) < 0.0f)
 	{
 		tangent.w = -1;
 		//vector_inverse(tangent);
@@ -553,15 +879,124 @@ void calculate_tangent_and_binormal(s_vector& tangent, s_vector& binormal, s_vec
 
 	//binormal->w = 0.0f;
 }
-void ff_interpolating(for_fs* dest, for_fs* src1, for_fs* src2, for_fs* src3, float a, float b, float c)
+void mesh_compute_tangents(vertex_t* vertices, int vertex_count, const int* indices, int index_count, int topology)
+{
+	vector<s_vector> tangents(vertex_count), binormals(vertex_count);
+	int tris = topology == TOPOLOGY_TRIANGLE_STRIP ? index_count - 2 : index_count / 3;
+	for (int t = 0; t < tris; t++)
+	{
+		int id[3];
+		if (topology == TOPOLOGY_TRIANGLE_STRIP)
+		{
+			// same winding as draw_indexed
+			int i = t + 2;
+			if (i % 2 == 0) { id[0] = i - 2; id[1] = i - 1; }
+			else { id[0] = i - 1; id[1] = i - 2; }
+			id[2] = i;
+		}
+		else
+		{
+			id[0] = t * 3; id[1] = t * 3 + 1; id[2] = t * 3 + 2;
+		}
+		if (indices != NULL)
+			for (int k = 0; k < 3; k++) id[k] = indices[id[k]];
+		// strips stitch rows with degenerate triangles
+		if (id[0] == id[1] || id[1] == id[2] || id[0] == id[2]) continue;
+		vertex_t* v0 = &vertices[id[0]];
+		vertex_t* v1 = &vertices[id[1]];
+		vertex_t* v2 = &vertices[id[2]];
+		s_vector tangent, binormal;
+		calculate_tangent_and_binormal(tangent, binormal, v0->pos, v1->pos, v2->pos, v0->tc.u, v0->tc.v, v1->tc.u, v1->tc.v, v2->tc.u, v2->tc.v);
+		for (int k = 0; k < 3; k++)
+		{
+			tangents[id[k]].x += tangent.x; tangents[id[k]].y += tangent.y; tangents[id[k]].z += tangent.z;
+			binormals[id[k]].x += binormal.x; binormals[id[k]].y += binormal.y; binormals[id[k]].z += binormal.z;
+		}
+	}
+	for (int i = 0; i < vertex_count; i++)
+	{
+		s_vector n(vertices[i].normal.x, vertices[i].normal.y, vertices[i].normal.z, 0.0f);
+		n.normalize();
+		// Gram-Schmidt against the vertex normal
+		s_vector& sum = tangents[i];
+		float d = dot(n, sum);
+		s_vector t(sum.x - n.x * d, sum.y - n.y * d, sum.z - n.z * d, 0.0f);
+		if (t.length() < 1e-6f)
+		{
+			// no usable uv gradient, any direction perpendicular to the normal will do
+			s_vector axis(fabsf(n.x) < 0.9f ? 1.0f : 0.0f, fabsf(n.x) < 0.9f ? 0.0f : 1.0f, 0.0f, 0.0f);
+			t.crossproduct(axis, n);
+		}
+		t.normalize();
+		s_vector c; c.crossproduct(n, t);
+		t.w = c.dotproduct(binormals[i]) < 0.0f ? -1.0f : 1.0f;
+		vertices[i].tangent = t;
+	}
+}
+
+void mesh_compute_bounds(const vertex_t* vertices, int first, int count, mesh_group_t* group)
+{
+	group->first = first;
+	group->count = count;
+	group->material_idex = count > 0 ? vertices[first].material_idex : 0;
+	s_vector lo(1e30f, 1e30f, 1e30f, 1.0f), hi(-1e30f, -1e30f, -1e30f, 1.0f);
+	for (int i = first; i < first + count; i++)
+	{
+		const s_vector& p = vertices[i].pos;
+		lo.x = std::min(lo.x, p.x); lo.y = std::min(lo.y, p.y); lo.z = std::min(lo.z, p.z);
+		hi.x = std::max(hi.x, p.x); hi.y = std::max(hi.y, p.y); hi.z = std::max(hi.z, p.z);
+	}
+	if (count <= 0) { lo.reset(0.0f, 0.0f, 0.0f, 1.0f); hi = lo; }
+	group->box_min = lo;
+	group->box_max = hi;
+	group->center.reset((lo.x + hi.x) * 0.5f, (lo.y + hi.y) * 0.5f, (lo.z + hi.z) * 0.5f, 1.0f);
+	float radius = 0.0f;
+	for (int i = first; i < first + count; i++)
+	{
+		const s_vector& p = vertices[i].pos;
+		float dx = p.x - group->center.x, dy = p.y - group->center.y, dz = p.z - group->center.z;
+		radius = std::max(radius, dx * dx + dy * dy + dz * dz);
+	}
+	group->radius = sqrtf(radius);
+}
+
+void mesh_compute_groups(const vertex_t* vertices, int first, int count, vector<mesh_group_t>& groups)
+{
+	int end = first + count - count % 3;
+	for (int start = first; start < end;)
+	{
+		int stop = start + 3;
+		while (stop < end && vertices[stop].material_idex == vertices[start].material_idex) stop += 3;
+		mesh_group_t group;
+		mesh_compute_bounds(vertices, start, stop - start, &group);
+		groups.push_back(group);
+		start = stop;
+	}
+}
+void ff_interpolating(for_fs* dest, for_fs* src1, for_fs* src2, for_fs* src3, float a, float b, float c, int varyings)
 {
-	dest->pos.interpolate(a, b, c, src1->pos, src2->pos, src3->pos, 1.0f);
-	dest->color.interpolate(a, b, c, src1->color, src2->color, src3->color, 1.0f);
-	dest->texcoord.interpolate(a, b, c, src1->texcoord, src2->texcoord, src3->texcoord, 1.0f);
-	dest->normal.interpolate(a, b, c, src1->normal, src2->normal, src3->normal, 1.0f);
-	dest->storage0.interpolate(a, b, c, src1->storage0, src2->storage0, src3->storage0, 1.0f);
-	dest->storage1.interpolate(a, b, c, src1->storage1, src2->storage1, src3->storage1, 1.0f);
-	dest->storage2.interpolate(a, b, c, src1->storage2, src2->storage2, src3->storage2, 1.0f);
+	if (varyings & VARYING_POS) dest->pos.interpolate(a, b, c, src1->pos, src2->pos, src3->pos, 1.0f);
+	else dest->pos = src1->pos;
+	if (varyings & VARYING_COLOR) dest->color.interpolate(a, b, c, src1->color, src2->color, src3->color, 1.0f);
+	else dest->color = src1->color;
+	if (varyings & VARYING_TEXCOORD) dest->texcoord.interpolate(a, b, c, src1->texcoord, src2->texcoord, src3->texcoord, 1.0f);
+	else dest->texcoord = src1->texcoord;
+	if (varyings & VARYING_NORMAL) dest->normal.interpolate(a, b, c, src1->normal, src2->normal, src3->normal, 1.0f);
+	else dest->normal = src1->normal;
+	if (varyings & VARYING_TBN)
+	{
+		dest->storage0.interpolate(a, b, c, src1->storage0, src2->storage0, src3->storage0, 1.0f);
+		dest->storage1.interpolate(a, b, c, src1->storage1, src2->storage1, src3->storage1, 1.0f);
+		dest->storage2.interpolate(a, b, c, src1->storage2, src2->storage2, src3->storage2, 1.0f);
+	}
+	else
+	{
+		dest->storage0 = src1->storage0;
+		dest->storage1 = src1->storage1;
+		dest->storage2 = src1->storage2;
+	}
+	dest->quad = NULL;
+	dest->instance = src1->instance;
 }
 
 
@@ -569,179 +1004,814 @@ void ff_interpolating(for_fs* dest, for_fs* src1, for_fs* src2, for_fs* src3, fl
 // Ⱦʵ
 //=====================================================================
 
-// ɨ
-void device_draw_scanline(device_t* device, scanline_t* scanline, s_vector& point1, s_vector& point2, s_vector& point3, for_fs* ffs, int count)
+// 1/depth of a fragment from its perspective correct weights and the clip space vertices
+static float fragment_depth(s_vector& barycenter, s_vector& point1, s_vector& point2, s_vector& point3)
 {
-	IUINT32* framebuffer = device->framebuffer[scanline->y];
-	float* zbuffer = device->zbuffer[scanline->y];
-	int x = scanline->x;
-	int w = scanline->w;
-	int width = device->width;
-	int height = device->height;
-	int render_state = device->render_state;
-	for (; w > 0; x++, w--)
+	float alpha = barycenter.x; float beta = barycenter.y; float gamma = barycenter.z;
+
+	float Z = 1.0 / (alpha / point1.w + beta / point2.w + gamma / point3.w);
+	float zp = alpha * point1.z / point1.w + beta * point2.z / point2.w + gamma * point3.z / point3.w;
+	zp *= Z;
+	/*if (zp < depth_buf[get_index(i, j)])
 	{
-		if (x >= 0 && x < width)
-		{
-			float rhw = scanline->v.rhw;
-			float ww = 1.0f / rhw;
-			s_vector barycenter(0.0f, 0.0f, 0.0f, 1.0f);
-			s_vector interpos = scanline->v.pos;
-			transform_homogenize_reverse(interpos, interpos, ww, width, height);
-			computeBarycentric3D(barycenter, point1, point2, point3, interpos);
-			float alpha = barycenter.x; float beta = barycenter.y; float gamma = barycenter.z;
-
-			float Z = 1.0 / (alpha / point1.w + beta / point2.w + gamma / point3.w);
-			float zp = alpha * point1.z / point1.w + beta * point2.z / point2.w + gamma * point3.z / point3.w;
-			zp *= Z;
-			float daozp = 1.0 / zp;
-			/*if (zp < depth_buf[get_index(i, j)])
-			{
-				depth_buf[get_index(i, j)] = zp;
-			}*/
-			if (daozp >= zbuffer[x])
-			{
-
-				zbuffer[x] = daozp;
-				for_fs ff;
+		depth_buf[get_index(i, j)] = zp;
+	}*/
+	return 1.0 / zp;
+}
+static void shade_none(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co);
+static void shade_light(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co);
+static void shade_phong_color(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co);
+static void shade_phong_texture(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co);
+static void shade_phong_blend(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co);
+static void shade_bump_blend(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co);
+static void shade_pbr(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co);
+static void shade_pbr_texture(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co);
+
+// the fragment stage of a SHADER_* id known at compile time, so the builtin shaders are
+// called directly from the pixel loops. SHADER_CUSTOM goes through the pipeline of the material
+template <int Shader>
+static inline void shade_fragment(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co)
+{
+	switch (Shader)
+	{
+	case SHADER_NONE: shade_none(device, ff, color, count, is_ban, ori_co); break;
+	case SHADER_LIGHT: shade_light(device, ff, color, count, is_ban, ori_co); break;
+	case SHADER_PHONG_COLOR: shade_phong_color(device, ff, color, count, is_ban, ori_co); break;
+	case SHADER_PHONG_TEXTURE: shade_phong_texture(device, ff, color, count, is_ban, ori_co); break;
+	case SHADER_PHONG_BLEND: shade_phong_blend(device, ff, color, count, is_ban, ori_co); break;
+	case SHADER_BUMP_BLEND: shade_bump_blend(device, ff, color, count, is_ban, ori_co); break;
+	case SHADER_PBR: shade_pbr(device, ff, color, count, is_ban, ori_co); break;
+	case SHADER_PBR_TEXTURE: shade_pbr_texture(device, ff, color, count, is_ban, ori_co); break;
+	default: device_pipeline(device, count)->fragment(device, ff, color, count, is_ban, ori_co); break;
+	}
+}
 
+// instantiate fn for the SHADER_* id picked at run time, once per triangle or G-buffer sample
+#define SHADER_SWITCH(id, fn, args) \
+	switch (id) \
+	{ \
+	case SHADER_NONE: fn<SHADER_NONE> args; break; \
+	case SHADER_LIGHT: fn<SHADER_LIGHT> args; break; \
+	case SHADER_PHONG_COLOR: fn<SHADER_PHONG_COLOR> args; break; \
+	case SHADER_PHONG_TEXTURE: fn<SHADER_PHONG_TEXTURE> args; break; \
+	case SHADER_PHONG_BLEND: fn<SHADER_PHONG_BLEND> args; break; \
+	case SHADER_BUMP_BLEND: fn<SHADER_BUMP_BLEND> args; break; \
+	case SHADER_PBR: fn<SHADER_PBR> args; break; \
+	case SHADER_PBR_TEXTURE: fn<SHADER_PBR_TEXTURE> args; break; \
+	default: fn<SHADER_CUSTOM> args; break; \
+	}
 
+// fn<SHADER_*, pass> for every SHADER_* id in id order, SHADER_CUSTOM last
+#define SHADER_ROW(fn, pass) \
+	{ fn<SHADER_NONE, pass>, fn<SHADER_LIGHT, pass>, fn<SHADER_PHONG_COLOR, pass>, fn<SHADER_PHONG_TEXTURE, pass>, fn<SHADER_PHONG_BLEND, pass>, \
+	fn<SHADER_BUMP_BLEND, pass>, fn<SHADER_PBR, pass>, fn<SHADER_PBR_TEXTURE, pass>, fn<SHADER_CUSTOM, pass> }
+
+// fn instantiated for every RASTER_PASS_* and SHADER_* id, indexed [raster_pass][id] once per draw so the
+// pixel loops have neither a pass nor a shader branch. the depth pass shades nothing, its row is SHADER_NONE
+#define RASTER_TABLE(fn) \
+	{ SHADER_ROW(fn, RASTER_PASS_COLOR), \
+	{ fn<SHADER_NONE, RASTER_PASS_DEPTH>, fn<SHADER_NONE, RASTER_PASS_DEPTH>, fn<SHADER_NONE, RASTER_PASS_DEPTH>, fn<SHADER_NONE, RASTER_PASS_DEPTH>, \
+	fn<SHADER_NONE, RASTER_PASS_DEPTH>, fn<SHADER_NONE, RASTER_PASS_DEPTH>, fn<SHADER_NONE, RASTER_PASS_DEPTH>, fn<SHADER_NONE, RASTER_PASS_DEPTH>, \
+	fn<SHADER_NONE, RASTER_PASS_DEPTH> }, \
+	SHADER_ROW(fn, RASTER_PASS_EQUAL), SHADER_ROW(fn, RASTER_PASS_BLEND) }
+
+// the shaders of id write radiance when the frame is shaded into device->hdr, the others display colour
+static inline bool shader_radiance(int id)
+{
+	return id == SHADER_PBR || id == SHADER_PBR_TEXTURE;
+}
+// row y of the colour the fragments of the calling thread write, indexed by framebuffer x: the block of
+// its tile while a tile worker shades one, see tile_target, otherwise device->color
+static inline IUINT32* device_color_row(device_t* device, int y)
+{
+	const tile_target_t* target = tile_target();
+	if (target == NULL) return surface_row_u32(device->color, y);
+	return surface_row_u32(target->color, y - target->y0) - target->x0;
+}
+// shade one fragment that passed the depth test and write it to the framebuffer, false when nothing was written
+template <int Shader>
+static bool device_shade_pixel(device_t* device, int x, int y, for_fs& ff, int count)
+{
+	IUINT32* framebuffer = device_color_row(device, y);
+	int render_state = device->render_state;
+	if (count != 2 && !(render_state & (RENDER_STATE_COLOR | RENDER_STATE_TEXTURE))) return false;
+	PROFILE_SCOPE(device, PROFILE_STAGE_SHADE);
+	PROFILE_COUNT(device, PROFILE_FRAGMENTS_SHADED, 1);
+	if (device->raster_pass == RASTER_PASS_BLEND) PROFILE_COUNT(device, PROFILE_FRAGMENTS_BLENDED, 1);
+	s_color color(0.0f, 0.0f, 0.0f, 1.0f);
+	bool ban = 0;
+	s_vector ori_col(-1.0f, -1.0f, -1.0f, 1.0f);
+	hdr_t* hdr = device->hdr;
+	float* pixel = NULL;
+	if (hdr_active(hdr))
+	{
+		// black is no colour like on the colour target
+		pixel = hdr_pixel(hdr, x, y);
+		if (pixel[0] != 0.0f || pixel[1] != 0.0f || pixel[2] != 0.0f) hdr_display(hdr, pixel, ori_col);
+	}
+	else if (framebuffer[x] != 0)
+	{
+		IUINT32 cc = framebuffer[x];
+		ori_col.x = (float)((cc >> 16) & 0xff) / 255.0f;
+		ori_col.y = (float)((cc >> 8) & 0xff) / 255.0f;
+		ori_col.z = (float)(cc & 0xff) / 255.0f;
+		ori_col.w = (float)((cc >> 24) & 0xff) / 255.0f;
+	}
+	light_list_t* lights = device->lights;
+	ff.lights = (lights != NULL && !lights->lights.empty()) ? light_list_tile(lights, x, y) : NULL;
+	ssao_t* ssao = device->ssao;
+	ff.occlusion = (ssao != NULL && ssao->active) ? ssao_at(ssao, x, y, ff.pos.w) : 1.0f;
+	shade_fragment<Shader>(device, &ff, color, count, ban, ori_col);
+	// only the textured state lets the shader discard the fragment
+	if (ban && count != 2 && !(render_state & RENDER_STATE_COLOR)) return false;
+	if (pixel != NULL)
+	{
+		hdr_store(hdr, pixel, color, shader_radiance(Shader));
+		return true;
+	}
+	int R = (int)(color.r * 255.0f);
+	int G = (int)(color.g * 255.0f);
+	int B = (int)(color.b * 255.0f);
+	R = CMID(R, 0, 255);
+	G = CMID(G, 0, 255);
+	B = CMID(B, 0, 255);
+	framebuffer[x] = (R << 16) | (G << 8) | (B);
+	return true;
+}
+// shade the stored G-buffer sample of a pixel and mark the pixel empty, false when nothing was written
+static bool device_resolve_sample(device_t* device, int x, int y)
+{
+	gbuffer_t* gbuffer = device->gbuffer;
+	int index = y * gbuffer->width + x;
+	int count = gbuffer->counts[index];
+	if (count < 0) return false;
+	gbuffer->counts[index] = -1;
+	g_sample_t* sample = &gbuffer->samples[index];
+	for_fs ff;
+	ff.pos = sample->pos;
+	ff.normal = sample->normal;
+	ff.texcoord = sample->texcoord;
+	for (int k = 0; k < 4; k++) ff.duv[k] = sample->duv[k];
+	ff.color = sample->color;
+	ff.storage0 = sample->storage0;
+	ff.storage1 = sample->storage1;
+	ff.storage2 = sample->storage2;
+	ff.quad = NULL;
+	// device_resolve_gbuffer set device->PBR to the sample's
+	ff.instance = NULL;
+	// the sample keeps its own material, so its shader is picked here and not by the caller
+	bool written = false;
+	SHADER_SWITCH(device_pipeline(device, count)->id, written = device_shade_pixel, (device, x, y, ff, count));
+	return written;
+}
+template <typename T>
+static inline bool depth_test_write(T* z, T d, int pass)
+{
+	if (pass == RASTER_PASS_DEPTH)
+	{
+		if (d >= *z) *z = d;
+		return false;
+	}
+	if (pass == RASTER_PASS_BLEND) return d >= *z;
+	// both passes compute daozp the same way, so the winner compares equal
+	if (!(pass == RASTER_PASS_EQUAL ? d == *z : d >= *z)) return false;
+	*z = d;
+	return true;
+}
+// depth test and write of one fragment for the raster pass Pass, true when it is to be shaded.
+// the depth pass only writes and always returns false
+template <int Pass>
+static inline bool device_depth_test(device_t* device, int x, int y, float daozp)
+{
+	surface_t* depth = device->depth;
+	bool shade;
+	if (depth->format == SURFACE_FORMAT_DEPTH16)
+		shade = depth_test_write(surface_row_u16(depth, y) + x, depth16_encode(daozp), Pass);
+	else if (depth->format == SURFACE_FORMAT_DEPTH24)
+		shade = depth_test_write(surface_row_u32(depth, y) + x, depth24_encode(daozp), Pass);
+	else
+	{
+		float* z = surface_row_f32(depth, y) + x;
+		float before = *z;
+		shade = depth_test_write(z, daozp, Pass);
+		if (device->hiz != NULL && *z != before) hiz_mark(device->hiz, x, y);
+	}
+	if (!shade && Pass != RASTER_PASS_DEPTH) PROFILE_COUNT(device, PROFILE_FRAGMENTS_DEPTH_REJECTED, 1);
+	return shade;
+}
+// depth test and shade one fragment, barycenter holds the perspective correct weights
+// screen space derivatives of the texcoord for the LOD of TEXTURE_FILTER_TRILINEAR. with r_i the
+// unnormalized perspective weights u = sum(r_i * u_i) / sum(r_i), so du/dx = sum(dr_i/dx * (u_i - u)) * ww
+// where ww = 1 / sum(r_i) and dr_i/dx is for_fs::weight_grad of vertex i
+static inline void device_uv_derivatives(device_t* device, for_fs* ff, const for_fs* ffs, float ww)
+{
+	if (device->texture_filter != TEXTURE_FILTER_TRILINEAR) return;
+	float d[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 3; i++)
+	{
+		float du = ffs[i].texcoord.u - ff->texcoord.u, dv = ffs[i].texcoord.v - ff->texcoord.v;
+		float gx = ffs[i].weight_grad[0], gy = ffs[i].weight_grad[1];
+		d[0] += gx * du; d[1] += gx * dv;
+		d[2] += gy * du; d[3] += gy * dv;
+	}
+	for (int k = 0; k < 4; k++) ff->duv[k] = d[k] * ww;
+}
+// store a fragment that passed the depth test in the G-buffer, or shade it
+template <int Shader>
+static void device_write_fragment(device_t* device, int x, int y, for_fs& ff, int count)
+{
+	gbuffer_t* gbuffer = device->gbuffer;
+	if (gbuffer != NULL && gbuffer->active)
+	{
+		if (!f_shader_reads_destination(device, &ff, count))
+		{
+			g_sample_t* sample = &gbuffer->samples[y * gbuffer->width + x];
+			sample->pos = ff.pos;
+			sample->normal = ff.normal;
+			sample->texcoord = ff.texcoord;
+			for (int k = 0; k < 4; k++) sample->duv[k] = ff.duv[k];
+			sample->color = ff.color;
+			sample->storage0 = ff.storage0;
+			sample->storage1 = ff.storage1;
+			sample->storage2 = ff.storage2;
+			gbuffer->counts[y * gbuffer->width + x] = count;
+			sample->pbr = ff.instance != NULL ? ff.instance->gbuffer_pbr : (int)gbuffer->pbr.size() - 1;
+			return;
+		}
+		// blending needs the colour of the surface below in the framebuffer first.
+		// f_shader_reads_destination is only true for scenes that do not read device->PBR,
+		// so the sample can be shaded with the current one
+		device_resolve_sample(device, x, y);
+	}
+	device_shade_pixel<Shader>(device, x, y, ff, count);
+}
+// interpolate and shade one fragment that passed the depth test
+template <int Shader>
+static inline void device_shade_fragment(device_t* device, int x, int y, float ww, s_vector& barycenter, for_fs* ffs, int count)
+{
+	for_fs ff;
+	ff_interpolating(&ff, &ffs[0], &ffs[1], &ffs[2], barycenter.x, barycenter.y, barycenter.z, ffs[0].varyings);
+	ff.pos.w = ww;
+	ff.normal.normalize();
+	device_uv_derivatives(device, &ff, ffs, ww);
+	device_write_fragment<Shader>(device, x, y, ff, count);
+}
+template <int Shader, int Pass>
+static void device_draw_fragment(device_t* device, int x, int y, float ww, float daozp, s_vector& barycenter, for_fs* ffs, int count)
+{
+	if (device_depth_test<Pass>(device, x, y, daozp)) device_shade_fragment<Shader>(device, x, y, ww, barycenter, ffs, count);
+}
+// ɨ
+template <int Shader, int Pass>
+static void device_draw_scanline(device_t* device, scanline_t* scanline, s_vector& point1, s_vector& point2, s_vector& point3, for_fs* ffs, int count, int x0, int x1)
+{
+	int x = scanline->x;
+	int w = scanline->w;
+	float width = device->transform.w;
+	float height = device->transform.h;
+	for (; w > 0; x++, w--)
+	{
+		if (x >= x0 && x < x1)
+		{
+			float rhw = scanline->v.rhw;
+			float ww = 1.0f / rhw;
+			s_vector barycenter(0.0f, 0.0f, 0.0f, 1.0f);
+			s_vector interpos = scanline->v.pos;
+			interpos.x += device->viewport_x;
+			interpos.y += device->viewport_y;
+			transform_homogenize_reverse(interpos, interpos, ww, width, height);
+			computeBarycentric3D(barycenter, point1, point2, point3, interpos);
 
-				ff_interpolating(&ff, &ffs[0], &ffs[1], &ffs[2], barycenter.x, barycenter.y, barycenter.z);
-				ff.pos.w = ww;
-				ff.normal.normalize();
-				s_color color(0.0f, 0.0f, 0.0f, 1.0f);
-				if (count == 2)
+			device_draw_fragment<Shader, Pass>(device, x, scanline->y, ww, fragment_depth(barycenter, point1, point2, point3), barycenter, ffs, count);
+		}
+		vertex_add(&scanline->v, &scanline->step);
+		if (x >= x1) break;
+	}
+}
+//Ⱦ 
+template <int Shader, int Pass>
+static void device_render_trap_shader(device_t* device, trapezoid_t* trap, s_vector& point1, s_vector& point2, s_vector& point3, for_fs* ffs, int count, int x0, int y0, int x1, int y1)
+{
+	scanline_t scanline;
+	int j, top, bottom;
+	top = (int)(trap->top + 0.5f);
+	bottom = (int)(trap->bottom + 0.5f);
+	// every row is interpolated from the edges directly, so rows outside [y0, y1) are skipped outright
+	for (j = std::max(top, y0); j < std::min(bottom, y1); j++)
+	{
+		trapezoid_edge_interp(trap, (float)j + 0.5f);
+		trapezoid_init_scan_line(trap, &scanline, j);
+		device_draw_scanline<Shader, Pass>(device, &scanline, point1, point2, point3, ffs, count, x0, x1);
+	}
+}
+void device_render_trap_rect(device_t* device, trapezoid_t* trap, s_vector& point1, s_vector& point2, s_vector& point3, for_fs* ffs, int count, int x0, int y0, int x1, int y1)
+{
+	PROFILE_SCOPE(device, PROFILE_STAGE_RASTER);
+	typedef void (*trap_shader_t)(device_t*, trapezoid_t*, s_vector&, s_vector&, s_vector&, for_fs*, int, int, int, int, int);
+	static const trap_shader_t table[RASTER_PASSES][SHADER_CUSTOM + 1] = RASTER_TABLE(device_render_trap_shader);
+	int id = std::min(device_pipeline(device, count)->id, SHADER_CUSTOM);
+	table[device->raster_pass][id](device, trap, point1, point2, point3, ffs, count, x0, y0, x1, y1);
+}
+void device_render_trap(device_t* device, trapezoid_t* trap, s_vector& point1, s_vector& point2, s_vector& point3, for_fs* ffs, int count)
+{
+	device_render_trap_rect(device, trap, point1, point2, point3, ffs, count, 0, 0, device->width, device->height);
+}
+// the perspective correct weights b, 1/w and daozp of a pixel of the edge function path whose
+// edge values at the center are e0..e2, from edge_triangle_weights instead of un-projecting the pixel
+// and calling computeBarycentric3D, the accuracy is documented at RASTER_EDGE_EPSILON
+static inline float device_edge_lane(const edge_triangle_t* tri, float e0, float e1, float e2, float* b, float& ww)
+{
+	edge_triangle_weights(tri, e0, e1, e2, b, ww);
+	return (b[0] * tri->rhw[0] + b[1] * tri->rhw[1] + b[2] * tri->rhw[2])
+		/ (b[0] * tri->zrhw[0] + b[1] * tri->zrhw[1] + b[2] * tri->zrhw[2]);
+}
+// depth test and write of the covered pixels of a block row at (x, y) for the raster pass Pass, bit i of
+// covered is pixel x + i. returns the pixels to be shaded, the depth pass only writes and returns 0.
+// the float and 24 bit formats compare the whole row at once with the s_simd kernels
+template <int Pass>
+static inline int device_depth_test_row(device_t* device, int x, int y, const float* daozp, int covered)
+{
+	surface_t* depth = device->depth;
+	int flags = (Pass == RASTER_PASS_EQUAL ? S_SIMD_DEPTH_EQUAL : 0) | (Pass == RASTER_PASS_BLEND ? 0 : S_SIMD_DEPTH_WRITE);
+	int pass = 0;
+	if (depth->format == SURFACE_FORMAT_DEPTH16)
+	{
+		unsigned short* z = surface_row_u16(depth, y) + x;
+		for (int i = 0; i < RASTER_BLOCK; i++)
+			if ((covered & (1 << i)) && depth_test_write(z + i, depth16_encode(daozp[i]), Pass)) pass |= 1 << i;
+	}
+	else if (depth->format == SURFACE_FORMAT_DEPTH24)
+	{
+		IUINT32 d[RASTER_BLOCK];
+		for (int i = 0; i < RASTER_BLOCK; i++) d[i] = (covered & (1 << i)) ? depth24_encode(daozp[i]) : 0;
+		pass = s_simd_get()->depth_test_u32(surface_row_u32(depth, y) + x, d, covered, flags);
+	}
+	else
+	{
+		pass = s_simd_get()->depth_test_f32(surface_row_f32(depth, y) + x, daozp, covered, flags);
+		// the row lies in one hiz block, HIZ_BLOCK is RASTER_BLOCK
+		if (device->hiz != NULL && (flags & S_SIMD_DEPTH_WRITE) && Pass != RASTER_PASS_EQUAL && pass != 0) hiz_mark(device->hiz, x, y);
+	}
+	if (Pass == RASTER_PASS_DEPTH) return 0;
+	int rejected = covered & ~pass;
+	while (rejected != 0)
+	{
+		PROFILE_COUNT(device, PROFILE_FRAGMENTS_DEPTH_REJECTED, 1);
+		rejected &= rejected - 1;
+	}
+	return pass;
+}
+// shade the lanes of a packet that starts at pixel (x, y) and write them like device_shade_pixel.
+// the lanes are a row of pixels, or with quad the 2x2 quad at (x, y) in row major order
+static void device_shade_packet(device_t* device, fs_packet_t* packet, int x, int y, int quad)
+{
+	PROFILE_SCOPE(device, PROFILE_STAGE_SHADE);
+	float r[FS_PACKET_WIDTH], g[FS_PACKET_WIDTH], b[FS_PACKET_WIDTH], a[FS_PACKET_WIDTH];
+	f_shader_packet(device, packet, r, g, b, a);
+	hdr_t* hdr = device->hdr;
+	bool radiance = shader_radiance(device_pipeline(device, packet->count)->id);
+	for (int i = 0; i < FS_PACKET_WIDTH; i++)
+	{
+		if (!(packet->mask & (1 << i))) continue;
+		int px = quad ? x + (i & 1) : x + i;
+		int py = quad ? y + (i >> 1) : y;
+		PROFILE_COUNT(device, PROFILE_FRAGMENTS_SHADED, 1);
+		if (hdr_active(hdr))
+		{
+			hdr_store(hdr, hdr_pixel(hdr, px, py), s_color(r[i], g[i], b[i], a[i]), radiance);
+			continue;
+		}
+		IUINT32* framebuffer = device_color_row(device, py);
+		int R = (int)(r[i] * 255.0f);
+		int G = (int)(g[i] * 255.0f);
+		int B = (int)(b[i] * 255.0f);
+		R = CMID(R, 0, 255);
+		G = CMID(G, 0, 255);
+		B = CMID(B, 0, 255);
+		framebuffer[px] = (R << 16) | (G << 8) | (B);
+	}
+}
+// the samples the current draw takes, NULL when it works per pixel. shadow casters and the
+// transparent pass test against the pixel depth, which is the farthest of its samples
+static inline msaa_t* device_msaa(device_t* device)
+{
+	msaa_t* msaa = device->msaa;
+	if (msaa == NULL || !msaa->active || device->shadow_pass || device->raster_pass == RASTER_PASS_BLEND) return NULL;
+	return msaa;
+}
+// perspective correct weights of the triangle at (fx, fy), false beyond the horizon of its plane
+static inline bool device_edge_weights(const edge_triangle_t* tri, float fx, float fy, float* b, float& ww)
+{
+	const edge_eq_t* e = tri->e;
+	float r[3];
+	for (int k = 0; k < 3; k++) r[k] = (e[k].a * (fx - e[k].x0) + e[k].b * (fy - e[k].y0)) * tri->rhw_area[k];
+	if (r[0] + r[1] + r[2] <= 0.0f) return false;
+	ww = 1.0f / (r[0] + r[1] + r[2]);
+	for (int k = 0; k < 3; k++) b[k] = r[k] * ww;
+	return true;
+}
+// coverage and depth test of the samples of pixel (x, y) for the raster pass Pass, returns the mask
+// of the ones to shade. the pixel depth follows the farthest sample so hi-z and the blend pass stay conservative
+template <int Pass>
+static int device_msaa_test(device_t* device, msaa_t* msaa, const edge_triangle_t* tri, int x, int y, int cover)
+{
+	const edge_eq_t* e = tri->e;
+	float* zs = surface_row_f32(msaa->depth, y) + x * MSAA_SAMPLES;
+	int covered = 0, mask = 0;
+	for (int s = 0; s < MSAA_SAMPLES; s++)
+	{
+		float fx = (float)x + 0.5f + (float)msaa_offsets[s][0] / MSAA_GRID;
+		float fy = (float)y + 0.5f + (float)msaa_offsets[s][1] / MSAA_GRID;
+		if (cover != 2)
+		{
+			// the sample grid is a multiple of the subpixel one
+			long long sx = RASTER_CENTER(x) + msaa_offsets[s][0] * (RASTER_SUBPIXEL / MSAA_GRID);
+			long long sy = RASTER_CENTER(y) + msaa_offsets[s][1] * (RASTER_SUBPIXEL / MSAA_GRID);
+			bool inside = true;
+			for (int k = 0; k < 3 && inside; k++) inside = edge_eq_value(&e[k], sx, sy) >= e[k].min;
+			if (!inside) continue;
+		}
+		float b[3], ww;
+		if (!device_edge_weights(tri, fx, fy, b, ww)) continue;
+		covered = 1;
+		float daozp = (b[0] * tri->rhw[0] + b[1] * tri->rhw[1] + b[2] * tri->rhw[2])
+			/ (b[0] * tri->zrhw[0] + b[1] * tri->zrhw[1] + b[2] * tri->zrhw[2]);
+		if (depth_test_write(zs + s, daozp, Pass)) mask |= 1 << s;
+	}
+	if (!covered) return 0;
+	if (mask == 0 && Pass != RASTER_PASS_DEPTH) PROFILE_COUNT(device, PROFILE_FRAGMENTS_DEPTH_REJECTED, 1);
+	float farthest = zs[0];
+	for (int s = 1; s < MSAA_SAMPLES; s++) farthest = std::min(farthest, zs[s]);
+	surface_t* depth = device->depth;
+	if (depth->format == SURFACE_FORMAT_DEPTH16) surface_row_u16(depth, y)[x] = depth16_encode(farthest);
+	else if (depth->format == SURFACE_FORMAT_DEPTH24) surface_row_u32(depth, y)[x] = depth24_encode(farthest);
+	else
+	{
+		float* z = surface_row_f32(depth, y) + x;
+		if (*z != farthest && device->hiz != NULL) hiz_mark(device->hiz, x, y);
+		*z = farthest;
+	}
+	return mask;
+}
+// the first sample of mask is where a pixel whose center has no weights is interpolated
+static inline void device_msaa_position(int mask, int x, int y, float& fx, float& fy)
+{
+	int s = 0;
+	while (!(mask & (1 << s))) s++;
+	fx = (float)x + 0.5f + (float)msaa_offsets[s][0] / MSAA_GRID;
+	fy = (float)y + 0.5f + (float)msaa_offsets[s][1] / MSAA_GRID;
+}
+// copy the shaded colour of pixel (x, y) in device->color to the samples of mask
+static inline void device_msaa_store(device_t* device, msaa_t* msaa, int x, int y, int mask)
+{
+	IUINT32 c = device_color_row(device, y)[x];
+	IUINT32* samples = surface_row_u32(msaa->color, y) + x * MSAA_SAMPLES;
+	for (int s = 0; s < MSAA_SAMPLES; s++) if (mask & (1 << s)) samples[s] = c;
+}
+// shade the fragment of pixel (x, y) once for the samples of mask. device->color holds the colour of one
+// of them while f_shader runs, so blending shaders read a destination, and a discard leaves them all alone
+template <int Shader>
+static void device_msaa_shade(device_t* device, msaa_t* msaa, int x, int y, int mask, for_fs& ff, int count)
+{
+	int first = 0;
+	while (!(mask & (1 << first))) first++;
+	device_color_row(device, y)[x] = surface_row_u32(msaa->color, y)[x * MSAA_SAMPLES + first];
+	if (device_shade_pixel<Shader>(device, x, y, ff, count)) device_msaa_store(device, msaa, x, y, mask);
+}
+// device_edge_lane and the depth test with samples: test them and interpolate at the pixel center into ff, returns the mask
+template <int Pass>
+static int device_msaa_fragment(device_t* device, msaa_t* msaa, const edge_triangle_t* tri, int x, int y, int cover, for_fs* ffs, for_fs* ff)
+{
+	int mask = device_msaa_test<Pass>(device, msaa, tri, x, y, cover);
+	if (mask == 0) return 0;
+	float fx = (float)x + 0.5f, fy = (float)y + 0.5f;
+	float b[3], ww;
+	if (!device_edge_weights(tri, fx, fy, b, ww))
+	{
+		device_msaa_position(mask, x, y, fx, fy);
+		device_edge_weights(tri, fx, fy, b, ww);
+	}
+	ff_interpolating(ff, &ffs[0], &ffs[1], &ffs[2], b[0], b[1], b[2], ffs[0].varyings);
+	ff->pos.w = ww;
+	ff->normal.normalize();
+	device_uv_derivatives(device, ff, ffs, ww);
+	return mask;
+}
+// RASTER_MODE_QUAD: the pixels [px0, px1] x [py0, py1] of one block in 2x2 quads at even coordinates.
+// every lane is interpolated, the ones outside the triangle or the rect are helper lanes that are
+// neither depth tested nor written but give the live ones their FS_DDX / FS_DDY neighbours.
+// with TEXTURE_FILTER_TRILINEAR the quad differences of texcoord replace device_uv_derivatives
+template <int Shader, int Pass>
+static void device_render_quads(device_t* device, const edge_triangle_t* tri, for_fs* ffs, int count, int cover, int px0, int py0, int px1, int py1, bool use_packet)
+{
+	const edge_eq_t* e = tri->e;
+	msaa_t* msaa = device_msaa(device);
+	for (int qy = py0 & ~1; qy <= py1; qy += 2)
+	{
+		for (int qx = px0 & ~1; qx <= px1; qx += 2)
+		{
+			float b[4][3], ww[4];
+			int covered = 0, valid = 0;
+			for (int i = 0; i < 4; i++)
+			{
+				int x = qx + (i & 1), y = qy + (i >> 1);
+				long long v[3];
+				float w[3];
+				for (int k = 0; k < 3; k++)
+				{
+					v[k] = edge_eq_value(&e[k], RASTER_CENTER(x), RASTER_CENTER(y));
+					w[k] = (float)v[k] * RASTER_EDGE_UNIT;
+				}
+				float r0 = w[0] * tri->rhw_area[0], r1 = w[1] * tri->rhw_area[1], r2 = w[2] * tri->rhw_area[2];
+				// a helper lane beyond the horizon of the triangle's plane has no perspective weights
+				if (r0 + r1 + r2 <= 0.0f) continue;
+				valid |= 1 << i;
+				ww[i] = 1.0f / (r0 + r1 + r2);
+				b[i][0] = r0 * ww[i]; b[i][1] = r1 * ww[i]; b[i][2] = r2 * ww[i];
+				if (x >= px0 && x <= px1 && y >= py0 && y <= py1 && (cover == 2 || (v[0] >= e[0].min && v[1] >= e[1].min && v[2] >= e[2].min)))
+					covered |= 1 << i;
+			}
+			int live = 0, masks[4];
+			for (int i = 0; i < 4; i++)
+			{
+				int x = qx + (i & 1), y = qy + (i >> 1);
+				if (msaa != NULL)
 				{
-					bool ban = 0;
-					s_vector ori_col(-1.0f, -1.0f, -1.0f, 1.0f);
-					if (framebuffer[x] != NULL)
+					// a lane is live when any of its samples is, a center without weights moves to one of them
+					if (x < px0 || x > px1 || y < py0 || y > py1) continue;
+					masks[i] = device_msaa_test<Pass>(device, msaa, tri, x, y, cover);
+					if (masks[i] == 0) continue;
+					live |= 1 << i;
+					if (!(valid & (1 << i)))
 					{
-						IUINT32 cc = framebuffer[x];
-						int texture_a = (cc >> 24) & 0xff;
-						int texture_r = (cc >> 16) & 0xff;
-						int texture_g = (cc >> 8) & 0xff;
-						int texture_b = cc & 0xff;
-						//printf("%d %d %d\n", texture_r, texture_g, texture_b);
-						//printf("%f %f %f\n", ff.color.r, ff.color.g, ff.color.b);
-						ori_col.x = (float)texture_r / 255.0f;
-						ori_col.y = (float)texture_g / 255.0f;
-						ori_col.z = (float)texture_b / 255.0f;
-						ori_col.w = (float)texture_a / 255.0f;
+						float fx, fy;
+						device_msaa_position(masks[i], x, y, fx, fy);
+						if (device_edge_weights(tri, fx, fy, b[i], ww[i])) valid |= 1 << i;
 					}
-
-					f_shader(device, &ff, color, count, ban, ori_col);
-					float a = color.a;
-					float r = color.r;
-					float g = color.g;
-					float b = color.b;
-					//printf("%f %f %f\n", r, g, b);
-					int R = (int)(r * 255.0f);
-					int G = (int)(g * 255.0f);
-					int B = (int)(b * 255.0f);
-					R = CMID(R, 0, 255);
-					G = CMID(G, 0, 255);
-					B = CMID(B, 0, 255);
-					framebuffer[x] = (R << 16) | (G << 8) | (B);
+					continue;
 				}
-				else if (render_state & RENDER_STATE_COLOR)
+				if (!(covered & (1 << i))) continue;
+				float daozp = (b[i][0] * tri->rhw[0] + b[i][1] * tri->rhw[1] + b[i][2] * tri->rhw[2])
+					/ (b[i][0] * tri->zrhw[0] + b[i][1] * tri->zrhw[1] + b[i][2] * tri->zrhw[2]);
+				if (device_depth_test<Pass>(device, x, y, daozp)) live |= 1 << i;
+			}
+			live &= valid;
+			if (live == 0) continue;
+			for_fs quad[4];
+			int first = 0;
+			while (!(live & (1 << first))) first++;
+			for (int i = 0; i < 4; i++)
+			{
+				if (!(valid & (1 << i))) continue;
+				ff_interpolating(&quad[i], &ffs[0], &ffs[1], &ffs[2], b[i][0], b[i][1], b[i][2], ffs[0].varyings);
+				quad[i].pos.w = ww[i];
+				quad[i].normal.normalize();
+			}
+			// lanes without weights copy a live one, their differences are then 0
+			for (int i = 0; i < 4; i++) if (!(valid & (1 << i))) quad[i] = quad[first];
+			for (int i = 0; i < 4; i++) quad[i].quad = quad;
+			if (device->texture_filter == TEXTURE_FILTER_TRILINEAR)
+			{
+				float duv[4] = { FS_DDX(&quad[0], texcoord.u), FS_DDX(&quad[0], texcoord.v), FS_DDY(&quad[0], texcoord.u), FS_DDY(&quad[0], texcoord.v) };
+				for (int i = 0; i < 4; i++) for (int k = 0; k < 4; k++) quad[i].duv[k] = duv[k];
+			}
+			if (use_packet)
+			{
+				// the quad is the packet, helper lanes are masked off
+				fs_packet_t packet;
+				packet.mask = 0;
+				packet.count = count;
+				packet.instance = ffs[0].instance;
+				for (int i = 0; i < 4; i++) if (live & (1 << i)) fs_packet_set_lane(&packet, i, &quad[i]);
+				device_shade_packet(device, &packet, qx, qy, 1);
+				if (msaa != NULL)
+					for (int i = 0; i < 4; i++) if (live & (1 << i)) device_msaa_store(device, msaa, qx + (i & 1), qy + (i >> 1), masks[i]);
+				continue;
+			}
+			for (int i = 0; i < 4; i++)
+			{
+				if (!(live & (1 << i))) continue;
+				if (msaa != NULL) device_msaa_shade<Shader>(device, msaa, qx + (i & 1), qy + (i >> 1), masks[i], quad[i], count);
+				else device_write_fragment<Shader>(device, qx + (i & 1), qy + (i >> 1), quad[i], count);
+			}
+		}
+	}
+}
+// RASTER_MODE_EDGE with samples over the pixels [px0, px1] x [py0, py1] of one block
+template <int Shader, int Pass>
+static void device_render_msaa(device_t* device, msaa_t* msaa, const edge_triangle_t* tri, for_fs* ffs, int count, int cover, int px0, int py0, int px1, int py1, bool use_packet)
+{
+	for (int y = py0; y <= py1; y++)
+	{
+		if (use_packet)
+		{
+			for (int x = px0; x <= px1; x += FS_PACKET_WIDTH)
+			{
+				fs_packet_t packet;
+				packet.mask = 0;
+				packet.count = count;
+				packet.instance = ffs[0].instance;
+				int masks[FS_PACKET_WIDTH];
+				for (int i = 0; i < FS_PACKET_WIDTH && x + i <= px1; i++)
 				{
-					bool ban = 0;
-					s_vector ori_col(-1.0f, -1.0f, -1.0f, 1.0f);
-					if (framebuffer[x] != NULL)
+					for_fs ff;
+					masks[i] = device_msaa_fragment<Pass>(device, msaa, tri, x + i, y, cover, ffs, &ff);
+					if (masks[i] != 0) fs_packet_set_lane(&packet, i, &ff);
+				}
+				if (packet.mask == 0) continue;
+				device_shade_packet(device, &packet, x, y, 0);
+				for (int i = 0; i < FS_PACKET_WIDTH; i++) if (packet.mask & (1 << i)) device_msaa_store(device, msaa, x + i, y, masks[i]);
+			}
+			continue;
+		}
+		for (int x = px0; x <= px1; x++)
+		{
+			for_fs ff;
+			int mask = device_msaa_fragment<Pass>(device, msaa, tri, x, y, cover, ffs, &ff);
+			if (mask != 0) device_msaa_shade<Shader>(device, msaa, x, y, mask, ff, count);
+		}
+	}
+}
+template <int Shader, int Pass>
+static void device_render_edge_shader(device_t* device, edge_triangle_t* tri, for_fs* ffs, int count, int x0, int y0, int x1, int y1)
+{
+	// rows are shaded FS_PACKET_WIDTH pixels at a time when f_shader_packet covers the scene,
+	// the G-buffer and the depth pass only store per fragment and shade one pixel at a time
+	bool use_packet = Pass != RASTER_PASS_DEPTH
+		&& (device->gbuffer == NULL || !device->gbuffer->active)
+		&& (count == 2 || (device->render_state & (RENDER_STATE_COLOR | RENDER_STATE_TEXTURE)))
+		&& f_shader_packet_supported(device, count);
+	int min_x = std::max(tri->min_x, x0), max_x = std::min(tri->max_x, x1 - 1);
+	int min_y = std::max(tri->min_y, y0), max_y = std::min(tri->max_y, y1 - 1);
+	if (min_x > max_x || min_y > max_y) return;
+	// blocks are aligned to the screen so neighbouring triangles share the same grid
+	min_x &= ~(RASTER_BLOCK - 1);
+	min_y &= ~(RASTER_BLOCK - 1);
+	const edge_eq_t* e = tri->e;
+	hiz_t* hiz = device_hiz(device);
+	msaa_t* msaa = device_msaa(device);
+	// how far the samples of a pixel are from its center
+	float reach = msaa != NULL ? MSAA_REACH : 0.0f;
+	for (int by = min_y; by <= max_y; by += RASTER_BLOCK)
+	{
+		for (int bx = min_x; bx <= max_x; bx += RASTER_BLOCK)
+		{
+			float cx = (float)bx + 0.5f, cy = (float)by + 0.5f;
+			int cover = msaa != NULL ? edge_triangle_classify_samples(tri, cx, cy, RASTER_BLOCK, reach) : edge_triangle_classify_block(tri, cx, cy, RASTER_BLOCK);
+			if (cover == 0) continue;
+			int px0 = std::max(bx, std::max(tri->min_x, x0)), px1 = std::min(bx + RASTER_BLOCK - 1, max_x);
+			int py0 = std::max(by, std::max(tri->min_y, y0)), py1 = std::min(by + RASTER_BLOCK - 1, max_y);
+			if (hiz != NULL)
+			{
+				// 1 / daozp of device_edge_lane is a ratio of two screen space planes, so while
+				// the denominator stays positive over the block its nearest value is at a corner
+				float zp = 1e30f;
+				for (int k = 0; k < 4; k++)
+				{
+					float qx = (k & 1) ? (float)px1 + 0.5f + reach : (float)px0 + 0.5f - reach;
+					float qy = (k & 2) ? (float)py1 + 0.5f + reach : (float)py0 + 0.5f - reach;
+					float r = 0.0f, z = 0.0f;
+					for (int i = 0; i < 3; i++)
 					{
-						IUINT32 cc = framebuffer[x];
-						int texture_a = (cc >> 24) & 0xff;
-						int texture_r = (cc >> 16) & 0xff;
-						int texture_g = (cc >> 8) & 0xff;
-						int texture_b = cc & 0xff;
-						//printf("%d %d %d\n", texture_r, texture_g, texture_b);
-						//printf("%f %f %f\n", ff.color.r, ff.color.g, ff.color.b);
-						ori_col.x = (float)texture_r / 255.0f;
-						ori_col.y = (float)texture_g / 255.0f;
-						ori_col.z = (float)texture_b / 255.0f;
-						ori_col.w = (float)texture_a / 255.0f;
+						float ri = (e[i].a * (qx - e[i].x0) + e[i].b * (qy - e[i].y0)) * tri->rhw_area[i] * tri->rhw[i];
+						r += ri;
+						z += ri * tri->z[i];
 					}
-					f_shader(device, &ff, color, count, ban, ori_col);
-					float a = color.a;
-					float r = color.r;
-					float g = color.g;
-					float b = color.b;
-					//printf("%f %f %f\n", r, g, b);
-					int R = (int)(r * 255.0f);
-					int G = (int)(g * 255.0f);
-					int B = (int)(b * 255.0f);
-					R = CMID(R, 0, 255);
-					G = CMID(G, 0, 255);
-					B = CMID(B, 0, 255);
-					framebuffer[x] = (R << 16) | (G << 8) | (B);
+					zp = r > 0.0f ? std::min(zp, z / r) : 0.0f;
+					if (zp <= 0.0f) break;
 				}
-				else if (render_state & RENDER_STATE_TEXTURE)
+				if (zp > 0.0f && hiz_rect_hidden(hiz, device->depth, px0, py0, px1, py1, 1.0f / zp))
+				{
+					hiz->blocks_rejected++;
+					continue;
+				}
+			}
+			if (device->raster_mode == RASTER_MODE_QUAD)
+			{
+				device_render_quads<Shader, Pass>(device, tri, ffs, count, cover, px0, py0, px1, py1, use_packet);
+				continue;
+			}
+			if (msaa != NULL)
+			{
+				device_render_msaa<Shader, Pass>(device, msaa, tri, ffs, count, cover, px0, py0, px1, py1, use_packet);
+				continue;
+			}
+			// the fixed point values step exactly, so a pixel gets the same coverage from any block or tile
+			long long sx = RASTER_CENTER(px0), sy = RASTER_CENTER(py0);
+			long long row0 = edge_eq_value(&e[0], sx, sy), row1 = edge_eq_value(&e[1], sx, sy), row2 = edge_eq_value(&e[2], sx, sy);
+			long long dx0 = e[0].ia << RASTER_SUBPIXEL_BITS, dx1 = e[1].ia << RASTER_SUBPIXEL_BITS, dx2 = e[2].ia << RASTER_SUBPIXEL_BITS;
+			long long dy0 = e[0].ib << RASTER_SUBPIXEL_BITS, dy1 = e[1].ib << RASTER_SUBPIXEL_BITS, dy2 = e[2].ib << RASTER_SUBPIXEL_BITS;
+			for (int y = py0; y <= py1; y++)
+			{
+				// the weights and depth of the covered pixels of the row, then one depth test for all of them
+				float b[RASTER_BLOCK][3], ww[RASTER_BLOCK], daozp[RASTER_BLOCK];
+				int covered = 0;
+				long long w0 = row0, w1 = row1, w2 = row2;
+				for (int i = 0; px0 + i <= px1; i++)
 				{
-					bool ban = 0;
-					s_vector ori_col(-1.0f, -1.0f, -1.0f, 1.0f);
-					if (framebuffer[x] != NULL)
+					daozp[i] = 0.0f;
+					if (cover == 2 || (w0 >= e[0].min && w1 >= e[1].min && w2 >= e[2].min))
 					{
-						IUINT32 cc = framebuffer[x];
-						int texture_a = (cc >> 24) & 0xff;
-						int texture_r = (cc >> 16) & 0xff;
-						int texture_g = (cc >> 8) & 0xff;
-						int texture_b = cc & 0xff;
-						//printf("%d %d %d\n", texture_r, texture_g, texture_b);
-						//printf("%f %f %f\n", ff.color.r, ff.color.g, ff.color.b);
-						ori_col.x = (float)texture_r / 255.0f;
-						ori_col.y = (float)texture_g / 255.0f;
-						ori_col.z = (float)texture_b / 255.0f;
-						ori_col.w = (float)texture_a / 255.0f;
+						daozp[i] = device_edge_lane(tri, (float)w0 * RASTER_EDGE_UNIT, (float)w1 * RASTER_EDGE_UNIT, (float)w2 * RASTER_EDGE_UNIT, b[i], ww[i]);
+						covered |= 1 << i;
 					}
-					f_shader(device, &ff, color, count, ban, ori_col);
-					if (ban == 0)
+					w0 += dx0; w1 += dx1; w2 += dx2;
+				}
+				row0 += dy0; row1 += dy1; row2 += dy2;
+				if (covered == 0) continue;
+				int pass = device_depth_test_row<Pass>(device, px0, y, daozp, covered);
+				if (pass == 0) continue;
+				if (use_packet)
+				{
+					for (int i0 = 0; px0 + i0 <= px1; i0 += FS_PACKET_WIDTH)
 					{
-						float a = color.a;
-						float r = color.r;
-						float g = color.g;
-						float b = color.b;
-						int R = (int)(r * 255.0f);
-						int G = (int)(g * 255.0f);
-						int B = (int)(b * 255.0f);
-						R = CMID(R, 0, 255);
-						G = CMID(G, 0, 255);
-						B = CMID(B, 0, 255);
-						framebuffer[x] = (R << 16) | (G << 8) | (B);
+						if (!((pass >> i0) & ((1 << FS_PACKET_WIDTH) - 1))) continue;
+						fs_packet_t packet;
+						packet.mask = 0;
+						packet.count = count;
+						packet.instance = ffs[0].instance;
+						for (int i = 0; i < FS_PACKET_WIDTH; i++)
+						{
+							int lane = i0 + i;
+							if (!(pass & (1 << lane))) continue;
+							for_fs ff;
+							ff_interpolating(&ff, &ffs[0], &ffs[1], &ffs[2], b[lane][0], b[lane][1], b[lane][2], ffs[0].varyings);
+							ff.pos.w = ww[lane];
+							ff.normal.normalize();
+							device_uv_derivatives(device, &ff, ffs, ww[lane]);
+							fs_packet_set_lane(&packet, i, &ff);
+						}
+						device_shade_packet(device, &packet, px0 + i0, y, 0);
 					}
+					continue;
+				}
+				for (int i = 0; px0 + i <= px1; i++)
+				{
+					if (!(pass & (1 << i))) continue;
+					s_vector barycenter(b[i][0], b[i][1], b[i][2], 1.0f);
+					device_shade_fragment<Shader>(device, px0 + i, y, ww[i], barycenter, ffs, count);
 				}
-
 			}
-
 		}
-		vertex_add(&scanline->v, &scanline->step);
-		if (x >= width) break;
 	}
 }
-//Ⱦ 
-void device_render_trap(device_t* device, trapezoid_t* trap, s_vector& point1, s_vector& point2, s_vector& point3, for_fs* ffs, int count)
+void device_render_edge_rect(device_t* device, edge_triangle_t* tri, for_fs* ffs, int count, int x0, int y0, int x1, int y1)
 {
-	scanline_t scanline;
-	int j, top, bottom;
-	top = (int)(trap->top + 0.5f);
-	bottom = (int)(trap->bottom + 0.5f);
-	for (j = top; j < bottom; j++)
+	PROFILE_SCOPE(device, PROFILE_STAGE_RASTER);
+	typedef void (*edge_shader_t)(device_t*, edge_triangle_t*, for_fs*, int, int, int, int, int);
+	static const edge_shader_t table[RASTER_PASSES][SHADER_CUSTOM + 1] = RASTER_TABLE(device_render_edge_shader);
+	int id = std::min(device_pipeline(device, count)->id, SHADER_CUSTOM);
+	table[device->raster_pass][id](device, tri, ffs, count, x0, y0, x1, y1);
+}
+static void device_draw_setup(device_t* device, vertex_t* v1, vertex_t* v2, vertex_t* v3, s_vector* points, for_fs* ffs, int count);
+// for_fs::weight_grad from the float screen positions, like edge_triangle_init without the snapping
+static void device_weight_grad(const vertex_t* v1, const vertex_t* v2, const vertex_t* v3, for_fs* ffs)
+{
+	const vertex_t* p[3] = { v1, v2, v3 };
+	float a[3], b[3];
+	for (int i = 0; i < 3; i++)
 	{
-		if (j >= 0 && j < device->height)
-		{
-			trapezoid_edge_interp(trap, (float)j + 0.5f);
-			trapezoid_init_scan_line(trap, &scanline, j);
-			device_draw_scanline(device, &scanline, point1, point2, point3, ffs, count);
-		}
-		if (j >= device->height) break;
+		const vertex_t* from = p[(i + 1) % 3];
+		const vertex_t* to = p[(i + 2) % 3];
+		a[i] = from->pos.y - to->pos.y;
+		b[i] = to->pos.x - from->pos.x;
+	}
+	float area = a[0] * (v1->pos.x - v2->pos.x) + b[0] * (v1->pos.y - v2->pos.y);
+	for (int i = 0; i < 3; i++)
+	{
+		// the signs of a, b and area cancel, so the winding does not matter
+		float rhw_area = area != 0.0f ? p[i]->rhw * (1.0f / area) : 0.0f;
+		ffs[i].weight_grad[0] = a[i] * rhw_area;
+		ffs[i].weight_grad[1] = b[i] * rhw_area;
 	}
 }
-//  render_state ԭʼ
-void device_draw_primitive(device_t* device, vertex_t* v1,
-	vertex_t* v2, vertex_t* v3, int count)
+static bool device_cull_clip(device_t* device, s_vector* clip);
+
+// the load time tangent to world space, the binormal follows from the world normal and the handedness in tangent.w
+static void device_tangent_frame(device_t* device, for_vs* av, const s_vector& tangent)
+{
+	s_vector t(tangent.x, tangent.y, tangent.z, 0.0f);
+	apply_to_vector(av->tangent, t, device->transform.world);
+	av->tangent.normalize();
+	av->tangent.w = tangent.w;
+	av->binormal.crossproduct(av->normal, av->tangent);
+	av->binormal.float_dot(tangent.w);
+}
+
+// the world space normal and tangent frame of vertex, av->pos is left alone
+static inline void device_world_attributes(device_t* device, const vertex_t* vertex, for_vs* av)
+{
+	av->normal = normalize(vertex->normal * device->transform.normal);
+	device_tangent_frame(device, av, vertex->tangent);
+}
+
+// the vertex stage of one triangle: transform, cull and v_shader. v1..v3 get their screen positions,
+// points the clip space ones and ffs the v_shader output. world holds the world space corners of a
+// pretransform_t, NULL when they are transformed here. false when the triangle was culled
+static bool device_vertex_stage(device_t* device, vertex_t* v1,
+	vertex_t* v2, vertex_t* v3, s_vector* points, for_fs* ffs, int count, const for_vs* world)
 {
 	vertex_t* vertexs[3] = { v1,v2,v3 };
-	s_vector points[3];
 	/*s_vector p1, p2, p3, c1, c2, c3;
 	int render_state = device->render_state;
 	//  Transform 仯
@@ -760,65 +1830,109 @@ void device_draw_primitive(device_t* device, vertex_t* v1,
 	device->transform.homogenize(p3, c3);
 	*/
 
-	//ת
-	s_matrix tmp;
-	tmp = device->transform.world;
-	tmp.inverse(); tmp.transpose();
-
-
-	s_vector c1, c2, c3;
-	for_vs vvs[3]; for_fs ffs[3];
-	for (int i = 0; i < 3; i++)
+	for_vs vvs[3];
+	int depth_only = device->raster_pass == RASTER_PASS_DEPTH;
+	PROFILE_COUNT(device, PROFILE_TRIANGLES_IN, 1);
 	{
-		vertex_t* vertex = vertexs[i];
-		for_vs* av = &vvs[i];
-		apply_to_vector(vertex->pos, vertex->pos, device->transform.world);
-		av->pos = vertex->pos;//ռpos
-		int a = 0, b = 0;
-		if (i == 0) a = 1, b = 2;
-		else if (i == 1) a = 0, b = 2;
-		else if (i == 2) a = 0, b = 1;
-		calculate_tangent_and_binormal(av->tangent, av->binormal, vertex->pos, vertexs[a]->pos, vertexs[b]->pos, vertex->tc.u, vertex->tc.v, vertexs[a]->tc.u, vertexs[a]->tc.v, vertexs[b]->tc.u, vertexs[b]->tc.v);
-
-		apply_to_vector(av->tangent, av->tangent, device->transform.world);
-		av->binormal.crossproduct(av->normal, av->tangent);
-		av->binormal.float_dot(av->tangent.w);
-
-		apply_to_vector(vertex->pos, vertex->pos, device->transform.vp);
-		points[i] = vertex->pos;
-		if (i == 0) c1 = vertex->pos;
-		if (i == 1) c2 = vertex->pos;
-		if (i == 2) c3 = vertex->pos;
-
-		apply_to_vector(vertex->normal, vertex->normal, tmp); // 
-		vertex->normal.normalize();
-
-
+		// the vertex stage, up to the triangle setup
+		PROFILE_SCOPE(device, PROFILE_STAGE_VERTEX);
+		// positions first, back faces are dropped before any attribute work
+		for (int i = 0; i < 3; i++)
+		{
+			vvs[i].pos = world != NULL ? world[i].pos : vertexs[i]->pos * device->transform.world;
+			points[i] = vvs[i].pos * device->transform.vp;
+		}
+		if (device_cull_clip(device, points))
+		{
+			PROFILE_COUNT(device, PROFILE_TRIANGLES_CULLED, 1);
+			return false;
+		}
+		for (int i = 0; i < 3; i++)
+		{
+			vertex_t* vertex = vertexs[i];
+			for_vs* av = &vvs[i];
+			vertex->pos = points[i];
+			if (depth_only)
+			{
+				// the depth pass only needs the screen position
+				device_homogenize(device, vertex->pos, vertex->pos);
+				continue;
+			}
 
+			if (world != NULL)
+			{
+				av->normal = world[i].normal;
+				av->tangent = world[i].tangent;
+				av->binormal = world[i].binormal;
+			}
+			else device_world_attributes(device, vertex, av);
+			vertex->normal = av->normal;
+			av->color = vertex->color;
+			av->texcoord = vertex->tc;
 
+			device_pipeline(device, count)->vertex(device, av, &ffs[i]); // ɫ
+			ffs[i].instance = device->instance;
+			device_homogenize(device, vertex->pos, vertex->pos);
 
-		av->normal = vertex->normal; // ռnormal
-		av->color = vertex->color;
-		av->texcoord = vertex->tc;
+		}
+	}
+	return true;
+}
 
-		v_shader(device, av, &ffs[i]); // ɫ
-		transform_homogenize(vertex->pos, vertex->pos, device->width, device->height);
+//  render_state ԭʼ
+void device_draw_primitive(device_t* device, vertex_t* v1, vertex_t* v2, vertex_t* v3, int count)
+{
+	s_vector points[3];
+	for_fs ffs[3];
+	if (device_vertex_stage(device, v1, v2, v3, points, ffs, count, NULL)) device_draw_setup(device, v1, v2, v3, points, ffs, count);
+}
 
+// cull, set up and rasterize a vertex shaded triangle. v1..v3 hold screen positions,
+// points the clip space ones
+// true when the screen space corners face away as selected by is_cull
+static inline bool device_cull_face(device_t* device, s_vector& s1, s_vector& s2, s_vector& s3)
+{
+	if (device->is_cull == 0) return false;
+	s_vector t1_t2 = s2 - s1;
+	s_vector t2_t3 = s3 - s2;
+
+	float crossdot = t1_t2.x * t2_t3.y - t2_t3.x * t1_t2.y;
+	if (device->is_cull == 1)
+	{ //ʱֻҪ
+		if (crossdot <= 0.0f) return true;
 	}
-	if (device->is_cull != 0)
+	else if (device->is_cull == 2)
+	{  //˳ʱֻҪ
+		if (crossdot > 0.0f) return true;
+	}
+	return false;
+}
+
+// the same test on clip space corners, so draw_primitive and draw_indexed can drop back faces
+// before the normal, tangent and v_shader work. it only decides when every w is positive,
+// triangles crossing the near plane are tested again after clipping
+static bool device_cull_clip(device_t* device, s_vector* clip)
+{
+	if (device->is_cull == 0) return false;
+	s_vector screen[3];
+	for (int i = 0; i < 3; i++)
 	{
-		s_vector t1_t2;  t1_t2.minus_two(v2->pos, v1->pos);
-		s_vector t2_t3; t2_t3.minus_two(v3->pos, v2->pos);
+		if (clip[i].w <= 0.0f) return false;
+		device_homogenize(device, screen[i], clip[i]);
+	}
+	return device_cull_face(device, screen[0], screen[1], screen[2]);
+}
 
-		float crossdot = t1_t2.x * t2_t3.y - t2_t3.x * t1_t2.y;
-		if (device->is_cull == 1)
-		{ //ʱֻҪ
-			if (crossdot <= 0.0f) return;
-		}
-		else if (device->is_cull == 2)
-		{  //˳ʱֻҪ
-			if (crossdot > 0.0f) return;
-		}
+static void device_draw_triangle(device_t* device, vertex_t* v1, vertex_t* v2, vertex_t* v3, s_vector* points, for_fs* ffs, int count)
+{
+	int depth_only = device->raster_pass == RASTER_PASS_DEPTH;
+	s_vector& c1 = points[0];
+	s_vector& c2 = points[1];
+	s_vector& c3 = points[2];
+	if (device_cull_face(device, v1->pos, v2->pos, v3->pos))
+	{
+		PROFILE_COUNT(device, PROFILE_TRIANGLES_CULLED, 1);
+		return;
 	}
 
 	s_vector point1(points[0].x, points[0].y, points[0].z, points[0].w);
@@ -827,6 +1941,25 @@ void device_draw_primitive(device_t* device, vertex_t* v1,
 	int render_state = device->render_state;
 	if (render_state & (RENDER_STATE_TEXTURE | RENDER_STATE_COLOR))
 	{
+		hiz_t* hiz = device_hiz(device);
+		if (hiz != NULL && !(render_state & RENDER_STATE_WIREFRAME))
+		{
+			// both paths store 1 / (interpolated z / w), the scanline one also scales it by the
+			// interpolated w. weights inside the triangle are convex, so the corners bound both
+			float zp = std::min(v1->pos.z, std::min(v2->pos.z, v3->pos.z));
+			if (device->raster_mode == RASTER_MODE_SCANLINE) zp *= std::min(c1.w, std::min(c2.w, c3.w));
+			int left = (int)floorf(std::min(v1->pos.x, std::min(v2->pos.x, v3->pos.x)));
+			int right = (int)ceilf(std::max(v1->pos.x, std::max(v2->pos.x, v3->pos.x)));
+			int top = (int)floorf(std::min(v1->pos.y, std::min(v2->pos.y, v3->pos.y)));
+			int bottom = (int)ceilf(std::max(v1->pos.y, std::max(v2->pos.y, v3->pos.y)));
+			if (zp > 0.0f && hiz_rect_hidden(hiz, device->depth, left, top, right, bottom, 1.0f / zp))
+			{
+				hiz->tris_rejected++;
+				PROFILE_COUNT(device, PROFILE_TRIANGLES_CULLED, 1);
+				return;
+			}
+		}
+		if (device->gbuffer != NULL && device->gbuffer->active && !depth_only && ffs[0].instance == NULL) gbuffer_track_pbr(device->gbuffer, device->PBR);
 
 		trapezoid_t traps[2];
 		v1->pos.w = c1.w;
@@ -839,11 +1972,46 @@ void device_draw_primitive(device_t* device, vertex_t* v1,
 		point1.w = c1.w;
 		point2.w = c2.w;
 		point3.w = c3.w;
-		if (n >= 1) { device_render_trap(device, &traps[0], point1, point2, point3, ffs, count); }
-		if (n >= 2) { device_render_trap(device, &traps[1], point1, point2, point3, ffs, count); }
+		edge_triangle_t edge_tri;
+		int use_edge = device->raster_mode != RASTER_MODE_SCANLINE;
+		// degenerate triangles cover no pixel centers
+		if (use_edge && !edge_triangle_init(&edge_tri, v1, v2, v3)) n = 0;
+		if (n > 0) PROFILE_COUNT(device, PROFILE_TRIANGLES_RASTER, 1);
+		if (!depth_only)
+		{
+			int varyings = device->varyings & f_shader_varyings(device, count);
+			for (int i = 0; i < 3; i++) ffs[i].varyings = varyings;
+		}
+		if (device->texture_filter == TEXTURE_FILTER_TRILINEAR && !depth_only && n > 0)
+		{
+			// weight gradients for device_uv_derivatives, the edge functions scaled like rhw_area.
+			// the scanline walk samples the unsnapped vertices, so its gradients come from them
+			if (use_edge)
+			{
+				for (int i = 0; i < 3; i++)
+				{
+					ffs[i].weight_grad[0] = edge_tri.e[i].a * edge_tri.rhw_area[i];
+					ffs[i].weight_grad[1] = edge_tri.e[i].b * edge_tri.rhw_area[i];
+				}
+			}
+			else device_weight_grad(v1, v2, v3, ffs);
+		}
+		if (device->tiler != NULL && device->tiler->recording)
+		{
+			tile_context_push(device->tiler, traps, n, point1, point2, point3, ffs, count, use_edge ? &edge_tri : NULL);
+		}
+		else if (use_edge)
+		{
+			if (n > 0) device_render_edge_rect(device, &edge_tri, ffs, count, 0, 0, device->width, device->height);
+		}
+		else
+		{
+			if (n >= 1) { device_render_trap(device, &traps[0], point1, point2, point3, ffs, count); }
+			if (n >= 2) { device_render_trap(device, &traps[1], point1, point2, point3, ffs, count); }
+		}
 	}
 
-	if ((render_state & RENDER_STATE_WIREFRAME) && device->framebuffer != NULL)//߿ 
+	if ((render_state & RENDER_STATE_WIREFRAME) && device->color != NULL)//߿ 
 	{
 		device_draw_line(device, (int)v1->pos.x, (int)v1->pos.y, (int)v2->pos.x, (int)v2->pos.y, device->foreground);
 		device_draw_line(device, (int)v1->pos.x, (int)v1->pos.y, (int)v3->pos.x, (int)v3->pos.y, device->foreground);
@@ -851,13 +2019,117 @@ void device_draw_primitive(device_t* device, vertex_t* v1,
 	}
 }
 
-void v_shader(device_t* device, for_vs* vv, for_fs* ff)
+// the clipper works on clip space corners, every attribute is still linear there
+typedef struct
 {
-	ff->pos = vv->pos;
-	ff->normal = vv->normal;
-	ff->color = vv->color;
-	ff->texcoord = vv->texcoord;
-	ff->tangent = vv->tangent;
+	s_vector clip;
+	vertex_t v;
+	for_fs ff;
+}clip_vertex_t;
+
+// signed distance to the clip planes, >= 0 inside. the near plane z = 0 is the exact CVV plane,
+// x and y use a guard band of CLIP_GUARD_BAND viewports: triangles reaching into it are left to
+// the rasterizers' scissoring, only ones beyond it are cut so a span never grows unbounded
+#define CLIP_GUARD_BAND 2.0f
+#define CLIP_PLANES 5
+static inline float clip_distance(const s_vector& c, int plane)
+{
+	switch (plane)
+	{
+	case 0: return c.z;
+	case 1: return CLIP_GUARD_BAND * c.w - c.x;
+	case 2: return CLIP_GUARD_BAND * c.w + c.x;
+	case 3: return CLIP_GUARD_BAND * c.w - c.y;
+	default: return CLIP_GUARD_BAND * c.w + c.y;
+	}
+}
+
+static void clip_vertex_lerp(clip_vertex_t* y, clip_vertex_t* a, clip_vertex_t* b, float t, int depth_only, int varyings)
+{
+	float w = interp(a->clip.w, b->clip.w, t);
+	y->clip.interp_two(a->clip, b->clip, t);
+	y->clip.w = w;
+	y->v = a->v;
+	vertex_interp(&y->v, &a->v, &b->v, t);
+	if (depth_only) return;
+	ff_interpolating(&y->ff, &a->ff, &b->ff, &b->ff, 1.0f - t, t, 0.0f, varyings);
+	y->ff.pos.w = a->ff.pos.w;
+	y->ff.tangent.interp_two(a->ff.tangent, b->ff.tangent, t);
+	y->ff.tangent.w = a->ff.tangent.w;
+	y->ff.binormal.interp_two(a->ff.binormal, b->ff.binormal, t);
+}
+
+// reject triangles outside the CVV, Sutherland-Hodgman clip the ones crossing the near plane or
+// the guard band and draw the clipped polygon as a fan. v1..v3 hold the screen positions of
+// points, the clip space positions
+static void device_draw_setup(device_t* device, vertex_t* v1, vertex_t* v2, vertex_t* v3, s_vector* points, for_fs* ffs, int count)
+{
+	if ((transform_check_cvv(points[0]) & transform_check_cvv(points[1]) & transform_check_cvv(points[2])) != 0)
+	{
+		PROFILE_COUNT(device, PROFILE_TRIANGLES_CULLED, 1);
+		return;
+	}
+	int outside = 0;
+	for (int plane = 0; plane < CLIP_PLANES; plane++)
+		for (int i = 0; i < 3; i++)
+			if (clip_distance(points[i], plane) < 0.0f) outside |= 1 << plane;
+	if (outside == 0)
+	{
+		device_draw_triangle(device, v1, v2, v3, points, ffs, count);
+		return;
+	}
+	PROFILE_COUNT(device, PROFILE_TRIANGLES_CLIPPED, 1);
+
+	int depth_only = device->raster_pass == RASTER_PASS_DEPTH;
+	vertex_t* vertexs[3] = { v1, v2, v3 };
+	// every plane adds at most one corner
+	clip_vertex_t buffer[2][3 + CLIP_PLANES];
+	clip_vertex_t* in = buffer[0];
+	clip_vertex_t* out = buffer[1];
+	int n = 3;
+	for (int i = 0; i < 3; i++)
+	{
+		in[i].clip = points[i];
+		in[i].v = *vertexs[i];
+		if (!depth_only) in[i].ff = ffs[i];
+	}
+	for (int plane = 0; plane < CLIP_PLANES && n >= 3; plane++)
+	{
+		if (!(outside & (1 << plane))) continue;
+		int m = 0;
+		for (int i = 0; i < n; i++)
+		{
+			clip_vertex_t* a = &in[i];
+			clip_vertex_t* b = &in[(i + 1) % n];
+			float da = clip_distance(a->clip, plane), db = clip_distance(b->clip, plane);
+			if (da >= 0.0f) out[m++] = *a;
+			if ((da >= 0.0f) != (db >= 0.0f))
+				clip_vertex_lerp(&out[m++], a, b, da / (da - db), depth_only, device->varyings);
+		}
+		n = m;
+		std::swap(in, out);
+	}
+	if (n < 3) return;
+	for (int i = 0; i < n; i++)
+		device_homogenize(device, in[i].v.pos, in[i].clip);
+	for (int i = 1; i + 1 < n; i++)
+	{
+		// device_draw_triangle scales tc and color by 1/w in place, so it gets copies
+		vertex_t corners[3] = { in[0].v, in[i].v, in[i + 1].v };
+		s_vector clipped[3] = { in[0].clip, in[i].clip, in[i + 1].clip };
+		for_fs fan[3];
+		if (!depth_only) { fan[0] = in[0].ff; fan[1] = in[i].ff; fan[2] = in[i + 1].ff; }
+		device_draw_triangle(device, &corners[0], &corners[1], &corners[2], clipped, fan, count);
+	}
+}
+
+void v_shader(device_t* device, for_vs* vv, for_fs* ff)
+{
+	ff->pos = vv->pos;
+	ff->normal = vv->normal;
+	ff->color = vv->color;
+	ff->texcoord = vv->texcoord;
+	ff->tangent = vv->tangent;
 	ff->binormal = vv->binormal;
 	s_vector tmp1(vv->tangent.x, vv->binormal.x, vv->normal.x, 1.0f);
 	ff->storage0 = tmp1;
@@ -875,7 +2147,7 @@ float DistributionGGX(s_vector& N, s_vector& H, float roughness)
 {
 	float a = roughness * roughness;
 	float a2 = a * a;
-	float NdotH = max(N.dotproduct(H), 0.0f);
+	float NdotH = max(dot(N, H), 0.0f);
 	float NdotH2 = NdotH * NdotH;
 
 	float nom = a2;
@@ -898,8 +2170,8 @@ float GeometrySchlickGGX(float NdotV, float roughness)
 // ----------------------------------------------------------------------------
 float GeometrySmith(s_vector& N, s_vector& V, s_vector& L, float roughness)
 {
-	float NdotV = max(N.dotproduct(V), 0.0f);
-	float NdotL = max(N.dotproduct(L), 0.0f);
+	float NdotV = max(dot(N, V), 0.0f);
+	float NdotL = max(dot(N, L), 0.0f);
 	float ggx2 = GeometrySchlickGGX(NdotV, roughness);
 	float ggx1 = GeometrySchlickGGX(NdotL, roughness);
 
@@ -909,7 +2181,7 @@ float GeometrySmith(s_vector& N, s_vector& V, s_vector& L, float roughness)
 void fresnelSchlick(s_vector& result,float cosTheta,s_vector& F0)
 {
 	s_vector the_1(1.0f, 1.0f, 1.0f, 1.0f);
-	s_vector tmp1; tmp1 = F0; tmp1.inverse(); tmp1.add(the_1);
+	s_vector tmp1 = -F0 + the_1;
 	float clamp = CMID(1.0 - cosTheta, 0.0f, 1.0f);
 	float tmp2 = pow(clamp, 5.0f);
 	tmp1.float_dot(tmp2);
@@ -917,916 +2189,1876 @@ void fresnelSchlick(s_vector& result,float cosTheta,s_vector& F0)
 	result.add_two(tmp1, F0);
 }
 
-void f_shader(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co)
+// D, G and F of the cook torrance lobe, the brdf.h forms with BRDF_MODE_FAST
+static inline void cook_torrance_terms(device_t* device, s_vector& N, s_vector& V, s_vector& L, s_vector& H, float roughness, s_vector& F0,
+	float& NDF, float& G, s_vector& F)
 {
-	int now_num = device->now_state;
-	if (now_num == 7)
+	float HdotV = max(dot(H, V), 0.0f);
+	if (device->brdf_mode != BRDF_MODE_FAST)
 	{
-		if (count == 2)
-		{
-
-
-
-			color.r = ff->color.r;
-			color.g = ff->color.g;
-			color.b = ff->color.b;
-			color.a = ff->color.a;
-
-
-
-		}
-		else
-		{
-			float u = ff->texcoord.u; float v = ff->texcoord.v;
-			//albedo
-			s_vector albedo; read_the_texture(albedo, &device->tPBR[count].albedo_texture, u, v);
-			//gamma 
-			float a_xx = albedo.x; float a_yy = albedo.y; float a_zz = albedo.z;
-			a_xx = pow(a_xx, 2.2f); a_yy = pow(a_yy, 2.2f); a_zz = pow(a_zz, 2.2f);
-			albedo.reset(a_xx, a_yy, a_zz, albedo.w);
-
-			//metallic
-			float metallic; s_vector v_metallic; read_the_texture(v_metallic, &device->tPBR[count].metallic_texture, u, v);
-			metallic = v_metallic.x;
-
-			//roughness
-			float roughness; s_vector v_roughness; read_the_texture(v_roughness, &device->tPBR[count].roughness_texture, u, v);
-			roughness = v_roughness.x;
-			//ao
-			float ao = device->PBR.ao;
-			//normal
-			s_vector N; N = ff->normal;
-
-			//get the norm
-			if (device->material[count].have_normal == 1)
-			{
-
-				s_vector norm;
-				read_the_texture(norm, &device->material[count].normal_texture, u, v);
-				norm.float_dot(2.0f);
-				s_vector tmp_1(1.0f, 1.0f, 1.0f, 1.0f);
-				norm.minus_two(norm, tmp_1);
-				norm.normalize();
-				norm.reset(ff->storage0.dotproduct(norm), ff->storage1.dotproduct(norm), ff->storage2.dotproduct(norm), 1.0f);
-				norm.normalize();
-				N = norm;
-			}
-
-
-
-			s_vector camPos; camPos = device->camera.viewpos; s_vector WorldPos; WorldPos = ff->pos;
-			s_vector V; V.minus_two(camPos, WorldPos); V.normalize();
-
-			s_vector F0(0.04f, 0.04f, 0.04f, 1.0f);
-
-			F0.interp_two(F0, albedo, metallic);
-
-			s_vector Lo(0.0f, 0.0f, 0.0f, 1.0f);
-
-			//do the light
-			s_vector lightcolor; s_vector lightpos;
-			lightcolor = device->pointlight[0].lightcolor;
-			lightpos = device->pointlight[0].lightpos;
-
-			s_vector L; L.minus_two(lightpos, WorldPos); L.normalize();
-			s_vector H; H.add_two(V, L); H.normalize();
-
-			float distance = L.length();
-			float attenuation = 1.0f / (distance * distance);
-			s_vector radiance; radiance = lightcolor; radiance.float_dot(attenuation);
-
-			//cook-Torrance BRDF
-			float NDF = DistributionGGX(N, H, roughness);
-			float G = GeometrySmith(N, V, L, roughness);
-			s_vector F;    float tmp1; tmp1 = H.dotproduct(V); tmp1 = max(tmp1, 0.0f); /*tmp1 = CMID(tmp1, 0.0f, 1.0f); */ fresnelSchlick(F, tmp1, F0);
-
-			s_vector numerator;  numerator = F;
-			float tmp2 = NDF * G;   numerator.float_dot(tmp2);
-			float denominator = 4.0f * max(N.dotproduct(V), 0.0f) * max(N.dotproduct(L), 0.0f) + 0.0001f;
-			s_vector specular = numerator;
-			specular.float_dot(1.0f / denominator);
+		NDF = DistributionGGX(N, H, roughness);
+		G = GeometrySmith(N, V, L, roughness);
+		fresnelSchlick(F, HdotV, F0);
+		return;
+	}
+	NDF = brdf_ndf(max(dot(N, H), 0.0f), roughness);
+	G = brdf_geometry(max(dot(N, V), 0.0f), max(dot(N, L), 0.0f), roughness);
+	float f = brdf_pow5(CMID(1.0f - HdotV, 0.0f, 1.0f));
+	F.reset(F0.x + (1.0f - F0.x) * f, F0.y + (1.0f - F0.y) * f, F0.z + (1.0f - F0.z) * f, 1.0f);
+}
 
-			s_vector kS; kS = F;
+// how much of pointlight[0] reaches the fragment through the bound shadow map, 1 without one
+static inline float device_shadow(device_t* device, for_fs* ff)
+{
+	return device->shadow != NULL ? shadow_map_visibility(device->shadow, ff->pos) : 1.0f;
+}
 
-			s_vector the_1(1.0f, 1.0f, 1.0f, 1.0f);
-			s_vector tmp9; tmp9 = kS; tmp9.inverse(); tmp9.add(the_1);
-			s_vector kD; kD = tmp9;
+// diffuse and specular of the light list entries of ff's tile with the phong model,
+// false when there are none and diffuse / specular are left untouched
+static bool tile_lights_phong(device_t* device, for_fs* ff, s_vector& norm, s_vector& viewdir, float shininess, s_vector& diffuse, s_vector& specular)
+{
+	if (ff->lights == NULL) return false;
+	diffuse.reset(0.0f, 0.0f, 0.0f, 1.0f);
+	specular.reset(0.0f, 0.0f, 0.0f, 1.0f);
+	for (const int* l = ff->lights; *l >= 0; l++)
+	{
+		point_light& light = device->lights->lights[*l];
+		s_vector L = light.lightpos - ff->pos;
+		float attenuation = light_attenuation(L.length(), light.range);
+		if (attenuation <= 0.0f) continue;
+		L.normalize();
+		float diff = max(dot(norm, L), 0.0f);
+		s_vector reflectdir = reflect(-L, norm);
+		float spec = pow(max(dot(viewdir, reflectdir), 0.0f), shininess);
+		diffuse += light.diffuse * (diff * attenuation);
+		specular += light.specular * (spec * attenuation);
+	}
+	return true;
+}
 
+// ambient of the PBR shaders from device->ibl: diffuse irradiance plus the split sum specular
+static void ibl_ambient_pbr(device_t* device, s_vector& N, s_vector& V, s_vector& albedo, s_vector& F0, float metallic, float roughness, float ao, s_vector& ambient)
+{
+	float NdotV = max(dot(N, V), 0.0f);
+	// fresnel with roughness, rough surfaces brighten less at grazing angles
+	float f = powf(1.0f - NdotV, 5.0f), g = 1.0f - roughness;
+	s_vector kS(F0.x + (max(g, F0.x) - F0.x) * f, F0.y + (max(g, F0.y) - F0.y) * f, F0.z + (max(g, F0.z) - F0.z) * f, 1.0f);
+	s_vector irradiance; ibl_irradiance(device->ibl, N, irradiance);
+	s_vector diffuse((1.0f - kS.x) * albedo.x, (1.0f - kS.y) * albedo.y, (1.0f - kS.z) * albedo.z, 1.0f);
+	diffuse.float_dot(1.0f - metallic);
+	diffuse.dot_two(diffuse, irradiance);
+
+	s_vector R(2.0f * NdotV * N.x - V.x, 2.0f * NdotV * N.y - V.y, 2.0f * NdotV * N.z - V.z, 1.0f);
+	s_vector prefiltered; ibl_specular(device->ibl, R, roughness, prefiltered);
+	float scale, bias; ibl_brdf(device->ibl, NdotV, roughness, &scale, &bias);
+	s_vector specular(F0.x * scale + bias, F0.y * scale + bias, F0.z * scale + bias, 1.0f);
+	specular.dot_two(specular, prefiltered);
+
+	ambient.add_two(diffuse, specular);
+	ambient.float_dot(ao);
+	ambient.w = 1.0f;
+}
 
-			kD.float_dot(1.0f - metallic);
+// cook torrance of the light list entries of ff's tile, added to Lo
+static void tile_lights_pbr(device_t* device, for_fs* ff, s_vector& N, s_vector& V, s_vector& albedo, s_vector& F0, float metallic, float roughness, s_vector& Lo)
+{
+	if (ff->lights == NULL) return;
+	for (const int* l = ff->lights; *l >= 0; l++)
+	{
+		point_light& light = device->lights->lights[*l];
+		s_vector L = light.lightpos - ff->pos;
+		float attenuation = light_attenuation(L.length(), light.range);
+		if (attenuation <= 0.0f) continue;
+		L.normalize();
+		s_vector H = normalize(V + L);
+		float NdotL = max(dot(N, L), 0.0f);
+		float NDF, G; s_vector F;
+		cook_torrance_terms(device, N, V, L, H, roughness, F0, NDF, G, F);
+		float denominator = 4.0f * max(dot(N, V), 0.0f) * NdotL + 0.0001f;
+		s_vector specular = F * (NDF * G / denominator);
+		s_vector kD(1.0f - F.x, 1.0f - F.y, 1.0f - F.z, 1.0f); kD.float_dot(1.0f - metallic);
+		s_vector term = kD * albedo * (1.0f / PI) + specular;
+		s_vector radiance = light.lightcolor * (attenuation * NdotL);
+		term.dot_two(term, radiance);
+		Lo.add(term);
+	}
+}
 
-			float NdotL = max(N.dotproduct(L), 0.0f);
+// count 2: the light cubes pass the vertex colour through
+static void shade_light(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co)
+{
+	color.r = ff->color.r;
+	color.g = ff->color.g;
+	color.b = ff->color.b;
+	color.a = ff->color.a;
+}
 
-			s_vector get1; get1.dot_two(kD, albedo); get1.float_dot(1.0f / PI);  get1.add(specular);
-			s_vector get2; get2 = radiance; get2.float_dot(NdotL);
-			get1.dot_two(get1, get2);
-			Lo.add(get1);
+// now_state 1: phong lighting of the vertex colour
+static void shade_phong_color(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co)
+{
+	s_vector result(0.0f, 0.0f, 0.0f, 1.0f);
+	s_vector lightcolor; s_vector lightpos;
+	lightcolor = device->pointlight[0].lightcolor;
+	lightpos = device->pointlight[0].lightpos;
+	s_vector objectcolor(ff->color.r, ff->color.g, ff->color.b, ff->color.a);
+	// ambient
+	float ambientStrength = device->m1;
+	s_vector ambient;
+	ambient = lightcolor;
+	ambient.float_dot(ambientStrength * ff->occlusion);
+
+	// diffuse
+	s_vector norm = ff->normal;
+	s_vector fragpos = ff->pos;
+	s_vector lightDir = normalize(lightpos - fragpos);
+	//lightDir.show();
+	float diff = max(dot(norm, lightDir), 0.0f);
+	//if (diff > 0.0f) { printf("%lf\n", diff); norm.show(); }
+	s_vector diffuse = lightcolor * diff;
+
+	//specular ߹
+	float specularstrength = device->m2;
+	//get the view pos
+	s_vector viewpos = device->camera.viewpos;
+	s_vector viewdir = normalize(viewpos - fragpos);
+	s_vector reflectdir = reflect(-lightDir, norm);
+	float spec = pow(max(dot(viewdir, reflectdir), 0.0f), 128);
+	s_vector specular = lightcolor;
+	specular.float_dot(spec); specular.float_dot(specularstrength);
+
+	if (device->shadow != NULL)
+	{
+		float shadow = device_shadow(device, ff);
+		diffuse.float_dot(shadow); specular.float_dot(shadow);
+	}
+	result = ambient + diffuse + specular;
+	s_vector tile_diffuse, tile_specular;
+	if (tile_lights_phong(device, ff, norm, viewdir, 128.0f, tile_diffuse, tile_specular))
+	{
+		tile_specular.float_dot(specularstrength);
+		result.add(tile_diffuse); result.add(tile_specular);
+	}
+	result.dot_two(result, objectcolor);
 
+	color.r = result.x;
+	color.g = result.y;
+	color.b = result.z;
+	color.a = result.w;
+	/*
 
-			//ambient lighting
-			s_vector tmp8(0.03f, 0.03f, 0.03f, 1.0f);
-			s_vector ambient; ambient.dot_two(tmp8, albedo);  ambient.float_dot(ao);
+	color.r = ff->color.r;
+	color.g = ff->color.g;
+	color.b = ff->color.b;
+	color.a = ff->color.a;
+	*/
+}
 
-			s_vector the_color; the_color.add_two(ambient, Lo);
+// now_state 2 and 3: phong lighting with diffuse and specular maps
+static void shade_phong_texture(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co)
+{
+	s_vector init_diffuse(0.64, 0.64, 0.64, 1.0f);
+	s_vector init_specular(0.5, 0.5, 0.5, 1.0f);
+	float u = ff->texcoord.u; float v = ff->texcoord.v;
+	s_vector result(0.0f, 0.0f, 0.0f, 1.0f);
+	s_vector lightpos;
+	const s_vector& light_ambient = device->pointlight[0].ambient;
+	const s_vector& light_diffuse = device->pointlight[0].diffuse;
+	const s_vector& light_specular = device->pointlight[0].specular;
+	lightpos = device->pointlight[0].lightpos;
+	s_vector objectcolor(ff->color.r, ff->color.g, ff->color.b, ff->color.a);
+	// ambient
+
+	//float r, g, b, a; a = 1.0f;
+	//device_texture_read_from_material(device, u, v, r, g, b, a);
+	//printf("%lf %lf %lf %lf\n", r, g, b, a);
+	s_vector material_ambient;
+	if (scene_material(device->assets, count)->have_diffuse == 1)
+		texture_read(material_ambient, &scene_material(device->assets, count)->diffuse_texture, u, v, ff->duv, device->texture_filter);
+	else material_ambient = init_diffuse;
+	s_vector ambient = light_ambient * material_ambient;
+	ambient.float_dot(ff->occlusion);
+	//ambient.show();
+
+	// diffuse
+	s_vector norm = ff->normal;
+	s_vector fragpos = ff->pos;
+	s_vector lightDir = normalize(lightpos - fragpos);
+	//lightDir.show();
+	float diff = max(dot(norm, lightDir), 0.0f);
+	//if (diff > 0.0f) { printf("%lf\n", diff); norm.show(); }
+	s_vector material_diffuse = material_ambient;
+	s_vector diffuse = light_diffuse * diff * material_diffuse;
+
+	//specular ߹
+	float material_shininess; material_shininess = scene_material(device->assets, count)->shininess;
+	//get the view pos
+	s_vector viewpos = device->camera.viewpos;
+	s_vector viewdir = normalize(viewpos - fragpos);
+	s_vector reflectdir = reflect(-lightDir, norm);
+	float spec = pow(max(dot(viewdir, reflectdir), 0.0f), material_shininess);
+	s_vector specular = light_specular;
+	specular.float_dot(spec);
+
+	s_vector material_specular;
+	if (scene_material(device->assets, count)->have_specular == 1)
+		texture_read(material_specular, &scene_material(device->assets, count)->specular_texture, u, v, ff->duv, device->texture_filter);
+	else material_specular = init_specular;
+	specular.dot_two(specular, material_specular);
+	//specular.show();
+	if (device->shadow != NULL)
+	{
+		float shadow = device_shadow(device, ff);
+		diffuse.float_dot(shadow); specular.float_dot(shadow);
+	}
+	result = ambient + diffuse + specular;
+	s_vector tile_diffuse, tile_specular;
+	if (tile_lights_phong(device, ff, norm, viewdir, material_shininess, tile_diffuse, tile_specular))
+	{
+		tile_diffuse.dot_two(tile_diffuse, material_diffuse);
+		tile_specular.dot_two(tile_specular, material_specular);
+		result.add(tile_diffuse); result.add(tile_specular);
+	}
+	//result.dot_two(result, objectcolor);
+	//result.show();
 
-			s_vector tmp7; tmp7.add_two(the_color, the_1);
-			the_color.divide_two(the_color, tmp7);
+	color.r = result.x;
+	color.g = result.y;
+	color.b = result.z;
+	color.a = result.w;
 
-			float gamma = 2.2;
 
-			float xx = the_color.x; float yy = the_color.y; float zz = the_color.z;
-			xx = pow(xx, 1.0f / gamma);
-			yy = pow(yy, 1.0f / gamma);
-			zz = pow(zz, 1.0f / gamma);
-			the_color.reset(xx, yy, zz, the_color.w);
+	/*
+	color.r = ff->color.r;
+	color.g = ff->color.g;
+	color.b = ff->color.b;
+	color.a = ff->color.a;
+	*/
+}
 
-			color.r = the_color.x;
-			color.g = the_color.y;
-			color.b = the_color.z;
-			color.a = 1.0f;
-		}
+// now_state 4: shade_phong_texture with alpha test and blending
+static void shade_phong_blend(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co)
+{
+	s_vector init_diffuse(0.64, 0.64, 0.64, 1.0f);
+	s_vector init_specular(0.5, 0.5, 0.5, 1.0f);
+	float u = ff->texcoord.u; float v = ff->texcoord.v;
+	s_vector result(0.0f, 0.0f, 0.0f, 1.0f);
+	s_vector lightpos;
+	const s_vector& light_ambient = device->pointlight[0].ambient;
+	const s_vector& light_diffuse = device->pointlight[0].diffuse;
+	const s_vector& light_specular = device->pointlight[0].specular;
+	lightpos = device->pointlight[0].lightpos;
+	s_vector objectcolor(ff->color.r, ff->color.g, ff->color.b, ff->color.a);
+	// ambient
+
+	//float r, g, b, a; a = 1.0f;
+	//device_texture_read_from_material(device, u, v, r, g, b, a);
+	//printf("%lf %lf %lf %lf\n", r, g, b, a);
+	s_vector material_ambient;
+	if (scene_material(device->assets, count)->have_diffuse == 1)
+		texture_read(material_ambient, &scene_material(device->assets, count)->diffuse_texture, u, v, ff->duv, device->texture_filter);
+	else material_ambient = init_diffuse;
+	if (material_ambient.w < 0.1f)
+	{
+		is_ban = 1; return;
 	}
-	else if (now_num == 1)
-	{
-	if (count == 1)
-	{
-		s_vector result(0.0f, 0.0f, 0.0f, 1.0f);
-		s_vector lightcolor; s_vector lightpos;
-		lightcolor = device->pointlight[0].lightcolor;
-		lightpos = device->pointlight[0].lightpos;
-		s_vector objectcolor(ff->color.r, ff->color.g, ff->color.b, ff->color.a);
-		// ambient
-		float ambientStrength = device->m1;
-		s_vector ambient;
-		ambient = lightcolor;
-		ambient.float_dot(ambientStrength);
-
-		// diffuse
-		s_vector norm = ff->normal;
-		s_vector fragpos = ff->pos;
-		s_vector lightDir; lightDir.minus_two(lightpos, fragpos); lightDir.normalize();
-		//lightDir.show();
-		float diff = max(norm.dotproduct(lightDir), 0.0f);
-		//if (diff > 0.0f) { printf("%lf\n", diff); norm.show(); }
-		s_vector diffuse; diffuse = lightcolor; diffuse.float_dot(diff);
-
-		//specular ߹
-		float specularstrength = device->m2;
-		//get the view pos
-		s_vector viewpos = device->camera.viewpos;
-		s_vector viewdir; viewdir.minus_two(viewpos, fragpos); viewdir.normalize();
-		s_vector in_lightdir; in_lightdir = lightDir; in_lightdir.inverse();
-		s_vector reflectdir; reflectdir.reflect(in_lightdir, norm);
-		float spec = pow(max(viewdir.dotproduct(reflectdir), 0.0f), 128);
-		s_vector specular = lightcolor;
-		specular.float_dot(spec); specular.float_dot(specularstrength);
-
-		result.add_two(ambient, diffuse); result.add_two(result, specular);
-		result.dot_two(result, objectcolor);
-
-		color.r = result.x;
-		color.g = result.y;
-		color.b = result.z;
-		color.a = result.w;
-		/*
-
-		color.r = ff->color.r;
-		color.g = ff->color.g;
-		color.b = ff->color.b;
-		color.a = ff->color.a;
-		*/
-
+	else
+		if (ori_co.x != -1.0f)
+		{
+			float a1 = material_ambient.w; float a2 = 1.0f - a1;
+			material_ambient = material_ambient * a1 + ori_co * a2;
+		}
 
-	}
-	else if (count == 2)
+	s_vector ambient = light_ambient * material_ambient;
+	ambient.float_dot(ff->occlusion);
+	//ambient.show();
+
+	// diffuse
+	s_vector norm = ff->normal;
+	s_vector fragpos = ff->pos;
+	s_vector lightDir = normalize(lightpos - fragpos);
+	//lightDir.show();
+	float diff = max(dot(norm, lightDir), 0.0f);
+	//if (diff > 0.0f) { printf("%lf\n", diff); norm.show(); }
+	s_vector material_diffuse = material_ambient;
+	s_vector diffuse = light_diffuse * diff * material_diffuse;
+
+	//specular ߹
+	float material_shininess; material_shininess = scene_material(device->assets, count)->shininess;
+	//get the view pos
+	s_vector viewpos = device->camera.viewpos;
+	s_vector viewdir = normalize(viewpos - fragpos);
+	s_vector reflectdir = reflect(-lightDir, norm);
+	float spec = pow(max(dot(viewdir, reflectdir), 0.0f), material_shininess);
+	s_vector specular = light_specular;
+	specular.float_dot(spec);
+
+	s_vector material_specular;
+	if (scene_material(device->assets, count)->have_specular == 1)
+		texture_read(material_specular, &scene_material(device->assets, count)->specular_texture, u, v, ff->duv, device->texture_filter);
+	else material_specular = init_specular;
+	specular.dot_two(specular, material_specular);
+	//specular.show();
+	if (device->shadow != NULL)
 	{
-		color.r = ff->color.r;
-		color.g = ff->color.g;
-		color.b = ff->color.b;
-		color.a = ff->color.a;
+		float shadow = device_shadow(device, ff);
+		diffuse.float_dot(shadow); specular.float_dot(shadow);
 	}
-    }
-	else if (now_num == 2)
-	{
-	if (count == 2)
+	result = ambient + diffuse + specular;
+	s_vector tile_diffuse, tile_specular;
+	if (tile_lights_phong(device, ff, norm, viewdir, material_shininess, tile_diffuse, tile_specular))
 	{
+		tile_diffuse.dot_two(tile_diffuse, material_diffuse);
+		tile_specular.dot_two(tile_specular, material_specular);
+		result.add(tile_diffuse); result.add(tile_specular);
+	}
+	//result.dot_two(result, objectcolor);
+	//result.show();
+
+	color.r = result.x;
+	color.g = result.y;
+	color.b = result.z;
+	color.a = result.w;
 
 
+	/*
+	color.r = ff->color.r;
+	color.g = ff->color.g;
+	color.b = ff->color.b;
+	color.a = ff->color.a;
+	*/
+}
 
-		color.r = ff->color.r;
-		color.g = ff->color.g;
-		color.b = ff->color.b;
-		color.a = ff->color.a;
+// now_state 5: shade_phong_blend with normal maps
+static void shade_bump_blend(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co)
+{
+	s_vector init_diffuse(0.64, 0.64, 0.64, 1.0f);
+	s_vector init_specular(0.5, 0.5, 0.5, 1.0f);
+	float u = ff->texcoord.u; float v = ff->texcoord.v;
+	s_vector result(0.0f, 0.0f, 0.0f, 1.0f);
+	s_vector lightpos;
+	const s_vector& light_ambient = device->pointlight[0].ambient;
+	const s_vector& light_diffuse = device->pointlight[0].diffuse;
+	const s_vector& light_specular = device->pointlight[0].specular;
+	lightpos = device->pointlight[0].lightpos;
+	//bump
+	/*if (scene_material(device->assets, count)->have_normal == 1)
+		lightpos.reset(dot(ff->storage0, lightpos), dot(ff->storage1, lightpos), dot(ff->storage2, lightpos), 1.0f);
+	*/
 
+	s_vector objectcolor(ff->color.r, ff->color.g, ff->color.b, ff->color.a);
+	// ambient
+
+	//float r, g, b, a; a = 1.0f;
+	//device_texture_read_from_material(device, u, v, r, g, b, a);
+	//printf("%lf %lf %lf %lf\n", r, g, b, a);
+	s_vector material_ambient;
+	if (scene_material(device->assets, count)->have_diffuse == 1)
+		texture_read(material_ambient, &scene_material(device->assets, count)->diffuse_texture, u, v, ff->duv, device->texture_filter);
+	else material_ambient = init_diffuse;
+	if (material_ambient.w < 0.1f)
+	{
+		is_ban = 1; return;
+	}
+	else
+		if (ori_co.x != -1.0f)
+		{
+			float a1 = material_ambient.w; float a2 = 1.0f - a1;
+			material_ambient = material_ambient * a1 + ori_co * a2;
+		}
 
+	s_vector ambient = light_ambient * material_ambient;
+	ambient.float_dot(ff->occlusion);
+	//ambient.show();
 
+	// diffuse
+	s_vector norm;       // = ff->normal
+	if (scene_material(device->assets, count)->have_normal == 1)
+	{
+		// a unit vector in tangent space already, its length doesn't matter before the normalize below
+		texture_read(norm, &scene_material(device->assets, count)->normal_texture, u, v, ff->duv, device->texture_filter);
+		norm.reset(dot(ff->storage0, norm), dot(ff->storage1, norm), dot(ff->storage2, norm), 1.0f);
+		norm.normalize();
 	}
 	else
 	{
-		s_vector init_diffuse(0.64, 0.64, 0.64, 1.0f);
-		s_vector init_specular(0.5, 0.5, 0.5, 1.0f);
-		float u = ff->texcoord.u; float v = ff->texcoord.v;
-		s_vector result(0.0f, 0.0f, 0.0f, 1.0f);
-		s_vector lightpos;
-		s_vector light_ambient; light_ambient = device->pointlight[0].ambient;
-		s_vector light_diffuse; light_diffuse = device->pointlight[0].diffuse;
-		s_vector light_specular; light_specular = device->pointlight[0].specular;
-		lightpos = device->pointlight[0].lightpos;
-		s_vector objectcolor(ff->color.r, ff->color.g, ff->color.b, ff->color.a);
-		// ambient
-
-		//float r, g, b, a; a = 1.0f;
-		//device_texture_read_from_material(device, u, v, r, g, b, a);
-		//printf("%lf %lf %lf %lf\n", r, g, b, a);
-		s_vector material_ambient;
-		if (device->material[count].have_diffuse == 1)
-			read_the_texture(material_ambient, &device->material[count].diffuse_texture, u, v);
-		else material_ambient = init_diffuse;
-		s_vector ambient;                ambient.dot_two(light_ambient, material_ambient);
-		//ambient.show();
-
-		// diffuse
-		s_vector norm = ff->normal;
-		s_vector fragpos = ff->pos;
-		s_vector lightDir; lightDir.minus_two(lightpos, fragpos); lightDir.normalize();
-		//lightDir.show();
-		float diff = max(norm.dotproduct(lightDir), 0.0f);
-		//if (diff > 0.0f) { printf("%lf\n", diff); norm.show(); }
-		s_vector material_diffuse; material_diffuse = material_ambient;
-		s_vector diffuse; diffuse = light_diffuse; diffuse.float_dot(diff); diffuse.dot_two(diffuse, material_diffuse);
-
-		//specular ߹
-		float material_shininess; material_shininess = device->material[count].shininess;
-		//get the view pos
-		s_vector viewpos = device->camera.viewpos;
-		s_vector viewdir; viewdir.minus_two(viewpos, fragpos); viewdir.normalize();
-		s_vector in_lightdir; in_lightdir = lightDir; in_lightdir.inverse();
-		s_vector reflectdir; reflectdir.reflect(in_lightdir, norm);
-		float spec = pow(max(viewdir.dotproduct(reflectdir), 0.0f), material_shininess);
-		s_vector specular = light_specular;
-		specular.float_dot(spec);
-
-		s_vector material_specular;
-		if (device->material[count].have_specular == 1)
-			read_the_texture(material_specular, &device->material[count].specular_texture, u, v);
-		else material_specular = init_specular;
-		specular.dot_two(specular, material_specular);
-		//specular.show();
-		result.add_two(ambient, diffuse); result.add_two(result, specular);
-		//result.dot_two(result, objectcolor);
-		//result.show();
-
-		color.r = result.x;
-		color.g = result.y;
-		color.b = result.z;
-		color.a = result.w;
-
-
-		/*
-		color.r = ff->color.r;
-		color.g = ff->color.g;
-		color.b = ff->color.b;
-		color.a = ff->color.a;
+		norm = ff->normal;
+	}
+
+	s_vector fragpos = ff->pos;
+	//bump
+	/*if (scene_material(device->assets, count)->have_normal == 1)
+		fragpos.reset(dot(ff->storage0, fragpos), dot(ff->storage1, fragpos), dot(ff->storage2, fragpos), 1.0f);
 		*/
 
+	s_vector lightDir = normalize(lightpos - fragpos);
+	//lightDir.show();
+	float diff = max(dot(norm, lightDir), 0.0f);
+	//if (diff > 0.0f) { printf("%lf\n", diff); norm.show(); }
+	s_vector material_diffuse = material_ambient;
+	s_vector diffuse = light_diffuse * diff * material_diffuse;
+
+	//specular ߹
+	float material_shininess; material_shininess = scene_material(device->assets, count)->shininess;
+	//get the view pos
+	s_vector viewpos = device->camera.viewpos;
+	//bump
+	/*if (scene_material(device->assets, count)->have_normal == 1)
+		viewpos.reset(dot(ff->storage0, viewpos), dot(ff->storage1, viewpos), dot(ff->storage2, viewpos), 1.0f);
+		*/
 
-	}
-    }
-	else if (now_num == 3)
+	s_vector viewdir = normalize(viewpos - fragpos);
+	s_vector reflectdir = reflect(-lightDir, norm);
+	float spec = pow(max(dot(viewdir, reflectdir), 0.0f), material_shininess);
+	s_vector specular = light_specular;
+	specular.float_dot(spec);
+
+	s_vector material_specular;
+	if (scene_material(device->assets, count)->have_specular == 1)
+		texture_read(material_specular, &scene_material(device->assets, count)->specular_texture, u, v, ff->duv, device->texture_filter);
+	else material_specular = init_specular;
+	specular.dot_two(specular, material_specular);
+	//specular.show();
+	if (device->shadow != NULL)
 	{
-	if (count == 2)
+		float shadow = device_shadow(device, ff);
+		diffuse.float_dot(shadow); specular.float_dot(shadow);
+	}
+	result = ambient + diffuse + specular;
+	s_vector tile_diffuse, tile_specular;
+	if (tile_lights_phong(device, ff, norm, viewdir, material_shininess, tile_diffuse, tile_specular))
 	{
+		tile_diffuse.dot_two(tile_diffuse, material_diffuse);
+		tile_specular.dot_two(tile_specular, material_specular);
+		result.add(tile_diffuse); result.add(tile_specular);
+	}
+	//result.dot_two(result, objectcolor);
+	//result.show();
 
+	//gamma 
+	/*float gamma = 2.2;
 
+	float xx = result.x; float yy = result.y; float zz = result.z;
+	xx = pow(xx, 1.0f / gamma);
+	yy = pow(yy, 1.0f / gamma);
+	zz = pow(zz, 1.0f / gamma);
+	result.reset(xx, yy, zz, result.w);
+	*/
 
-		color.r = ff->color.r;
-		color.g = ff->color.g;
-		color.b = ff->color.b;
-		color.a = ff->color.a;
+	color.r = result.x;
+	color.g = result.y;
+	color.b = result.z;
+	color.a = result.w;
 
 
+	/*
+	color.r = ff->color.r;
+	color.g = ff->color.g;
+	color.b = ff->color.b;
+	color.a = ff->color.a;
+	*/
+}
 
-	}
-	else
-	{
-		s_vector init_diffuse(0.64, 0.64, 0.64, 1.0f);
-		s_vector init_specular(0.5, 0.5, 0.5, 1.0f);
-		float u = ff->texcoord.u; float v = ff->texcoord.v;
-		s_vector result(0.0f, 0.0f, 0.0f, 1.0f);
-		s_vector lightpos;
-		s_vector light_ambient; light_ambient = device->pointlight[0].ambient;
-		s_vector light_diffuse; light_diffuse = device->pointlight[0].diffuse;
-		s_vector light_specular; light_specular = device->pointlight[0].specular;
-		lightpos = device->pointlight[0].lightpos;
-		s_vector objectcolor(ff->color.r, ff->color.g, ff->color.b, ff->color.a);
-		// ambient
-
-		//float r, g, b, a; a = 1.0f;
-		//device_texture_read_from_material(device, u, v, r, g, b, a);
-		//printf("%lf %lf %lf %lf\n", r, g, b, a);
-		s_vector material_ambient;
-		if (device->material[count].have_diffuse == 1)
-			read_the_texture(material_ambient, &device->material[count].diffuse_texture, u, v);
-		else material_ambient = init_diffuse;
-		s_vector ambient;                ambient.dot_two(light_ambient, material_ambient);
-		//ambient.show();
-
-		// diffuse
-		s_vector norm = ff->normal;
-		s_vector fragpos = ff->pos;
-		s_vector lightDir; lightDir.minus_two(lightpos, fragpos); lightDir.normalize();
-		//lightDir.show();
-		float diff = max(norm.dotproduct(lightDir), 0.0f);
-		//if (diff > 0.0f) { printf("%lf\n", diff); norm.show(); }
-		s_vector material_diffuse; material_diffuse = material_ambient;
-		s_vector diffuse; diffuse = light_diffuse; diffuse.float_dot(diff); diffuse.dot_two(diffuse, material_diffuse);
-
-		//specular ߹
-		float material_shininess; material_shininess = device->material[count].shininess;
-		//get the view pos
-		s_vector viewpos = device->camera.viewpos;
-		s_vector viewdir; viewdir.minus_two(viewpos, fragpos); viewdir.normalize();
-		s_vector in_lightdir; in_lightdir = lightDir; in_lightdir.inverse();
-		s_vector reflectdir; reflectdir.reflect(in_lightdir, norm);
-		float spec = pow(max(viewdir.dotproduct(reflectdir), 0.0f), material_shininess);
-		s_vector specular = light_specular;
-		specular.float_dot(spec);
-
-		s_vector material_specular;
-		if (device->material[count].have_specular == 1)
-			read_the_texture(material_specular, &device->material[count].specular_texture, u, v);
-		else material_specular = init_specular;
-		specular.dot_two(specular, material_specular);
-		//specular.show();
-		result.add_two(ambient, diffuse); result.add_two(result, specular);
-		//result.dot_two(result, objectcolor);
-		//result.show();
-
-		color.r = result.x;
-		color.g = result.y;
-		color.b = result.z;
-		color.a = result.w;
-
-
-		/*
-		color.r = ff->color.r;
-		color.g = ff->color.g;
-		color.b = ff->color.b;
-		color.a = ff->color.a;
-		*/
+// now_state 6: cook torrance with the constants of device->PBR or of the instance
+static void shade_pbr(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co)
+{
+	const s_PBR& pbr = fragment_pbr(device, ff);
+	s_vector albedo; albedo = pbr.albedo;
+	float metallic = pbr.metallic;
+	s_vector v_metallic(metallic, metallic, metallic, 1.0f);
+	float roughness = pbr.roughness;
+	float ao = pbr.ao * ff->occlusion;
+	s_vector N; N = ff->normal;
+	s_vector camPos; camPos = device->camera.viewpos; s_vector WorldPos; WorldPos = ff->pos;
+	s_vector V = normalize(camPos - WorldPos);
 
+	s_vector F0(0.04f, 0.04f, 0.04f, 1.0f);
 
-	}
+	F0 = lerp(F0, albedo, metallic);
 
-    }
-	else if (now_num == 4)
-	{
-	if (count == 2)
-	{
+	s_vector Lo(0.0f, 0.0f, 0.0f, 1.0f);
 
+	//do the light
+	s_vector lightcolor; s_vector lightpos;
+	lightcolor = device->pointlight[0].lightcolor;
+	lightpos = device->pointlight[0].lightpos;
 
+	s_vector L = normalize(lightpos - WorldPos);
+	s_vector H = normalize(V + L);
 
-		color.r = ff->color.r;
-		color.g = ff->color.g;
-		color.b = ff->color.b;
-		color.a = ff->color.a;
+	float distance = L.length();
+	float attenuation = 1.0f / (distance * distance);
+	s_vector radiance = lightcolor * attenuation;
 
+	//cook-Torrance BRDF
+	float NDF, G; s_vector F;
+	cook_torrance_terms(device, N, V, L, H, roughness, F0, NDF, G, F);
 
+	s_vector numerator;  numerator = F;
+	float tmp2 = NDF * G;   numerator.float_dot(tmp2);
+	float denominator = 4.0f * max(dot(N, V), 0.0f) * max(dot(N, L), 0.0f) + 0.0001f;
+	s_vector specular = numerator;
+	specular.float_dot(1.0f / denominator);
 
-	}
-	else
-	{
-		s_vector init_diffuse(0.64, 0.64, 0.64, 1.0f);
-		s_vector init_specular(0.5, 0.5, 0.5, 1.0f);
-		float u = ff->texcoord.u; float v = ff->texcoord.v;
-		s_vector result(0.0f, 0.0f, 0.0f, 1.0f);
-		s_vector lightpos;
-		s_vector light_ambient; light_ambient = device->pointlight[0].ambient;
-		s_vector light_diffuse; light_diffuse = device->pointlight[0].diffuse;
-		s_vector light_specular; light_specular = device->pointlight[0].specular;
-		lightpos = device->pointlight[0].lightpos;
-		s_vector objectcolor(ff->color.r, ff->color.g, ff->color.b, ff->color.a);
-		// ambient
-
-		//float r, g, b, a; a = 1.0f;
-		//device_texture_read_from_material(device, u, v, r, g, b, a);
-		//printf("%lf %lf %lf %lf\n", r, g, b, a);
-		s_vector material_ambient;
-		if (device->material[count].have_diffuse == 1)
-			read_the_texture(material_ambient, &device->material[count].diffuse_texture, u, v);
-		else material_ambient = init_diffuse;
-		if (material_ambient.w < 0.1f)
-		{
-			is_ban = 1; return;
-		}
-		else
-			if (ori_co.x != -1.0f)
-			{
-				float a1 = material_ambient.w; float a2 = 1.0f - a1;
-				s_vector tmp1; tmp1 = material_ambient; tmp1.float_dot(a1);
-				s_vector tmp2; tmp2 = ori_co; tmp2.float_dot(a2);
-				material_ambient.add_two(tmp1, tmp2);
-			}
+	s_vector kS; kS = F;
 
-		s_vector ambient;                ambient.dot_two(light_ambient, material_ambient);
-		//ambient.show();
-
-		// diffuse
-		s_vector norm = ff->normal;
-		s_vector fragpos = ff->pos;
-		s_vector lightDir; lightDir.minus_two(lightpos, fragpos); lightDir.normalize();
-		//lightDir.show();
-		float diff = max(norm.dotproduct(lightDir), 0.0f);
-		//if (diff > 0.0f) { printf("%lf\n", diff); norm.show(); }
-		s_vector material_diffuse; material_diffuse = material_ambient;
-		s_vector diffuse; diffuse = light_diffuse; diffuse.float_dot(diff); diffuse.dot_two(diffuse, material_diffuse);
-
-		//specular ߹
-		float material_shininess; material_shininess = device->material[count].shininess;
-		//get the view pos
-		s_vector viewpos = device->camera.viewpos;
-		s_vector viewdir; viewdir.minus_two(viewpos, fragpos); viewdir.normalize();
-		s_vector in_lightdir; in_lightdir = lightDir; in_lightdir.inverse();
-		s_vector reflectdir; reflectdir.reflect(in_lightdir, norm);
-		float spec = pow(max(viewdir.dotproduct(reflectdir), 0.0f), material_shininess);
-		s_vector specular = light_specular;
-		specular.float_dot(spec);
-
-		s_vector material_specular;
-		if (device->material[count].have_specular == 1)
-			read_the_texture(material_specular, &device->material[count].specular_texture, u, v);
-		else material_specular = init_specular;
-		specular.dot_two(specular, material_specular);
-		//specular.show();
-		result.add_two(ambient, diffuse); result.add_two(result, specular);
-		//result.dot_two(result, objectcolor);
-		//result.show();
-
-		color.r = result.x;
-		color.g = result.y;
-		color.b = result.z;
-		color.a = result.w;
-
-
-		/*
-		color.r = ff->color.r;
-		color.g = ff->color.g;
-		color.b = ff->color.b;
-		color.a = ff->color.a;
-		*/
+	s_vector the_1(1.0f, 1.0f, 1.0f, 1.0f);
+	s_vector kD = -kS + the_1;
 
 
-	}
-    }
-	else if (now_num == 5)
-	{
-	if (count == 2)
-	{
+	kD.float_dot(1.0f - metallic);
 
+	float NdotL = max(dot(N, L), 0.0f);
 
+	s_vector get1 = kD * albedo * (1.0f / PI) + specular;
+	s_vector get2 = radiance * NdotL;
+	get1.dot_two(get1, get2);
+	if (device->shadow != NULL) get1.float_dot(device_shadow(device, ff));
+	Lo.add(get1);
+	tile_lights_pbr(device, ff, N, V, albedo, F0, metallic, roughness, Lo);
 
-		color.r = ff->color.r;
-		color.g = ff->color.g;
-		color.b = ff->color.b;
-		color.a = ff->color.a;
 
+	//ambient lighting
+	s_vector tmp8(0.03f, 0.03f, 0.03f, 1.0f);
+	s_vector ambient = tmp8 * albedo * ao;
+	if (device->ibl != NULL) ibl_ambient_pbr(device, N, V, albedo, F0, metallic, roughness, ao, ambient);
 
+	s_vector the_color = ambient + Lo;
 
-	}
-	else
+	// with HDR the post pass tone maps the radiance
+	if (!hdr_active(device->hdr))
 	{
-		s_vector init_diffuse(0.64, 0.64, 0.64, 1.0f);
-		s_vector init_specular(0.5, 0.5, 0.5, 1.0f);
-		float u = ff->texcoord.u; float v = ff->texcoord.v;
-		s_vector result(0.0f, 0.0f, 0.0f, 1.0f);
-		s_vector lightpos;
-		s_vector light_ambient; light_ambient = device->pointlight[0].ambient;
-		s_vector light_diffuse; light_diffuse = device->pointlight[0].diffuse;
-		s_vector light_specular; light_specular = device->pointlight[0].specular;
-		lightpos = device->pointlight[0].lightpos;
-		//bump
-		/*if (device->material[count].have_normal == 1)
-			lightpos.reset(ff->storage0.dotproduct(lightpos), ff->storage1.dotproduct(lightpos), ff->storage2.dotproduct(lightpos), 1.0f);
-		*/
+		s_vector tmp7 = the_color + the_1;
+		the_color.divide_two(the_color, tmp7);
 
-		s_vector objectcolor(ff->color.r, ff->color.g, ff->color.b, ff->color.a);
-		// ambient
-
-		//float r, g, b, a; a = 1.0f;
-		//device_texture_read_from_material(device, u, v, r, g, b, a);
-		//printf("%lf %lf %lf %lf\n", r, g, b, a);
-		s_vector material_ambient;
-		if (device->material[count].have_diffuse == 1)
-			read_the_texture(material_ambient, &device->material[count].diffuse_texture, u, v);
-		else material_ambient = init_diffuse;
-		if (material_ambient.w < 0.1f)
-		{
-			is_ban = 1; return;
-		}
-		else
-			if (ori_co.x != -1.0f)
-			{
-				float a1 = material_ambient.w; float a2 = 1.0f - a1;
-				s_vector tmp1; tmp1 = material_ambient; tmp1.float_dot(a1);
-				s_vector tmp2; tmp2 = ori_co; tmp2.float_dot(a2);
-				material_ambient.add_two(tmp1, tmp2);
-			}
+		float xx = the_color.x; float yy = the_color.y; float zz = the_color.z;
+		xx = gamma_encode(xx);
+		yy = gamma_encode(yy);
+		zz = gamma_encode(zz);
+		the_color.reset(xx, yy, zz, the_color.w);
+	}
 
-		s_vector ambient;                ambient.dot_two(light_ambient, material_ambient);
-		//ambient.show();
+	color.r = the_color.x;
+	color.g = the_color.y;
+	color.b = the_color.z;
+	color.a = 1.0f;
+}
 
-		// diffuse
-		s_vector norm;       // = ff->normal
-		if (device->material[count].have_normal == 1)
-		{
-			read_the_texture(norm, &device->material[count].normal_texture, u, v);
-			norm.float_dot(2.0f);
-			s_vector tmp_1(1.0f, 1.0f, 1.0f, 1.0f);
-			norm.minus_two(norm, tmp_1);
-			norm.normalize();
-			norm.reset(ff->storage0.dotproduct(norm), ff->storage1.dotproduct(norm), ff->storage2.dotproduct(norm), 1.0f);
-			norm.normalize();
-		}
-		else
-		{
-			norm = ff->normal;
-		}
+// now_state 7: cook torrance with albedo, orm and normal maps
+static void shade_pbr_texture(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co)
+{
+	float u = ff->texcoord.u; float v = ff->texcoord.v;
+	//albedo
+	s_vector albedo; texture_read(albedo, &scene_pbr(device->assets, count)->albedo_texture, u, v, ff->duv, device->texture_filter);
+
+	//ao, roughness, metallic in one fetch
+	const t_PBR* t = scene_pbr(device->assets, count);
+	const s_PBR& pbr = fragment_pbr(device, ff);
+	s_vector orm; orm.reset(pbr.ao, pbr.roughness, pbr.metallic, 1.0f);
+	if (t->orm_channels != 0) texture_read(orm, &t->orm_texture, u, v, ff->duv, device->texture_filter);
+	float metallic = (t->orm_channels & ORM_CHANNEL_METALLIC) ? orm.z : pbr.metallic;
+	float roughness = (t->orm_channels & ORM_CHANNEL_ROUGHNESS) ? orm.y : pbr.roughness;
+	float ao = ((t->orm_channels & ORM_CHANNEL_AO) ? orm.x : pbr.ao) * ff->occlusion;
+	//normal
+	s_vector N; N = ff->normal;
+
+	//get the norm
+	if (scene_material(device->assets, count)->have_normal == 1)
+	{
 
-		s_vector fragpos = ff->pos;
-		//bump
-		/*if (device->material[count].have_normal == 1)
-			fragpos.reset(ff->storage0.dotproduct(fragpos), ff->storage1.dotproduct(fragpos), ff->storage2.dotproduct(fragpos), 1.0f);
-			*/
-
-		s_vector lightDir; lightDir.minus_two(lightpos, fragpos); lightDir.normalize();
-		//lightDir.show();
-		float diff = max(norm.dotproduct(lightDir), 0.0f);
-		//if (diff > 0.0f) { printf("%lf\n", diff); norm.show(); }
-		s_vector material_diffuse; material_diffuse = material_ambient;
-		s_vector diffuse; diffuse = light_diffuse; diffuse.float_dot(diff); diffuse.dot_two(diffuse, material_diffuse);
-
-		//specular ߹
-		float material_shininess; material_shininess = device->material[count].shininess;
-		//get the view pos
-		s_vector viewpos = device->camera.viewpos;
-		//bump
-		/*if (device->material[count].have_normal == 1)
-			viewpos.reset(ff->storage0.dotproduct(viewpos), ff->storage1.dotproduct(viewpos), ff->storage2.dotproduct(viewpos), 1.0f);
-			*/
-
-		s_vector viewdir; viewdir.minus_two(viewpos, fragpos); viewdir.normalize();
-		s_vector in_lightdir; in_lightdir = lightDir; in_lightdir.inverse();
-		s_vector reflectdir; reflectdir.reflect(in_lightdir, norm);
-		float spec = pow(max(viewdir.dotproduct(reflectdir), 0.0f), material_shininess);
-		s_vector specular = light_specular;
-		specular.float_dot(spec);
-
-		s_vector material_specular;
-		if (device->material[count].have_specular == 1)
-			read_the_texture(material_specular, &device->material[count].specular_texture, u, v);
-		else material_specular = init_specular;
-		specular.dot_two(specular, material_specular);
-		//specular.show();
-		result.add_two(ambient, diffuse); result.add_two(result, specular);
-		//result.dot_two(result, objectcolor);
-		//result.show();
-
-		//gamma 
-		/*float gamma = 2.2;
-
-		float xx = result.x; float yy = result.y; float zz = result.z;
-		xx = pow(xx, 1.0f / gamma);
-		yy = pow(yy, 1.0f / gamma);
-		zz = pow(zz, 1.0f / gamma);
-		result.reset(xx, yy, zz, result.w);
-		*/
+		s_vector norm;
+		// a unit vector in tangent space already, its length doesn't matter before the normalize below
+		texture_read(norm, &scene_material(device->assets, count)->normal_texture, u, v, ff->duv, device->texture_filter);
+		norm.reset(dot(ff->storage0, norm), dot(ff->storage1, norm), dot(ff->storage2, norm), 1.0f);
+		norm.normalize();
+		N = norm;
+	}
 
-		color.r = result.x;
-		color.g = result.y;
-		color.b = result.z;
-		color.a = result.w;
 
 
-		/*
-		color.r = ff->color.r;
-		color.g = ff->color.g;
-		color.b = ff->color.b;
-		color.a = ff->color.a;
-		*/
+	s_vector camPos; camPos = device->camera.viewpos; s_vector WorldPos; WorldPos = ff->pos;
+	s_vector V = normalize(camPos - WorldPos);
 
+	s_vector F0(0.04f, 0.04f, 0.04f, 1.0f);
 
-	}
-    }
-	else if (now_num == 6)
-	{
-	if (count == 2)
-	{
+	F0 = lerp(F0, albedo, metallic);
 
+	s_vector Lo(0.0f, 0.0f, 0.0f, 1.0f);
 
+	//do the light
+	s_vector lightcolor; s_vector lightpos;
+	lightcolor = device->pointlight[0].lightcolor;
+	lightpos = device->pointlight[0].lightpos;
 
-		color.r = ff->color.r;
-		color.g = ff->color.g;
-		color.b = ff->color.b;
-		color.a = ff->color.a;
+	s_vector L = normalize(lightpos - WorldPos);
+	s_vector H = normalize(V + L);
 
+	float distance = L.length();
+	float attenuation = 1.0f / (distance * distance);
+	s_vector radiance = lightcolor * attenuation;
 
+	//cook-Torrance BRDF
+	float NDF, G; s_vector F;
+	cook_torrance_terms(device, N, V, L, H, roughness, F0, NDF, G, F);
 
-	}
-	else
-	{
-		s_vector albedo; albedo = device->PBR.albedo;
-		float metallic = device->PBR.metallic;
-		s_vector v_metallic(metallic, metallic, metallic, 1.0f);
-		float roughness = device->PBR.roughness;
-		float ao = device->PBR.ao;
-		s_vector N; N = ff->normal;
-		s_vector camPos; camPos = device->camera.viewpos; s_vector WorldPos; WorldPos = ff->pos;
-		s_vector V; V.minus_two(camPos, WorldPos); V.normalize();
+	s_vector numerator;  numerator = F;
+	float tmp2 = NDF * G;   numerator.float_dot(tmp2);
+	float denominator = 4.0f * max(dot(N, V), 0.0f) * max(dot(N, L), 0.0f) + 0.0001f;
+	s_vector specular = numerator;
+	specular.float_dot(1.0f / denominator);
 
-		s_vector F0(0.04f, 0.04f, 0.04f, 1.0f);
+	s_vector kS; kS = F;
 
-		F0.interp_two(F0, albedo, metallic);
+	s_vector the_1(1.0f, 1.0f, 1.0f, 1.0f);
+	s_vector kD = -kS + the_1;
 
-		s_vector Lo(0.0f, 0.0f, 0.0f, 1.0f);
 
-		//do the light
-		s_vector lightcolor; s_vector lightpos;
-		lightcolor = device->pointlight[0].lightcolor;
-		lightpos = device->pointlight[0].lightpos;
+	kD.float_dot(1.0f - metallic);
 
-		s_vector L; L.minus_two(lightpos, WorldPos); L.normalize();
-		s_vector H; H.add_two(V, L); H.normalize();
+	float NdotL = max(dot(N, L), 0.0f);
 
-		float distance = L.length();
-		float attenuation = 1.0f / (distance * distance);
-		s_vector radiance; radiance = lightcolor; radiance.float_dot(attenuation);
+	s_vector get1 = kD * albedo * (1.0f / PI) + specular;
+	s_vector get2 = radiance * NdotL;
+	get1.dot_two(get1, get2);
+	if (device->shadow != NULL) get1.float_dot(device_shadow(device, ff));
+	Lo.add(get1);
+	tile_lights_pbr(device, ff, N, V, albedo, F0, metallic, roughness, Lo);
 
-		//cook-Torrance BRDF
-		float NDF = DistributionGGX(N, H, roughness);
-		float G = GeometrySmith(N, V, L, roughness);
-		s_vector F;    float tmp1; tmp1 = H.dotproduct(V); tmp1 = CMID(tmp1, 0.0f, 1.0f);  fresnelSchlick(F, tmp1, F0);
 
-		s_vector numerator;  numerator = F;
-		float tmp2 = NDF * G;   numerator.float_dot(tmp2);
-		float denominator = 4.0f * max(N.dotproduct(V), 0.0f) * max(N.dotproduct(L), 0.0f) + 0.0001f;
-		s_vector specular = numerator;
-		specular.float_dot(1.0f / denominator);
+	//ambient lighting
+	s_vector tmp8(0.03f, 0.03f, 0.03f, 1.0f);
+	s_vector ambient = tmp8 * albedo * ao;
+	if (device->ibl != NULL) ibl_ambient_pbr(device, N, V, albedo, F0, metallic, roughness, ao, ambient);
 
-		s_vector kS; kS = F;
+	s_vector the_color = ambient + Lo;
 
-		s_vector the_1(1.0f, 1.0f, 1.0f, 1.0f);
-		s_vector tmp9; tmp9 = kS; tmp9.inverse(); tmp9.add(the_1);
-		s_vector kD; kD = tmp9;
+	// with HDR the post pass tone maps the radiance
+	if (!hdr_active(device->hdr))
+	{
+		s_vector tmp7 = the_color + the_1;
+		the_color.divide_two(the_color, tmp7);
 
+		float xx = the_color.x; float yy = the_color.y; float zz = the_color.z;
+		xx = gamma_encode(xx);
+		yy = gamma_encode(yy);
+		zz = gamma_encode(zz);
+		the_color.reset(xx, yy, zz, the_color.w);
+	}
 
-		kD.float_dot(1.0f - metallic);
+	color.r = the_color.x;
+	color.g = the_color.y;
+	color.b = the_color.z;
+	color.a = 1.0f;
+}
 
-		float NdotL = max(N.dotproduct(L), 0.0f);
+static void shade_none(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co)
+{
+}
 
-		s_vector get1; get1.dot_two(kD, albedo); get1.float_dot(1.0f / PI);  get1.add(specular);
-		s_vector get2; get2 = radiance; get2.float_dot(NdotL);
-		get1.dot_two(get1, get2);
-		Lo.add(get1);
+static const pipeline_t builtin_pipelines[SHADER_COUNT] = {
+	{ SHADER_NONE, "none", v_shader, shade_none },
+	{ SHADER_LIGHT, "light", v_shader, shade_light },
+	{ SHADER_PHONG_COLOR, "phong color", v_shader, shade_phong_color },
+	{ SHADER_PHONG_TEXTURE, "phong texture", v_shader, shade_phong_texture },
+	{ SHADER_PHONG_BLEND, "phong blend", v_shader, shade_phong_blend },
+	{ SHADER_BUMP_BLEND, "bump blend", v_shader, shade_bump_blend },
+	{ SHADER_PBR, "pbr", v_shader, shade_pbr },
+	{ SHADER_PBR_TEXTURE, "pbr texture", v_shader, shade_pbr_texture },
+};
+
+const pipeline_t* pipeline_builtin(int id)
+{
+	return &builtin_pipelines[id];
+}
 
+const pipeline_t* device_pipeline(device_t* device, int count)
+{
+	if (device->pipeline != NULL) return device->pipeline;
+	const pipeline_t* bound = scene_material(device->assets, count)->pipeline;
+	if (bound != NULL) return bound;
+	if (count == 2) return &builtin_pipelines[SHADER_LIGHT];
+	switch (device->now_state)
+	{
+	case 1: return &builtin_pipelines[count == 1 ? SHADER_PHONG_COLOR : SHADER_NONE];
+	case 2:
+	case 3: return &builtin_pipelines[SHADER_PHONG_TEXTURE];
+	case 4: return &builtin_pipelines[SHADER_PHONG_BLEND];
+	case 5: return &builtin_pipelines[SHADER_BUMP_BLEND];
+	case 6: return &builtin_pipelines[SHADER_PBR];
+	case 7: return &builtin_pipelines[SHADER_PBR_TEXTURE];
+	}
+	return &builtin_pipelines[SHADER_NONE];
+}
 
-		//ambient lighting
-		s_vector tmp8(0.03f, 0.03f, 0.03f, 1.0f);
-		s_vector ambient; ambient.dot_two(tmp8, albedo);  ambient.float_dot(ao);
+void device_bind_pipeline(device_t* device, const pipeline_t* pipeline)
+{
+	device->pipeline = pipeline;
+}
 
-		s_vector the_color; the_color.add_two(ambient, Lo);
+void device_set_material_pipeline(device_t* device, int count, const pipeline_t* pipeline)
+{
+	scene_assets_material(device->assets, count)->pipeline = pipeline;
+}
 
-		s_vector tmp7; tmp7.add_two(the_color, the_1);
-		the_color.divide_two(the_color, tmp7);
+void f_shader(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co)
+{
+	device_pipeline(device, count)->fragment(device, ff, color, count, is_ban, ori_co);
+}
 
-		float gamma = 2.2;
 
-		float xx = the_color.x; float yy = the_color.y; float zz = the_color.z;
-		xx = pow(xx, 1.0f / gamma);
-		yy = pow(yy, 1.0f / gamma);
-		zz = pow(zz, 1.0f / gamma);
-		the_color.reset(xx, yy, zz, the_color.w);
+void device_set_tile_mode(device_t* device, int threads)
+{
+	tile_context_destory(device->tiler);
+	device->tiler = NULL;
+	device->tile_threads = 0;
+	if (threads == 0) return;
+	device->tiler = tile_context_create(threads, device->width, device->height);
+	device->tile_threads = device->tiler->threads;
+}
 
-		color.r = the_color.x;
-		color.g = the_color.y;
-		color.b = the_color.z;
-		color.a = 1.0f;
-	}
-    }
+void device_tile_begin(device_t* device)
+{
+	// every draw starts here while still single threaded, so the light tiles follow the camera
+	if (device->lights != NULL && !device->shadow_pass) light_list_update(device->lights, device, device->arena);
+	if (device->tiler == NULL) return;
+	// wireframe lines are drawn in submit order on top of the fill, keep that path immediate
+	int render_state = device->render_state;
+	device->tiler->recording = (render_state & (RENDER_STATE_TEXTURE | RENDER_STATE_COLOR)) && !(render_state & RENDER_STATE_WIREFRAME);
 }
 
+void device_tile_end(device_t* device)
+{
+	if (device->tiler == NULL || !device->tiler->recording) return;
+	device->tiler->recording = 0;
+	tile_context_flush(device->tiler, device);
+}
 
-void draw_plane(device_t* device, int num, vertex_t* mesh, int count)
+int f_shader_varyings(device_t* device, int count)
 {
-	vertex_t p1, p2, p3;
-	for (int i = 0; i < num; i += 3)
+	const pipeline_t* pipeline = device_pipeline(device, count);
+	if (pipeline->id == SHADER_LIGHT) return VARYING_COLOR;
+	if (pipeline->id == SHADER_CUSTOM) return VARYING_ALL;
+	const s_material* material = scene_material(device->assets, count);
+	int varyings = VARYING_POS | VARYING_NORMAL;
+	// f_shader_reads_destination samples the diffuse texture for the G-buffer
+	if (material->have_diffuse == 1) varyings |= VARYING_TEXCOORD;
+	switch (pipeline->id)
 	{
-		p1 = mesh[i]; p2 = mesh[i + 1]; p3 = mesh[i + 2];
-		int index_m = p1.material_idex;
-		device_draw_primitive(device, &p1, &p2, &p3, index_m);
+	case SHADER_PHONG_COLOR: return varyings | VARYING_COLOR;
+	case SHADER_PHONG_TEXTURE:
+	case SHADER_PHONG_BLEND: return varyings | VARYING_COLOR | VARYING_TEXCOORD;
+	case SHADER_BUMP_BLEND: return varyings | VARYING_COLOR | VARYING_TEXCOORD | (material->have_normal == 1 ? VARYING_TBN : 0);
+	case SHADER_PBR_TEXTURE: return varyings | VARYING_TEXCOORD | (material->have_normal == 1 ? VARYING_TBN : 0);
 	}
+	return varyings;
+}
 
+bool f_shader_reads_destination(device_t* device, for_fs* ff, int count)
+{
+	// only the blinn-phong scenes 4 and 5 blend the diffuse alpha with the framebuffer
+	if (device->now_state != 4 && device->now_state != 5) return false;
+	if (count == 2 || scene_material(device->assets, count)->have_diffuse != 1) return false;
+	s_vector texel;
+	texture_read(texel, &scene_material(device->assets, count)->diffuse_texture, ff->texcoord.u, ff->texcoord.v, ff->duv, device->texture_filter);
+	return texel.w < 1.0f;
 }
 
-void draw_plane(device_t* device, int num, vector<vertex_t>& mesh, int count)
+// restore the PBR parameters the sample at index was drawn with, pbr is the entry device->PBR holds
+static inline void device_sample_pbr(device_t* device, int index, int& pbr)
 {
-	vertex_t p1, p2, p3;
-	for (int i = 0; i < num; i += 3)
+	gbuffer_t* gbuffer = device->gbuffer;
+	int sample_pbr = gbuffer->samples[index].pbr;
+	if (sample_pbr != pbr && sample_pbr >= 0)
 	{
-		p1 = mesh[i]; p2 = mesh[i + 1]; p3 = mesh[i + 2];
-		int index_m = p1.material_idex;
-		device_draw_primitive(device, &p1, &p2, &p3, index_m);
+		pbr = sample_pbr;
+		device->PBR = gbuffer->pbr[pbr];
 	}
 }
-void draw_plane_STRIP(device_t* device,vector<vertex_t>& mesh, vector<int>& indices, int count)
+
+// the samples of the block [x0, x1) x [y0, y1) at a coarse rate, see coarse.h
+static void device_resolve_block(device_t* device, int x0, int y0, int x1, int y1, int& pbr)
 {
-	vertex_t p1, p2, p3;
-	for (int i = 2; i < indices.size(); i++)
+	gbuffer_t* gbuffer = device->gbuffer;
+	coarse_t* coarse = device->coarse;
+	int width = gbuffer->width;
+	// the drawn sample nearest the middle
+	int best = -1, best_d = 0;
+	for (int y = y0; y < y1; y++)
 	{
-		int id1, id2, id3;
-		if (i % 2 == 0)
+		for (int x = x0; x < x1; x++)
 		{
-			id1 =indices[i - 2]; id2 =indices[i - 1]; id3 = indices[i];
+			if (gbuffer->counts[y * width + x] < 0) continue;
+			int dx = 2 * x + 1 - x0 - x1, dy = 2 * y + 1 - y0 - y1;
+			int d = dx * dx + dy * dy;
+			if (best < 0 || d < best_d) { best = y * width + x; best_d = d; }
 		}
-		else
+	}
+	if (best < 0) return;
+	int bx = best % width, by = best / width, count = gbuffer->counts[best];
+	const g_sample_t* shaded = &gbuffer->samples[best];
+	device_sample_pbr(device, best, pbr);
+	bool written = device_resolve_sample(device, bx, by);
+	coarse->shaded++;
+	hdr_t* hdr = hdr_active(device->hdr) ? device->hdr : NULL;
+	for (int y = y0; y < y1; y++)
+	{
+		for (int x = x0; x < x1; x++)
 		{
-			id1 = indices[i - 1]; id2 = indices[i - 2]; id3 = indices[i];
+			int index = y * width + x;
+			if (gbuffer->counts[index] < 0) continue;
+			const g_sample_t* s = &gbuffer->samples[index];
+			bool take = written && gbuffer->counts[index] == count && s->pbr == shaded->pbr
+				&& fabsf(s->pos.w - shaded->pos.w) <= shaded->pos.w * COARSE_DEPTH
+				&& dot(s->normal, shaded->normal) >= COARSE_NORMAL;
+			if (!take)
+			{
+				device_sample_pbr(device, index, pbr);
+				device_resolve_sample(device, x, y);
+				coarse->shaded++;
+				continue;
+			}
+			gbuffer->counts[index] = -1;
+			if (hdr != NULL)
+			{
+				const float* from = hdr_pixel(hdr, bx, by);
+				float* to = hdr_pixel(hdr, x, y);
+				for (int k = 0; k < 3; k++) to[k] = from[k];
+			}
+			else device_color_row(device, y)[x] = device_color_row(device, by)[bx];
+			coarse->taken++;
 		}
-		p1 = mesh[id1]; p2 = mesh[id2]; p3 = mesh[id3];
-		int index_m = p1.material_idex;
-		device_draw_primitive(device, &p1, &p2, &p3, index_m);
 	}
-
-}
-
-void camera_at_zero(device_t* device, s_vector eye, s_vector at, s_vector up)
-{
-	set_look_at_matrix(device->transform.view, eye, at, up);
-	device->transform.update();
 }
 
-void init_texture(device_t* device)
+static void device_resolve_gbuffer(device_t* device)
 {
-	static IUINT32 texture[256][256];
-	int i, j;
-	for (j = 0; j < 256; j++)
+	gbuffer_t* gbuffer = device->gbuffer;
+	if (gbuffer == NULL || !gbuffer->active) return;
+	s_PBR saved = device->PBR;
+	int pbr = -1;
+	coarse_t* coarse = device->coarse;
+	if (coarse == NULL)
 	{
-		for (i = 0; i < 256; i++)
+		for (int y = 0; y < gbuffer->height; y++)
 		{
-			int x = i / 32;
-			int y = j / 32;
-			texture[j][i] = ((x + y) & 1) ? 0xffffff : 0x3fbcef;
+			for (int x = 0; x < gbuffer->width; x++)
+			{
+				int index = y * gbuffer->width + x;
+				if (gbuffer->counts[index] < 0) continue;
+				device_sample_pbr(device, index, pbr);
+				device_resolve_sample(device, x, y);
+			}
 		}
 	}
-	device_set_texture(device, texture, 256 * 4, 256, 256);
+	else
+	{
+		int tiles_x = (gbuffer->width + COARSE_TILE - 1) / COARSE_TILE;
+		std::vector<unsigned char>& rates = coarse->rates;
+		rates.resize(tiles_x);
+		long long shaded = 0;
+		for (int ty = 0; ty * COARSE_TILE < gbuffer->height; ty++)
+		{
+			int y0 = ty * COARSE_TILE, y1 = std::min(y0 + COARSE_TILE, gbuffer->height);
+			// the tiles without a sample stay 0 and are skipped, found in one pass over the rows of the band
+			std::fill(rates.begin(), rates.end(), 0);
+			for (int y = y0; y < y1; y++)
+			{
+				const int* counts = &gbuffer->counts[y * gbuffer->width];
+				for (int x = 0; x < gbuffer->width; x++)
+					if (counts[x] >= 0) rates[x / COARSE_TILE] = 1;
+			}
+			// the rate looks at the whole tile before any of it is shaded
+			for (int tx = 0; tx < tiles_x; tx++)
+				if (rates[tx] != 0) rates[tx] = (unsigned char)coarse_tile_rate(device, coarse, gbuffer, tx, ty);
+			// the tiles of rate 1 row by row across the band, the G-buffer is read in order like without coarse shading
+			for (int y = y0; y < y1; y++)
+			{
+				for (int x = 0; x < gbuffer->width; x++)
+				{
+					if (rates[x / COARSE_TILE] != 1)
+					{
+						x = (x / COARSE_TILE + 1) * COARSE_TILE - 1;
+						continue;
+					}
+					int index = y * gbuffer->width + x;
+					if (gbuffer->counts[index] < 0) continue;
+					device_sample_pbr(device, index, pbr);
+					device_resolve_sample(device, x, y);
+					shaded++;
+				}
+			}
+			for (int tx = 0; tx < tiles_x; tx++)
+			{
+				int rate = rates[tx];
+				if (rate <= 1) continue;
+				int x1 = std::min((tx + 1) * COARSE_TILE, gbuffer->width);
+				for (int y = y0; y < y1; y += rate)
+					for (int x = tx * COARSE_TILE; x < x1; x += rate)
+						device_resolve_block(device, x, y, std::min(x + rate, x1), std::min(y + rate, y1), pbr);
+			}
+		}
+		coarse->shaded += shaded;
+	}
+	device->PBR = saved;
+	gbuffer->active = 0;
 }
 
-
-void init_texture_by_photo(device_t* device, char const* path)
+// the post passes on the display colour of the frame
+static void device_resolve_post(device_t* device)
 {
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
-	//stbi_image_free(data);
-	unsigned bytePerPixel = nrChannels;
-	//cout << height << " " << width << endl;
+	post_t* post = device->post;
+	if (post == NULL) return;
+	if (post->effects & POST_FXAA)
+	{
+		PROFILE_SCOPE(device, PROFILE_STAGE_FXAA);
+		post_fxaa(post, device->color);
+	}
+	if (post->effects & (POST_GRADE | POST_VIGNETTE))
+	{
+		PROFILE_SCOPE(device, PROFILE_STAGE_GRADE);
+		post_grade(post, device->color);
+	}
+}
 
-	int n = height; int m = width;
+void device_resolve(device_t* device)
+{
+	PROFILE_SCOPE(device, PROFILE_STAGE_RESOLVE);
+	raytrace_t* rt = device->raytrace;
+	if (rt != NULL && rt->capturing)
+	{
+		// the shaded draws only reached the tracer, the other targets hold nothing of the frame
+		raytrace_end(rt, device);
+		raytrace_render(rt, device);
+		if (device->gbuffer != NULL) device->gbuffer->active = 0;
+		if (device->msaa != NULL) device->msaa->active = 0;
+		device_resolve_post(device);
+		return;
+	}
+	// a frame of nothing but G-buffer samples can be shaded again, see relight.h
+	relight_t* relight = device->relight;
+	if (relight != NULL && relight->recording)
+	{
+		relight->recording = 0;
+		bool blended = device->transparent != NULL && !device->transparent->draws.empty();
+		if (device->gbuffer != NULL && device->gbuffer->active && !blended && device->taa == NULL) relight_keep(relight, device->gbuffer);
+	}
+	// the G-buffer positions are gone once it is shaded
+	if (device->taa != NULL) taa_motion(device->taa, device);
+	gbuffer_t* gbuffer = device->gbuffer;
+	if (device->ssao != NULL && gbuffer != NULL && gbuffer->active)
+	{
+		PROFILE_SCOPE(device, PROFILE_STAGE_SSAO);
+		ssao_compute(device->ssao, gbuffer, device->transform.projection.m[1][1] * device->transform.h * 0.5f);
+	}
+	device_resolve_gbuffer(device);
+	if (device->ssao != NULL) device->ssao->active = 0;
+	if (device->msaa != NULL && device->msaa->active)
+	{
+		msaa_resolve(device->msaa, device->color);
+		device->msaa->active = 0;
+	}
+	// blending needs every opaque pixel below in the framebuffer, deferred ones included
+	if (device->transparent != NULL) transparent_list_flush(device->transparent, device);
+	// the history of taa is display colour
+	if (hdr_active(device->hdr))
+	{
+		if (device->post != NULL && (device->post->effects & POST_BLOOM))
+		{
+			PROFILE_SCOPE(device, PROFILE_STAGE_BLOOM);
+			post_bloom(device->post, device->hdr);
+		}
+		PROFILE_SCOPE(device, PROFILE_STAGE_TONEMAP);
+		hdr_resolve(device->hdr, device->color);
+		device->hdr->active = 0;
+	}
+	if (device->taa != NULL) taa_resolve(device->taa, device);
+	// after taa, fxaa of the jittered frames would blur them twice
+	device_resolve_post(device);
+}
 
-	IUINT32** texture = NULL;
-	texture = new IUINT32 * [n];
+bool device_relight_begin(device_t* device)
+{
+	relight_t* relight = device->relight;
+	if (relight == NULL || !relight->kept || device->gbuffer == NULL) return false;
+	// the probe still takes scratch, draw_instanced puts its instances there
+	arena_reset(device->arena);
+	relight->probing = 1;
+	relight->probe = 0;
+	relight->probe_pbr.clear();
+	return true;
+}
 
-	for (int i = 0; i < n; i++)
-		texture[i] = new IUINT32[m];
+bool device_relight_end(device_t* device)
+{
+	relight_t* relight = device->relight;
+	if (relight == NULL || !relight->probing) return false;
+	relight->probing = 0;
+	if (relight->probe != relight->key || !relight_restore(relight, device->gbuffer))
+	{
+		relight->drawn++;
+		return false;
+	}
+	relight->relit++;
+	// what device_clear does for a frame that is only shaded
+	if (device->assets->textures->streamer != NULL) texture_streamer_update(device->assets->textures->streamer);
+	// a frame with a G-buffer never has samples, a tracer or wire frames
+	if (device->hdr != NULL) device->hdr->active = 1;
+	device_clear_color(device, relight->clear_mode);
+	memset(&device->cull_stats, 0, sizeof(device->cull_stats));
+	// the lights may have moved, the probe drew nothing that placed them
+	if (device->lights != NULL) light_list_update(device->lights, device, device->arena);
+	device->gbuffer->active = 1;
+	return true;
+}
 
-	for (int y = 0; y < height; y++)
+// draw_plane walks its triangles twice with RENDER_STATE_DEPTH_PREPASS: depth only, then shading
+static int device_pass_count(device_t* device)
+{
+	int render_state = device->render_state;
+	if (!(render_state & RENDER_STATE_DEPTH_PREPASS) || (render_state & RENDER_STATE_WIREFRAME)) return 1;
+	return (render_state & (RENDER_STATE_TEXTURE | RENDER_STATE_COLOR)) ? 2 : 1;
+}
+
+static void device_pass_begin(device_t* device, int pass, int passes)
+{
+	if (device->shadow_pass) device->raster_pass = RASTER_PASS_DEPTH;
+	else if (passes == 1) device->raster_pass = RASTER_PASS_COLOR;
+	else device->raster_pass = (pass == 0) ? RASTER_PASS_DEPTH : RASTER_PASS_EQUAL;
+}
+
+// shadow_map_update keeps the depth pass up between draws
+static void device_pass_end(device_t* device)
+{
+	device->raster_pass = device->shadow_pass ? RASTER_PASS_DEPTH : RASTER_PASS_COLOR;
+}
+
+#define VERTEX_CHUNK  64         // triangles of one vertex job
+#define VERTEX_WINDOW 2048       // triangles in the post-transform buffer at a time
+
+// one triangle of the post-transform buffer of device_draw_list
+typedef struct
+{
+	vertex_t v[3];           // as device_vertex_stage leaves them, with the screen positions
+	s_vector points[3];
+	for_fs ffs[3];
+	int visible;             // not culled by the vertex stage
+}post_triangle_t;
+
+typedef struct
+{
+	device_t* device;
+	const vertex_t* mesh;    // the first corner of the window
+	const for_vs* world;     // its world space corners, NULL when the vertex stage transforms them
+	post_triangle_t* out;
+}vertex_job_t;
+
+// job of device_draw_list, the vertex stage and the cull of the triangles [begin, end) of the window
+static void device_vertex_job(void* data, int begin, int end)
+{
+	vertex_job_t* job = (vertex_job_t*)data;
+	for (int t = begin; t < end; t++)
 	{
-		for (int x = 0; x < width; x++)
+		post_triangle_t* tri = &job->out[t];
+		for (int k = 0; k < 3; k++) tri->v[k] = job->mesh[t * 3 + k];
+		const for_vs* world = job->world != NULL ? job->world + t * 3 : NULL;
+		tri->visible = device_vertex_stage(job->device, &tri->v[0], &tri->v[1], &tri->v[2], tri->points, tri->ffs, tri->v[0].material_idex, world);
+	}
+}
+
+// the triangle list mesh[0, num) in the current pass. the vertex stage runs in chunks on the job system,
+// the set up and the binning take the triangles of the post-transform buffer in their order after it.
+// buffer holds min(num / 3, VERTEX_WINDOW) triangles, world the world space corners or NULL
+static void device_draw_list(device_t* device, const vertex_t* mesh, int num, const for_vs* world, post_triangle_t* buffer)
+{
+	int tris = num / 3;
+	for (int first = 0; first < tris; first += VERTEX_WINDOW)
+	{
+		int n = std::min(tris - first, VERTEX_WINDOW);
+		vertex_job_t job = { device, mesh + first * 3, world != NULL ? world + first * 3 : NULL, buffer };
+		job_parallel_for(job_system(), 0, n, VERTEX_CHUNK, device_vertex_job, &job);
+		for (int t = 0; t < n; t++)
 		{
+			post_triangle_t* tri = &buffer[t];
+			if (tri->visible) device_draw_setup(device, &tri->v[0], &tri->v[1], &tri->v[2], tri->points, tri->ffs, tri->v[0].material_idex);
+		}
+	}
+}
 
-			unsigned char* pixelOffset = data + (x + y * width) * bytePerPixel;
+static bool device_capturing(device_t* device);
+static void device_capture(device_t* device, const vertex_layout_t* layout, const int* indices, int index_count, int topology);
+static void device_record(device_t* device, const vertex_layout_t* layout, const int* indices, int index_count, int topology);
 
-			unsigned char r = pixelOffset[0];
-			unsigned char g = pixelOffset[1];
-			unsigned char b = pixelOffset[2];
-			unsigned char a = nrChannels >= 4 ? pixelOffset[3] : 0xff;
-			int rr = (int)r; int gg = (int)g;  int bb = (int)b;  int aa = (int)a;
-			int R = rr;
-			int G = gg;
-			int B = bb;
-			int A = aa;
-			R = CMID(R, 0, 255);
-			G = CMID(G, 0, 255);
-			B = CMID(B, 0, 255);
-			A = CMID(A, 0, 255);
-			texture[y][x] = (A << 24) | (R << 16) | (G << 8) | (B);
-			//cout<<(int)r<<" "<<(int)g<<" "<<(int)b<<" "<<(int)a<<endl;
+// fold a shaded draw into the key of device->relight with the material constants its samples get, true
+// while device_relight_begin probes and the draw is to do nothing else
+static bool device_relight_draw(device_t* device, const void* vertices, int count, const void* indices, int index_count, int topology, const s_PBR& pbr)
+{
+	relight_t* relight = device->relight;
+	if (relight == NULL || !(relight->recording || relight->probing) || device->shadow_pass) return false;
+	int render_state = device->render_state;
+	if (!(render_state & (RENDER_STATE_TEXTURE | RENDER_STATE_COLOR)) || (render_state & RENDER_STATE_WIREFRAME)) return false;
+	// the vertices behind the pointers are taken to be the same ones
+	int ints[7] = { count, index_count, topology, render_state, device->raster_mode, device->now_state, device->width * 65536 + device->height };
+	const void* pointers[3] = { vertices, indices, device->pipeline };
+	relight_fold(relight, ints, sizeof(ints));
+	relight_fold(relight, pointers, sizeof(pointers));
+	relight_fold(relight, device->transform.world.m, sizeof(device->transform.world.m));
+	relight_fold(relight, device->transform.vp.m, sizeof(device->transform.vp.m));
+	// the regions of a frame share its view projection
+	float viewport[2] = { device->viewport_x, device->viewport_y };
+	relight_fold(relight, viewport, sizeof(viewport));
+	relight->probe_pbr.push_back(pbr);
+	return relight->probing != 0;
+}
+
+void device_relight_fold(device_t* device, const void* data, size_t bytes)
+{
+	relight_t* relight = device->relight;
+	if (relight == NULL || !(relight->recording || relight->probing) || device->shadow_pass) return;
+	relight_fold(relight, data, bytes);
+}
+
+// the world space corners of mesh[0, num) kept in device->pretransform, transformed again when the mesh
+// or the world matrix changed. NULL without one
+static const for_vs* device_pretransform(device_t* device, const vertex_t* mesh, int num)
+{
+	pretransform_t* cache = device->pretransform;
+	if (cache == NULL || num < 3) return NULL;
+	const s_matrix& world = device->transform.world;
+	if (cache->mesh != mesh || cache->num != num || memcmp(&cache->world.m[0][0], &world.m[0][0], sizeof(world.m)) != 0)
+	{
+		cache->mesh = mesh;
+		cache->num = num;
+		cache->world = world;
+		cache->corners.resize(num);
+		for (int i = 0; i < num; i++)
+		{
+			for_vs* av = &cache->corners[i];
+			av->pos = mesh[i].pos * world;
+			device_world_attributes(device, &mesh[i], av);
 		}
+		cache->builds++;
 	}
-	stbi_image_free(data);
-	device_set_texture_by_photo(device, texture, height * 4, width, height);
-	for (int i = 0; i < n; i++)
+	return &cache->corners[0];
+}
+
+void draw_plane(device_t* device, int num, vertex_t* mesh, int count)
+{
+	multiview_t* mv = multiview_recording(device);
+	if (mv != NULL)
 	{
-		delete[] texture[i];
+		vertex_layout_t layout;
+		vertex_layout_interleaved(&layout, mesh, num);
+		multiview_draw(mv, device, VARYING_ALL);
+		device_record(device, &layout, NULL, num, TOPOLOGY_TRIANGLE_LIST);
+		return;
 	}
-	delete[] texture;
+	if (device_relight_draw(device, mesh, num, NULL, count, TOPOLOGY_TRIANGLE_LIST, device->PBR)) return;
+	if (device_capturing(device))
+	{
+		vertex_layout_t layout;
+		vertex_layout_interleaved(&layout, mesh, num);
+		device_capture(device, &layout, NULL, num, TOPOLOGY_TRIANGLE_LIST);
+		return;
+	}
+	post_triangle_t* buffer = arena_array<post_triangle_t>(device->arena, std::min(num / 3, VERTEX_WINDOW));
+	const for_vs* world = device_pretransform(device, mesh, num);
+	int passes = device_pass_count(device);
+	for (int pass = 0; pass < passes; pass++)
+	{
+		device_pass_begin(device, pass, passes);
+		device_tile_begin(device);
+		device_draw_list(device, mesh, num, world, buffer);
+		device_tile_end(device);
+	}
+	device_pass_end(device);
 }
 
+void draw_plane(device_t* device, int num, vector<vertex_t>& mesh, int count)
+{
+	draw_plane(device, num, mesh.data(), count);
+}
+void draw_plane_transparent(device_t* device, int num, vertex_t* mesh, int count)
+{
+	// blended surfaces do not cast
+	if (device->shadow_pass) return;
+	multiview_t* mv = multiview_recording(device);
+	if (mv != NULL)
+	{
+		multiview_transparent(mv, device, mesh, num);
+		return;
+	}
+	if (device_relight_draw(device, mesh, num, NULL, -1, TOPOLOGY_TRIANGLE_LIST, device->PBR)) return;
+	if (device_capturing(device))
+	{
+		draw_plane(device, num, mesh, count);
+		return;
+	}
+	if (device->transparent == NULL) device->transparent = transparent_list_create();
+	transparent_list_push(device->transparent, device, mesh, num);
+}
 
-void init_texture_by_diffuse(device_t* device, char const* path, int count)
-{  //ͼ
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
-	//stbi_image_free(data);
-	unsigned bytePerPixel = nrChannels;
-	//cout << height << " " << width << endl;
-	int n = height; int m = width;
+// true when bounds are outside the model space frustum planes
+static bool device_frustum_outside(const s_vector* planes, const mesh_group_t* bounds)
+{
+	const s_vector& c = bounds->center;
+	bool straddles = false;
+	bool outside = false;
+	for (int i = 0; i < 6 && !outside; i++)
+	{
+		// the planes of a model space frustum are not normalized
+		const s_vector& f = planes[i];
+		float d = f.x * c.x + f.y * c.y + f.z * c.z + f.w;
+		float r = bounds->radius * sqrtf(f.x * f.x + f.y * f.y + f.z * f.z);
+		if (d < -r) outside = true;
+		else if (d < r) straddles = true;
+	}
+	for (int i = 0; i < 6 && straddles && !outside; i++)
+	{
+		// the box corner farthest along the plane normal
+		const s_vector& f = planes[i];
+		float px = f.x >= 0.0f ? bounds->box_max.x : bounds->box_min.x;
+		float py = f.y >= 0.0f ? bounds->box_max.y : bounds->box_min.y;
+		float pz = f.z >= 0.0f ? bounds->box_max.z : bounds->box_min.z;
+		if (f.x * px + f.y * py + f.z * pz + f.w < 0.0f) outside = true;
+	}
+	return outside;
+}
 
-	IUINT32** texture = NULL;
-	texture = new IUINT32 * [n];
+bool device_cull_bounds(device_t* device, const mesh_group_t* bounds)
+{
+	device->cull_stats.tested++;
+	bool outside = device_frustum_outside(device->transform.frustum, bounds);
+	// a multiview frame keeps what any of its views sees
+	multiview_t* mv = multiview_recording(device);
+	for (size_t i = 0; mv != NULL && outside && i < mv->views.size(); i++)
+	{
+		device_t* view = mv->views[i];
+		if (view == device) continue;
+		view->transform.world = device->transform.world;
+		view->transform.update();
+		outside = device_frustum_outside(view->transform.frustum, bounds);
+	}
+	if (outside)
+	{
+		device->cull_stats.culled++;
+		device->cull_stats.vertices_culled += bounds->count;
+	}
+	return outside;
+}
 
-	for (int i = 0; i < n; i++)
-		texture[i] = new IUINT32[m];
+static float transform_screen_radius(s_transform& t, const mesh_group_t* bounds)
+{
+	const s_vector& c = bounds->center;
+	// clip w is the view depth, the largest axis of world scales the radius
+	float w = c.x * t.transform.m[0][3] + c.y * t.transform.m[1][3] + c.z * t.transform.m[2][3] + t.transform.m[3][3];
+	float scale = 0.0f;
+	for (int i = 0; i < 3; i++)
+		scale = std::max(scale, t.world.m[i][0] * t.world.m[i][0] + t.world.m[i][1] * t.world.m[i][1] + t.world.m[i][2] * t.world.m[i][2]);
+	float radius = bounds->radius * sqrtf(scale);
+	if (w <= radius) return FLT_MAX;
+	return radius * t.projection.m[1][1] * t.h * 0.5f / w;
+}
 
-	for (int y = 0; y < height; y++)
+float device_screen_radius(device_t* device, const mesh_group_t* bounds)
+{
+	float radius = transform_screen_radius(device->transform, bounds);
+	// the finest level any view of a multiview frame needs
+	multiview_t* mv = multiview_recording(device);
+	for (size_t i = 0; mv != NULL && i < mv->views.size(); i++)
 	{
-		for (int x = 0; x < width; x++)
+		device_t* view = mv->views[i];
+		if (view == device) continue;
+		view->transform.world = device->transform.world;
+		view->transform.update();
+		radius = std::max(radius, transform_screen_radius(view->transform, bounds));
+	}
+	return radius;
+}
+
+bool device_occluded_box(device_t* device, const s_vector& box_min, const s_vector& box_max)
+{
+	hiz_t* hiz = device_hiz(device);
+	int render_state = device->render_state;
+	// nothing is drawn while a multiview frame records, and one view's depth doesn't hide for the others
+	if (hiz == NULL || device->shadow_pass || multiview_recording(device) != NULL || !(render_state & (RENDER_STATE_TEXTURE | RENDER_STATE_COLOR)) || (render_state & RENDER_STATE_WIREFRAME))
+		return false;
+	// the same bound as the triangle test of device_draw_triangle, over the corners of the box
+	float left = FLT_MAX, right = -FLT_MAX, top = FLT_MAX, bottom = -FLT_MAX, zmin = FLT_MAX, wmin = FLT_MAX;
+	for (int i = 0; i < 8; i++)
+	{
+		s_vector corner(i & 1 ? box_max.x : box_min.x, i & 2 ? box_max.y : box_min.y, i & 4 ? box_max.z : box_min.z, 1.0f), c, p;
+		apply_to_vector(c, corner, device->transform.vp);
+		if (c.w <= 1e-5f || c.z < 0.0f) return false;
+		device_homogenize(device, p, c);
+		left = std::min(left, p.x); right = std::max(right, p.x);
+		top = std::min(top, p.y); bottom = std::max(bottom, p.y);
+		zmin = std::min(zmin, p.z);
+		wmin = std::min(wmin, c.w);
+	}
+	float zp = device->raster_mode == RASTER_MODE_SCANLINE ? zmin * wmin : zmin;
+	if (zp <= 0.0f || !hiz_rect_hidden(hiz, device->depth, (int)floorf(left), (int)floorf(top), (int)ceilf(right), (int)ceilf(bottom), 1.0f / zp))
+		return false;
+	device->cull_stats.occluded++;
+	return true;
+}
+
+void draw_groups(device_t* device, vector<vertex_t>& mesh, vector<mesh_group_t>& groups)
+{
+	if (mesh.empty()) return;
+	multiview_t* mv = multiview_recording(device);
+	if (mv != NULL)
+	{
+		multiview_draw(mv, device, VARYING_ALL);
+		for (size_t g = 0; g < groups.size(); g++)
+		{
+			if (device_cull_bounds(device, &groups[g])) continue;
+			vertex_layout_t layout;
+			vertex_layout_interleaved(&layout, &mesh[groups[g].first], groups[g].count);
+			device_record(device, &layout, NULL, groups[g].count, TOPOLOGY_TRIANGLE_LIST);
+		}
+		return;
+	}
+	if (device_relight_draw(device, &mesh[0], (int)mesh.size(), groups.data(), (int)groups.size(), TOPOLOGY_TRIANGLE_LIST, device->PBR)) return;
+	if (device_capturing(device))
+	{
+		// the groups outside the frustum still cast and show behind blended texels
+		for (size_t g = 0; g < groups.size(); g++)
+			draw_plane(device, groups[g].count, &mesh[groups[g].first], 0);
+		return;
+	}
+	// one cull per group, the depth prepass reuses the result
+	vector<char> visible(groups.size());
+	int largest = 0;
+	for (size_t g = 0; g < groups.size(); g++)
+	{
+		visible[g] = !device_cull_bounds(device, &groups[g]);
+		if (visible[g]) largest = std::max(largest, groups[g].count / 3);
+	}
+	post_triangle_t* buffer = arena_array<post_triangle_t>(device->arena, std::min(largest, VERTEX_WINDOW));
+	int passes = device_pass_count(device);
+	for (int pass = 0; pass < passes; pass++)
+	{
+		device_pass_begin(device, pass, passes);
+		device_tile_begin(device);
+		for (size_t g = 0; g < groups.size(); g++)
 		{
+			if (visible[g]) device_draw_list(device, &mesh[groups[g].first], groups[g].count, NULL, buffer);
+		}
+		device_tile_end(device);
+	}
+	device_pass_end(device);
+}
+void draw_plane_STRIP(device_t* device,vector<vertex_t>& mesh, vector<int>& indices, int count)
+{
+	draw_indexed(device, mesh, indices, TOPOLOGY_TRIANGLE_STRIP);
+}
 
-			unsigned char* pixelOffset = data + (x + y * width) * bytePerPixel;
+void vertex_layout_interleaved(vertex_layout_t* layout, const vertex_t* vertices, int count)
+{
+	int stride = sizeof(vertex_t);
+	layout->count = count;
+	layout->attributes = VERTEX_ATTR_POS | VERTEX_ATTR_TEXCOORD | VERTEX_ATTR_COLOR | VERTEX_ATTR_NORMAL | VERTEX_ATTR_TANGENT | VERTEX_ATTR_MATERIAL;
+	layout->pos.data = &vertices->pos; layout->pos.stride = stride;
+	layout->tc.data = &vertices->tc; layout->tc.stride = stride;
+	layout->color.data = &vertices->color; layout->color.stride = stride;
+	layout->normal.data = &vertices->normal; layout->normal.stride = stride;
+	layout->tangent.data = &vertices->tangent; layout->tangent.stride = stride;
+	layout->material.data = &vertices->material_idex; layout->material.stride = stride;
+}
 
-			unsigned char r = pixelOffset[0];
-			unsigned char g = pixelOffset[1];
-			unsigned char b = pixelOffset[2];
-			unsigned char a = nrChannels >= 4 ? pixelOffset[3] : 0xff;
-			int rr = (int)r; int gg = (int)g;  int bb = (int)b;  int aa = (int)a;
-			int R = rr;
-			int G = gg;
-			int B = bb;
-			int A = aa;
-			R = CMID(R, 0, 255);
-			G = CMID(G, 0, 255);
-			B = CMID(B, 0, 255);
-			A = CMID(A, 0, 255);
-			texture[y][x] = (A << 24) | (R << 16) | (G << 8) | (B);
-			//cout<<(int)r<<" "<<(int)g<<" "<<(int)b<<" "<<(int)a<<endl;
+int vertex_layout_varyings(const vertex_layout_t* layout)
+{
+	int varyings = VARYING_POS;
+	if (layout->attributes & VERTEX_ATTR_COLOR) varyings |= VARYING_COLOR;
+	if (layout->attributes & VERTEX_ATTR_TEXCOORD) varyings |= VARYING_TEXCOORD;
+	// the TBN rows hold the normal too
+	if (layout->attributes & VERTEX_ATTR_NORMAL) varyings |= VARYING_NORMAL | VARYING_TBN;
+	if (layout->attributes & VERTEX_ATTR_TANGENT) varyings |= VARYING_TBN;
+	return varyings;
+}
+
+// one entry of the post-transform cache of draw_indexed
+typedef struct
+{
+	s_vector clip;           // clip and screen are filled by device_post_position
+	s_vector screen;         // after device_homogenize
+	s_vector normal;         // world space, normalized
+	for_fs ff;               // v_shader output
+	int positioned;          // clip and screen are valid
+	int done;                // normal and ff are valid
+}post_vertex_t;
+
+static post_vertex_t* device_post_position(device_t* device, vector<post_vertex_t>& cache, const vertex_layout_t* layout, int id)
+{
+	post_vertex_t* pv = &cache[id];
+	if (pv->positioned) return pv;
+	s_vector world, pos(vertex_fetch<s_vector>(layout->pos, id));
+	apply_to_vector(world, pos, device->transform.world);
+	apply_to_vector(pv->clip, world, device->transform.vp);
+	device_homogenize(device, pv->screen, pv->clip);
+	pv->positioned = 1;
+	return pv;
+}
+
+// the attributes of vertex id with the constants of vertex_layout_t for missing streams,
+// only pos, tc, color, normal, tangent and material_idex are set
+static void vertex_layout_read(const vertex_layout_t* layout, int id, vertex_t* vertex)
+{
+	int attributes = layout->attributes;
+	s_vector pos(vertex_fetch<s_vector>(layout->pos, id));
+	vertex->pos = pos;
+	if (attributes & VERTEX_ATTR_TEXCOORD) { s_vector2f tc(vertex_fetch<s_vector2f>(layout->tc, id)); vertex->tc = tc; }
+	else vertex->tc.u = vertex->tc.v = 0.0f;
+	if (attributes & VERTEX_ATTR_COLOR) { s_color color(vertex_fetch<s_color>(layout->color, id)); vertex->color = color; }
+	else { vertex->color.r = vertex->color.g = vertex->color.b = vertex->color.a = 1.0f; }
+	if (attributes & VERTEX_ATTR_NORMAL) { s_vector normal(vertex_fetch<s_vector>(layout->normal, id)); vertex->normal = normal; }
+	else vertex->normal.reset(0.0f, 0.0f, 1.0f, 0.0f);
+	if (attributes & VERTEX_ATTR_TANGENT) { s_vector tangent(vertex_fetch<s_vector>(layout->tangent, id)); vertex->tangent = tangent; }
+	else vertex->tangent.reset(1.0f, 0.0f, 0.0f, 1.0f);
+	vertex->material_idex = (attributes & VERTEX_ATTR_MATERIAL) ? vertex_fetch<int>(layout->material, id) : 0;
+	vertex->rhw = 1.0f;
+}
+
+// the corners of triangle t of a list or strip, odd strip triangles swap their first two to keep the winding
+static inline void topology_corners(int topology, int t, int* corner)
+{
+	if (topology == TOPOLOGY_TRIANGLE_STRIP)
+	{
+		int i = t + 2;
+		corner[0] = i % 2 == 0 ? i - 2 : i - 1;
+		corner[1] = i % 2 == 0 ? i - 1 : i - 2;
+		corner[2] = i;
+	}
+	else
+	{
+		corner[0] = t * 3; corner[1] = t * 3 + 1; corner[2] = t * 3 + 2;
+	}
+}
+
+// the shaded draws of the frame go to device->raytrace instead of the rasterizer
+static bool device_capturing(device_t* device)
+{
+	raytrace_t* rt = device->raytrace;
+	int render_state = device->render_state;
+	return rt != NULL && rt->capturing && !device->shadow_pass
+		&& (render_state & (RENDER_STATE_TEXTURE | RENDER_STATE_COLOR)) && !(render_state & RENDER_STATE_WIREFRAME);
+}
+
+// hand the triangles of indices, the vertices in order for NULL, to device->raytrace with the vertex
+// shader output of their corners. strips keep their winding like device_post_corners, nothing is culled
+static void device_capture(device_t* device, const vertex_layout_t* layout, const int* indices, int index_count, int topology)
+{
+	PROFILE_SCOPE(device, PROFILE_STAGE_VERTEX);
+	s_matrix& normal_matrix = device->transform.normal;
+	int strip = topology == TOPOLOGY_TRIANGLE_STRIP;
+	int tris = strip ? std::max(index_count - 2, 0) : index_count / 3;
+	for (int t = 0; t < tris; t++)
+	{
+		int corner[3];
+		topology_corners(topology, t, corner);
+		s_vector world[3];
+		for_fs ffs[3];
+		int count = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			vertex_t vertex;
+			vertex_layout_read(layout, indices != NULL ? indices[corner[k]] : corner[k], &vertex);
+			if (k == 0) count = vertex.material_idex;
+			for_vs av;
+			apply_to_vector(av.pos, vertex.pos, device->transform.world);
+			apply_to_vector(av.normal, vertex.normal, normal_matrix);
+			av.normal.normalize();
+			device_tangent_frame(device, &av, vertex.tangent);
+			av.color = vertex.color;
+			av.texcoord = vertex.tc;
+			world[k] = av.pos;
+			device_pipeline(device, count)->vertex(device, &av, &ffs[k]);
+			ffs[k].instance = NULL;
 		}
+		raytrace_add(device->raytrace, device, world, ffs, count);
 	}
-	stbi_image_free(data);
-	device_set_texture_by_diffuse(device, texture, height * 4, width, height, count);
+}
 
+// the world space work of vertex id: position, normal and tangent frame through the world matrix and the
+// vertex shader of its material into ff, the world normal into normal
+static void device_world_vertex(device_t* device, const vertex_layout_t* layout, int id, s_matrix& normal_matrix, s_vector& normal, for_fs* ff)
+{
+	vertex_t vertex;
+	vertex_layout_read(layout, id, &vertex);
+	for_vs av;
+	apply_to_vector(av.pos, vertex.pos, device->transform.world);
+	apply_to_vector(normal, vertex.normal, normal_matrix);
+	normal.normalize();
+	av.normal = normal;
+	device_tangent_frame(device, &av, vertex.tangent);
+	av.color = vertex.color;
+	av.texcoord = vertex.tc;
+	device_pipeline(device, vertex.material_idex)->vertex(device, &av, ff);
+	ff->instance = device->instance;
 }
 
-void init_texture_by_specular(device_t* device, char const* path, int count)
-{  //þ߹ͼ
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
-	//stbi_image_free(data);
-	unsigned bytePerPixel = nrChannels;
-	//cout << height << " " << width << endl;
-	int n = height; int m = width;
+static post_vertex_t* device_post_vertex(device_t* device, vector<post_vertex_t>& cache, const vertex_layout_t* layout, int id, s_matrix& normal_matrix)
+{
+	post_vertex_t* pv = &cache[id];
+	if (pv->done) return pv;
+	PROFILE_SCOPE(device, PROFILE_STAGE_VERTEX);
+	device_world_vertex(device, layout, id, normal_matrix, pv->normal, &pv->ff);
+	pv->done = 1;
+	return pv;
+}
 
-	IUINT32** texture = NULL;
-	texture = new IUINT32 * [n];
+// append the triangles of indices, the vertices in order for NULL, to the current draw of device->multiview.
+// every vertex they use is shaded once in world space, the views do the rest. nothing is culled here
+static void device_record(device_t* device, const vertex_layout_t* layout, const int* indices, int index_count, int topology)
+{
+	PROFILE_SCOPE(device, PROFILE_STAGE_VERTEX);
+	multiview_t* mv = device->multiview;
+	s_matrix& normal_matrix = device->transform.normal;
+	int tris = topology == TOPOLOGY_TRIANGLE_STRIP ? std::max(index_count - 2, 0) : index_count / 3;
+	// the record index of every vertex shaded so far, -1 for the others
+	vector<int> slot(layout->count, -1);
+	for (int t = 0; t < tris; t++)
+	{
+		int corner[3];
+		topology_corners(topology, t, corner);
+		for (int k = 0; k < 3; k++)
+		{
+			int id = indices != NULL ? indices[corner[k]] : corner[k];
+			if (slot[id] < 0)
+			{
+				s_vector normal;
+				for_fs ff;
+				device_world_vertex(device, layout, id, normal_matrix, normal, &ff);
+				slot[id] = (int)mv->vertices.size();
+				mv->vertices.push_back(ff);
+			}
+			mv->corners.push_back(slot[id]);
+		}
+		int first = indices != NULL ? indices[corner[0]] : corner[0];
+		mv->materials.push_back((layout->attributes & VERTEX_ATTR_MATERIAL) ? vertex_fetch<int>(layout->material, first) : 0);
+	}
+}
+
+// assemble one triangle from the cache and hand it to device_draw_setup
+static void device_draw_cached(device_t* device, vector<post_vertex_t>& cache, const vertex_layout_t* layout, int id1, int id2, int id3, s_matrix& normal_matrix)
+{
+	int ids[3] = { id1, id2, id3 };
+	vertex_t corners[3];
+	s_vector points[3];
+	for_fs ffs[3];
+	for (int i = 0; i < 3; i++)
+	{
+		post_vertex_t* pv = device_post_vertex(device, cache, layout, ids[i], normal_matrix);
+		vertex_layout_read(layout, ids[i], &corners[i]);
+		corners[i].pos = pv->screen;
+		corners[i].normal = pv->normal;
+		points[i] = pv->clip;
+		ffs[i] = pv->ff;
+	}
+	device_draw_setup(device, &corners[0], &corners[1], &corners[2], points, ffs, corners[0].material_idex);
+}
+
+// append the corners of the front facing triangles of indices to corners. only the positions
+// are computed here, so the back faces never reach the attribute work of device_post_vertex.
+// odd strip triangles swap their first two corners to keep the winding
+static void device_post_corners(device_t* device, vector<post_vertex_t>& cache, const vertex_layout_t* layout, const int* indices, int index_count, int topology, vector<int>& corners)
+{
+	PROFILE_SCOPE(device, PROFILE_STAGE_VERTEX);
+	int strip = topology == TOPOLOGY_TRIANGLE_STRIP;
+	int tris = strip ? std::max(index_count - 2, 0) : index_count / 3;
+	PROFILE_COUNT(device, PROFILE_TRIANGLES_IN, tris);
+	corners.reserve(corners.size() + tris * 3);
+	for (int t = 0; t < tris; t++)
+	{
+		int id[3];
+		if (strip)
+		{
+			int i = t + 2;
+			id[0] = indices[i % 2 == 0 ? i - 2 : i - 1];
+			id[1] = indices[i % 2 == 0 ? i - 1 : i - 2];
+			id[2] = indices[i];
+		}
+		else
+		{
+			id[0] = indices[t * 3]; id[1] = indices[t * 3 + 1]; id[2] = indices[t * 3 + 2];
+		}
+		post_vertex_t* p[3];
+		for (int k = 0; k < 3; k++) p[k] = device_post_position(device, cache, layout, id[k]);
+		// like device_cull_clip, a triangle crossing w = 0 is left to the test after clipping
+		if (p[0]->clip.w > 0.0f && p[1]->clip.w > 0.0f && p[2]->clip.w > 0.0f
+			&& device_cull_face(device, p[0]->screen, p[1]->screen, p[2]->screen))
+		{
+			PROFILE_COUNT(device, PROFILE_TRIANGLES_CULLED, 1);
+			continue;
+		}
+		corners.push_back(id[0]); corners.push_back(id[1]); corners.push_back(id[2]);
+	}
+}
+
+// the corners of one pass
+static void device_draw_corner_list(device_t* device, vector<post_vertex_t>& cache, const vertex_layout_t* layout, vector<int>& corners)
+{
+	s_matrix& normal_matrix = device->transform.normal;
+	for (size_t i = 0; i < corners.size(); i += 3)
+		device_draw_cached(device, cache, layout, corners[i], corners[i + 1], corners[i + 2], normal_matrix);
+}
+
+static void device_draw_corners(device_t* device, vector<post_vertex_t>& cache, const vertex_layout_t* layout, vector<int>& corners)
+{
+	int passes = device_pass_count(device);
+	device->varyings = vertex_layout_varyings(layout);
+	for (int pass = 0; pass < passes; pass++)
+	{
+		device_pass_begin(device, pass, passes);
+		device_tile_begin(device);
+		device_draw_corner_list(device, cache, layout, corners);
+		device_tile_end(device);
+	}
+	device_pass_end(device);
+	device->varyings = VARYING_ALL;
+}
+
+static post_vertex_t device_post_empty()
+{
+	post_vertex_t empty;
+	empty.positioned = 0;
+	empty.done = 0;
+	return empty;
+}
+
+void draw_indexed(device_t* device, vector<vertex_t>& vertices, vector<int>& indices, int topology)
+{
+	if (vertices.empty() || indices.empty()) return;
+	vertex_layout_t layout;
+	vertex_layout_interleaved(&layout, &vertices[0], (int)vertices.size());
+	multiview_t* mv = multiview_recording(device);
+	if (mv != NULL)
+	{
+		multiview_draw(mv, device, vertex_layout_varyings(&layout));
+		device_record(device, &layout, &indices[0], (int)indices.size(), topology);
+		return;
+	}
+	if (device_relight_draw(device, &vertices[0], (int)vertices.size(), &indices[0], (int)indices.size(), topology, device->PBR)) return;
+	if (device_capturing(device))
+	{
+		device_capture(device, &layout, &indices[0], (int)indices.size(), topology);
+		return;
+	}
+	vector<post_vertex_t> cache(vertices.size(), device_post_empty());
+	vector<int> corners;
+	device_post_corners(device, cache, &layout, &indices[0], (int)indices.size(), topology, corners);
+	device_draw_corners(device, cache, &layout, corners);
+}
+
+void draw_indexed_groups(device_t* device, const vertex_layout_t* layout, const int* indices, const mesh_group_t* groups, int group_count)
+{
+	multiview_t* mv = multiview_recording(device);
+	if (mv != NULL)
+	{
+		multiview_draw(mv, device, vertex_layout_varyings(layout));
+		for (int g = 0; g < group_count; g++)
+		{
+			if (!device_cull_bounds(device, &groups[g])) device_record(device, layout, indices + groups[g].first, groups[g].count, TOPOLOGY_TRIANGLE_LIST);
+		}
+		return;
+	}
+	if (device_relight_draw(device, layout->pos.data, layout->count, indices, group_count, TOPOLOGY_TRIANGLE_LIST, device->PBR)) return;
+	if (device_capturing(device))
+	{
+		for (int g = 0; g < group_count; g++)
+			device_capture(device, layout, indices + groups[g].first, groups[g].count, TOPOLOGY_TRIANGLE_LIST);
+		return;
+	}
+	vector<post_vertex_t> cache(layout->count, device_post_empty());
+	// the vertices of culled groups are never transformed
+	vector<int> corners;
+	for (int g = 0; g < group_count; g++)
+	{
+		if (device_cull_bounds(device, &groups[g])) continue;
+		device_post_corners(device, cache, layout, indices + groups[g].first, groups[g].count, TOPOLOGY_TRIANGLE_LIST, corners);
+	}
+	device_draw_corners(device, cache, layout, corners);
+}
+
+void draw_instanced(device_t* device, vector<vertex_t>& vertices, vector<int>& indices, int topology,
+	const s_matrix* transforms, const s_PBR* params, int instances, const mesh_group_t* bounds)
+{
+	if (vertices.empty() || indices.empty() || instances <= 0) return;
+	vertex_layout_t layout;
+	vertex_layout_interleaved(&layout, &vertices[0], (int)vertices.size());
+	// the fragments point at their instance until the frame is resolved, so it lives in the frame arena
+	instance_t* instance = arena_array<instance_t>(device->arena, instances);
+	gbuffer_t* gbuffer = device->gbuffer;
+	s_matrix world = device->transform.world;
+	vector<char> visible(instances);
+	bool probed = false;
+	for (int i = 0; i < instances; i++)
+	{
+		instance[i].pbr = params != NULL ? params[i] : device->PBR;
+		instance[i].gbuffer_pbr = gbuffer != NULL && gbuffer->active ? gbuffer_track_pbr(gbuffer, instance[i].pbr) : -1;
+		device->transform.world = transforms[i];
+		device->transform.update();
+		visible[i] = bounds == NULL || !device_cull_bounds(device, bounds);
+		probed = device_relight_draw(device, &vertices[0], (int)vertices.size(), &indices[0], (int)indices.size(), topology, instance[i].pbr);
+	}
+	if (probed)
+	{
+		device->transform.world = world;
+		device->transform.update();
+		return;
+	}
+	multiview_t* mv = multiview_recording(device);
+	if (mv != NULL)
+	{
+		// a draw per instance, each with its own constants
+		for (int i = 0; i < instances; i++)
+		{
+			if (!visible[i]) continue;
+			device->transform.world = transforms[i];
+			device->transform.update();
+			device->instance = &instance[i];
+			multiview_draw(mv, device, vertex_layout_varyings(&layout));
+			device_record(device, &layout, &indices[0], (int)indices.size(), topology);
+		}
+		device->instance = NULL;
+		device->transform.world = world;
+		device->transform.update();
+		return;
+	}
+	if (device_capturing(device))
+	{
+		for (int i = 0; i < instances; i++)
+		{
+			device->transform.world = transforms[i];
+			device->transform.update();
+			device->instance = &instance[i];
+			device_capture(device, &layout, &indices[0], (int)indices.size(), topology);
+		}
+		device->instance = NULL;
+		device->transform.world = world;
+		device->transform.update();
+		return;
+	}
+	vector<post_vertex_t> cache(vertices.size());
+	vector<int> corners;
+	int passes = device_pass_count(device);
+	device->varyings = vertex_layout_varyings(&layout);
+	for (int pass = 0; pass < passes; pass++)
+	{
+		device_pass_begin(device, pass, passes);
+		device_tile_begin(device);
+		for (int i = 0; i < instances; i++)
+		{
+			if (!visible[i]) continue;
+			device->transform.world = transforms[i];
+			device->transform.update();
+			device->instance = &instance[i];
+			cache.assign(cache.size(), device_post_empty());
+			corners.clear();
+			device_post_corners(device, cache, &layout, &indices[0], (int)indices.size(), topology, corners);
+			device_draw_corner_list(device, cache, &layout, corners);
+		}
+		device->instance = NULL;
+		device_tile_end(device);
+	}
+	device_pass_end(device);
+	device->varyings = VARYING_ALL;
+	device->transform.world = world;
+	device->transform.update();
+}
+
+void draw_shaded(device_t* device, const for_fs* vertices, const int* corners, const int* materials, int triangles, int varyings)
+{
+	if (triangles <= 0) return;
+	if (device_capturing(device))
+	{
+		// the tracer takes world space triangles as they are
+		for (int t = 0; t < triangles; t++)
+		{
+			s_vector world[3];
+			for_fs ffs[3];
+			for (int k = 0; k < 3; k++)
+			{
+				ffs[k] = vertices[corners[t * 3 + k]];
+				ffs[k].instance = device->instance;
+				world[k] = ffs[k].pos;
+			}
+			raytrace_add(device->raytrace, device, world, ffs, materials[t]);
+		}
+		return;
+	}
+	int passes = device_pass_count(device);
+	device->varyings = varyings;
+	for (int pass = 0; pass < passes; pass++)
+	{
+		device_pass_begin(device, pass, passes);
+		device_tile_begin(device);
+		PROFILE_COUNT(device, PROFILE_TRIANGLES_IN, triangles);
+		for (int t = 0; t < triangles; t++)
+		{
+			vertex_t v[3];
+			s_vector points[3];
+			for_fs ffs[3];
+			for (int k = 0; k < 3; k++)
+			{
+				ffs[k] = vertices[corners[t * 3 + k]];
+				ffs[k].instance = device->instance;
+				apply_to_vector(points[k], ffs[k].pos, device->transform.vp);
+			}
+			if (device_cull_clip(device, points))
+			{
+				PROFILE_COUNT(device, PROFILE_TRIANGLES_CULLED, 1);
+				continue;
+			}
+			for (int k = 0; k < 3; k++)
+			{
+				// the corners the set up and the scanline walk read
+				device_homogenize(device, v[k].pos, points[k]);
+				v[k].tc = ffs[k].texcoord;
+				v[k].color = ffs[k].color;
+				v[k].normal = ffs[k].normal;
+				v[k].tangent = ffs[k].tangent;
+				v[k].material_idex = materials[t];
+				v[k].rhw = 1.0f;
+			}
+			device_draw_setup(device, &v[0], &v[1], &v[2], points, ffs, materials[t]);
+		}
+		device_tile_end(device);
+	}
+	device_pass_end(device);
+	device->varyings = VARYING_ALL;
+}
 
-	for (int i = 0; i < n; i++)
-		texture[i] = new IUINT32[m];
+void camera_at_zero(device_t* device, s_vector eye, s_vector at, s_vector up)
+{
+	set_look_at_matrix(device->transform.view, eye, at, up);
+	device->transform.update();
+}
 
-	for (int y = 0; y < height; y++)
+void init_texture(device_t* device)
+{
+	static IUINT32 texture[256][256];
+	int i, j;
+	for (j = 0; j < 256; j++)
 	{
-		for (int x = 0; x < width; x++)
+		for (i = 0; i < 256; i++)
 		{
-
-			unsigned char* pixelOffset = data + (x + y * width) * bytePerPixel;
-
-			unsigned char r = pixelOffset[0];
-			unsigned char g = pixelOffset[1];
-			unsigned char b = pixelOffset[2];
-			unsigned char a = nrChannels >= 4 ? pixelOffset[3] : 0xff;
-			int rr = (int)r; int gg = (int)g;  int bb = (int)b;  int aa = (int)a;
-			int R = rr;
-			int G = gg;
-			int B = bb;
-			int A = aa;
-			R = CMID(R, 0, 255);
-			G = CMID(G, 0, 255);
-			B = CMID(B, 0, 255);
-			A = CMID(A, 0, 255);
-			texture[y][x] = (A << 24) | (R << 16) | (G << 8) | (B);
-			//cout<<(int)r<<" "<<(int)g<<" "<<(int)b<<" "<<(int)a<<endl;
+			int x = i / 32;
+			int y = j / 32;
+			texture[j][i] = ((x + y) & 1) ? 0xffffff : 0x3fbcef;
 		}
 	}
-	stbi_image_free(data);
-	device_set_texture_by_specular(device, texture, height * 4, width, height, count);
+	device_set_texture(device, texture, 256 * 4, 256, 256);
 }
 
 
-void init_texture_by_normal(device_t* device, char const* path, int count)
+void init_texture_by_photo(device_t* device, char const* path)
 {
-	//÷ͼ
 	int width, height, nrChannels;
 	unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
 	//stbi_image_free(data);
 	unsigned bytePerPixel = nrChannels;
 	//cout << height << " " << width << endl;
+
 	int n = height; int m = width;
 
 	IUINT32** texture = NULL;
@@ -1860,187 +4092,177 @@ void init_texture_by_normal(device_t* device, char const* path, int count)
 		}
 	}
 	stbi_image_free(data);
-	device_set_texture_by_normal(device, texture, height * 4, width, height, count);
+	device_set_texture_by_photo(device, texture, height * 4, width, height);
+	for (int i = 0; i < n; i++)
+	{
+		delete[] texture[i];
+	}
+	delete[] texture;
 }
 
 
-void init_texture_by_albedo(device_t* device, char const* path, int count)
+bool mount_texture_file(device_t* device, char const* path)
 {
-	//albedoͼ 
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
-	//stbi_image_free(data);
-	unsigned bytePerPixel = nrChannels;
-	//cout << height << " " << width << endl;
-	int n = height; int m = width;
-
-	IUINT32** texture = NULL;
-	texture = new IUINT32 * [n];
+	return texture_registry_mount(device->assets->textures, path);
+}
 
-	for (int i = 0; i < n; i++)
-		texture[i] = new IUINT32[m];
+void device_set_texture_budget(device_t* device, int megabytes)
+{
+	texture_registry_t* registry = device->assets->textures;
+	size_t budget = (size_t)std::max(megabytes, 0) * 1024 * 1024;
+	if (registry->streamer == NULL) registry->streamer = texture_streamer_create(budget);
+	else registry->streamer->budget = budget;
+}
 
-	for (int y = 0; y < height; y++)
-	{
-		for (int x = 0; x < width; x++)
-		{
+void prefetch_texture(device_t* device, char const* path)
+{
+	texture_registry_prefetch(device->assets->textures, path, device->texture_layout);
+}
 
-			unsigned char* pixelOffset = data + (x + y * width) * bytePerPixel;
+// point dst at the registry entry of path, the texels are not copied
+static bool device_bind_texture(device_t* device, s_texture* dst, char const* path)
+{
+	const s_texture* t = texture_registry_load(device->assets->textures, path, device->texture_layout);
+	if (t == NULL) return false;
+	texture_release(dst);
+	*dst = *t;
+	return true;
+}
 
-			unsigned char r = pixelOffset[0];
-			unsigned char g = pixelOffset[1];
-			unsigned char b = pixelOffset[2];
-			unsigned char a = nrChannels >= 4 ? pixelOffset[3] : 0xff;
-			int rr = (int)r; int gg = (int)g;  int bb = (int)b;  int aa = (int)a;
-			int R = rr;
-			int G = gg;
-			int B = bb;
-			int A = aa;
-			R = CMID(R, 0, 255);
-			G = CMID(G, 0, 255);
-			B = CMID(B, 0, 255);
-			A = CMID(A, 0, 255);
-			texture[y][x] = (A << 24) | (R << 16) | (G << 8) | (B);
-			//cout<<(int)r<<" "<<(int)g<<" "<<(int)b<<" "<<(int)a<<endl;
-		}
-	}
-	stbi_image_free(data);
-	device_set_texture_by_albedo(device, texture, height * 4, width, height, count);
+void init_texture_by_diffuse(device_t* device, char const* path, int count)
+{
+	if (!device_bind_texture(device, &scene_assets_material(device->assets, count)->diffuse_texture, path)) return;
 }
 
-void init_texture_by_metallic(device_t* device, char const* path, int count)
+void init_texture_by_specular(device_t* device, char const* path, int count)
 {
-	//metallicͼ 
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
-	//stbi_image_free(data);
-	unsigned bytePerPixel = nrChannels;
-	//cout << height << " " << width << endl;
-	int n = height; int m = width;
+	if (!device_bind_texture(device, &scene_assets_material(device->assets, count)->specular_texture, path)) return;
+}
 
-	IUINT32** texture = NULL;
-	texture = new IUINT32 * [n];
 
-	for (int i = 0; i < n; i++)
-		texture[i] = new IUINT32[m];
+// the unit vectors of the file, converted once for every material that binds it
+void init_texture_by_normal(device_t* device, char const* path, int count)
+{
+	const s_texture* t = texture_registry_normals(device->assets->textures, path, device->texture_layout);
+	if (t == NULL) return;
+	s_texture* dst = &scene_assets_material(device->assets, count)->normal_texture;
+	texture_release(dst);
+	*dst = *t;
+}
 
-	for (int y = 0; y < height; y++)
-	{
-		for (int x = 0; x < width; x++)
-		{
 
-			unsigned char* pixelOffset = data + (x + y * width) * bytePerPixel;
+void init_texture_by_albedo(device_t* device, char const* path, int count)
+{
+	if (!device_bind_texture(device, &scene_assets_pbr(device->assets, count)->albedo_texture, path)) return;
+	scene_assets_pbr(device->assets, count)->albedo_texture.srgb = 1;
+}
 
-			unsigned char r = pixelOffset[0];
-			unsigned char g = pixelOffset[1];
-			unsigned char b = pixelOffset[2];
-			unsigned char a = nrChannels >= 4 ? pixelOffset[3] : 0xff;
-			int rr = (int)r; int gg = (int)g;  int bb = (int)b;  int aa = (int)a;
-			int R = rr;
-			int G = gg;
-			int B = bb;
-			int A = aa;
-			R = CMID(R, 0, 255);
-			G = CMID(G, 0, 255);
-			B = CMID(B, 0, 255);
-			A = CMID(A, 0, 255);
-			texture[y][x] = (A << 24) | (R << 16) | (G << 8) | (B);
-			//cout<<(int)r<<" "<<(int)g<<" "<<(int)b<<" "<<(int)a<<endl;
-		}
+// only one channel is kept, so a decoded file is not worth a registry entry. a baked one is mapped anyway
+static void device_pack_orm_file(device_t* device, char const* path, int count, int channel)
+{
+	const s_texture* baked = texture_registry_find(device->assets->textures, path, TEXTURE_LAYOUT_LINEAR);
+	if (baked != NULL)
+	{
+		device_pack_orm(device, baked, count, channel);
+		return;
 	}
-	stbi_image_free(data);
-	device_set_texture_by_metallic(device, texture, height * 4, width, height, count);
+	s_texture image;
+	texture_init(&image);
+	if (!texture_load(&image, path, TEXTURE_LAYOUT_LINEAR)) return;
+	device_pack_orm(device, &image, count, channel);
+	texture_release(&image);
 }
 
-void init_texture_by_roughness(device_t* device, char const* path, int count)
+void init_texture_by_metallic(device_t* device, char const* path, int count)
 {
-	//roughnessͼ ֲڶ
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
-	//stbi_image_free(data);
-	unsigned bytePerPixel = nrChannels;
-	//cout << height << " " << width << endl;
-	int n = height; int m = width;
+	device_pack_orm_file(device, path, count, ORM_CHANNEL_METALLIC);
+}
 
-	IUINT32** texture = NULL;
-	texture = new IUINT32 * [n];
+void init_texture_by_roughness(device_t* device, char const* path, int count)
+{
+	device_pack_orm_file(device, path, count, ORM_CHANNEL_ROUGHNESS);
+}
 
-	for (int i = 0; i < n; i++)
-		texture[i] = new IUINT32[m];
+void init_texture_by_ao(device_t* device, char const* path, int count)
+{
+	device_pack_orm_file(device, path, count, ORM_CHANNEL_AO);
+}
 
-	for (int y = 0; y < height; y++)
+void init_texture_by_orm(device_t* device, char const* ao, char const* roughness, char const* metallic, int count)
+{
+	t_PBR* t = scene_assets_pbr(device->assets, count);
+	std::string key = texture_orm_key(ao, roughness, metallic);
+	const s_texture* baked = texture_registry_find(device->assets->textures, key.c_str(), device->texture_layout);
+	if (baked != NULL)
 	{
-		for (int x = 0; x < width; x++)
-		{
-
-			unsigned char* pixelOffset = data + (x + y * width) * bytePerPixel;
-
-			unsigned char r = pixelOffset[0];
-			unsigned char g = pixelOffset[1];
-			unsigned char b = pixelOffset[2];
-			unsigned char a = nrChannels >= 4 ? pixelOffset[3] : 0xff;
-			int rr = (int)r; int gg = (int)g;  int bb = (int)b;  int aa = (int)a;
-			int R = rr;
-			int G = gg;
-			int B = bb;
-			int A = aa;
-			R = CMID(R, 0, 255);
-			G = CMID(G, 0, 255);
-			B = CMID(B, 0, 255);
-			A = CMID(A, 0, 255);
-			texture[y][x] = (A << 24) | (R << 16) | (G << 8) | (B);
-			//cout<<(int)r<<" "<<(int)g<<" "<<(int)b<<" "<<(int)a<<endl;
-		}
+		texture_release(&t->orm_texture);
+		t->orm_texture = *baked;
+		t->orm_channels = (ao ? ORM_CHANNEL_AO : 0) | (roughness ? ORM_CHANNEL_ROUGHNESS : 0) | (metallic ? ORM_CHANNEL_METALLIC : 0);
+		return;
 	}
-	stbi_image_free(data);
-	device_set_texture_by_roughness(device, texture, height * 4, width, height, count);
+	// the order the texture baker packs in, the first file sets the size
+	if (metallic) init_texture_by_metallic(device, metallic, count);
+	if (roughness) init_texture_by_roughness(device, roughness, count);
+	if (ao) init_texture_by_ao(device, ao, count);
 }
 
-void init_texture_by_ao(device_t* device, char const* path, int count)
+bool load_obj(std::vector<vertex_t>& tot_vertex, device_t* device, const char* obj_path, const char* pre_mtl_path, int start, bool filp_y)
 {
-	//aoͼ ڱ
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
-	//stbi_image_free(data);
-	unsigned bytePerPixel = nrChannels;
-	//cout << height << " " << width << endl;
-	int n = height; int m = width;
-
-	IUINT32** texture = NULL;
-	texture = new IUINT32 * [n];
+	std::vector<mesh_group_t> groups;
+	return load_obj(tot_vertex, groups, device, obj_path, pre_mtl_path, start, filp_y);
+}
 
-	for (int i = 0; i < n; i++)
-		texture[i] = new IUINT32[m];
+bool load_obj(std::vector<vertex_t>& tot_vertex, std::vector<mesh_group_t>& groups, device_t* device, const char* obj_path, const char* pre_mtl_path, int start, bool filp_y)
+{
+	std::vector<mesh_material_t> materials;
+	if (!load_obj_mesh(tot_vertex, groups, materials, obj_path, pre_mtl_path, start, filp_y)) return false;
+	if (!materials.empty()) device_bind_materials(device, &materials[0], (int)materials.size(), start);
+	return true;
+}
 
-	for (int y = 0; y < height; y++)
+void device_bind_materials(device_t* device, const mesh_material_t* materials, int count, int start)
+{
+	// the table grows once here, target stays valid through the loop
+	scene_assets_reserve(device->assets, start + count);
+	// decode every texture in parallel, the loop below binds them as they finish
+	for (int i = 0; i < count; i++)
 	{
-		for (int x = 0; x < width; x++)
+		const char* paths[3] = { materials[i].diffuse_path, materials[i].specular_path, materials[i].normal_path };
+		for (int k = 0; k < 3; k++)
+			if (paths[k][0] != 0) prefetch_texture(device, paths[k]);
+	}
+	for (int i = 0; i < count; i++)
+	{
+		const mesh_material_t* m = &materials[i];
+		s_material* target = &device->assets->material[start + i];
+		target->have_diffuse = 0;
+		target->have_specular = 0;
+		target->have_normal = 0;
+		if (m->diffuse_path[0] != 0)
 		{
-
-			unsigned char* pixelOffset = data + (x + y * width) * bytePerPixel;
-
-			unsigned char r = pixelOffset[0];
-			unsigned char g = pixelOffset[1];
-			unsigned char b = pixelOffset[2];
-			unsigned char a = nrChannels >= 4 ? pixelOffset[3] : 0xff;
-			int rr = (int)r; int gg = (int)g;  int bb = (int)b;  int aa = (int)a;
-			int R = rr;
-			int G = gg;
-			int B = bb;
-			int A = aa;
-			R = CMID(R, 0, 255);
-			G = CMID(G, 0, 255);
-			B = CMID(B, 0, 255);
-			A = CMID(A, 0, 255);
-			texture[y][x] = (A << 24) | (R << 16) | (G << 8) | (B);
-			//cout<<(int)r<<" "<<(int)g<<" "<<(int)b<<" "<<(int)a<<endl;
+			target->have_diffuse = 1;
+			init_texture_by_diffuse(device, m->diffuse_path, start + i);
+		}
+		if (m->specular_path[0] != 0)
+		{
+			target->have_specular = 1;
+			init_texture_by_specular(device, m->specular_path, start + i);
+		}
+		if (m->normal_path[0] != 0)
+		{
+			target->have_normal = 1;
+			init_texture_by_normal(device, m->normal_path, start + i);
 		}
+		target->shininess = m->material.shininess;
+		// s_vector only assigns from non-const references
+		v_material material = m->material;
+		device->assets->v_m_num++;
+		device->assets->vmaterial.resize(device->assets->v_m_num + 1);
+		device->assets->vmaterial[device->assets->v_m_num] = material;
 	}
-	stbi_image_free(data);
-	device_set_texture_by_ao(device, texture, height * 4, width, height, count);
 }
 
-bool load_obj(std::vector<vertex_t>& tot_vertex, device_t* device, const char* obj_path, const char* pre_mtl_path, int start, bool filp_y)
+bool load_obj_mesh(std::vector<vertex_t>& tot_vertex, std::vector<mesh_group_t>& groups, std::vector<mesh_material_t>& mesh_materials, const char* obj_path, const char* pre_mtl_path, int start, bool filp_y)
 {
 	tinyobj::attrib_t attrib; // еݷ
 	std::vector<tinyobj::shape_t> shapes;
@@ -2056,6 +4278,8 @@ bool load_obj(std::vector<vertex_t>& tot_vertex, device_t* device, const char* o
 	} index_t;
 	*/
 	std::vector<tinyobj::material_t> materials;
+	size_t first = tot_vertex.size();
+	std::vector<tinyobj::index_t> corners;   // the obj indices of every pushed vertex
 
 	std::string warn;
 	std::string err;
@@ -2090,65 +4314,36 @@ bool load_obj(std::vector<vertex_t>& tot_vertex, device_t* device, const char* o
 	//1.ȡֲʺ
 	for (int i = 0; i < materials.size(); i++)
 	{
-		v_material m;
+		mesh_material_t m = mesh_material_t();
 		tinyobj::material_t tm = materials[i];
 
-		m.ambient.x = tm.ambient[0];
-		m.ambient.y = tm.ambient[1];
-		m.ambient.z = tm.ambient[2];
-
-		m.diffuse.x = tm.diffuse[0];
-		m.diffuse.y = tm.diffuse[1];
-		m.diffuse.z = tm.diffuse[2];
-		//  std::cout<<m.diffuse.x<<" "<<m.diffuse.y<<" "<<m.diffuse.z<<endl;
-		m.specular.x = tm.specular[0];
-		m.specular.y = tm.specular[1];
-		m.specular.z = tm.specular[2];
-
-		// std::cout<<m.specular.x<<" "<<m.specular.y<<" "<<m.specular.z<<endl;
-
-		m.shininess = tm.shininess;
-		device->material[start + i].have_diffuse = 0;
-		device->material[start + i].have_specular = 0;
-		device->material[start + i].have_normal = 0;
-		if (tm.diffuse_texname != "") {
-			string the_path = tm.diffuse_texname;
-			the_path = "model/" + the_path;
-			const char* str = the_path.c_str();
-			device->material[start + i].have_diffuse = 1;
-			init_texture_by_diffuse(device, str, start + i);
-			//init_texture_by_specular(&device, "container2_specular.png", 1);
-			//m.diffuse_tex_id = make_texture_by_png(m.diffuse_texname, true);
-		}
-		if (tm.specular_texname != "") {
-			string the_path = tm.specular_texname;
-			the_path = "model/" + the_path;
-			const char* str = the_path.c_str();
-			device->material[start + i].have_specular = 1;
-			init_texture_by_specular(device, str, start + i);
-		}
-
-		if (tm.bump_texname != "") {
-			string the_path = tm.bump_texname;
-			the_path = "model/" + the_path;
-			const char* str = the_path.c_str();
-			device->material[start + i].have_normal = 1;
-			init_texture_by_normal(device, str, start + i);
-		}
-
-		device->material[start + i].shininess = tm.shininess;
-
-		/*m->ambient_tex_id = -1;
-		m->diffuse_tex_id = -1;
-		m->specular_tex_id = -1;
-
-		m->alpha_tex_id = -1;
-		*/
+		m.material.ambient.x = tm.ambient[0];
+		m.material.ambient.y = tm.ambient[1];
+		m.material.ambient.z = tm.ambient[2];
 
+		m.material.diffuse.x = tm.diffuse[0];
+		m.material.diffuse.y = tm.diffuse[1];
+		m.material.diffuse.z = tm.diffuse[2];
 
+		m.material.specular.x = tm.specular[0];
+		m.material.specular.y = tm.specular[1];
+		m.material.specular.z = tm.specular[2];
 
-		device->v_m_num++;
-		device->vmaterial[device->v_m_num] = m;
+		m.material.shininess = tm.shininess;
+		const std::string* names[3] = { &tm.diffuse_texname, &tm.specular_texname, &tm.bump_texname };
+		char* paths[3] = { m.diffuse_path, m.specular_path, m.normal_path };
+		for (int k = 0; k < 3; k++)
+		{
+			if (*names[k] == "") continue;
+			std::string the_path = "model/" + *names[k];
+			if (the_path.size() >= MESH_PATH_MAX)
+			{
+				printf("texture path too long: %s\n", the_path.c_str());
+				continue;
+			}
+			strcpy(paths[k], the_path.c_str());
+		}
+		mesh_materials.push_back(m);
 	}
 
 
@@ -2173,6 +4368,7 @@ bool load_obj(std::vector<vertex_t>& tot_vertex, device_t* device, const char* o
 	  // std::cout<<"the num "<<i<<"  is  "<<shapes[i].mesh.num_face_vertices.size()<<" "<<shapes[i].mesh.material_ids.size()<<endl;
 
 		int index_offset = 0;
+		size_t shape_first = tot_vertex.size();
 
 		// For each face
 		for (int f = 0; f < shapes[i].mesh.num_face_vertices.size(); f++) {
@@ -2230,16 +4426,39 @@ bool load_obj(std::vector<vertex_t>& tot_vertex, device_t* device, const char* o
 				mesh_data.rhw = 1.0f;
 				mesh_data.material_idex = start + m_index;
 				tot_vertex.push_back(mesh_data);
+				corners.push_back(shapes[i].mesh.indices[index_offset + v]);
 				cnt++;
 			}
 
 			// ƫ
 			index_offset += fnum;
 		}
+		if (tot_vertex.size() > shape_first) mesh_compute_groups(&tot_vertex[0], (int)shape_first, (int)(tot_vertex.size() - shape_first), groups);
 
 	}
 
 
+	// weld the corners that share an obj vertex so their tangents are averaged
+	std::map<std::pair<int, std::pair<int, int> >, int> welded;
+	std::vector<vertex_t> unique;
+	std::vector<int> weld_indices;
+	for (size_t k = 0; k < corners.size(); k++)
+	{
+		std::pair<int, std::pair<int, int> > key(corners[k].vertex_index, std::make_pair(corners[k].normal_index, corners[k].texcoord_index));
+		std::map<std::pair<int, std::pair<int, int> >, int>::iterator it = welded.find(key);
+		if (it == welded.end())
+		{
+			it = welded.insert(std::make_pair(key, (int)unique.size())).first;
+			unique.push_back(tot_vertex[first + k]);
+		}
+		weld_indices.push_back(it->second);
+	}
+	if (!unique.empty())
+	{
+		mesh_compute_tangents(&unique[0], (int)unique.size(), &weld_indices[0], (int)weld_indices.size(), TOPOLOGY_TRIANGLE_LIST);
+		for (size_t k = 0; k < corners.size(); k++) tot_vertex[first + k].tangent = unique[weld_indices[k]].tangent;
+	}
+
 	std::cout << "# Loading Complete #" << std::endl;
 
 	//std::cout <<cnt<<std::endl;
@@ -2255,4 +4474,32 @@ void device_set_pointlight(device_t* device, s_vector& pos, s_vector& color, int
 {
 	device->pointlight[cnt].lightpos = pos;
 	device->pointlight[cnt].lightcolor = color;
+}
+
+int device_add_light(device_t* device, s_vector& pos, s_vector& color, float range)
+{
+	if (device->lights == NULL) device->lights = light_list_create(device->width, device->height);
+	point_light light;
+	light.lightpos = pos;
+	light.lightcolor = color;
+	light.ambient.reset(0.0f, 0.0f, 0.0f, 1.0f);
+	light.diffuse = color;
+	light.specular = color;
+	light.range = range;
+	return light_list_add(device->lights, light);
+}
+
+void device_clear_lights(device_t* device)
+{
+	if (device->lights != NULL) light_list_clear(device->lights);
+}
+
+void device_set_shadow_map(device_t* device, shadow_map_t* map)
+{
+	device->shadow = map;
+}
+
+void device_set_ibl(device_t* device, ibl_t* ibl)
+{
+	device->ibl = ibl;
 }
\ No newline at end of file
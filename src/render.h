@@ -6,9 +6,33 @@
 #define render_h
 #include "s_math.h"
 #include "rasterize.h"
+#include "surface.h"
 #include<iostream>
 #include<vector>
 using namespace std;
+struct tile_context_t;
+struct pipeline_t;
+struct transparent_list_t;
+struct light_list_t;
+struct shadow_map_t;
+struct ibl_t;
+struct gbuffer_t;
+struct hiz_t;
+struct occlusion_t;
+struct raytrace_t;
+struct msaa_t;
+struct taa_t;
+struct relight_t;
+struct hdr_t;
+struct post_t;
+struct ssao_t;
+struct coarse_t;
+struct multiview_t;
+struct pretransform_t;
+struct arena_t;
+struct texture_registry_t;
+struct scene_assets_t;
+struct profile_t;
 typedef struct
 {
 	s_vector lightpos;
@@ -17,29 +41,45 @@ typedef struct
 	s_vector ambient;
 	s_vector diffuse;
 	s_vector specular;
+	float range;             // light list only: the light does not reach past it, see light_attenuation
 }point_light;
 typedef struct
 {
 	s_vector viewpos;
 }s_camera;
+#define TEXTURE_MAX_LEVELS 12   // up to 2048 x 2048
 typedef struct
 {
-	IUINT32** texture;
 	int tex_width;           // 
 	int tex_height;          // ߶
 	float max_u;             // ȣtex_width - 1
 	float max_v;             // ߶ȣtex_height - 1
+	int layout;              // TEXTURE_LAYOUT_*, fixed when the texture is stored
+	int format;              // TEXTURE_FORMAT_*, picked when a TEXTURE_LAYOUT_BC texture is stored
+	int srgb;                // rgb is gamma encoded, texture_read returns it linear. set after texture_store
+	int normal;              // rgb is a unit vector v as 127.5 * (v + 1), texture_read returns v, see texture_store_normals
+	int levels;              // mip levels including level 0, see texture_store
+	IUINT32* mip[TEXTURE_MAX_LEVELS]; // level k is max(1, w >> k) x max(1, h >> k), read it with texture_texel
+	int mip_pitch[TEXTURE_MAX_LEVELS]; // linear: texels per row, tiled and bc: tiles per row, morton: interleaved bits
+	IUINT32* block;          // holds every mip[k]
+	size_t bytes;            // size of block
+	int shared;              // texels belong to a texture_registry_t entry or a mapped texture file
+	struct texture_stream_t* stream; // the resident levels texture_read samples, NULL when all of them are
 }s_texture;
 
+// the parameters the shaders read first, the textures after them
 typedef struct
 {
 	float shininess;
-	s_texture diffuse_texture;
-	s_texture specular_texture;
-	s_texture normal_texture;
 	bool have_diffuse;
 	bool have_specular;
 	bool have_normal;
+	const pipeline_t* pipeline; // bound once by device_set_material_pipeline, NULL for the one of now_state
+	s_texture diffuse_texture;
+	s_texture specular_texture;
+	s_texture normal_texture;
+	s_texture light_texture;  // baked light of the lightmap pipeline, see lightmap.h
+	int light_material;       // lightmap pipeline: the material count the albedo is read from
 }s_material;
 typedef struct
 {
@@ -48,6 +88,15 @@ typedef struct
 	s_vector diffuse;
 	s_vector specular;
 }v_material;
+#define MESH_PATH_MAX 128
+// one obj material before it is bound to a device, plain data so it can live in a mesh file
+typedef struct
+{
+	v_material material;
+	char diffuse_path[MESH_PATH_MAX];   // "" when the material has no such map
+	char specular_path[MESH_PATH_MAX];
+	char normal_path[MESH_PATH_MAX];
+}mesh_material_t;
 
 typedef struct
 {
@@ -59,17 +108,46 @@ typedef struct
 typedef struct
 {
 	s_texture albedo_texture;
-	s_texture metallic_texture;
-	s_texture roughness_texture;
-	s_texture ao_texture;
+	s_texture orm_texture;   // r = ao, g = roughness, b = metallic, one fetch for all three
+	int orm_channels;        // ORM_CHANNEL_* loaded into orm_texture, the others come from s_PBR
 }t_PBR;
+
+// the material constants of one instance of draw_instanced, used instead of device->PBR
+typedef struct
+{
+	s_PBR pbr;
+	int gbuffer_pbr;         // its entry in gbuffer_t::pbr, -1 outside deferred shading
+}instance_t;
+#define ORM_CHANNEL_AO        1
+#define ORM_CHANNEL_ROUGHNESS 2
+#define ORM_CHANNEL_METALLIC  4
+// counters of the object cull stage since the last device_clear
+typedef struct
+{
+	int tested;              // bounds handed to device_cull_bounds
+	int culled;              // of those, outside the frustum
+	int vertices_culled;     // vertices the culled groups hold
+	int occluded;            // world boxes device_occluded_box found hidden
+}cull_stats_t;
 typedef struct
 {
 	s_transform transform;   // 任
 	int width;               // ڿ
 	int height;              // ڸ߶
-	IUINT32** framebuffer;   // ػ棺framebuffer[y]  y
-	float** zbuffer;         // Ȼ棺zbuffer[y] Ϊ yָ
+	surface_t* color;        // XRGB32 framebuffer the draws write, output itself at render scale 1
+	surface_t* output;       // XRGB32 output_width x output_height, may wrap the memory passed to device_init
+	int output_width;
+	int output_height;
+	float render_scale;      // color is this fraction of the output size, see device_set_render_scale
+	int frame_width;         // size of the frame output is a region of, see device_set_region
+	int frame_height;
+	int region_x;            // output pixel of the frame at the top left corner of output
+	int region_y;
+	float viewport_x;        // the same corner in pixels of color, transform.w x transform.h is the frame in them
+	float viewport_y;
+	int upscale_filter;      // UPSCALE_* device_present scales color up to output with
+	surface_t* depth;        // DEPTH32, DEPTH24 or DEPTH16, see device_set_depth_format
+	void* table_block;       // the texture row tables of device_init
 	IUINT32** texture;       // ͬÿ
 	int tex_width;           // 
 	int tex_height;          // ߶
@@ -79,29 +157,213 @@ typedef struct
 	IUINT32 background;      // ɫ
 	IUINT32 foreground;      // ߿ɫ
 	point_light pointlight[20];
-	s_material material[100];
-	v_material vmaterial[100];
-	int v_m_num;
 	s_camera camera;
 	IUINT32** texture_di;
 	IUINT32** texture_spe;
 	int is_cull;
 	s_PBR PBR;
-	t_PBR tPBR[30];//texture PBR
 	int now_state;
 	float m1;
 	float m2;
+	int tile_threads;        // >0 enables the tiled multithreaded back end, see device_set_tile_mode
+	tile_context_t* tiler;
+	int raster_mode;         // RASTER_MODE_SCANLINE, RASTER_MODE_EDGE or RASTER_MODE_QUAD
+	gbuffer_t* gbuffer;      // created on the first device_clear with RENDER_STATE_DEFERRED
+	int msaa_samples;        // 1, or MSAA_SAMPLES per pixel, see device_set_msaa
+	msaa_t* msaa;            // created on the first device_clear with msaa_samples > 1
+	taa_t* taa;              // temporal anti-aliasing history, NULL when off, see device_set_taa
+	arena_t* arena;          // scratch memory of the frame, reset by device_clear, see device_scratch
+	int raster_pass;         // RASTER_PASS_*, set by draw_plane for RENDER_STATE_DEPTH_PREPASS
+	hiz_t* hiz;              // coarse depth for triangle and block rejection, NULL when disabled
+	occlusion_t* occlusion;  // occluder depth scene_graph_draw tests the nodes against, NULL when off, see device_set_occlusion
+	light_list_t* lights;    // range limited lights on top of pointlight[0], created by device_add_light
+	shadow_map_t* shadow;    // shadows of pointlight[0], see device_set_shadow_map
+	int shadow_pass;         // set while shadow_map_update draws the casters, every draw is depth only
+	ibl_t* ibl;              // environment lighting of the PBR shaders, see device_set_ibl
+	transparent_list_t* transparent; // draws queued by draw_plane_transparent, created on first use
+	const pipeline_t* pipeline; // bound by device_bind_pipeline, NULL selects a builtin one from now_state
+	cull_stats_t cull_stats;
+	int texture_filter;      // TEXTURE_FILTER_*, see device_set_texture_filter
+	int brdf_mode;           // BRDF_MODE_*, see device_set_brdf_mode
+	int texture_layout;      // TEXTURE_LAYOUT_* for the textures stored from now on
+	scene_assets_t* assets;  // materials and textures, see device_share_assets
+	int owns_assets;         // assets were made by device_init and are freed with the device
+	int varyings;            // VARYING_* the vertex layout of the current draw varies, see vertex_layout_varyings
+	profile_t* profile;      // stage timers and counters, NULL when off, see device_set_profile
+	const instance_t* instance; // of the draw_instanced instance being drawn, NULL outside of one
+	float lod_density;       // triangles per covered pixel mesh_lod_select aims at, 0 draws full detail, see device_set_lod
+	raytrace_t* raytrace;    // ray traced frames, NULL when they are rasterized, see device_set_raytrace
+	relight_t* relight;      // the G-buffer kept for lighting only frames, NULL when off, see device_set_relight
+	hdr_t* hdr;              // the float colour the frames are shaded into, NULL when off, see device_set_hdr
+	post_t* post;            // bloom, fxaa, grade and vignette of device_resolve, NULL when off, see device_set_post
+	ssao_t* ssao;            // ambient occlusion of the G-buffer, NULL when off, see device_set_ssao
+	coarse_t* coarse;        // shading rates of the G-buffer tiles, NULL when every pixel is shaded, see device_set_shading_rate
+	multiview_t* multiview;  // the views the draws are recorded for between multiview_begin and multiview_end, otherwise NULL
+	pretransform_t* pretransform; // the world space corners of the mesh draw_plane draws, NULL for none. see pretransform_t
 
 }device_t;
 
+#define RASTER_PASS_COLOR    0  // depth test with >= and shade
+#define RASTER_PASS_DEPTH    1  // only write zbuffer, no vertex or fragment shading
+#define RASTER_PASS_EQUAL    2  // shade only the fragments whose depth equals zbuffer
+#define RASTER_PASS_BLEND    3  // depth test with >= and shade, zbuffer is left untouched
+#define RASTER_PASSES        4
+
+#define RASTER_MODE_SCANLINE 0  // trapezoid + scanline walk
+#define RASTER_MODE_EDGE     1  // half-space edge functions over 8x8 blocks
+#define RASTER_MODE_QUAD     2  // RASTER_MODE_EDGE walking the blocks in 2x2 quads with helper lanes, see FS_DDX
+
+#define TEXTURE_FILTER_NEAREST   0  // one texel of level 0, the original lookup
+#define TEXTURE_FILTER_BILINEAR  1  // four texels of level 0
+#define TEXTURE_FILTER_TRILINEAR 2  // bilinear in the two mip levels around the uv derivative LOD
+
+#define TEXTURE_LAYOUT_LINEAR 0  // row after row
+#define TEXTURE_LAYOUT_TILED4 1  // 4x4 texel tiles of 64 bytes, row after row of tiles
+#define TEXTURE_LAYOUT_MORTON 2  // z-order curve over the padded power of two square
+#define TEXTURE_LAYOUT_BC     3  // 4x4 texel tiles compressed to 8 or 16 bytes, row after row of tiles, see texture_bc.h
+
+#define TEXTURE_FORMAT_RGBA8  0  // 4 bytes per texel, the format of every layout but TEXTURE_LAYOUT_BC
+#define TEXTURE_FORMAT_BC1    1  // opaque colour, 8 bytes a tile
+#define TEXTURE_FORMAT_BC3    2  // colour and alpha, 16 bytes a tile
+#define TEXTURE_FORMAT_BC4    3  // one grey channel, 8 bytes a tile
+#define TEXTURE_FORMAT_BC5    4  // x and y of a normal map, 16 bytes a tile
+#define TEXTURE_FORMAT_BC4X3  5  // ao, roughness and metallic of an orm texture, a BC4 block each, 24 bytes a tile
+
+#define BRDF_MODE_EXACT 0  // DistributionGGX, GeometrySmith and fresnelSchlick as written
+#define BRDF_MODE_FAST  1  // the single precision terms of brdf.h, see brdf_report for their error
+
 #define RENDER_STATE_WIREFRAME 1  //Ⱦ߿ 
 #define RENDER_STATE_TEXTURE    2  //Ⱦ 
 #define RENDER_STATE_COLOR      4  //Ⱦɫ
+#define RENDER_STATE_DEFERRED   8  // shade in device_resolve after all draws, combine with TEXTURE or COLOR
+#define RENDER_STATE_DEPTH_PREPASS 16 // draw_plane lays down depth first, then shades only the visible fragments
 //豸ʼfbΪⲿ֡棬NULLⲿ֡ 
 void device_init(device_t* device, int width, int height, void* fb);
 
 // ɾ豸
 void device_destory(device_t* device);
+
+// draw with the scene_assets_t of source instead of the device's own, and start from its lights,
+// environment, modes and render scale. source keeps owning the assets and has to outlive device. draws only
+// read the assets, so devices sharing them may draw at the same time
+void device_share_assets(device_t* device, const device_t* source);
+
+// the output from now on is fb with rows pitch bytes apart, NULL gives the device memory of its own.
+// fb is the output size, only the pointer is kept, see swap_chain_acquire
+void device_set_framebuffer(device_t* device, void* fb, int pitch);
+
+// draw into a color surface of scale (RENDER_SCALE_MIN..1) times the output size, device_present
+// scales it up. every render target is recreated empty when the size changes, the projection keeps
+// the output aspect
+void device_set_render_scale(device_t* device, float scale);
+
+// draw the region of a frame_width x frame_height frame whose top left corner is (x, y) in output, which
+// keeps its own size. the projection stays the one of the frame and the viewport moves by whole pixels, so
+// every triangle is clipped and set up like in the frame, and the background gradient runs over the frame.
+// screen space effects only see the region. frame_width 0 draws the output as a frame of its own
+void device_set_region(device_t* device, int frame_width, int frame_height, int x, int y);
+
+// the viewport transform of clip space x into pixels of color: the frame, moved by the region
+inline void device_homogenize(const device_t* device, s_vector& y, s_vector& x)
+{
+	transform_homogenize(y, x, device->transform.w, device->transform.h);
+	y.x -= device->viewport_x;
+	y.y -= device->viewport_y;
+}
+
+// UPSCALE_BILINEAR (default) or UPSCALE_EDGE
+void device_set_upscale_filter(device_t* device, int filter);
+
+// after device_resolve: fill output from color when the render scale is below 1
+void device_present(device_t* device);
+
+// record stage times and counters into device->profile, only with SIMPLERENDER_PROFILE.
+// frames are bracketed with profile_frame_begin / profile_frame_end by the caller
+void device_set_profile(device_t* device, int enable);
+
+// SURFACE_FORMAT_DEPTH32 (default), SURFACE_FORMAT_DEPTH24 or SURFACE_FORMAT_DEPTH16, the depth surface
+// is recreated empty. all three keep larger nearer: float 1/z, whose precision the far plane at infinity
+// doesn't spend, or 1 - z of the projection in 24 or 16 bit integers
+void device_set_depth_format(device_t* device, int format);
+
+// hierarchical z rejection of hidden triangles and edge mode blocks, on by default.
+// it only works on SURFACE_FORMAT_DEPTH32 and is skipped with integer depth
+void device_set_hiz(device_t* device, int enable);
+
+// software occlusion culling of the scene graph nodes, off by default. scene_graph_draw rasterizes the
+// occluder nodes into an OCCLUSION_WIDTH x OCCLUSION_HEIGHT depth buffer and skips the nodes it hides
+void device_set_occlusion(device_t* device, int enable);
+
+// 1 (default) or MSAA_SAMPLES coverage and depth samples per pixel, shaded once per pixel and triangle.
+// only RASTER_MODE_EDGE and RASTER_MODE_QUAD take samples, deferred frames and the transparent pass stay per pixel
+void device_set_msaa(device_t* device, int samples);
+
+// level of detail selection of the meshes with a mesh_lod_t, off by default so every mesh is drawn in
+// full. on aims at MESH_LOD_DENSITY triangles per pixel of their bounding circle
+void device_set_lod(device_t* device, int enable);
+
+// ray trace the frames with samples per pixel and device_resolve, 0 (default) rasterizes them. the shaded
+// draws between device_clear and device_resolve only hand their triangles to the tracer, wireframe lines and
+// shadow passes are still rasterized. see raytrace.h
+void device_set_raytrace(device_t* device, int samples);
+
+// temporal anti-aliasing, off by default: device_clear offsets the projection by a sub pixel jitter and
+// device_resolve blends the frame with the reprojected earlier ones. turning it on again drops the history
+void device_set_taa(device_t* device, int enable);
+
+// keep the G-buffer of RENDER_STATE_DEFERRED frames for device_relight_begin, off by default
+void device_set_relight(device_t* device, int enable);
+
+// instead of device_clear: the draws until device_relight_end only fold their geometry and transforms
+// into a key, nothing is rasterized. false when no G-buffer is kept, the frame is then drawn as usual
+bool device_relight_begin(device_t* device);
+
+// true when the draws since device_relight_begin are the ones of the kept frame: the kept G-buffer is
+// back with the material constants of the new draws and device_resolve shades it with the current
+// lights. false when something moved, the frame has to be drawn from device_clear on. see relight.h
+bool device_relight_end(device_t* device);
+
+// fold bytes into the relight key of the frame being recorded or probed, for a draw whose vertices are
+// rewritten behind the same pointers: a generation of their contents tells the frames apart
+void device_relight_fold(device_t* device, const void* data, size_t bytes);
+
+// shade into a float colour target and tone map it in device_resolve, off by default so every shader packs
+// its own colour. the PBR shaders write radiance, see hdr.h
+void device_set_hdr(device_t* device, int enable);
+
+// radiance multiplier of the tone map of device_set_hdr, 1 by default. without HDR it has no effect
+void device_set_exposure(device_t* device, float exposure);
+
+// the POST_* effects of post.h device_resolve runs, 0 turns them off. bloom needs device_set_hdr, frames that
+// aren't shaded into the HDR colour skip it. the grade, strengths and threshold are in device->post
+void device_set_post(device_t* device, int effects);
+
+// screen space ambient occlusion of deferred frames at half resolution, multiplied into the ambient term of
+// the shaders. off by default, see ssao.h
+void device_set_ssao(device_t* device, int enable);
+
+#define SHADING_RATE_OFF  0      // every pixel runs the shader
+#define SHADING_RATE_AUTO 1      // smooth rough tiles of deferred frames shade 2x2 or 4x4 blocks once, see coarse.h
+
+void device_set_shading_rate(device_t* device, int mode);
+
+// rates 1, 2 or 4 of the tiles_x * tiles_y tiles of COARSE_TILE pixels of deferred frames, row major, in
+// place of the automatic ones. NULL goes back to them. turns coarse shading on
+void device_set_shading_rate_image(device_t* device, const unsigned char* rates, int tiles_x, int tiles_y);
+
+// the arena for scratch memory that lives until the next device_clear: the sub-arena of the calling
+// tile worker while it shades tiles, device->arena otherwise
+arena_t* device_scratch(device_t* device);
+
+// TEXTURE_FILTER_NEAREST (default), TEXTURE_FILTER_BILINEAR or TEXTURE_FILTER_TRILINEAR for every material texture
+void device_set_texture_filter(device_t* device, int filter);
+
+// BRDF_MODE_EXACT (default) or BRDF_MODE_FAST for the cook torrance terms of the PBR shaders
+void device_set_brdf_mode(device_t* device, int mode);
+
+// TEXTURE_LAYOUT_LINEAR (default), TEXTURE_LAYOUT_TILED4, TEXTURE_LAYOUT_MORTON or TEXTURE_LAYOUT_BC for the textures
+// set after the call, already stored textures keep their layout
+void device_set_texture_layout(device_t* device, int layout);
 //õǰ 
 void device_set_texture(device_t* device, void* bits, long pitch, int w, int h);
 
@@ -115,6 +377,8 @@ void device_set_texture_by_normal(device_t* device, IUINT32** texture, long pitc
 
 void device_set_texture_by_albedo(device_t* device, IUINT32** texture, long pitch, int w, int h, int count);
 
+// metallic, roughness and ao take the red channel of the image and pack it into tPBR[count].orm_texture.
+// the first one loaded fixes the size of the packed texture, the later ones are resampled to it
 void device_set_texture_by_metallic(device_t* device, IUINT32** texture, long pitch, int w, int h, int count);
 
 void device_set_texture_by_roughness(device_t* device, IUINT32** texture, long pitch, int w, int h, int count);
@@ -126,6 +390,26 @@ void device_set_pointlight(device_t* device, s_vector& pos, s_vector& color,s_ve
 
 void device_set_pointlight(device_t* device, s_vector& pos, s_vector& color, int cnt);
 
+// add a point light that fades out at range. every shader adds the lights of the pixel's
+// screen tile to the scene light pointlight[0]. returns the index of the light
+int device_add_light(device_t* device, s_vector& pos, s_vector& color, float range);
+
+void device_clear_lights(device_t* device);
+
+// the shaders darken the diffuse and specular terms of pointlight[0] with map, NULL turns shadows off.
+// the map is owned by the caller and drawn with shadow_map_update
+void device_set_shadow_map(device_t* device, shadow_map_t* map);
+
+// the PBR shaders take their ambient term from the irradiance and prefiltered maps of ibl,
+// NULL goes back to the constant ambient. ibl is owned by the caller, see ibl_load
+void device_set_ibl(device_t* device, ibl_t* ibl);
+
+// the exact cook torrance terms, brdf.h has the ones of BRDF_MODE_FAST
+float DistributionGGX(s_vector& N, s_vector& H, float roughness);
+float GeometrySchlickGGX(float NdotV, float roughness);
+float GeometrySmith(s_vector& N, s_vector& V, s_vector& L, float roughness);
+void fresnelSchlick(s_vector& result, float cosTheta, s_vector& F0);
+
 //ò
 
 //void device_set_material(device_t* device, s_vector& am, s_vector& di,s_vector& spe, float shi,int cnt);
@@ -143,6 +427,9 @@ void read_the_texture(s_vector& tmp, const  s_texture* t_texture, float u, float
 
 void read_the_texture_dir(s_vector& tmp, const  s_texture* t_texture, int x, int y);
 
+// barycentric weights of pos in the triangle p0 p1 p2 into tmp.xyz, false for a degenerate triangle
+bool computeBarycentric3D(s_vector& tmp, s_vector& p0, s_vector& p1, s_vector& p2, s_vector& pos);
+
 
 //=====================================================================
 // Ⱦʵ
@@ -168,7 +455,19 @@ typedef struct
 	s_vector2f texcoord;// 
 }for_vs;
 
-typedef struct
+// the world space corners of a triangle list whose world matrix stays the same from frame to frame.
+// with device->pretransform set draw_plane transforms them when the mesh or the world matrix is not
+// the one they were made with, and otherwise only applies the view projection to them
+struct pretransform_t
+{
+	const vertex_t* mesh;    // the triangle list, NULL before the first draw
+	int num;
+	s_matrix world;          // the world matrix the corners were transformed with
+	std::vector<for_vs> corners; // position, normal and tangent frame in world space
+	int builds;              // times the corners were transformed
+};
+
+typedef struct for_fs
 {
 	s_vector pos;// 
 	s_vector2f texcoord;// 
@@ -179,24 +478,230 @@ typedef struct
 	s_vector storage0;// ֵĴ
 	s_vector storage1;
 	s_vector storage2;
+	float duv[4];            // fragment: du/dx, dv/dx, du/dy, dv/dy of texcoord, only set for TEXTURE_FILTER_TRILINEAR
+	float weight_grad[2];    // vertex: x and y gradient of its unnormalized perspective weight, set with duv
+	int varyings;            // vertex: VARYING_* interpolated for the triangle, see f_shader_varyings
+	const int* lights;       // fragment: -1 terminated device->lights indices of the pixel's tile, NULL without a light
+	                         // list. set by device_shade_pixel
+	float occlusion;         // fragment: the ambient visibility of the pixel from device_set_ssao, 1 without. set by
+	                         // device_shade_pixel
+	const struct for_fs* quad; // fragment: the 4 lanes of its 2x2 quad in RASTER_MODE_QUAD, row major, otherwise NULL
+	const instance_t* instance; // the draw_instanced instance of the triangle, NULL outside of one
 }for_fs;
 
+// the PBR constants of a fragment, those of its instance when it has one
+static inline const s_PBR& fragment_pbr(const device_t* device, const for_fs* ff)
+{
+	return ff->instance != NULL ? ff->instance->pbr : device->PBR;
+}
+
+// coarse screen space derivatives of a fragment member like texcoord.u or pos.x: the difference
+// across the first row / column of its quad, 0 when the fragment was not shaded in a quad
+#define FS_DDX(ff, member) ((ff)->quad != NULL ? (ff)->quad[1].member - (ff)->quad[0].member : 0.0f)
+#define FS_DDY(ff, member) ((ff)->quad != NULL ? (ff)->quad[2].member - (ff)->quad[0].member : 0.0f)
+
+// for_fs members interpolated across a triangle, the others are copies of the first corner
+#define VARYING_POS      1
+#define VARYING_COLOR    2
+#define VARYING_TEXCOORD 4
+#define VARYING_NORMAL   8
+#define VARYING_TBN      16  // storage0..2
+#define VARYING_ALL      31
+
+void ff_interpolating(for_fs* dest, for_fs* src1, for_fs* src2, for_fs* src3, float a, float b, float c, int varyings);
+
+// rasterize one trapezoid, only writing pixels inside [x0, x1) x [y0, y1)
+void device_render_trap_rect(device_t* device, trapezoid_t* trap, s_vector& point1, s_vector& point2, s_vector& point3, for_fs* ffs, int count, int x0, int y0, int x1, int y1);
+
+// rasterize a set-up triangle with edge functions, only writing pixels inside [x0, x1) x [y0, y1)
+void device_render_edge_rect(device_t* device, edge_triangle_t* tri, for_fs* ffs, int count, int x0, int y0, int x1, int y1);
+
+// threads: 0 = single threaded (default), < 0 = one worker per hardware thread
+void device_set_tile_mode(device_t* device, int threads);
+
+// triangles drawn between begin and end are binned into tiles and shaded in parallel at end
+void device_tile_begin(device_t* device);
+
+void device_tile_end(device_t* device);
+
+// shade the G-buffer into the framebuffer, then draw the transparent queue over it.
+// call once per frame after the last draw
+void device_resolve(device_t* device);
+
+// true when f_shader blends with or discards against the framebuffer for this fragment,
+// such fragments are shaded immediately in deferred mode
+bool f_shader_reads_destination(device_t* device, for_fs* ff, int count);
+
+// VARYING_* f_shader and f_shader_packet read for material count in the current now_state.
+// the rasterizers interpolate these and the ones device->varyings allows, the rest stays flat
+int f_shader_varyings(device_t* device, int count);
+
 void v_shader(device_t* device, for_vs* vv, for_fs* ff);
 
 void f_shader(device_t* device, for_fs* ff, s_color& color,int count,bool& is_ban,s_vector& ori_co);
 
+// compiled shader objects. the rasterizers pick the pipeline once per triangle and instantiate
+// the pixel loop for the builtin ids, so no per-pixel switch on now_state is left
+#define SHADER_NONE          0
+#define SHADER_LIGHT         1   // the light cube, every material count == 2
+#define SHADER_PHONG_COLOR   2
+#define SHADER_PHONG_TEXTURE 3
+#define SHADER_PHONG_BLEND   4
+#define SHADER_BUMP_BLEND    5
+#define SHADER_PBR           6
+#define SHADER_PBR_TEXTURE   7
+#define SHADER_CUSTOM        8   // user pipelines, called through the function pointers
+#define SHADER_COUNT         8   // builtin pipelines
+
+// runs on the jobs of the vertex stage, several triangles at once, so it only writes ff
+typedef void(*vertex_shader_t)(device_t* device, for_vs* vv, for_fs* ff);
+typedef void(*fragment_shader_t)(device_t* device, for_fs* ff, s_color& color, int count, bool& is_ban, s_vector& ori_co);
+
+struct pipeline_t
+{
+	int id;                  // SHADER_*
+	const char* name;
+	vertex_shader_t vertex;
+	fragment_shader_t fragment;
+};
+
+const pipeline_t* pipeline_builtin(int id);
+
+// the bound pipeline, otherwise the builtin one of now_state for material count
+const pipeline_t* device_pipeline(device_t* device, int count);
+
+// pipeline overrides now_state for every draw until it is unbound with NULL
+void device_bind_pipeline(device_t* device, const pipeline_t* pipeline);
+
+// material count is drawn with pipeline whatever now_state is, NULL gives it back to now_state.
+// a pipeline bound with device_bind_pipeline still comes first
+void device_set_material_pipeline(device_t* device, int count, const pipeline_t* pipeline);
+
 void draw_plane(device_t* device, int num, vertex_t* mesh, int count);
 
 void draw_plane(device_t* device, int num, vector<vertex_t>& mesh, int count);//
 
+// queue the triangles of mesh for the transparent pass of device_resolve. they are sorted
+// back to front with the other queued ones and drawn after all opaque geometry without depth writes
+void draw_plane_transparent(device_t* device, int num, vertex_t* mesh, int count);
+
 void draw_plane_STRIP(device_t* device, vector<vertex_t>& mesh, vector<int>& indices, int count);
 
+#define TOPOLOGY_TRIANGLE_LIST  0
+#define TOPOLOGY_TRIANGLE_STRIP 1
+
+// draw triangles assembled from indices. every referenced vertex is transformed and vertex shaded
+// once per call into a post-transform cache, the strip winding follows draw_plane_STRIP
+void draw_indexed(device_t* device, vector<vertex_t>& vertices, vector<int>& indices, int topology);
+
+// load time tangent frames into vertex_t::tangent. the face tangents of every triangle sharing a
+// vertex are summed and made orthogonal to its normal, w is the handedness of the uv mapping.
+// indices may be NULL for a plain triangle list
+void mesh_compute_tangents(vertex_t* vertices, int vertex_count, const int* indices, int index_count, int topology);
+
+// a run of triangle list vertices with one material and its model space bounds
+typedef struct
+{
+	int first, count;        // vertex range, count is a multiple of 3
+	int material_idex;
+	s_vector box_min, box_max;
+	s_vector center;         // bounding sphere around the box center
+	float radius;
+}mesh_group_t;
+
+// bounds of vertices [first, first + count), material_idex is taken from the first one
+void mesh_compute_bounds(const vertex_t* vertices, int first, int count, mesh_group_t* group);
+
+// split the triangle list [first, first + count) into runs of equal material_idex and append them
+void mesh_compute_groups(const vertex_t* vertices, int first, int count, vector<mesh_group_t>& groups);
+
+// true when the bounds are outside the frustum of the current transform. the sphere is tried
+// first, the box only when the sphere straddles a plane. updates device->cull_stats
+bool device_cull_bounds(device_t* device, const mesh_group_t* bounds);
+
+// radius in pixels of the bounding sphere of bounds under the current transform, FLT_MAX when the
+// eye is inside of it
+float device_screen_radius(device_t* device, const mesh_group_t* bounds);
+
+// true when the hiz depth of what is drawn so far hides the world space box under the view projection
+// of device everywhere. false without hiz, for boxes reaching behind the near plane and while the depth
+// doesn't decide the visibility
+bool device_occluded_box(device_t* device, const s_vector& box_min, const s_vector& box_max);
+
+// draw_plane for the groups that survive device_cull_bounds
+void draw_groups(device_t* device, vector<vertex_t>& mesh, vector<mesh_group_t>& groups);
+
+#define VERTEX_ATTR_POS      1
+#define VERTEX_ATTR_TEXCOORD 2
+#define VERTEX_ATTR_COLOR    4
+#define VERTEX_ATTR_NORMAL   8
+#define VERTEX_ATTR_TANGENT  16
+#define VERTEX_ATTR_MATERIAL 32
+
+typedef struct
+{
+	const void* data;        // attribute of vertex 0
+	int stride;              // bytes to the next vertex, sizeof the attribute for a tightly packed stream
+}vertex_stream_t;
+
+// where the attributes of count vertices are. a vertex_t array is one interleaved set of streams,
+// a structure of arrays one stream per attribute. only the position pass of the indexed draws
+// runs on every vertex, so it reads pos alone. a missing attribute is a constant: white, uv 0,
+// normal +z, tangent +x, material 0
+typedef struct
+{
+	int count;
+	int attributes;          // VERTEX_ATTR_* of the streams that are set, pos is required
+	vertex_stream_t pos, tc, color, normal, tangent, material;
+}vertex_layout_t;
+
+// the layout of an array of vertex_t, every attribute
+void vertex_layout_interleaved(vertex_layout_t* layout, const vertex_t* vertices, int count);
+
+template <typename T>
+inline const T& vertex_fetch(const vertex_stream_t& stream, int id)
+{
+	return *(const T*)((const char*)stream.data + (size_t)id * stream.stride);
+}
+
+// VARYING_* that change across a triangle drawn from layout, the others are flat
+int vertex_layout_varyings(const vertex_layout_t* layout);
+
+// draw_indexed of the triangle list groups that survive device_cull_bounds, first / count of the
+// groups are index ranges. nothing is copied, so the streams may be a mapped mesh_file_t
+void draw_indexed_groups(device_t* device, const vertex_layout_t* layout, const int* indices, const mesh_group_t* groups, int group_count);
+
+// draw_indexed once per instance with the world matrix transforms[i] and the material constants
+// params[i] (device->PBR for all of them when NULL), all in one tile pass without touching
+// device->PBR. the vertex streams and the post-transform cache are shared by the instances, bounds
+// (may be NULL) culls each instance. the world matrix is restored afterwards
+void draw_instanced(device_t* device, vector<vertex_t>& vertices, vector<int>& indices, int topology,
+	const s_matrix* transforms, const s_PBR* params, int instances, const mesh_group_t* bounds);
+
+// draw triangles whose corners are vertex shaded in world space already: corners holds 3 indices into vertices
+// per triangle, materials the material of each, and the pos of a vertex is its world position. only the view
+// projection, the cull and the set up are left, in every pass of the render state. the fragments get
+// device->instance, varyings are the VARYING_* of the layout the vertices came from. see multiview.h
+void draw_shaded(device_t* device, const for_fs* vertices, const int* corners, const int* materials, int triangles, int varyings);
+
 void camera_at_zero(device_t* device, s_vector eye, s_vector at, s_vector up);
 
 void init_texture(device_t* device);
 
 void init_texture_by_photo(device_t* device, char const* path);
 
+// textures baked by the texture baker are mapped from path instead of decoded, false when it can't be mapped
+bool mount_texture_file(device_t* device, char const* path);
+
+// stream the textures mounted from now on: only the mip levels the frames sample are kept in memory, at
+// most megabytes of them. device_clear takes the levels the last frame sampled and queues their loads,
+// so no other device may draw with the same assets while it runs
+void device_set_texture_budget(device_t* device, int megabytes);
+
+// start decoding path on the texture registry's worker threads, the init_texture_by_diffuse /
+// specular / normal / albedo call for it later only waits for the decode
+void prefetch_texture(device_t* device, char const* path);
+
 void init_texture_by_diffuse(device_t* device, char const* path, int count);
 
 void init_texture_by_specular(device_t* device, char const* path, int count);
@@ -211,6 +716,19 @@ void init_texture_by_roughness(device_t* device, char const* path, int count);
 
 void init_texture_by_ao(device_t* device, char const* path, int count);
 
+// the metallic, roughness and ao calls above in one, mapped already packed when a mounted file has
+// them baked together. any path may be NULL
+void init_texture_by_orm(device_t* device, char const* ao, char const* roughness, char const* metallic, int count);
+
 bool load_obj(std::vector<vertex_t>& tot_vertex, device_t* device, const char* obj_path, const char* pre_mtl_path, int start, bool filp_y);
 
+// also appends one mesh_group_t per material run of every obj shape to groups
+bool load_obj(std::vector<vertex_t>& tot_vertex, std::vector<mesh_group_t>& groups, device_t* device, const char* obj_path, const char* pre_mtl_path, int start, bool filp_y);
+
+// the part of load_obj that needs no device: the triangle list, its groups and the materials
+bool load_obj_mesh(std::vector<vertex_t>& tot_vertex, std::vector<mesh_group_t>& groups, std::vector<mesh_material_t>& materials, const char* obj_path, const char* pre_mtl_path, int start, bool filp_y);
+
+// load the textures of materials into device->assets->material[start..] and append them to vmaterial
+void device_bind_materials(device_t* device, const mesh_material_t* materials, int count, int start);
+
 #endif
@@ -1,4 +1,5 @@
 #include "s_math.h"
+#include "s_simd.h"
 #include<cmath>
 //Խ紦 
 int CMID(int x, int min, int max)
@@ -19,90 +20,66 @@ float interp_(float& x1, float& x2, float t)
 	return x1 + (x2 - x1) * t;
 }
 
-float s_vector::length()// 
+float s_vector::length() const// 
 {
-	return (float)sqrt(x * x + y * y + z * z);
+	return ::length(*this);
 }
 //a=b+c;
-void s_vector::add_two(s_vector& b, s_vector& c)
+void s_vector::add_two(const s_vector& b, const s_vector& c)
 {
-	x = b.x + c.x;
-	y = b.y + c.y;
-	z = b.z + c.z;
-	w = 1.0;
+	*this = b + c;
 }
 //a+=b;
-void s_vector::add(s_vector& b)
+void s_vector::add(const s_vector& b)
 {
-	x += b.x;
-	y += b.y;
-	z += b.z;
-	w = 1.0f;
+	*this = *this + b;
 }
 
-s_vector& s_vector::operator+=(s_vector& t)
+s_vector& s_vector::operator+=(const s_vector& t)
 {
-	x += t.x; y += t.y; z += t.z; w = 1.0;
+	*this = *this + t;
 	return *this;
 }
 //a=b-c;
-void s_vector::minus_two(s_vector& b, s_vector& c)
+void s_vector::minus_two(const s_vector& b, const s_vector& c)
 {
-	x = b.x - c.x;
-	y = b.y - c.y;
-	z = b.z - c.z;
-	w = 1.0;
+	*this = b - c;
 }
 
 //return the result of dotproduct 
-float s_vector::dotproduct(s_vector& t)
+float s_vector::dotproduct(const s_vector& t) const
 {
-	return x * t.x + y * t.y + z * t.z;
+	return dot(*this, t);
 }
 //a=a*b;
 
 
-void s_vector::dot_two(s_vector& b, s_vector& c)
+void s_vector::dot_two(const s_vector& b, const s_vector& c)
 {
-	x = b.x * c.x;
-	y = b.y * c.y;
-	z = b.z * c.z;
-	w = 1.0;
+	*this = b * c;
 }
 
 void s_vector::float_dot(float k)
 {
-	x *= k;
-	y *= k;
-	z *= k;
-	w *= k;
+	*this = *this * k;
 }
 
-void s_vector::float_dot_two(s_vector& tmp, float k)
+void s_vector::float_dot_two(const s_vector& tmp, float k)
 {
-	x = tmp.x * k;
-	y = tmp.y * k;
-	z = tmp.z * k;
-	w = tmp.w * k;
+	*this = tmp * k;
 }
 
 //a=b X c
-void s_vector::crossproduct(s_vector& b, s_vector& c)
+void s_vector::crossproduct(const s_vector& b, const s_vector& c)
 {
-	x = b.y * c.z - b.z * c.y;
-	y = b.z * c.x - b.x * c.z;
-	z = b.x * c.y - b.y * c.x;
-	w = 1.0f;
+	*this = cross(b, c);
 }
 //interp the vector
-void s_vector::interp_two(s_vector& a, s_vector& b, float t)
+void s_vector::interp_two(const s_vector& a, const s_vector& b, float t)
 {
-	x = interp(a.x, b.x, t);
-	y = interp(a.y, b.y, t);
-	z = interp(a.z, b.z, t);
-	w = 1.0f;
+	*this = lerp(a, b, t);
 }
-void s_vector::divide_two(s_vector& a, s_vector& b)
+void s_vector::divide_two(const s_vector& a, const s_vector& b)
 {
 	x = a.x / (b.x+ 0.0001f);
 	y= a.y / (b.y + 0.0001f);
@@ -111,97 +88,60 @@ void s_vector::divide_two(s_vector& a, s_vector& b)
 
 void s_vector::normalize()
 {
-	float length = this->length();
-	if (length != 0.0f)
-	{
-		float inv = 1.0f / length;
-		x *= inv;
-		y *= inv;
-		z *= inv;
-	}
+	*this = ::normalize(*this);
 }
 void s_vector::float_divide(float k)
 {
-	x = x / k;
-	y = y / k;
-	z = z / k;
-	w = w / k;
+	*this = *this / k;
 }
 
-void s_vector::interpolate(float alpha, float beta, float gamma, s_vector& vert1, s_vector& vert2, s_vector& vert3, float weight)
-{
-	s_vector tmp1; tmp1.float_dot_two(vert1, alpha);
-	s_vector tmp2; tmp2.float_dot_two(vert2, beta);
-	s_vector tmp3; tmp3.float_dot_two(vert3, gamma);
-	s_vector tmp4; tmp4.add_two(tmp1, tmp2);
-	tmp4.add_two(tmp4, tmp3);
-	tmp4.float_divide(weight);
-	x = tmp4.x;
-	y = tmp4.y;
-	z = tmp4.z;
-	w = tmp4.w;
+void s_vector::interpolate(float alpha, float beta, float gamma, const s_vector& vert1, const s_vector& vert2, const s_vector& vert3, float weight)
+{
+	s_simd_get()->interpolate(&x, &vert1.x, &vert2.x, &vert3.x, alpha, beta, gamma, weight);
+	// add_two always set w to 1 before the divide
+	w = 1.0f / weight;
 }
 
 void s_vector::inverse()
 {
-	x = -x;
-	y = -y;
-	z = -z;
+	*this = -*this;
 }
 
-void s_vector::reflect(s_vector& v, s_vector& n)
+void s_vector::reflect(const s_vector& v, const s_vector& n)
 {
-	*this = n;
-	float temp = -2.0 * v.dotproduct(n);
-	this->float_dot(temp);
-	this->add(v);
+	*this = ::reflect(v, n);
 }
 
 
 //s_vector2f
-void s_vector2f::add_two(s_vector2f& b, s_vector2f& c)
+void s_vector2f::add_two(const s_vector2f& b, const s_vector2f& c)
 {
-	u = b.u + c.u;
-	v = b.v + c.v;
+	*this = b + c;
 }
 void s_vector2f::float_dot(float k)
 {
-	u *= k;
-	v *= k;
+	*this = *this * k;
 }
-void s_vector2f::float_dot_two(s_vector2f& tmp, float k)
+void s_vector2f::float_dot_two(const s_vector2f& tmp, float k)
 {
-	u = tmp.u * k;
-	v = tmp.v * k;
-
+	*this = tmp * k;
 }
 void s_vector2f::float_divide(float k)
 {
-	u /= k;
-	v /= k;
+	*this = *this / k;
 }
-void s_vector2f::interpolate(float alpha, float beta, float gamma, s_vector2f& vert1, s_vector2f& vert2, s_vector2f& vert3, float weight)
+void s_vector2f::interpolate(float alpha, float beta, float gamma, const s_vector2f& vert1, const s_vector2f& vert2, const s_vector2f& vert3, float weight)
 {
-	s_vector2f tmp1; tmp1.float_dot_two(vert1, alpha);
-	s_vector2f tmp2; tmp2.float_dot_two(vert2, beta);
-	s_vector2f tmp3; tmp3.float_dot_two(vert3, gamma);
-	s_vector2f tmp4; tmp4.add_two(tmp1, tmp2);
-	tmp4.add_two(tmp4, tmp3);
-	tmp4.float_divide(weight);
-	u = tmp4.u;
-	v = tmp4.v;
+	*this = (vert1 * alpha + vert2 * beta + vert3 * gamma) / weight;
 }
 
 
-void s_color::dot_two(s_color& x, s_color& y)
+void s_color::dot_two(const s_color& x, const s_color& y)
 {
-	r = x.r * y.r;
-	g = x.g * y.g;
-	b = x.b * y.b;
-	a = x.a * y.a;
+	*this = x * y;
 }
 
-void s_color::dot_array(s_color& x, float* c)
+void s_color::dot_array(const s_color& x, const float* c)
 {
 	r = x.r * c[0];
 	g = x.g * c[1];
@@ -209,31 +149,19 @@ void s_color::dot_array(s_color& x, float* c)
 }
 void s_color::float_dot(float k)
 {
-	r *= k;
-	g *= k;
-	b *= k;
-	a *= k;
+	*this = *this * k;
 }
-void s_color::add_two(s_color& x, s_color& y)
+void s_color::add_two(const s_color& x, const s_color& y)
 {
-	r = x.r + y.r;
-	g = x.g + y.g;
-	b = x.b + y.b;
-	a = x.a + y.a;
+	*this = x + y;
 }
-void s_color::minus_two(s_color& x, s_color& y)
+void s_color::minus_two(const s_color& x, const s_color& y)
 {
-	r = x.r - y.r;
-	g = x.g - y.g;
-	b = x.b - y.b;
-	a = x.a - y.a;
+	*this = x - y;
 }
-void s_color::float_dot_two(s_color& x, float f)
+void s_color::float_dot_two(const s_color& x, float f)
 {
-	r = x.r * f;
-	g = x.g * f;
-	b = x.b * f;
-	a = x.a * f;
+	*this = x * f;
 }
 void s_color::float_divide(float f)
 {
@@ -242,23 +170,14 @@ void s_color::float_divide(float f)
 	b /= f;
 	a /= f;
 }
-void s_color::interpolate(float alpha, float beta, float gamma, s_color& vert1, s_color& vert2, s_color& vert3, float weight)
+void s_color::interpolate(float alpha, float beta, float gamma, const s_color& vert1, const s_color& vert2, const s_color& vert3, float weight)
 {
-	s_color tmp1; tmp1.float_dot_two(vert1, alpha);
-	s_color tmp2; tmp2.float_dot_two(vert2, beta);
-	s_color tmp3; tmp3.float_dot_two(vert3, gamma);
-	s_color tmp4; tmp4.add_two(tmp1, tmp2);
-	tmp4.add_two(tmp4, tmp3);
-	tmp4.float_divide(weight);
-	r = tmp4.r;
-	g = tmp4.g;
-	b = tmp4.b;
-	a = tmp4.a;
+	s_simd_get()->interpolate(&r, &vert1.r, &vert2.r, &vert3.r, alpha, beta, gamma, weight);
 }
 
 
 // m=a+b;
-void s_matrix::add_two(s_matrix& a, s_matrix& b)
+void s_matrix::add_two(const s_matrix& a, const s_matrix& b)
 {
 
 	for (int i = 0; i < 4; i++)
@@ -266,28 +185,19 @@ void s_matrix::add_two(s_matrix& a, s_matrix& b)
 			m[i][j] = a.m[i][j] + b.m[i][j];
 }
 // m=a-b;
-void s_matrix::minus_two(s_matrix& a, s_matrix& b)
+void s_matrix::minus_two(const s_matrix& a, const s_matrix& b)
 {
 	for (int i = 0; i < 4; i++)
 		for (int j = 0; j < 4; j++)
 			m[i][j] = a.m[i][j] - b.m[i][j];
 }
 //m=a*b;
-void s_matrix::mul_two(s_matrix& a, s_matrix& b)
+void s_matrix::mul_two(const s_matrix& a, const s_matrix& b)
 {
-	for (int i = 0; i < 4; i++)
-	{
-		for (int j = 0; j < 4; j++)
-		{
-			m[j][i] = (a.m[j][0] * b.m[0][i]) +
-				(a.m[j][1] * b.m[1][i]) +
-				(a.m[j][2] * b.m[2][i]) +
-				(a.m[j][3] * b.m[3][i]);
-		}
-	}
+	s_simd_get()->mat_mul(&m[0][0], &a.m[0][0], &b.m[0][0]);
 }
 //m=a*f
-void s_matrix::scale(s_matrix& a, float f)
+void s_matrix::scale(const s_matrix& a, float f)
 {
 	for (int i = 0; i < 4; i++)
 	{
@@ -355,7 +265,7 @@ void s_matrix::set_rotate(float x, float y, float z, float theta)
 }
 
 //let m be the rotate matrix 
-void s_matrix::set_rotate(s_vector v, float theta)
+void s_matrix::set_rotate(const s_vector& v, float theta)
 {
 	float x = v.x, y = v.y, z = v.z;
 	float qsin = (float)sin(theta * 0.5f);
@@ -381,40 +291,7 @@ void s_matrix::set_rotate(s_vector v, float theta)
 }
 void s_matrix::inverse()
 {
-	float t[3][6];
-	int i, j, k;
-	float f;
-
-	for (i = 0; i < 3; i++)
-		for (j = 0; j < 6; j++) {
-			if (j < 3)
-				t[i][j] = m[i][j];
-			else if (j == i + 3)
-				t[i][j] = 1;
-			else
-				t[i][j] = 0;
-		}
-
-	for (i = 0; i < 3; i++) {
-		f = t[i][i];
-		for (j = 0; j < 6; j++)
-			t[i][j] /= f;
-		for (j = 0; j < 3; j++) {
-			if (j != i) {
-				f = t[j][i];
-				for (k = 0; k < 6; k++)
-					t[j][k] = t[j][k] - t[i][k] * f;
-			}
-		}
-	}
-
-	for (i = 0; i < 3; i++)
-		for (j = 3; j < 6; j++)
-			m[i][j - 3] = t[i][j];
-
-	m[3][0] = -m[3][0];
-	m[3][1] = -m[3][1];
-	m[3][2] = -m[3][2];
+	s_simd_get()->inverse(&m[0][0]);
 }
 //ת 
 void s_matrix::transpose()
@@ -428,7 +305,7 @@ void s_matrix::transpose()
 		}
 }
 
-void s_matrix::set_rotate_translate_scale(s_vector& axis, float theta, s_vector& pos, s_vector& scale)
+void s_matrix::set_rotate_translate_scale(const s_vector& axis, float theta, const s_vector& pos, const s_vector& scale)
 {
 	this->set_scale(scale.x, scale.y, scale.z);
 	s_matrix r, t = *this;
@@ -439,7 +316,7 @@ void s_matrix::set_rotate_translate_scale(s_vector& axis, float theta, s_vector&
 	m[3][2] = pos.z;
 }
 
-void s_matrix::set_axis(s_vector& xaxis, s_vector& yaxis, s_vector& zaxis, s_vector& pos)
+void s_matrix::set_axis(const s_vector& xaxis, const s_vector& yaxis, const s_vector& zaxis, const s_vector& pos)
 {
 	m[0][0] = xaxis.x;    m[0][1] = xaxis.y;   m[0][2] = xaxis.z;
 	m[1][0] = yaxis.x;    m[1][1] = yaxis.y;   m[1][2] = yaxis.z;
@@ -448,4 +325,18 @@ void s_matrix::set_axis(s_vector& xaxis, s_vector& yaxis, s_vector& zaxis, s_vec
 
 	m[0][3] = m[1][3] = m[2][3] = 0.0f;
 	m[3][3] = 1.0f;
-}
\ No newline at end of file
+}
+
+s_matrix operator*(const s_matrix& a, const s_matrix& b)
+{
+	s_matrix out;
+	out.mul_two(a, b);
+	return out;
+}
+
+s_vector operator*(const s_vector& v, const s_matrix& m)
+{
+	s_vector out;
+	s_simd_get()->apply(&out.x, &v.x, &m.m[0][0]);
+	return out;
+}
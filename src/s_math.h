@@ -2,6 +2,7 @@
 #define s_math_h
 
 #include<cstdio>
+#include<cmath>
 #include<iostream>
 typedef unsigned int IUINT32;
 //Խ紦 
@@ -10,67 +11,62 @@ float CMID(float x, float min, float max);
 //ֵt Ϊ [0, 1] ֵ֮ 
 float interp(float x1, float x2, float t);
 float interp_(float& x1, float& x2, float t);
-class s_vector
+// 16 byte aligned so the s_simd kernels can treat them as one register
+class alignas(16) s_vector
 {
 public:
 	float x, y, z, w;
 
-	s_vector() { x = y = z = w = 0.0; }
-	s_vector(float a, float b, float c, float d) { x = a; y = b; z = c; w = d; }
-	~s_vector() {};
-	float length();
+	constexpr s_vector() : x(0.0f), y(0.0f), z(0.0f), w(0.0f) {}
+	constexpr s_vector(float a, float b, float c, float d) : x(a), y(b), z(c), w(d) {}
+	float length() const;
 	void show()
 	{
 		printf("%lf %lf %lf %lf\n", x, y, z, w);
 	}
 	void reset(float a, float b, float c, float d) { x = a; y = b; z = c; w = d; }
 
-	void equal(s_vector& t)
+	void equal(const s_vector& t)
 	{
 		x = t.x; y = t.y; z = t.z; w = t.w;
 	}
-	s_vector& operator=(s_vector& t)
-	{
-		x = t.x; y = t.y; z = t.z;  w = t.w;
-		return *this;
-	}
-	s_vector& operator+=(s_vector& t);
+	s_vector& operator+=(const s_vector& t);
 
 	//a=b+c;
-	void add_two(s_vector& b, s_vector& c);
+	void add_two(const s_vector& b, const s_vector& c);
 
-	void add(s_vector& b);
+	void add(const s_vector& b);
 
 	//a=b-c;
-	void minus_two(s_vector& b, s_vector& c);
+	void minus_two(const s_vector& b, const s_vector& c);
 
 	//return the result of dotproduct 
-	float dotproduct(s_vector& t);
+	float dotproduct(const s_vector& t) const;
 	//a=a*b;
 
 
-	void dot_two(s_vector& b, s_vector& c);
+	void dot_two(const s_vector& b, const s_vector& c);
 
 	void float_dot(float k);
 
-	void float_dot_two(s_vector& tmp, float k);
+	void float_dot_two(const s_vector& tmp, float k);
 
 	//a=b X c
-	void crossproduct(s_vector& b, s_vector& c);
+	void crossproduct(const s_vector& b, const s_vector& c);
 	//interp the vector
-	void interp_two(s_vector& a, s_vector& b, float t);
+	void interp_two(const s_vector& a, const s_vector& b, float t);
 
 	void normalize();
 
 	void float_divide(float k);
 
-	void divide_two(s_vector& a, s_vector& b);
+	void divide_two(const s_vector& a, const s_vector& b);
 	//ֵ 
-	void interpolate(float alpha, float beta, float gamma, s_vector& vert1, s_vector& vert2, s_vector& vert3, float weight);
+	void interpolate(float alpha, float beta, float gamma, const s_vector& vert1, const s_vector& vert2, const s_vector& vert3, float weight);
 	//a=-a;
 	void inverse();
 
-	void reflect(s_vector& v, s_vector& n);
+	void reflect(const s_vector& v, const s_vector& n);
 
 
 };
@@ -79,65 +75,52 @@ class s_vector2f
 {
 public:
 	float u, v;
-	s_vector2f() { u = v = 0.0; }
-	s_vector2f(float a, float b) { u = a; v = b; }
-	~s_vector2f() {};
-	s_vector2f& operator=(s_vector2f& t)
-	{
-		u = t.u;
-		v = t.v;
-		return *this;
-	}
+	constexpr s_vector2f() : u(0.0f), v(0.0f) {}
+	constexpr s_vector2f(float a, float b) : u(a), v(b) {}
 	void show()
 	{
 		printf("%lf %lf\n", u, v);
 	}
-	void add_two(s_vector2f& b, s_vector2f& c);
+	void add_two(const s_vector2f& b, const s_vector2f& c);
 
 	void float_dot(float k);
 
-	void float_dot_two(s_vector2f& tmp, float k);
+	void float_dot_two(const s_vector2f& tmp, float k);
 
 	void float_divide(float k);
 
-	void interpolate(float alpha, float beta, float gamma, s_vector2f& vert1, s_vector2f& vert2, s_vector2f& vert3, float weight);
+	void interpolate(float alpha, float beta, float gamma, const s_vector2f& vert1, const s_vector2f& vert2, const s_vector2f& vert3, float weight);
 
 };
 
-class s_color
+class alignas(16) s_color
 {
 public:
 	float r, g, b, a;
-	s_color() { r = g = b = a = 0.0f; }
-	s_color(float x, float y, float z, float w) { r = x; g = y; b = z; a = w; }
-	~s_color() {}
+	constexpr s_color() : r(0.0f), g(0.0f), b(0.0f), a(0.0f) {}
+	constexpr s_color(float x, float y, float z, float w) : r(x), g(y), b(z), a(w) {}
 	void show()
 	{
 		printf("%lf %lf %lf %lf\n", r, g, b, a);
 	}
-	s_color& operator=(s_color& t)
-	{
-		r = t.r; g = t.g; b = t.b; a = t.a;
-		return *this;
-	}
-	void dot_two(s_color& x, s_color& y);
-	void dot_array(s_color& x, float* c);
+	void dot_two(const s_color& x, const s_color& y);
+	void dot_array(const s_color& x, const float* c);
 
 	void float_dot(float k);
 
-	void add_two(s_color& x, s_color& y);
+	void add_two(const s_color& x, const s_color& y);
 
-	void minus_two(s_color& x, s_color& y);
+	void minus_two(const s_color& x, const s_color& y);
 
-	void float_dot_two(s_color& x, float f);
+	void float_dot_two(const s_color& x, float f);
 
 	void float_divide(float f);
 
-	void interpolate(float alpha, float beta, float gamma, s_color& vert1, s_color& vert2, s_color& vert3, float weight);
+	void interpolate(float alpha, float beta, float gamma, const s_color& vert1, const s_color& vert2, const s_color& vert3, float weight);
 
 };
 
-class s_matrix
+class alignas(16) s_matrix
 {
 public:
 	float m[4][4];
@@ -153,19 +136,6 @@ public:
 			for (int j = 0; j < 4; j++)
 				m[i][j] = x;
 	}
-	~s_matrix() {}
-
-	s_matrix& operator=(s_matrix& t)
-	{
-		for (int i = 0; i < 4; i++)
-		{
-			for (int j = 0; j < 4; j++)
-			{
-				m[i][j] = t.m[i][j];
-			}
-		}
-		return *this;
-	}
 	void show()
 	{
 		for (int i = 0; i < 4; i++)
@@ -178,16 +148,16 @@ public:
 		}
 	}
 	// m=a+b;
-	void add_two(s_matrix& a, s_matrix& b);
+	void add_two(const s_matrix& a, const s_matrix& b);
 
 	// m=a-b;
-	void minus_two(s_matrix& a, s_matrix& b);
+	void minus_two(const s_matrix& a, const s_matrix& b);
 
 	//m=a*b;
-	void mul_two(s_matrix& a, s_matrix& b);
+	void mul_two(const s_matrix& a, const s_matrix& b);
 
 	//m=a*f
-	void scale(s_matrix& a, float f);
+	void scale(const s_matrix& a, float f);
 
 	//set toλ 
 	void set_identity();
@@ -203,18 +173,67 @@ public:
 	//let m be the rotate matrix 
 	void set_rotate(float x, float y, float z, float theta);
 	//let m be the rotate matrix 
-	void set_rotate(s_vector v, float theta);
+	void set_rotate(const s_vector& v, float theta);
 	void inverse();
 	//ת 
 	void transpose();
 
 
-	void set_rotate_translate_scale(s_vector& axis, float theta, s_vector& pos, s_vector& scale);
+	void set_rotate_translate_scale(const s_vector& axis, float theta, const s_vector& pos, const s_vector& scale);
 
-	void set_axis(s_vector& xaxis, s_vector& yaxis, s_vector& zaxis, s_vector& pos);
+	void set_axis(const s_vector& xaxis, const s_vector& yaxis, const s_vector& zaxis, const s_vector& pos);
 
 
 };
 
+// value api: the results are returned and the arguments are const, so temporaries bind and the
+// compiler keeps the intermediates in registers. the xyz operations set w to 1 like the methods
+// above, which are wrappers of these, and do the same float operations in the same order
+constexpr s_vector operator+(const s_vector& a, const s_vector& b) { return s_vector(a.x + b.x, a.y + b.y, a.z + b.z, 1.0f); }
+constexpr s_vector operator-(const s_vector& a, const s_vector& b) { return s_vector(a.x - b.x, a.y - b.y, a.z - b.z, 1.0f); }
+// keeps w like s_vector::inverse
+constexpr s_vector operator-(const s_vector& a) { return s_vector(-a.x, -a.y, -a.z, a.w); }
+// componentwise like dot_two
+constexpr s_vector operator*(const s_vector& a, const s_vector& b) { return s_vector(a.x * b.x, a.y * b.y, a.z * b.z, 1.0f); }
+// all four lanes like float_dot
+constexpr s_vector operator*(const s_vector& a, float k) { return s_vector(a.x * k, a.y * k, a.z * k, a.w * k); }
+constexpr s_vector operator*(float k, const s_vector& a) { return a * k; }
+constexpr s_vector operator/(const s_vector& a, float k) { return s_vector(a.x / k, a.y / k, a.z / k, a.w / k); }
+constexpr float dot(const s_vector& a, const s_vector& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+constexpr s_vector cross(const s_vector& b, const s_vector& c)
+{
+	return s_vector(b.y * c.z - b.z * c.y, b.z * c.x - b.x * c.z, b.x * c.y - b.y * c.x, 1.0f);
+}
+constexpr s_vector lerp(const s_vector& a, const s_vector& b, float t)
+{
+	return s_vector(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, 1.0f);
+}
+// v mirrored about the plane of normal n
+constexpr s_vector reflect(const s_vector& v, const s_vector& n) { return n * (-2.0f * dot(v, n)) + v; }
+// of xyz
+inline float length(const s_vector& v) { return sqrtf(dot(v, v)); }
+// xyz / length(xyz), w kept, unchanged when the length is 0
+inline s_vector normalize(const s_vector& v)
+{
+	float len = length(v);
+	if (len == 0.0f) return v;
+	float inv = 1.0f / len;
+	return s_vector(v.x * inv, v.y * inv, v.z * inv, v.w);
+}
+
+constexpr s_vector2f operator+(const s_vector2f& a, const s_vector2f& b) { return s_vector2f(a.u + b.u, a.v + b.v); }
+constexpr s_vector2f operator*(const s_vector2f& a, float k) { return s_vector2f(a.u * k, a.v * k); }
+constexpr s_vector2f operator/(const s_vector2f& a, float k) { return s_vector2f(a.u / k, a.v / k); }
+
+constexpr s_color operator+(const s_color& x, const s_color& y) { return s_color(x.r + y.r, x.g + y.g, x.b + y.b, x.a + y.a); }
+constexpr s_color operator-(const s_color& x, const s_color& y) { return s_color(x.r - y.r, x.g - y.g, x.b - y.b, x.a - y.a); }
+constexpr s_color operator*(const s_color& x, const s_color& y) { return s_color(x.r * y.r, x.g * y.g, x.b * y.b, x.a * y.a); }
+constexpr s_color operator*(const s_color& x, float f) { return s_color(x.r * f, x.g * f, x.b * f, x.a * f); }
+
+// a * b through the s_simd kernels
+s_matrix operator*(const s_matrix& a, const s_matrix& b);
+// the row vector v * m, like apply_to_vector
+s_vector operator*(const s_vector& v, const s_matrix& m);
+
 #endif
 
@@ -0,0 +1,214 @@
+#include "s_simd.h"
+#include <cmath>
+#include <atomic>
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+//scalar
+static void scalar_mat_mul(float* out, const float* a, const float* b)
+{
+	float t[16];
+	for (int j = 0; j < 4; j++)
+		for (int i = 0; i < 4; i++)
+			t[j * 4 + i] = (a[j * 4 + 0] * b[0 * 4 + i]) +
+				(a[j * 4 + 1] * b[1 * 4 + i]) +
+				(a[j * 4 + 2] * b[2 * 4 + i]) +
+				(a[j * 4 + 3] * b[3 * 4 + i]);
+	for (int i = 0; i < 16; i++) out[i] = t[i];
+}
+
+static void scalar_apply(float* out, const float* v, const float* m)
+{
+	float X = v[0], Y = v[1], Z = v[2], W = v[3];
+	for (int i = 0; i < 4; i++)
+		out[i] = X * m[0 * 4 + i] + Y * m[1 * 4 + i] + Z * m[2 * 4 + i] + W * m[3 * 4 + i];
+}
+
+static void scalar_interpolate(float* out, const float* a, const float* b, const float* c, float alpha, float beta, float gamma, float weight)
+{
+	for (int i = 0; i < 4; i++)
+		out[i] = (a[i] * alpha + b[i] * beta + c[i] * gamma) / weight;
+}
+
+static float scalar_dot3(const float* a, const float* b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void scalar_normalize3(float* v)
+{
+	float length = (float)sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if (length != 0.0f)
+	{
+		float inv = 1.0f / length;
+		v[0] *= inv;
+		v[1] *= inv;
+		v[2] *= inv;
+	}
+}
+
+static void scalar_inverse(float* m)
+{
+	float t[3][6];
+	int i, j, k;
+	float f;
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 6; j++)
+			t[i][j] = (j < 3) ? m[i * 4 + j] : (j == i + 3 ? 1.0f : 0.0f);
+	for (i = 0; i < 3; i++) {
+		f = t[i][i];
+		for (j = 0; j < 6; j++)
+			t[i][j] /= f;
+		for (j = 0; j < 3; j++) {
+			if (j != i) {
+				f = t[j][i];
+				for (k = 0; k < 6; k++)
+					t[j][k] = t[j][k] - t[i][k] * f;
+			}
+		}
+	}
+	for (i = 0; i < 3; i++)
+		for (j = 3; j < 6; j++)
+			m[i * 4 + j - 3] = t[i][j];
+	m[12] = -m[12];
+	m[13] = -m[13];
+	m[14] = -m[14];
+}
+
+template <typename T>
+static int scalar_depth_test(T* z, const T* d, int mask, int flags)
+{
+	int pass = 0;
+	for (int i = 0; i < 8; i++)
+	{
+		if (!(mask & (1 << i))) continue;
+		if (!((flags & S_SIMD_DEPTH_EQUAL) ? d[i] == z[i] : d[i] >= z[i])) continue;
+		pass |= 1 << i;
+		if (flags & S_SIMD_DEPTH_WRITE) z[i] = d[i];
+	}
+	return pass;
+}
+
+static int scalar_depth_test_f32(float* z, const float* d, int mask, int flags)
+{
+	return scalar_depth_test(z, d, mask, flags);
+}
+
+static int scalar_depth_test_u32(unsigned int* z, const unsigned int* d, int mask, int flags)
+{
+	return scalar_depth_test(z, d, mask, flags);
+}
+
+static void scalar_mat_blend4(float* out, const float* const* m, const float* w)
+{
+	for (int i = 0; i < 16; i++)
+		out[i] = m[0][i] * w[0] + m[1][i] * w[1] + m[2][i] * w[2] + m[3][i] * w[3];
+}
+
+static const s_simd_kernels_t scalar_kernels = {
+	S_SIMD_SCALAR, "scalar",
+	scalar_mat_mul, scalar_apply, scalar_interpolate, scalar_dot3, scalar_normalize3, scalar_inverse,
+	scalar_depth_test_f32, scalar_depth_test_u32, scalar_mat_blend4
+};
+
+const s_simd_kernels_t* s_simd_scalar()
+{
+	return &scalar_kernels;
+}
+
+//neon, always present on aarch64
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+static void neon_mat_mul(float* out, const float* a, const float* b)
+{
+	float32x4_t b0 = vld1q_f32(b), b1 = vld1q_f32(b + 4), b2 = vld1q_f32(b + 8), b3 = vld1q_f32(b + 12);
+	float32x4_t r[4];
+	for (int j = 0; j < 4; j++)
+	{
+		float32x4_t s = vmulq_n_f32(b0, a[j * 4 + 0]);
+		s = vaddq_f32(s, vmulq_n_f32(b1, a[j * 4 + 1]));
+		s = vaddq_f32(s, vmulq_n_f32(b2, a[j * 4 + 2]));
+		r[j] = vaddq_f32(s, vmulq_n_f32(b3, a[j * 4 + 3]));
+	}
+	for (int j = 0; j < 4; j++) vst1q_f32(out + j * 4, r[j]);
+}
+
+static void neon_apply(float* out, const float* v, const float* m)
+{
+	float X = v[0], Y = v[1], Z = v[2], W = v[3];
+	float32x4_t s = vmulq_n_f32(vld1q_f32(m), X);
+	s = vaddq_f32(s, vmulq_n_f32(vld1q_f32(m + 4), Y));
+	s = vaddq_f32(s, vmulq_n_f32(vld1q_f32(m + 8), Z));
+	s = vaddq_f32(s, vmulq_n_f32(vld1q_f32(m + 12), W));
+	vst1q_f32(out, s);
+}
+
+static void neon_interpolate(float* out, const float* a, const float* b, const float* c, float alpha, float beta, float gamma, float weight)
+{
+	float32x4_t s = vaddq_f32(vmulq_n_f32(vld1q_f32(a), alpha), vmulq_n_f32(vld1q_f32(b), beta));
+	s = vaddq_f32(s, vmulq_n_f32(vld1q_f32(c), gamma));
+#if defined(__aarch64__)
+	s = vdivq_f32(s, vdupq_n_f32(weight));
+	vst1q_f32(out, s);
+#else
+	float t[4];
+	vst1q_f32(t, s);
+	for (int i = 0; i < 4; i++) out[i] = t[i] / weight;
+#endif
+}
+
+static void neon_mat_blend4(float* out, const float* const* m, const float* w)
+{
+	for (int j = 0; j < 16; j += 4)
+	{
+		float32x4_t s = vaddq_f32(vmulq_n_f32(vld1q_f32(m[0] + j), w[0]), vmulq_n_f32(vld1q_f32(m[1] + j), w[1]));
+		s = vaddq_f32(s, vmulq_n_f32(vld1q_f32(m[2] + j), w[2]));
+		vst1q_f32(out + j, vaddq_f32(s, vmulq_n_f32(vld1q_f32(m[3] + j), w[3])));
+	}
+}
+
+static const s_simd_kernels_t neon_kernels = {
+	S_SIMD_NEON, "neon",
+	neon_mat_mul, neon_apply, neon_interpolate, scalar_dot3, scalar_normalize3, scalar_inverse,
+	scalar_depth_test_f32, scalar_depth_test_u32, neon_mat_blend4
+};
+
+const s_simd_kernels_t* s_simd_neon()
+{
+	return &neon_kernels;
+}
+#else
+const s_simd_kernels_t* s_simd_neon()
+{
+	return 0;
+}
+#endif
+
+// job workers read it while another thread may select, the kernel tables themselves are constant
+static std::atomic<const s_simd_kernels_t*> active_kernels(0);
+
+const s_simd_kernels_t* s_simd_get()
+{
+	const s_simd_kernels_t* k = active_kernels.load(std::memory_order_acquire);
+	if (k != 0) return k;
+	k = s_simd_avx2();
+	if (k == 0) k = s_simd_sse41();
+	if (k == 0) k = s_simd_neon();
+	if (k == 0) k = s_simd_scalar();
+	// threads racing here detect the same back end, one that s_simd_select set in between wins
+	const s_simd_kernels_t* none = 0;
+	if (!active_kernels.compare_exchange_strong(none, k, std::memory_order_acq_rel)) return none;
+	return k;
+}
+
+int s_simd_select(int isa)
+{
+	const s_simd_kernels_t* k = 0;
+	if (isa == S_SIMD_SCALAR) k = s_simd_scalar();
+	else if (isa == S_SIMD_SSE41) k = s_simd_sse41();
+	else if (isa == S_SIMD_AVX2) k = s_simd_avx2();
+	else if (isa == S_SIMD_NEON) k = s_simd_neon();
+	if (k == 0) return 0;
+	active_kernels.store(k, std::memory_order_release);
+	return 1;
+}
@@ -0,0 +1,58 @@
+#ifndef s_simd_h
+#define s_simd_h
+//=====================================================================
+// SIMD kernels behind s_vector / s_color / s_matrix, picked at run time.
+// every back end does the same float operations in the same order as
+// the scalar code, so results are bit-identical. the build turns off the
+// contraction into fused multiply-add the compiler would otherwise do
+// (-ffp-contract=off, /fp:precise), see CMakeLists.txt.
+//=====================================================================
+
+#define S_SIMD_SCALAR 0
+#define S_SIMD_SSE41  1
+#define S_SIMD_AVX2   2
+#define S_SIMD_NEON   3
+
+// flags of the depth test kernels
+#define S_SIMD_DEPTH_EQUAL 1     // pass on d == z instead of d >= z
+#define S_SIMD_DEPTH_WRITE 2     // the lanes that pass get d
+
+// vectors are 4 floats (x, y, z, w), matrices 16 floats row major like s_matrix::m
+typedef struct
+{
+	int isa;
+	const char* name;
+	// out = a * b, out may alias a or b
+	void (*mat_mul)(float* out, const float* a, const float* b);
+	// out = v * m (row vector), out may alias v
+	void (*apply)(float* out, const float* v, const float* m);
+	// out = (a * alpha + b * beta + c * gamma) / weight on all four lanes
+	void (*interpolate)(float* out, const float* a, const float* b, const float* c, float alpha, float beta, float gamma, float weight);
+	// s_vector inlines dot and normalize as the scalar form of these two, a call costs more than three lanes
+	float (*dot3)(const float* a, const float* b);
+	// xyz /= length(xyz) unless the length is 0
+	void (*normalize3)(float* v);
+	// Gauss-Jordan on the upper 3x3 and negated translation, see s_matrix::inverse
+	void (*inverse)(float* m);
+	// depth test of a row of up to 8 fragments, larger is nearer: the lanes of mask (bit i is z[i]) where
+	// d >= z, see S_SIMD_DEPTH_*. the lanes outside mask are neither read nor written
+	int (*depth_test_f32)(float* z, const float* d, int mask, int flags);
+	// the same on integer depth below 2^31
+	int (*depth_test_u32)(unsigned int* z, const unsigned int* d, int mask, int flags);
+	// out = ((m[0] * w[0] + m[1] * w[1]) + m[2] * w[2]) + m[3] * w[3], the joint matrix of a skinned vertex
+	void (*mat_blend4)(float* out, const float* const* m, const float* w);
+}s_simd_kernels_t;
+
+// the kernels in use, the best supported back end is chosen on first call
+const s_simd_kernels_t* s_simd_get();
+
+// force a back end, returns 0 if it is not supported on this CPU/build
+int s_simd_select(int isa);
+
+// back ends, NULL when not compiled in or not supported by the CPU
+const s_simd_kernels_t* s_simd_scalar();
+const s_simd_kernels_t* s_simd_sse41();
+const s_simd_kernels_t* s_simd_avx2();
+const s_simd_kernels_t* s_simd_neon();
+
+#endif
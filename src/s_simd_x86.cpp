@@ -0,0 +1,317 @@
+#include "s_simd.h"
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// gcc/clang need the ISA enabled per function, msvc accepts the intrinsics anywhere
+#if defined(__GNUC__) || defined(__clang__)
+#define S_SIMD_TARGET(x) __attribute__((target(x)))
+#else
+#define S_SIMD_TARGET(x)
+#endif
+
+static int cpu_has(int isa)
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int leaves = info[0];
+	__cpuid(info, 1);
+	int sse41 = (info[2] >> 19) & 1;
+	int osxsave = (info[2] >> 27) & 1, avx = (info[2] >> 28) & 1;
+	if (isa == S_SIMD_SSE41) return sse41;
+	// avx2 is a bit of leaf 7, older cpus stop before it
+	if (leaves < 7 || !osxsave || !avx || (_xgetbv(0) & 6) != 6) return 0;
+	__cpuidex(info, 7, 0);
+	return (info[1] >> 5) & 1;
+#else
+	__builtin_cpu_init();
+	if (isa == S_SIMD_SSE41) return __builtin_cpu_supports("sse4.1");
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+//sse4.1
+S_SIMD_TARGET("sse4.1")
+static void sse_mat_mul(float* out, const float* a, const float* b)
+{
+	__m128 b0 = _mm_loadu_ps(b), b1 = _mm_loadu_ps(b + 4), b2 = _mm_loadu_ps(b + 8), b3 = _mm_loadu_ps(b + 12);
+	__m128 r[4];
+	for (int j = 0; j < 4; j++)
+	{
+		__m128 s = _mm_mul_ps(_mm_set1_ps(a[j * 4 + 0]), b0);
+		s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(a[j * 4 + 1]), b1));
+		s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(a[j * 4 + 2]), b2));
+		r[j] = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(a[j * 4 + 3]), b3));
+	}
+	for (int j = 0; j < 4; j++) _mm_storeu_ps(out + j * 4, r[j]);
+}
+
+S_SIMD_TARGET("sse4.1")
+static void sse_apply(float* out, const float* v, const float* m)
+{
+	__m128 p = _mm_loadu_ps(v);
+	__m128 s = _mm_mul_ps(_mm_shuffle_ps(p, p, 0x00), _mm_loadu_ps(m));
+	s = _mm_add_ps(s, _mm_mul_ps(_mm_shuffle_ps(p, p, 0x55), _mm_loadu_ps(m + 4)));
+	s = _mm_add_ps(s, _mm_mul_ps(_mm_shuffle_ps(p, p, 0xaa), _mm_loadu_ps(m + 8)));
+	s = _mm_add_ps(s, _mm_mul_ps(_mm_shuffle_ps(p, p, 0xff), _mm_loadu_ps(m + 12)));
+	_mm_storeu_ps(out, s);
+}
+
+S_SIMD_TARGET("sse4.1")
+static void sse_interpolate(float* out, const float* a, const float* b, const float* c, float alpha, float beta, float gamma, float weight)
+{
+	__m128 s = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a), _mm_set1_ps(alpha)), _mm_mul_ps(_mm_loadu_ps(b), _mm_set1_ps(beta)));
+	s = _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(c), _mm_set1_ps(gamma)));
+	_mm_storeu_ps(out, _mm_div_ps(s, _mm_set1_ps(weight)));
+}
+
+// (x + y) + z, the same order as the scalar sum
+S_SIMD_TARGET("sse4.1")
+static inline __m128 sse_sum3(__m128 p)
+{
+	__m128 s = _mm_add_ss(p, _mm_shuffle_ps(p, p, 0x55));
+	return _mm_add_ss(s, _mm_movehl_ps(p, p));
+}
+
+S_SIMD_TARGET("sse4.1")
+static float sse_dot3(const float* a, const float* b)
+{
+	return _mm_cvtss_f32(sse_sum3(_mm_mul_ps(_mm_loadu_ps(a), _mm_loadu_ps(b))));
+}
+
+S_SIMD_TARGET("sse4.1")
+static void sse_normalize3(float* v)
+{
+	__m128 p = _mm_loadu_ps(v);
+	__m128 length = _mm_sqrt_ss(sse_sum3(_mm_mul_ps(p, p)));
+	if (_mm_cvtss_f32(length) == 0.0f) return;
+	__m128 inv = _mm_div_ss(_mm_set_ss(1.0f), length);
+	__m128 n = _mm_mul_ps(p, _mm_shuffle_ps(inv, inv, 0x00));
+	// keep w
+	_mm_storeu_ps(v, _mm_blend_ps(n, p, 0x8));
+}
+
+// one Gauss-Jordan row is 6 floats, it is kept in two registers
+S_SIMD_TARGET("sse4.1")
+static void sse_inverse(float* m)
+{
+	__m128 lo[3], hi[3];
+	for (int i = 0; i < 3; i++)
+	{
+		lo[i] = _mm_blend_ps(_mm_loadu_ps(m + i * 4), _mm_setzero_ps(), 0x8);
+		hi[i] = _mm_setzero_ps();
+	}
+	lo[0] = _mm_blend_ps(lo[0], _mm_set1_ps(1.0f), 0x8);
+	hi[1] = _mm_blend_ps(hi[1], _mm_set1_ps(1.0f), 0x1);
+	hi[2] = _mm_blend_ps(hi[2], _mm_set1_ps(1.0f), 0x2);
+	for (int i = 0; i < 3; i++)
+	{
+		float t[4];
+		_mm_storeu_ps(t, lo[i]);
+		__m128 f = _mm_set1_ps(t[i]);
+		lo[i] = _mm_div_ps(lo[i], f);
+		hi[i] = _mm_div_ps(hi[i], f);
+		for (int j = 0; j < 3; j++)
+		{
+			if (j == i) continue;
+			_mm_storeu_ps(t, lo[j]);
+			f = _mm_set1_ps(t[i]);
+			lo[j] = _mm_sub_ps(lo[j], _mm_mul_ps(lo[i], f));
+			hi[j] = _mm_sub_ps(hi[j], _mm_mul_ps(hi[i], f));
+		}
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		float t[8];
+		_mm_storeu_ps(t, lo[i]);
+		_mm_storeu_ps(t + 4, hi[i]);
+		m[i * 4 + 0] = t[3];
+		m[i * 4 + 1] = t[4];
+		m[i * 4 + 2] = t[5];
+	}
+	m[12] = -m[12];
+	m[13] = -m[13];
+	m[14] = -m[14];
+}
+
+// sse has no masked loads, the lanes of mask are copied in and out around two 4 wide compares
+S_SIMD_TARGET("sse4.1")
+static int sse_depth_test_f32(float* z, const float* d, int mask, int flags)
+{
+	float zs[8] = { 0 }, ds[8] = { 0 };
+	for (int i = 0; i < 8; i++) if (mask & (1 << i)) { zs[i] = z[i]; ds[i] = d[i]; }
+	int pass = 0;
+	for (int h = 0; h < 8; h += 4)
+	{
+		__m128 vz = _mm_loadu_ps(zs + h), vd = _mm_loadu_ps(ds + h);
+		__m128 c = (flags & S_SIMD_DEPTH_EQUAL) ? _mm_cmpeq_ps(vd, vz) : _mm_cmpge_ps(vd, vz);
+		pass |= _mm_movemask_ps(c) << h;
+	}
+	pass &= mask;
+	if (flags & S_SIMD_DEPTH_WRITE)
+		for (int i = 0; i < 8; i++) if (pass & (1 << i)) z[i] = d[i];
+	return pass;
+}
+
+S_SIMD_TARGET("sse4.1")
+static int sse_depth_test_u32(unsigned int* z, const unsigned int* d, int mask, int flags)
+{
+	int zs[8] = { 0 }, ds[8] = { 0 };
+	for (int i = 0; i < 8; i++) if (mask & (1 << i)) { zs[i] = (int)z[i]; ds[i] = (int)d[i]; }
+	int pass = 0;
+	for (int h = 0; h < 8; h += 4)
+	{
+		__m128i vz = _mm_loadu_si128((const __m128i*)(zs + h)), vd = _mm_loadu_si128((const __m128i*)(ds + h));
+		__m128i c = _mm_cmpeq_epi32(vd, vz);
+		if (!(flags & S_SIMD_DEPTH_EQUAL)) c = _mm_or_si128(c, _mm_cmpgt_epi32(vd, vz));
+		pass |= _mm_movemask_ps(_mm_castsi128_ps(c)) << h;
+	}
+	pass &= mask;
+	if (flags & S_SIMD_DEPTH_WRITE)
+		for (int i = 0; i < 8; i++) if (pass & (1 << i)) z[i] = d[i];
+	return pass;
+}
+
+S_SIMD_TARGET("sse4.1")
+static void sse_mat_blend4(float* out, const float* const* m, const float* w)
+{
+	__m128 w0 = _mm_set1_ps(w[0]), w1 = _mm_set1_ps(w[1]), w2 = _mm_set1_ps(w[2]), w3 = _mm_set1_ps(w[3]);
+	for (int j = 0; j < 16; j += 4)
+	{
+		__m128 s = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m[0] + j), w0), _mm_mul_ps(_mm_loadu_ps(m[1] + j), w1));
+		s = _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(m[2] + j), w2));
+		_mm_storeu_ps(out + j, _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(m[3] + j), w3)));
+	}
+}
+
+static const s_simd_kernels_t sse_kernels = {
+	S_SIMD_SSE41, "sse4.1",
+	sse_mat_mul, sse_apply, sse_interpolate, sse_dot3, sse_normalize3, sse_inverse,
+	sse_depth_test_f32, sse_depth_test_u32, sse_mat_blend4
+};
+
+//avx2, the 4x4 product is done two rows per instruction
+S_SIMD_TARGET("avx2")
+static void avx_mat_mul(float* out, const float* a, const float* b)
+{
+	__m256 b0 = _mm256_broadcast_ps((const __m128*)b), b1 = _mm256_broadcast_ps((const __m128*)(b + 4));
+	__m256 b2 = _mm256_broadcast_ps((const __m128*)(b + 8)), b3 = _mm256_broadcast_ps((const __m128*)(b + 12));
+	__m256 r[2];
+	for (int j = 0; j < 2; j++)
+	{
+		const float* r0 = a + j * 8, * r1 = r0 + 4;
+		__m256 s = _mm256_mul_ps(_mm256_setr_ps(r0[0], r0[0], r0[0], r0[0], r1[0], r1[0], r1[0], r1[0]), b0);
+		s = _mm256_add_ps(s, _mm256_mul_ps(_mm256_setr_ps(r0[1], r0[1], r0[1], r0[1], r1[1], r1[1], r1[1], r1[1]), b1));
+		s = _mm256_add_ps(s, _mm256_mul_ps(_mm256_setr_ps(r0[2], r0[2], r0[2], r0[2], r1[2], r1[2], r1[2], r1[2]), b2));
+		r[j] = _mm256_add_ps(s, _mm256_mul_ps(_mm256_setr_ps(r0[3], r0[3], r0[3], r0[3], r1[3], r1[3], r1[3], r1[3]), b3));
+	}
+	_mm256_storeu_ps(out, r[0]);
+	_mm256_storeu_ps(out + 8, r[1]);
+}
+
+// a whole Gauss-Jordan row fits in one register
+S_SIMD_TARGET("avx2")
+static void avx_inverse(float* m)
+{
+	__m256 row[3];
+	for (int i = 0; i < 3; i++)
+		row[i] = _mm256_setr_ps(m[i * 4 + 0], m[i * 4 + 1], m[i * 4 + 2], i == 0 ? 1.0f : 0.0f, i == 1 ? 1.0f : 0.0f, i == 2 ? 1.0f : 0.0f, 0.0f, 0.0f);
+	for (int i = 0; i < 3; i++)
+	{
+		float t[8];
+		_mm256_storeu_ps(t, row[i]);
+		row[i] = _mm256_div_ps(row[i], _mm256_set1_ps(t[i]));
+		for (int j = 0; j < 3; j++)
+		{
+			if (j == i) continue;
+			_mm256_storeu_ps(t, row[j]);
+			row[j] = _mm256_sub_ps(row[j], _mm256_mul_ps(row[i], _mm256_set1_ps(t[i])));
+		}
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		float t[8];
+		_mm256_storeu_ps(t, row[i]);
+		m[i * 4 + 0] = t[3];
+		m[i * 4 + 1] = t[4];
+		m[i * 4 + 2] = t[5];
+	}
+	m[12] = -m[12];
+	m[13] = -m[13];
+	m[14] = -m[14];
+}
+
+// lane i of the mask register is all ones when bit i of mask is set
+S_SIMD_TARGET("avx2")
+static inline __m256i avx_lanes(int mask)
+{
+	const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+	return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(mask), bits), bits);
+}
+
+// the row of 8 in one compare, the masked loads and stores keep off the pixels past its end
+S_SIMD_TARGET("avx2")
+static int avx_depth_test_f32(float* z, const float* d, int mask, int flags)
+{
+	__m256i lanes = avx_lanes(mask);
+	__m256 vz = _mm256_maskload_ps(z, lanes), vd = _mm256_maskload_ps(d, lanes);
+	__m256 c = (flags & S_SIMD_DEPTH_EQUAL) ? _mm256_cmp_ps(vd, vz, _CMP_EQ_OQ) : _mm256_cmp_ps(vd, vz, _CMP_GE_OQ);
+	c = _mm256_and_ps(c, _mm256_castsi256_ps(lanes));
+	if (flags & S_SIMD_DEPTH_WRITE) _mm256_maskstore_ps(z, _mm256_castps_si256(c), vd);
+	return _mm256_movemask_ps(c);
+}
+
+S_SIMD_TARGET("avx2")
+static int avx_depth_test_u32(unsigned int* z, const unsigned int* d, int mask, int flags)
+{
+	__m256i lanes = avx_lanes(mask);
+	__m256i vz = _mm256_maskload_epi32((const int*)z, lanes), vd = _mm256_maskload_epi32((const int*)d, lanes);
+	__m256i c = _mm256_cmpeq_epi32(vd, vz);
+	if (!(flags & S_SIMD_DEPTH_EQUAL)) c = _mm256_or_si256(c, _mm256_cmpgt_epi32(vd, vz));
+	c = _mm256_and_si256(c, lanes);
+	if (flags & S_SIMD_DEPTH_WRITE) _mm256_maskstore_epi32((int*)z, c, vd);
+	return _mm256_movemask_ps(_mm256_castsi256_ps(c));
+}
+
+// two rows of the four matrices per instruction
+S_SIMD_TARGET("avx2")
+static void avx_mat_blend4(float* out, const float* const* m, const float* w)
+{
+	__m256 w0 = _mm256_set1_ps(w[0]), w1 = _mm256_set1_ps(w[1]), w2 = _mm256_set1_ps(w[2]), w3 = _mm256_set1_ps(w[3]);
+	for (int j = 0; j < 16; j += 8)
+	{
+		__m256 s = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(m[0] + j), w0), _mm256_mul_ps(_mm256_loadu_ps(m[1] + j), w1));
+		s = _mm256_add_ps(s, _mm256_mul_ps(_mm256_loadu_ps(m[2] + j), w2));
+		_mm256_storeu_ps(out + j, _mm256_add_ps(s, _mm256_mul_ps(_mm256_loadu_ps(m[3] + j), w3)));
+	}
+}
+
+static const s_simd_kernels_t avx_kernels = {
+	S_SIMD_AVX2, "avx2",
+	avx_mat_mul, sse_apply, sse_interpolate, sse_dot3, sse_normalize3, avx_inverse,
+	avx_depth_test_f32, avx_depth_test_u32, avx_mat_blend4
+};
+
+const s_simd_kernels_t* s_simd_sse41()
+{
+	return cpu_has(S_SIMD_SSE41) ? &sse_kernels : 0;
+}
+
+const s_simd_kernels_t* s_simd_avx2()
+{
+	return cpu_has(S_SIMD_AVX2) ? &avx_kernels : 0;
+}
+#else
+const s_simd_kernels_t* s_simd_sse41()
+{
+	return 0;
+}
+
+const s_simd_kernels_t* s_simd_avx2()
+{
+	return 0;
+}
+#endif
@@ -0,0 +1,835 @@
+//=====================================================================
+// the demo scene: the seven states the window steps through, and
+// draw_box which draws one frame of the current state. the materials,
+// textures, meshes, lights and camera presets come from a scene file.
+// shared by the window and the headless renderer.
+//=====================================================================
+#include "scene.h"
+#include "texture.h"
+#include "shadow.h"
+#include "ibl.h"
+#include "scene_assets.h"
+#include "mesh_lod.h"
+#include "scene_graph.h"
+#include "scene_file.h"
+#include "memory_track.h"
+#include "lightmap.h"
+#include "raytrace.h"
+#include <cmath>
+#include <algorithm>
+#include <deque>
+
+vertex_t mesh[36] = {
+	// Positions                  // Texture Coords  //color           //rhw // Normals  // tangent
+	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f,-1.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f, -0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f ,1.0f}, 1,{ 0.0f,  0.0f,-1.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f, -0.5f, 1.0f}, {1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f ,1.0f},1, {0.0f,  0.0f,-1.0f ,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f, -0.5f, 1.0f}, { 1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f ,1.0f},1, {0.0f,  0.0f,-1.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f, -0.5f, 1.0f}, {1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, {0.0f,  0.0f,-1.0f ,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1,{ 0.0f,  0.0f,-1.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+
+	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f},{1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f, 1.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f,  0.5f, 1.0f},{ 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, {0.0f,  0.0f,  1.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f,  0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f,  1.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, { 0.0f,  0.0f,  1.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+
+	{{-0.5f,  0.5f,  0.5f, 1.0f}, { 1.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f}, 1, {-1.0f,  0.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f, -0.5f, 1.0f},{ 1.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { -1.0f,  0.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, { -1.0f,  0.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { -1.0f,  0.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f}, 1, { -1.0f,  0.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f,  0.5f,1.0f},{ 1.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { -1.0f,  0.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+
+	{{0.5f,  0.5f,  0.5f,1.0f}, { 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {1.0f,  0.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f,  0.5f,1.0f},{ 0.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f, -0.5f,1.0f},{ 0.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f, -0.5f,1.0f},{ 0.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f, -0.5f,1.0f},{ 1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f,1.0f},{ 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+
+	{{-0.5f, -0.5f, -0.5f,1.0f},{  0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, {  0.0f, -1.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f, -0.5f,1.0f}, { 1.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, { 0.0f, -1.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f,  0.5f,1.0f}, { 1.0f,  0.0f}, {1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f, -1.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f,  0.5f,1.0f}, { 1.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1,{ 0.0f, -1.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f,  0.5f,1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, {  0.0f, -1.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f, -0.5f,1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, {  0.0f, -1.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+
+	{{-0.5f,  0.5f, -0.5f, 1.0f}, {0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f, 1.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f,  0.5f, 1.0f},  {0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1,{ 0.0f, 1.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f, 1.0f},  {1.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,1.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f, 1.0f},  {1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,1.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f, -0.5f, 1.0f},  {1.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1,{ 0.0f,1.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f, -0.5f, 1.0f},  {0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1,{ 0.0f, 1.0f,  0.0f,0.0f},1, { 0.0f, 0.0f, 0.0f, 0.0f }}
+};
+vertex_t mesh2[36] = {
+	// Positions                  // Texture Coords  //color           //rhw // Normals  //index_material  // tangent
+	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 1.0f, 1.0f, 1.0f },1, { 0.0f,  0.0f,-1.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f, -0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 1.0f, 1.0f ,1.0f}, 1,{ 0.0f,  0.0f,-1.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f, -0.5f, 1.0f}, {1.0f,  1.0f}, { 1.0f, 1.0f, 1.0f ,1.0f},1, {0.0f,  0.0f,-1.0f ,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f, -0.5f, 1.0f}, { 1.0f,  1.0f}, { 1.0f, 1.0f, 1.0f ,1.0f},1, {0.0f,  0.0f,-1.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f, -0.5f, 1.0f}, {1.0f,  0.0f}, { 1.0f, 1.0f, 1.0f, 1.0f },1, {0.0f,  0.0f,-1.0f ,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  0.0f},{1.0f, 1.0f, 1.0f, 1.0f }, 1,{ 0.0f,  0.0f,-1.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+
+	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f},{1.0f, 1.0f, 1.0f, 1.0f },1, { 0.0f,  0.0f, 1.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f,  0.5f, 1.0f},{ 1.0f,  0.0f}, { 1.0f, 1.0f, 1.0f, 1.0f },1, {0.0f,  0.0f,  1.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  1.0f}, { 1.0f, 1.0f, 1.0f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  1.0f}, { 1.0f, 1.0f, 1.0f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f,  0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 1.0f, 1.0f, 1.0f },1, { 0.0f,  0.0f,  1.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 1.0f, 1.0f, 1.0f }, 1, { 0.0f,  0.0f,  1.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+
+	{{-0.5f,  0.5f,  0.5f, 1.0f}, { 1.0f,  0.0f},{ 1.0f, 1.0f, 1.0f, 1.0f}, 1, {-1.0f,  0.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f, -0.5f, 1.0f},{ 1.0f,  1.0f},{ 1.0f, 1.0f, 1.0f, 1.0f },1, { -1.0f,  0.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 1.0f, 1.0f, 1.0f }, 1, { -1.0f,  0.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 1.0f, 1.0f, 1.0f },1, { -1.0f,  0.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 1.0f, 1.0f, 1.0f}, 1, { -1.0f,  0.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f,  0.5f,1.0f},{ 1.0f,  0.0f},{ 1.0f, 1.0f, 1.0f, 1.0f },1, { -1.0f,  0.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+
+	{{0.5f,  0.5f,  0.5f,1.0f}, { 1.0f,  0.0f}, {1.0f, 1.0f, 1.0f, 1.0f }, 1, {1.0f,  0.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f,  0.5f,1.0f},{ 0.0f,  0.0f}, { 1.0f, 1.0f, 1.0f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f, -0.5f,1.0f},{ 0.0f,  1.0f}, {1.0f, 1.0f, 1.0f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f, -0.5f,1.0f},{ 0.0f,  1.0f}, { 1.0f, 1.0f, 1.0f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f, -0.5f,1.0f},{ 1.0f,  1.0f}, { 1.0f, 1.0f, 1.0f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f,1.0f},{ 1.0f,  0.0f}, { 1.0f, 1.0f, 1.0f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+
+	{{-0.5f, -0.5f, -0.5f,1.0f},{  0.0f,  1.0f},{ 1.0f, 1.0f, 1.0f, 1.0f }, 1, {  0.0f, -1.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f, -0.5f,1.0f}, { 1.0f,  1.0f},{ 1.0f, 1.0f, 1.0f, 1.0f }, 1, { 0.0f, -1.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f,  0.5f,1.0f}, { 1.0f,  0.0f}, {1.0f, 1.0f, 1.0f, 1.0f },1, { 0.0f, -1.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f,  0.5f,1.0f}, { 1.0f,  0.0f},{ 1.0f, 1.0f, 1.0f, 1.0f }, 1,{ 0.0f, -1.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f,  0.5f,1.0f},{ 0.0f,  0.0f},{ 1.0f, 1.0f, 1.0f, 1.0f },1, {  0.0f, -1.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f, -0.5f,1.0f},{ 0.0f,  1.0f},{ 1.0f, 1.0f, 1.0f, 1.0f }, 1, {  0.0f, -1.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+
+	{{-0.5f,  0.5f, -0.5f, 1.0f}, {0.0f,  1.0f},{ 1.0f, 1.0f, 1.0f, 1.0f },1, { 0.0f, 1.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f,  0.5f, 1.0f},  {0.0f,  0.0f},{1.0f, 1.0f, 1.0f, 1.0f },1,{ 0.0f, 1.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f, 1.0f},  {1.0f,  0.0f},{ 1.0f, 1.0f, 1.0f, 1.0f },1, { 0.0f,1.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f, 1.0f},  {1.0f,  0.0f}, { 1.0f, 1.0f, 1.0f, 1.0f },1, { 0.0f,1.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f, -0.5f, 1.0f},  {1.0f,  1.0f},{ 1.0f, 1.0f, 1.0f, 1.0f }, 1,{ 0.0f,1.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f, -0.5f, 1.0f},  {0.0f,  1.0f},{1.0f, 1.0f, 1.0f, 1.0f },1,{ 0.0f, 1.0f,  0.0f,0.0f},2, { 0.0f, 0.0f, 0.0f, 0.0f }}
+};
+
+vertex_t mesh_grass[6] =
+{
+	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  1.0f},{1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f, 1.0f,0.0f},19, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, {0.0f,  0.0f,  1.0f,0.0f},19, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},19, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},19, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f,  1.0f,0.0f},19, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, { 0.0f,  0.0f,  1.0f,0.0f},19, { 0.0f, 0.0f, 0.0f, 0.0f }}
+
+
+
+};
+
+vertex_t mesh_window[6] =
+{
+		{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  1.0f},{1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f, 1.0f,0.0f},18, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, {0.0f,  0.0f,  1.0f,0.0f},18, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},18, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},18, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f,  1.0f,0.0f},18, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, { 0.0f,  0.0f,  1.0f,0.0f},18, { 0.0f, 0.0f, 0.0f, 0.0f }}
+
+
+};
+
+vertex_t mesh_bump[36] = {
+	// Positions                  // Texture Coords  //color           //rhw // Normals  // tangent
+	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f,-1.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f, -0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f ,1.0f}, 1,{ 0.0f,  0.0f,-1.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f, -0.5f, 1.0f}, {1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f ,1.0f},1, {0.0f,  0.0f,-1.0f ,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f, -0.5f, 1.0f}, { 1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f ,1.0f},1, {0.0f,  0.0f,-1.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f, -0.5f, 1.0f}, {1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, {0.0f,  0.0f,-1.0f ,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1,{ 0.0f,  0.0f,-1.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+
+	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f},{1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f, 1.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f,  0.5f, 1.0f},{ 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, {0.0f,  0.0f,  1.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f, 1.0f},{ 1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {0.0f,  0.0f,  1.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f,  0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,  0.0f,  1.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, { 0.0f,  0.0f,  1.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+
+	{{-0.5f,  0.5f,  0.5f, 1.0f}, { 1.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f}, 1, {-1.0f,  0.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f, -0.5f, 1.0f},{ 1.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { -1.0f,  0.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, { -1.0f,  0.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f, -0.5f, 1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { -1.0f,  0.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f,  0.5f, 1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f}, 1, { -1.0f,  0.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f,  0.5f,1.0f},{ 1.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { -1.0f,  0.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+
+	{{0.5f,  0.5f,  0.5f,1.0f}, { 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f }, 1, {1.0f,  0.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f,  0.5f,1.0f},{ 0.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f, -0.5f,1.0f},{ 0.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f, -0.5f,1.0f},{ 0.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f, -0.5f,1.0f},{ 1.0f,  1.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f,1.0f},{ 1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 1.0f,  0.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+
+	{{-0.5f, -0.5f, -0.5f,1.0f},{  0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, {  0.0f, -1.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f, -0.5f,1.0f}, { 1.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, { 0.0f, -1.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f,  0.5f,1.0f}, { 1.0f,  0.0f}, {1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f, -1.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f, -0.5f,  0.5f,1.0f}, { 1.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1,{ 0.0f, -1.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f,  0.5f,1.0f},{ 0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, {  0.0f, -1.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f, -0.5f, -0.5f,1.0f},{ 0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1, {  0.0f, -1.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+
+	{{-0.5f,  0.5f, -0.5f, 1.0f}, {0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f, 1.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f,  0.5f, 1.0f},  {0.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1,{ 0.0f, 1.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f, 1.0f},  {1.0f,  0.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,1.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f,  0.5f, 1.0f},  {1.0f,  0.0f}, { 1.0f, 0.5f, 0.31f, 1.0f },1, { 0.0f,1.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{0.5f,  0.5f, -0.5f, 1.0f},  {1.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f }, 1,{ 0.0f,1.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }},
+	{{-0.5f,  0.5f, -0.5f, 1.0f},  {0.0f,  1.0f},{ 1.0f, 0.5f, 0.31f, 1.0f },1,{ 0.0f, 1.0f,  0.0f,0.0f},17, { 0.0f, 0.0f, 0.0f, 0.0f }}
+};
+
+std::vector<vertex_t> tot_vertex;
+std::vector<mesh_group_t> tot_groups;   // material runs of tot_vertex for the cull stage
+mesh_file_t* tot_mesh = NULL;           // model/nanosuit.mesh from MESH_BAKER, replaces tot_vertex when present
+// the levels of detail of the nanosuit, over the welded tot_vertex or the vertices of tot_mesh
+std::vector<vertex_t> suit_vertices;
+vertex_layout_t suit_layout;
+mesh_lod_t suit_lod;
+mesh_group_t suit_bounds;
+
+void draw_nanosuit(device_t* device)
+{
+	int level = mesh_lod_select(device, &suit_lod, &suit_bounds);
+	if (level > 0)
+		draw_indexed_groups(device, &suit_layout, &suit_lod.indices[level][0], &suit_lod.groups[level][0], (int)suit_lod.groups[level].size());
+	else if (tot_mesh != NULL)
+		draw_indexed_groups(device, &tot_mesh->layout, tot_mesh->indices, tot_mesh->groups, tot_mesh->header->group_count);
+	else draw_groups(device, tot_vertex, tot_groups);
+}
+// weld tot_vertex when the obj was loaded and simplify the nanosuit
+static void nanosuit_build_lod()
+{
+	std::vector<int> welded;
+	if (tot_mesh != NULL)
+	{
+		suit_layout = tot_mesh->layout;
+		mesh_lod_build(&suit_lod, &suit_layout, tot_mesh->indices, tot_mesh->groups, tot_mesh->header->group_count);
+	}
+	else if (!tot_vertex.empty())
+	{
+		// the groups are vertex ranges of tot_vertex, so they are the same ranges of welded
+		mesh_weld(tot_vertex, suit_vertices, welded);
+		vertex_layout_interleaved(&suit_layout, &suit_vertices[0], (int)suit_vertices.size());
+		mesh_lod_build(&suit_lod, &suit_layout, &welded[0], &tot_groups[0], (int)tot_groups.size());
+	}
+	else suit_lod.levels = 1;
+	// one sphere around the group spheres
+	for (int i = 0; i < (int)suit_lod.groups[0].size(); i++)
+	{
+		const mesh_group_t& g = suit_lod.groups[0][i];
+		if (i == 0) suit_bounds = g;
+		for (int k = 0; k < 3; k++)
+		{
+			(&suit_bounds.box_min.x)[k] = std::min((&suit_bounds.box_min.x)[k], (&g.box_min.x)[k]);
+			(&suit_bounds.box_max.x)[k] = std::max((&suit_bounds.box_max.x)[k], (&g.box_max.x)[k]);
+		}
+	}
+	for (int k = 0; k < 3; k++) (&suit_bounds.center.x)[k] = ((&suit_bounds.box_min.x)[k] + (&suit_bounds.box_max.x)[k]) * 0.5f;
+	suit_bounds.radius = 0.0f;
+	for (int i = 0; i < (int)suit_lod.groups[0].size(); i++)
+	{
+		const mesh_group_t& g = suit_lod.groups[0][i];
+		float dx = g.center.x - suit_bounds.center.x, dy = g.center.y - suit_bounds.center.y, dz = g.center.z - suit_bounds.center.z;
+		suit_bounds.radius = std::max(suit_bounds.radius, sqrtf(dx * dx + dy * dy + dz * dz) + g.radius);
+	}
+}
+// shadow_draw_t of the nanosuit scene, user is its world matrix
+void draw_nanosuit_caster(device_t* device, void* user)
+{
+	device->transform.world = *(s_matrix*)user;
+	device->transform.update();
+	draw_nanosuit(device);
+}
+shadow_map_t* suit_shadow = NULL;
+std::vector<vertex_t> tot_data;
+std::vector<int> indices;
+
+std::vector<vertex_t> tot_vertex2;
+std::vector<vertex_t> tot_data2;
+std::vector<int> indices2;
+mesh_group_t ball_bounds, ball2_bounds;
+mesh_lod_t ball_lod, ball2_lod;          // of the strips above, as triangle lists
+// the list of ball_lod at level, or NULL for the strip itself
+static std::vector<int>* ball_level(device_t* device, mesh_lod_t* lod, const mesh_group_t* bounds)
+{
+	int level = mesh_lod_select(device, lod, bounds);
+	return level > 0 ? &lod->indices[level] : NULL;
+}
+// the levels of detail of a strip of vertices
+static void ball_build_lod(mesh_lod_t* lod, std::vector<vertex_t>& vertices, std::vector<int>& strip, const mesh_group_t* bounds)
+{
+	std::vector<int> list;
+	mesh_strip_to_list(&strip[0], (int)strip.size(), list);
+	vertex_layout_t layout;
+	vertex_layout_interleaved(&layout, &vertices[0], (int)vertices.size());
+	mesh_group_t group = *bounds;
+	group.first = 0;
+	group.count = (int)list.size();
+	mesh_lod_build(lod, &layout, &list[0], &group, 1);
+}
+// the world matrix of the light box at pos and the position of pointlight[0] on its corner
+static void light_box_place(s_vector& pos, s_matrix& m, s_vector& light)
+{
+	s_vector axis(-1.0f, -0.5f, 1.0f, 1.0f);
+	s_vector scale(0.2f, 0.2f, 0.2f, 1.0f);
+	m.set_rotate_translate_scale(axis, 1.0f, pos, scale);
+	s_vector rightpos(0.5f, 0.5f, 0.5f, 1.0f);
+	apply_to_vector(light, rightpos, m);
+}
+// the description of the states, read by the first scene_view or scene_load. an empty one when the
+// file can't be read, so the states are still drawn, untextured
+static std::string scene_path = SCENE_FILE_DEFAULT;
+static scene_file_t* scene_description = NULL;
+
+void scene_set_file(const char* path)
+{
+	scene_path = path;
+}
+
+static scene_file_t* scene_file()
+{
+	if (scene_description != NULL) return scene_description;
+	scene_description = scene_file_open(scene_path.c_str());
+	if (scene_description == NULL)
+	{
+		printf("can't read the scene from %s\n", scene_path.c_str());
+		scene_description = scene_file_create(scene_path.c_str());
+	}
+	return scene_description;
+}
+
+static s_vector scene_light_pos(int state)
+{
+	const float* p = scene_file()->light[state];
+	return s_vector(p[0], p[1], p[2], 1.0f);
+}
+// record pointlight[0] on the corner of the light box of state and put node 0 of locals there. a frame
+// does this before anything is drawn, so the objects are lit by the light of their own state and not
+// by the one a previous frame left. terms are the ambient, diffuse and specular colors, NULL keeps the
+// ones already set
+static void scene_set_light(cmdbuf_t* cb, s_matrix* locals, int state, const s_vector& color, const s_vector* terms)
+{
+	s_vector pos = scene_light_pos(state);
+	s_vector light;
+	light_box_place(pos, locals[0], light);
+	cmdbuf_set_light(cb, 0, light, color, terms);
+}
+
+// the objects of every state, node 0 is the light box and the others follow in draw order
+mesh_group_t box_bounds, light_box_bounds, bump_bounds, grass_bounds, window_bounds;
+static scene_graph_t scene_graphs[SCENE_STATES + 1];
+
+// draw_box moves the nodes of its frame, so every thread that draws the scene works on a copy of
+// scene_graphs and the batch workers don't move each other's nodes
+static scene_graph_t* scene_graph_of(int state)
+{
+	static thread_local std::vector<scene_graph_t> copies;
+	if (copies.empty()) copies.assign(scene_graphs, scene_graphs + SCENE_STATES + 1);
+	return &copies[state];
+}
+
+// scene_draw_t of the nodes, user is the mesh of the boxes and quads
+static void scene_draw_box(device_t* device, const scene_node_t* node)
+{
+	draw_plane(device, 36, (vertex_t*)node->user, node->material);
+}
+// the static boxes with a baked lightmap, user is their lightmap_t
+static void scene_draw_lightmapped(device_t* device, const scene_node_t* node)
+{
+	lightmap_t* lm = (lightmap_t*)node->user;
+	draw_plane(device, (int)lm->mesh.size(), &lm->mesh[0], lm->material);
+}
+static void scene_draw_quad_transparent(device_t* device, const scene_node_t* node)
+{
+	draw_plane_transparent(device, 6, (vertex_t*)node->user, node->material);
+}
+// the textured ball of state 7
+static void scene_draw_ball(device_t* device, const scene_node_t* node)
+{
+	std::vector<int>* level = ball_level(device, &ball_lod, &ball_bounds);
+	if (level != NULL) draw_indexed(device, tot_data, *level, TOPOLOGY_TRIANGLE_LIST);
+	else draw_plane_STRIP(device, tot_data, indices, node->material);
+}
+// the ball of state 6, its material rides with the instance so device->PBR is left alone
+static void scene_draw_pbr_ball(device_t* device, const scene_node_t* node)
+{
+	s_PBR ball;
+	ball.albedo.reset(0.5f, 0.0f, 0.0f, 1.0f);
+	ball.ao = 1.0f;
+	ball.metallic = device->m1 / 7.0f;
+	ball.roughness = device->m2 / 7.0f;
+	std::vector<int>* level = ball_level(device, &ball2_lod, &ball2_bounds);
+	if (level != NULL) draw_instanced(device, tot_data2, *level, TOPOLOGY_TRIANGLE_LIST, &node->world, &ball, 1, &ball2_bounds);
+	else draw_instanced(device, tot_data2, indices2, TOPOLOGY_TRIANGLE_STRIP, &node->world, &ball, 1, &ball2_bounds);
+}
+// the suit of state 3, it shadows itself. neither it nor the light move, so the cube map placed by
+// scene_load is only drawn again when the raster mode changes
+static void scene_draw_suit(device_t* device, const scene_node_t* node)
+{
+	s_matrix m = node->world;
+	shadow_map_update(suit_shadow, device, draw_nanosuit_caster, &m, 0);
+	device_set_shadow_map(device, suit_shadow);
+	device->transform.world = m;
+	device->transform.update();
+	draw_nanosuit(device);
+}
+
+// the nodes of every state, placed by draw_box
+static void scene_build_graphs()
+{
+	mesh_compute_bounds(mesh, 0, 36, &box_bounds);
+	mesh_compute_bounds(mesh2, 0, 36, &light_box_bounds);
+	mesh_compute_bounds(mesh_bump, 0, 36, &bump_bounds);
+	mesh_compute_bounds(mesh_grass, 0, 6, &grass_bounds);
+	mesh_compute_bounds(mesh_window, 0, 6, &window_bounds);
+	s_matrix identity;
+	identity.set_identity();
+	for (int state = 1; state <= SCENE_STATES; state++)
+	{
+		scene_graph_t* graph = &scene_graphs[state];
+		scene_graph_init(graph);
+		// material count 2 is the light box
+		s_vector pos = scene_light_pos(state), light;
+		s_matrix m;
+		light_box_place(pos, m, light);
+		scene_graph_add(graph, SCENE_NODE_NONE, m, &light_box_bounds, scene_draw_box, mesh2, 2);
+	}
+	scene_graph_add(&scene_graphs[1], SCENE_NODE_NONE, identity, &box_bounds, scene_draw_box, mesh, 1);
+	scene_graph_add(&scene_graphs[2], SCENE_NODE_NONE, identity, &box_bounds, scene_draw_box, mesh, 1);
+	scene_graph_add(&scene_graphs[3], SCENE_NODE_NONE, identity, &suit_bounds, scene_draw_suit, NULL, 3);
+	scene_graph_add(&scene_graphs[4], SCENE_NODE_NONE, identity, &box_bounds, scene_draw_box, mesh, 1);
+	scene_graph_add(&scene_graphs[4], SCENE_NODE_NONE, identity, &grass_bounds, scene_draw_quad_transparent, mesh_grass, 3);
+	scene_graph_add(&scene_graphs[4], SCENE_NODE_NONE, identity, &window_bounds, scene_draw_quad_transparent, mesh_window, 4);
+	scene_graph_add(&scene_graphs[5], SCENE_NODE_NONE, identity, &bump_bounds, scene_draw_box, mesh_bump, 1);
+	scene_graph_add(&scene_graphs[6], SCENE_NODE_NONE, identity, &ball2_bounds, scene_draw_pbr_ball, NULL, 1);
+	scene_graph_add(&scene_graphs[7], SCENE_NODE_NONE, identity, &ball_bounds, scene_draw_ball, NULL, 1);
+	// the opaque cubes hide what is behind them, with device_set_occlusion
+	scene_graph_set_occluder(&scene_graphs[1], 1, mesh, 36);
+	scene_graph_set_occluder(&scene_graphs[2], 1, mesh, 36);
+	scene_graph_set_occluder(&scene_graphs[4], 1, mesh, 36);
+	scene_graph_set_occluder(&scene_graphs[5], 1, mesh_bump, 36);
+	scene_graph_set_blended(&scene_graphs[4], 2);
+	scene_graph_set_blended(&scene_graphs[4], 3);
+	// the light boxes and the cube of state 4 keep their place, the other cubes turn with theta
+	for (int state = 1; state <= SCENE_STATES; state++) scene_graph_set_static(&scene_graphs[state], 0);
+	scene_graph_set_static(&scene_graphs[4], 1);
+}
+
+#define SCENE_RECORD_NODES 4     // nodes a frame of scene_record moves, the most any state has
+
+// cmd_call_t of a recorded frame, user is the scene_graphs entry of the state. the nodes of the copy of the
+// running thread are moved to the recorded locals, then the graph is culled and drawn
+static void scene_draw_graph(device_t* device, void* user, const s_matrix* locals, int count)
+{
+	scene_graph_t* graph = scene_graph_of((int)((scene_graph_t*)user - scene_graphs));
+	for (int i = 0; i < count; i++) scene_graph_set_local(graph, i, locals[i]);
+	scene_graph_draw(graph, device);
+}
+
+void scene_record(cmdbuf_t* cb, device_t* device, float theta)
+{
+	int state = device->now_state;
+	s_matrix locals[SCENE_RECORD_NODES];
+	// the light box and the object of the state, every state has them
+	int moved = state >= 1 && state <= SCENE_STATES ? 2 : 0;
+	cmdbuf_set_shadow_map(cb, NULL);
+	s_vector color(1.0f, 1.0f, 1.0f, 1.0f);
+	s_vector dim[3] = { s_vector(0.2f, 0.2f, 0.2f, 1.0f), s_vector(0.5f, 0.5f, 0.5f, 1.0f), s_vector(1.0f, 1.0f, 1.0f, 1.0f) };
+	s_vector bright[3] = { s_vector(0.5f, 0.5f, 0.5f, 1.0f), s_vector(0.5f, 0.5f, 0.5f, 1.0f), s_vector(1.0f, 1.0f, 1.0f, 1.0f) };
+	s_vector axis(-1.0f, -0.5f, 1.0f, 1.0f);
+	if (state == 7)
+	{
+		color.reset(device->m1, device->m1, device->m1, device->m1);
+		scene_set_light(cb, locals, state, color, bright);
+		s_vector pos(2.0f, 1.0f, 0.0f, 1.0f), scale(0.6f, 0.6f, 0.6f, 1.0f);
+		locals[1].set_rotate_translate_scale(axis, theta, pos, scale);
+		s_PBR pbr = device->PBR;
+		pbr.ao = 1.0f;
+		cmdbuf_set_pbr(cb, pbr);
+	}
+	else if (state == 1)
+	{
+		scene_set_light(cb, locals, state, color, NULL);
+		s_vector pos(2.0f, 0.0f, 0.0f, 1.0f), scale(1.0f, 1.0f, 1.0f, 1.0f);
+		locals[1].set_rotate_translate_scale(axis, theta, pos, scale);
+	}
+	else if (state == 2)
+	{
+		scene_set_light(cb, locals, state, color, dim);
+		locals[1].set_rotate(-1, -0.5, 1, theta);
+	}
+	else if (state == 3)
+	{
+		s_vector terms[3] = { s_vector(device->m1, device->m1, device->m1, 1.0f), s_vector(0.5f, 0.5f, 0.5f, 1.0f), s_vector(1.0f, 1.0f, 1.0f, 1.0f) };
+		scene_set_light(cb, locals, state, color, terms);
+		s_vector pos(0.0f, 1.5f, 0.0f, 1.0f), scale(0.3f, 0.3f, 0.3f, 1.0f);
+		axis.reset(1.0f, 0.0f, 0.0f, 1.0f);
+		locals[1].set_rotate_translate_scale(axis, 3.5f, pos, scale);
+	}
+	else if (state == 4)
+	{
+		scene_set_light(cb, locals, state, color, dim);
+		s_vector pos(2.0f, 0.0f, 0.0f, 1.0f), scale(1.0f, 1.0f, 1.0f, 1.0f);
+		locals[1].set_rotate_translate_scale(axis, 2.44f, pos, scale);
+		// the grass and the window, m1 lifts the grass
+		axis.reset(1.0f, 0.0f, 0.0f, 1.0f);
+		pos.reset(1.0f, 1.0f + device->m1, -1.0f, 1.0f);
+		locals[2].set_rotate_translate_scale(axis, -0.30f, pos, scale);
+		pos.reset(1.0f, 1.0f, 0.0f, 1.0f);
+		locals[3].set_rotate_translate_scale(axis, -0.30f, pos, scale);
+		moved = 4;
+	}
+	else if (state == 5)
+	{
+		scene_set_light(cb, locals, state, color, dim);
+		locals[1].set_rotate(-1, -0.5, 1, theta);
+	}
+	else if (state == 6)
+	{
+		color.reset(1.18f, 1.18f, 1.18f, 1.0f);
+		scene_set_light(cb, locals, state, color, bright);
+		s_vector pos(2.0f, 1.0f, 0.0f, 1.0f), scale(0.6f, 0.6f, 0.6f, 1.0f);
+		locals[1].set_rotate_translate_scale(axis, theta, pos, scale);
+	}
+	cmdbuf_call(cb, scene_draw_graph, &scene_graphs[state], locals, moved);
+}
+
+void draw_box(device_t* device, float theta)
+{
+	// each thread records into a buffer of its own and runs it right away
+	static thread_local cmdbuf_t frame = cmdbuf_t();
+	cmdbuf_reset(&frame);
+	scene_record(&frame, device, theta);
+	cmdbuf_execute(device, &frame);
+}
+
+// the nodes scene_bake_lightmaps bakes: the boxes that keep their place, the light boxes excepted
+static bool scene_lightmapped(const scene_node_t& node)
+{
+	return node.still && node.draw == scene_draw_box && node.material != 2;
+}
+
+// name of the lightmap of node of state in the texture file
+static std::string scene_lightmap_name(int state, int node)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "lightmap/%d/%d", state, node);
+	return name;
+}
+
+bool scene_bake_lightmaps(device_t* device, const char* path, int cell, int rays)
+{
+	int render_state = device->render_state;
+	int samples = device->raytrace != NULL ? device->raytrace->samples : 0;
+	device->render_state = RENDER_STATE_TEXTURE;
+	device_set_raytrace(device, 1);
+	std::vector<std::string> names;
+	std::vector<s_texture*> textures;
+	for (int state = 1; state <= SCENE_STATES; state++)
+	{
+		// a frame of the camera preset captures the triangles the rays are traced against
+		s_vector eye, at, target, up(0.0f, 0.0f, 1.0f, 1.0f);
+		float alpha;
+		scene_view(device, state, eye, at, alpha);
+		device->camera.viewpos = eye;
+		target.add_two(eye, at);
+		device_clear(device, 1);
+		camera_at_zero(device, eye, target, up);
+		draw_box(device, alpha);
+		raytrace_end(device->raytrace, device);
+		scene_graph_t* graph = scene_graph_of(state);
+		for (size_t i = 0; i < graph->nodes.size(); i++)
+		{
+			const scene_node_t& node = graph->nodes[i];
+			if (!scene_lightmapped(node)) continue;
+			s_texture* t = new s_texture;
+			texture_init(t);
+			lightmap_bake(t, device, (const vertex_t*)node.user, 36, node.world, cell, rays);
+			names.push_back(scene_lightmap_name(state, (int)i));
+			textures.push_back(t);
+			printf("%s: %d x %d\n", names.back().c_str(), t->tex_width, t->tex_height);
+		}
+	}
+	std::vector<const char*> paths;
+	for (size_t i = 0; i < names.size(); i++) paths.push_back(names[i].c_str());
+	bool ok = !textures.empty() && texture_file_write(path, &paths[0], &textures[0], (int)textures.size());
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		texture_release(textures[i]);
+		delete textures[i];
+	}
+	device_set_raytrace(device, samples);
+	device->render_state = render_state;
+	return ok;
+}
+
+// of the lightmapped nodes, push_back keeps the pointers of the nodes
+static std::deque<lightmap_t> scene_lightmaps;
+
+// the nodes the lightmaps of path have a lightmap for draw their lightmapped copy from now on. before the
+// first scene_graph_of, so the copies of the threads start out with them
+static void scene_apply_lightmaps(device_t* device, const char* path)
+{
+	if (!mount_texture_file(device, path))
+	{
+		printf("can't map the lightmaps %s\n", path);
+		return;
+	}
+	int count = 0;
+	for (int state = 1; state <= SCENE_STATES; state++)
+	{
+		scene_graph_t* graph = &scene_graphs[state];
+		for (size_t i = 0; i < graph->nodes.size(); i++)
+		{
+			scene_node_t& node = graph->nodes[i];
+			if (!scene_lightmapped(node)) continue;
+			const s_texture* t = texture_registry_find(device->assets->textures, scene_lightmap_name(state, (int)i).c_str(), TEXTURE_LAYOUT_LINEAR);
+			if (t == NULL) continue;
+			scene_lightmaps.push_back(lightmap_t());
+			lightmap_init(&scene_lightmaps.back(), device, (const vertex_t*)node.user, 36, t, node.material);
+			node.user = &scene_lightmaps.back();
+			node.draw = scene_draw_lightmapped;
+			count++;
+		}
+	}
+	printf("%s: %d nodes lightmapped\n", path, count);
+}
+
+int scene_pick(device_t* device, float x, float y)
+{
+	scene_graph_t* graph = scene_graph_of(device->now_state);
+	// the direction of the pixel in view space, the projection offsets by the taa jitter included
+	const s_matrix& p = device->transform.projection;
+	const s_matrix& v = device->transform.view;
+	float nx = (x + device->viewport_x) / device->transform.w * 2.0f - 1.0f, ny = 1.0f - (y + device->viewport_y) / device->transform.h * 2.0f;
+	float view[3] = { (nx - p.m[2][0]) / p.m[0][0], (ny - p.m[2][1]) / p.m[1][1], 1.0f };
+	// the view matrix is a rotation R and a translation t, the eye is -t R^T and directions turn by R^T
+	s_vector eye, dir;
+	float* e = &eye.x;
+	float* d = &dir.x;
+	for (int i = 0; i < 3; i++)
+	{
+		e[i] = -(v.m[3][0] * v.m[i][0] + v.m[3][1] * v.m[i][1] + v.m[3][2] * v.m[i][2]);
+		d[i] = view[0] * v.m[i][0] + view[1] * v.m[i][1] + view[2] * v.m[i][2];
+	}
+	eye.w = 1.0f;
+	dir.w = 0.0f;
+	return scene_graph_pick(graph, eye, dir, NULL);
+}
+
+void get_the_ball(std::vector<vertex_t>& tot_data,std::vector<int>& indices)
+{
+	const unsigned int X_SEGMENTS = 64;
+	const unsigned int Y_SEGMENTS = 64;
+	const float PI = 3.14159265359;
+	for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
+	{
+		for (unsigned int y = 0; y <= Y_SEGMENTS; ++y)
+		{
+			float xSegment = (float)x / (float)X_SEGMENTS;
+			float ySegment = (float)y / (float)Y_SEGMENTS;
+			float xPos = std::cos(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
+			float yPos = std::cos(ySegment * PI);
+			float zPos = std::sin(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
+			vertex_t m;
+			m.pos.x = xPos; m.pos.y = yPos;  m.pos.z = zPos; m.pos.w = 1.0f;
+			m.tc.u = xSegment; m.tc.v = ySegment;
+			m.normal.x = xPos; m.normal.y = yPos; m.normal.z = zPos;
+			m.material_idex = 20;
+			m.rhw = 1;
+			m.color.r = 0.5f; m.color.g = 0.0f; m.color.b = 0.0f; m.color.a = 1.0f;
+			//positions.push_back(glm::vec3(xPos, yPos, zPos));
+			//uv.push_back(glm::vec2(xSegment, ySegment));
+		//	normals.push_back(glm::vec3(xPos, yPos, zPos));
+			tot_data.push_back(m);
+			
+		}
+	}
+	bool oddRow = false;
+	for (unsigned int y = 0; y < Y_SEGMENTS; ++y)
+	{
+		if (!oddRow) // even rows: y == 0, y == 2; and so on
+		{
+			for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
+			{
+				indices.push_back(y * (X_SEGMENTS + 1) + x);
+				indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
+			}
+		}
+		else
+		{
+			for (int x = X_SEGMENTS; x >= 0; --x)
+			{
+				indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
+				indices.push_back(y * (X_SEGMENTS + 1) + x);
+			}
+		}
+		oddRow = !oddRow;
+	}
+	mesh_compute_tangents(&tot_data[0], (int)tot_data.size(), &indices[0], (int)indices.size(), TOPOLOGY_TRIANGLE_STRIP);
+}
+void get_the_ball2(std::vector<vertex_t>& tot_data, std::vector<int>& indices)
+{
+	const unsigned int X_SEGMENTS = 64;
+	const unsigned int Y_SEGMENTS = 64;
+	const float PI = 3.14159265359;
+	for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
+	{
+		for (unsigned int y = 0; y <= Y_SEGMENTS; ++y)
+		{
+			float xSegment = (float)x / (float)X_SEGMENTS;
+			float ySegment = (float)y / (float)Y_SEGMENTS;
+			float xPos = std::cos(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
+			float yPos = std::cos(ySegment * PI);
+			float zPos = std::sin(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
+			vertex_t m;
+			m.pos.x = xPos; m.pos.y = yPos;  m.pos.z = zPos; m.pos.w = 1.0f;
+			m.tc.u = xSegment; m.tc.v = ySegment;
+			m.normal.x = xPos; m.normal.y = yPos; m.normal.z = zPos;
+			m.material_idex = 16;
+			m.rhw = 1;
+			m.color.r = 0.5f; m.color.g = 0.0f; m.color.b = 0.0f; m.color.a = 1.0f;
+			//positions.push_back(glm::vec3(xPos, yPos, zPos));
+			//uv.push_back(glm::vec2(xSegment, ySegment));
+		//	normals.push_back(glm::vec3(xPos, yPos, zPos));
+			tot_data.push_back(m);
+
+		}
+	}
+	bool oddRow = false;
+	for (unsigned int y = 0; y < Y_SEGMENTS; ++y)
+	{
+		if (!oddRow) // even rows: y == 0, y == 2; and so on
+		{
+			for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
+			{
+				indices.push_back(y * (X_SEGMENTS + 1) + x);
+				indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
+			}
+		}
+		else
+		{
+			for (int x = X_SEGMENTS; x >= 0; --x)
+			{
+				indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
+				indices.push_back(y * (X_SEGMENTS + 1) + x);
+			}
+		}
+		oddRow = !oddRow;
+	}
+	mesh_compute_tangents(&tot_data[0], (int)tot_data.size(), &indices[0], (int)indices.size(), TOPOLOGY_TRIANGLE_STRIP);
+}
+// point the suit shadow at the light of state 3 and draw the suit into it, the same matrices draw_box builds
+static void scene_place_suit_shadow(device_t* device)
+{
+	s_matrix m;
+	s_vector pos = scene_light_pos(3), light;
+	light_box_place(pos, m, light);
+	s_vector axis(1.0f, 0.0f, 0.0f, 1.0f), scale(0.3f, 0.3f, 0.3f, 1.0f);
+	pos.reset(0.0f, 1.5f, 0.0f, 1.0f);
+	m.set_rotate_translate_scale(axis, 3.5f, pos, scale);
+	shadow_map_point(suit_shadow, light, 0.05f, 20.0f);
+	shadow_map_update(suit_shadow, device, draw_nanosuit_caster, &m, 0);
+}
+
+// the bytes of the levels a lod built, level 0 is the mesh itself
+static long long scene_lod_bytes(const mesh_lod_t* lod)
+{
+	long long bytes = 0;
+	for (int level = 1; level < MESH_LOD_LEVELS; level++) bytes += memory_bytes(lod->indices[level]) + memory_bytes(lod->groups[level]);
+	return bytes;
+}
+
+// the meshes live in vectors and a mapped file until the end, they are counted once they are built
+static void scene_note_meshes()
+{
+	static long long noted = 0;
+	long long bytes = memory_bytes(tot_vertex) + memory_bytes(tot_groups) + memory_bytes(suit_vertices)
+		+ memory_bytes(tot_data) + memory_bytes(indices) + memory_bytes(tot_data2) + memory_bytes(indices2)
+		+ scene_lod_bytes(&suit_lod) + scene_lod_bytes(&ball_lod) + scene_lod_bytes(&ball2_lod);
+	if (tot_mesh != NULL) bytes += (long long)tot_mesh->map.size;
+	memory_note(MEMORY_MESHES, bytes - noted);
+	noted = bytes;
+}
+
+void scene_load(device_t* device)
+{
+	get_the_ball(tot_data, indices);
+	get_the_ball2(tot_data2, indices2);
+	mesh_compute_bounds(&tot_data[0], 0, (int)tot_data.size(), &ball_bounds);
+	mesh_compute_bounds(&tot_data2[0], 0, (int)tot_data2.size(), &ball2_bounds);
+	ball_build_lod(&ball_lod, tot_data, indices, &ball_bounds);
+	ball_build_lod(&ball2_lod, tot_data2, indices2, &ball2_bounds);
+	mesh_compute_tangents(mesh, 36, NULL, 36, TOPOLOGY_TRIANGLE_LIST);
+	mesh_compute_tangents(mesh2, 36, NULL, 36, TOPOLOGY_TRIANGLE_LIST);
+	mesh_compute_tangents(mesh_grass, 6, NULL, 6, TOPOLOGY_TRIANGLE_LIST);
+	mesh_compute_tangents(mesh_window, 6, NULL, 6, TOPOLOGY_TRIANGLE_LIST);
+	mesh_compute_tangents(mesh_bump, 36, NULL, 36, TOPOLOGY_TRIANGLE_LIST);
+	// the texture files, materials and images of the description, the images decode in parallel
+	scene_file_t* file = scene_file();
+	scene_file_apply(file, device);
+
+	// the baked mesh is mapped as is, the obj is only parsed when it is missing
+	const scene_file_mesh_t* suit = scene_file_mesh(file, "nanosuit");
+	if (suit != NULL) tot_mesh = mesh_file_open(suit->baked.c_str());
+	if (tot_mesh != NULL) device_bind_materials(device, tot_mesh->materials, tot_mesh->header->material_count, tot_mesh->header->material_start);
+	else if (suit != NULL) load_obj(tot_vertex, tot_groups, device, suit->obj.c_str(), suit->mtl_dir.c_str(), suit->start, 1);
+	nanosuit_build_lod();
+	scene_build_graphs();
+	if (!file->lightmaps.empty()) scene_apply_lightmaps(device, file->lightmaps.c_str());
+	scene_note_meshes();
+	printf("textures: %d files decoded, %d mapped, %d cache hits, %.1f MB\n", device->assets->textures->loads, device->assets->textures->mapped, device->assets->textures->hits, device->assets->textures->bytes / (1024.0 * 1024.0));
+
+	// the PBR scenes are lit by the environment when there is one, the tables are cached next to it
+	ibl_t* environment = file->environment.empty() ? NULL : ibl_load(file->environment.c_str(), file->environment_cache.c_str());
+	if (environment != NULL) device_set_ibl(device, environment);
+
+	// drawn here so that draw_box only reads it, devices drawing at the same time can share it
+	suit_shadow = shadow_map_create(SHADOW_CUBE, 512);
+	scene_place_suit_shadow(device);
+}
+
+scene_loader_t* scene_load_begin(device_t* device)
+{
+	scene_loader_t* loader = new scene_loader_t;
+	loader->done = 0;
+	loader->thread = std::thread([loader, device]() {
+		scene_load(device);
+		loader->done.store(1, std::memory_order_release);
+	});
+	return loader;
+}
+
+int scene_load_poll(scene_loader_t* loader)
+{
+	return loader->done.load(std::memory_order_acquire);
+}
+
+void scene_load_end(scene_loader_t* loader)
+{
+	if (loader == NULL) return;
+	loader->thread.join();
+	delete loader;
+}
+
+void scene_view(device_t* device, int state, s_vector& eye, s_vector& at, float& alpha)
+{
+	device->now_state = state;
+	device->is_cull = 1;
+	const scene_file_camera_t* c = &scene_file()->camera[state];
+	eye.reset(c->eye[0], c->eye[1], c->eye[2], 1.0f);
+	at.reset(c->at[0], c->at[1], c->at[2], 1.0f);
+	alpha = c->alpha;
+	device->m1 = c->m1;
+	device->m2 = c->m2;
+}
+
+int scene_reload(device_t* device)
+{
+	if (scene_description == NULL) return 0;
+	int flags = scene_file_poll(scene_description, device);
+	if (flags & SCENE_FILE_LIGHTS) scene_place_suit_shadow(device);
+	if (flags & SCENE_FILE_MESHES) printf("%s: meshes, the environment and the lightmaps are only read when the scene loads\n", scene_description->path.c_str());
+	if (flags & SCENE_FILE_MATERIALS) printf("%s: %d materials bound again so far\n", scene_description->path.c_str(), scene_description->uploads);
+	return flags;
+}
@@ -0,0 +1,73 @@
+#ifndef scene_h
+#define scene_h
+//=====================================================================
+// the demo scene of the window: states 1 to 7, each a camera preset
+// and a set of objects drawn by draw_box. the window and the headless
+// renderer load it once and then only switch states and cameras.
+//=====================================================================
+#include "render.h"
+#include "mesh_file.h"
+#include "scene_graph.h"
+#include "cmdbuf.h"
+#include <atomic>
+#include <thread>
+
+#define SCENE_STATES 7
+#define SCENE_FILE_DEFAULT "scene/demo.scene"   // the description the states are read from, see scene_file.h
+
+// read the states from path instead of SCENE_FILE_DEFAULT, before the first scene_view or scene_load
+void scene_set_file(const char* path);
+
+// materials, textures, meshes and the environment of every state. afterwards draw_box only reads
+// the scene, so devices that share the materials of device may draw it from several threads
+void scene_load(device_t* device);
+
+// scene_load on a thread of its own, so the window comes up and keeps answering while the obj is parsed, its
+// vertices expanded and the images decoded. neither device nor the scene may be used before scene_load_poll
+// returned 1
+struct scene_loader_t
+{
+	std::thread thread;      // runs scene_load
+	std::atomic<int> done;   // 1 once scene_load returned
+};
+
+scene_loader_t* scene_load_begin(device_t* device);
+
+// 1 when the scene is loaded, returns at once
+int scene_load_poll(scene_loader_t* loader);
+
+// wait for the load and free loader
+void scene_load_end(scene_loader_t* loader);
+
+// switch device to state 1..7 and give its camera preset: the eye, the view direction at and
+// the object rotation alpha draw_box takes. device->m1 and m2, the values the F3..F6 keys tune,
+// are reset to the ones of the state
+void scene_view(device_t* device, int state, s_vector& eye, s_vector& at, float& alpha);
+
+// bind the materials whose lines or images changed since the scene was read and move the lights
+// that moved. returns the SCENE_FILE_* that changed, a changed camera is taken by calling scene_view
+// again. only between frames, while no other device draws the scene
+int scene_reload(device_t* device);
+
+// draw the objects of device->now_state, theta rotates the boxes and the spheres. the objects are
+// the nodes of a scene graph per state, culled through its bounding volume hierarchy. the frame is
+// recorded with scene_record and executed at once
+void draw_box(device_t* device, float theta);
+
+// record the frame draw_box draws into cb: the light, the constants and the scene graph of the state,
+// which is culled and drawn when cb runs. only reads device and never the scene graph: the places of the
+// nodes are recorded into cb and set on the graph copy of the thread that runs it, so any thread may
+// record and cb draws the frame of its recording however often and whenever it runs
+void scene_record(cmdbuf_t* cb, device_t* device, float theta);
+
+// bake the lightmaps of the static boxes of every state into the texture file path, see lightmap.h. each
+// state draws a ray traced frame of its camera preset first, so only what that frame captures shadows the
+// boxes. cell texels per triangle and rays per texel for the ambient term. after scene_load, false when
+// nothing could be written
+bool scene_bake_lightmaps(device_t* device, const char* path, int cell, int rays);
+
+// the node of the current state under pixel (x, y) of the last draw_box of this thread, by the
+// world boxes of the nodes. SCENE_NODE_NONE when the pixel shows none, 0 is the light box
+int scene_pick(device_t* device, float x, float y);
+
+#endif
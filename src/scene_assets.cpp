@@ -0,0 +1,69 @@
+#include "scene_assets.h"
+#include "texture.h"
+
+// every material and PBR texture slot
+static void scene_assets_each_texture(scene_assets_t* assets, void (*fn)(s_texture*))
+{
+	for (size_t i = 0; i < assets->material.size(); i++)
+	{
+		fn(&assets->material[i].diffuse_texture);
+		fn(&assets->material[i].specular_texture);
+		fn(&assets->material[i].normal_texture);
+		fn(&assets->material[i].light_texture);
+	}
+	for (size_t i = 0; i < assets->tPBR.size(); i++)
+	{
+		fn(&assets->tPBR[i].albedo_texture);
+		fn(&assets->tPBR[i].orm_texture);
+	}
+}
+
+scene_assets_t* scene_assets_create()
+{
+	scene_assets_t* assets = new scene_assets_t();
+	assets->v_m_num = 0;
+	assets->textures = texture_registry_create();
+	scene_assets_reserve(assets, 1);
+	return assets;
+}
+
+void scene_assets_destory(scene_assets_t* assets)
+{
+	if (assets == NULL) return;
+	scene_assets_each_texture(assets, texture_release);
+	texture_registry_destory(assets->textures);
+	delete assets;
+}
+
+void scene_assets_reserve(scene_assets_t* assets, int count)
+{
+	for (int i = (int)assets->material.size(); i < count; i++)
+	{
+		s_material material = s_material();
+		texture_init(&material.diffuse_texture);
+		texture_init(&material.specular_texture);
+		texture_init(&material.normal_texture);
+		texture_init(&material.light_texture);
+		assets->material.push_back(material);
+	}
+	for (int i = (int)assets->tPBR.size(); i < count; i++)
+	{
+		t_PBR pbr = t_PBR();
+		texture_init(&pbr.albedo_texture);
+		texture_init(&pbr.orm_texture);
+		pbr.orm_channels = 0;
+		assets->tPBR.push_back(pbr);
+	}
+}
+
+s_material* scene_assets_material(scene_assets_t* assets, int count)
+{
+	scene_assets_reserve(assets, count + 1);
+	return &assets->material[count];
+}
+
+t_PBR* scene_assets_pbr(scene_assets_t* assets, int count)
+{
+	scene_assets_reserve(assets, count + 1);
+	return &assets->tPBR[count];
+}
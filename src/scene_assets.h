@@ -0,0 +1,50 @@
+#ifndef scene_assets_h
+#define scene_assets_h
+//=====================================================================
+// the loaded materials and textures a device draws with, apart from
+// the render targets and the per frame state of device_t. the loaders
+// fill them through a device, after that draws only read them, so any
+// number of devices may share one scene_assets_t, also from several
+// threads, see device_share_assets. the material table is as long as
+// the highest material count a loader wrote.
+//=====================================================================
+#include "render.h"
+#include <vector>
+
+struct scene_assets_t
+{
+	// by material count, grown by the loaders. entry 0 is never written, scene_material hands it out
+	// for a count past the end
+	std::vector<s_material> material;
+	std::vector<v_material> vmaterial; // the obj materials in load order, from entry 1 on
+	int v_m_num;
+	std::vector<t_PBR> tPBR;           // texture PBR, by material count like material
+	texture_registry_t* textures;      // image files decoded by the init_texture_by_* loaders
+};
+
+// empty materials and a registry without files
+scene_assets_t* scene_assets_create();
+
+// frees every texture and the registry
+void scene_assets_destory(scene_assets_t* assets);
+
+// make room for material counts below count in material and tPBR, the new entries are empty. pointers
+// into the tables don't survive it
+void scene_assets_reserve(scene_assets_t* assets, int count);
+
+// the entries of count for a loader, the tables grow when they are too short
+s_material* scene_assets_material(scene_assets_t* assets, int count);
+t_PBR* scene_assets_pbr(scene_assets_t* assets, int count);
+
+// the entries of count the shaders read, the empty entry 0 when count is past the end
+inline const s_material* scene_material(const scene_assets_t* assets, int count)
+{
+	return &assets->material[(unsigned)count < assets->material.size() ? count : 0];
+}
+
+inline const t_PBR* scene_pbr(const scene_assets_t* assets, int count)
+{
+	return &assets->tPBR[(unsigned)count < assets->tPBR.size() ? count : 0];
+}
+
+#endif
@@ -0,0 +1,389 @@
+#include "scene_file.h"
+#include "scene_assets.h"
+#include "texture.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <set>
+#include <sys/stat.h>
+
+// changes whenever the modification time or the size of path does, -1 when it is missing
+static long long scene_file_stamp(const char* path)
+{
+	struct stat st;
+	if (stat(path, &st) != 0) return -1;
+	return (long long)st.st_mtime * 1000003LL + (long long)st.st_size;
+}
+
+scene_file_t* scene_file_create(const char* path)
+{
+	scene_file_t* file = new scene_file_t;
+	file->path = path;
+	file->stamp = -1;
+	for (int s = 0; s <= SCENE_STATES; s++)
+	{
+		const float light[3] = { 0.0f, 2.0f, 2.0f };
+		const scene_file_camera_t camera = { { 0.0f, 0.0f, 10.0f }, { 0.0f, 0.0f, -1.0f }, 1.0f, 0.0f, 0.0f };
+		memcpy(file->light[s], light, sizeof(light));
+		file->camera[s] = camera;
+	}
+	file->uploads = 0;
+	return file;
+}
+
+void scene_file_destory(scene_file_t* file)
+{
+	delete file;
+}
+
+// the images a material or pbr line names, in the order they are bound
+static void scene_file_material_images(const scene_file_material_t& m, std::vector<const std::string*>& out)
+{
+	out.push_back(&m.diffuse);
+	out.push_back(&m.specular);
+	out.push_back(&m.normal);
+}
+
+static void scene_file_pbr_images(const scene_file_pbr_t& p, std::vector<const std::string*>& out)
+{
+	out.push_back(&p.albedo);
+	out.push_back(&p.ao);
+	out.push_back(&p.roughness);
+	out.push_back(&p.metallic);
+}
+
+// the material count of a material, pbr or mesh line, false unless it is a number in [1, SCENE_FILE_MATERIALS_MAX)
+static bool scene_file_read_index(const char* word, int* index)
+{
+	char* end;
+	long n = strtol(word, &end, 10);
+	if (end == word || *end != 0 || n < 1 || n >= SCENE_FILE_MATERIALS_MAX) return false;
+	*index = (int)n;
+	return true;
+}
+
+// KEY VALUE pairs after the index of a material or pbr line, false on a key it doesn't know
+static bool scene_file_read_material(char** words, int count, scene_file_material_t* m)
+{
+	m->shininess = -1.0f;
+	if (!scene_file_read_index(words[1], &m->index) || count % 2 != 0) return false;
+	for (int i = 2; i < count; i += 2)
+	{
+		if (strcmp(words[i], "shininess") == 0) m->shininess = (float)atof(words[i + 1]);
+		else if (strcmp(words[i], "diffuse") == 0) m->diffuse = words[i + 1];
+		else if (strcmp(words[i], "specular") == 0) m->specular = words[i + 1];
+		else if (strcmp(words[i], "normal") == 0) m->normal = words[i + 1];
+		else return false;
+	}
+	return true;
+}
+
+static bool scene_file_read_pbr(char** words, int count, scene_file_pbr_t* p)
+{
+	if (!scene_file_read_index(words[1], &p->index) || count % 2 != 0) return false;
+	for (int i = 2; i < count; i += 2)
+	{
+		if (strcmp(words[i], "albedo") == 0) p->albedo = words[i + 1];
+		else if (strcmp(words[i], "ao") == 0) p->ao = words[i + 1];
+		else if (strcmp(words[i], "roughness") == 0) p->roughness = words[i + 1];
+		else if (strcmp(words[i], "metallic") == 0) p->metallic = words[i + 1];
+		else return false;
+	}
+	return true;
+}
+
+// one line split into words, false when it can't be read
+static bool scene_file_read_line(scene_file_t* file, char** words, int count)
+{
+	const char* kind = words[0];
+	int state = count > 1 ? atoi(words[1]) : 0;
+	if (strcmp(kind, "mount") == 0 && count == 2)
+	{
+		file->mounts.push_back(words[1]);
+		return true;
+	}
+	if (strcmp(kind, "material") == 0 && count >= 2)
+	{
+		scene_file_material_t m;
+		if (!scene_file_read_material(words, count, &m)) return false;
+		file->materials.push_back(m);
+		return true;
+	}
+	if (strcmp(kind, "pbr") == 0 && count >= 2)
+	{
+		scene_file_pbr_t p;
+		if (!scene_file_read_pbr(words, count, &p)) return false;
+		file->pbr.push_back(p);
+		return true;
+	}
+	if (strcmp(kind, "mesh") == 0 && count == 6)
+	{
+		scene_file_mesh_t mesh;
+		if (!scene_file_read_index(words[5], &mesh.start)) return false;
+		mesh.name = words[1];
+		mesh.baked = words[2];
+		mesh.obj = words[3];
+		mesh.mtl_dir = words[4];
+		file->meshes.push_back(mesh);
+		return true;
+	}
+	if (strcmp(kind, "environment") == 0 && count == 3)
+	{
+		file->environment = words[1];
+		file->environment_cache = words[2];
+		return true;
+	}
+	if (strcmp(kind, "lightmaps") == 0 && count == 2)
+	{
+		file->lightmaps = words[1];
+		return true;
+	}
+	if (state < 1 || state > SCENE_STATES) return false;
+	if (strcmp(kind, "light") == 0 && count == 5)
+	{
+		for (int i = 0; i < 3; i++) file->light[state][i] = (float)atof(words[2 + i]);
+		return true;
+	}
+	if (strcmp(kind, "camera") == 0 && count == 11)
+	{
+		scene_file_camera_t* c = &file->camera[state];
+		for (int i = 0; i < 3; i++)
+		{
+			c->eye[i] = (float)atof(words[2 + i]);
+			c->at[i] = (float)atof(words[5 + i]);
+		}
+		c->alpha = (float)atof(words[8]);
+		c->m1 = (float)atof(words[9]);
+		c->m2 = (float)atof(words[10]);
+		return true;
+	}
+	return false;
+}
+
+// fill file from file->path, false when it is missing or a line can't be read
+static bool scene_file_read(scene_file_t* file)
+{
+	FILE* fp = fopen(file->path.c_str(), "r");
+	if (fp == NULL) return false;
+	file->stamp = scene_file_stamp(file->path.c_str());
+	char line[1024];
+	int number = 0;
+	bool ok = true;
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		number++;
+		// a line longer than the buffer would be read as two
+		if (strchr(line, '\n') == NULL && !feof(fp))
+		{
+			printf("%s:%d: the line is longer than %d characters\n", file->path.c_str(), number, (int)sizeof(line) - 2);
+			ok = false;
+			break;
+		}
+		char* comment = strchr(line, '#');
+		if (comment != NULL) *comment = 0;
+		char* words[SCENE_FILE_WORDS];
+		int count = 0;
+		bool long_line = false;
+		for (char* w = strtok(line, " \t\r\n"); w != NULL; w = strtok(NULL, " \t\r\n"))
+		{
+			if (count == SCENE_FILE_WORDS)
+			{
+				long_line = true;
+				break;
+			}
+			words[count++] = w;
+		}
+		if (count == 0) continue;
+		if (long_line || !scene_file_read_line(file, words, count))
+		{
+			printf("%s:%d: can't read this %s line\n", file->path.c_str(), number, words[0]);
+			ok = false;
+			break;
+		}
+	}
+	fclose(fp);
+	std::vector<const std::string*> images;
+	for (size_t i = 0; i < file->materials.size(); i++) scene_file_material_images(file->materials[i], images);
+	for (size_t i = 0; i < file->pbr.size(); i++) scene_file_pbr_images(file->pbr[i], images);
+	for (size_t i = 0; i < images.size(); i++)
+		if (!images[i]->empty()) file->images[*images[i]] = scene_file_stamp(images[i]->c_str());
+	return ok;
+}
+
+scene_file_t* scene_file_open(const char* path)
+{
+	scene_file_t* file = scene_file_create(path);
+	if (!scene_file_read(file))
+	{
+		scene_file_destory(file);
+		return NULL;
+	}
+	return file;
+}
+
+static void scene_file_bind_material(device_t* device, const scene_file_material_t& m)
+{
+	s_material* target = scene_assets_material(device->assets, m.index);
+	if (m.shininess >= 0.0f) target->shininess = m.shininess;
+	target->have_diffuse = !m.diffuse.empty();
+	target->have_specular = !m.specular.empty();
+	target->have_normal = !m.normal.empty();
+	if (target->have_diffuse) init_texture_by_diffuse(device, m.diffuse.c_str(), m.index);
+	if (target->have_specular) init_texture_by_specular(device, m.specular.c_str(), m.index);
+	if (target->have_normal) init_texture_by_normal(device, m.normal.c_str(), m.index);
+}
+
+static void scene_file_bind_pbr(device_t* device, const scene_file_pbr_t& p, bool orm)
+{
+	if (!p.albedo.empty()) init_texture_by_albedo(device, p.albedo.c_str(), p.index);
+	if (!orm || (p.ao.empty() && p.roughness.empty() && p.metallic.empty())) return;
+	// the channels are packed into what the texture holds, so it starts over
+	t_PBR* t = scene_assets_pbr(device->assets, p.index);
+	texture_release(&t->orm_texture);
+	t->orm_channels = 0;
+	init_texture_by_orm(device, p.ao.empty() ? NULL : p.ao.c_str(), p.roughness.empty() ? NULL : p.roughness.c_str(),
+		p.metallic.empty() ? NULL : p.metallic.c_str(), p.index);
+}
+
+// the images device decodes through the registry, the orm channels are read straight from their files
+static void scene_file_registry_images(const scene_file_t* file, std::set<std::string>& out)
+{
+	for (size_t i = 0; i < file->materials.size(); i++)
+	{
+		const scene_file_material_t& m = file->materials[i];
+		if (!m.diffuse.empty()) out.insert(m.diffuse);
+		if (!m.specular.empty()) out.insert(m.specular);
+		if (!m.normal.empty()) out.insert(m.normal);
+	}
+	for (size_t i = 0; i < file->pbr.size(); i++)
+		if (!file->pbr[i].albedo.empty()) out.insert(file->pbr[i].albedo);
+}
+
+void scene_file_apply(scene_file_t* file, device_t* device)
+{
+	// baked textures are mapped as is, whatever is missing from the files is decoded
+	for (size_t i = 0; i < file->mounts.size(); i++) mount_texture_file(device, file->mounts[i].c_str());
+	// decode in parallel, the binds below pick the results up
+	std::set<std::string> images;
+	scene_file_registry_images(file, images);
+	for (std::set<std::string>::iterator it = images.begin(); it != images.end(); ++it) prefetch_texture(device, it->c_str());
+	for (size_t i = 0; i < file->materials.size(); i++) scene_file_bind_material(device, file->materials[i]);
+	for (size_t i = 0; i < file->pbr.size(); i++) scene_file_bind_pbr(device, file->pbr[i], true);
+}
+
+static bool scene_file_names(const std::vector<const std::string*>& images, const std::set<std::string>& changed)
+{
+	for (size_t i = 0; i < images.size(); i++)
+		if (changed.count(*images[i])) return true;
+	return false;
+}
+
+int scene_file_poll(scene_file_t* file, device_t* device)
+{
+	// the images that changed on disk since they were read
+	std::set<std::string> changed;
+	std::map<std::string, long long>::iterator it;
+	for (it = file->images.begin(); it != file->images.end(); ++it)
+	{
+		long long stamp = scene_file_stamp(it->first.c_str());
+		if (stamp == it->second) continue;
+		it->second = stamp;
+		changed.insert(it->first);
+	}
+	long long stamp = scene_file_stamp(file->path.c_str());
+	if (stamp == file->stamp && changed.empty()) return 0;
+	scene_file_t* next = file;
+	if (stamp != file->stamp)
+	{
+		next = scene_file_create(file->path.c_str());
+		if (!scene_file_read(next))
+		{
+			// the last description stays, the file is read again when it is saved next
+			printf("%s: keeping the scene as it was\n", file->path.c_str());
+			file->stamp = stamp;
+			scene_file_destory(next);
+			next = file;
+			if (changed.empty()) return 0;
+		}
+		else
+		{
+			// an image the new file still names and that changed on disk counts as changed there too
+			for (it = next->images.begin(); it != next->images.end(); ++it)
+			{
+				std::map<std::string, long long>::iterator old = file->images.find(it->first);
+				if (old != file->images.end() && old->second != it->second) changed.insert(it->first);
+			}
+		}
+	}
+
+	int flags = 0;
+	for (size_t i = 0; i < next->mounts.size(); i++)
+	{
+		bool mounted = false;
+		for (size_t k = 0; k < file->mounts.size() && !mounted; k++) mounted = file->mounts[k] == next->mounts[i];
+		if (!mounted) mount_texture_file(device, next->mounts[i].c_str());
+	}
+	// decode the changed images again and the new ones in parallel, the binds below pick them up
+	std::set<std::string> images, known;
+	scene_file_registry_images(next, images);
+	scene_file_registry_images(file, known);
+	for (std::set<std::string>::iterator name = images.begin(); name != images.end(); ++name)
+	{
+		if (changed.count(*name)) texture_registry_reload(device->assets->textures, name->c_str(), device->texture_layout);
+		else if (!known.count(*name)) prefetch_texture(device, name->c_str());
+	}
+	for (size_t i = 0; i < next->materials.size(); i++)
+	{
+		const scene_file_material_t& m = next->materials[i];
+		const scene_file_material_t* old = NULL;
+		for (size_t k = 0; k < file->materials.size() && next != file; k++)
+			if (file->materials[k].index == m.index) old = &file->materials[k];
+		std::vector<const std::string*> names;
+		scene_file_material_images(m, names);
+		bool same = next == file || (old != NULL && old->shininess == m.shininess && old->diffuse == m.diffuse
+			&& old->specular == m.specular && old->normal == m.normal);
+		if (same && !scene_file_names(names, changed)) continue;
+		scene_file_bind_material(device, m);
+		file->uploads++;
+		flags |= SCENE_FILE_MATERIALS;
+	}
+	for (size_t i = 0; i < next->pbr.size(); i++)
+	{
+		const scene_file_pbr_t& p = next->pbr[i];
+		const scene_file_pbr_t* old = NULL;
+		for (size_t k = 0; k < file->pbr.size() && next != file; k++)
+			if (file->pbr[k].index == p.index) old = &file->pbr[k];
+		bool albedo = next != file && (old == NULL || old->albedo != p.albedo);
+		bool orm = next != file && (old == NULL || old->ao != p.ao || old->roughness != p.roughness || old->metallic != p.metallic);
+		albedo = albedo || changed.count(p.albedo) != 0;
+		orm = orm || changed.count(p.ao) != 0 || changed.count(p.roughness) != 0 || changed.count(p.metallic) != 0;
+		if (!albedo && !orm) continue;
+		scene_file_bind_pbr(device, p, orm);
+		file->uploads++;
+		flags |= SCENE_FILE_MATERIALS;
+	}
+	if (next == file) return flags;
+
+	if (memcmp(next->light, file->light, sizeof(file->light)) != 0) flags |= SCENE_FILE_LIGHTS;
+	if (memcmp(next->camera, file->camera, sizeof(file->camera)) != 0) flags |= SCENE_FILE_CAMERAS;
+	bool meshes = next->meshes.size() != file->meshes.size() || next->environment != file->environment || next->environment_cache != file->environment_cache
+		|| next->lightmaps != file->lightmaps;
+	for (size_t i = 0; i < next->meshes.size() && !meshes; i++)
+	{
+		const scene_file_mesh_t& a = next->meshes[i];
+		const scene_file_mesh_t& b = file->meshes[i];
+		meshes = a.name != b.name || a.baked != b.baked || a.obj != b.obj || a.mtl_dir != b.mtl_dir || a.start != b.start;
+	}
+	if (meshes) flags |= SCENE_FILE_MESHES;
+	next->uploads = file->uploads;
+	*file = *next;
+	scene_file_destory(next);
+	return flags;
+}
+
+const scene_file_mesh_t* scene_file_mesh(const scene_file_t* file, const char* name)
+{
+	for (size_t i = 0; i < file->meshes.size(); i++)
+		if (file->meshes[i].name == name) return &file->meshes[i];
+	return NULL;
+}
@@ -0,0 +1,97 @@
+#ifndef scene_file_h
+#define scene_file_h
+//=====================================================================
+// scene description files: the materials, textures, meshes, lights,
+// cameras and the environment of the demo states as text, one entry
+// per line. opening a file prefetches every image it names on the job
+// system before anything is bound. a poll notices when the file or an
+// image it names changed on disk and uploads only the materials whose
+// line or images changed, the other textures stay bound as they are.
+//
+//   mount PATH                          texture file searched before decoding
+//   material N [shininess S] [diffuse PATH] [specular PATH] [normal PATH]
+//   pbr N [albedo PATH] [ao PATH] [roughness PATH] [metallic PATH]
+//   mesh NAME BAKED OBJ MTL_DIR FIRST   baked mesh, the obj when it is missing
+//   environment HDR CACHE
+//   lightmaps PATH                      texture file of LIGHTMAP_BAKER, the static nodes it has are lightmapped
+//   light STATE X Y Z                   the light box of a state
+//   camera STATE EYE.X EYE.Y EYE.Z AT.X AT.Y AT.Z ALPHA M1 M2
+//
+// everything after a '#' is a comment. the have_* flags of a material
+// follow the maps its line names.
+//=====================================================================
+#include "render.h"
+#include "scene.h"
+#include <map>
+#include <string>
+#include <vector>
+
+#define SCENE_FILE_MATERIALS   1   // poll: a material or one of its images changed
+#define SCENE_FILE_LIGHTS      2   // poll: a light moved
+#define SCENE_FILE_CAMERAS     4   // poll: a camera changed
+#define SCENE_FILE_MESHES      8   // poll: a mesh, the environment or the lightmaps changed, only read by scene_load
+
+#define SCENE_FILE_MATERIALS_MAX 4096 // material, pbr and mesh lines index [1, SCENE_FILE_MATERIALS_MAX), 0 is the empty entry
+#define SCENE_FILE_WORDS         16   // of a line, a line with more is refused
+
+typedef struct
+{
+	int index;               // in scene_assets_t::material
+	float shininess;         // below 0 when the line has none, the material keeps its own
+	std::string diffuse, specular, normal;
+}scene_file_material_t;
+
+typedef struct
+{
+	int index;               // in scene_assets_t::tPBR
+	std::string albedo, ao, roughness, metallic;
+}scene_file_pbr_t;
+
+typedef struct
+{
+	std::string name;
+	std::string baked, obj, mtl_dir;
+	int start;               // material of the first obj material
+}scene_file_mesh_t;
+
+typedef struct
+{
+	float eye[3], at[3];
+	float alpha, m1, m2;
+}scene_file_camera_t;
+
+struct scene_file_t
+{
+	std::string path;
+	long long stamp;         // of path when it was read, -1 when it is missing
+	std::vector<std::string> mounts;
+	std::vector<scene_file_material_t> materials;
+	std::vector<scene_file_pbr_t> pbr;
+	std::vector<scene_file_mesh_t> meshes;
+	std::string environment, environment_cache;
+	std::string lightmaps;   // "" without baked lightmaps
+	float light[SCENE_STATES + 1][3];
+	scene_file_camera_t camera[SCENE_STATES + 1];
+	std::map<std::string, long long> images; // stamps of the images the materials name
+	int uploads;             // materials bound again by polls
+};
+
+// an empty description of path with a default light and camera for every state, nothing is read
+scene_file_t* scene_file_create(const char* path);
+
+// the description in path, NULL when it is missing or a line can't be read
+scene_file_t* scene_file_open(const char* path);
+
+void scene_file_destory(scene_file_t* file);
+
+// mount the texture files, prefetch every image and bind the materials of file to device
+void scene_file_apply(scene_file_t* file, device_t* device);
+
+// read the file again when it or one of its images changed and bind what changed. returns the
+// SCENE_FILE_* that changed, 0 when nothing did or the new file can't be read
+int scene_file_poll(scene_file_t* file, device_t* device);
+
+// the mesh named name, NULL when there is none
+const scene_file_mesh_t* scene_file_mesh(const scene_file_t* file, const char* name);
+
+#endif
@@ -0,0 +1,352 @@
+#include "scene_graph.h"
+#include "occlusion.h"
+#include "multiview.h"
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <algorithm>
+
+void scene_graph_init(scene_graph_t* graph)
+{
+	graph->nodes.clear();
+	graph->bvh.clear();
+	graph->root = -1;
+	graph->built = 0;
+	graph->moved = 0;
+	graph->stats.visited = graph->stats.culled = graph->stats.hidden = graph->stats.occluded = graph->stats.refit = 0;
+	graph->visible.clear();
+}
+
+int scene_graph_add(scene_graph_t* graph, int parent, const s_matrix& local, const mesh_group_t* bounds,
+	scene_draw_t draw, void* user, int material)
+{
+	scene_node_t node;
+	node.parent = parent;
+	node.local = local;
+	node.world = local;
+	node.bounds = bounds;
+	node.draw = draw;
+	node.user = user;
+	node.material = material;
+	node.leaf = -1;
+	node.occluder = NULL;
+	node.occluder_count = 0;
+	node.blended = 0;
+	node.moved = 1;
+	node.still = 0;
+	node.pretransform.mesh = NULL;
+	node.pretransform.num = 0;
+	node.pretransform.builds = 0;
+	graph->nodes.push_back(node);
+	graph->built = 0;
+	graph->moved = 1;
+	return (int)graph->nodes.size() - 1;
+}
+
+void scene_graph_set_local(scene_graph_t* graph, int node, const s_matrix& local)
+{
+	scene_node_t& n = graph->nodes[node];
+	if (memcmp(&n.local.m[0][0], &local.m[0][0], sizeof(n.local.m)) == 0) return;
+	n.local = local;
+	n.moved = 1;
+	graph->moved = 1;
+}
+
+void scene_graph_set_occluder(scene_graph_t* graph, int node, const vertex_t* vertices, int count)
+{
+	graph->nodes[node].occluder = vertices;
+	graph->nodes[node].occluder_count = count;
+}
+
+void scene_graph_set_blended(scene_graph_t* graph, int node)
+{
+	graph->nodes[node].blended = 1;
+}
+
+void scene_graph_set_static(scene_graph_t* graph, int node)
+{
+	graph->nodes[node].still = 1;
+}
+
+// the world box around the 8 corners of the model space box of node
+static void scene_node_box(scene_node_t& node)
+{
+	const mesh_group_t* b = node.bounds;
+	node.box_min.reset(FLT_MAX, FLT_MAX, FLT_MAX, 1.0f);
+	node.box_max.reset(-FLT_MAX, -FLT_MAX, -FLT_MAX, 1.0f);
+	for (int i = 0; i < 8; i++)
+	{
+		s_vector corner(i & 1 ? b->box_max.x : b->box_min.x, i & 2 ? b->box_max.y : b->box_min.y, i & 4 ? b->box_max.z : b->box_min.z, 1.0f), p;
+		apply_to_vector(p, corner, node.world);
+		node.box_min.x = std::min(node.box_min.x, p.x); node.box_max.x = std::max(node.box_max.x, p.x);
+		node.box_min.y = std::min(node.box_min.y, p.y); node.box_max.y = std::max(node.box_max.y, p.y);
+		node.box_min.z = std::min(node.box_min.z, p.z); node.box_max.z = std::max(node.box_max.z, p.z);
+	}
+}
+
+static void scene_bvh_merge(scene_bvh_t& entry, const scene_bvh_t& a, const scene_bvh_t& b)
+{
+	entry.box_min.reset(std::min(a.box_min.x, b.box_min.x), std::min(a.box_min.y, b.box_min.y), std::min(a.box_min.z, b.box_min.z), 1.0f);
+	entry.box_max.reset(std::max(a.box_max.x, b.box_max.x), std::max(a.box_max.y, b.box_max.y), std::max(a.box_max.z, b.box_max.z), 1.0f);
+}
+
+// the entry over nodes [first, last), split at the median of the box centers along their widest axis
+static int scene_bvh_build(scene_graph_t* graph, std::vector<int>& nodes, int first, int last, int parent)
+{
+	int index = (int)graph->bvh.size();
+	graph->bvh.push_back(scene_bvh_t());
+	graph->bvh[index].parent = parent;
+	if (last - first == 1)
+	{
+		scene_node_t& node = graph->nodes[nodes[first]];
+		scene_bvh_t& leaf = graph->bvh[index];
+		leaf.box_min = node.box_min;
+		leaf.box_max = node.box_max;
+		leaf.left = leaf.right = -1;
+		leaf.node = nodes[first];
+		node.leaf = index;
+		return index;
+	}
+	float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (int i = first; i < last; i++)
+	{
+		const scene_node_t& node = graph->nodes[nodes[i]];
+		for (int k = 0; k < 3; k++)
+		{
+			float c = (&node.box_min.x)[k] + (&node.box_max.x)[k];
+			lo[k] = std::min(lo[k], c);
+			hi[k] = std::max(hi[k], c);
+		}
+	}
+	int axis = 0;
+	for (int k = 1; k < 3; k++) if (hi[k] - lo[k] > hi[axis] - lo[axis]) axis = k;
+	int middle = (first + last) / 2;
+	const std::vector<scene_node_t>& all = graph->nodes;
+	std::nth_element(nodes.begin() + first, nodes.begin() + middle, nodes.begin() + last, [&](int a, int b) {
+		return (&all[a].box_min.x)[axis] + (&all[a].box_max.x)[axis] < (&all[b].box_min.x)[axis] + (&all[b].box_max.x)[axis];
+	});
+	// the vector may grow under the recursion, so the entry is looked up again afterwards
+	int left = scene_bvh_build(graph, nodes, first, middle, index);
+	int right = scene_bvh_build(graph, nodes, middle, last, index);
+	scene_bvh_t& entry = graph->bvh[index];
+	entry.left = left;
+	entry.right = right;
+	entry.node = -1;
+	scene_bvh_merge(entry, graph->bvh[left], graph->bvh[right]);
+	return index;
+}
+
+void scene_graph_update(scene_graph_t* graph)
+{
+	graph->stats.refit = 0;
+	if (!graph->moved) return;
+	// parents come first, so one pass hands the moves down to the children
+	std::vector<scene_node_t>& nodes = graph->nodes;
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		scene_node_t& node = nodes[i];
+		if (node.parent != SCENE_NODE_NONE && nodes[node.parent].moved) node.moved = 1;
+		if (!node.moved) continue;
+		if (node.parent != SCENE_NODE_NONE) node.world.mul_two(node.local, nodes[node.parent].world);
+		else node.world = node.local;
+		if (node.bounds != NULL) scene_node_box(node);
+	}
+	if (!graph->built)
+	{
+		std::vector<int> leaves;
+		for (size_t i = 0; i < nodes.size(); i++) if (nodes[i].bounds != NULL) leaves.push_back((int)i);
+		graph->bvh.clear();
+		graph->root = leaves.empty() ? -1 : scene_bvh_build(graph, leaves, 0, (int)leaves.size(), -1);
+		graph->built = 1;
+	}
+	else
+	{
+		// mark the paths of the moved leaves, then merge the marked entries children first. the
+		// children of an entry come after it, so that is the reverse order
+		std::vector<char> refit(graph->bvh.size(), 0);
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			const scene_node_t& node = nodes[i];
+			if (!node.moved || node.leaf < 0) continue;
+			graph->bvh[node.leaf].box_min = node.box_min;
+			graph->bvh[node.leaf].box_max = node.box_max;
+			for (int e = graph->bvh[node.leaf].parent; e >= 0 && !refit[e]; e = graph->bvh[e].parent) refit[e] = 1;
+		}
+		for (int e = (int)graph->bvh.size() - 1; e >= 0; e--)
+		{
+			if (!refit[e]) continue;
+			scene_bvh_t& entry = graph->bvh[e];
+			scene_bvh_merge(entry, graph->bvh[entry.left], graph->bvh[entry.right]);
+			graph->stats.refit++;
+		}
+	}
+	for (size_t i = 0; i < nodes.size(); i++) nodes[i].moved = 0;
+	graph->moved = 0;
+}
+
+// 0 outside, 1 straddling, 2 inside the world space frustum planes
+static int scene_box_frustum(const s_vector* planes, const s_vector& box_min, const s_vector& box_max)
+{
+	int result = 2;
+	for (int i = 0; i < 6; i++)
+	{
+		const s_vector& f = planes[i];
+		// the corners farthest along and against the plane normal
+		float px = f.x >= 0.0f ? box_max.x : box_min.x, nx = f.x >= 0.0f ? box_min.x : box_max.x;
+		float py = f.y >= 0.0f ? box_max.y : box_min.y, ny = f.y >= 0.0f ? box_min.y : box_max.y;
+		float pz = f.z >= 0.0f ? box_max.z : box_min.z, nz = f.z >= 0.0f ? box_min.z : box_max.z;
+		if (f.x * px + f.y * py + f.z * pz + f.w < 0.0f) return 0;
+		if (f.x * nx + f.y * ny + f.z * nz + f.w < 0.0f) result = 1;
+	}
+	return result;
+}
+
+static void scene_bvh_cull(scene_graph_t* graph, const s_vector* planes, int index, bool inside, std::vector<int>& out)
+{
+	const scene_bvh_t& entry = graph->bvh[index];
+	graph->stats.visited++;
+	if (!inside)
+	{
+		int test = scene_box_frustum(planes, entry.box_min, entry.box_max);
+		if (test == 0) return;
+		inside = test == 2;
+	}
+	if (entry.node >= 0)
+	{
+		out.push_back(entry.node);
+		return;
+	}
+	scene_bvh_cull(graph, planes, entry.left, inside, out);
+	scene_bvh_cull(graph, planes, entry.right, inside, out);
+}
+
+void scene_graph_draw(scene_graph_t* graph, device_t* device)
+{
+	scene_graph_update(graph);
+	graph->stats.visited = graph->stats.culled = graph->stats.hidden = graph->stats.occluded = 0;
+	// a multiview frame draws the nodes any of its views sees
+	multiview_t* mv = multiview_recording(device);
+	int views = mv != NULL ? (int)mv->views.size() : 1;
+	std::vector<int>& visible = graph->visible;
+	visible.clear();
+	for (int v = 0; v < views && graph->root >= 0; v++)
+	{
+		// world space planes of the view projection, built like s_transform::update builds them
+		const s_matrix& vp = mv != NULL ? mv->views[v]->transform.vp : device->transform.vp;
+		s_vector planes[6];
+		for (int i = 0; i < 3; i++)
+		{
+			float* f[2] = { &planes[i * 2].x, &planes[i * 2 + 1].x };
+			for (int r = 0; r < 4; r++)
+			{
+				float c = vp.m[r][i], w = vp.m[r][3];
+				f[0][r] = i == 2 ? c : w + c;
+				f[1][r] = w - c;
+			}
+		}
+		scene_bvh_cull(graph, planes, graph->root, false, visible);
+	}
+	if (views > 1)
+	{
+		std::sort(visible.begin(), visible.end());
+		visible.erase(std::unique(visible.begin(), visible.end()), visible.end());
+	}
+	// a tree of n leaves has 2n - 1 entries
+	graph->stats.culled = (int)(graph->bvh.size() + 1) / 2 - (int)visible.size();
+	// nodes without bounds can't be culled
+	for (size_t i = 0; i < graph->nodes.size(); i++)
+		if (graph->nodes[i].bounds == NULL && graph->nodes[i].draw != NULL) visible.push_back((int)i);
+	std::sort(visible.begin(), visible.end());
+	// the opaque nodes by pipeline and material, equal ones and the blended ones stay in node order
+	const std::vector<scene_node_t>& nodes = graph->nodes;
+	std::stable_sort(visible.begin(), visible.end(), [&nodes, device](int a, int b) {
+		const scene_node_t& na = nodes[a];
+		const scene_node_t& nb = nodes[b];
+		if (na.blended || nb.blended) return na.blended < nb.blended;
+		int pa = device_pipeline(device, na.material)->id, pb = device_pipeline(device, nb.material)->id;
+		return pa != pb ? pa < pb : na.material < nb.material;
+	});
+	// the occluders have to end up opaque in the depth, which wireframe frames don't write. what they hide
+	// from one view of a multiview frame another may see
+	occlusion_t* occlusion = device->occlusion;
+	if (device->shadow_pass || mv != NULL || !(device->render_state & (RENDER_STATE_TEXTURE | RENDER_STATE_COLOR)) || (device->render_state & RENDER_STATE_WIREFRAME))
+		occlusion = NULL;
+	if (occlusion != NULL)
+	{
+		occlusion_begin(occlusion, device->transform.vp);
+		for (size_t i = 0; i < visible.size(); i++)
+		{
+			const scene_node_t& node = graph->nodes[visible[i]];
+			if (node.occluder != NULL) occlusion_add(occlusion, node.world, node.occluder, node.occluder_count);
+		}
+	}
+	for (size_t i = 0; i < visible.size(); i++)
+	{
+		scene_node_t& node = graph->nodes[visible[i]];
+		if (node.draw == NULL) continue;
+		if (occlusion != NULL && node.occluder == NULL && node.bounds != NULL && occlusion_test(occlusion, node.box_min, node.box_max))
+		{
+			graph->stats.hidden++;
+			continue;
+		}
+		if (node.bounds != NULL && device_occluded_box(device, node.box_min, node.box_max))
+		{
+			graph->stats.occluded++;
+			continue;
+		}
+		device->transform.world = node.world;
+		device->transform.update();
+		device->pretransform = node.still ? &node.pretransform : NULL;
+		node.draw(device, &node);
+		device->pretransform = NULL;
+	}
+}
+
+// entry and exit parameters of the ray in the box, false when it misses or the box is behind it
+static bool scene_ray_box(const s_vector& origin, const s_vector& inv, const s_vector& box_min, const s_vector& box_max, float& t0)
+{
+	float tmin = 0.0f, tmax = FLT_MAX;
+	for (int k = 0; k < 3; k++)
+	{
+		float o = (&origin.x)[k], d = (&inv.x)[k];
+		float a = ((&box_min.x)[k] - o) * d, b = ((&box_max.x)[k] - o) * d;
+		if (a > b) std::swap(a, b);
+		tmin = std::max(tmin, a);
+		tmax = std::min(tmax, b);
+		if (tmin > tmax) return false;
+	}
+	t0 = tmin;
+	return true;
+}
+
+int scene_graph_pick(scene_graph_t* graph, const s_vector& origin, const s_vector& dir, float* distance)
+{
+	scene_graph_update(graph);
+	graph->stats.visited = 0;
+	int best = SCENE_NODE_NONE;
+	float nearest = FLT_MAX;
+	if (graph->root < 0) return best;
+	// a zero direction component divides to infinity, the slabs then compare against +-inf as they should
+	s_vector inv(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z, 0.0f);
+	std::vector<int> stack(1, graph->root);
+	while (!stack.empty())
+	{
+		const scene_bvh_t& entry = graph->bvh[stack.back()];
+		stack.pop_back();
+		graph->stats.visited++;
+		float t;
+		if (!scene_ray_box(origin, inv, entry.box_min, entry.box_max, t) || t >= nearest) continue;
+		if (entry.node >= 0)
+		{
+			nearest = t;
+			best = entry.node;
+		}
+		else
+		{
+			stack.push_back(entry.left);
+			stack.push_back(entry.right);
+		}
+	}
+	if (distance != NULL) *distance = nearest;
+	return best;
+}
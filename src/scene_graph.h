@@ -0,0 +1,107 @@
+#ifndef scene_graph_h
+#define scene_graph_h
+//=====================================================================
+// scene graph: nodes with a transform relative to their parent, the
+// mesh they draw and its model space bounds. the world space boxes of
+// the nodes are the leaves of a bounding volume hierarchy. nodes that
+// move only refit the boxes on their path to the root, so frustum
+// culling and picking visit subtrees instead of every node. the nodes
+// that survive are tested against the occluder nodes, see occlusion.h,
+// and against the hiz depth before they are drawn.
+//=====================================================================
+#include "render.h"
+#include <vector>
+
+#define SCENE_NODE_NONE -1
+
+struct scene_node_t;
+
+// draws node, device->transform.world is already its world matrix
+typedef void (*scene_draw_t)(device_t* device, const scene_node_t* node);
+
+struct scene_node_t
+{
+	int parent;              // an earlier node or SCENE_NODE_NONE, children come after their parent
+	s_matrix local;          // relative to the parent
+	s_matrix world;          // local times the world of the parent, kept by scene_graph_update
+	const mesh_group_t* bounds; // model space, NULL for a node that only places its children
+	scene_draw_t draw;       // may be NULL
+	void* user;              // mesh of the draw
+	int material;            // material count the draw uses
+	s_vector box_min, box_max; // world space box around bounds
+	int leaf;                // its entry in bvh, -1 without bounds
+	const vertex_t* occluder; // triangle list rasterized into device->occlusion, NULL for a node that hides nothing
+	int occluder_count;
+	int blended;             // drawn after the opaque nodes in node order, see scene_graph_set_blended
+	int moved;               // local changed since the last scene_graph_update
+	int still;               // its draw keeps the world space corners in pretransform, see scene_graph_set_static
+	pretransform_t pretransform;
+};
+
+typedef struct
+{
+	s_vector box_min, box_max;
+	int parent, left, right; // bvh entries, -1 for none
+	int node;                // scene node of a leaf, -1 for an inner entry
+}scene_bvh_t;
+
+// tests of the last scene_graph_draw and scene_graph_pick
+typedef struct
+{
+	int visited;             // bvh entries tested against the frustum or the ray
+	int culled;              // nodes outside the frustum
+	int hidden;              // nodes inside it but behind the occluders of device->occlusion
+	int occluded;            // nodes inside it but hidden behind the hiz depth
+	int refit;               // bvh entries refit by the last scene_graph_update
+}scene_graph_stats_t;
+
+struct scene_graph_t
+{
+	std::vector<scene_node_t> nodes;
+	std::vector<scene_bvh_t> bvh;
+	int root;                // bvh entry, -1 when no node has bounds
+	int built;               // bvh holds every node, scene_graph_add clears it
+	int moved;               // some node moved since the last scene_graph_update
+	scene_graph_stats_t stats;
+	std::vector<int> visible; // of the last scene_graph_draw, in draw order
+};
+
+void scene_graph_init(scene_graph_t* graph);
+
+// returns the index of the new node, the hierarchy is rebuilt by the next scene_graph_update
+int scene_graph_add(scene_graph_t* graph, int parent, const s_matrix& local, const mesh_group_t* bounds,
+	scene_draw_t draw, void* user, int material);
+
+// move node, nothing happens when local is the one it already has
+void scene_graph_set_local(scene_graph_t* graph, int node, const s_matrix& local);
+
+// world matrices and boxes of the moved nodes and their children. the first call after scene_graph_add
+// builds the hierarchy by median splits, the later ones refit the boxes above the moved leaves
+void scene_graph_update(scene_graph_t* graph);
+
+// make node an occluder, vertices[0, count) is a triangle list the draw of node covers opaque with
+// depth writes, closed if the device culls back faces. it may be coarser than the mesh as long as it
+// stays inside of it
+void scene_graph_set_occluder(scene_graph_t* graph, int node, const vertex_t* vertices, int count);
+
+// node blends with what is behind it, so it keeps its place after the opaque nodes instead of being
+// sorted by material
+void scene_graph_set_blended(scene_graph_t* graph, int node);
+
+// node is expected to keep its world matrix, so the draw_plane of its draw gets node's pretransform_t
+// and the world transform of the vertex stage runs once instead of every frame. each copy of the graph
+// has caches of its own
+void scene_graph_set_static(scene_graph_t* graph, int node);
+
+// update, then draw the nodes inside the frustum of the view projection of device. the opaque ones go
+// first sorted by pipeline and material, so a material's shader and textures stay bound and hot across
+// the nodes that share it, the blended ones follow in node order. with device->occlusion the visible occluders are rasterized first and the nodes they hide are skipped,
+// so are those the hiz depth of the nodes drawn before them hides. device->transform.world is left at
+// the world of the last node drawn
+void scene_graph_draw(scene_graph_t* graph, device_t* device);
+
+// the nearest node whose world box the ray from origin along dir hits, SCENE_NODE_NONE when none.
+// distance gets the ray parameter of the hit
+int scene_graph_pick(scene_graph_t* graph, const s_vector& origin, const s_vector& dir, float* distance);
+
+#endif
@@ -0,0 +1,377 @@
+#include "shade_packet.h"
+#include "texture.h"
+#include "gamma.h"
+#include "hdr.h"
+#include "light.h"
+#include "scene_assets.h"
+#include <cmath>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PACKET_SSE 1
+#endif
+
+static const float PI = 3.14159265359;
+
+//=====================================================================
+// 4 lane float. every operation is the plain IEEE one, so a lane gives
+// exactly what the scalar f_shader code computes for that fragment
+//=====================================================================
+#ifdef PACKET_SSE
+typedef __m128 f4;
+static inline f4 f4_set(float a) { return _mm_set1_ps(a); }
+static inline f4 f4_load(const float* p) { return _mm_loadu_ps(p); }
+static inline void f4_store(float* p, f4 a) { _mm_storeu_ps(p, a); }
+static inline f4 f4_add(f4 a, f4 b) { return _mm_add_ps(a, b); }
+static inline f4 f4_sub(f4 a, f4 b) { return _mm_sub_ps(a, b); }
+static inline f4 f4_mul(f4 a, f4 b) { return _mm_mul_ps(a, b); }
+static inline f4 f4_div(f4 a, f4 b) { return _mm_div_ps(a, b); }
+static inline f4 f4_sqrt(f4 a) { return _mm_sqrt_ps(a); }
+static inline f4 f4_select(f4 mask, f4 a, f4 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+static inline f4 f4_lt(f4 a, f4 b) { return _mm_cmplt_ps(a, b); }
+static inline f4 f4_gt(f4 a, f4 b) { return _mm_cmpgt_ps(a, b); }
+static inline f4 f4_neq(f4 a, f4 b) { return _mm_cmpneq_ps(a, b); }
+static inline f4 f4_neg(f4 a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+#else
+typedef struct { float v[4]; } f4;
+static inline f4 f4_set(float a) { f4 r; for (int i = 0; i < 4; i++) r.v[i] = a; return r; }
+static inline f4 f4_load(const float* p) { f4 r; for (int i = 0; i < 4; i++) r.v[i] = p[i]; return r; }
+static inline void f4_store(float* p, f4 a) { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+static inline f4 f4_add(f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] + b.v[i]; return a; }
+static inline f4 f4_sub(f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] - b.v[i]; return a; }
+static inline f4 f4_mul(f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] * b.v[i]; return a; }
+static inline f4 f4_div(f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] / b.v[i]; return a; }
+static inline f4 f4_sqrt(f4 a) { for (int i = 0; i < 4; i++) a.v[i] = sqrtf(a.v[i]); return a; }
+// masks are 1.0f / 0.0f lanes, only f4_select reads them
+static inline f4 f4_select(f4 mask, f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = mask.v[i] != 0.0f ? a.v[i] : b.v[i]; return a; }
+static inline f4 f4_lt(f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] < b.v[i] ? 1.0f : 0.0f; return a; }
+static inline f4 f4_gt(f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] > b.v[i] ? 1.0f : 0.0f; return a; }
+static inline f4 f4_neq(f4 a, f4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] != b.v[i] ? 1.0f : 0.0f; return a; }
+static inline f4 f4_neg(f4 a) { for (int i = 0; i < 4; i++) a.v[i] = -a.v[i]; return a; }
+#endif
+
+// max(a, 0.0f) as std::max does it: (a < 0) ? 0 : a
+static inline f4 f4_max0(f4 a) { f4 zero = f4_set(0.0f); return f4_select(f4_lt(a, zero), zero, a); }
+// CMID(a, 0.0f, 1.0f)
+static inline f4 f4_clamp01(f4 a)
+{
+	f4 zero = f4_set(0.0f), one = f4_set(1.0f);
+	return f4_select(f4_lt(a, zero), zero, f4_select(f4_gt(a, one), one, a));
+}
+
+typedef struct { f4 x, y, z; } v3;
+
+static inline v3 v3_set(float x, float y, float z) { v3 r = { f4_set(x), f4_set(y), f4_set(z) }; return r; }
+static inline v3 v3_add(v3 a, v3 b) { v3 r = { f4_add(a.x, b.x), f4_add(a.y, b.y), f4_add(a.z, b.z) }; return r; }
+static inline v3 v3_sub(v3 a, v3 b) { v3 r = { f4_sub(a.x, b.x), f4_sub(a.y, b.y), f4_sub(a.z, b.z) }; return r; }
+static inline v3 v3_mul(v3 a, v3 b) { v3 r = { f4_mul(a.x, b.x), f4_mul(a.y, b.y), f4_mul(a.z, b.z) }; return r; }
+static inline v3 v3_scale(v3 a, f4 k) { v3 r = { f4_mul(a.x, k), f4_mul(a.y, k), f4_mul(a.z, k) }; return r; }
+static inline v3 v3_neg(v3 a) { v3 r = { f4_neg(a.x), f4_neg(a.y), f4_neg(a.z) }; return r; }
+static inline f4 v3_dot(v3 a, v3 b) { return f4_add(f4_add(f4_mul(a.x, b.x), f4_mul(a.y, b.y)), f4_mul(a.z, b.z)); }
+static inline f4 v3_length(v3 a) { return f4_sqrt(v3_dot(a, a)); }
+// s_vector::normalize, a zero vector stays zero
+static inline v3 v3_normalize(v3 a)
+{
+	f4 length = v3_length(a);
+	f4 inv = f4_div(f4_set(1.0f), length);
+	f4 keep = f4_neq(length, f4_set(0.0f));
+	v3 r = { f4_select(keep, f4_mul(a.x, inv), a.x), f4_select(keep, f4_mul(a.y, inv), a.y), f4_select(keep, f4_mul(a.z, inv), a.z) };
+	return r;
+}
+static inline v3 v3_from(const s_vector& v) { return v3_set(v.x, v.y, v.z); }
+// s_vector::reflect(v, n): n * (-2 * dot(v, n)) + v
+static inline v3 v3_reflect(v3 v, v3 n)
+{
+	f4 temp = f4_mul(f4_set(-2.0f), v3_dot(v, n));
+	return v3_add(v3_scale(n, temp), v);
+}
+
+// pow and the double precision helpers of the scalar code run lane by lane,
+// only for the live lanes
+static inline f4 f4_pow(int mask, f4 a, float e)
+{
+	float t[4];
+	f4_store(t, a);
+	for (int i = 0; i < 4; i++) if (mask & (1 << i)) t[i] = pow(t[i], e);
+	return f4_load(t);
+}
+
+static inline f4 f4_gamma_encode(int mask, f4 a)
+{
+	float t[4];
+	f4_store(t, a);
+	for (int i = 0; i < 4; i++) if (mask & (1 << i)) t[i] = gamma_encode(t[i]);
+	return f4_load(t);
+}
+
+static inline f4 f4_pow128(int mask, f4 a)
+{
+	float t[4];
+	f4_store(t, a);
+	for (int i = 0; i < 4; i++) if (mask & (1 << i)) t[i] = pow(t[i], 128);
+	return f4_load(t);
+}
+
+// the (float)(x * (a - 1.0) + 1.0) term of DistributionGGX
+static inline f4 f4_ggx_denom(int mask, f4 NdotH2, f4 a2)
+{
+	float n[4], a[4];
+	f4_store(n, NdotH2);
+	f4_store(a, a2);
+	for (int i = 0; i < 4; i++) if (mask & (1 << i)) n[i] = (n[i] * (a[i] - 1.0) + 1.0);
+	return f4_load(n);
+}
+
+// GeometrySchlickGGX
+static inline f4 f4_schlick_ggx(int mask, f4 NdotV, f4 roughness)
+{
+	float n[4], r[4];
+	f4_store(n, NdotV);
+	f4_store(r, roughness);
+	for (int i = 0; i < 4; i++)
+	{
+		if (!(mask & (1 << i))) continue;
+		float rr = (r[i] + 1.0);
+		float k = (rr * rr) / 8.0;
+		float denom = n[i] * (1.0 - k) + k;
+		n[i] = n[i] / denom;
+	}
+	return f4_load(n);
+}
+
+// texture_read with the device filter for every lane in the mask
+static void gather_texture(device_t* device, const s_texture* tex, const fs_packet_t* p, v3& rgb)
+{
+	float r[4] = { 0 }, g[4] = { 0 }, b[4] = { 0 };
+	for (int i = 0; i < FS_PACKET_WIDTH; i++)
+	{
+		if (!(p->mask & (1 << i))) continue;
+		s_vector texel;
+		float duv[4] = { p->duv[0][i], p->duv[1][i], p->duv[2][i], p->duv[3][i] };
+		texture_read(texel, tex, p->u[i], p->v[i], duv, device->texture_filter);
+		r[i] = texel.x; g[i] = texel.y; b[i] = texel.z;
+	}
+	rgb.x = f4_load(r); rgb.y = f4_load(g); rgb.z = f4_load(b);
+}
+
+static void store_color(v3 c, f4 a, float* r, float* g, float* b, float* out_a)
+{
+	f4_store(r, c.x); f4_store(g, c.y); f4_store(b, c.z); f4_store(out_a, a);
+}
+
+// SHADER_PHONG_COLOR: phong with the vertex colour
+static void shade_phong_color(device_t* device, const fs_packet_t* p, v3 P, v3 N, float* r, float* g, float* b, float* a)
+{
+	s_vector& lc = device->pointlight[0].lightcolor;
+	v3 lightcolor = v3_from(lc);
+	v3 lightpos = v3_from(device->pointlight[0].lightpos);
+	v3 objectcolor = { f4_load(p->color_r), f4_load(p->color_g), f4_load(p->color_b) };
+	v3 ambient = v3_scale(lightcolor, f4_set(device->m1));
+
+	v3 lightDir = v3_normalize(v3_sub(lightpos, P));
+	f4 diff = f4_max0(v3_dot(N, lightDir));
+	v3 diffuse = v3_scale(lightcolor, diff);
+
+	v3 viewdir = v3_normalize(v3_sub(v3_from(device->camera.viewpos), P));
+	v3 in_lightdir = v3_neg(lightDir);
+	v3 reflectdir = v3_reflect(in_lightdir, N);
+	f4 spec = f4_pow128(p->mask, f4_max0(v3_dot(viewdir, reflectdir)));
+	v3 specular = v3_scale(v3_scale(lightcolor, spec), f4_set(device->m2));
+
+	v3 result = v3_add(v3_add(ambient, diffuse), specular);
+	result = v3_mul(result, objectcolor);
+	store_color(result, f4_set(1.0f), r, g, b, a);
+}
+
+// SHADER_PHONG_TEXTURE: blinn-phong with the material textures
+static void shade_phong_textured(device_t* device, const fs_packet_t* p, v3 P, v3 N, float* r, float* g, float* b, float* a)
+{
+	const s_material* material = scene_material(device->assets, p->count);
+	v3 light_ambient = v3_from(device->pointlight[0].ambient);
+	v3 light_diffuse = v3_from(device->pointlight[0].diffuse);
+	v3 light_specular = v3_from(device->pointlight[0].specular);
+	v3 lightpos = v3_from(device->pointlight[0].lightpos);
+
+	v3 material_ambient;
+	if (material->have_diffuse == 1) gather_texture(device, &material->diffuse_texture, p, material_ambient);
+	else material_ambient = v3_set(0.64f, 0.64f, 0.64f);
+	v3 ambient = v3_mul(light_ambient, material_ambient);
+
+	v3 lightDir = v3_normalize(v3_sub(lightpos, P));
+	f4 diff = f4_max0(v3_dot(N, lightDir));
+	v3 diffuse = v3_mul(v3_scale(light_diffuse, diff), material_ambient);
+
+	v3 viewdir = v3_normalize(v3_sub(v3_from(device->camera.viewpos), P));
+	v3 in_lightdir = v3_neg(lightDir);
+	v3 reflectdir = v3_reflect(in_lightdir, N);
+	f4 spec = f4_pow(p->mask, f4_max0(v3_dot(viewdir, reflectdir)), material->shininess);
+	v3 specular = v3_scale(light_specular, spec);
+
+	v3 material_specular;
+	if (material->have_specular == 1) gather_texture(device, &material->specular_texture, p, material_specular);
+	else material_specular = v3_set(0.5f, 0.5f, 0.5f);
+	specular = v3_mul(specular, material_specular);
+
+	store_color(v3_add(v3_add(ambient, diffuse), specular), f4_set(1.0f), r, g, b, a);
+}
+
+// SHADER_PBR (constant parameters) / SHADER_PBR_TEXTURE: cook-torrance
+static void shade_cook_torrance(device_t* device, const fs_packet_t* p, v3 P, v3 N, bool textured, float* r, float* g, float* b, float* a)
+{
+	v3 albedo;
+	f4 metallic, roughness, ao;
+	const s_PBR& pbr = p->instance != NULL ? p->instance->pbr : device->PBR;
+	if (textured)
+	{
+		const t_PBR* t = scene_pbr(device->assets, p->count);
+		gather_texture(device, &t->albedo_texture, p, albedo);
+		metallic = f4_set(pbr.metallic);
+		roughness = f4_set(pbr.roughness);
+		ao = f4_set(pbr.ao);
+		if (t->orm_channels != 0)
+		{
+			// r = ao, g = roughness, b = metallic
+			v3 orm;
+			gather_texture(device, &t->orm_texture, p, orm);
+			if (t->orm_channels & ORM_CHANNEL_METALLIC) metallic = orm.z;
+			if (t->orm_channels & ORM_CHANNEL_ROUGHNESS) roughness = orm.y;
+			if (t->orm_channels & ORM_CHANNEL_AO) ao = orm.x;
+		}
+		const s_material* material = scene_material(device->assets, p->count);
+		if (material->have_normal == 1)
+		{
+			v3 norm;
+			// unpacked by the texture, and its length doesn't matter before the normalize below
+			gather_texture(device, &material->normal_texture, p, norm);
+			v3 s0 = { f4_load(p->tbn[0][0]), f4_load(p->tbn[0][1]), f4_load(p->tbn[0][2]) };
+			v3 s1 = { f4_load(p->tbn[1][0]), f4_load(p->tbn[1][1]), f4_load(p->tbn[1][2]) };
+			v3 s2 = { f4_load(p->tbn[2][0]), f4_load(p->tbn[2][1]), f4_load(p->tbn[2][2]) };
+			v3 tn = { v3_dot(s0, norm), v3_dot(s1, norm), v3_dot(s2, norm) };
+			N = v3_normalize(tn);
+		}
+	}
+	else
+	{
+		albedo = v3_from(pbr.albedo);
+		metallic = f4_set(pbr.metallic);
+		roughness = f4_set(pbr.roughness);
+		ao = f4_set(pbr.ao);
+	}
+	v3 one = v3_set(1.0f, 1.0f, 1.0f);
+
+	v3 V = v3_normalize(v3_sub(v3_from(device->camera.viewpos), P));
+	v3 F0 = v3_set(0.04f, 0.04f, 0.04f);
+	F0 = v3_add(F0, v3_scale(v3_sub(albedo, F0), metallic));
+
+	v3 lightcolor = v3_from(device->pointlight[0].lightcolor);
+	v3 L = v3_normalize(v3_sub(v3_from(device->pointlight[0].lightpos), P));
+	v3 H = v3_normalize(v3_add(V, L));
+	f4 distance = v3_length(L);
+	f4 attenuation = f4_div(f4_set(1.0f), f4_mul(distance, distance));
+	v3 radiance = v3_scale(lightcolor, attenuation);
+
+	// DistributionGGX
+	f4 ra = f4_mul(roughness, roughness);
+	f4 a2 = f4_mul(ra, ra);
+	f4 NdotH = f4_max0(v3_dot(N, H));
+	f4 denom = f4_ggx_denom(p->mask, f4_mul(NdotH, NdotH), a2);
+	denom = f4_mul(f4_mul(f4_set(PI), denom), denom);
+	f4 NDF = f4_div(a2, denom);
+	// GeometrySmith
+	f4 NdotV = f4_max0(v3_dot(N, V));
+	f4 NdotL = f4_max0(v3_dot(N, L));
+	f4 G = f4_mul(f4_schlick_ggx(p->mask, NdotL, roughness), f4_schlick_ggx(p->mask, NdotV, roughness));
+	// fresnelSchlick
+	f4 HdotV = v3_dot(H, V);
+	f4 cosTheta = textured ? f4_max0(HdotV) : f4_clamp01(HdotV);
+	f4 f5 = f4_pow(p->mask, f4_clamp01(f4_sub(f4_set(1.0f), cosTheta)), 5.0f);
+	v3 F = v3_add(v3_scale(v3_sub(one, F0), f5), F0);
+
+	v3 numerator = v3_scale(F, f4_mul(NDF, G));
+	f4 denominator = f4_add(f4_mul(f4_mul(f4_set(4.0f), NdotV), NdotL), f4_set(0.0001f));
+	v3 specular = v3_scale(numerator, f4_div(f4_set(1.0f), denominator));
+
+	v3 kD = v3_scale(v3_sub(one, F), f4_sub(f4_set(1.0f), metallic));
+	v3 get1 = v3_add(v3_scale(v3_mul(kD, albedo), f4_set(1.0f / PI)), specular);
+	v3 get2 = v3_scale(radiance, NdotL);
+	v3 Lo = v3_add(v3_set(0.0f, 0.0f, 0.0f), v3_mul(get1, get2));
+
+	v3 ambient = v3_scale(v3_mul(v3_set(0.03f, 0.03f, 0.03f), albedo), ao);
+	v3 c = v3_add(ambient, Lo);
+	// with HDR the post pass tone maps the radiance
+	if (!hdr_active(device->hdr))
+	{
+		v3 t7 = v3_add(c, one);
+		c.x = f4_div(c.x, f4_add(t7.x, f4_set(0.0001f)));
+		c.y = f4_div(c.y, f4_add(t7.y, f4_set(0.0001f)));
+		c.z = f4_div(c.z, f4_add(t7.z, f4_set(0.0001f)));
+		c.x = f4_gamma_encode(p->mask, c.x); c.y = f4_gamma_encode(p->mask, c.y); c.z = f4_gamma_encode(p->mask, c.z);
+	}
+	store_color(c, f4_set(1.0f), r, g, b, a);
+}
+
+void fs_packet_set_lane(fs_packet_t* packet, int i, const for_fs* ff)
+{
+	packet->mask |= 1 << i;
+	packet->pos_x[i] = ff->pos.x; packet->pos_y[i] = ff->pos.y; packet->pos_z[i] = ff->pos.z; packet->pos_w[i] = ff->pos.w;
+	packet->normal_x[i] = ff->normal.x; packet->normal_y[i] = ff->normal.y; packet->normal_z[i] = ff->normal.z;
+	packet->u[i] = ff->texcoord.u; packet->v[i] = ff->texcoord.v;
+	for (int k = 0; k < 4; k++) packet->duv[k][i] = ff->duv[k];
+	packet->color_r[i] = ff->color.r; packet->color_g[i] = ff->color.g; packet->color_b[i] = ff->color.b; packet->color_a[i] = ff->color.a;
+	const s_vector* rows[3] = { &ff->storage0, &ff->storage1, &ff->storage2 };
+	for (int k = 0; k < 3; k++)
+	{
+		packet->tbn[k][0][i] = rows[k]->x;
+		packet->tbn[k][1][i] = rows[k]->y;
+		packet->tbn[k][2][i] = rows[k]->z;
+	}
+}
+
+bool f_shader_packet_supported(device_t* device, int count)
+{
+	// the packet shaders follow the pipeline f_shader runs, any other one (the blends, a custom pipeline) stays scalar
+	int id = device_pipeline(device, count)->id;
+	if (id == SHADER_LIGHT) return true;
+	if (id != SHADER_PHONG_COLOR && id != SHADER_PHONG_TEXTURE && id != SHADER_PBR && id != SHADER_PBR_TEXTURE) return false;
+	// the packet shaders only know pointlight[0], no shadows, the exact brdf and the constant ambient
+	if (device->lights != NULL && !device->lights->lights.empty()) return false;
+	if (device->shadow != NULL) return false;
+	if ((device->ibl != NULL || device->brdf_mode != BRDF_MODE_EXACT) && (id == SHADER_PBR || id == SHADER_PBR_TEXTURE)) return false;
+	return true;
+}
+
+// idle lanes take a copy of a live one, so the SIMD code never runs on stale stack values
+static void fs_packet_fill_idle(fs_packet_t* packet)
+{
+	int live = 0;
+	while (!(packet->mask & (1 << live))) live++;
+	float* lanes[] = { packet->pos_x, packet->pos_y, packet->pos_z, packet->pos_w, packet->normal_x, packet->normal_y, packet->normal_z,
+		packet->u, packet->v, packet->color_r, packet->color_g, packet->color_b, packet->color_a };
+	for (int i = 0; i < FS_PACKET_WIDTH; i++)
+	{
+		if (packet->mask & (1 << i)) continue;
+		for (int k = 0; k < (int)(sizeof(lanes) / sizeof(lanes[0])); k++) lanes[k][i] = lanes[k][live];
+		for (int k = 0; k < 3; k++)
+			for (int c = 0; c < 3; c++) packet->tbn[k][c][i] = packet->tbn[k][c][live];
+	}
+}
+
+void f_shader_packet(device_t* device, fs_packet_t* packet, float* r, float* g, float* b, float* a)
+{
+	if (packet->mask == 0) return;
+	if (packet->mask != (1 << FS_PACKET_WIDTH) - 1) fs_packet_fill_idle(packet);
+	int id = device_pipeline(device, packet->count)->id;
+	if (id == SHADER_LIGHT)
+	{
+		// the light cube shows its vertex colour
+		for (int i = 0; i < FS_PACKET_WIDTH; i++)
+		{
+			r[i] = packet->color_r[i]; g[i] = packet->color_g[i]; b[i] = packet->color_b[i]; a[i] = packet->color_a[i];
+		}
+		return;
+	}
+	v3 P = { f4_load(packet->pos_x), f4_load(packet->pos_y), f4_load(packet->pos_z) };
+	v3 N = { f4_load(packet->normal_x), f4_load(packet->normal_y), f4_load(packet->normal_z) };
+	if (id == SHADER_PHONG_COLOR) shade_phong_color(device, packet, P, N, r, g, b, a);
+	else if (id == SHADER_PHONG_TEXTURE) shade_phong_textured(device, packet, P, N, r, g, b, a);
+	else shade_cook_torrance(device, packet, P, N, id == SHADER_PBR_TEXTURE, r, g, b, a);
+}
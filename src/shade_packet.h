@@ -0,0 +1,36 @@
+#ifndef shade_packet_h
+#define shade_packet_h
+//=====================================================================
+// packet shading: FS_PACKET_WIDTH fragments of one triangle in
+// structure-of-arrays form, shaded together in SIMD lanes.
+//=====================================================================
+#include "render.h"
+
+#define FS_PACKET_WIDTH 4
+
+typedef struct
+{
+	int mask;                // bit i set when lane i holds a fragment
+	int count;               // material index, the same for every lane
+	const instance_t* instance; // for_fs::instance, the same for every lane
+	float pos_x[FS_PACKET_WIDTH], pos_y[FS_PACKET_WIDTH], pos_z[FS_PACKET_WIDTH], pos_w[FS_PACKET_WIDTH];
+	float normal_x[FS_PACKET_WIDTH], normal_y[FS_PACKET_WIDTH], normal_z[FS_PACKET_WIDTH]; // normalized
+	float u[FS_PACKET_WIDTH], v[FS_PACKET_WIDTH];
+	float duv[4][FS_PACKET_WIDTH];      // for_fs::duv
+	float color_r[FS_PACKET_WIDTH], color_g[FS_PACKET_WIDTH], color_b[FS_PACKET_WIDTH], color_a[FS_PACKET_WIDTH];
+	float tbn[3][3][FS_PACKET_WIDTH];   // storage0..2 of for_fs, xyz
+}fs_packet_t;
+
+// copy an interpolated fragment into lane i and set its mask bit
+void fs_packet_set_lane(fs_packet_t* packet, int i, const for_fs* ff);
+
+// true when f_shader_packet has a SIMD path for device_pipeline(device, count).
+// the blend pipelines and custom ones stay on f_shader, so do a light list, shadows,
+// image based lighting and BRDF_MODE_FAST
+bool f_shader_packet_supported(device_t* device, int count);
+
+// shade the lanes set in packet->mask, same results as calling f_shader per lane.
+// the idle lanes of packet are overwritten
+void f_shader_packet(device_t* device, fs_packet_t* packet, float* r, float* g, float* b, float* a);
+
+#endif
@@ -0,0 +1,181 @@
+#include "shadow.h"
+#include "raytrace.h"
+#include <cstring>
+#include <cmath>
+
+shadow_map_t* shadow_map_create(int type, int size)
+{
+	shadow_map_t* map = new shadow_map_t;
+	map->type = type;
+	map->size = size;
+	map->faces = (type == SHADOW_CUBE) ? 6 : (type == SHADOW_TRACED ? 0 : 1);
+	for (int f = 0; f < SHADOW_MAX_FACES; f++)
+		map->depth[f] = (f < map->faces) ? surface_create(size, size, SURFACE_FORMAT_DEPTH32, NULL, 0) : NULL;
+	map->light.reset(0.0f, 0.0f, 0.0f, 1.0f);
+	map->bias = 0.05f;
+	map->valid = 0;
+	map->key = 0;
+	map->raster_mode = RASTER_MODE_SCANLINE;
+	map->renders = 0;
+	map->tracer = NULL;
+	return map;
+}
+
+void shadow_map_destory(shadow_map_t* map)
+{
+	if (map == NULL) return;
+	for (int f = 0; f < map->faces; f++) surface_destory(map->depth[f]);
+	delete map;
+}
+
+void shadow_map_invalidate(shadow_map_t* map)
+{
+	map->valid = 0;
+}
+
+// rebuild vp from view and projection, a changed light makes the faces stale
+static void shadow_map_commit(shadow_map_t* map)
+{
+	for (int f = 0; f < map->faces; f++)
+	{
+		s_matrix vp;
+		vp.mul_two(map->view[f], map->projection);
+		if (memcmp(&vp, &map->vp[f], sizeof(s_matrix)) != 0) map->valid = 0;
+		map->vp[f] = vp;
+	}
+}
+
+void shadow_map_point(shadow_map_t* map, s_vector& pos, float zn, float zf)
+{
+	// +x -x +y -y +z -z, shadow_map_visibility picks the face by the major axis
+	static const float dirs[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	map->light = pos;
+	set_perspective_matrix(map->projection, 3.1415926f * 0.5f, 1.0f, zn, zf);
+	for (int f = 0; f < map->faces; f++)
+	{
+		s_vector at(pos.x + dirs[f][0], pos.y + dirs[f][1], pos.z + dirs[f][2], 1.0f);
+		s_vector up(0.0f, 1.0f, 0.0f, 1.0f);
+		if (dirs[f][1] != 0) up.reset(0.0f, 0.0f, 1.0f, 1.0f);
+		set_look_at_matrix(map->view[f], pos, at, up);
+	}
+	shadow_map_commit(map);
+}
+
+void shadow_map_directional(shadow_map_t* map, s_vector& dir, s_vector& center, float extent)
+{
+	map->light = dir;
+	map->light.normalize();
+	map->light.w = 0.0f;
+	s_vector eye(center.x - map->light.x * extent * 2.0f, center.y - map->light.y * extent * 2.0f, center.z - map->light.z * extent * 2.0f, 1.0f);
+	s_vector up(0.0f, 1.0f, 0.0f, 1.0f);
+	if (fabsf(map->light.y) > 0.99f) up.reset(0.0f, 0.0f, 1.0f, 1.0f);
+	set_look_at_matrix(map->view[0], eye, center, up);
+	set_ortho_matrix(map->projection, -extent, extent, -extent, extent, 0.0f, extent * 4.0f);
+	shadow_map_commit(map);
+}
+
+void shadow_map_update(shadow_map_t* map, device_t* device, shadow_draw_t draw, void* user, unsigned long long caster_key)
+{
+	if (map->valid && map->key == caster_key && map->raster_mode == device->raster_mode) return;
+	int width = device->width, height = device->height;
+	surface_t* depth = device->depth;
+	hiz_t* hiz = device->hiz;
+	tile_context_t* tiler = device->tiler;
+	int render_state = device->render_state;
+	int is_cull = device->is_cull;
+	s_matrix world = device->transform.world, view = device->transform.view, projection = device->transform.projection;
+	float viewport[4] = { device->transform.w, device->transform.h, device->viewport_x, device->viewport_y };
+
+	// the face is the viewport, draw_plane and friends stay on RASTER_PASS_DEPTH while shadow_pass is set
+	device->width = device->height = map->size;
+	device->transform.w = device->transform.h = (float)map->size;
+	device->viewport_x = device->viewport_y = 0.0f;
+	device->hiz = NULL;
+	device->tiler = NULL;
+	device->render_state = RENDER_STATE_TEXTURE;
+	// open meshes would let the light through their back faces
+	device->is_cull = 0;
+	device->shadow_pass = 1;
+	device->raster_pass = RASTER_PASS_DEPTH;
+	device->transform.projection = map->projection;
+	for (int f = 0; f < map->faces; f++)
+	{
+		surface_clear(map->depth[f], 0);
+		device->depth = map->depth[f];
+		device->transform.view = map->view[f];
+		device->transform.update();
+		draw(device, user);
+	}
+
+	device->shadow_pass = 0;
+	device->raster_pass = RASTER_PASS_COLOR;
+	device->width = width;
+	device->height = height;
+	device->transform.w = viewport[0];
+	device->transform.h = viewport[1];
+	device->viewport_x = viewport[2];
+	device->viewport_y = viewport[3];
+	device->depth = depth;
+	device->hiz = hiz;
+	device->tiler = tiler;
+	device->render_state = render_state;
+	device->is_cull = is_cull;
+	device->transform.world = world;
+	device->transform.view = view;
+	device->transform.projection = projection;
+	device->transform.update();
+	map->valid = 1;
+	map->key = caster_key;
+	map->raster_mode = device->raster_mode;
+	map->renders++;
+}
+
+float shadow_map_visibility(const shadow_map_t* map, const s_vector& pos)
+{
+	// move towards the light so a surface does not shadow itself
+	float lx, ly, lz;
+	if (map->type != SHADOW_DIRECTIONAL) { lx = map->light.x - pos.x; ly = map->light.y - pos.y; lz = map->light.z - pos.z; }
+	else { lx = -map->light.x; ly = -map->light.y; lz = -map->light.z; }
+	float len = sqrtf(lx * lx + ly * ly + lz * lz);
+	if (len <= 0.0f) return 1.0f;
+	float k = map->bias / len;
+	float p[4] = { pos.x + lx * k, pos.y + ly * k, pos.z + lz * k, 1.0f };
+	if (map->type == SHADOW_TRACED) return raytrace_visible(map->tracer, p, &map->light.x) ? 1.0f : 0.0f;
+
+	int face = 0;
+	if (map->type == SHADOW_CUBE)
+	{
+		// the light to point direction is -l
+		float ax = fabsf(lx), ay = fabsf(ly), az = fabsf(lz);
+		if (ax >= ay && ax >= az) face = lx < 0.0f ? 0 : 1;
+		else if (ay >= az) face = ly < 0.0f ? 2 : 3;
+		else face = lz < 0.0f ? 4 : 5;
+	}
+	const s_matrix& m = map->vp[face];
+	float clip[4];
+	for (int c = 0; c < 4; c++)
+		clip[c] = p[0] * m.m[0][c] + p[1] * m.m[1][c] + p[2] * m.m[2][c] + p[3] * m.m[3][c];
+	if (clip[3] <= 0.0f || clip[2] <= 0.0f) return 1.0f;
+	float rhw = 1.0f / clip[3];
+	float sx = (clip[0] * rhw + 1.0f) * map->size * 0.5f;
+	float sy = (1.0f - clip[1] * rhw) * map->size * 0.5f;
+	// the value the rasterizer stores, larger is nearer: 1 / (z / w), the scanline path also scales it by w
+	float depth = map->raster_mode != RASTER_MODE_SCANLINE ? clip[3] / clip[2] : 1.0f / clip[2];
+	if (map->type == SHADOW_DIRECTIONAL && (sx < 0.0f || sy < 0.0f || sx >= map->size || sy >= map->size)) return 1.0f;
+
+	int cx = (int)floorf(sx), cy = (int)floorf(sy);
+	int lit = 0;
+	for (int dy = -1; dy <= 1; dy++)
+	{
+		int y = cy + dy;
+		y = y < 0 ? 0 : (y >= map->size ? map->size - 1 : y);
+		const float* row = surface_row_f32(map->depth[face], y);
+		for (int dx = -1; dx <= 1; dx++)
+		{
+			int x = cx + dx;
+			x = x < 0 ? 0 : (x >= map->size ? map->size - 1 : x);
+			if (depth >= row[x]) lit++;
+		}
+	}
+	return lit / 9.0f;
+}
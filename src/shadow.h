@@ -0,0 +1,58 @@
+#ifndef shadow_h
+#define shadow_h
+//=====================================================================
+// shadow maps: the casters are drawn from the light into depth only
+// surfaces with the RASTER_PASS_DEPTH fast path, the shaders compare
+// against them with 3x3 PCF. a map is only drawn again when its light
+// or the caster key passed by the caller change.
+//=====================================================================
+#include "render.h"
+#include "surface.h"
+
+#define SHADOW_CUBE        0  // six 90 degree faces around a point light
+#define SHADOW_DIRECTIONAL 1  // one orthographic face along a direction
+#define SHADOW_TRACED      2  // no faces, a ray from the point light position through the triangles of tracer
+#define SHADOW_MAX_FACES   6
+
+// draws the shadow casters, the device is set up for the light
+typedef void(*shadow_draw_t)(device_t* device, void* user);
+
+struct shadow_map_t
+{
+	int type;                // SHADOW_*
+	int size;                // width and height of every face
+	int faces;               // 6 for SHADOW_CUBE, 1 for SHADOW_DIRECTIONAL, 0 for SHADOW_TRACED
+	surface_t* depth[SHADOW_MAX_FACES];   // SURFACE_FORMAT_DEPTH32 like device->depth
+	s_matrix view[SHADOW_MAX_FACES];
+	s_matrix projection;
+	s_matrix vp[SHADOW_MAX_FACES];        // view * projection
+	s_vector light;          // SHADOW_CUBE: position, SHADOW_DIRECTIONAL: normalized direction the light travels
+	float bias;              // world units a lookup is moved towards the light
+	int valid;               // the faces hold the casters of key
+	unsigned long long key;
+	int raster_mode;         // device->raster_mode the faces were drawn with, it decides the stored depth
+	int renders;             // times the casters were drawn, for profiling
+	const struct raytrace_t* tracer; // SHADOW_TRACED: the captured scene, see raytrace.h
+};
+
+shadow_map_t* shadow_map_create(int type, int size);
+
+void shadow_map_destory(shadow_map_t* map);
+
+// place a SHADOW_CUBE map at the point light pos, the faces see from zn to zf
+void shadow_map_point(shadow_map_t* map, s_vector& pos, float zn, float zf);
+
+// aim a SHADOW_DIRECTIONAL map along dir at the box of half size extent around center
+void shadow_map_directional(shadow_map_t* map, s_vector& dir, s_vector& center, float extent);
+
+// draw the casters into every face unless the light and caster_key are the ones already drawn
+void shadow_map_update(shadow_map_t* map, device_t* device, shadow_draw_t draw, void* user, unsigned long long caster_key);
+
+// forget the faces, the next shadow_map_update draws them again
+void shadow_map_invalidate(shadow_map_t* map);
+
+// fraction of the 3x3 PCF taps around world position pos that see the light, 1 outside the map.
+// a SHADOW_TRACED map gives 0 or 1
+float shadow_map_visibility(const shadow_map_t* map, const s_vector& pos);
+
+#endif
@@ -0,0 +1,162 @@
+#include "skin.h"
+#include "s_simd.h"
+#include "job.h"
+#include <cmath>
+#include <algorithm>
+
+skin_t* skin_create(const vertex_t* vertices, int count, const skin_weights_t* weights, const s_matrix* inverse_bind, int joints,
+	const int* indices, const mesh_group_t* groups, int group_count)
+{
+	skin_t* skin = new skin_t;
+	skin->rest = vertices;
+	skin->count = count;
+	skin->indices = indices;
+	skin->weights.assign(weights, weights + count);
+	joints = std::min(std::max(joints, 1), SKIN_JOINTS_MAX);
+	skin->inverse_bind.assign(inverse_bind, inverse_bind + joints);
+	s_matrix identity;
+	identity.set_identity();
+	skin->palette.assign(joints, identity);
+	for (int b = 0; b < 2; b++)
+	{
+		skin->pos[b].resize(count);
+		skin->normal[b].resize(count);
+		skin->tangent[b].resize(count);
+	}
+	skin->current = 1;
+	skin->groups.assign(groups, groups + group_count);
+	skin->posed = 0;
+	skin_update(skin);
+	return skin;
+}
+
+void skin_destory(skin_t* skin)
+{
+	delete skin;
+}
+
+int skin_add_morph(skin_t* skin, const s_vector* pos, const s_vector* normal)
+{
+	skin_morph_t morph;
+	morph.pos.assign(pos, pos + skin->count);
+	if (normal != NULL) morph.normal.assign(normal, normal + skin->count);
+	morph.weight = 0.0f;
+	skin->morphs.push_back(morph);
+	return (int)skin->morphs.size() - 1;
+}
+
+void skin_set_morph(skin_t* skin, int morph, float weight)
+{
+	skin->morphs[morph].weight = weight;
+}
+
+void skin_set_pose(skin_t* skin, const s_matrix* pose)
+{
+	for (size_t j = 0; j < skin->palette.size(); j++) skin->palette[j].mul_two(skin->inverse_bind[j], pose[j]);
+}
+
+// job of skin_update, poses the vertices [begin, end)
+static void skin_job(void* data, int begin, int end)
+{
+	skin_t* skin = (skin_t*)data;
+	const s_simd_kernels_t* simd = s_simd_get();
+	s_vector* pos = &skin->pos[skin->current][0];
+	s_vector* normal = &skin->normal[skin->current][0];
+	s_vector* tangent = &skin->tangent[skin->current][0];
+	const s_matrix* palette = &skin->palette[0];
+	int joints = (int)skin->palette.size();
+	for (int i = begin; i < end; i++)
+	{
+		const vertex_t& v = skin->rest[i];
+		s_vector p = v.pos, n = v.normal, t = v.tangent;
+		for (size_t k = 0; k < skin->active.size(); k++)
+		{
+			const skin_morph_t& morph = skin->morphs[skin->active[k]];
+			float w = morph.weight;
+			p.x += morph.pos[i].x * w; p.y += morph.pos[i].y * w; p.z += morph.pos[i].z * w;
+			if (morph.normal.empty()) continue;
+			n.x += morph.normal[i].x * w; n.y += morph.normal[i].y * w; n.z += morph.normal[i].z * w;
+		}
+		p.w = 1.0f;
+		n.w = 0.0f;
+		float handedness = t.w;
+		t.w = 0.0f;
+		const skin_weights_t& sw = skin->weights[i];
+		// most vertices follow one joint, its matrix needs no blending
+		const float* m = &palette[std::min((int)sw.joint[0], joints - 1)].m[0][0];
+		float blended[16];
+		if (sw.weight[0] < 1.0f)
+		{
+			const float* mats[SKIN_WEIGHTS];
+			for (int k = 0; k < SKIN_WEIGHTS; k++) mats[k] = &palette[std::min((int)sw.joint[k], joints - 1)].m[0][0];
+			simd->mat_blend4(blended, mats, sw.weight);
+			m = blended;
+		}
+		simd->apply(&pos[i].x, &p.x, m);
+		simd->apply(&normal[i].x, &n.x, m);
+		simd->normalize3(&normal[i].x);
+		simd->apply(&tangent[i].x, &t.x, m);
+		simd->normalize3(&tangent[i].x);
+		tangent[i].w = handedness;
+	}
+}
+
+// job of skin_update, the bounds of the groups [begin, end) like mesh_compute_bounds
+static void skin_bounds_job(void* data, int begin, int end)
+{
+	skin_t* skin = (skin_t*)data;
+	const s_vector* pos = &skin->pos[skin->current][0];
+	for (int g = begin; g < end; g++)
+	{
+		mesh_group_t* group = &skin->groups[g];
+		const int* indices = skin->indices + group->first;
+		s_vector lo(1e30f, 1e30f, 1e30f, 1.0f), hi(-1e30f, -1e30f, -1e30f, 1.0f);
+		for (int i = 0; i < group->count; i++)
+		{
+			const s_vector& p = pos[indices[i]];
+			lo.x = std::min(lo.x, p.x); lo.y = std::min(lo.y, p.y); lo.z = std::min(lo.z, p.z);
+			hi.x = std::max(hi.x, p.x); hi.y = std::max(hi.y, p.y); hi.z = std::max(hi.z, p.z);
+		}
+		if (group->count <= 0) { lo.reset(0.0f, 0.0f, 0.0f, 1.0f); hi = lo; }
+		group->box_min = lo;
+		group->box_max = hi;
+		group->center.reset((lo.x + hi.x) * 0.5f, (lo.y + hi.y) * 0.5f, (lo.z + hi.z) * 0.5f, 1.0f);
+		float radius = 0.0f;
+		for (int i = 0; i < group->count; i++)
+		{
+			const s_vector& p = pos[indices[i]];
+			float dx = p.x - group->center.x, dy = p.y - group->center.y, dz = p.z - group->center.z;
+			radius = std::max(radius, dx * dx + dy * dy + dz * dz);
+		}
+		group->radius = sqrtf(radius);
+	}
+}
+
+void skin_update(skin_t* skin)
+{
+	skin->current = 1 - skin->current;
+	skin->active.clear();
+	for (size_t k = 0; k < skin->morphs.size(); k++)
+		if (skin->morphs[k].weight != 0.0f) skin->active.push_back((int)k);
+	if (skin->count > 0)
+	{
+		job_parallel_for(job_system(), 0, skin->count, SKIN_CHUNK, skin_job, skin);
+		job_parallel_for(job_system(), 0, (int)skin->groups.size(), 1, skin_bounds_job, skin);
+	}
+	skin->posed += skin->count;
+	vertex_layout_t* layout = &skin->layout;
+	vertex_layout_interleaved(layout, skin->rest, skin->count);
+	if (skin->count <= 0) return;
+	layout->pos.data = &skin->pos[skin->current][0];
+	layout->normal.data = &skin->normal[skin->current][0];
+	layout->tangent.data = &skin->tangent[skin->current][0];
+	layout->pos.stride = layout->normal.stride = layout->tangent.stride = sizeof(s_vector);
+}
+
+void skin_draw(device_t* device, skin_t* skin)
+{
+	if (skin->groups.empty()) return;
+	// the posed streams are reused every other pose, the count of posed vertices tells the poses apart
+	device_relight_fold(device, &skin->posed, sizeof(skin->posed));
+	draw_indexed_groups(device, &skin->layout, skin->indices, &skin->groups[0], (int)skin->groups.size());
+}
@@ -0,0 +1,78 @@
+#ifndef skin_h
+#define skin_h
+//=====================================================================
+// skeletal and morph target animation of an indexed mesh. every vertex
+// follows up to SKIN_WEIGHTS joints, its rest position moved by the
+// weighted morph targets first, then by the sum of the joint matrices
+// weighted by the vertex, blended four at a time by the mat_blend4
+// kernel of s_simd. the palette of joint matrices is made once per
+// pose and the vertices are posed in chunks of SKIN_CHUNK on the job
+// system into streams of their own, which draw_indexed_groups draws
+// like a static mesh: every vertex is transformed once into the post-
+// transform cache and the groups are culled with bounds of the pose.
+// the joints are taken to be rigid, the normals and tangents go
+// through the same matrix as the positions.
+//=====================================================================
+#include "render.h"
+#include <vector>
+
+#define SKIN_WEIGHTS    4        // joints per vertex
+#define SKIN_JOINTS_MAX 256      // joints of a mesh, an unsigned char indexes them
+#define SKIN_CHUNK      256      // vertices posed by one job
+
+typedef struct
+{
+	unsigned char joint[SKIN_WEIGHTS];
+	float weight[SKIN_WEIGHTS];  // summing to 1, the joints not used get 0
+}skin_weights_t;
+
+// the offsets a morph target gives the rest vertices at weight 1
+typedef struct
+{
+	std::vector<s_vector> pos, normal;
+	float weight;            // 0 leaves the target out
+}skin_morph_t;
+
+struct skin_t
+{
+	const vertex_t* rest;    // rest pose, not owned
+	int count;
+	const int* indices;      // triangle lists of the groups, not owned
+	std::vector<skin_weights_t> weights;   // of every vertex
+	std::vector<s_matrix> inverse_bind;    // model space to the space of joint j in the rest pose
+	std::vector<s_matrix> palette;         // inverse_bind[j] * pose[j], set by skin_set_pose
+	std::vector<skin_morph_t> morphs;
+	std::vector<int> active;               // morphs of a weight other than 0, while posing
+	// the posed streams alternate between two buffers. two skin_updates between frames find the same
+	// pointers again, so keys on them, like relighting, need posed too
+	std::vector<s_vector> pos[2], normal[2], tangent[2];
+	int current;             // buffer of the last skin_update
+	vertex_layout_t layout;  // the posed streams with the rest uv, colour and material
+	std::vector<mesh_group_t> groups;      // first / count index ranges, bounds of the last skin_update
+	long long posed;         // vertices posed since skin_create, skin_draw folds it into the relight key
+};
+
+// vertices[0, count) in the rest pose with weights[i] for vertex i and joints inverse bind matrices. groups
+// are the index ranges of indices to draw, both are kept. every joint starts at its bind matrix, so the mesh is
+// posed in the rest pose
+skin_t* skin_create(const vertex_t* vertices, int count, const skin_weights_t* weights, const s_matrix* inverse_bind, int joints,
+	const int* indices, const mesh_group_t* groups, int group_count);
+
+void skin_destory(skin_t* skin);
+
+// a morph target with the position and normal offsets of every vertex, normal may be NULL. returns its index
+int skin_add_morph(skin_t* skin, const s_vector* pos, const s_vector* normal);
+
+void skin_set_morph(skin_t* skin, int morph, float weight);
+
+// the model space matrices of the joints in the pose, one per joint
+void skin_set_pose(skin_t* skin, const s_matrix* pose);
+
+// pose the vertices with the palette and morph weights set and update the bounds of the groups, returns when
+// every chunk is done
+void skin_update(skin_t* skin);
+
+// draw_indexed_groups of the last pose
+void skin_draw(device_t* device, skin_t* skin);
+
+#endif
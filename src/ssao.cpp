@@ -0,0 +1,177 @@
+#include "ssao.h"
+#include "job.h"
+#include <cmath>
+#include <algorithm>
+
+// the rotation of the spiral of a half pixel, (rank + 0.5) / 16 of a turn by the bayer matrix, so
+// neighbours sample in directions far apart and every 4x4 block sees every rotation once
+static const int ssao_bayer[4][4] = {
+	{ 0, 8, 2, 10 },
+	{ 12, 4, 14, 6 },
+	{ 3, 11, 1, 9 },
+	{ 15, 7, 13, 5 },
+};
+
+ssao_t* ssao_create()
+{
+	ssao_t* ssao = new ssao_t;
+	ssao->width = ssao->height = 0;
+	ssao->active = 0;
+	ssao->radius = 0.5f;
+	ssao->intensity = 1.0f;
+	ssao->bias = 0.01f;
+	return ssao;
+}
+
+void ssao_destory(ssao_t* ssao)
+{
+	delete ssao;
+}
+
+typedef struct
+{
+	ssao_t* ssao;
+	const gbuffer_t* gbuffer;
+	float scale;             // half pixels per world unit at clip w 1
+	float spiral[SSAO_SAMPLES][3]; // direction and distance in [0, 1] of each sample before the rotation
+	float rotation[16][2];   // cos and sin of each rank
+}ssao_pass_t;
+
+// job: the first drawn sample of every 2x2 block of the G-buffer, half rows [begin, end)
+static void ssao_gather_rows(void* data, int begin, int end)
+{
+	ssao_pass_t* pass = (ssao_pass_t*)data;
+	ssao_t* ssao = pass->ssao;
+	const gbuffer_t* gbuffer = pass->gbuffer;
+	for (int y = begin; y < end; y++)
+	{
+		for (int x = 0; x < ssao->width; x++)
+		{
+			ssao_point_t* p = &ssao->points[y * ssao->width + x];
+			p->w = 0.0f;
+			for (int k = 0; k < 4; k++)
+			{
+				int gx = x * 2 + (k & 1), gy = y * 2 + (k >> 1);
+				if (gx >= gbuffer->width || gy >= gbuffer->height) continue;
+				int index = gy * gbuffer->width + gx;
+				if (gbuffer->counts[index] < 0) continue;
+				const g_sample_t* s = &gbuffer->samples[index];
+				p->x = s->pos.x; p->y = s->pos.y; p->z = s->pos.z;
+				p->nx = s->normal.x; p->ny = s->normal.y; p->nz = s->normal.z;
+				p->w = s->pos.w;
+				break;
+			}
+		}
+	}
+}
+
+// job: the occlusion of half rows [begin, end). a neighbour v away occludes by how far it is above the
+// tangent plane over its distance, fading out at the radius, see "scalable ambient obscurance"
+static void ssao_occlusion_rows(void* data, int begin, int end)
+{
+	ssao_pass_t* pass = (ssao_pass_t*)data;
+	ssao_t* ssao = pass->ssao;
+	int width = ssao->width, height = ssao->height;
+	float radius2 = ssao->radius * ssao->radius;
+	float radius6 = radius2 * radius2 * radius2;
+	float strength = ssao->intensity / radius6 * (5.0f / SSAO_SAMPLES);
+	for (int y = begin; y < end; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			const ssao_point_t* p = &ssao->points[y * width + x];
+			float* out = &ssao->occlusion[y * width + x];
+			if (p->w <= 0.0f)
+			{
+				*out = 1.0f;
+				continue;
+			}
+			float reach = std::min(ssao->radius * pass->scale / p->w, SSAO_RADIUS_MAX);
+			const float* rotation = pass->rotation[ssao_bayer[y & 3][x & 3]];
+			float sum = 0.0f;
+			for (int k = 0; k < SSAO_SAMPLES; k++)
+			{
+				const float* s = pass->spiral[k];
+				float dx = (s[0] * rotation[0] - s[1] * rotation[1]) * s[2] * reach;
+				float dy = (s[0] * rotation[1] + s[1] * rotation[0]) * s[2] * reach;
+				int sx = x + (int)floorf(dx + 0.5f), sy = y + (int)floorf(dy + 0.5f);
+				if (sx < 0 || sy < 0 || sx >= width || sy >= height || (sx == x && sy == y)) continue;
+				const ssao_point_t* q = &ssao->points[sy * width + sx];
+				if (q->w <= 0.0f) continue;
+				float vx = q->x - p->x, vy = q->y - p->y, vz = q->z - p->z;
+				float vv = vx * vx + vy * vy + vz * vz;
+				float vn = vx * p->nx + vy * p->ny + vz * p->nz;
+				float f = std::max(radius2 - vv, 0.0f);
+				sum += f * f * f * std::max((vn - ssao->bias) / (vv + 0.01f), 0.0f);
+			}
+			*out = std::max(1.0f - sum * strength, 0.0f);
+		}
+	}
+}
+
+// job: the 4x4 block around each half pixel of rows [begin, end) averaged over the ones of its depth,
+// the rotation pattern repeats every 4 so it evens out
+static void ssao_blur_rows(void* data, int begin, int end)
+{
+	ssao_pass_t* pass = (ssao_pass_t*)data;
+	ssao_t* ssao = pass->ssao;
+	int width = ssao->width, height = ssao->height;
+	for (int y = begin; y < end; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			int index = y * width + x;
+			float w = ssao->points[index].w;
+			if (w <= 0.0f)
+			{
+				ssao->visibility[index] = 1.0f;
+				continue;
+			}
+			float sum = 0.0f, weight = 0.0f;
+			for (int j = std::max(y - 1, 0); j <= std::min(y + 2, height - 1); j++)
+			{
+				for (int i = std::max(x - 1, 0); i <= std::min(x + 2, width - 1); i++)
+				{
+					int at = j * width + i;
+					float d = fabsf(ssao->points[at].w - w) / (w * SSAO_DEPTH);
+					if (d >= 1.0f) continue;
+					sum += ssao->occlusion[at] * (1.0f - d);
+					weight += 1.0f - d;
+				}
+			}
+			ssao->visibility[index] = sum / weight;
+		}
+	}
+}
+
+void ssao_compute(ssao_t* ssao, const gbuffer_t* gbuffer, float scale)
+{
+	ssao->width = (gbuffer->width + 1) / 2;
+	ssao->height = (gbuffer->height + 1) / 2;
+	size_t size = (size_t)ssao->width * ssao->height;
+	ssao->points.resize(size);
+	ssao->occlusion.resize(size);
+	ssao->visibility.resize(size);
+	ssao_pass_t pass;
+	pass.ssao = ssao;
+	pass.gbuffer = gbuffer;
+	pass.scale = scale * 0.5f;
+	const float turn = 6.28318531f;
+	for (int k = 0; k < SSAO_SAMPLES; k++)
+	{
+		float t = ((float)k + 0.5f) / SSAO_SAMPLES;
+		pass.spiral[k][0] = cosf(t * SSAO_TURNS * turn);
+		pass.spiral[k][1] = sinf(t * SSAO_TURNS * turn);
+		pass.spiral[k][2] = t;
+	}
+	for (int i = 0; i < 16; i++)
+	{
+		pass.rotation[i][0] = cosf(((float)i + 0.5f) / 16.0f * turn);
+		pass.rotation[i][1] = sinf(((float)i + 0.5f) / 16.0f * turn);
+	}
+	job_system_t* jobs = job_system();
+	job_parallel_for(jobs, 0, ssao->height, SSAO_ROWS, ssao_gather_rows, &pass);
+	job_parallel_for(jobs, 0, ssao->height, SSAO_ROWS, ssao_occlusion_rows, &pass);
+	job_parallel_for(jobs, 0, ssao->height, SSAO_ROWS, ssao_blur_rows, &pass);
+	ssao->active = 1;
+}
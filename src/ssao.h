@@ -0,0 +1,70 @@
+#ifndef ssao_h
+#define ssao_h
+//=====================================================================
+// screen space ambient occlusion of deferred frames. device_resolve
+// takes every other G-buffer sample in x and y, gathers SSAO_SAMPLES
+// of its neighbours on a spiral whose rotation repeats every 4x4 half
+// pixels, and blurs that pattern away over 4x4 half pixels of about
+// the same depth. the shaders multiply their ambient term with the
+// value of their pixel, upsampled with bilinear weights that drop the
+// half pixels of another depth. frames without a G-buffer aren't
+// occluded.
+//=====================================================================
+#include "render.h"
+#include "gbuffer.h"
+#include <vector>
+
+#define SSAO_SAMPLES 8           // per half pixel
+#define SSAO_TURNS 3             // of the spiral over the samples
+#define SSAO_RADIUS_MAX 32.0f    // half pixels, the radius of the near samples is cut to it
+#define SSAO_DEPTH 0.1f          // relative difference of clip w the blur and upsampling still take
+#define SSAO_ROWS 8              // half rows per job
+
+typedef struct
+{
+	float x, y, z;           // world position
+	float nx, ny, nz;        // normal
+	float w;                 // clip w, 0 where nothing was drawn
+}ssao_point_t;
+
+struct ssao_t
+{
+	int width, height;       // half of the G-buffer, rounded up
+	int active;              // visibility holds the G-buffer being resolved
+	float radius;            // world units the occluders are looked for in, 0.5 by default
+	float intensity;         // 1 by default
+	float bias;              // world units a surface must rise above the tangent plane, 0.01 by default
+	std::vector<ssao_point_t> points;   // width * height
+	std::vector<float> occlusion;       // the raw visibility in [0, 1]
+	std::vector<float> visibility;      // blurred
+};
+
+ssao_t* ssao_create();
+
+void ssao_destory(ssao_t* ssao);
+
+// before the G-buffer is shaded: the visibility of its samples. scale is the projection's pixels per world
+// unit at clip w 1 in the G-buffer
+void ssao_compute(ssao_t* ssao, const gbuffer_t* gbuffer, float scale);
+
+// the visibility of pixel (x, y) of clip w w, 1 when no half pixel around is of its depth
+inline float ssao_at(const ssao_t* ssao, int x, int y, float w)
+{
+	int x0 = x >> 1, y0 = y >> 1;
+	int x1 = x0 + 1 < ssao->width ? x0 + 1 : x0, y1 = y0 + 1 < ssao->height ? y0 + 1 : y0;
+	float fx = (x & 1) ? 0.5f : 0.0f, fy = (y & 1) ? 0.5f : 0.0f;
+	int index[4] = { y0 * ssao->width + x0, y0 * ssao->width + x1, y1 * ssao->width + x0, y1 * ssao->width + x1 };
+	float bilinear[4] = { (1.0f - fx) * (1.0f - fy), fx * (1.0f - fy), (1.0f - fx) * fy, fx * fy };
+	float sum = 0.0f, weight = 0.0f;
+	for (int k = 0; k < 4; k++)
+	{
+		float d = ssao->points[index[k]].w - w;
+		d = (d < 0.0f ? -d : d) / (w * SSAO_DEPTH);
+		float b = bilinear[k] * (d < 1.0f ? 1.0f - d : 0.0f);
+		sum += ssao->visibility[index[k]] * b;
+		weight += b;
+	}
+	return weight > 1e-4f ? sum / weight : 1.0f;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include "surface.h"
+#include "memory_track.h"
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+
+static int surface_bpp(int format)
+{
+	if (format == SURFACE_FORMAT_RGBA32F) return 16;
+	return format == SURFACE_FORMAT_DEPTH16 ? 2 : 4;
+}
+
+surface_t* surface_create(int width, int height, int format, void* external, int pitch)
+{
+	surface_t* surface = (surface_t*)malloc(sizeof(surface_t));
+	assert(surface);
+	surface->width = width;
+	surface->height = height;
+	surface->format = format;
+	surface->bpp = surface_bpp(format);
+	if (external != NULL)
+	{
+		surface->block = NULL;
+		surface->pixels = (unsigned char*)external;
+		surface->pitch = pitch > 0 ? pitch : width * surface->bpp;
+		return surface;
+	}
+	surface->pitch = (width * surface->bpp + SURFACE_ALIGN - 1) & ~(SURFACE_ALIGN - 1);
+	surface->block = memory_alloc(MEMORY_TARGETS, (size_t)surface->pitch * height + SURFACE_ALIGN, 0);
+	size_t addr = (size_t)surface->block;
+	surface->pixels = (unsigned char*)((addr + SURFACE_ALIGN - 1) & ~(size_t)(SURFACE_ALIGN - 1));
+	surface_clear(surface, 0);
+	return surface;
+}
+
+void surface_destory(surface_t* surface)
+{
+	if (surface == NULL) return;
+	memory_free(surface->block);
+	free(surface);
+}
+
+surface_t surface_view(const surface_t* surface, int x, int y, int w, int h)
+{
+	surface_t view = *surface;
+	view.pixels = surface->pixels + y * surface->pitch + x * surface->bpp;
+	view.width = w;
+	view.height = h;
+	view.block = NULL;
+	return view;
+}
+
+void surface_clear(surface_t* surface, IUINT32 value)
+{
+	int row = surface->width * surface->bpp;
+	if (surface->bpp == 2) value = (value & 0xffff) | (value << 16);
+	// a value made of one repeated byte (0 depth, black or white) is a memset
+	bool bytes = value == (value & 0xff) * 0x01010101u;
+	if (bytes && row == surface->pitch)
+	{
+		memset(surface->pixels, value & 0xff, (size_t)row * surface->height);
+		return;
+	}
+	for (int y = 0; y < surface->height; y++)
+	{
+		unsigned char* dst = surface->pixels + y * surface->pitch;
+		if (bytes) memset(dst, value & 0xff, row);
+		else if (surface->bpp == 2)
+		{
+			unsigned short* p = (unsigned short*)dst;
+			for (int x = 0; x < surface->width; x++) p[x] = (unsigned short)value;
+		}
+		else
+		{
+			// every word of a float pixel gets value
+			IUINT32* p = (IUINT32*)dst;
+			for (int x = 0; x < row / 4; x++) p[x] = value;
+		}
+	}
+}
+
+unsigned long long surface_hash(const surface_t* surface)
+{
+	// FNV-1a over 32 bit words, a 16 bit row ends in a half word that is padded with zeros
+	const unsigned long long prime = 0x100000001b3ULL;
+	unsigned long long h = 0xcbf29ce484222325ULL;
+	h = (h ^ (unsigned long long)surface->width) * prime;
+	h = (h ^ (unsigned long long)surface->height) * prime;
+	h = (h ^ (unsigned long long)surface->format) * prime;
+	int row = surface->width * surface->bpp;
+	for (int y = 0; y < surface->height; y++)
+	{
+		const unsigned char* src = surface->pixels + y * surface->pitch;
+		int x = 0;
+		for (; x + 4 <= row; x += 4)
+		{
+			IUINT32 word;
+			memcpy(&word, src + x, 4);
+			h = (h ^ word) * prime;
+		}
+		if (x < row)
+		{
+			IUINT32 word = 0;
+			memcpy(&word, src + x, row - x);
+			h = (h ^ word) * prime;
+		}
+	}
+	return h;
+}
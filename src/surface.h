@@ -0,0 +1,68 @@
+#ifndef surface_h
+#define surface_h
+//=====================================================================
+// render targets: one flat block per surface, rows are pitch bytes
+// apart and start on SURFACE_ALIGN boundaries when the surface owns
+// its memory, so pixel (x, y) is pixels + y * pitch + x * bpp.
+//=====================================================================
+#include "s_math.h"
+
+#define SURFACE_ALIGN 64
+
+#define SURFACE_FORMAT_XRGB32  0  // IUINT32 0x00RRGGBB, the framebuffer
+#define SURFACE_FORMAT_DEPTH32 1  // float 1/z, larger is nearer, 0 is empty
+#define SURFACE_FORMAT_DEPTH16 2  // unsigned short, see depth16_encode
+#define SURFACE_FORMAT_RGBA32F 3  // 4 floats, the HDR colour of hdr.h
+#define SURFACE_FORMAT_DEPTH24 4  // IUINT32, see depth24_encode
+
+typedef struct
+{
+	unsigned char* pixels;   // pixel (0, 0)
+	int width, height;
+	int pitch;               // bytes from one row to the next
+	int format;              // SURFACE_FORMAT_*
+	int bpp;                 // bytes per pixel
+	void* block;             // allocation freed by surface_destory, NULL for external memory and views
+}surface_t;
+
+// external may be NULL, the surface then allocates aligned rows itself.
+// pitch is only used with external memory, 0 means width * bpp
+surface_t* surface_create(int width, int height, int format, void* external, int pitch);
+
+void surface_destory(surface_t* surface);
+
+// a sub rectangle sharing the pixels of surface, it owns nothing and needs no destory
+surface_t surface_view(const surface_t* surface, int x, int y, int w, int h);
+
+// set every pixel to value: the IUINT32 for XRGB32, the bits of a float for DEPTH32,
+// the low 16 bits for DEPTH16, the IUINT32 for DEPTH24
+void surface_clear(surface_t* surface, IUINT32 value);
+
+// 64 bit content hash of the pixels, the padding of the rows is left out. equal surfaces of one size
+// and format hash the same whatever their pitch, so a frame can be told unchanged without keeping it
+unsigned long long surface_hash(const surface_t* surface);
+
+inline IUINT32* surface_row_u32(const surface_t* surface, int y) { return (IUINT32*)(surface->pixels + y * surface->pitch); }
+inline float* surface_row_f32(const surface_t* surface, int y) { return (float*)(surface->pixels + y * surface->pitch); }
+inline unsigned short* surface_row_u16(const surface_t* surface, int y) { return (unsigned short*)(surface->pixels + y * surface->pitch); }
+
+// 16 bit depth keeps 1 - 1/daozp, the post projection z flipped so that larger is still nearer
+inline unsigned short depth16_encode(float daozp)
+{
+	if (daozp <= 0.0f) return 0;
+	float d = 1.0f - 1.0f / daozp;
+	d = d < 0.0f ? 0.0f : (d > 1.0f ? 1.0f : d);
+	return (unsigned short)(d * 65535.0f + 0.5f);
+}
+
+// 24 bit depth is depth16_encode with 2^24 - 1 steps, below 2^31 so the depth test kernels can
+// compare it signed
+inline IUINT32 depth24_encode(float daozp)
+{
+	if (daozp <= 0.0f) return 0;
+	float d = 1.0f - 1.0f / daozp;
+	d = d < 0.0f ? 0.0f : (d > 1.0f ? 1.0f : d);
+	return (IUINT32)((double)d * 16777215.0 + 0.5);
+}
+
+#endif
@@ -0,0 +1,98 @@
+#include "swap_chain.h"
+#include <cassert>
+
+static void swap_chain_worker(swap_chain_t* chain)
+{
+	std::unique_lock<std::mutex> hold(chain->lock);
+	for (;;)
+	{
+		chain->queued.wait(hold, [chain] { return chain->quit || !chain->queue.empty(); });
+		if (chain->queue.empty()) break;
+		int index = chain->queue.front();
+		chain->queue.pop_front();
+		// the renderer may acquire and draw other buffers meanwhile
+		hold.unlock();
+		chain->present(chain->buffers[index], chain->user);
+		hold.lock();
+		chain->busy[index] = 0;
+		chain->presented++;
+		chain->released.notify_all();
+	}
+}
+
+static swap_chain_t* swap_chain_start(swap_chain_t* chain, swap_present_t present, void* user)
+{
+	for (size_t i = 0; i < chain->buffers.size(); i++) chain->busy.push_back(0);
+	chain->current = -1;
+	chain->next = 0;
+	chain->present = present;
+	chain->user = user;
+	chain->presented = 0;
+	chain->quit = false;
+	chain->worker = std::thread(swap_chain_worker, chain);
+	return chain;
+}
+
+swap_chain_t* swap_chain_create(int width, int height, int buffers, swap_present_t present, void* user)
+{
+	if (buffers < 2) buffers = 2;
+	if (buffers > SWAP_CHAIN_MAX_BUFFERS) buffers = SWAP_CHAIN_MAX_BUFFERS;
+	swap_chain_t* chain = new swap_chain_t();
+	for (int i = 0; i < buffers; i++) chain->buffers.push_back(surface_create(width, height, SURFACE_FORMAT_XRGB32, NULL, 0));
+	chain->owned = true;
+	return swap_chain_start(chain, present, user);
+}
+
+swap_chain_t* swap_chain_create_on(const std::vector<surface_t*>& buffers, swap_present_t present, void* user)
+{
+	swap_chain_t* chain = new swap_chain_t();
+	for (size_t i = 0; i < buffers.size() && i < SWAP_CHAIN_MAX_BUFFERS; i++) chain->buffers.push_back(buffers[i]);
+	chain->owned = false;
+	return swap_chain_start(chain, present, user);
+}
+
+void swap_chain_destory(swap_chain_t* chain)
+{
+	if (chain == NULL) return;
+	{
+		std::lock_guard<std::mutex> hold(chain->lock);
+		chain->quit = true;
+	}
+	chain->queued.notify_all();
+	chain->worker.join();
+	for (size_t i = 0; i < chain->buffers.size() && chain->owned; i++) surface_destory(chain->buffers[i]);
+	delete chain;
+}
+
+surface_t* swap_chain_acquire(swap_chain_t* chain)
+{
+	std::unique_lock<std::mutex> hold(chain->lock);
+	if (chain->current >= 0) return chain->buffers[chain->current];
+	// buffers are handed out round robin, so the one presented longest ago is reused first
+	int index = chain->next;
+	chain->released.wait(hold, [chain, index] { return !chain->busy[index]; });
+	chain->current = index;
+	chain->next = (index + 1) % (int)chain->buffers.size();
+	return chain->buffers[index];
+}
+
+void swap_chain_submit(swap_chain_t* chain)
+{
+	{
+		std::lock_guard<std::mutex> hold(chain->lock);
+		assert(chain->current >= 0);
+		chain->busy[chain->current] = 1;
+		chain->queue.push_back(chain->current);
+		chain->current = -1;
+	}
+	chain->queued.notify_one();
+}
+
+void swap_chain_flush(swap_chain_t* chain)
+{
+	std::unique_lock<std::mutex> hold(chain->lock);
+	chain->released.wait(hold, [chain] {
+		for (size_t i = 0; i < chain->busy.size(); i++) if (chain->busy[i]) return false;
+		return true;
+	});
+}
@@ -0,0 +1,58 @@
+#ifndef swap_chain_h
+#define swap_chain_h
+//=====================================================================
+// swap chain: a few color buffers the device draws into in turn, and
+// a present thread that hands finished ones to a present callback
+// while the next frame is drawn. a buffer is either free, drawn into,
+// queued or being presented; acquire waits for a free one, so the
+// renderer is never more than the queue length ahead of the screen.
+//=====================================================================
+#include "surface.h"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define SWAP_CHAIN_MAX_BUFFERS 3
+
+// runs on the present thread, buffer stays untouched until it returns
+typedef void (*swap_present_t)(const surface_t* buffer, void* user);
+
+struct swap_chain_t
+{
+	std::vector<surface_t*> buffers;    // XRGB32
+	bool owned;                         // the chain made the buffers and destroys them
+	std::vector<int> busy;              // queued or being presented
+	std::deque<int> queue;              // submitted buffers in present order
+	int current;                        // acquired and not yet submitted, -1 for none
+	int next;                           // the buffer acquire tries first
+	swap_present_t present;
+	void* user;
+	std::thread worker;
+	std::mutex lock;
+	std::condition_variable queued, released;
+	int presented;                      // frames presented since create
+	bool quit;
+};
+
+// buffers is clamped to 2..SWAP_CHAIN_MAX_BUFFERS
+swap_chain_t* swap_chain_create(int width, int height, int buffers, swap_present_t present, void* user);
+
+// a chain over buffers made elsewhere, like the ones of a present backend, that outlive it. with one buffer
+// drawing waits for its present, more than SWAP_CHAIN_MAX_BUFFERS are left out
+swap_chain_t* swap_chain_create_on(const std::vector<surface_t*>& buffers, swap_present_t present, void* user);
+
+// presents what is queued, then stops the thread
+void swap_chain_destory(swap_chain_t* chain);
+
+// the next buffer to draw into, waits while every buffer is queued or on screen
+surface_t* swap_chain_acquire(swap_chain_t* chain);
+
+// queue the acquired buffer for present and return at once
+void swap_chain_submit(swap_chain_t* chain);
+
+// wait until every submitted buffer has been presented
+void swap_chain_flush(swap_chain_t* chain);
+
+#endif
@@ -0,0 +1,255 @@
+#include "taa.h"
+#include "gbuffer.h"
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+// a pixel whose last position is unknown, behind the camera of the last frame
+#define TAA_NO_HISTORY 1e30f
+
+// radical inverse of index in base, in [0, 1)
+static float taa_halton(int index, int base)
+{
+	float f = 1.0f, r = 0.0f;
+	for (; index > 0; index /= base)
+	{
+		f /= (float)base;
+		r += f * (float)(index % base);
+	}
+	return r;
+}
+
+// out = m^-1, Gauss-Jordan with partial pivoting. s_matrix::inverse only handles rigid transforms
+static bool taa_invert(const s_matrix& m, s_matrix& out)
+{
+	double t[4][8];
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 8; j++) t[i][j] = j < 4 ? (double)m.m[i][j] : (j - 4 == i ? 1.0 : 0.0);
+	for (int c = 0; c < 4; c++)
+	{
+		int pivot = c;
+		for (int r = c + 1; r < 4; r++) if (fabs(t[r][c]) > fabs(t[pivot][c])) pivot = r;
+		if (t[pivot][c] == 0.0) return false;
+		for (int j = 0; j < 8; j++) std::swap(t[c][j], t[pivot][j]);
+		double f = 1.0 / t[c][c];
+		for (int j = 0; j < 8; j++) t[c][j] *= f;
+		for (int r = 0; r < 4; r++)
+		{
+			if (r == c || t[r][c] == 0.0) continue;
+			double g = t[r][c];
+			for (int j = 0; j < 8; j++) t[r][j] -= g * t[c][j];
+		}
+	}
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++) out.m[i][j] = (float)t[i][j + 4];
+	return true;
+}
+
+taa_t* taa_create(int width, int height)
+{
+	taa_t* taa = new taa_t;
+	taa->width = width;
+	taa->height = height;
+	taa->jittered = 0;
+	taa->jitter_x = taa->jitter_y = 0.0f;
+	taa->projection.set_identity();
+	taa->prev_vp.set_identity();
+	for (int i = 0; i < 2; i++) taa->history[i] = surface_create(width, height, SURFACE_FORMAT_XRGB32, NULL, 0);
+	taa->motion.resize(width * height * 2);
+	taa_reset(taa);
+	return taa;
+}
+
+void taa_destory(taa_t* taa)
+{
+	if (taa == NULL) return;
+	for (int i = 0; i < 2; i++) surface_destory(taa->history[i]);
+	delete taa;
+}
+
+void taa_reset(taa_t* taa)
+{
+	taa->frame = 0;
+	taa->current = 0;
+}
+
+void taa_begin(taa_t* taa, device_t* device)
+{
+	s_transform& transform = device->transform;
+	// a second clear without a resolve moves the projection again, not on top of the last offset
+	if (taa->jittered) transform.projection = taa->projection;
+	taa->projection = transform.projection;
+	int phase = taa->frame % TAA_JITTER_PHASES + 1;
+	taa->jitter_x = taa_halton(phase, 2) - 0.5f;
+	taa->jitter_y = taa_halton(phase, 3) - 0.5f;
+	// clip.x += dx * clip.w moves every point by dx in ndc, the screen y axis points down
+	float dx = taa->jitter_x * 2.0f / transform.w, dy = -taa->jitter_y * 2.0f / transform.h;
+	for (int r = 0; r < 4; r++)
+	{
+		transform.projection.m[r][0] += dx * transform.projection.m[r][3];
+		transform.projection.m[r][1] += dy * transform.projection.m[r][3];
+	}
+	transform.update();
+	taa->jittered = 1;
+}
+
+// screen position of clip, false behind the camera
+static inline bool taa_screen(const s_vector& clip, float width, float height, float& sx, float& sy)
+{
+	if (clip.w <= 0.0f) return false;
+	float rhw = 1.0f / clip.w;
+	sx = (clip.x * rhw + 1.0f) * width * 0.5f;
+	sy = (1.0f - clip.y * rhw) * height * 0.5f;
+	return true;
+}
+
+void taa_motion(taa_t* taa, device_t* device)
+{
+	if (taa->frame == 0) return;
+	s_transform& transform = device->transform;
+	float width = transform.w, height = transform.h;
+	s_matrix vp, inverse, reproject;
+	vp.mul_two(transform.view, taa->projection);
+	// ndc of the drawn frame to clip space of the last one
+	if (!taa_invert(transform.vp, inverse)) inverse.set_identity();
+	reproject.mul_two(inverse, taa->prev_vp);
+	gbuffer_t* gbuffer = device->gbuffer;
+	bool samples = gbuffer != NULL && gbuffer->active;
+	const surface_t* depth = device->depth;
+	for (int y = 0; y < taa->height; y++)
+	{
+		float* motion = &taa->motion[y * taa->width * 2];
+		for (int x = 0; x < taa->width; x++, motion += 2)
+		{
+			// in pixels of the frame, the region of the device starts at its viewport corner
+			float fx = (float)x + 0.5f + device->viewport_x, fy = (float)y + 0.5f + device->viewport_y;
+			float now_x = fx - taa->jitter_x, now_y = fy - taa->jitter_y;
+			float last_x, last_y;
+			s_vector clip;
+			bool seen;
+			if (samples && gbuffer->counts[y * gbuffer->width + x] >= 0)
+			{
+				s_vector pos = gbuffer->samples[y * gbuffer->width + x].pos;
+				pos.w = 1.0f;
+				s_vector now;
+				apply_to_vector(now, pos, vp);
+				taa_screen(now, width, height, now_x, now_y);
+				apply_to_vector(clip, pos, taa->prev_vp);
+				seen = taa_screen(clip, width, height, last_x, last_y);
+			}
+			else
+			{
+				float z;
+				if (depth->format == SURFACE_FORMAT_DEPTH16)
+				{
+					unsigned short d = surface_row_u16(depth, y)[x];
+					z = d == 0 ? 0.0f : 1.0f - (float)d / 65535.0f;
+				}
+				else if (depth->format == SURFACE_FORMAT_DEPTH24)
+				{
+					IUINT32 d = surface_row_u32(depth, y)[x];
+					z = d == 0 ? 0.0f : (float)(1.0 - (double)d / 16777215.0);
+				}
+				else
+				{
+					float daozp = surface_row_f32(depth, y)[x];
+					z = daozp > 0.0f ? 1.0f / daozp : 0.0f;
+				}
+				// the background is drawn in screen space, it stays where it is
+				if (z == 0.0f)
+				{
+					motion[0] = motion[1] = 0.0f;
+					continue;
+				}
+				s_vector ndc(fx * 2.0f / width - 1.0f, 1.0f - fy * 2.0f / height, z, 1.0f);
+				apply_to_vector(clip, ndc, reproject);
+				seen = taa_screen(clip, width, height, last_x, last_y);
+			}
+			motion[0] = seen ? now_x - last_x : TAA_NO_HISTORY;
+			motion[1] = seen ? now_y - last_y : TAA_NO_HISTORY;
+		}
+	}
+}
+
+// bilinear read of the rgb channels of an XRGB32 surface at pixel position (x, y), pixel centers at +0.5
+static inline void taa_fetch(const surface_t* surface, float x, float y, float* rgb)
+{
+	x -= 0.5f;
+	y -= 0.5f;
+	int x0 = (int)floorf(x), y0 = (int)floorf(y);
+	float fx = x - (float)x0, fy = y - (float)y0;
+	int x1 = std::min(x0 + 1, surface->width - 1), y1 = std::min(y0 + 1, surface->height - 1);
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	const IUINT32* r0 = surface_row_u32(surface, y0);
+	const IUINT32* r1 = surface_row_u32(surface, y1);
+	IUINT32 c[4] = { r0[x0], r0[x1], r1[x0], r1[x1] };
+	float w[4] = { (1.0f - fx) * (1.0f - fy), fx * (1.0f - fy), (1.0f - fx) * fy, fx * fy };
+	for (int k = 0; k < 3; k++)
+	{
+		int shift = 16 - k * 8;
+		rgb[k] = 0.0f;
+		for (int i = 0; i < 4; i++) rgb[k] += w[i] * (float)((c[i] >> shift) & 0xff);
+	}
+}
+
+void taa_resolve(taa_t* taa, device_t* device)
+{
+	surface_t* color = device->color;
+	const surface_t* history = taa->history[taa->current];
+	surface_t* result = taa->history[taa->current ^ 1];
+	int width = taa->width, height = taa->height;
+	for (int y = 0; y < height; y++)
+	{
+		const IUINT32* src = surface_row_u32(color, y);
+		IUINT32* dst = surface_row_u32(result, y);
+		const float* motion = &taa->motion[y * width * 2];
+		for (int x = 0; x < width; x++, motion += 2)
+		{
+			float last_x = (float)x + 0.5f - motion[0], last_y = (float)y + 0.5f - motion[1];
+			if (taa->frame == 0 || !(last_x >= 0.0f && last_x < (float)width && last_y >= 0.0f && last_y < (float)height))
+			{
+				dst[x] = src[x];
+				continue;
+			}
+			// the history is clamped to the range of the 3x3 neighbourhood of the new frame
+			int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+			for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1); ny++)
+			{
+				const IUINT32* row = surface_row_u32(color, ny);
+				for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1); nx++)
+				{
+					for (int k = 0; k < 3; k++)
+					{
+						int v = (row[nx] >> (16 - k * 8)) & 0xff;
+						lo[k] = std::min(lo[k], v);
+						hi[k] = std::max(hi[k], v);
+					}
+				}
+			}
+			float h[3];
+			taa_fetch(history, last_x, last_y, h);
+			IUINT32 out = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				float c = (float)((src[x] >> (16 - k * 8)) & 0xff);
+				float v = std::min(std::max(h[k], (float)lo[k]), (float)hi[k]);
+				int channel = (int)(v + (c - v) * TAA_BLEND + 0.5f);
+				out |= (IUINT32)channel << (16 - k * 8);
+			}
+			dst[x] = out;
+		}
+	}
+	// only now, the neighbourhoods of the next rows read the rows above
+	for (int y = 0; y < height; y++) memcpy(surface_row_u32(color, y), surface_row_u32(result, y), width * 4);
+	taa->current ^= 1;
+	taa->frame++;
+	s_transform& transform = device->transform;
+	if (taa->jittered)
+	{
+		transform.projection = taa->projection;
+		transform.update();
+		taa->jittered = 0;
+	}
+	taa->prev_vp.mul_two(transform.view, transform.projection);
+}
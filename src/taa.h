@@ -0,0 +1,48 @@
+#ifndef taa_h
+#define taa_h
+//=====================================================================
+// temporal anti-aliasing: every frame moves the projection by a sub
+// pixel offset of a halton sequence, and device_resolve blends the frame
+// into a history of the earlier ones. the history is read where the
+// pixel was in the last frame, found with the previous view projection
+// from the G-buffer position or from the depth surface, and clamped to
+// the colours around the pixel so moving objects do not leave trails.
+//=====================================================================
+#include "render.h"
+#include <vector>
+
+#define TAA_JITTER_PHASES 8      // length of the halton (2, 3) sequence of offsets
+#define TAA_BLEND 0.1f           // weight of the new frame once there is a history
+
+struct taa_t
+{
+	int width, height;
+	int frame;               // drawn since the history was reset
+	int jittered;            // taa_begin moved device->transform.projection
+	float jitter_x, jitter_y; // of the open frame, in pixels
+	s_matrix projection;     // without the offset, put back by taa_resolve
+	s_matrix prev_vp;        // view * projection of the last frame, without the offset
+	surface_t* history[2];   // XRGB32, history[current] is the last result
+	int current;
+	std::vector<float> motion; // 2 floats per pixel: screen position now minus in the last frame, in pixels
+};
+
+taa_t* taa_create(int width, int height);
+
+void taa_destory(taa_t* taa);
+
+// forget the history, the next frame is taken as it is
+void taa_reset(taa_t* taa);
+
+// with device_clear: offset device->transform.projection for the next frame
+void taa_begin(taa_t* taa, device_t* device);
+
+// before the G-buffer is shaded: the motion of every pixel. pixels with a G-buffer sample use its
+// position, the others are un-projected from the depth surface and the empty ones do not move
+void taa_motion(taa_t* taa, device_t* device);
+
+// after everything else of device_resolve: blend device->color with the history and keep the
+// result as the next history, then put the projection back
+void taa_resolve(taa_t* taa, device_t* device);
+
+#endif
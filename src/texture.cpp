@@ -0,0 +1,707 @@
+#include "texture.h"
+#include "texture_stream.h"
+#include "gamma.h"
+#include "memory_track.h"
+#include "stb_image.h"
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+void texture_init(s_texture* t)
+{
+	t->tex_width = t->tex_height = 0;
+	t->max_u = t->max_v = 0.0f;
+	t->layout = TEXTURE_LAYOUT_LINEAR;
+	t->format = TEXTURE_FORMAT_RGBA8;
+	t->srgb = 0;
+	t->normal = 0;
+	t->levels = 0;
+	t->block = NULL;
+	t->bytes = 0;
+	t->shared = 0;
+	t->stream = NULL;
+	for (int k = 0; k < TEXTURE_MAX_LEVELS; k++)
+	{
+		t->mip[k] = NULL;
+		t->mip_pitch[k] = 0;
+	}
+}
+
+void texture_release(s_texture* t)
+{
+	if (!t->shared) memory_free(t->block);
+	texture_init(t);
+}
+
+static inline int texture_level_width(const s_texture* t, int k) { return std::max(1, t->tex_width >> k); }
+static inline int texture_level_height(const s_texture* t, int k) { return std::max(1, t->tex_height >> k); }
+
+static int texture_log2_ceil(int v)
+{
+	int bits = 0;
+	while ((1 << bits) < v) bits++;
+	return bits;
+}
+
+size_t texture_level_size(int layout, int format, int w, int h, int* pitch)
+{
+	if (layout == TEXTURE_LAYOUT_BC)
+	{
+		*pitch = (w + 3) / 4;
+		return (size_t)*pitch * ((h + 3) / 4) * texture_bc_words(format);
+	}
+	if (layout == TEXTURE_LAYOUT_TILED4)
+	{
+		*pitch = (w + 3) / 4;
+		return (size_t)*pitch * ((h + 3) / 4) * 16;
+	}
+	if (layout == TEXTURE_LAYOUT_MORTON)
+	{
+		// both sides padded to powers of two
+		int bw = texture_log2_ceil(w), bh = texture_log2_ceil(h);
+		*pitch = std::min(bw, bh);
+		return (size_t)1 << (bw + bh);
+	}
+	*pitch = w;
+	return (size_t)w * h;
+}
+
+int texture_level_count(int w, int h)
+{
+	int levels = 1;
+	while (levels < TEXTURE_MAX_LEVELS && (std::max(1, w >> (levels - 1)) > 1 || std::max(1, h >> (levels - 1)) > 1)) levels++;
+	return levels;
+}
+
+// empty storage of every level for a w x h texture
+static void texture_allocate(s_texture* t, int w, int h, int layout, int format)
+{
+	texture_release(t);
+	t->tex_width = w;
+	t->tex_height = h;
+	t->max_u = (float)(w - 1);
+	t->max_v = (float)(h - 1);
+	t->layout = layout;
+	t->format = format;
+	int levels = texture_level_count(w, h);
+	t->levels = levels;
+	size_t offsets[TEXTURE_MAX_LEVELS], total = 0;
+	for (int k = 0; k < levels; k++)
+	{
+		offsets[k] = total;
+		total += texture_level_size(layout, format, texture_level_width(t, k), texture_level_height(t, k), &t->mip_pitch[k]);
+	}
+	t->block = (IUINT32*)memory_alloc(MEMORY_TEXTURES, total * sizeof(IUINT32), 1);
+	t->bytes = total * sizeof(IUINT32);
+	for (int k = 0; k < levels; k++) t->mip[k] = t->block + offsets[k];
+}
+
+// box filter levels 1.. from level 0
+static void texture_build_mips(s_texture* t)
+{
+	for (int k = 1; k < t->levels; k++)
+	{
+		int lw = texture_level_width(t, k), lh = texture_level_height(t, k);
+		int pw = texture_level_width(t, k - 1), ph = texture_level_height(t, k - 1);
+		for (int y = 0; y < lh; y++)
+		{
+			for (int x = 0; x < lw; x++)
+			{
+				// 2x2 box, odd sizes repeat the last row or column
+				int x0 = std::min(x * 2, pw - 1), x1 = std::min(x * 2 + 1, pw - 1);
+				int y0 = std::min(y * 2, ph - 1), y1 = std::min(y * 2 + 1, ph - 1);
+				IUINT32 c[4] = { texture_texel(t, k - 1, x0, y0), texture_texel(t, k - 1, x1, y0), texture_texel(t, k - 1, x0, y1), texture_texel(t, k - 1, x1, y1) };
+				IUINT32 out = 0;
+				for (int shift = 0; shift < 32; shift += 8)
+				{
+					IUINT32 sum = 2;
+					for (int i = 0; i < 4; i++) sum += (c[i] >> shift) & 0xff;
+					out |= (sum / 4) << shift;
+				}
+				t->mip[k][texture_texel_index(t, k, x, y)] = out;
+			}
+		}
+	}
+}
+
+// every level of the linear texture src compressed into t in format, the texels past the border of a
+// level repeat its last row and column
+static void texture_compress(s_texture* t, const s_texture* src, int format)
+{
+	texture_allocate(t, src->tex_width, src->tex_height, TEXTURE_LAYOUT_BC, format);
+	int words = texture_bc_words(format);
+	for (int k = 0; k < t->levels; k++)
+	{
+		int w = texture_level_width(t, k), h = texture_level_height(t, k);
+		for (int by = 0; by < (h + 3) / 4; by++)
+		{
+			for (int bx = 0; bx < t->mip_pitch[k]; bx++)
+			{
+				IUINT32 texels[16];
+				for (int i = 0; i < 16; i++)
+					texels[i] = texture_texel(src, k, std::min(bx * 4 + (i & 3), w - 1), std::min(by * 4 + (i >> 2), h - 1));
+				texture_bc_encode(format, texels, t->mip[k] + ((size_t)by * t->mip_pitch[k] + bx) * words);
+			}
+		}
+	}
+}
+
+// compress the linear texture src into t in the format its level 0 needs, and free src
+static void texture_compress_picked(s_texture* t, s_texture* src)
+{
+	texture_compress(t, src, texture_bc_pick(src->mip[0], (size_t)src->tex_width * src->tex_height));
+	texture_release(src);
+}
+
+void texture_store(s_texture* t, IUINT32** rows, int w, int h, int layout)
+{
+	if (layout == TEXTURE_LAYOUT_BC)
+	{
+		s_texture linear;
+		texture_init(&linear);
+		texture_store(&linear, rows, w, h, TEXTURE_LAYOUT_LINEAR);
+		texture_compress_picked(t, &linear);
+		return;
+	}
+	texture_allocate(t, w, h, layout, TEXTURE_FORMAT_RGBA8);
+	for (int y = 0; y < h; y++)
+		for (int x = 0; x < w; x++)
+			t->mip[0][texture_texel_index(t, 0, x, y)] = rows[y][x];
+	texture_build_mips(t);
+}
+
+bool texture_load(s_texture* t, const char* path, int layout)
+{
+	if (layout == TEXTURE_LAYOUT_BC)
+	{
+		s_texture linear;
+		texture_init(&linear);
+		if (!texture_load(&linear, path, TEXTURE_LAYOUT_LINEAR)) return false;
+		texture_compress_picked(t, &linear);
+		return true;
+	}
+	int w, h, channels;
+	unsigned char* data = stbi_load(path, &w, &h, &channels, 0);
+	if (data == NULL) return false;
+	// the decoded bytes go straight into level 0
+	texture_allocate(t, w, h, layout, TEXTURE_FORMAT_RGBA8);
+	for (int y = 0; y < h; y++)
+	{
+		for (int x = 0; x < w; x++)
+		{
+			const unsigned char* p = data + ((size_t)y * w + x) * channels;
+			IUINT32 r = p[0];
+			IUINT32 g = channels >= 3 ? p[1] : r;
+			IUINT32 b = channels >= 3 ? p[2] : r;
+			IUINT32 a = channels >= 4 ? p[3] : (channels == 2 ? p[1] : 0xff);
+			t->mip[0][texture_texel_index(t, 0, x, y)] = (a << 24) | (r << 16) | (g << 8) | b;
+		}
+	}
+	stbi_image_free(data);
+	texture_build_mips(t);
+	return true;
+}
+
+// the channel at shift of a TEXTURE_FORMAT_BC4X3 orm from the red channel of the linear channel, its
+// own BC4 blocks are written and the other channels are left as they are
+static void texture_pack_channel_bc(s_texture* orm, const s_texture* channel, int shift)
+{
+	if (orm->levels == 0)
+	{
+		// the other channels 0 like an empty orm of texture_pack_channel
+		texture_allocate(orm, channel->tex_width, channel->tex_height, TEXTURE_LAYOUT_BC, TEXTURE_FORMAT_BC4X3);
+		IUINT32 zeros[16] = { 0 }, block[2];
+		texture_bc_encode_channel(zeros, 16, block);
+		for (size_t i = 0; i < orm->bytes / sizeof(IUINT32); i += 2)
+		{
+			orm->block[i] = block[0];
+			orm->block[i + 1] = block[1];
+		}
+	}
+	int words = texture_bc_words(TEXTURE_FORMAT_BC4X3), at = (16 - shift) / 8 * 2;
+	for (int k = 0; k < orm->levels; k++)
+	{
+		int w = texture_level_width(orm, k), h = texture_level_height(orm, k);
+		for (int by = 0; by < (h + 3) / 4; by++)
+		{
+			for (int bx = 0; bx < orm->mip_pitch[k]; bx++)
+			{
+				IUINT32 texels[16];
+				for (int i = 0; i < 16; i++)
+					texels[i] = texture_texel(channel, k, std::min(bx * 4 + (i & 3), w - 1), std::min(by * 4 + (i >> 2), h - 1));
+				texture_bc_encode_channel(texels, 16, orm->mip[k] + ((size_t)by * orm->mip_pitch[k] + bx) * words + at);
+			}
+		}
+	}
+}
+
+void texture_pack_channel(s_texture* orm, const s_texture* src, int shift, int layout)
+{
+	int w = src->tex_width, h = src->tex_height;
+	int ow = orm->levels > 0 ? orm->tex_width : w;
+	int oh = orm->levels > 0 ? orm->tex_height : h;
+	if (layout == TEXTURE_LAYOUT_BC)
+	{
+		// resampled into the red channel of a linear texture with its mips, then into the blocks of its channel
+		std::vector<IUINT32> texels((size_t)ow * oh);
+		std::vector<IUINT32*> rows(oh);
+		for (int y = 0; y < oh; y++)
+		{
+			rows[y] = &texels[(size_t)y * ow];
+			int sy = std::min((int)((y + 0.5f) * h / oh), h - 1);
+			for (int x = 0; x < ow; x++)
+				rows[y][x] = 0xff000000u | (texture_texel(src, 0, std::min((int)((x + 0.5f) * w / ow), w - 1), sy) & 0xff0000u);
+		}
+		s_texture channel;
+		texture_init(&channel);
+		texture_store(&channel, &rows[0], ow, oh, TEXTURE_LAYOUT_LINEAR);
+		texture_pack_channel_bc(orm, &channel, shift);
+		texture_release(&channel);
+		return;
+	}
+	std::vector<IUINT32> texels((size_t)ow * oh);
+	std::vector<IUINT32*> rows(oh);
+	for (int y = 0; y < oh; y++)
+	{
+		rows[y] = &texels[(size_t)y * ow];
+		int sy = std::min((int)((y + 0.5f) * h / oh), h - 1);
+		for (int x = 0; x < ow; x++)
+		{
+			int sx = std::min((int)((x + 0.5f) * w / ow), w - 1);
+			IUINT32 c = orm->levels > 0 ? texture_texel(orm, 0, x, y) : 0xff000000u;
+			IUINT32 r = (texture_texel(src, 0, sx, sy) >> 16) & 0xff;
+			rows[y][x] = (c & ~(0xffu << shift)) | (r << shift);
+		}
+	}
+	texture_store(orm, &rows[0], ow, oh, layout);
+}
+
+// the unit vector of a normal map texel, straight up for one without a direction
+static void texture_normal_decode(IUINT32 c, float* n)
+{
+	n[0] = (float)((c >> 16) & 0xff) * (2.0f / 255.0f) - 1.0f;
+	n[1] = (float)((c >> 8) & 0xff) * (2.0f / 255.0f) - 1.0f;
+	n[2] = (float)(c & 0xff) * (2.0f / 255.0f) - 1.0f;
+	float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	if (length < 1e-6f)
+	{
+		n[0] = n[1] = 0.0f;
+		n[2] = 1.0f;
+		return;
+	}
+	for (int i = 0; i < 3; i++) n[i] /= length;
+}
+
+static IUINT32 texture_normal_encode(const float* n, IUINT32 alpha)
+{
+	IUINT32 c = alpha << 24;
+	for (int i = 0; i < 3; i++)
+	{
+		int b = (int)floorf(n[i] * 127.5f + 128.0f);
+		c |= (IUINT32)std::min(std::max(b, 0), 255) << (16 - i * 8);
+	}
+	return c;
+}
+
+void texture_store_normals(s_texture* t, const s_texture* src, int layout)
+{
+	if (layout == TEXTURE_LAYOUT_BC)
+	{
+		s_texture linear;
+		texture_init(&linear);
+		texture_store_normals(&linear, src, TEXTURE_LAYOUT_LINEAR);
+		texture_compress(t, &linear, TEXTURE_FORMAT_BC5);
+		texture_release(&linear);
+		t->normal = 1;
+		return;
+	}
+	texture_allocate(t, src->tex_width, src->tex_height, layout, TEXTURE_FORMAT_RGBA8);
+	for (int y = 0; y < t->tex_height; y++)
+	{
+		for (int x = 0; x < t->tex_width; x++)
+		{
+			IUINT32 c = texture_texel(src, 0, x, y);
+			float n[3];
+			texture_normal_decode(c, n);
+			t->mip[0][texture_texel_index(t, 0, x, y)] = texture_normal_encode(n, c >> 24);
+		}
+	}
+	// the mean of the 2x2 texels below is shorter than a unit vector where they bend, so it is normalized again
+	for (int k = 1; k < t->levels; k++)
+	{
+		int lw = texture_level_width(t, k), lh = texture_level_height(t, k);
+		int pw = texture_level_width(t, k - 1), ph = texture_level_height(t, k - 1);
+		for (int y = 0; y < lh; y++)
+		{
+			for (int x = 0; x < lw; x++)
+			{
+				int x0 = std::min(x * 2, pw - 1), x1 = std::min(x * 2 + 1, pw - 1);
+				int y0 = std::min(y * 2, ph - 1), y1 = std::min(y * 2 + 1, ph - 1);
+				IUINT32 c[4] = { texture_texel(t, k - 1, x0, y0), texture_texel(t, k - 1, x1, y0), texture_texel(t, k - 1, x0, y1), texture_texel(t, k - 1, x1, y1) };
+				IUINT32 sum = 0;
+				IUINT32 packed[4];
+				for (int i = 0; i < 4; i++) sum += c[i] >> 24;
+				// summed as bytes, the decode is affine so the mean of the bytes is the mean of the vectors
+				for (int i = 0; i < 3; i++)
+				{
+					int shift = 16 - i * 8;
+					packed[i] = ((c[0] >> shift) & 0xff) + ((c[1] >> shift) & 0xff) + ((c[2] >> shift) & 0xff) + ((c[3] >> shift) & 0xff);
+				}
+				float n[3];
+				float length = 0.0f;
+				for (int i = 0; i < 3; i++)
+				{
+					n[i] = (float)packed[i] * (0.5f / 255.0f) - 1.0f;
+					length += n[i] * n[i];
+				}
+				length = sqrtf(length);
+				if (length < 1e-6f)
+				{
+					n[0] = n[1] = 0.0f;
+					n[2] = 1.0f;
+				}
+				else for (int i = 0; i < 3; i++) n[i] /= length;
+				t->mip[k][texture_texel_index(t, k, x, y)] = texture_normal_encode(n, (sum + 2) / 4);
+			}
+		}
+	}
+	t->normal = 1;
+}
+
+std::string texture_orm_key(const char* ao, const char* roughness, const char* metallic)
+{
+	return std::string("orm|") + (ao ? ao : "") + '|' + (roughness ? roughness : "") + '|' + (metallic ? metallic : "");
+}
+
+texture_registry_t* texture_registry_create()
+{
+	texture_registry_t* registry = new texture_registry_t;
+	registry->loads = 0;
+	registry->hits = 0;
+	registry->mapped = 0;
+	registry->bytes = 0;
+	registry->quit = false;
+	registry->streamer = NULL;
+	return registry;
+}
+
+void texture_registry_destory(texture_registry_t* registry)
+{
+	if (registry == NULL) return;
+	{
+		std::unique_lock<std::mutex> guard(registry->lock);
+		registry->quit = true;
+	}
+	job_wait(job_system(), &registry->jobs);
+	texture_streamer_destory(registry->streamer);
+	std::map<std::string, s_texture*>::iterator it;
+	for (it = registry->textures.begin(); it != registry->textures.end(); ++it)
+	{
+		it->second->shared = 0;
+		texture_release(it->second);
+		delete it->second;
+	}
+	for (size_t i = 0; i < registry->retired.size(); i++)
+	{
+		registry->retired[i]->shared = 0;
+		texture_release(registry->retired[i]);
+		delete registry->retired[i];
+	}
+	for (size_t i = 0; i < registry->files.size(); i++)
+		texture_file_close(registry->files[i]);
+	delete registry;
+}
+
+static std::string texture_registry_key(const char* path, int layout)
+{
+	// one entry per file and layout
+	return std::string(path) + '#' + (char)('0' + layout);
+}
+
+bool texture_registry_mount(texture_registry_t* registry, const char* path)
+{
+	texture_file_t* file = texture_file_open(path);
+	if (file == NULL) return false;
+	registry->files.push_back(file);
+	return true;
+}
+
+// a new entry viewing the mapped texels of path, NULL when no mounted file has it
+static s_texture* texture_registry_map(texture_registry_t* registry, const std::string& key, const char* path, int layout)
+{
+	s_texture image;
+	for (size_t i = 0; i < registry->files.size(); i++)
+	{
+		if (!texture_file_find(registry->files[i], path, layout, &image)) continue;
+		s_texture* t = new s_texture(image);
+		registry->textures[key] = t;
+		registry->mapped++;
+		if (registry->streamer != NULL) texture_streamer_add(registry->streamer, t);
+		return t;
+	}
+	return NULL;
+}
+
+// decode into t, which is not in the map yet or still in registry->decoding
+static void texture_registry_decode(texture_registry_t* registry, s_texture* t, const std::string& path, int layout)
+{
+	bool ok = texture_load(t, path.c_str(), layout);
+	std::unique_lock<std::mutex> guard(registry->lock);
+	if (ok)
+	{
+		t->shared = 1;
+		registry->loads++;
+		registry->bytes += t->bytes;
+	}
+}
+
+// job of prefetch, data is a texture_job_t it owns
+static void texture_registry_job(void* data, int, int)
+{
+	texture_job_t* job = (texture_job_t*)data;
+	texture_registry_t* registry = job->registry;
+	bool quit;
+	{
+		std::unique_lock<std::mutex> guard(registry->lock);
+		quit = registry->quit;
+	}
+	if (!quit) texture_registry_decode(registry, job->texture, job->path, job->layout);
+	{
+		std::unique_lock<std::mutex> guard(registry->lock);
+		registry->decoding.erase(job->texture);
+	}
+	registry->done.notify_all();
+	delete job;
+}
+
+void texture_registry_prefetch(texture_registry_t* registry, const char* path, int layout)
+{
+	std::string key = texture_registry_key(path, layout);
+	if (registry->textures.count(key) || texture_registry_map(registry, key, path, layout)) return;
+	texture_job_t* job = new texture_job_t;
+	job->registry = registry;
+	job->path = path;
+	job->layout = layout;
+	job->texture = new s_texture;
+	texture_init(job->texture);
+	registry->textures[key] = job->texture;
+	{
+		std::unique_lock<std::mutex> guard(registry->lock);
+		registry->decoding.insert(job->texture);
+	}
+	job_submit(job_system(), texture_registry_job, job, 0, 1, &registry->jobs);
+}
+
+int texture_registry_pending(texture_registry_t* registry)
+{
+	std::unique_lock<std::mutex> guard(registry->lock);
+	return (int)registry->decoding.size();
+}
+
+void texture_registry_wait(texture_registry_t* registry)
+{
+	// decodes the queued files on this thread too
+	job_wait(job_system(), &registry->jobs);
+}
+
+// the entry of key, waited for when it is still decoding. NULL when there is none yet
+static s_texture* texture_registry_entry(texture_registry_t* registry, const std::string& key)
+{
+	std::map<std::string, s_texture*>::iterator it = registry->textures.find(key);
+	if (it == registry->textures.end()) return NULL;
+	s_texture* t = it->second;
+	std::unique_lock<std::mutex> guard(registry->lock);
+	registry->hits++;
+	// prefetched but not decoded yet, wait for this file only
+	registry->done.wait(guard, [&] { return registry->decoding.count(t) == 0; });
+	return t;
+}
+
+const s_texture* texture_registry_load(texture_registry_t* registry, const char* path, int layout)
+{
+	std::string key = texture_registry_key(path, layout);
+	s_texture* t = texture_registry_entry(registry, key);
+	if (t == NULL) t = texture_registry_map(registry, key, path, layout);
+	if (t == NULL)
+	{
+		// a failed file stays in the map empty, so it is only tried once
+		t = new s_texture;
+		texture_init(t);
+		registry->textures[key] = t;
+		texture_registry_decode(registry, t, path, layout);
+	}
+	return t->levels > 0 ? t : NULL;
+}
+
+const s_texture* texture_registry_reload(texture_registry_t* registry, const char* path, int layout)
+{
+	std::string key = texture_registry_key(path, layout);
+	s_texture* old = texture_registry_entry(registry, key);
+	if (old != NULL) registry->retired.push_back(old);
+	// the normal map made from the old texels is made again on its next bind
+	std::map<std::string, s_texture*>::iterator normals = registry->textures.find("normal|" + key);
+	if (normals != registry->textures.end())
+	{
+		registry->retired.push_back(normals->second);
+		registry->textures.erase(normals);
+	}
+	s_texture* t = new s_texture;
+	texture_init(t);
+	registry->textures[key] = t;
+	texture_registry_decode(registry, t, path, layout);
+	return t->levels > 0 ? t : NULL;
+}
+
+const s_texture* texture_registry_normals(texture_registry_t* registry, const char* path, int layout)
+{
+	std::string key = "normal|" + texture_registry_key(path, layout);
+	s_texture* t = texture_registry_entry(registry, key);
+	if (t != NULL) return t->levels > 0 ? t : NULL;
+	t = new s_texture;
+	texture_init(t);
+	registry->textures[key] = t;
+	s_texture linear;
+	texture_init(&linear);
+	// compressed normals are made from the decoded file, not from its compressed colours, and no colour entry is kept
+	const s_texture* src = layout == TEXTURE_LAYOUT_BC && texture_load(&linear, path, TEXTURE_LAYOUT_LINEAR) ? &linear : texture_registry_load(registry, path, layout);
+	if (src == NULL) return NULL;
+	texture_store_normals(t, src, layout);
+	texture_release(&linear);
+	t->shared = 1;
+	std::unique_lock<std::mutex> guard(registry->lock);
+	registry->bytes += t->bytes;
+	return t;
+}
+
+const s_texture* texture_registry_find(texture_registry_t* registry, const char* path, int layout)
+{
+	std::string key = texture_registry_key(path, layout);
+	s_texture* t = texture_registry_entry(registry, key);
+	if (t == NULL) t = texture_registry_map(registry, key, path, layout);
+	return t != NULL && t->levels > 0 ? t : NULL;
+}
+
+// bilinear lookup in level k, texel centers sit at u * (w - 1) like read_the_texture. texels are the
+// level, t->mip[k] or its resident copy
+static void texture_bilinear(float* rgba, const s_texture* t, int k, const IUINT32* texels, float u, float v)
+{
+	int w = texture_level_width(t, k), h = texture_level_height(t, k);
+	float fx = std::min(std::max(u * (float)(w - 1), 0.0f), (float)(w - 1));
+	float fy = std::min(std::max(v * (float)(h - 1), 0.0f), (float)(h - 1));
+	int x0 = (int)fx, y0 = (int)fy;
+	int x1 = std::min(x0 + 1, w - 1), y1 = std::min(y0 + 1, h - 1);
+	float tx = fx - (float)x0, ty = fy - (float)y0;
+	IUINT32 c00 = texture_level_texel(t, texels, k, x0, y0), c10 = texture_level_texel(t, texels, k, x1, y0);
+	IUINT32 c01 = texture_level_texel(t, texels, k, x0, y1), c11 = texture_level_texel(t, texels, k, x1, y1);
+	// r, g, b, a like read_the_texture
+	const int shifts[4] = { 16, 8, 0, 24 };
+	for (int i = 0; i < 4; i++)
+	{
+		int s = shifts[i];
+		if (t->srgb && i < 3)
+		{
+			// filter the decoded values, not the encoded bytes
+			float top = gamma_decode((c00 >> s) & 0xff) + (gamma_decode((c10 >> s) & 0xff) - gamma_decode((c00 >> s) & 0xff)) * tx;
+			float bottom = gamma_decode((c01 >> s) & 0xff) + (gamma_decode((c11 >> s) & 0xff) - gamma_decode((c01 >> s) & 0xff)) * tx;
+			rgba[i] = top + (bottom - top) * ty;
+			continue;
+		}
+		float top = (float)((c00 >> s) & 0xff) + ((float)((c10 >> s) & 0xff) - (float)((c00 >> s) & 0xff)) * tx;
+		float bottom = (float)((c01 >> s) & 0xff) + ((float)((c11 >> s) & 0xff) - (float)((c01 >> s) & 0xff)) * tx;
+		// the bytes of a normal map are filtered before they are unpacked, the unpack is affine
+		if (t->normal && i < 3) rgba[i] = (top + (bottom - top) * ty) * (2.0f / 255.0f) - 1.0f;
+		else rgba[i] = (top + (bottom - top) * ty) * (1.0f / 255.0f);
+	}
+}
+
+void texture_read(s_vector& tmp, const s_texture* t, float u, float v, const float* duv, int filter)
+{
+	if (filter == TEXTURE_FILTER_NEAREST && t->stream != NULL)
+	{
+		// the texel of read_the_texture in the finest resident level
+		int k = 0;
+		const IUINT32* texels = texture_stream_level(t->stream, k);
+		int w = texture_level_width(t, k), h = texture_level_height(t, k);
+		int x = CMID((int)(u * (float)(w - 1) + 0.5f), 0, w - 1);
+		int y = CMID((int)(v * (float)(h - 1) + 0.5f), 0, h - 1);
+		IUINT32 cc = texture_level_texel(t, texels, k, x, y);
+		if (t->normal)
+		{
+			tmp.x = (float)((cc >> 16) & 0xff) * (2.0f / 255.0f) - 1.0f;
+			tmp.y = (float)((cc >> 8) & 0xff) * (2.0f / 255.0f) - 1.0f;
+			tmp.z = (float)(cc & 0xff) * (2.0f / 255.0f) - 1.0f;
+		}
+		else if (t->srgb)
+		{
+			tmp.x = gamma_decode((cc >> 16) & 0xff);
+			tmp.y = gamma_decode((cc >> 8) & 0xff);
+			tmp.z = gamma_decode(cc & 0xff);
+		}
+		else
+		{
+			tmp.x = (float)((cc >> 16) & 0xff) / 255.0f;
+			tmp.y = (float)((cc >> 8) & 0xff) / 255.0f;
+			tmp.z = (float)(cc & 0xff) / 255.0f;
+		}
+		tmp.w = (float)((cc >> 24) & 0xff) / 255.0f;
+		return;
+	}
+	if (filter == TEXTURE_FILTER_NEAREST)
+	{
+		if (!t->srgb && !t->normal)
+		{
+			read_the_texture(tmp, t, u, v);
+			return;
+		}
+		// same texel as read_the_texture
+		int x = CMID((int)(u * t->max_u + 0.5f), 0, t->tex_width - 1);
+		int y = CMID((int)(v * t->max_v + 0.5f), 0, t->tex_height - 1);
+		IUINT32 cc = texture_texel(t, 0, x, y);
+		if (t->normal)
+		{
+			tmp.x = (float)((cc >> 16) & 0xff) * (2.0f / 255.0f) - 1.0f;
+			tmp.y = (float)((cc >> 8) & 0xff) * (2.0f / 255.0f) - 1.0f;
+			tmp.z = (float)(cc & 0xff) * (2.0f / 255.0f) - 1.0f;
+		}
+		else
+		{
+			tmp.x = gamma_decode((cc >> 16) & 0xff);
+			tmp.y = gamma_decode((cc >> 8) & 0xff);
+			tmp.z = gamma_decode(cc & 0xff);
+		}
+		tmp.w = (float)((cc >> 24) & 0xff) / 255.0f;
+		return;
+	}
+	float rgba[4];
+	float lod = 0.0f;
+	if (filter == TEXTURE_FILTER_TRILINEAR && t->levels > 1)
+	{
+		// footprint of one pixel in level 0 texels, the longer of the two screen axes
+		float ax = duv[0] * t->max_u, ay = duv[1] * t->max_v;
+		float bx = duv[2] * t->max_u, by = duv[3] * t->max_v;
+		float rho2 = std::max(ax * ax + ay * ay, bx * bx + by * by);
+		lod = rho2 > 1.0f ? 0.5f * log2f(rho2) : 0.0f;
+		lod = std::min(lod, (float)(t->levels - 1));
+	}
+	int k = (int)lod;
+	float f = lod - (float)k;
+	const IUINT32* texels = t->mip[k];
+	if (t->stream != NULL)
+	{
+		// a coarser level than the footprint asks for when the finer one is not resident yet
+		int level = k;
+		texels = texture_stream_level(t->stream, level);
+		if (level != k) f = 0.0f;
+		k = level;
+	}
+	texture_bilinear(rgba, t, k, texels, u, v);
+	if (f > 0.0f && k + 1 < t->levels)
+	{
+		float next[4];
+		int level = k + 1;
+		const IUINT32* coarser = t->stream != NULL ? texture_stream_level(t->stream, level) : t->mip[k + 1];
+		texture_bilinear(next, t, k + 1, coarser, u, v);
+		for (int i = 0; i < 4; i++) rgba[i] += (next[i] - rgba[i]) * f;
+	}
+	tmp.x = rgba[0]; tmp.y = rgba[1]; tmp.z = rgba[2]; tmp.w = rgba[3];
+}
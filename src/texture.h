@@ -0,0 +1,161 @@
+#ifndef texture_h
+#define texture_h
+//=====================================================================
+// storage, mip chains and filtered lookups for s_texture. every level
+// of a texture lives in one block, in the TEXTURE_LAYOUT_* picked when
+// it is stored, and the smaller levels are box filtered from level 0.
+// a TEXTURE_LAYOUT_BC texture is made linear first and its levels are
+// compressed after, in the block format its texels need.
+// texels are only reached through texture_texel. image files are
+// decoded once by the texture_registry_t of the device, in parallel
+// when they are prefetched, or mapped from a mounted texture file,
+// whose levels are streamed when the registry has a streamer.
+//=====================================================================
+#include "render.h"
+#include "texture_file.h"
+#include "job.h"
+#include "texture_stream.h"
+#include "texture_bc.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+// empty texture, for s_texture values that were never stored
+void texture_init(s_texture* t);
+
+// copy a w x h image into t with every mip level, freeing what t held before
+void texture_store(s_texture* t, IUINT32** rows, int w, int h, int layout);
+
+// t holds the texels of the normal map src as unit vectors, every mip level the normalized mean of the
+// one above, and texture_read returns the vector instead of the colour. t->normal is set
+void texture_store_normals(s_texture* t, const s_texture* src, int layout);
+
+// decode an image file straight into t, false when it can't be read
+bool texture_load(s_texture* t, const char* path, int layout);
+
+// copy the red channel of src into bits shift..shift + 7 of orm, resampled to the size orm
+// already has. an empty orm takes the size of src with the other channels 0 and alpha 255. in
+// TEXTURE_LAYOUT_BC orm is TEXTURE_FORMAT_BC4X3 and only the blocks of the channel are written
+void texture_pack_channel(s_texture* orm, const s_texture* src, int shift, int layout);
+
+// registry and texture file name of the ao / roughness / metallic texture packed from
+// the three files, any of them may be NULL
+std::string texture_orm_key(const char* ao, const char* roughness, const char* metallic);
+
+// IUINT32 words a w x h level occupies in layout and format, and its mip_pitch
+size_t texture_level_size(int layout, int format, int w, int h, int* pitch);
+
+// levels of the mip chain of a w x h texture, down to 1 x 1 or TEXTURE_MAX_LEVELS
+int texture_level_count(int w, int h);
+
+// frees the block unless it belongs to a texture_registry_t, then empties t
+void texture_release(s_texture* t);
+
+struct texture_registry_t;
+
+typedef struct
+{
+	texture_registry_t* registry;
+	std::string path;
+	int layout;
+	s_texture* texture;      // the map entry the job decodes into
+}texture_job_t;
+
+// every image file decoded so far, once per layout. material textures are
+// copies of the entries, so they share the entry's block. prefetched files
+// are decoded by jobs of the job system, the map itself is only used by one
+// thread at a time, the one that calls prefetch and load
+struct texture_registry_t
+{
+	std::map<std::string, s_texture*> textures;  // empty texture for a file that failed to load
+	int loads;               // files decoded
+	int hits;                // loads of a file that was already decoded or prefetched
+	int mapped;              // entries found in a mounted texture file
+	size_t bytes;            // texel memory of every decoded entry, all mip levels
+	std::vector<texture_file_t*> files; // mounted, searched before anything is decoded
+	std::vector<s_texture*> retired;    // entries replaced by reload, copies of them may still be bound
+	texture_streamer_t* streamer;       // streams the mapped entries, NULL when they are read straight from the files
+
+	job_counter_t jobs;      // the decode jobs of prefetch
+	std::set<const s_texture*> decoding; // queued or being decoded
+	std::mutex lock;
+	std::condition_variable done;
+	bool quit;               // the queued jobs skip their file
+};
+
+texture_registry_t* texture_registry_create();
+
+void texture_registry_destory(texture_registry_t* registry);
+
+// search the baked textures of a texture file before decoding, false when it can't be mapped
+bool texture_registry_mount(texture_registry_t* registry, const char* path);
+
+// queue path for decoding on the job system and return at once
+void texture_registry_prefetch(texture_registry_t* registry, const char* path, int layout);
+
+// prefetched files that are not decoded yet, for polling
+int texture_registry_pending(texture_registry_t* registry);
+
+void texture_registry_wait(texture_registry_t* registry);
+
+// the entry for path. decoded now on the first request, or waited for when it
+// was prefetched and is still decoding. NULL when the file can't be read
+const s_texture* texture_registry_load(texture_registry_t* registry, const char* path, int layout);
+
+// decode path again for a file that changed on disk, the mounted files are not searched. the entry
+// it replaces is kept until the registry is destroyed. NULL when the file can't be read
+const s_texture* texture_registry_reload(texture_registry_t* registry, const char* path, int layout);
+
+// the normal map of path made by texture_store_normals from the entry of texture_registry_load, made once
+// and kept with the entries. NULL when the file can't be read
+const s_texture* texture_registry_normals(texture_registry_t* registry, const char* path, int layout);
+
+// like texture_registry_load but never decodes, for names that are only in texture files
+const s_texture* texture_registry_find(texture_registry_t* registry, const char* path, int layout);
+
+// morton code of the low bits of v, spread to the even bit positions
+inline unsigned texture_spread_bits(unsigned v)
+{
+	v = (v | (v << 8)) & 0x00FF00FFu;
+	v = (v | (v << 4)) & 0x0F0F0F0Fu;
+	v = (v | (v << 2)) & 0x33333333u;
+	v = (v | (v << 1)) & 0x55555555u;
+	return v;
+}
+
+// offset of texel (x, y) in mip[k], x and y must be inside the level. not for TEXTURE_LAYOUT_BC
+inline unsigned texture_texel_index(const s_texture* t, int k, int x, int y)
+{
+	unsigned pitch = (unsigned)t->mip_pitch[k];
+	if (t->layout == TEXTURE_LAYOUT_TILED4)
+		return ((y >> 2) * pitch + (x >> 2)) * 16 + (y & 3) * 4 + (x & 3);
+	if (t->layout == TEXTURE_LAYOUT_MORTON)
+	{
+		// pitch is the number of interleaved bits, the longer side keeps its high bits on top
+		unsigned low = (1u << pitch) - 1u;
+		return texture_spread_bits((unsigned)x & low) | (texture_spread_bits((unsigned)y & low) << 1)
+			| ((((unsigned)x >> pitch) | ((unsigned)y >> pitch)) << (pitch * 2));
+	}
+	return y * pitch + x;
+}
+
+// texel (x, y) of level k, whose texels are level: t->mip[k] or its resident copy
+inline IUINT32 texture_level_texel(const s_texture* t, const IUINT32* level, int k, int x, int y)
+{
+	if (t->layout == TEXTURE_LAYOUT_BC) return texture_bc_texel(t, level, k, x, y);
+	return level[texture_texel_index(t, k, x, y)];
+}
+
+inline IUINT32 texture_texel(const s_texture* t, int k, int x, int y)
+{
+	return texture_level_texel(t, t->mip[k], k, x, y);
+}
+
+// read_the_texture with a filter, rgb decoded to linear when t->srgb and to the filtered vector when t->normal. duv is du/dx, dv/dx, du/dy, dv/dy and only read by
+// TEXTURE_FILTER_TRILINEAR, TEXTURE_FILTER_NEAREST reads the same texel as read_the_texture
+void texture_read(s_vector& tmp, const s_texture* t, float u, float v, const float* duv, int filter);
+
+#endif
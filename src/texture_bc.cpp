@@ -0,0 +1,252 @@
+#include "texture_bc.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+int texture_bc_pick(const IUINT32* texels, size_t count)
+{
+	bool grey = true;
+	for (size_t i = 0; i < count; i++)
+	{
+		IUINT32 c = texels[i];
+		if ((c >> 24) != 0xff) return TEXTURE_FORMAT_BC3;
+		if (((c >> 16) & 0xff) != (c & 0xff) || ((c >> 8) & 0xff) != (c & 0xff)) grey = false;
+	}
+	return grey ? TEXTURE_FORMAT_BC4 : TEXTURE_FORMAT_BC1;
+}
+
+static inline int bc_channel(IUINT32 c, int shift) { return (int)((c >> shift) & 0xff); }
+
+static inline unsigned bc_pack565(int r, int g, int b)
+{
+	return (unsigned)(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+
+// the 8 bit channels of a 565 colour
+static inline void bc_unpack565(unsigned c, int* rgb)
+{
+	int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+// the 4 colours of a BC1 block with ends c0 > c1, or 3 and transparent black when three
+static void bc1_palette(unsigned c0, unsigned c1, bool three, IUINT32* palette)
+{
+	int a[3], b[3];
+	bc_unpack565(c0, a);
+	bc_unpack565(c1, b);
+	int p[4][3];
+	for (int i = 0; i < 3; i++)
+	{
+		p[0][i] = a[i];
+		p[1][i] = b[i];
+		p[2][i] = three ? (a[i] + b[i]) / 2 : (2 * a[i] + b[i]) / 3;
+		p[3][i] = three ? 0 : (a[i] + 2 * b[i]) / 3;
+	}
+	for (int k = 0; k < 4; k++)
+		palette[k] = (three && k == 3 ? 0u : 0xffu << 24) | (IUINT32)p[k][0] << 16 | (IUINT32)p[k][1] << 8 | (IUINT32)p[k][2];
+}
+
+// colour of 16 texels into the 8 bytes at out, always with 4 colours
+static void bc1_encode(const IUINT32* texels, unsigned char* out)
+{
+	int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			int v = bc_channel(texels[i], 16 - c * 8);
+			lo[c] = std::min(lo[c], v);
+			hi[c] = std::max(hi[c], v);
+		}
+	}
+	// the ends moved in by a sixteenth of the box, the texels on its corners are rare
+	for (int c = 0; c < 3; c++)
+	{
+		int inset = (hi[c] - lo[c]) / 16;
+		lo[c] += inset;
+		hi[c] -= inset;
+	}
+	unsigned c0 = bc_pack565(hi[0], hi[1], hi[2]), c1 = bc_pack565(lo[0], lo[1], lo[2]);
+	if (c0 < c1) std::swap(c0, c1);
+	unsigned indices = 0;
+	if (c0 != c1)
+	{
+		IUINT32 palette[4];
+		bc1_palette(c0, c1, false, palette);
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0, best_d = 0x7fffffff;
+			for (int k = 0; k < 4; k++)
+			{
+				int d = 0;
+				for (int c = 16; c >= 0; c -= 8)
+				{
+					int e = bc_channel(texels[i], c) - bc_channel(palette[k], c);
+					d += e * e;
+				}
+				if (d < best_d)
+				{
+					best_d = d;
+					best = k;
+				}
+			}
+			indices |= (unsigned)best << (i * 2);
+		}
+	}
+	out[0] = (unsigned char)(c0 & 0xff);
+	out[1] = (unsigned char)(c0 >> 8);
+	out[2] = (unsigned char)(c1 & 0xff);
+	out[3] = (unsigned char)(c1 >> 8);
+	for (int i = 0; i < 4; i++) out[4 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+// the colour of 16 texels from the 8 bytes at in, alpha from a BC1 block of 3 colours or 255
+static void bc1_decode(const unsigned char* in, bool four, IUINT32* texels)
+{
+	unsigned c0 = in[0] | (unsigned)in[1] << 8, c1 = in[2] | (unsigned)in[3] << 8;
+	IUINT32 palette[4];
+	bc1_palette(c0, c1, !four && c0 <= c1, palette);
+	unsigned indices = in[4] | (unsigned)in[5] << 8 | (unsigned)in[6] << 16 | (unsigned)in[7] << 24;
+	for (int i = 0; i < 16; i++) texels[i] = palette[(indices >> (i * 2)) & 3];
+}
+
+// the 8 values of a BC4 block with ends a0 > a1
+static void bc4_palette(int a0, int a1, int* palette)
+{
+	palette[0] = a0;
+	palette[1] = a1;
+	for (int i = 1; i < 7; i++) palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+}
+
+// the channel at shift of 16 texels into the 8 bytes at out, always with 8 values
+static void bc4_encode(const IUINT32* texels, int shift, unsigned char* out)
+{
+	int lo = 255, hi = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		lo = std::min(lo, bc_channel(texels[i], shift));
+		hi = std::max(hi, bc_channel(texels[i], shift));
+	}
+	unsigned long long indices = 0;
+	if (hi != lo)
+	{
+		int palette[8];
+		bc4_palette(hi, lo, palette);
+		for (int i = 0; i < 16; i++)
+		{
+			int v = bc_channel(texels[i], shift), best = 0;
+			for (int k = 1; k < 8; k++)
+				if (abs(palette[k] - v) < abs(palette[best] - v)) best = k;
+			indices |= (unsigned long long)best << (i * 3);
+		}
+	}
+	out[0] = (unsigned char)hi;
+	out[1] = (unsigned char)lo;
+	for (int i = 0; i < 6; i++) out[2 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+// the 16 values of the 8 bytes at in
+static void bc4_decode(const unsigned char* in, int* values)
+{
+	int a0 = in[0], a1 = in[1];
+	int palette[8];
+	if (a0 > a1) bc4_palette(a0, a1, palette);
+	else
+	{
+		// 6 values between the ends, then 0 and 255
+		palette[0] = a0;
+		palette[1] = a1;
+		for (int i = 1; i < 5; i++) palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+	unsigned long long indices = 0;
+	for (int i = 0; i < 6; i++) indices |= (unsigned long long)in[2 + i] << (i * 8);
+	for (int i = 0; i < 16; i++) values[i] = palette[(indices >> (i * 3)) & 7];
+}
+
+void texture_bc_encode(int format, const IUINT32* texels, IUINT32* block)
+{
+	unsigned char* out = (unsigned char*)block;
+	switch (format)
+	{
+	case TEXTURE_FORMAT_BC1: bc1_encode(texels, out); break;
+	case TEXTURE_FORMAT_BC3:
+		bc4_encode(texels, 24, out);
+		bc1_encode(texels, out + 8);
+		break;
+	case TEXTURE_FORMAT_BC4: bc4_encode(texels, 16, out); break;
+	case TEXTURE_FORMAT_BC5:
+		bc4_encode(texels, 16, out);
+		bc4_encode(texels, 8, out + 8);
+		break;
+	case TEXTURE_FORMAT_BC4X3:
+		for (int c = 0; c < 3; c++) bc4_encode(texels, 16 - c * 8, out + c * 8);
+		break;
+	}
+}
+
+void texture_bc_encode_channel(const IUINT32* texels, int shift, IUINT32* block)
+{
+	bc4_encode(texels, shift, (unsigned char*)block);
+}
+
+void texture_bc_decode(int format, const IUINT32* block, IUINT32* texels)
+{
+	const unsigned char* in = (const unsigned char*)block;
+	int a[16], b[16];
+	switch (format)
+	{
+	case TEXTURE_FORMAT_BC1: bc1_decode(in, false, texels); break;
+	case TEXTURE_FORMAT_BC3:
+		bc1_decode(in + 8, true, texels);
+		bc4_decode(in, a);
+		for (int i = 0; i < 16; i++) texels[i] = (texels[i] & 0xffffffu) | (IUINT32)a[i] << 24;
+		break;
+	case TEXTURE_FORMAT_BC4:
+		bc4_decode(in, a);
+		for (int i = 0; i < 16; i++) texels[i] = 0xffu << 24 | (IUINT32)a[i] << 16 | (IUINT32)a[i] << 8 | (IUINT32)a[i];
+		break;
+	case TEXTURE_FORMAT_BC5:
+		bc4_decode(in, a);
+		bc4_decode(in + 8, b);
+		for (int i = 0; i < 16; i++)
+		{
+			// the unit vector's z is the positive root, encoded like texture_store_normals
+			float x = (float)a[i] * (2.0f / 255.0f) - 1.0f, y = (float)b[i] * (2.0f / 255.0f) - 1.0f;
+			float z = sqrtf(std::max(1.0f - x * x - y * y, 0.0f));
+			int c = std::min(std::max((int)floorf(z * 127.5f + 128.0f), 0), 255);
+			texels[i] = 0xffu << 24 | (IUINT32)a[i] << 16 | (IUINT32)b[i] << 8 | (IUINT32)c;
+		}
+		break;
+	}
+}
+
+typedef struct
+{
+	int format;              // TEXTURE_FORMAT_RGBA8 for an empty entry
+	IUINT32 block[TEXTURE_BC_WORDS_MAX];
+	IUINT32 texels[16];
+}texture_bc_cached_t;
+
+// keyed by the bytes of the block and not its address, so a freed level can't leave stale texels behind
+static thread_local texture_bc_cached_t texture_bc_cache[TEXTURE_BC_CACHE];
+
+IUINT32 texture_bc_texel(const s_texture* t, const IUINT32* level, int k, int x, int y)
+{
+	int words = texture_bc_words(t->format);
+	const IUINT32* block = level + ((size_t)(y >> 2) * t->mip_pitch[k] + (x >> 2)) * words;
+	IUINT32 hash = 0;
+	for (int i = 0; i < words; i++) hash = hash * 0x9E3779B1u ^ block[i];
+	texture_bc_cached_t& cached = texture_bc_cache[(hash ^ (hash >> 16) ^ (IUINT32)t->format) % TEXTURE_BC_CACHE];
+	if (cached.format != t->format || memcmp(cached.block, block, words * sizeof(IUINT32)) != 0)
+	{
+		texture_bc_decode(t->format, block, cached.texels);
+		memcpy(cached.block, block, words * sizeof(IUINT32));
+		cached.format = t->format;
+	}
+	return cached.texels[(y & 3) * 4 + (x & 3)];
+}
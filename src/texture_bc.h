@@ -0,0 +1,47 @@
+#ifndef texture_bc_h
+#define texture_bc_h
+//=====================================================================
+// block compressed texels of TEXTURE_LAYOUT_BC. every 4x4 texels of a
+// level are one block of 8 or 16 bytes in the TEXTURE_FORMAT_* of the
+// texture, row after row of blocks like TEXTURE_LAYOUT_TILED4:
+//   BC1  two rgb565 ends and 2 bit indices, opaque colour
+//   BC3  a BC4 block of alpha, then a BC1 block of colour
+//   BC4  two 8 bit ends and 3 bit indices of one grey channel
+//   BC5  two BC4 blocks, x and y of a normal map, z rebuilt from them
+//   BC4X3  three BC4 blocks of red, green and blue, the independent
+//        channels of an orm texture, each written on its own
+// the encoder takes the bounding box of the block's colours as the
+// ends, fast enough for load time. a texel is fetched by decoding its
+// whole block, so every thread keeps the last decoded blocks by their
+// bytes: the four texels of a bilinear lookup mostly share one block.
+//=====================================================================
+#include "render.h"
+#include <cstddef>
+
+#define TEXTURE_BC_CACHE 16      // decoded blocks per thread
+
+#define TEXTURE_BC_WORDS_MAX 6  // of a TEXTURE_FORMAT_BC4X3 block
+
+// IUINT32 words of a block of format
+inline int texture_bc_words(int format)
+{
+	if (format == TEXTURE_FORMAT_BC4X3) return 6;
+	return format == TEXTURE_FORMAT_BC3 || format == TEXTURE_FORMAT_BC5 ? 4 : 2;
+}
+
+// the smallest format that holds count texels without losing a channel: BC4 for grey, BC1 for opaque, else BC3
+int texture_bc_pick(const IUINT32* texels, size_t count);
+
+// compress the 4x4 texels of a block, row after row, into block
+void texture_bc_encode(int format, const IUINT32* texels, IUINT32* block);
+
+// the channel at shift of the 4x4 texels of a block as a BC4 block into the 2 words at block
+void texture_bc_encode_channel(const IUINT32* texels, int shift, IUINT32* block);
+
+// the 16 texels of block, row after row
+void texture_bc_decode(int format, const IUINT32* block, IUINT32* texels);
+
+// texel (x, y) of level k of t, whose texels are level: t->mip[k] or its resident copy
+IUINT32 texture_bc_texel(const s_texture* t, const IUINT32* level, int k, int x, int y);
+
+#endif
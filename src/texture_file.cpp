@@ -0,0 +1,152 @@
+#include "texture_file.h"
+#include "texture.h"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+static unsigned long long texture_file_align(unsigned long long offset)
+{
+	return (offset + TEXTURE_FILE_ALIGN - 1) / TEXTURE_FILE_ALIGN * TEXTURE_FILE_ALIGN;
+}
+
+bool texture_file_write(const char* path, const char* const* paths, const s_texture* const* textures, int count)
+{
+	texture_file_header_t header;
+	memset(&header, 0, sizeof(header));
+	header.magic = TEXTURE_FILE_MAGIC;
+	header.version = TEXTURE_FILE_VERSION;
+	header.entry_size = sizeof(texture_file_entry_t);
+	header.entry_count = count;
+	std::vector<texture_file_entry_t> entries(count);
+	unsigned long long offset = sizeof(header) + (unsigned long long)count * sizeof(texture_file_entry_t);
+	for (int i = 0; i < count; i++)
+	{
+		const s_texture* t = textures[i];
+		texture_file_entry_t* e = &entries[i];
+		memset(e, 0, sizeof(texture_file_entry_t));
+		if (strlen(paths[i]) >= TEXTURE_FILE_PATH_MAX) return false;
+		strcpy(e->path, paths[i]);
+		e->width = t->tex_width;
+		e->height = t->tex_height;
+		e->layout = t->layout;
+		e->format = t->format;
+		e->levels = t->levels;
+		for (int k = 0; k < t->levels; k++)
+		{
+			e->mip_pitch[k] = t->mip_pitch[k];
+			e->mip_offset[k] = (unsigned long long)(t->mip[k] - t->mip[0]);
+		}
+		e->offset = texture_file_align(offset);
+		e->bytes = t->bytes;
+		offset = e->offset + e->bytes;
+	}
+
+	FILE* fp = fopen(path, "wb");
+	if (fp == NULL) return false;
+	static const char zeros[TEXTURE_FILE_ALIGN] = { 0 };
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	if (ok && count > 0) ok = fwrite(&entries[0], sizeof(texture_file_entry_t), count, fp) == (size_t)count;
+	unsigned long long at = sizeof(header) + (unsigned long long)count * sizeof(texture_file_entry_t);
+	for (int i = 0; ok && i < count; i++)
+	{
+		size_t pad = (size_t)(entries[i].offset - at);
+		ok = fwrite(zeros, 1, pad, fp) == pad && fwrite(textures[i]->mip[0], 1, textures[i]->bytes, fp) == textures[i]->bytes;
+		at = entries[i].offset + entries[i].bytes;
+	}
+	if (fclose(fp) != 0) ok = false;
+	return ok;
+}
+
+// the format fits the layout and the levels are where and as large as texture_allocate puts them
+static bool texture_file_check_entry(const texture_file_entry_t* e)
+{
+	if (e->width < 1 || e->height < 1 || e->width > TEXTURE_FILE_SIZE_MAX || e->height > TEXTURE_FILE_SIZE_MAX) return false;
+	if (e->layout == TEXTURE_LAYOUT_BC)
+	{
+		if (e->format < TEXTURE_FORMAT_BC1 || e->format > TEXTURE_FORMAT_BC4X3) return false;
+	}
+	else if (e->layout < TEXTURE_LAYOUT_LINEAR || e->layout > TEXTURE_LAYOUT_MORTON || e->format != TEXTURE_FORMAT_RGBA8) return false;
+	if (e->levels != texture_level_count(e->width, e->height)) return false;
+	unsigned long long words = 0;
+	for (int k = 0; k < e->levels; k++)
+	{
+		int pitch = 0;
+		size_t size = texture_level_size(e->layout, e->format, std::max(1, e->width >> k), std::max(1, e->height >> k), &pitch);
+		if (e->mip_offset[k] != words || e->mip_pitch[k] != pitch) return false;
+		words += size;
+	}
+	return e->bytes == words * sizeof(IUINT32);
+}
+
+static bool texture_file_check(const texture_file_t* file)
+{
+	size_t size = file->map.size;
+	const texture_file_header_t* header = file->header;
+	if (size < sizeof(texture_file_header_t) || header->magic != TEXTURE_FILE_MAGIC || header->version != TEXTURE_FILE_VERSION
+		|| header->entry_size != sizeof(texture_file_entry_t) || header->entry_count < 0)
+		return false;
+	if (size < sizeof(texture_file_header_t) + (size_t)header->entry_count * sizeof(texture_file_entry_t)) return false;
+	for (int i = 0; i < header->entry_count; i++)
+	{
+		const texture_file_entry_t* e = &file->entries[i];
+		if (!texture_file_check_entry(e) || e->offset % TEXTURE_FILE_ALIGN != 0 || e->offset > size || e->bytes > size - e->offset) return false;
+		if (memchr(e->path, 0, TEXTURE_FILE_PATH_MAX) == NULL) return false;
+	}
+	return true;
+}
+
+texture_file_t* texture_file_open(const char* path)
+{
+	texture_file_t* file = new texture_file_t;
+	memset(file, 0, sizeof(texture_file_t));
+	if (!file_map_open(&file->map, path))
+	{
+		delete file;
+		return NULL;
+	}
+	file->header = (const texture_file_header_t*)file->map.data;
+	file->entries = (const texture_file_entry_t*)(file->header + 1);
+	if (!texture_file_check(file))
+	{
+		printf("%s is not a texture file of this build, bake it again\n", path);
+		texture_file_close(file);
+		return NULL;
+	}
+	return file;
+}
+
+void texture_file_close(texture_file_t* file)
+{
+	if (file == NULL) return;
+	file_map_close(&file->map);
+	delete file;
+}
+
+bool texture_file_find(const texture_file_t* file, const char* path, int layout, s_texture* t)
+{
+	for (int i = 0; i < file->header->entry_count; i++)
+	{
+		const texture_file_entry_t* e = &file->entries[i];
+		if (e->layout != layout || strcmp(e->path, path) != 0) continue;
+		texture_init(t);
+		t->tex_width = e->width;
+		t->tex_height = e->height;
+		t->max_u = (float)(e->width - 1);
+		t->max_v = (float)(e->height - 1);
+		t->layout = e->layout;
+		t->format = e->format;
+		t->levels = e->levels;
+		// the block is only read, the mapping is read only
+		IUINT32* block = (IUINT32*)((const char*)file->map.data + e->offset);
+		for (int k = 0; k < e->levels; k++)
+		{
+			t->mip[k] = block + e->mip_offset[k];
+			t->mip_pitch[k] = e->mip_pitch[k];
+		}
+		t->bytes = (size_t)e->bytes;
+		t->shared = 1;
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,58 @@
+#ifndef texture_file_h
+#define texture_file_h
+//=====================================================================
+// baked textures: decoded images with their whole mip chain, already
+// in a TEXTURE_LAYOUT_*, written by the texture baker tool. a mounted
+// file is mapped and its entries are s_texture views of the mapping,
+// so nothing is decoded or copied at run time.
+//=====================================================================
+#include "render.h"
+#include "file_map.h"
+
+#define TEXTURE_FILE_MAGIC    0x50584554   // "TEXP"
+#define TEXTURE_FILE_VERSION  2
+#define TEXTURE_FILE_ALIGN    64           // every texel block starts on a cache line
+#define TEXTURE_FILE_PATH_MAX 256
+#define TEXTURE_FILE_SIZE_MAX 65536        // width and height of an entry
+
+typedef struct
+{
+	unsigned magic;
+	unsigned version;
+	unsigned entry_size;     // sizeof(texture_file_entry_t) of the build that wrote it
+	int entry_count;
+}texture_file_header_t;
+
+typedef struct
+{
+	char path[TEXTURE_FILE_PATH_MAX]; // the path init_texture_by_* is called with, or a texture_orm_key
+	int width, height;
+	int layout, levels;
+	int format;                       // TEXTURE_FORMAT_* of the texels
+	int mip_pitch[TEXTURE_MAX_LEVELS];
+	unsigned long long offset;        // of the texel block from the start of the file
+	unsigned long long bytes;
+	unsigned long long mip_offset[TEXTURE_MAX_LEVELS]; // texels from the start of the block
+}texture_file_entry_t;
+// the header is followed by texture_file_entry_t[entry_count], then the blocks
+
+typedef struct
+{
+	const texture_file_header_t* header;
+	const texture_file_entry_t* entries;
+	file_map_t map;
+}texture_file_t;
+
+// write count stored textures, paths[i] is the name texture_file_find looks for
+bool texture_file_write(const char* path, const char* const* paths, const s_texture* const* textures, int count);
+
+// map a baked texture file, NULL when it is missing, truncated or from another version
+texture_file_t* texture_file_open(const char* path);
+
+void texture_file_close(texture_file_t* file);
+
+// point t at the mapped texels of the entry for path in layout, false when the file has none.
+// t is shared and must not be written
+bool texture_file_find(const texture_file_t* file, const char* path, int layout, s_texture* t);
+
+#endif
@@ -0,0 +1,156 @@
+#include "texture_stream.h"
+#include "memory_track.h"
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+texture_streamer_t* texture_streamer_create(size_t budget)
+{
+	texture_streamer_t* streamer = new texture_streamer_t;
+	streamer->budget = budget;
+	streamer->resident = 0;
+	streamer->frame = 0;
+	streamer->loads = 0;
+	memset(&streamer->stats, 0, sizeof(streamer->stats));
+	return streamer;
+}
+
+void texture_streamer_destory(texture_streamer_t* streamer)
+{
+	if (streamer == NULL) return;
+	texture_streamer_wait(streamer);
+	for (size_t i = 0; i < streamer->streams.size(); i++)
+	{
+		texture_stream_t* stream = streamer->streams[i];
+		for (int k = 0; k < stream->levels; k++) memory_free((void*)stream->level[k].load());
+		delete stream;
+	}
+	delete streamer;
+}
+
+// copy level k out of the file and publish it, the levels after it are resident already
+static void texture_stream_copy(texture_stream_t* stream, int k)
+{
+	IUINT32* copy = (IUINT32*)memory_alloc(MEMORY_TEXTURES, stream->level_bytes[k], 0);
+	memcpy(copy, stream->mapped[k], stream->level_bytes[k]);
+	stream->level[k].store(copy, std::memory_order_relaxed);
+	stream->resident.store(k, std::memory_order_release);
+}
+
+void texture_streamer_add(texture_streamer_t* streamer, s_texture* t)
+{
+	texture_stream_t* stream = new texture_stream_t;
+	stream->streamer = streamer;
+	stream->levels = t->levels;
+	// the levels follow each other in the block, the last one ends with it
+	const IUINT32* end = t->mip[0] + t->bytes / sizeof(IUINT32);
+	stream->tail = 0;
+	for (int k = 0; k < TEXTURE_MAX_LEVELS; k++)
+	{
+		stream->mapped[k] = k < t->levels ? t->mip[k] : NULL;
+		stream->level_bytes[k] = k < t->levels ? (size_t)((k + 1 < t->levels ? t->mip[k + 1] : end) - t->mip[k]) * sizeof(IUINT32) : 0;
+		stream->level[k].store(NULL);
+		stream->used[k] = 0;
+		if (k < t->levels && std::max(t->tex_width >> k, t->tex_height >> k) > TEXTURE_STREAM_TAIL) stream->tail = k + 1;
+	}
+	stream->tail = std::min(stream->tail, t->levels - 1);
+	stream->resident.store(t->levels);
+	stream->wanted.store(t->levels);
+	stream->loading.store(0);
+	stream->target = stream->tail;
+	for (int k = t->levels - 1; k >= stream->tail; k--)
+	{
+		texture_stream_copy(stream, k);
+		streamer->resident += stream->level_bytes[k];
+	}
+	streamer->streams.push_back(stream);
+	streamer->stats.streams++;
+	t->stream = stream;
+}
+
+// job of update, data is the stream, copies its levels from resident - 1 down to target
+static void texture_stream_load(void* data, int, int)
+{
+	texture_stream_t* stream = (texture_stream_t*)data;
+	for (int k = stream->resident.load(std::memory_order_relaxed) - 1; k >= stream->target; k--)
+	{
+		texture_stream_copy(stream, k);
+		stream->streamer->loads++;
+	}
+	stream->loading.store(0, std::memory_order_release);
+}
+
+// free the finest level of the stream whose finest level was sampled the longest time ago, never one
+// sampled after frame `keep` or of a stream that is loading. false when there is none
+static bool texture_streamer_evict(texture_streamer_t* streamer, unsigned long long keep)
+{
+	texture_stream_t* victim = NULL;
+	for (size_t i = 0; i < streamer->streams.size(); i++)
+	{
+		texture_stream_t* stream = streamer->streams[i];
+		int k = stream->resident.load(std::memory_order_relaxed);
+		if (k >= stream->tail || stream->loading.load(std::memory_order_acquire) || stream->used[k] >= keep) continue;
+		if (victim == NULL || stream->used[k] < victim->used[victim->resident.load(std::memory_order_relaxed)]) victim = stream;
+	}
+	if (victim == NULL) return false;
+	int k = victim->resident.load(std::memory_order_relaxed);
+	victim->resident.store(k + 1, std::memory_order_relaxed);
+	memory_free((void*)victim->level[k].load(std::memory_order_relaxed));
+	victim->level[k].store(NULL, std::memory_order_relaxed);
+	streamer->resident -= victim->level_bytes[k];
+	streamer->stats.evictions++;
+	return true;
+}
+
+void texture_streamer_update(texture_streamer_t* streamer)
+{
+	unsigned long long frame = ++streamer->frame;
+	// the feedback of the last frame, every level from the finest sampled one on was used
+	std::vector<texture_stream_t*> wanted;
+	for (size_t i = 0; i < streamer->streams.size(); i++)
+	{
+		texture_stream_t* stream = streamer->streams[i];
+		int k = stream->wanted.exchange(stream->levels, std::memory_order_relaxed);
+		if (k >= stream->levels) continue;
+		for (int j = k; j < stream->levels; j++) stream->used[j] = frame;
+		if (k < stream->resident.load(std::memory_order_relaxed) && !stream->loading.load(std::memory_order_acquire))
+		{
+			stream->target = k;
+			wanted.push_back(stream);
+		}
+	}
+	// the finest requests go last, they are the first to lose when the budget runs out
+	std::sort(wanted.begin(), wanted.end(), [](const texture_stream_t* a, const texture_stream_t* b) { return a->target > b->target; });
+	for (size_t i = 0; i < wanted.size(); i++)
+	{
+		texture_stream_t* stream = wanted[i];
+		int resident = stream->resident.load(std::memory_order_relaxed);
+		size_t need = 0;
+		int target = resident;
+		for (int k = resident - 1; k >= stream->target; k--)
+		{
+			while (streamer->resident + need + stream->level_bytes[k] > streamer->budget && texture_streamer_evict(streamer, frame)) {}
+			if (streamer->resident + need + stream->level_bytes[k] > streamer->budget) break;
+			need += stream->level_bytes[k];
+			target = k;
+		}
+		if (target > stream->target) streamer->stats.misses++;
+		if (target == resident) continue;
+		stream->target = target;
+		streamer->resident += need;
+		stream->loading.store(1, std::memory_order_relaxed);
+		job_submit(job_system(), texture_stream_load, stream, 0, 1, &streamer->jobs);
+	}
+}
+
+void texture_streamer_wait(texture_streamer_t* streamer)
+{
+	job_wait(job_system(), &streamer->jobs);
+}
+
+texture_stream_stats_t texture_streamer_stats(texture_streamer_t* streamer)
+{
+	texture_stream_stats_t stats = streamer->stats;
+	stats.loads = streamer->loads.load();
+	return stats;
+}
@@ -0,0 +1,87 @@
+#ifndef texture_stream_h
+#define texture_stream_h
+//=====================================================================
+// texture streaming: the textures mapped from a mounted texture file
+// keep only the mip levels the frames sample in memory, under a budget.
+// texture_read records the finest level every streamed texture was
+// asked for and samples the finest one that is resident instead when
+// that is coarser. once a frame the update copies the missing levels
+// out of the mapped file on the job system, finest last, and frees the
+// levels that were sampled the longest time ago when the copies don't
+// fit the budget. the small levels of the tail always stay, so every
+// texture can be sampled from the moment it is mapped.
+//=====================================================================
+#include "render.h"
+#include "job.h"
+#include <vector>
+#include <atomic>
+
+#define TEXTURE_STREAM_TAIL 64   // levels of at most this many texels per side are never freed
+
+struct texture_streamer_t;
+
+struct texture_stream_t
+{
+	texture_streamer_t* streamer;
+	const IUINT32* mapped[TEXTURE_MAX_LEVELS];   // the levels in the texture file
+	size_t level_bytes[TEXTURE_MAX_LEVELS];
+	std::atomic<const IUINT32*> level[TEXTURE_MAX_LEVELS]; // the copy texture_read samples, NULL when not resident
+	int levels;
+	int tail;                                    // first level of the tail
+	std::atomic<int> resident;                   // finest resident level, every coarser one is resident too
+	std::atomic<int> wanted;                     // finest level sampled since the last update, levels when none
+	unsigned long long used[TEXTURE_MAX_LEVELS]; // update of the last frame that sampled the level or a finer one
+	std::atomic<int> loading;                    // a load job is queued or running
+	int target;                                  // level the queued load goes down to
+};
+
+// counters since the streamer was made
+typedef struct
+{
+	int streams;             // textures registered
+	long long loads;         // levels copied in by the jobs
+	long long evictions;     // levels freed for the budget
+	long long misses;        // updates where a sampled level didn't fit the budget
+}texture_stream_stats_t;
+
+struct texture_streamer_t
+{
+	size_t budget;           // bytes the copies may take, the tails included
+	size_t resident;         // bytes of the copies, queued loads included
+	unsigned long long frame;
+	std::vector<texture_stream_t*> streams;
+	job_counter_t jobs;      // the load jobs
+	std::atomic<long long> loads;
+	texture_stream_stats_t stats;
+};
+
+texture_streamer_t* texture_streamer_create(size_t budget);
+
+// waits for the loads and frees every copy, the textures of the streams must not be sampled afterwards
+void texture_streamer_destory(texture_streamer_t* streamer);
+
+// stream t, a view of a mapped texture file. the tail is copied at once and t->stream is set, so the
+// s_texture copies made of t afterwards are streamed too
+void texture_streamer_add(texture_streamer_t* streamer, s_texture* t);
+
+// take the levels the last frame sampled, free the least recently sampled levels the budget needs and
+// queue the loads. only while no texture of the streamer is sampled
+void texture_streamer_update(texture_streamer_t* streamer);
+
+// wait for the queued loads
+void texture_streamer_wait(texture_streamer_t* streamer);
+
+texture_stream_stats_t texture_streamer_stats(texture_streamer_t* streamer);
+
+// the texels texture_read samples for level k or a coarser one, k becomes the level it is. records k
+// as sampled
+inline const IUINT32* texture_stream_level(texture_stream_t* stream, int& k)
+{
+	// a lost race only delays the load by a frame
+	if (k < stream->wanted.load(std::memory_order_relaxed)) stream->wanted.store(k, std::memory_order_relaxed);
+	int resident = stream->resident.load(std::memory_order_acquire);
+	if (k < resident) k = resident;
+	return stream->level[k].load(std::memory_order_relaxed);
+}
+
+#endif
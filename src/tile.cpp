@@ -0,0 +1,214 @@
+#include "tile.h"
+#include "job.h"
+#include "gbuffer.h"
+#include "hdr.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+// the sub-arena of the thread shading tiles, see tile_arena
+static thread_local arena_t* tile_thread_arena = NULL;
+static thread_local const tile_target_t* tile_thread_target = NULL;
+
+// the shaders write colour in these passes, the others only touch depth, the G-buffer or the HDR colour.
+// the tiles don't overlap, so the HDR colour is written in place
+static bool tile_writes_color(const device_t* device)
+{
+	if (device->shadow_pass || device->raster_pass == RASTER_PASS_DEPTH || hdr_active(device->hdr)) return false;
+	return device->gbuffer == NULL || !device->gbuffer->active;
+}
+
+// copy the rows [y0, y1) of columns [x0, x1) between the framebuffer and the block of target
+static void tile_copy(surface_t* color, const tile_target_t* target, int x1, int y1, bool store)
+{
+	size_t bytes = (size_t)(x1 - target->x0) * sizeof(IUINT32);
+	for (int y = target->y0; y < y1; y++)
+	{
+		IUINT32* row = surface_row_u32(color, y) + target->x0;
+		IUINT32* block = surface_row_u32(target->color, y - target->y0);
+		if (store) memcpy(row, block, bytes);
+		else memcpy(block, row, bytes);
+	}
+}
+
+// job of tile_context_flush, tiles [begin, end) in row order
+static void tile_shade_tiles(void* data, int begin, int end)
+{
+	tile_context_t* ctx = (tile_context_t*)data;
+	device_t* device = ctx->device;
+	// a job waiting for another flush may run this one in between, so the arena is put back
+	arena_t* outer = tile_thread_arena;
+	const tile_target_t* outer_target = tile_thread_target;
+	int thread = job_thread_index(job_system());
+	tile_thread_arena = ctx->arenas[thread];
+	tile_target_t target;
+	target.color = ctx->blocks[thread];
+	bool color = tile_writes_color(device);
+	for (int t = begin; t < end; t++)
+	{
+		int x0 = (t % ctx->tiles_x) * TILE_SIZE;
+		int y0 = (t / ctx->tiles_x) * TILE_SIZE;
+		int x1 = std::min(x0 + TILE_SIZE, device->width);
+		int y1 = std::min(y0 + TILE_SIZE, device->height);
+		if (ctx->bins[t].head == NULL) continue;
+		target.x0 = x0;
+		target.y0 = y0;
+		if (color)
+		{
+			// the block starts as what the earlier draws left in the framebuffer
+			tile_copy(device->color, &target, x1, y1, false);
+			tile_thread_target = &target;
+		}
+		for (tile_chunk_t* chunk = ctx->bins[t].head; chunk != NULL; chunk = chunk->next)
+		{
+			for (int i = 0; i < chunk->n; i++)
+			{
+				tile_tri_t* tri = chunk->tris[i];
+				if (tri->n == 0)
+				{
+					device_render_edge_rect(device, tile_tri_edge(tri), tri->ffs, tri->count, x0, y0, x1, y1);
+					continue;
+				}
+				s_vector* point = tile_tri_points(tri);
+				for (int k = 0; k < tri->n; k++)
+				{
+					// the trapezoid is copied because the scanline walk writes into its edges
+					trapezoid_t trap = tile_tri_traps(tri)[k];
+					device_render_trap_rect(device, &trap, point[0], point[1], point[2], tri->ffs, tri->count, x0, y0, x1, y1);
+				}
+			}
+		}
+		if (color)
+		{
+			tile_thread_target = outer_target;
+			tile_copy(device->color, &target, x1, y1, true);
+		}
+	}
+	tile_thread_arena = outer;
+}
+
+tile_context_t* tile_context_create(int threads, int width, int height)
+{
+	tile_context_t* ctx = new tile_context_t;
+	ctx->threads = threads == 1 ? 1 : job_system()->threads;
+	ctx->tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+	ctx->tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+	ctx->recording = 0;
+	ctx->arena = arena_create(ARENA_BLOCK);
+	ctx->triangles = 0;
+	tile_bin_t empty = { NULL, NULL };
+	ctx->bins.assign(ctx->tiles_x * ctx->tiles_y, empty);
+	ctx->device = NULL;
+	for (int i = 0; i < job_system()->threads; i++)
+	{
+		ctx->arenas.push_back(arena_create(ARENA_BLOCK));
+		ctx->blocks.push_back(surface_create(TILE_SIZE, TILE_SIZE, SURFACE_FORMAT_XRGB32, NULL, 0));
+	}
+	return ctx;
+}
+
+void tile_context_destory(tile_context_t* ctx)
+{
+	if (ctx == NULL) return;
+	for (size_t i = 0; i < ctx->arenas.size(); i++) arena_destory(ctx->arenas[i]);
+	for (size_t i = 0; i < ctx->blocks.size(); i++) surface_destory(ctx->blocks[i]);
+	arena_destory(ctx->arena);
+	delete ctx;
+}
+
+void tile_context_push(tile_context_t* ctx, trapezoid_t* traps, int n, s_vector& point1, s_vector& point2, s_vector& point3, for_fs* ffs, int count, edge_triangle_t* edge)
+{
+	if (n <= 0) return;
+	float minx = 1e30f, maxx = -1e30f;
+	for (int k = 0; k < n; k++)
+	{
+		edge_t* e[2] = { &traps[k].left, &traps[k].right };
+		for (int s = 0; s < 2; s++)
+		{
+			minx = std::min(minx, std::min(e[s]->v1.pos.x, e[s]->v2.pos.x));
+			maxx = std::max(maxx, std::max(e[s]->v1.pos.x, e[s]->v2.pos.x));
+		}
+	}
+
+	// same rounding as device_render_trap / trapezoid_init_scan_line, widened by one pixel
+	int top = (int)(traps[0].top + 0.5f);
+	int bottom = (int)(traps[n - 1].bottom + 0.5f);
+	int left = (int)floorf(minx) - 1;
+	int right = (int)ceilf(maxx) + 1;
+	if (edge != NULL)
+	{
+		top = edge->min_y; bottom = edge->max_y + 1;
+		left = edge->min_x; right = edge->max_x;
+	}
+	int max_x = ctx->tiles_x * TILE_SIZE - 1, max_y = ctx->tiles_y * TILE_SIZE - 1;
+	if (bottom <= 0 || top > max_y || right < 0 || left > max_x) return;
+	top = std::max(top, 0); bottom = std::min(bottom, max_y + 1);
+	left = std::max(left, 0); right = std::min(right, max_x);
+	if (top >= bottom) return;
+
+	size_t tail = edge != NULL ? sizeof(edge_triangle_t) : sizeof(s_vector) * 3 + sizeof(trapezoid_t) * n;
+	tile_tri_t* tri = (tile_tri_t*)arena_alloc(ctx->arena, sizeof(tile_tri_t) + tail);
+	for (int i = 0; i < 3; i++) tri->ffs[i] = ffs[i];
+	tri->count = count;
+	if (edge != NULL)
+	{
+		tri->n = 0;
+		*tile_tri_edge(tri) = *edge;
+	}
+	else
+	{
+		tri->n = n;
+		s_vector* point = tile_tri_points(tri);
+		point[0] = point1;
+		point[1] = point2;
+		point[2] = point3;
+		for (int k = 0; k < n; k++) tile_tri_traps(tri)[k] = traps[k];
+	}
+	ctx->triangles++;
+	for (int ty = top / TILE_SIZE; ty <= (bottom - 1) / TILE_SIZE; ty++)
+	{
+		for (int tx = left / TILE_SIZE; tx <= right / TILE_SIZE; tx++)
+		{
+			tile_bin_t* bin = &ctx->bins[ty * ctx->tiles_x + tx];
+			if (bin->tail == NULL || bin->tail->n == TILE_BIN_CHUNK)
+			{
+				tile_chunk_t* chunk = arena_array<tile_chunk_t>(ctx->arena, 1);
+				chunk->next = NULL;
+				chunk->n = 0;
+				if (bin->tail != NULL) bin->tail->next = chunk;
+				else bin->head = chunk;
+				bin->tail = chunk;
+			}
+			bin->tail->tris[bin->tail->n++] = tri;
+		}
+	}
+}
+
+void tile_context_flush(tile_context_t* ctx, device_t* device)
+{
+	if (ctx->triangles == 0) return;
+	ctx->device = device;
+	int total = ctx->tiles_x * ctx->tiles_y;
+	// one tile per job, the cost of a tile varies too much for larger ones
+	if (ctx->threads == 1) tile_shade_tiles(ctx, 0, total);
+	else job_parallel_for(job_system(), 0, total, 1, tile_shade_tiles, ctx);
+	ctx->triangles = 0;
+	tile_bin_t empty = { NULL, NULL };
+	ctx->bins.assign(ctx->bins.size(), empty);
+	arena_reset(ctx->arena);
+}
+
+void tile_context_reset_arenas(tile_context_t* ctx)
+{
+	for (size_t i = 0; i < ctx->arenas.size(); i++) arena_reset(ctx->arenas[i]);
+}
+
+arena_t* tile_arena()
+{
+	return tile_thread_arena;
+}
+
+const tile_target_t* tile_target()
+{
+	return tile_thread_target;
+}
@@ -0,0 +1,102 @@
+#ifndef tile_h
+#define tile_h
+//=====================================================================
+// tile binning: triangles are set up once, binned into screen tiles
+// and every tile is shaded by exactly one worker, so no locks are
+// needed on framebuffer/zbuffer. a worker shades the colour of its tile
+// into a TILE_SIZE x TILE_SIZE block of its own, contiguous and hot in
+// the cache, instead of TILE_SIZE rows of the framebuffer a pitch apart,
+// and copies the block back into the framebuffer when the tile is done.
+//=====================================================================
+#include "render.h"
+#include "arena.h"
+#include <vector>
+
+#define TILE_SIZE 64
+#define TILE_BIN_CHUNK 30        // triangles per link of a bin list
+
+// a set-up triangle as binned, allocated in the arena of the tile context with only the data of its
+// walk behind it: the edge_triangle_t of RASTER_MODE_EDGE (edge equations, depth and 1/w planes), or
+// for the scanline walk the clip space corners and n trapezoids. the vertex attributes are kept as
+// they are, the walks weight them with the barycentric coordinates of the pixel
+typedef struct
+{
+	for_fs ffs[3];
+	int count;               // material index passed to f_shader
+	int n;                   // trapezoids from trapezoid_init_triangle, 0 for the edge walk
+}tile_tri_t;
+
+static inline edge_triangle_t* tile_tri_edge(tile_tri_t* tri)
+{
+	return (edge_triangle_t*)(tri + 1);
+}
+
+// clip space positions used by the barycentric step of the scanline walk
+static inline s_vector* tile_tri_points(tile_tri_t* tri)
+{
+	return (s_vector*)(tri + 1);
+}
+
+static inline trapezoid_t* tile_tri_traps(tile_tri_t* tri)
+{
+	return (trapezoid_t*)(tile_tri_points(tri) + 3);
+}
+
+// one link of the triangles of a tile, in submit order
+typedef struct tile_chunk_t
+{
+	struct tile_chunk_t* next;
+	int n;
+	tile_tri_t* tris[TILE_BIN_CHUNK];
+}tile_chunk_t;
+
+typedef struct
+{
+	tile_chunk_t* head;
+	tile_chunk_t* tail;
+}tile_bin_t;
+
+// the colour block a thread shades its tile into, see tile_target
+typedef struct
+{
+	surface_t* color;        // XRGB32 TILE_SIZE x TILE_SIZE, rows TILE_SIZE * 4 bytes apart
+	int x0, y0;              // framebuffer pixel of its (0, 0)
+}tile_target_t;
+
+struct tile_context_t
+{
+	int threads;
+	int tiles_x, tiles_y;
+	int recording;
+	arena_t* arena;                        // the records and bin links until the next flush
+	int triangles;                         // binned since the last flush
+	std::vector<tile_bin_t> bins;          // per tile
+	std::vector<arena_t*> arenas;          // one per thread of the job system, by job_thread_index
+	std::vector<surface_t*> blocks;        // colour blocks of the tile targets, likewise
+	device_t* device;                      // of the flush
+};
+
+// threads 1 shades the tiles on the thread calling tile_context_flush, any other count spreads
+// them over the workers of the shared job system, whose size follows the hardware
+tile_context_t* tile_context_create(int threads, int width, int height);
+
+void tile_context_destory(tile_context_t* ctx);
+
+// bin one set-up triangle, its bounding box is taken from the trapezoids.
+// edge may be NULL, otherwise the tile is rasterized with edge functions
+void tile_context_push(tile_context_t* ctx, trapezoid_t* traps, int n, s_vector& point1, s_vector& point2, s_vector& point3, for_fs* ffs, int count, edge_triangle_t* edge);
+
+// shade every binned tile in parallel, then empty the bins
+void tile_context_flush(tile_context_t* ctx, device_t* device);
+
+// with device_clear: empty the arenas of the shading threads
+void tile_context_reset_arenas(tile_context_t* ctx);
+
+// the arena of the calling thread while it shades tiles, NULL outside tile_context_flush
+arena_t* tile_arena();
+
+// the block the calling thread shades the colour of its tile into, NULL outside tile_context_flush
+// and in the passes that write no colour
+const tile_target_t* tile_target();
+
+#endif
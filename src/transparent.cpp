@@ -0,0 +1,113 @@
+#include "transparent.h"
+#include <cstring>
+
+transparent_list_t* transparent_list_create()
+{
+	return new transparent_list_t;
+}
+
+void transparent_list_destory(transparent_list_t* list)
+{
+	delete list;
+}
+
+void transparent_list_clear(transparent_list_t* list)
+{
+	list->tris.clear();
+	list->draws.clear();
+	list->keys.clear();
+}
+
+// map a float to an unsigned key with the same order, negative values included
+static inline IUINT32 float_sort_key(float f)
+{
+	IUINT32 u;
+	memcpy(&u, &f, sizeof(u));
+	return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+void transparent_list_push(transparent_list_t* list, device_t* device, vertex_t* mesh, int num)
+{
+	if (num < 3) return;
+	transparent_draw_t draw;
+	draw.world = device->transform.world;
+	draw.pbr = device->PBR;
+	int index = (int)list->draws.size();
+	list->draws.push_back(draw);
+	for (int i = 0; i + 2 < num; i += 3)
+	{
+		transparent_tri_t tri;
+		for (int k = 0; k < 3; k++) tri.v[k] = mesh[i + k];
+		tri.draw = index;
+		tri.count = mesh[i].material_idex;
+		// the view depth of the centroid, farther triangles get smaller keys
+		s_vector c((mesh[i].pos.x + mesh[i + 1].pos.x + mesh[i + 2].pos.x) / 3.0f,
+			(mesh[i].pos.y + mesh[i + 1].pos.y + mesh[i + 2].pos.y) / 3.0f,
+			(mesh[i].pos.z + mesh[i + 1].pos.z + mesh[i + 2].pos.z) / 3.0f, 1.0f);
+		s_vector world, view;
+		apply_to_vector(world, c, device->transform.world);
+		apply_to_vector(view, world, device->transform.view);
+		list->tris.push_back(tri);
+		list->keys.push_back(~float_sort_key(view.z));
+	}
+}
+
+void radix_sort_keys(IUINT32* keys, int* order, IUINT32* key_temp, int* order_temp, int n)
+{
+	IUINT32* src_key = keys, *dst_key = key_temp;
+	int* src = order, *dst = order_temp;
+	for (int shift = 0; shift < 32; shift += 8)
+	{
+		int offset[257];
+		memset(offset, 0, sizeof(offset));
+		for (int i = 0; i < n; i++) offset[((src_key[i] >> shift) & 0xff) + 1]++;
+		for (int b = 0; b < 256; b++) offset[b + 1] += offset[b];
+		for (int i = 0; i < n; i++)
+		{
+			int slot = offset[(src_key[i] >> shift) & 0xff]++;
+			dst_key[slot] = src_key[i];
+			dst[slot] = src[i];
+		}
+		IUINT32* tk = src_key; src_key = dst_key; dst_key = tk;
+		int* t = src; src = dst; dst = t;
+	}
+	// an even number of passes leaves the result in keys and order
+}
+
+void transparent_list_flush(transparent_list_t* list, device_t* device)
+{
+	int n = (int)list->tris.size();
+	if (n == 0) return;
+	list->order.resize(n);
+	list->key_temp.resize(n);
+	list->order_temp.resize(n);
+	for (int i = 0; i < n; i++) list->order[i] = i;
+	radix_sort_keys(&list->keys[0], &list->order[0], &list->key_temp[0], &list->order_temp[0], n);
+
+	s_matrix world = device->transform.world;
+	s_PBR pbr = device->PBR;
+	device->raster_pass = RASTER_PASS_BLEND;
+	int draw = -1;
+	for (int i = 0; i < n; i++)
+	{
+		transparent_tri_t* tri = &list->tris[list->order[i]];
+		if (tri->draw != draw)
+		{
+			// the tiles are shaded with the device state of their draw, so flush them before it changes
+			if (draw >= 0) device_tile_end(device);
+			draw = tri->draw;
+			device->transform.world = list->draws[draw].world;
+			device->transform.update();
+			device->PBR = list->draws[draw].pbr;
+			device_tile_begin(device);
+		}
+		vertex_t p1 = tri->v[0], p2 = tri->v[1], p3 = tri->v[2];
+		device_draw_primitive(device, &p1, &p2, &p3, tri->count);
+	}
+	device_tile_end(device);
+	device->raster_pass = RASTER_PASS_COLOR;
+	device->transform.world = world;
+	device->transform.update();
+	device->PBR = pbr;
+	transparent_list_clear(list);
+}
@@ -0,0 +1,49 @@
+#ifndef transparent_h
+#define transparent_h
+//=====================================================================
+// sorted transparency: blended triangles are queued during the frame,
+// radix sorted back to front by view depth and drawn after all opaque
+// geometry without writing the zbuffer.
+//=====================================================================
+#include "render.h"
+#include <vector>
+
+typedef struct
+{
+	vertex_t v[3];           // model space, as passed to device_draw_primitive
+	int draw;                // index into transparent_list_t::draws
+	int count;               // material index passed to f_shader
+}transparent_tri_t;
+
+typedef struct
+{
+	s_matrix world;          // device->transform.world of the queued draw
+	s_PBR pbr;
+}transparent_draw_t;
+
+struct transparent_list_t
+{
+	std::vector<transparent_tri_t> tris;
+	std::vector<transparent_draw_t> draws;
+	std::vector<IUINT32> keys;          // per triangle, ascending order is back to front
+	std::vector<int> order;             // sorted triangle indices
+	std::vector<IUINT32> key_temp;      // radix sort ping-pong buffers
+	std::vector<int> order_temp;
+};
+
+transparent_list_t* transparent_list_create();
+
+void transparent_list_destory(transparent_list_t* list);
+
+void transparent_list_clear(transparent_list_t* list);
+
+// queue num / 3 triangles with the current world transform and PBR parameters
+void transparent_list_push(transparent_list_t* list, device_t* device, vertex_t* mesh, int num);
+
+// stable LSD radix sort of order[0..n) by keys, 8 bits per pass
+void radix_sort_keys(IUINT32* keys, int* order, IUINT32* key_temp, int* order_temp, int n);
+
+// draw the queued triangles back to front with RASTER_PASS_BLEND, then empty the list
+void transparent_list_flush(transparent_list_t* list, device_t* device);
+
+#endif
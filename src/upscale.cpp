@@ -0,0 +1,132 @@
+#include "upscale.h"
+#include <cmath>
+#include <vector>
+
+// one output column or row: the two source ones around its center and the weight of the second, 0..256
+typedef struct
+{
+	int i0, i1;
+	int f;
+}upscale_tap_t;
+
+static void upscale_taps(std::vector<upscale_tap_t>& taps, int dst, int src)
+{
+	taps.resize(dst);
+	float step = (float)src / (float)dst;
+	for (int i = 0; i < dst; i++)
+	{
+		float s = ((float)i + 0.5f) * step - 0.5f;
+		if (s < 0.0f) s = 0.0f;
+		int i0 = (int)s;
+		if (i0 > src - 1) i0 = src - 1;
+		taps[i].i0 = i0;
+		taps[i].i1 = i0 + 1 < src ? i0 + 1 : i0;
+		taps[i].f = (int)((s - (float)i0) * 256.0f + 0.5f);
+	}
+}
+
+// a + (b - a) * f / 256 for all three channels, red and blue share one multiply
+static inline IUINT32 upscale_lerp(IUINT32 a, IUINT32 b, int f)
+{
+	IUINT32 rb = ((a & 0xff00ff) * (IUINT32)(256 - f) + (b & 0xff00ff) * (IUINT32)f) >> 8;
+	IUINT32 g = ((a & 0xff00) * (IUINT32)(256 - f) + (b & 0xff00) * (IUINT32)f) >> 8;
+	return (rb & 0xff00ff) | (g & 0xff00);
+}
+
+static inline int upscale_luma(IUINT32 c)
+{
+	return (int)((((c >> 16) & 0xff) * 77 + ((c >> 8) & 0xff) * 150 + (c & 0xff) * 29) >> 8);
+}
+
+// bilinear weights w[4] of p[4], each divided by how far its luma is from the tap with the largest weight
+static IUINT32 upscale_edge_pixel(const IUINT32* p, float* w)
+{
+	int nearest = 0;
+	for (int k = 1; k < 4; k++) if (w[k] > w[nearest]) nearest = k;
+	int reference = upscale_luma(p[nearest]);
+	float sum = 0.0f, r = 0.0f, g = 0.0f, b = 0.0f;
+	for (int k = 0; k < 4; k++)
+	{
+		float d = (float)(upscale_luma(p[k]) - reference);
+		float weight = w[k] / (1.0f + d * d * (1.0f / 1024.0f));
+		r += weight * (float)((p[k] >> 16) & 0xff);
+		g += weight * (float)((p[k] >> 8) & 0xff);
+		b += weight * (float)(p[k] & 0xff);
+		sum += weight;
+	}
+	float inv = 1.0f / sum;
+	int R = (int)(r * inv + 0.5f), G = (int)(g * inv + 0.5f), B = (int)(b * inv + 0.5f);
+	return (IUINT32)((R << 16) | (G << 8) | B);
+}
+
+void surface_upscale(surface_t* dst, const surface_t* src, int filter)
+{
+	std::vector<upscale_tap_t> xs, ys;
+	upscale_taps(xs, dst->width, src->width);
+	upscale_taps(ys, dst->height, src->height);
+	for (int y = 0; y < dst->height; y++)
+	{
+		const upscale_tap_t& ty = ys[y];
+		const IUINT32* row0 = surface_row_u32(src, ty.i0);
+		const IUINT32* row1 = surface_row_u32(src, ty.i1);
+		IUINT32* out = surface_row_u32(dst, y);
+		if (filter == UPSCALE_EDGE)
+		{
+			float fy = (float)ty.f * (1.0f / 256.0f);
+			for (int x = 0; x < dst->width; x++)
+			{
+				const upscale_tap_t& tx = xs[x];
+				float fx = (float)tx.f * (1.0f / 256.0f);
+				IUINT32 p[4] = { row0[tx.i0], row0[tx.i1], row1[tx.i0], row1[tx.i1] };
+				float w[4] = { (1.0f - fx) * (1.0f - fy), fx * (1.0f - fy), (1.0f - fx) * fy, fx * fy };
+				out[x] = upscale_edge_pixel(p, w);
+			}
+			continue;
+		}
+		for (int x = 0; x < dst->width; x++)
+		{
+			const upscale_tap_t& tx = xs[x];
+			IUINT32 top = upscale_lerp(row0[tx.i0], row0[tx.i1], tx.f);
+			IUINT32 bottom = upscale_lerp(row1[tx.i0], row1[tx.i1], tx.f);
+			out[x] = upscale_lerp(top, bottom, ty.f);
+		}
+	}
+}
+
+void render_scale_control_init(render_scale_control_t* control, float target_ms, float min_scale, float max_scale)
+{
+	control->target_ms = target_ms;
+	control->min_scale = min_scale < RENDER_SCALE_MIN ? RENDER_SCALE_MIN : min_scale;
+	control->max_scale = max_scale > 1.0f ? 1.0f : max_scale;
+	control->scale = control->max_scale;
+	control->average_ms = 0.0f;
+	control->settle = 0;
+}
+
+float render_scale_control_update(render_scale_control_t* control, float frame_ms)
+{
+	if (control->average_ms <= 0.0f) control->average_ms = frame_ms;
+	else control->average_ms = control->average_ms * 0.8f + frame_ms * 0.2f;
+	if (control->settle > 0)
+	{
+		control->settle--;
+		return control->scale;
+	}
+	// a band around the target keeps the scale from flickering between two sizes
+	float ratio = control->target_ms / control->average_ms;
+	if (ratio > 0.9f && ratio < 1.1f) return control->scale;
+	float scale = control->scale * sqrtf(ratio);
+	// drop fast when too slow, grow slowly when there is room
+	if (scale > control->scale + 0.05f) scale = control->scale + 0.05f;
+	if (scale < control->scale - 0.25f) scale = control->scale - 0.25f;
+	// steps of 1/32, so the render target is not resized for every small change
+	scale = floorf(scale * 32.0f + 0.5f) / 32.0f;
+	if (scale < control->min_scale) scale = control->min_scale;
+	if (scale > control->max_scale) scale = control->max_scale;
+	if (scale == control->scale) return scale;
+	// expect the cost of the new size, the frames that follow correct it
+	control->average_ms *= (scale * scale) / (control->scale * control->scale);
+	control->scale = scale;
+	control->settle = 8;
+	return scale;
+}
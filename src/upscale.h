@@ -0,0 +1,34 @@
+#ifndef upscale_h
+#define upscale_h
+//=====================================================================
+// resolution scaled rendering: the device draws into a color surface
+// smaller than the output, device_present scales it up with one of
+// the filters below. render_scale_control_t picks the scale of the
+// next frame from the time the last ones took.
+//=====================================================================
+#include "surface.h"
+
+#define UPSCALE_BILINEAR 0  // four source pixels weighted by distance
+#define UPSCALE_EDGE     1  // bilinear, pixels far in luma from the nearest one lose weight, keeps edges sharp
+
+#define RENDER_SCALE_MIN 0.25f
+
+// fill dst from src, both XRGB32. the pixel centers line up, so a 1:1 copy is exact
+void surface_upscale(surface_t* dst, const surface_t* src, int filter);
+
+// automatic render scale: pixel cost is taken as proportional to the scale squared
+typedef struct
+{
+	float target_ms;         // frame time to hold
+	float min_scale, max_scale;
+	float scale;             // render scale of the next frame
+	float average_ms;        // smoothed frame time, 0 before the first frame
+	int settle;              // frames left before the scale may change again
+}render_scale_control_t;
+
+void render_scale_control_init(render_scale_control_t* control, float target_ms, float min_scale, float max_scale);
+
+// feed the time of the frame just drawn, returns the scale of the next one
+float render_scale_control_update(render_scale_control_t* control, float frame_ms);
+
+#endif